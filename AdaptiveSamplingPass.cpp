@@ -0,0 +1,119 @@
+#include "AdaptiveSamplingPass.h"
+#include "PassProfiler.h"
+
+using namespace Falcor;
+
+namespace
+{
+    // Must match AdaptiveSampling.slang
+    const uint32_t kTileSize = 16;
+
+    // SVGF keeps the moments of luminance(float3(v, 0, 0)) for scalar signals
+    const float kScalarLuminance = 0.2126f;
+}
+
+AdaptiveSamplingPass::AdaptiveSamplingPass(uint32_t width, uint32_t height, SVGFPass::SignalType signalType, TexturePool::SharedPtr texturePool)
+    : mTexturePool(texturePool),
+      mSignalType(signalType),
+      mMaxRaysPerPixel(4),
+      mTargetStdDev(0.02f),
+      mMinHistoryLength(4),
+      mRefreshInterval(8)
+{
+    Program::DefineList defines;
+    if (signalType == SVGFPass::SignalType::Scalar) defines.add("SCALAR_SIGNAL");
+
+    mSamplingProgram = ComputeProgram::createFromFile("AdaptiveSampling.slang", "main", defines);
+    mSamplingVars = ComputeVars::create(mSamplingProgram->getReflector());
+    mSamplingState = ComputeState::create();
+    mSamplingState->setProgram(mSamplingProgram);
+
+    Resize(width, height);
+}
+
+AdaptiveSamplingPass::~AdaptiveSamplingPass()
+{
+    ReleaseTargets();
+}
+
+void AdaptiveSamplingPass::Resize(uint32_t width, uint32_t height)
+{
+    if (mRayCounts && mRayCounts->getWidth() == width && mRayCounts->getHeight() == height) return;
+
+    ReleaseTargets();
+
+    const Resource::BindFlags bindFlags = Resource::BindFlags::UnorderedAccess | Resource::BindFlags::ShaderResource;
+    mRayCounts = mTexturePool->Acquire(width, height, ResourceFormat::R8Uint, bindFlags);
+    mPrevRayCounts = mTexturePool->Acquire(width, height, ResourceFormat::R8Uint, bindFlags);
+
+    // Room for every pixel. Buffers are not pooled, they only change with the size.
+    mWorkList = Buffer::create(size_t(width) * height * sizeof(uint32_t), bindFlags, Buffer::CpuAccess::None);
+    mWorkListCount = Buffer::create(sizeof(uint32_t), bindFlags, Buffer::CpuAccess::None);
+}
+
+void AdaptiveSamplingPass::ReleaseTargets()
+{
+    mTexturePool->Release(mRayCounts);
+    mTexturePool->Release(mPrevRayCounts);
+    mRayCounts = nullptr;
+    mPrevRayCounts = nullptr;
+}
+
+void AdaptiveSamplingPass::Execute(
+    RenderContext* renderContext,
+    const SVGFSharedHistory& history,
+    const SVGFPass& filter,
+    Texture::SharedPtr motionVec,
+    Texture::SharedPtr linearZ,
+    uint32_t frameCount)
+{
+    PROFILE_PASS("AdaptiveSampling");
+
+    std::swap(mRayCounts, mPrevRayCounts);
+
+    // Frames in the exponential moving average of the reprojection once the history is long enough
+    const float alpha = filter.GetAlpha();
+    const float maxEffectiveFrames = alpha > 0.0f ? (2.0f - alpha) / alpha : 1e30f;
+    const float targetStdDev = mTargetStdDev * (mSignalType == SVGFPass::SignalType::Scalar ? kScalarLuminance : 1.0f);
+
+    mSamplingVars->setTexture("gMotion", motionVec);
+    mSamplingVars->setTexture("gLinearZ", linearZ);
+    mSamplingVars->setTexture("gHistoryLength", history.GetHistoryLength());
+    mSamplingVars->setTexture("gLastFiltered", filter.GetLastFiltered());
+    mSamplingVars->setTexture("gPrevRayCount", mPrevRayCounts);
+    mSamplingVars->setTexture("gRayCount", mRayCounts);
+    mSamplingVars->setRawBuffer("gWorkList", mWorkList);
+    mSamplingVars->setRawBuffer("gWorkListCount", mWorkListCount);
+
+    mSamplingVars["PerPassCB"]["gMaxRaysPerPixel"] = std::min(mMaxRaysPerPixel, kMaxRaysPerPixel);
+    mSamplingVars["PerPassCB"]["gTargetVariance"] = std::max(1e-12f, targetStdDev * targetStdDev);
+    mSamplingVars["PerPassCB"]["gMaxEffectiveFrames"] = maxEffectiveFrames;
+    mSamplingVars["PerPassCB"]["gMinHistoryLength"] = float(mMinHistoryLength);
+    mSamplingVars["PerPassCB"]["gRefreshInterval"] = std::max(1u, mRefreshInterval);
+    mSamplingVars["PerPassCB"]["gFrameCount"] = frameCount;
+    mSamplingVars["PerPassCB"]["gUseHistory"] = filter.HasValidHistory() && filter.IsTemporalReprojectionEnabled();
+
+    renderContext->clearUAV(mWorkListCount->getUAV().get(), uvec4(0));
+
+    const uint32_t groupsX = (mRayCounts->getWidth() + kTileSize - 1) / kTileSize;
+    const uint32_t groupsY = (mRayCounts->getHeight() + kTileSize - 1) / kTileSize;
+
+    renderContext->pushComputeState(mSamplingState);
+    renderContext->pushComputeVars(mSamplingVars);
+    renderContext->dispatch(groupsX, groupsY, 1);
+    renderContext->popComputeVars();
+    renderContext->popComputeState();
+}
+
+size_t AdaptiveSamplingPass::GetAllocatedBytes() const
+{
+    return GetTextureSizeInBytes(mRayCounts) + GetTextureSizeInBytes(mPrevRayCounts) + mWorkList->getSize() + mWorkListCount->getSize();
+}
+
+void AdaptiveSamplingPass::RenderGui(Gui* gui)
+{
+    gui->addIntSlider("Max Rays Per Pixel", *reinterpret_cast<int32_t*>(&mMaxRaysPerPixel), 1, int32_t(kMaxRaysPerPixel));
+    gui->addFloatSlider("Target Std Dev", mTargetStdDev, 0.001f, 0.2f);
+    gui->addIntSlider("Min History Length", *reinterpret_cast<int32_t*>(&mMinHistoryLength), 1, 32);
+    gui->addIntSlider("Refresh Interval", *reinterpret_cast<int32_t*>(&mRefreshInterval), 1, 32);
+}
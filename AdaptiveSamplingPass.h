@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Falcor.h"
+#include "SVGFPass.h"
+#include "TexturePool.h"
+
+// Decides how many rays (0 to maxRaysPerPixel) every pixel of a full-res effect gets, from the variance its SVGF
+// filter kept last frame and the shared history length, and compacts the pixels that get any into a work list the
+// ray generation shaders trace instead of the launch grid. Runs after SVGFSharedHistory::Update and before tracing;
+// the filter then gets GetRayCounts() so that pixels without rays keep their history. Cpu::AdaptiveSampler is the
+// headless version.
+class AdaptiveSamplingPass
+{
+public:
+    using SharedPtr = std::shared_ptr<AdaptiveSamplingPass>;
+
+    // Must match Data/AdaptiveSampling.h, the ray count takes the top 4 bits of a work list entry
+    static const uint32_t kMaxRaysPerPixel = 15;
+
+    // signalType is that of the filter passed to Execute
+    AdaptiveSamplingPass(uint32_t width, uint32_t height, SVGFPass::SignalType signalType, TexturePool::SharedPtr texturePool);
+    ~AdaptiveSamplingPass();
+
+    // Reallocates the ray counts and the work list at the new size. Nothing happens at the current size.
+    void Resize(uint32_t width, uint32_t height);
+
+    void Execute(
+        Falcor::RenderContext* renderContext,
+        const SVGFSharedHistory& history,
+        const SVGFPass& filter,
+        Falcor::Texture::SharedPtr motionVec,
+        Falcor::Texture::SharedPtr linearZ,
+        uint32_t frameCount);
+
+    void RenderGui(Falcor::Gui* gui);
+
+    // R8Uint rays per pixel of the last Execute
+    Falcor::Texture::SharedPtr GetRayCounts() const { return mRayCounts; }
+
+    // Entries are x | y << 14 | rays << 28, their number is the first uint of GetWorkListCount()
+    Falcor::Buffer::SharedPtr GetWorkList() const { return mWorkList; }
+    Falcor::Buffer::SharedPtr GetWorkListCount() const { return mWorkListCount; }
+
+    size_t GetAllocatedBytes() const;
+
+private:
+    void ReleaseTargets();
+
+    Falcor::ComputeProgram::SharedPtr mSamplingProgram;
+    Falcor::ComputeVars::SharedPtr mSamplingVars;
+    Falcor::ComputeState::SharedPtr mSamplingState;
+
+    Falcor::Texture::SharedPtr mRayCounts;
+    Falcor::Texture::SharedPtr mPrevRayCounts;
+    Falcor::Buffer::SharedPtr mWorkList;
+    Falcor::Buffer::SharedPtr mWorkListCount;
+
+    TexturePool::SharedPtr mTexturePool;
+    SVGFPass::SignalType mSignalType;
+
+    uint32_t mMaxRaysPerPixel;
+    float mTargetStdDev;        // Of the accumulated signal, of its luminance for color signals
+    uint32_t mMinHistoryLength; // Younger pixels get mMaxRaysPerPixel
+    uint32_t mRefreshInterval;  // Pixels that need no rays still get one every this many frames
+};
@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include "Benchmarks.h"
+#include "../Cpu/AdaptiveSampling.h"
+#include "../Cpu/Bvh.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/RaytracedEffects.h"
+#include "../Cpu/SVGF.h"
+#include "../Cpu/SVGFSharedHistory.h"
+
+using namespace Cpu;
+
+namespace
+{
+    const float kAODistance = 3.0f;     // Same as the synthetic scene's analytic AO
+
+    enum class Effect : uint32_t
+    {
+        Shadows = 0,
+        Reflection,
+        AO,
+        Count
+    };
+
+    const uint32_t kEffectCount = uint32_t(Effect::Count);
+    const char* const kEffectNames[kEffectCount] = { "shadows", "reflection", "ao" };
+    const SVGFSignalType kSignalTypes[kEffectCount] = { SVGFSignalType::Scalar, SVGFSignalType::Color, SVGFSignalType::Scalar };
+
+    void Trace(RaytracedEffects& effects, Effect effect, const RtGBuffer& gBuffer, uint32_t frameCount, Image4F& output)
+    {
+        switch (effect)
+        {
+        case Effect::Shadows: effects.TraceShadows(gBuffer, RayScale::Full, frameCount, output); break;
+        case Effect::Reflection: effects.TraceReflection(gBuffer, RayScale::Full, frameCount, output); break;
+        default: effects.TraceAO(gBuffer, RayScale::Full, frameCount, kAODistance, output); break;
+        }
+    }
+
+    // Every pixel with the same number of rays
+    void BuildUniformWorkList(uint32_t width, uint32_t height, uint32_t rays, std::vector<uint32_t>& workList)
+    {
+        workList.clear();
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x) workList.push_back(x | (y << 14) | (rays << 28));
+        }
+    }
+
+    // Sum of squared rgb differences over the pixels with geometry, accumulated over frames
+    struct ErrorAccumulator
+    {
+        double sumSquared = 0.0;
+        double count = 0.0;
+
+        void Add(const Image4F& a, const Image4F& b, const Image4F& worldPosition)
+        {
+            for (size_t i = 0; i < a.GetPixelCount(); ++i)
+            {
+                if (worldPosition.GetData()[i].w == 0.0f) continue;
+                const float3 d = a.GetData()[i].rgb() - b.GetData()[i].rgb();
+                sumSquared += double(d.x) * d.x + double(d.y) * d.y + double(d.z) * d.z;
+                count += 3.0;
+            }
+        }
+
+        double GetRmse() const { return count > 0.0 ? std::sqrt(sumSquared / count) : 0.0; }
+    };
+
+    // One way of spending rays: the same number everywhere, or an AdaptiveSampler per effect. Each has its own
+    // denoisers, in the compact layout the app uses.
+    struct SamplingRun
+    {
+        std::string name;
+        uint32_t uniformRays = 0;       // 0 for adaptive
+        float targetStdDev = 0.0f;
+
+        std::unique_ptr<SVGFSharedHistory> history;
+        std::unique_ptr<SVGFPass> filters[kEffectCount];
+        std::unique_ptr<AdaptiveSampler> samplers[kEffectCount];
+        Image4F traced[kEffectCount];
+
+        uint64_t rays[kEffectCount] = {};
+        uint64_t samples[kEffectCount] = {};
+        double traceMs[kEffectCount] = {};
+        double samplerMs[kEffectCount] = {};
+        ErrorAccumulator error[kEffectCount];
+    };
+
+    // Uniform rays that reach `rmse`, interpolated log-log between the uniform runs. False outside their range.
+    bool GetEqualQualityRays(const std::vector<const SamplingRun*>& uniformRuns, uint32_t effect, double rmse, double& rays)
+    {
+        for (size_t i = 0; i + 1 < uniformRuns.size(); ++i)
+        {
+            const double rmse0 = uniformRuns[i]->error[effect].GetRmse();
+            const double rmse1 = uniformRuns[i + 1]->error[effect].GetRmse();
+            if (rmse > rmse0 || rmse < rmse1 || rmse0 <= 0.0 || rmse1 <= 0.0 || rmse0 == rmse1) continue;
+
+            const double rays0 = double(uniformRuns[i]->rays[effect]);
+            const double rays1 = double(uniformRuns[i + 1]->rays[effect]);
+            const double t = std::log(rmse / rmse0) / std::log(rmse1 / rmse0);
+            rays = std::exp(std::log(rays0) + t * (std::log(rays1) - std::log(rays0)));
+            return true;
+        }
+        return false;
+    }
+}
+
+int RunAdaptiveBench(const CommandLine& args)
+{
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolutions", "640x360");
+    const uint32_t frameCount = std::max(1u, args.GetUint("frames", 32));
+    const uint32_t warmupCount = args.GetUint("warmup", 8);
+    const uint32_t sphereSegments = args.GetUint("segments", 64);
+    const std::vector<uint32_t> uniformRays = args.GetUintList("uniform", "1,2,4");
+    const std::vector<std::string> targetNames = args.GetStringList("targets", "0.002,0.005,0.01,0.02");
+    const uint32_t maxRays = std::min(AdaptiveSampler::kMaxRaysPerPixel, std::max(1u, args.GetUint("max-rays", 4)));
+    const uint32_t referenceRays = std::max(1u, args.GetUint("reference-rays", 32));
+    const std::string outputPath = args.GetString("output", "");
+
+    ThreadPool threadPool(args.GetUint("threads", 0));
+
+    for (uint32_t rays : uniformRays)
+    {
+        if (rays == 0 || rays > AdaptiveSampler::kMaxRaysPerPixel)
+        {
+            fprintf(stderr, "Uniform rays have to be between 1 and %u\n", AdaptiveSampler::kMaxRaysPerPixel);
+            return 1;
+        }
+    }
+    std::vector<float> targets;
+    for (const std::string& name : targetNames)
+    {
+        const float target = float(std::atof(name.c_str()));
+        if (target <= 0.0f)
+        {
+            fprintf(stderr, "Invalid target '%s'\n", name.c_str());
+            return 1;
+        }
+        targets.push_back(target);
+    }
+
+    uint32_t failedChecks = 0;
+    auto check = [&](bool condition, const std::string& name, const char* message)
+    {
+        if (condition) return;
+        fprintf(stderr, "adaptive: %s: %s\n", name.c_str(), message);
+        failedChecks++;
+    };
+
+    SyntheticScene syntheticScene;
+    TriangleScene scene;
+    syntheticScene.BuildTriangleScene(sphereSegments, scene);
+    Bvh bvh;
+    bvh.Build(scene, BvhBuildSettings(), &threadPool);
+    RaytracedEffects effects(scene, bvh, threadPool);
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "adaptive");
+    json.Field("threads", threadPool.GetThreadCount());
+    json.Field("frames", frameCount);
+    json.Field("warmup", warmupCount);
+    json.Field("maxRaysPerPixel", maxRays);
+    json.Field("referenceRays", referenceRays);
+    json.Key("runs").BeginArray();
+
+    FrameData frame;
+    for (const Resolution& resolution : resolutions)
+    {
+        const std::string resolutionName = std::to_string(resolution.width) + "x" + std::to_string(resolution.height);
+        fprintf(stderr, "adaptive %s\n", resolutionName.c_str());
+
+        std::vector<std::unique_ptr<SamplingRun>> runs;
+        auto createRun = [&](const std::string& name, uint32_t rays, float target)
+        {
+            std::unique_ptr<SamplingRun> run(new SamplingRun());
+            run->name = name;
+            run->uniformRays = rays;
+            run->targetStdDev = target;
+            run->history.reset(new SVGFSharedHistory(resolution.width, resolution.height, &threadPool));
+            for (uint32_t e = 0; e < kEffectCount; ++e)
+            {
+                run->filters[e].reset(new SVGFPass(resolution.width, resolution.height, *run->history, kSignalTypes[e], &threadPool));
+                if (rays > 0) continue;
+                run->samplers[e].reset(new AdaptiveSampler(&threadPool));
+                run->samplers[e]->GetSettings().maxRaysPerPixel = maxRays;
+                run->samplers[e]->GetSettings().targetStdDev = target;
+            }
+            return run;
+        };
+        for (uint32_t rays : uniformRays) runs.push_back(createRun("uniform" + std::to_string(rays), rays, 0.0f));
+        for (size_t i = 0; i < targets.size(); ++i) runs.push_back(createRun("adaptive" + targetNames[i], 0, targets[i]));
+
+        // Denoised like the runs, so the error is the noise that makes it through the filter rather than its blur
+        const std::unique_ptr<SamplingRun> reference = createRun("reference", referenceRays, 0.0f);
+
+        std::vector<uint32_t> workList;
+        Image4F referencePass;
+        Image4F launch;
+        for (uint32_t frameIndex = 0; frameIndex < frameCount; ++frameIndex)
+        {
+            syntheticScene.RenderFrame(frameIndex, resolution.width, resolution.height, frame, threadPool);
+            const Image4F& motionVec = frame.Get(FrameTarget::MotionVector);
+            const Image4F& linearZ = frame.Get(FrameTarget::SVGF_LinearZ);
+            const Image4F& normalDepth = frame.Get(FrameTarget::SVGF_CompactNormDepth);
+
+            RtGBuffer gBuffer;
+            gBuffer.worldPosition = &frame.Get(FrameTarget::WorldPosition);
+            gBuffer.normalRoughness = &frame.Get(FrameTarget::NormalRoughness);
+            gBuffer.albedo = &frame.Get(FrameTarget::Albedo);
+            gBuffer.cameraPosition = syntheticScene.GetCameraPosition(frameIndex);
+
+            // The converged frame: passes of up to kMaxRaysPerPixel rays per pixel, seeds apart from the ones the runs draw
+            reference->history->Update(motionVec, linearZ);
+            for (uint32_t e = 0; e < kEffectCount; ++e)
+            {
+                Image4F& converged = reference->traced[e];
+                converged.Resize(resolution.width, resolution.height);
+                for (uint32_t first = 0, pass = 1; first < referenceRays; first += AdaptiveSampler::kMaxRaysPerPixel, ++pass)
+                {
+                    const uint32_t rays = std::min(AdaptiveSampler::kMaxRaysPerPixel, referenceRays - first);
+                    BuildUniformWorkList(resolution.width, resolution.height, rays, workList);
+                    effects.SetWorkList(&workList);
+                    Trace(effects, Effect(e), gBuffer, frameIndex + (pass << 20), referencePass);
+                    for (size_t i = 0; i < referencePass.GetPixelCount(); ++i)
+                    {
+                        converged.GetData()[i] += referencePass.GetData()[i] * (float(rays) / float(referenceRays));
+                    }
+                }
+                reference->filters[e]->Execute(converged, motionVec, linearZ, normalDepth);
+            }
+            reference->history->EndFrame(linearZ);
+
+            const bool measured = frameIndex >= warmupCount;
+
+            for (const auto& run : runs)
+            {
+                run->history->Update(motionVec, linearZ);
+                for (uint32_t e = 0; e < kEffectCount; ++e)
+                {
+                    const Image<uint8_t>* rayCounts = nullptr;
+                    if (run->samplers[e])
+                    {
+                        AdaptiveSampler& sampler = *run->samplers[e];
+                        sampler.Update(*run->history, *run->filters[e], motionVec, linearZ, frameIndex);
+                        effects.SetWorkList(&sampler.GetWorkList());
+                        rayCounts = &sampler.GetRayCounts();
+                        if (measured) run->samplerMs[e] += sampler.GetStats().elapsedMs;
+                        if (measured) run->samples[e] += sampler.GetStats().listedRays;
+
+                        uint64_t listedRays = 0;
+                        bool countsMatch = true;
+                        for (uint32_t entry : sampler.GetWorkList())
+                        {
+                            const uint32_t rays = AdaptiveSampler::GetWorkListRayCount(entry);
+                            listedRays += rays;
+                            countsMatch = countsMatch && rays > 0 && rays <= maxRays && rays == rayCounts->At(AdaptiveSampler::GetWorkListPixel(entry));
+                        }
+                        check(countsMatch && listedRays == sampler.GetStats().listedRays, resolutionName + " " + run->name + " " + kEffectNames[e],
+                            "the work list does not match the ray counts");
+                    }
+                    else
+                    {
+                        BuildUniformWorkList(resolution.width, resolution.height, run->uniformRays, workList);
+                        effects.SetWorkList(&workList);
+                        if (measured) run->samples[e] += uint64_t(run->uniformRays) * resolution.width * resolution.height;
+                    }
+
+                    Trace(effects, Effect(e), gBuffer, frameIndex, run->traced[e]);
+                    if (measured) run->rays[e] += effects.GetLastStats().rays;
+                    if (measured) run->traceMs[e] += effects.GetLastStats().elapsedMs;
+
+                    // One ray from the work list has to be what a launch traces
+                    if (frameIndex == 0 && run->uniformRays == 1)
+                    {
+                        effects.SetWorkList(nullptr);
+                        Trace(effects, Effect(e), gBuffer, frameIndex, launch);
+                        check(std::memcmp(launch.GetData(), run->traced[e].GetData(), launch.GetSizeInBytes()) == 0,
+                            resolutionName + " " + run->name + " " + kEffectNames[e], "one ray per pixel differs from the launch grid");
+                    }
+
+                    const Image4F& denoised = run->filters[e]->Execute(run->traced[e], motionVec, linearZ, normalDepth, rayCounts);
+                    if (measured) run->error[e].Add(denoised, reference->filters[e]->GetOutput(), *gBuffer.worldPosition);
+                }
+                run->history->EndFrame(linearZ);
+            }
+            effects.SetWorkList(nullptr);
+        }
+
+        std::vector<const SamplingRun*> uniformRuns;
+        for (const auto& run : runs)
+        {
+            if (run->uniformRays > 0) uniformRuns.push_back(run.get());
+        }
+        std::sort(uniformRuns.begin(), uniformRuns.end(), [](const SamplingRun* a, const SamplingRun* b) { return a->uniformRays < b->uniformRays; });
+
+        const uint32_t measuredFrames = std::max(1u, frameCount - std::min(frameCount, warmupCount));
+        const double pixels = double(resolution.width) * resolution.height;
+        for (const auto& run : runs)
+        {
+            json.BeginObject();
+            json.Field("resolution", resolutionName);
+            json.Field("sampling", run->name);
+            if (run->uniformRays > 0) json.Field("raysPerPixel", run->uniformRays);
+            else json.Field("targetStdDev", run->targetStdDev);
+            for (uint32_t e = 0; e < kEffectCount; ++e)
+            {
+                const double rmse = run->error[e].GetRmse();
+                json.Key(kEffectNames[e]).BeginObject();
+                json.Field("raysPerFrame", run->rays[e] / measuredFrames);
+                json.Field("samplesPerPixel", float(double(run->samples[e]) / (pixels * measuredFrames)));
+                json.Field("traceMs", float(run->traceMs[e] / measuredFrames));
+                if (run->uniformRays == 0) json.Field("samplerMs", float(run->samplerMs[e] / measuredFrames));
+                json.Field("rmse", float(rmse));
+
+                // The rays uniform sampling needs for the same error, and how many of them adaptive sampling saves
+                double equalQualityRays = 0.0;
+                if (run->uniformRays == 0 && GetEqualQualityRays(uniformRuns, e, rmse, equalQualityRays))
+                {
+                    json.Field("equalQualityUniformRays", uint64_t(equalQualityRays / measuredFrames));
+                    json.Field("raySavings", float(1.0 - double(run->rays[e]) / equalQualityRays));
+                }
+                json.EndObject();
+            }
+            json.EndObject();
+        }
+    }
+
+    json.EndArray();
+    json.Field("failedChecks", failedChecks);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedChecks > 0 ? 2 : 0;
+}
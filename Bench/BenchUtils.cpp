@@ -0,0 +1,221 @@
+#include "BenchUtils.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace Cpu;
+
+namespace
+{
+    std::vector<std::string> Split(const std::string& s, char separator)
+    {
+        std::vector<std::string> parts;
+        std::stringstream stream(s);
+        std::string part;
+        while (std::getline(stream, part, separator))
+        {
+            if (!part.empty()) parts.push_back(part);
+        }
+        return parts;
+    }
+
+    // G-buffer tiles of RenderGBuffer()
+    const uint32_t kTileSize = 16;
+}
+
+CommandLine::CommandLine(int argc, char** argv, int first)
+{
+    for (int i = first; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) continue;
+
+        arg = arg.substr(2);
+        if (i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0) mOptions[arg] = argv[++i];
+        else mOptions[arg] = "";
+    }
+}
+
+std::string CommandLine::GetString(const std::string& name, const std::string& defaultValue) const
+{
+    auto it = mOptions.find(name);
+    return it != mOptions.end() ? it->second : defaultValue;
+}
+
+uint32_t CommandLine::GetUint(const std::string& name, uint32_t defaultValue) const
+{
+    auto it = mOptions.find(name);
+    return it != mOptions.end() ? uint32_t(std::strtoul(it->second.c_str(), nullptr, 10)) : defaultValue;
+}
+
+float CommandLine::GetFloat(const std::string& name, float defaultValue) const
+{
+    auto it = mOptions.find(name);
+    return it != mOptions.end() ? float(std::atof(it->second.c_str())) : defaultValue;
+}
+
+std::vector<std::string> CommandLine::GetStringList(const std::string& name, const std::string& defaultValue) const
+{
+    return Split(GetString(name, defaultValue), ',');
+}
+
+std::vector<uint32_t> CommandLine::GetUintList(const std::string& name, const std::string& defaultValue) const
+{
+    std::vector<uint32_t> values;
+    for (const std::string& part : Split(GetString(name, defaultValue), ','))
+    {
+        values.push_back(uint32_t(std::strtoul(part.c_str(), nullptr, 10)));
+    }
+    return values;
+}
+
+std::vector<float> CommandLine::GetFloatList(const std::string& name, const std::string& defaultValue) const
+{
+    std::vector<float> values;
+    for (const std::string& part : Split(GetString(name, defaultValue), ','))
+    {
+        values.push_back(float(std::atof(part.c_str())));
+    }
+    return values;
+}
+
+std::vector<Resolution> CommandLine::GetResolutions(const std::string& name, const std::string& defaultValue) const
+{
+    std::vector<Resolution> values;
+    for (const std::string& part : Split(GetString(name, defaultValue), ','))
+    {
+        Resolution r;
+        if (sscanf(part.c_str(), "%ux%u", &r.width, &r.height) == 2 && r.width > 0 && r.height > 0) values.push_back(r);
+        else fprintf(stderr, "Ignoring malformed resolution '%s'\n", part.c_str());
+    }
+    return values;
+}
+
+FrameSource::FrameSource(const std::string& sequenceDirectory, Cpu::ThreadPool& threadPool)
+    : mSequenceDirectory(sequenceDirectory),
+      mThreadPool(threadPool)
+{
+    if (mSequenceDirectory.empty()) return;
+
+    mIsCapture = Cpu::IsFrameCapture(mSequenceDirectory);
+    if (mIsCapture) mSequenceFrameCount = mCapture.Open(mSequenceDirectory) ? mCapture.GetFrameCount() : 0;
+    else mSequenceFrameCount = Cpu::CountSequenceFrames(mSequenceDirectory);
+}
+
+bool FrameSource::GetFrame(uint32_t frameIndex, uint32_t width, uint32_t height, Cpu::FrameData& frame)
+{
+    if (mSequenceDirectory.empty())
+    {
+        mSyntheticScene.RenderFrame(frameIndex, width, height, frame, mThreadPool);
+        return true;
+    }
+
+    if (mSequenceFrameCount == 0) return false;
+    const uint32_t sequenceIndex = frameIndex % mSequenceFrameCount;
+    if (mIsCapture ? !mCapture.LoadFrame(sequenceIndex, mLoadedFrame) : !Cpu::LoadFrame(Cpu::GetFramePath(mSequenceDirectory, sequenceIndex), mLoadedFrame)) return false;
+
+    if (mLoadedFrame.width == width && mLoadedFrame.height == height) std::swap(frame, mLoadedFrame);
+    else Cpu::ResampleFrame(mLoadedFrame, width, height, frame);
+    return true;
+}
+
+bool FrameSource::GetCameraPosition(uint32_t frameIndex, Cpu::float3& position) const
+{
+    if (mSequenceDirectory.empty())
+    {
+        position = mSyntheticScene.GetCameraPosition(frameIndex);
+        return true;
+    }
+
+    if (!mIsCapture || mSequenceFrameCount == 0) return false;
+    const float* p = mCapture.GetFrame(frameIndex % mSequenceFrameCount).camera.position;
+    position = Cpu::float3(p[0], p[1], p[2]);
+    return true;
+}
+
+PathCamera GetGBufferCamera(const Bvh& bvh, uint32_t width, uint32_t height)
+{
+    float3 boundsMin, boundsMax;
+    bvh.GetBounds(boundsMin, boundsMax);
+    const float3 center = (boundsMin + boundsMax) * 0.5f;
+    const float radius = length(boundsMax - boundsMin) * 0.5f;
+
+    PathCamera camera;
+    camera.position = center + normalize(float3(0.3f, 0.45f, 1.0f)) * (radius * 1.2f);
+    camera.forward = normalize(center - camera.position);
+    camera.right = normalize(cross(camera.forward, float3(0.0f, 1.0f, 0.0f)));
+    camera.up = cross(camera.right, camera.forward);
+    camera.tanHalfFovY = std::tan(60.0f * kPi / 360.0f);
+    camera.aspectRatio = float(width) / float(height);
+    return camera;
+}
+
+void RenderGBuffer(const TriangleScene& scene, const Bvh& bvh, uint32_t width, uint32_t height, ThreadPool& threadPool, GBuffer& gBuffer)
+{
+    const PathCamera camera = GetGBufferCamera(bvh, width, height);
+
+    gBuffer.worldPosition.Resize(width, height);
+    gBuffer.normalRoughness.Resize(width, height);
+    gBuffer.albedo.Resize(width, height);
+    threadPool.ParallelForTiles(width, height, kTileSize, [&](const TileRect& tile, uint32_t)
+    {
+        for (uint32_t y = tile.y0; y < tile.y1; ++y)
+        {
+            for (uint32_t x = tile.x0; x < tile.x1; ++x)
+            {
+                Ray ray;
+                ray.origin = camera.position;
+                ray.direction = camera.GetDirection(float(x) + 0.5f, float(y) + 0.5f, width, height);
+
+                RayHit hit;
+                if (!bvh.Intersect(ray, hit)) continue;
+                float3 normal = scene.GetNormal(hit.triangle, hit.u, hit.v);
+                if (dot(normal, ray.direction) > 0.0f) normal = -normal;
+                const SceneMaterial& material = scene.GetTriangleMaterial(hit.triangle);
+                gBuffer.worldPosition.At(int(x), int(y)) = float4(ray.origin + ray.direction * hit.t, 1.0f);
+                gBuffer.normalRoughness.At(int(x), int(y)) = float4(normal, material.linearRoughness);
+                gBuffer.albedo.At(int(x), int(y)) = float4(material.baseColor, 1.0f);
+            }
+        }
+    });
+
+    gBuffer.view.worldPosition = &gBuffer.worldPosition;
+    gBuffer.view.normalRoughness = &gBuffer.normalRoughness;
+    gBuffer.view.albedo = &gBuffer.albedo;
+    gBuffer.view.cameraPosition = camera.position;
+}
+
+size_t GetPeakResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return size_t(usage.ru_maxrss);
+#else
+    return size_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+bool WriteTextFile(const std::string& path, const std::string& text)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    const bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    fclose(file);
+    return ok;
+}
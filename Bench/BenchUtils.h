@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "../Cpu/Bvh.h"
+#include "../Cpu/FrameCapture.h"
+#include "../Cpu/FrameSequence.h"
+#include "../Cpu/PathTracer.h"
+#include "../Cpu/Shading.h"
+#include "../Cpu/ThreadPool.h"
+#include "SyntheticScene.h"
+
+struct Resolution
+{
+    uint32_t width;
+    uint32_t height;
+};
+
+// "--key value" and "--flag" style options following the subcommand name
+class CommandLine
+{
+public:
+    CommandLine(int argc, char** argv, int first);
+
+    bool Has(const std::string& name) const { return mOptions.count(name) != 0; }
+    std::string GetString(const std::string& name, const std::string& defaultValue) const;
+    uint32_t GetUint(const std::string& name, uint32_t defaultValue) const;
+    float GetFloat(const std::string& name, float defaultValue) const;
+
+    // Comma separated lists, e.g. "1,2,4" and "1280x720,1920x1080"
+    std::vector<std::string> GetStringList(const std::string& name, const std::string& defaultValue) const;
+    std::vector<uint32_t> GetUintList(const std::string& name, const std::string& defaultValue) const;
+    std::vector<float> GetFloatList(const std::string& name, const std::string& defaultValue) const;
+    std::vector<Resolution> GetResolutions(const std::string& name, const std::string& defaultValue) const;
+
+private:
+    std::map<std::string, std::string> mOptions;
+};
+
+// Feeds frames to a benchmark from a recorded sequence (--sequence, a directory of .rays frames or a .rcap capture) or
+// from the synthetic scene. Recorded frames are resampled when the requested resolution differs from the capture.
+class FrameSource
+{
+public:
+    FrameSource(const std::string& sequenceDirectory, Cpu::ThreadPool& threadPool);
+
+    bool IsValid() const { return mSequenceDirectory.empty() || mSequenceFrameCount > 0; }
+    std::string GetName() const { return mSequenceDirectory.empty() ? std::string("synthetic") : mSequenceDirectory; }
+
+    // Recorded sequences loop when more frames are requested than were captured
+    bool GetFrame(uint32_t frameIndex, uint32_t width, uint32_t height, Cpu::FrameData& frame);
+
+    // Where the camera of a frame was, for the view vectors of rays traced from its G-buffer. False for a directory of
+    // .rays frames, which do not record the camera.
+    bool GetCameraPosition(uint32_t frameIndex, Cpu::float3& position) const;
+
+private:
+    std::string mSequenceDirectory;
+    uint32_t mSequenceFrameCount = 0;
+    Cpu::FrameCaptureReader mCapture;
+    bool mIsCapture = false;
+    Cpu::ThreadPool& mThreadPool;
+    SyntheticScene mSyntheticScene;
+    Cpu::FrameData mLoadedFrame;
+};
+
+struct GBuffer
+{
+    Cpu::Image4F worldPosition;
+    Cpu::Image4F normalRoughness;
+    Cpu::Image4F albedo;
+    Cpu::RtGBuffer view;
+};
+
+// A camera above and in front of the scene's bounds, looking at the centre, so the secondary rays leave from what a
+// frame of the renderer would show
+Cpu::PathCamera GetGBufferCamera(const Cpu::Bvh& bvh, uint32_t width, uint32_t height);
+
+// Rasterizes the scene by casting a primary ray through every pixel center from GetGBufferCamera()
+void RenderGBuffer(const Cpu::TriangleScene& scene, const Cpu::Bvh& bvh, uint32_t width, uint32_t height, Cpu::ThreadPool& threadPool, GBuffer& gBuffer);
+
+size_t GetPeakResidentBytes();
+bool WriteTextFile(const std::string& path, const std::string& text);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "BenchUtils.h"
+
+// Subcommands of RaysBench. Each returns the process exit code.
+int RunDenoiseBench(const CommandLine& args);
+int RunUpsampleBench(const CommandLine& args);
+int RunGraphBench(const CommandLine& args);
+int RunPoolBench(const CommandLine& args);
+int RunDynamicResolutionBench(const CommandLine& args);
+int RunRtBench(const CommandLine& args);
+int RunSceneCacheBench(const CommandLine& args);
+int RunSceneLoadBench(const CommandLine& args);
+int RunBvhBench(const CommandLine& args);
+int RunRaySortBench(const CommandLine& args);
+int RunAdaptiveBench(const CommandLine& args);
+int RunLightBench(const CommandLine& args);
+int RunRestirBench(const CommandLine& args);
+int RunProbeBench(const CommandLine& args);
+int RunCaptureBench(const CommandLine& args);
+int RunProfileBench(const CommandLine& args);
+int RunGradientBench(const CommandLine& args);
+int RunRoughnessBench(const CommandLine& args);
+int RunBounceBench(const CommandLine& args);
+int RunPathTraceBench(const CommandLine& args);
+int RunSweepBench(const CommandLine& args);
@@ -0,0 +1,239 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "Benchmarks.h"
+#include "../Cpu/Bvh.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/LightSampling.h"
+#include "../Cpu/RaytracedEffects.h"
+#include "../Cpu/ReflectionClassification.h"
+#include "../Cpu/SceneCache.h"
+
+using namespace Cpu;
+
+namespace
+{
+    // The DXR payloads, Data/RaytracedReflection.slang before and after its bounce loop
+    const uint32_t kRecursivePayloadBytes = 32;     // float4 color, depth, hitT, randSeed
+    const uint32_t kHitPayloadBytes = 16;           // hitT and the packed normal, diffuse and roughness, specular
+
+    struct Difference
+    {
+        float maxDifference = 0.0f;
+        uint32_t mismatches = 0;    // Channels further apart than the tolerance
+        uint32_t channels = 0;
+    };
+
+    // The two designs sum the same terms in a different order, so they only agree up to float rounding
+    Difference Compare(const Image4F& a, const Image4F& b, float tolerance)
+    {
+        Difference difference;
+        for (size_t i = 0; i < a.GetPixelCount() && a.GetPixelCount() == b.GetPixelCount(); ++i)
+        {
+            const float4& x = a.GetData()[i];
+            const float4& y = b.GetData()[i];
+            const float values[3][2] = { { x.x, y.x }, { x.y, y.y }, { x.z, y.z } };
+            for (const auto& value : values)
+            {
+                const float d = std::fabs(value[0] - value[1]);
+                difference.maxDifference = std::max(difference.maxDifference, d);
+                if (!(d <= tolerance * std::max(1.0f, std::fabs(value[0])))) difference.mismatches++;
+                difference.channels++;
+            }
+        }
+        if (a.GetPixelCount() != b.GetPixelCount()) difference.mismatches = difference.channels = 1;
+        return difference;
+    }
+}
+
+int RunBounceBench(const CommandLine& args)
+{
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolutions", "640x360");
+    const std::vector<uint32_t> bounceCounts = args.GetUintList("bounces", "1,2,3,4");
+    const uint32_t frameCount = std::max(1u, args.GetUint("frames", 4));
+    const uint32_t sphereSegments = args.GetUint("segments", 64);
+    const std::string sceneCachePath = args.GetString("scene-cache", "");
+    const float tolerance = args.GetFloat("tolerance", 1e-4f);
+    const float maxMismatchFraction = args.GetFloat("max-mismatch-fraction", 0.001f);
+    const std::string outputPath = args.GetString("output", "");
+
+    ThreadPool threadPool(args.GetUint("threads", 0));
+
+    uint32_t failedChecks = 0;
+    auto check = [&](bool condition, const std::string& name, const char* message)
+    {
+        if (condition) return;
+        fprintf(stderr, "bounces: %s: %s\n", name.c_str(), message);
+        failedChecks++;
+    };
+
+    // The synthetic stand-in for Pica, or e.g. the cache RaysRenderer writes next to Pica.fscene
+    std::string sceneName = "synthetic";
+    SyntheticScene syntheticScene;
+    TriangleScene scene;
+    SceneCache sceneCache;
+    if (sceneCachePath.empty())
+    {
+        syntheticScene.BuildTriangleScene(sphereSegments, scene);
+    }
+    else
+    {
+        sceneName = sceneCachePath;
+        const SceneCache::Status status = sceneCache.OpenAnySource(sceneCachePath);
+        if (status != SceneCache::Status::Ok)
+        {
+            fprintf(stderr, "Failed to open '%s': %s\n", sceneCachePath.c_str(), GetSceneCacheStatusName(status));
+            return 1;
+        }
+        BuildTriangleScene(sceneCache.GetView(), scene, &threadPool);
+    }
+    if (scene.GetTriangleCount() == 0)
+    {
+        fprintf(stderr, "bounces: %s has no triangles\n", sceneName.c_str());
+        return 1;
+    }
+
+    Bvh bvh;
+    bvh.Build(scene, BvhBuildSettings(), &threadPool);
+    RaytracedEffects effects(scene, bvh, threadPool);
+    ReflectionClassifier classifier(&threadPool);
+    LightSampler lightSampler;
+    lightSampler.Build(scene);
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "bounces");
+    json.Field("scene", sceneName);
+    json.Field("triangles", scene.GetTriangleCount());
+    json.Field("threads", threadPool.GetThreadCount());
+    json.Field("frames", frameCount);
+    json.Field("recursivePayloadBytes", kRecursivePayloadBytes);
+    json.Field("hitPayloadBytes", kHitPayloadBytes);
+    json.Key("runs").BeginArray();
+
+    FrameData frame;
+    GBuffer gBuffer;
+    for (const Resolution& resolution : resolutions)
+    {
+        const std::string resolutionName = std::to_string(resolution.width) + "x" + std::to_string(resolution.height);
+
+        // The synthetic scene from the camera of the denoiser benchmarks, a cache from above its bounds
+        RtGBuffer view;
+        if (sceneCachePath.empty())
+        {
+            syntheticScene.RenderFrame(0, resolution.width, resolution.height, frame, threadPool);
+            view.worldPosition = &frame.Get(FrameTarget::WorldPosition);
+            view.normalRoughness = &frame.Get(FrameTarget::NormalRoughness);
+            view.albedo = &frame.Get(FrameTarget::Albedo);
+            view.cameraPosition = syntheticScene.GetCameraPosition(0);
+        }
+        else
+        {
+            RenderGBuffer(scene, bvh, resolution.width, resolution.height, threadPool, gBuffer);
+            view = gBuffer.view;
+        }
+
+        // One or two rays per pixel, so that a pixel's rays are more than one path of a batch
+        std::vector<uint32_t> workList;
+        for (uint32_t y = 0; y < resolution.height; ++y)
+        {
+            for (uint32_t x = 0; x < resolution.width; ++x) workList.push_back(x | (y << 14) | ((1 + ((x ^ y) & 1)) << 28));
+        }
+
+        for (uint32_t bounces : bounceCounts)
+        {
+            bounces = std::max(1u, bounces);
+            const std::string name = resolutionName + " " + std::to_string(bounces) + " bounces";
+            fprintf(stderr, "bounces %s\n", name.c_str());
+            effects.SetReflectionBounces(bounces);
+
+            const ReflectionTracing designs[] = { ReflectionTracing::Recursive, ReflectionTracing::Wavefront };
+            uint64_t rays[2] = {};
+            double ms[2] = {};
+            Image4F outputs[2];
+            Difference difference;
+            for (uint32_t frameIndex = 0; frameIndex < frameCount; ++frameIndex)
+            {
+                for (uint32_t d = 0; d < 2; ++d)
+                {
+                    effects.SetReflectionTracing(designs[d]);
+                    effects.TraceReflection(view, RayScale::Full, frameIndex, outputs[d]);
+                    rays[d] += effects.GetLastStats().rays;
+                    ms[d] += effects.GetLastStats().elapsedMs;
+                }
+                check(rays[0] == rays[1], name, "the designs trace different rays");
+
+                const Difference frameDifference = Compare(outputs[0], outputs[1], tolerance);
+                difference.maxDifference = std::max(difference.maxDifference, frameDifference.maxDifference);
+                difference.mismatches += frameDifference.mismatches;
+                difference.channels += frameDifference.channels;
+            }
+
+            // The batches of a work list, a classifier and sampled lights, one frame each, against the recursive paths
+            auto compareListed = [&](const char* message)
+            {
+                uint64_t listedRays[2] = {};
+                for (uint32_t d = 0; d < 2; ++d)
+                {
+                    effects.SetReflectionTracing(designs[d]);
+                    effects.TraceReflection(view, RayScale::Full, 0, outputs[d]);
+                    listedRays[d] = effects.GetLastStats().rays;
+                }
+                const Difference listedDifference = Compare(outputs[0], outputs[1], tolerance);
+                check(listedRays[0] == listedRays[1] &&
+                    float(listedDifference.mismatches) <= maxMismatchFraction * float(std::max(1u, listedDifference.channels)), name, message);
+            };
+            effects.SetWorkList(&workList);
+            compareListed("a work list traces differently as a wavefront");
+            effects.SetWorkList(nullptr);
+            classifier.Classify(view, 0);
+            effects.SetReflectionClassifier(&classifier);
+            compareListed("classified reflections trace differently as a wavefront");
+            effects.SetReflectionClassifier(nullptr);
+            effects.SetLightSampler(&lightSampler);
+            compareListed("sampled lights trace differently as a wavefront");
+            effects.SetLightSampler(nullptr);
+
+            const float mismatchFraction = float(difference.mismatches) / float(std::max(1u, difference.channels));
+            check(mismatchFraction <= maxMismatchFraction, name, "the designs disagree beyond float rounding");
+
+            const char* const designNames[] = { "recursive", "wavefront" };
+            json.BeginObject();
+            json.Field("resolution", resolutionName);
+            json.Field("bounces", bounces);
+            // Rays traced from a hit shader nest one level deeper per bounce, the shadow ray of the last hit included
+            json.Field("recursiveTraceDepth", bounces + 1);
+            json.Field("wavefrontTraceDepth", 1u);
+            for (uint32_t d = 0; d < 2; ++d)
+            {
+                json.Key(designNames[d]).BeginObject();
+                json.Field("raysPerFrame", rays[d] / frameCount);
+                json.Field("traceMs", float(ms[d] / frameCount));
+                json.Field("mraysPerSecond", float(ms[d] > 0.0 ? double(rays[d]) / ms[d] / 1000.0 : 0.0));
+                json.EndObject();
+            }
+            json.Field("speedup", float(ms[1] > 0.0 ? ms[0] / ms[1] : 0.0));
+            json.Field("maxDifference", difference.maxDifference);
+            json.Field("mismatchFraction", mismatchFraction);
+            json.EndObject();
+        }
+    }
+    effects.SetReflectionTracing(ReflectionTracing::Recursive);
+
+    json.EndArray();
+    json.Field("failedChecks", failedChecks);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedChecks > 0 ? 2 : 0;
+}
@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "Benchmarks.h"
+#include "ObjScene.h"
+#include "../Cpu/Bvh.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/Sampling.h"
+#include "../Cpu/SceneCache.h"
+#include "../Cpu/Timer.h"
+#include "../Cpu/TwoLevelBvh.h"
+
+using namespace Cpu;
+
+namespace
+{
+    const uint32_t kRaysPerTask = 4096;
+    // Hits closer than this to an edge of their triangle, relative to the magnitude of the coordinates, are grazing
+    const float kGrazingTolerance = 1e-5f;
+
+    struct BuilderInfo
+    {
+        const char* name;
+        BvhBuilder builder;
+    };
+
+    const BuilderInfo kBuilders[] =
+    {
+        { "sah", BvhBuilder::BinnedSah },
+        { "morton", BvhBuilder::Morton },
+    };
+
+    // Origins anywhere in the scene bounds, aimed at a random point of a random triangle so most rays hit something
+    std::vector<Ray> GenerateRays(const TriangleScene& scene, const float3& boundsMin, const float3& boundsMax, uint32_t rayCount, uint32_t seed)
+    {
+        std::vector<Ray> rays(rayCount);
+        uint32_t randState = RandInit(seed, 3, 16);
+        const float3 extent = boundsMax - boundsMin;
+        for (Ray& ray : rays)
+        {
+            ray.origin = boundsMin + extent * float3(RandNext(randState), RandNext(randState), RandNext(randState));
+            const uint32_t triangle = std::min(scene.GetTriangleCount() - 1, uint32_t(RandNext(randState) * float(scene.GetTriangleCount())));
+            float u = RandNext(randState), v = RandNext(randState);
+            if (u + v > 1.0f)
+            {
+                u = 1.0f - u;
+                v = 1.0f - v;
+            }
+            const float3 v0 = scene.GetVertex(triangle, 0);
+            const float3 target = v0 + (scene.GetVertex(triangle, 1) - v0) * u + (scene.GetVertex(triangle, 2) - v0) * v;
+            const float len = length(target - ray.origin);
+            ray.direction = len > 0.0f ? (target - ray.origin) / len : float3(0.0f, -1.0f, 0.0f);
+            ray.tMin = 1e-3f;
+        }
+        return rays;
+    }
+
+    // Closest hit rays per second over the whole pool, the better of two runs so the first one warms the caches
+    template<typename Accel>
+    double MeasureRaysPerSecond(const Accel& accel, const std::vector<Ray>& rays, ThreadPool& threadPool)
+    {
+        std::vector<uint32_t> hits(threadPool.GetThreadCount());
+        double bestMs = 0.0;
+        for (uint32_t run = 0; run < 2; ++run)
+        {
+            Timer timer;
+            threadPool.ParallelFor(uint32_t((rays.size() + kRaysPerTask - 1) / kRaysPerTask), [&](uint32_t task, uint32_t threadIndex)
+            {
+                const size_t last = std::min(rays.size(), size_t(task + 1) * kRaysPerTask);
+                for (size_t i = size_t(task) * kRaysPerTask; i < last; ++i)
+                {
+                    RayHit hit;
+                    if (accel.Intersect(rays[i], hit)) hits[threadIndex]++;
+                }
+            });
+            const double ms = timer.GetElapsedMs();
+            bestMs = run == 0 ? ms : std::min(bestMs, ms);
+        }
+        return bestMs > 0.0 ? double(rays.size()) / (bestMs * 1e-3) : 0.0;
+    }
+
+    // Whether the hit is within rounding distance of an edge of its triangle. The watertight test cannot let such a ray
+    // through a shared edge, but it can still slip past a silhouette in one space and graze it in another.
+    bool IsGrazing(const TriangleScene& scene, const Ray& ray, const RayHit& hit)
+    {
+        const float3 v0 = scene.GetVertex(hit.triangle, 0);
+        const float3 v1 = scene.GetVertex(hit.triangle, 1);
+        const float3 v2 = scene.GetVertex(hit.triangle, 2);
+        const float doubleArea = length(cross(v1 - v0, v2 - v0));
+        const float tolerance = kGrazingTolerance * (length(ray.origin) + length(ray.origin + ray.direction * hit.t));
+
+        // The distance to the edge opposite a vertex is its barycentric times the height over that edge
+        const float barycentrics[3] = { 1.0f - hit.u - hit.v, hit.u, hit.v };
+        const float edgeLengths[3] = { length(v2 - v1), length(v2 - v0), length(v1 - v0) };
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            if (std::fabs(barycentrics[i]) * doubleArea <= tolerance * edgeLengths[i]) return true;
+        }
+        return false;
+    }
+
+    struct MismatchCount
+    {
+        uint32_t mismatches = 0;
+        uint32_t grazing = 0;   // Disagreements where a hit grazes an edge, not counted as mismatches
+    };
+
+    // Rays where the two disagree on hitting, or on the distance beyond a relative tolerance. Different trees may
+    // legitimately pick either triangle of a shared edge, so triangle ids are not compared. Both number the
+    // triangles of scene the same way.
+    template<typename A, typename B>
+    MismatchCount CountMismatches(const A& a, const B& b, const TriangleScene& scene, const std::vector<Ray>& rays, uint32_t rayCount, float tolerance)
+    {
+        MismatchCount count;
+        for (uint32_t i = 0; i < std::min(rayCount, uint32_t(rays.size())); ++i)
+        {
+            RayHit hitA, hitB;
+            const bool foundA = a.Intersect(rays[i], hitA);
+            const bool foundB = b.Intersect(rays[i], hitB);
+            bool same = foundA == foundB && foundA == a.Occluded(rays[i]) && foundB == b.Occluded(rays[i]);
+            if (same && foundA) same = std::fabs(hitA.t - hitB.t) <= tolerance * std::max(1.0f, hitA.t);
+            if (same) continue;
+
+            if ((foundA && IsGrazing(scene, rays[i], hitA)) || (foundB && IsGrazing(scene, rays[i], hitB))) count.grazing++;
+            else count.mismatches++;
+        }
+        return count;
+    }
+
+    bool IsSameTree(const Bvh& a, const Bvh& b)
+    {
+        return a.GetNodeCount() == b.GetNodeCount() && a.GetLeafBlockCount() == b.GetLeafBlockCount() && a.GetDepth() == b.GetDepth() &&
+            std::memcmp(a.GetNodeData(), b.GetNodeData(), a.GetNodeCount() * Bvh::GetNodeSize()) == 0 &&
+            std::memcmp(a.GetLeafData(), b.GetLeafData(), a.GetLeafBlockCount() * Bvh::GetLeafBlockSize()) == 0;
+    }
+
+    std::vector<char> CopyTree(const Bvh& bvh)
+    {
+        const char* nodes = static_cast<const char*>(bvh.GetNodeData());
+        const char* leaves = static_cast<const char*>(bvh.GetLeafData());
+        std::vector<char> bytes(nodes, nodes + bvh.GetNodeCount() * Bvh::GetNodeSize());
+        bytes.insert(bytes.end(), leaves, leaves + bvh.GetLeafBlockCount() * Bvh::GetLeafBlockSize());
+        return bytes;
+    }
+
+    // Rigid animation: every instance moved and turned a little about the vertical
+    std::vector<SceneInstance> MoveInstances(const SceneView& view)
+    {
+        std::vector<SceneInstance> moved(view.instances.begin(), view.instances.end());
+        for (uint32_t i = 0; i < moved.size(); ++i)
+        {
+            float* m = moved[i].transform;
+            const float angle = 0.3f * std::sin(float(i));
+            const float c = std::cos(angle), s = std::sin(angle);
+            for (uint32_t column = 0; column < 3; ++column)
+            {
+                const float x = m[column * 4], z = m[column * 4 + 2];
+                m[column * 4] = c * x + s * z;
+                m[column * 4 + 2] = c * z - s * x;
+            }
+            m[12] += 0.5f * std::sin(float(i) * 1.7f);
+            m[13] += 0.1f * std::cos(float(i) * 0.9f);
+            m[14] += 0.5f * std::cos(float(i) * 2.3f);
+        }
+        return moved;
+    }
+}
+
+int RunBvhBench(const CommandLine& args)
+{
+    const std::vector<uint32_t> grids = args.GetUintList("grids", "2,4");
+    const uint32_t sphereSegments = args.GetUint("segments", 128);
+    // Coarse spheres have long thin triangles, so many of the rays aimed at them pass close to an edge
+    const uint32_t coarseSegments = args.GetUint("coarse-segments", 16);
+    const std::string sceneCachePath = args.GetString("scene-cache", "");
+    const uint32_t rayCount = std::max(1u, args.GetUint("rays", 500000));
+    const uint32_t validationRays = args.GetUint("validation-rays", 20000);
+    const float maxMismatchFraction = args.GetFloat("max-mismatch-fraction", 1e-3f);
+    const std::string outputPath = args.GetString("output", "");
+
+    ThreadPool threadPool(args.GetUint("threads", 0));
+    // Distances through a transformed instance are rounded differently than through world space triangles
+    const float tTolerance = 1e-3f;
+
+    uint32_t failedChecks = 0;
+    auto check = [&](bool condition, const std::string& sceneName, const char* message)
+    {
+        if (condition) return;
+        fprintf(stderr, "bvh: %s: %s\n", sceneName.c_str(), message);
+        failedChecks++;
+    };
+    auto checkMismatches = [&](const MismatchCount& count, const std::string& sceneName, const char* message)
+    {
+        check(float(count.mismatches) <= maxMismatchFraction * float(validationRays), sceneName, message);
+    };
+
+    struct SceneSource
+    {
+        std::string name;
+        SceneData data;
+        std::shared_ptr<SceneCache> cache;
+        SceneView view;
+    };
+    std::vector<std::unique_ptr<SceneSource>> sources;
+    auto addGridScene = [&](uint32_t grid, uint32_t segments, const std::string& name)
+    {
+        std::unique_ptr<SceneSource> source(new SceneSource());
+        source->name = name;
+        BuildGridScene(segments, std::max(1u, grid), source->data);
+        source->view = source->data.GetView();
+        sources.push_back(std::move(source));
+    };
+    for (uint32_t grid : grids) addGridScene(grid, sphereSegments, "grid" + std::to_string(std::max(1u, grid)));
+    if (coarseSegments > 0) addGridScene(2, coarseSegments, "grid2_segments" + std::to_string(coarseSegments));
+    if (!sceneCachePath.empty())
+    {
+        // E.g. the cache RaysRenderer writes next to Pica.fscene, which needs the full model set to be produced
+        std::unique_ptr<SceneSource> source(new SceneSource());
+        source->name = sceneCachePath;
+        source->cache = std::make_shared<SceneCache>();
+        const SceneCache::Status status = source->cache->OpenAnySource(sceneCachePath);
+        if (status != SceneCache::Status::Ok)
+        {
+            fprintf(stderr, "Failed to open '%s': %s\n", sceneCachePath.c_str(), GetSceneCacheStatusName(status));
+            return 1;
+        }
+        source->view = source->cache->GetView();
+        sources.push_back(std::move(source));
+    }
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "bvh");
+    json.Field("threads", threadPool.GetThreadCount());
+    json.Field("rays", rayCount);
+    json.Key("scenes").BeginArray();
+
+    for (const std::unique_ptr<SceneSource>& source : sources)
+    {
+        const std::string& name = source->name;
+        const SceneView& view = source->view;
+        TriangleScene scene;
+        BuildTriangleScene(view, scene, &threadPool);
+        if (scene.GetTriangleCount() == 0)
+        {
+            fprintf(stderr, "bvh: %s has no triangles\n", name.c_str());
+            return 1;
+        }
+
+        json.BeginObject();
+        json.Field("name", name);
+        json.Field("meshes", view.meshes.count);
+        json.Field("instances", view.instances.count);
+        json.Field("triangles", scene.GetTriangleCount());
+
+        // The parallel SAH tree is the reference for everything below
+        Bvh reference;
+        reference.Build(scene, BvhBuildSettings(), &threadPool);
+        float3 boundsMin, boundsMax;
+        reference.GetBounds(boundsMin, boundsMax);
+        const std::vector<Ray> rays = GenerateRays(scene, boundsMin, boundsMax, rayCount, 17);
+
+        json.Key("builders").BeginArray();
+        for (const BuilderInfo& info : kBuilders)
+        {
+            BvhBuildSettings settings;
+            settings.builder = info.builder;
+            Bvh serial, parallel;
+            serial.Build(scene, settings);
+            parallel.Build(scene, settings, &threadPool);
+            const bool matchesSerial = IsSameTree(serial, parallel);
+            check(matchesSerial, name, "the parallel build differs from the serial one");
+            const MismatchCount mismatches = CountMismatches(reference, parallel, scene, rays, validationRays, tTolerance);
+            checkMismatches(mismatches, name, "the builders disagree on hits");
+
+            json.BeginObject();
+            json.Field("builder", info.name);
+            json.Field("serialBuildMs", serial.GetBuildMs());
+            json.Field("parallelBuildMs", parallel.GetBuildMs());
+            json.Field("speedup", parallel.GetBuildMs() > 0.0f ? serial.GetBuildMs() / parallel.GetBuildMs() : 0.0f);
+            json.Field("sahCost", parallel.GetSahCost());
+            json.Field("nodes", parallel.GetNodeCount());
+            json.Field("leafBlocks", parallel.GetLeafBlockCount());
+            json.Field("depth", parallel.GetDepth());
+            json.Field("bytes", uint64_t(parallel.GetSizeInBytes()));
+            json.Field("mraysPerSecond", float(MeasureRaysPerSecond(parallel, rays, threadPool) * 1e-6));
+            json.Field("matchesSerial", matchesSerial);
+            json.Field("mismatches", mismatches.mismatches);
+            json.Field("grazing", mismatches.grazing);
+            json.EndObject();
+        }
+        json.EndArray();
+
+        // Moved instances flattened into a scene with the same triangles in the same order
+        const std::vector<SceneInstance> movedInstances = MoveInstances(view);
+        SceneView movedView = view;
+        movedView.instances = ArrayView<SceneInstance>(movedInstances);
+        TriangleScene movedScene;
+        BuildTriangleScene(movedView, movedScene, &threadPool);
+        Bvh rebuilt;
+        rebuilt.Build(movedScene, BvhBuildSettings(), &threadPool);
+
+        // Flat refit: the same tree over the moved triangles. Refitting the unchanged scene must not change a bit.
+        Bvh refitted;
+        refitted.Build(scene, BvhBuildSettings(), &threadPool);
+        const std::vector<char> before = CopyTree(refitted);
+        refitted.Refit(scene, &threadPool);
+        const bool refitUnchanged = CopyTree(refitted) == before;
+        check(refitUnchanged, name, "refitting the unchanged scene changed the tree");
+        refitted.Refit(movedScene, &threadPool);
+        const MismatchCount refitMismatches = CountMismatches(rebuilt, refitted, movedScene, rays, validationRays, tTolerance);
+        checkMismatches(refitMismatches, name, "the refitted tree disagrees with a rebuild");
+
+        json.Key("refit").BeginObject();
+        json.Field("rebuildMs", rebuilt.GetBuildMs());
+        json.Field("refitMs", refitted.GetRefitMs());
+        json.Field("rebuiltSahCost", rebuilt.GetSahCost());
+        json.Field("refitSahCost", refitted.GetSahCost());
+        json.Field("rebuiltMraysPerSecond", float(MeasureRaysPerSecond(rebuilt, rays, threadPool) * 1e-6));
+        json.Field("refitMraysPerSecond", float(MeasureRaysPerSecond(refitted, rays, threadPool) * 1e-6));
+        json.Field("unchangedIdentical", refitUnchanged);
+        json.Field("mismatches", refitMismatches.mismatches);
+        json.Field("grazing", refitMismatches.grazing);
+        json.EndObject();
+
+        // Two levels: meshes built once, instances moved by refitting the top level only
+        TwoLevelBvh twoLevel;
+        twoLevel.Build(view, BvhBuildSettings(), &threadPool);
+        const float twoLevelBuildMs = twoLevel.GetBuildMs();
+        check(twoLevel.GetTriangleCount() == scene.GetTriangleCount(), name, "the two-level BVH numbers triangles differently");
+        const MismatchCount twoLevelMismatches = CountMismatches(reference, twoLevel, scene, rays, validationRays, tTolerance);
+        checkMismatches(twoLevelMismatches, name, "the two-level BVH disagrees with the flat one");
+        const double twoLevelRate = MeasureRaysPerSecond(twoLevel, rays, threadPool);
+
+        for (uint32_t i = 0; i < movedInstances.size(); ++i) twoLevel.SetTransform(i, movedInstances[i].transform);
+        twoLevel.Refit();
+        const MismatchCount movedMismatches = CountMismatches(rebuilt, twoLevel, movedScene, rays, validationRays, tTolerance);
+        checkMismatches(movedMismatches, name, "the refitted two-level BVH disagrees with a rebuild");
+
+        json.Key("twoLevel").BeginObject();
+        json.Field("buildMs", twoLevelBuildMs);
+        json.Field("refitMs", twoLevel.GetRefitMs());
+        json.Field("topNodes", twoLevel.GetTopNodeCount());
+        json.Field("bytes", uint64_t(twoLevel.GetSizeInBytes()));
+        json.Field("mraysPerSecond", float(twoLevelRate * 1e-6));
+        json.Field("movedMraysPerSecond", float(MeasureRaysPerSecond(twoLevel, rays, threadPool) * 1e-6));
+        json.Field("mismatches", twoLevelMismatches.mismatches);
+        json.Field("grazing", twoLevelMismatches.grazing);
+        json.Field("movedMismatches", movedMismatches.mismatches);
+        json.Field("movedGrazing", movedMismatches.grazing);
+        json.EndObject();
+
+        json.EndObject();
+    }
+    json.EndArray();
+    json.Field("failedChecks", failedChecks);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedChecks > 0 ? 2 : 0;
+}
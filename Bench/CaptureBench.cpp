@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include "Benchmarks.h"
+#include "../Cpu/FrameCapture.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/Timer.h"
+
+using namespace Cpu;
+
+namespace
+{
+    // The formats RaysRenderer's G-buffer and ray traced targets have, see GetGBufferDesc() and AddHybridPasses()
+    const CaptureFormat kTargetFormats[kFrameTargetCount] =
+    {
+        CaptureFormat::RGBA32Float,     // WorldPosition
+        CaptureFormat::RGBA32Float,     // NormalRoughness
+        CaptureFormat::RGBA8Unorm,      // Albedo
+        CaptureFormat::RGBA16Float,     // MotionVector
+        CaptureFormat::RGBA16Float,     // SVGF_LinearZ
+        CaptureFormat::RGBA16Float,     // SVGF_CompactNormDepth
+        CaptureFormat::R8Unorm,         // Shadow
+        CaptureFormat::RGBA16Float,     // Reflection
+        CaptureFormat::R8Unorm,         // AO
+    };
+
+    // What FrameRecorder hands the writer for a frame
+    void PackFrame(const FrameData& frame, uint32_t frameIndex, CaptureFrame& capture)
+    {
+        capture.frameIndex = frameIndex;
+        capture.camera = CaptureCamera();
+        capture.camera.position[2] = float(frameIndex);
+        capture.targets.clear();
+        for (uint32_t i = 0; i < kFrameTargetCount; ++i)
+        {
+            if (!frame.HasTarget(FrameTarget(i))) continue;
+
+            CaptureTarget target;
+            target.target = FrameTarget(i);
+            target.format = kTargetFormats[i];
+            target.width = frame.width;
+            target.height = frame.height;
+            PackCaptureTarget(frame.targets[i], target.format, target.texels);
+            capture.targets.push_back(std::move(target));
+        }
+    }
+
+    // The frame as the GPU targets would hold it
+    void QuantizeFrame(const FrameData& frame, FrameData& quantized)
+    {
+        quantized.targetMask = frame.targetMask;
+        quantized.Resize(frame.width, frame.height);
+        std::vector<uint8_t> texels;
+        for (uint32_t i = 0; i < kFrameTargetCount; ++i)
+        {
+            if (!frame.HasTarget(FrameTarget(i))) continue;
+            PackCaptureTarget(frame.targets[i], kTargetFormats[i], texels);
+            UnpackCaptureTarget(texels.data(), kTargetFormats[i], frame.width, frame.height, quantized.targets[i]);
+        }
+    }
+
+    bool AreFramesEqual(const FrameData& a, const FrameData& b)
+    {
+        if (a.width != b.width || a.height != b.height || a.targetMask != b.targetMask) return false;
+        for (uint32_t i = 0; i < kFrameTargetCount; ++i)
+        {
+            if (!a.HasTarget(FrameTarget(i))) continue;
+            if (std::memcmp(a.targets[i].GetData(), b.targets[i].GetData(), a.targets[i].GetSizeInBytes()) != 0) return false;
+        }
+        return true;
+    }
+
+    // Noise does not compress, runs do, and both have to come back exactly. A stream cut short has to be rejected.
+    bool CheckCompression()
+    {
+        std::mt19937 rng(7);
+        std::vector<uint8_t> texels(4096 * 8);
+        for (size_t i = 0; i < texels.size(); ++i) texels[i] = (i < texels.size() / 2) ? uint8_t(rng()) : uint8_t(i / 700);
+
+        std::vector<uint8_t> compressed;
+        std::vector<uint8_t> decompressed(texels.size());
+        for (uint32_t texelBytes : { 1u, 4u, 8u, 16u })
+        {
+            CompressTexels(texels.data(), texels.size(), texelBytes, compressed);
+            if (!DecompressTexels(compressed.data(), compressed.size(), texelBytes, decompressed.data(), decompressed.size())) return false;
+            if (decompressed != texels) return false;
+            if (DecompressTexels(compressed.data(), compressed.size() - 1, texelBytes, decompressed.data(), decompressed.size())) return false;
+        }
+        return true;
+    }
+
+    bool CopyFilePrefix(const std::string& source, const std::string& destination, size_t bytes)
+    {
+        std::vector<uint8_t> data(bytes);
+        FILE* in = fopen(source.c_str(), "rb");
+        if (!in) return false;
+        const bool read = fread(data.data(), 1, bytes, in) == bytes;
+        fclose(in);
+        return read && WriteTextFile(destination, std::string(data.begin(), data.end()));
+    }
+}
+
+int RunCaptureBench(const CommandLine& args)
+{
+    const std::string sequence = args.GetString("sequence", "");
+    const uint32_t frameCount = std::max(2u, args.GetUint("frames", 30));
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolutions", "1280x720");
+    const std::vector<std::string> compressionNames = args.GetStringList("compression", "none,shuffle-rle");
+    const uint32_t maxQueuedFrames = std::max(1u, args.GetUint("queue", 4));
+    const std::string capturePath = args.GetString("path", "capture_bench.rcap");
+    // Leaves the last capture for replay with --sequence
+    const bool keep = args.GetUint("keep", 0) != 0;
+    const std::string outputPath = args.GetString("output", "");
+
+    std::vector<CaptureCompression> compressions;
+    for (const std::string& name : compressionNames)
+    {
+        uint32_t c = 0;
+        while (c < uint32_t(CaptureCompression::Count) && name != GetCaptureCompressionName(CaptureCompression(c))) c++;
+        if (c == uint32_t(CaptureCompression::Count))
+        {
+            fprintf(stderr, "Unknown compression '%s'\n", name.c_str());
+            return 1;
+        }
+        compressions.push_back(CaptureCompression(c));
+    }
+
+    ThreadPool threadPool(args.GetUint("threads", 0));
+    FrameSource source(sequence, threadPool);
+    if (!source.IsValid())
+    {
+        fprintf(stderr, "No frames found in '%s'\n", sequence.c_str());
+        return 1;
+    }
+
+    uint32_t failedChecks = 0;
+    const bool compressionValid = CheckCompression();
+    if (!compressionValid)
+    {
+        fprintf(stderr, "capture: compressed texels do not round trip\n");
+        failedChecks++;
+    }
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "capture");
+    json.Field("source", source.GetName());
+    json.Field("threads", threadPool.GetThreadCount());
+    json.Field("frames", frameCount);
+    json.Field("queue", maxQueuedFrames);
+    json.Field("compressionValid", compressionValid);
+    json.Key("runs").BeginArray();
+
+    FrameData frame;
+    FrameData quantized;
+    FrameData loaded;
+    for (const Resolution& resolution : resolutions)
+    {
+        for (CaptureCompression compression : compressions)
+        {
+            fprintf(stderr, "capture %ux%u %s\n", resolution.width, resolution.height, GetCaptureCompressionName(compression));
+
+            FrameCaptureWriter writer;
+            if (!writer.Open(capturePath, compression, maxQueuedFrames))
+            {
+                fprintf(stderr, "Failed to create '%s'\n", capturePath.c_str());
+                return 1;
+            }
+
+            // Submit() is all the render thread pays, the frames come faster than a GPU would produce them
+            double submitMs = 0.0;
+            size_t legacyBytes = 0;
+            CaptureFrame capture;
+            Timer captureTimer;
+            for (uint32_t i = 0; i < frameCount; ++i)
+            {
+                if (!source.GetFrame(i, resolution.width, resolution.height, frame))
+                {
+                    fprintf(stderr, "Failed to load frame %u\n", i);
+                    return 1;
+                }
+                PackFrame(frame, i, capture);
+                legacyBytes += 20 + frame.GetSizeInBytes();
+
+                Timer submitTimer;
+                writer.Submit(std::move(capture));
+                submitMs += submitTimer.GetElapsedMs();
+            }
+            writer.Close();
+            const double captureMs = captureTimer.GetElapsedMs();
+            const FrameCaptureStats stats = writer.GetStats();
+
+            Timer openTimer;
+            FrameCaptureReader reader;
+            const bool opened = reader.Open(capturePath);
+            const double openMs = openTimer.GetElapsedMs();
+
+            // Every written frame has to come back exactly as the GPU targets held it
+            bool roundTrip = opened && reader.GetFrameCount() == stats.writtenFrames && stats.writtenFrames > 0;
+            double loadMs = 0.0;
+            for (uint32_t f = 0; roundTrip && f < reader.GetFrameCount(); ++f)
+            {
+                const uint32_t frameIndex = reader.GetFrame(f).frameIndex;
+                Timer loadTimer;
+                roundTrip = reader.LoadFrame(f, loaded);
+                loadMs += loadTimer.GetElapsedMs();
+
+                roundTrip = roundTrip && reader.GetFrame(f).camera.position[2] == float(frameIndex) && source.GetFrame(frameIndex, resolution.width, resolution.height, frame);
+                if (roundTrip) QuantizeFrame(frame, quantized);
+                roundTrip = roundTrip && AreFramesEqual(loaded, quantized);
+            }
+            const uint32_t loadedFrames = opened ? reader.GetFrameCount() : 0;
+            reader.Close();
+
+            // A capture cut off mid-frame keeps the frames before the cut
+            const std::string cutPath = capturePath + ".cut";
+            bool truncation = CopyFilePrefix(capturePath, cutPath, size_t(stats.fileBytes - 100)) && reader.Open(cutPath);
+            truncation = truncation && reader.GetFrameCount() + 1 == stats.writtenFrames && (reader.GetFrameCount() == 0 || reader.LoadFrame(reader.GetFrameCount() - 1, loaded));
+            reader.Close();
+            remove(cutPath.c_str());
+            if (!keep) remove(capturePath.c_str());
+
+            if (!roundTrip || !truncation)
+            {
+                fprintf(stderr, "capture %ux%u %s: %s\n", resolution.width, resolution.height, GetCaptureCompressionName(compression),
+                    !roundTrip ? "frames do not round trip" : "a truncated capture lost complete frames");
+                failedChecks++;
+            }
+
+            const double writtenFrames = double(std::max<uint64_t>(stats.writtenFrames, 1));
+            json.BeginObject();
+            json.Field("width", resolution.width);
+            json.Field("height", resolution.height);
+            json.Field("compression", GetCaptureCompressionName(compression));
+            json.Field("writtenFrames", uint32_t(stats.writtenFrames));
+            json.Field("droppedFrames", uint32_t(stats.droppedFrames));
+            json.Field("submitMs", submitMs / frameCount);
+            json.Field("compressMs", stats.compressMs / writtenFrames);
+            json.Field("writeMs", stats.writeMs / writtenFrames);
+            json.Field("captureMs", captureMs);
+            json.Field("rawBytesPerFrame", double(stats.rawBytes) / writtenFrames);
+            json.Field("fileBytesPerFrame", double(stats.fileBytes) / writtenFrames);
+            json.Field("legacyBytesPerFrame", double(legacyBytes) / frameCount);
+            json.Field("compressionRatio", double(stats.rawBytes) / double(std::max<uint64_t>(stats.fileBytes, 1)));
+            json.Field("openMs", openMs);
+            json.Field("loadMs", loadMs / std::max(1u, loadedFrames));
+            json.Field("roundTrip", roundTrip);
+            json.Field("truncation", truncation);
+            json.EndObject();
+        }
+    }
+
+    json.EndArray();
+    json.Field("failedChecks", failedChecks);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedChecks > 0 ? 2 : 0;
+}
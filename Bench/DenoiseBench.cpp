@@ -0,0 +1,543 @@
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include "Benchmarks.h"
+#include "../Cpu/FrameProfiler.h"
+#include "../Cpu/SVGF.h"
+#include "../Cpu/SVGFPacked.h"
+#include "../Cpu/SVGFSharedHistory.h"
+#include "../Cpu/Statistics.h"
+#include "../Cpu/Timer.h"
+
+using namespace Cpu;
+
+namespace
+{
+    struct SignalInfo
+    {
+        const char* name;
+        FrameTarget target;
+        const char* scope;      // RaysRenderer's pass
+    };
+
+    // Same three filters RaysRenderer runs in Hybrid mode
+    const SignalInfo kSignals[] =
+    {
+        { "shadow", FrameTarget::Shadow, "DenoiseShadows" },
+        { "reflection", FrameTarget::Reflection, "DenoiseReflection" },
+        { "ao", FrameTarget::AO, "DenoiseAO" },
+    };
+
+    const uint32_t kSignalCount = sizeof(kSignals) / sizeof(kSignals[0]);
+
+    const FrameTarget kRequiredTargets[] =
+    {
+        FrameTarget::MotionVector, FrameTarget::SVGF_LinearZ, FrameTarget::SVGF_CompactNormDepth,
+        FrameTarget::Shadow, FrameTarget::Reflection, FrameTarget::AO,
+    };
+
+    struct DenoiseConfig
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t atrousIterations;
+        uint32_t atrousRadius;
+        AtrousPath atrousPath;
+    };
+
+    struct AtrousPathInfo
+    {
+        const char* name;
+        AtrousPath path;
+    };
+
+    const AtrousPathInfo kAtrousPaths[] =
+    {
+        { "pixel", AtrousPath::Pixel },
+        { "tiled", AtrousPath::Tiled },
+    };
+
+    const AtrousPathInfo* FindAtrousPath(const std::string& name)
+    {
+        for (const AtrousPathInfo& info : kAtrousPaths)
+        {
+            if (name == info.name) return &info;
+        }
+        return nullptr;
+    }
+
+    // One way of running the Hybrid mode filters over a frame
+    class Denoiser
+    {
+    public:
+        virtual ~Denoiser() = default;
+        virtual void Execute(const FrameData& frame) = 0;
+        virtual uint32_t GetPassCount() const = 0;
+        virtual const char* GetPassName(uint32_t pass) const = 0;
+        virtual const SVGFTimings& GetTimings(uint32_t pass) const = 0;
+        virtual size_t GetAllocatedBytes(uint32_t pass) const = 0;
+        virtual bool SupportsAtrousPath(AtrousPath path) const = 0;
+        virtual bool IsAtrousTiled(uint32_t iteration) const = 0;
+
+        // Filtered signal in the single-signal layout (rgb, variance), indexed like kSignals
+        virtual void GetOutput(uint32_t signal, Image4F& output) const = 0;
+    };
+
+    // One SVGFPass per signal, as RaysRenderer does by default
+    class SeparateDenoiser : public Denoiser
+    {
+    public:
+        SeparateDenoiser(const DenoiseConfig& config, ThreadPool& threadPool)
+        {
+            for (auto& filter : mFilters)
+            {
+                filter.reset(new SVGFPass(config.width, config.height, &threadPool));
+                filter->GetSettings().atrousIterations = config.atrousIterations;
+                filter->GetSettings().atrousRadius = config.atrousRadius;
+                filter->GetSettings().atrousPath = config.atrousPath;
+            }
+        }
+
+        void Execute(const FrameData& frame) override
+        {
+            for (uint32_t s = 0; s < kSignalCount; ++s)
+            {
+                FRAME_PROFILE(kSignals[s].scope);
+                mFilters[s]->Execute(frame.Get(kSignals[s].target), frame.Get(FrameTarget::MotionVector),
+                    frame.Get(FrameTarget::SVGF_LinearZ), frame.Get(FrameTarget::SVGF_CompactNormDepth));
+            }
+        }
+
+        uint32_t GetPassCount() const override { return kSignalCount; }
+        const char* GetPassName(uint32_t pass) const override { return kSignals[pass].name; }
+        const SVGFTimings& GetTimings(uint32_t pass) const override { return mFilters[pass]->GetTimings(); }
+        size_t GetAllocatedBytes(uint32_t pass) const override { return mFilters[pass]->GetAllocatedBytes(); }
+        bool SupportsAtrousPath(AtrousPath) const override { return true; }
+        bool IsAtrousTiled(uint32_t iteration) const override { return mFilters[0]->IsAtrousTiled(iteration); }
+        void GetOutput(uint32_t signal, Image4F& output) const override { output = mFilters[signal]->GetOutput(); }
+
+    private:
+        std::unique_ptr<SVGFPass> mFilters[kSignalCount];
+    };
+
+    // All three signals through one SVGFPackedPass
+    class PackedDenoiser : public Denoiser
+    {
+    public:
+        PackedDenoiser(const DenoiseConfig& config, ThreadPool& threadPool)
+            : mFilter(config.width, config.height, &threadPool)
+        {
+            mFilter.GetSettings().atrousIterations = config.atrousIterations;
+            mFilter.GetSettings().atrousRadius = config.atrousRadius;
+        }
+
+        void Execute(const FrameData& frame) override
+        {
+            FRAME_PROFILE("DenoisePacked");
+            mFilter.Execute(frame.Get(FrameTarget::Reflection), frame.Get(FrameTarget::Shadow), frame.Get(FrameTarget::AO),
+                frame.Get(FrameTarget::MotionVector), frame.Get(FrameTarget::SVGF_LinearZ), frame.Get(FrameTarget::SVGF_CompactNormDepth));
+        }
+
+        uint32_t GetPassCount() const override { return 1; }
+        const char* GetPassName(uint32_t) const override { return "packed"; }
+        const SVGFTimings& GetTimings(uint32_t) const override { return mFilter.GetTimings(); }
+        size_t GetAllocatedBytes(uint32_t) const override { return mFilter.GetAllocatedBytes(); }
+
+        // The packed filter only has the pixel kernel
+        bool SupportsAtrousPath(AtrousPath path) const override { return path == AtrousPath::Pixel; }
+        bool IsAtrousTiled(uint32_t) const override { return false; }
+
+        void GetOutput(uint32_t signal, Image4F& output) const override
+        {
+            const FrameTarget target = kSignals[signal].target;
+            if (target == FrameTarget::Reflection)
+            {
+                output = mFilter.GetReflectionOutput();
+                return;
+            }
+
+            const Image4F& scalar = mFilter.GetScalarOutput();
+            const bool isShadow = (target == FrameTarget::Shadow);
+            output.Resize(scalar.GetWidth(), scalar.GetHeight());
+            for (uint32_t y = 0; y < scalar.GetHeight(); ++y)
+            {
+                for (uint32_t x = 0; x < scalar.GetWidth(); ++x)
+                {
+                    const float4 s = scalar.At(x, y);
+                    output.At(x, y) = isShadow ? float4(s.x, 0.0f, 0.0f, s.y) : float4(s.z, 0.0f, 0.0f, s.w);
+                }
+            }
+        }
+
+    private:
+        SVGFPackedPass mFilter;
+    };
+
+    // One SVGFPass per signal in the compact fp16 layout, sharing history length and previous linear Z
+    // the way RaysRenderer runs the separate filters
+    class CompactDenoiser : public Denoiser
+    {
+    public:
+        CompactDenoiser(const DenoiseConfig& config, ThreadPool& threadPool)
+            : mHistory(config.width, config.height, &threadPool)
+        {
+            for (uint32_t s = 0; s < kSignalCount; ++s)
+            {
+                const SVGFSignalType signalType = (kSignals[s].target == FrameTarget::Reflection) ? SVGFSignalType::Color : SVGFSignalType::Scalar;
+                mFilters[s].reset(new SVGFPass(config.width, config.height, mHistory, signalType, &threadPool));
+                mFilters[s]->GetSettings().atrousIterations = config.atrousIterations;
+                mFilters[s]->GetSettings().atrousRadius = config.atrousRadius;
+                mFilters[s]->GetSettings().atrousPath = config.atrousPath;
+            }
+        }
+
+        void Execute(const FrameData& frame) override
+        {
+            const Image4F& motionVec = frame.Get(FrameTarget::MotionVector);
+            const Image4F& linearZ = frame.Get(FrameTarget::SVGF_LinearZ);
+
+            {
+                FRAME_PROFILE("SVGFHistory");
+                mHistory.Update(motionVec, linearZ);
+            }
+            for (uint32_t s = 0; s < kSignalCount; ++s)
+            {
+                FRAME_PROFILE(kSignals[s].scope);
+                mFilters[s]->Execute(frame.Get(kSignals[s].target), motionVec, linearZ, frame.Get(FrameTarget::SVGF_CompactNormDepth));
+            }
+            {
+                FRAME_PROFILE("SVGFHistoryEnd");
+                mHistory.EndFrame(linearZ);
+            }
+
+            mHistoryTimings.totalMs = mHistory.GetUpdateMs();
+        }
+
+        // The shared history is reported as one more pass
+        uint32_t GetPassCount() const override { return kSignalCount + 1; }
+        const char* GetPassName(uint32_t pass) const override { return pass < kSignalCount ? kSignals[pass].name : "sharedHistory"; }
+        const SVGFTimings& GetTimings(uint32_t pass) const override { return pass < kSignalCount ? mFilters[pass]->GetTimings() : mHistoryTimings; }
+        size_t GetAllocatedBytes(uint32_t pass) const override { return pass < kSignalCount ? mFilters[pass]->GetAllocatedBytes() : mHistory.GetAllocatedBytes(); }
+        bool SupportsAtrousPath(AtrousPath) const override { return true; }
+        bool IsAtrousTiled(uint32_t iteration) const override { return mFilters[0]->IsAtrousTiled(iteration); }
+        void GetOutput(uint32_t signal, Image4F& output) const override { output = mFilters[signal]->GetOutput(); }
+
+    private:
+        SVGFSharedHistory mHistory;
+        SVGFTimings mHistoryTimings;
+        std::unique_ptr<SVGFPass> mFilters[kSignalCount];
+    };
+
+    std::unique_ptr<Denoiser> CreateDenoiser(const std::string& mode, const DenoiseConfig& config, ThreadPool& threadPool)
+    {
+        if (mode == "separate") return std::unique_ptr<Denoiser>(new SeparateDenoiser(config, threadPool));
+        if (mode == "packed") return std::unique_ptr<Denoiser>(new PackedDenoiser(config, threadPool));
+        if (mode == "compact") return std::unique_ptr<Denoiser>(new CompactDenoiser(config, threadPool));
+        return nullptr;
+    }
+
+    struct StageSamples
+    {
+        std::vector<double> total;
+        std::vector<double> decode;
+        std::vector<double> reprojection;
+        std::vector<double> varianceEstimation;
+        std::vector<std::vector<double>> atrous;
+        std::vector<double> feedback;
+
+        void Add(const SVGFTimings& timings)
+        {
+            total.push_back(timings.totalMs);
+            decode.push_back(timings.decodeMs);
+            reprojection.push_back(timings.reprojectionMs);
+            varianceEstimation.push_back(timings.varianceEstimationMs);
+            feedback.push_back(timings.feedbackMs);
+            atrous.resize(timings.atrousMs.size());
+            for (size_t i = 0; i < timings.atrousMs.size(); ++i) atrous[i].push_back(timings.atrousMs[i]);
+        }
+    };
+
+    // Mean of the filtered signal, a cheap fingerprint that flags accidental changes in the result
+    float3 ComputeMean(const Image4F& image)
+    {
+        double sum[3] = {};
+        for (uint32_t y = 0; y < image.GetHeight(); ++y)
+        {
+            const float4* row = image.GetRow(y);
+            for (uint32_t x = 0; x < image.GetWidth(); ++x)
+            {
+                sum[0] += row[x].x;
+                sum[1] += row[x].y;
+                sum[2] += row[x].z;
+            }
+        }
+        const double n = double(std::max<size_t>(1, image.GetPixelCount()));
+        return float3(float(sum[0] / n), float(sum[1] / n), float(sum[2] / n));
+    }
+
+    float ComputeMaxDifference(const Image4F& a, const Image4F& b)
+    {
+        if (a.GetWidth() != b.GetWidth() || a.GetHeight() != b.GetHeight()) return INFINITY;
+
+        float maxDifference = 0.0f;
+        for (size_t i = 0; i < a.GetPixelCount(); ++i)
+        {
+            const float3 d = abs(a.GetData()[i].rgb() - b.GetData()[i].rgb());
+            maxDifference = std::max(maxDifference, std::max(d.x, std::max(d.y, d.z)));
+        }
+        return maxDifference;
+    }
+
+    void WriteStages(JsonWriter& json, const StageSamples& samples)
+    {
+        json.Key("stages").BeginObject();
+        WriteStats(json, "decode", ComputeStats(samples.decode));
+        WriteStats(json, "reprojection", ComputeStats(samples.reprojection));
+        WriteStats(json, "varianceEstimation", ComputeStats(samples.varianceEstimation));
+        json.Key("atrous").BeginArray();
+        for (const auto& iteration : samples.atrous)
+        {
+            const SampleStats stats = ComputeStats(iteration);
+            json.BeginObject();
+            json.Field("mean", stats.mean);
+            json.Field("p50", stats.p50);
+            json.Field("p99", stats.p99);
+            json.EndObject();
+        }
+        json.EndArray();
+        WriteStats(json, "feedback", ComputeStats(samples.feedback));
+        json.EndObject();
+    }
+}
+
+int RunDenoiseBench(const CommandLine& args)
+{
+    const std::string sequence = args.GetString("sequence", "");
+    const uint32_t frameCount = std::max(1u, args.GetUint("frames", 60));
+    const uint32_t warmupCount = args.GetUint("warmup", 5);
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolutions", "1280x720,1920x1080");
+    const std::vector<uint32_t> iterationCounts = args.GetUintList("iterations", "2,4");
+    const std::vector<uint32_t> radii = args.GetUintList("radius", "1,2");
+    const std::vector<std::string> modes = args.GetStringList("modes", "separate,packed,compact");
+    const std::vector<std::string> atrousPathNames = args.GetStringList("atrous-paths", "pixel,tiled");
+    const std::string outputPath = args.GetString("output", "");
+
+    // Largest per-channel difference to the reference run that still counts as the same image
+    const float tolerance = args.GetFloat("tolerance", 0.01f);
+    uint32_t failedRuns = 0;
+
+    ThreadPool threadPool(args.GetUint("threads", 0));
+    FrameSource source(sequence, threadPool);
+    if (!source.IsValid())
+    {
+        fprintf(stderr, "No frames found in '%s'\n", sequence.c_str());
+        return 1;
+    }
+
+    std::vector<const AtrousPathInfo*> atrousPaths;
+    for (const std::string& name : atrousPathNames)
+    {
+        const AtrousPathInfo* info = FindAtrousPath(name);
+        if (!info)
+        {
+            fprintf(stderr, "Unknown a-trous path '%s'\n", name.c_str());
+            return 1;
+        }
+        atrousPaths.push_back(info);
+    }
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "denoise");
+    json.Field("source", source.GetName());
+    json.Field("threads", threadPool.GetThreadCount());
+    json.Field("frames", frameCount);
+    json.Field("warmup", warmupCount);
+    json.Key("runs").BeginArray();
+
+    FrameData frame;
+    for (const Resolution& resolution : resolutions)
+    {
+        for (uint32_t iterations : iterationCounts)
+        {
+            for (uint32_t radius : radii)
+            {
+                // Final outputs of the first run, every other run is compared against them
+                std::vector<Image4F> referenceOutputs;
+                std::string referenceMode;
+
+                // Per-iteration a-trous p50 of the first path run for each mode, the base of the speedups
+                std::map<std::string, std::vector<double>> referenceAtrousMs;
+
+                for (const std::string& mode : modes)
+                {
+                    for (const AtrousPathInfo* atrousPath : atrousPaths)
+                    {
+                        const DenoiseConfig config = { resolution.width, resolution.height, iterations, radius, atrousPath->path };
+
+                        std::unique_ptr<Denoiser> denoiser = CreateDenoiser(mode, config, threadPool);
+                        if (!denoiser)
+                        {
+                            fprintf(stderr, "Unknown denoise mode '%s'\n", mode.c_str());
+                            return 1;
+                        }
+                        if (!denoiser->SupportsAtrousPath(atrousPath->path)) continue;
+
+                        fprintf(stderr, "denoise %s %s %ux%u iterations=%u radius=%u\n", mode.c_str(), atrousPath->name, resolution.width, resolution.height, iterations, radius);
+
+                        std::vector<double> frameMs;
+                        std::vector<StageSamples> stageSamples(denoiser->GetPassCount());
+                        size_t inputBytes = 0;
+
+                        for (uint32_t i = 0; i < warmupCount + frameCount; ++i)
+                        {
+                            if (!source.GetFrame(i, resolution.width, resolution.height, frame))
+                            {
+                                fprintf(stderr, "Failed to load frame %u\n", i);
+                                return 1;
+                            }
+                            for (FrameTarget target : kRequiredTargets)
+                            {
+                                if (!frame.HasTarget(target))
+                                {
+                                    fprintf(stderr, "Frame %u has no %s target\n", i, GetFrameTargetName(target));
+                                    return 1;
+                                }
+                            }
+                            inputBytes = frame.GetSizeInBytes();
+
+                            FrameProfiler::MarkFrame();
+                            Timer timer;
+                            denoiser->Execute(frame);
+                            const double elapsedMs = timer.GetElapsedMs();
+
+                            if (i < warmupCount) continue;
+                            frameMs.push_back(elapsedMs);
+                            for (uint32_t p = 0; p < denoiser->GetPassCount(); ++p) stageSamples[p].Add(denoiser->GetTimings(p));
+                        }
+
+                        const SampleStats frameStats = ComputeStats(frameMs);
+                        const double megapixels = double(resolution.width) * resolution.height * 1e-6;
+
+                        json.BeginObject();
+                        json.Field("mode", mode);
+                        json.Field("width", resolution.width);
+                        json.Field("height", resolution.height);
+                        json.Field("atrousIterations", iterations);
+                        json.Field("atrousRadius", radius);
+                        json.Field("atrousPath", atrousPath->name);
+                        WriteStats(json, "frameMs", frameStats);
+                        json.Field("megapixelsPerSecond", frameStats.p50 > 0.0 ? megapixels * kSignalCount / (frameStats.p50 * 1e-3) : 0.0);
+
+                        size_t passBytes = 0;
+                        json.Key("passes").BeginArray();
+                        for (uint32_t p = 0; p < denoiser->GetPassCount(); ++p)
+                        {
+                            passBytes += denoiser->GetAllocatedBytes(p);
+
+                            json.BeginObject();
+                            json.Field("name", denoiser->GetPassName(p));
+                            WriteStats(json, "totalMs", ComputeStats(stageSamples[p].total));
+                            WriteStages(json, stageSamples[p]);
+                            json.Field("allocatedBytes", uint64_t(denoiser->GetAllocatedBytes(p)));
+                            json.EndObject();
+                        }
+                        json.EndArray();
+
+                        // A-trous time per step size summed over the passes, with the speedup over the first path of this mode
+                        std::vector<double> atrousMs(iterations, 0.0);
+                        for (uint32_t p = 0; p < denoiser->GetPassCount(); ++p)
+                        {
+                            for (uint32_t i = 0; i < iterations && i < stageSamples[p].atrous.size(); ++i) atrousMs[i] += ComputeStats(stageSamples[p].atrous[i]).p50;
+                        }
+
+                        const bool isAtrousReference = referenceAtrousMs.count(mode) == 0;
+                        if (isAtrousReference) referenceAtrousMs[mode] = atrousMs;
+                        const std::vector<double>& baseAtrousMs = referenceAtrousMs[mode];
+
+                        json.Key("atrousSteps").BeginArray();
+                        for (uint32_t i = 0; i < iterations; ++i)
+                        {
+                            json.BeginObject();
+                            json.Field("stepSize", 1u << i);
+                            json.Field("tiled", denoiser->IsAtrousTiled(i));
+                            json.Field("p50Ms", atrousMs[i]);
+                            if (!isAtrousReference) json.Field("speedup", atrousMs[i] > 0.0 ? baseAtrousMs[i] / atrousMs[i] : 0.0);
+                            json.EndObject();
+                        }
+                        json.EndArray();
+
+                        const bool isReference = referenceOutputs.empty();
+                        if (isReference)
+                        {
+                            referenceOutputs.resize(kSignalCount);
+                            referenceMode = mode + "/" + atrousPath->name;
+                        }
+
+                        float maxDifference = 0.0f;
+                        json.Key("signals").BeginArray();
+                        Image4F output;
+                        for (uint32_t s = 0; s < kSignalCount; ++s)
+                        {
+                            denoiser->GetOutput(s, output);
+                            const float3 mean = ComputeMean(output);
+
+                            json.BeginObject();
+                            json.Field("name", kSignals[s].name);
+                            json.Key("outputMean").BeginArray().Value(double(mean.x)).Value(double(mean.y)).Value(double(mean.z)).EndArray();
+                            if (isReference)
+                            {
+                                referenceOutputs[s] = output;
+                            }
+                            else
+                            {
+                                const float difference = ComputeMaxDifference(output, referenceOutputs[s]);
+                                maxDifference = std::max(maxDifference, difference);
+                                json.Field("maxDifference", double(difference));
+                            }
+                            json.EndObject();
+                        }
+                        json.EndArray();
+                        if (!isReference)
+                        {
+                            const bool withinTolerance = (maxDifference <= tolerance);
+                            json.Field("comparedTo", referenceMode);
+                            json.Field("withinTolerance", withinTolerance);
+                            if (!withinTolerance)
+                            {
+                                fprintf(stderr, "denoise %s %s differs from %s by %g (tolerance %g)\n", mode.c_str(), atrousPath->name, referenceMode.c_str(), maxDifference, tolerance);
+                                failedRuns++;
+                            }
+                        }
+
+                        json.Key("memory").BeginObject();
+                        json.Field("passBytes", uint64_t(passBytes));
+                        json.Field("inputBytes", uint64_t(inputBytes));
+                        json.EndObject();
+                        json.EndObject();
+                    }
+                }
+            }
+        }
+    }
+
+    json.EndArray();
+    json.Field("peakResidentBytes", uint64_t(GetPeakResidentBytes()));
+    json.Field("tolerance", tolerance);
+    json.Field("failedRuns", failedRuns);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedRuns > 0 ? 2 : 0;
+}
@@ -0,0 +1,246 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "Benchmarks.h"
+#include "../Cpu/DynamicResolution.h"
+#include "../Cpu/JsonWriter.h"
+
+using namespace Cpu;
+
+namespace
+{
+    // GPU cost of RaysRenderer at full render resolution. Everything scales with the pixel count,
+    // ray tracing also with the ray fraction of the effect's ray scale.
+    struct CostModel
+    {
+        float fixedMs;
+        float rasterMs;         // G-buffer, deferred pass, TAA
+        float traceMs[kDynamicEffectCount];
+        float denoiseMs[kDynamicEffectCount];
+        float upsampleMs;       // Per effect traced below full resolution
+    };
+
+    const CostModel kLightLoad = { 1.5f, 2.5f, { 2.0f, 3.0f, 2.0f }, { 1.0f, 1.5f, 1.0f }, 0.2f };
+    const CostModel kHeavyLoad = { 1.5f, 4.0f, { 5.0f, 9.0f, 5.0f }, { 1.2f, 1.8f, 1.2f }, 0.3f };
+    const CostModel kRasterLoad = { 1.5f, 14.0f, { 3.0f, 4.0f, 3.0f }, { 1.0f, 1.5f, 1.0f }, 0.2f };   // Needs a lower resolution
+
+    enum class TraceShape : uint32_t
+    {
+        Constant = 0,
+        Spike,      // Reflection cost triples through the middle third, e.g. the camera turning to a mirror
+        Sweep       // Reflection cost follows a slow camera pan
+    };
+
+    struct Trace
+    {
+        const char* name;
+        const CostModel* load;
+        TraceShape shape;
+        float noise;                // Uniform per frame jitter, fraction of the frame time
+        bool expectNoChanges;
+        bool expectFullQualityAtEnd;
+        bool expectStableTail;      // No change in the last quarter
+    };
+
+    const Trace kTraces[] =
+    {
+        { "light", &kLightLoad, TraceShape::Constant, 0.0f, true, true, true },
+        { "heavy", &kHeavyLoad, TraceShape::Constant, 0.0f, false, false, true },
+        { "raster", &kRasterLoad, TraceShape::Constant, 0.0f, false, false, true },
+        { "noisy", &kHeavyLoad, TraceShape::Constant, 0.2f, false, false, false },
+        { "spike", &kLightLoad, TraceShape::Spike, 0.05f, false, true, true },
+        { "sweep", &kLightLoad, TraceShape::Sweep, 0.05f, false, false, false },
+    };
+
+    float GetReflectionMultiplier(TraceShape shape, uint32_t frame, uint32_t frameCount)
+    {
+        if (shape == TraceShape::Spike) return (frame >= frameCount / 3 && frame < frameCount * 2 / 3) ? 3.0f : 1.0f;
+        if (shape == TraceShape::Sweep)
+        {
+            const float s = std::sin(3.14159265f * float(frame) / float(frameCount) * 2.0f);
+            return 1.0f + 2.0f * s * s;
+        }
+        return 1.0f;
+    }
+
+    DynamicResolutionTimings SimulateFrame(const Trace& trace, const DynamicResolutionState& state, uint32_t frame, uint32_t frameCount, uint32_t& randState)
+    {
+        const CostModel& load = *trace.load;
+        const float pixels = state.renderScale * state.renderScale;
+
+        DynamicResolutionTimings timings;
+        timings.frameMs = load.fixedMs + load.rasterMs * pixels;
+        for (uint32_t i = 0; i < kDynamicEffectCount; ++i)
+        {
+            const float multiplier = (i == uint32_t(DynamicEffect::Reflection)) ? GetReflectionMultiplier(trace.shape, frame, frameCount) : 1.0f;
+            const RayScale scale = state.rayScales[i];
+            timings.traceMs[i] = load.traceMs[i] * multiplier * DynamicResolutionController::GetRayFraction(scale) * pixels;
+            timings.denoiseMs[i] = load.denoiseMs[i] * pixels;
+            timings.frameMs += timings.traceMs[i] + timings.denoiseMs[i];
+            if (scale != RayScale::Full) timings.frameMs += load.upsampleMs * pixels;
+        }
+
+        // Deterministic LCG, so that runs are comparable
+        randState = randState * 1664525u + 1013904223u;
+        const float r = float(randState >> 8) / float(1u << 24) * 2.0f - 1.0f;
+        const float jitter = 1.0f + r * trace.noise;
+        timings.frameMs *= jitter;
+        for (float& ms : timings.traceMs) ms *= jitter;
+        for (float& ms : timings.denoiseMs) ms *= jitter;
+        return timings;
+    }
+
+    bool IsDowngrade(const DynamicResolutionState& from, const DynamicResolutionState& to)
+    {
+        if (to.renderScale != from.renderScale) return to.renderScale < from.renderScale;
+        for (uint32_t i = 0; i < kDynamicEffectCount; ++i)
+        {
+            if (to.rayScales[i] != from.rayScales[i]) return DynamicResolutionController::GetRayFraction(to.rayScales[i]) < DynamicResolutionController::GetRayFraction(from.rayScales[i]);
+        }
+        return false;
+    }
+
+    const char* GetRayScaleName(RayScale scale)
+    {
+        switch (scale)
+        {
+        case RayScale::Half: return "half";
+        case RayScale::Checkerboard: return "checkerboard";
+        case RayScale::Quarter: return "quarter";
+        default: return "full";
+        }
+    }
+}
+
+int RunDynamicResolutionBench(const CommandLine& args)
+{
+    const std::vector<std::string> traceNames = args.GetStringList("traces", "light,heavy,raster,noisy,spike,sweep");
+    const uint32_t frameCount = std::max(120u, args.GetUint("frames", 1800));
+    const std::string outputPath = args.GetString("output", "");
+
+    DynamicResolutionSettings settings;
+    settings.targetFrameMs = args.GetFloat("target-ms", settings.targetFrameMs);
+
+    // Frames over budget by more than this are counted against the controller once it had time to react
+    const float kOverBudgetTolerance = 1.1f;
+    const uint32_t reactionFrames = settings.settleFrames * 8;
+    const float maxOverBudgetFraction = 0.05f;
+    // An opposite change within this many frames of the last one is an oscillation
+    const uint32_t oscillationWindow = settings.settleFrames * 3;
+    const uint32_t maxOscillations = 2;
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "dynamicResolution");
+    json.Field("targetFrameMs", settings.targetFrameMs);
+    json.Field("frames", frameCount);
+    json.Key("traces").BeginArray();
+
+    uint32_t failedRuns = 0;
+
+    for (const std::string& traceName : traceNames)
+    {
+        const Trace* trace = nullptr;
+        for (const Trace& candidate : kTraces)
+        {
+            if (traceName == candidate.name) trace = &candidate;
+        }
+        if (!trace)
+        {
+            fprintf(stderr, "Unknown trace '%s'\n", traceName.c_str());
+            return 1;
+        }
+
+        DynamicResolutionController controller(settings);
+        uint32_t randState = 12345;
+
+        uint32_t changes = 0;
+        uint32_t tailChanges = 0;
+        uint32_t oscillations = 0;
+        uint32_t overBudgetFrames = 0;
+        uint32_t judgedFrames = 0;
+        uint32_t lastChangeFrame = 0;
+        bool lastChangeWasDowngrade = false;
+        double frameMsSum = 0.0;
+        double renderScaleSum = 0.0;
+        float minRenderScale = 1.0f;
+
+        for (uint32_t frame = 0; frame < frameCount; ++frame)
+        {
+            const DynamicResolutionState before = controller.GetState();
+            const DynamicResolutionTimings timings = SimulateFrame(*trace, before, frame, frameCount, randState);
+
+            frameMsSum += timings.frameMs;
+            renderScaleSum += before.renderScale;
+            minRenderScale = std::min(minRenderScale, before.renderScale);
+
+            // Give the controller time to react to the start of the trace and to every load change of the spike
+            const bool loadChanged = trace->shape == TraceShape::Spike && (frame >= frameCount / 3 && frame < frameCount / 3 + reactionFrames);
+            if (frame >= reactionFrames && !loadChanged)
+            {
+                judgedFrames++;
+                if (timings.frameMs > settings.targetFrameMs * kOverBudgetTolerance * (1.0f + trace->noise)) overBudgetFrames++;
+            }
+
+            if (!controller.Update(timings)) continue;
+
+            const bool downgrade = IsDowngrade(before, controller.GetState());
+            if (changes > 0 && downgrade != lastChangeWasDowngrade && frame - lastChangeFrame < oscillationWindow) oscillations++;
+            if (frame >= frameCount * 3 / 4) tailChanges++;
+            changes++;
+            lastChangeFrame = frame;
+            lastChangeWasDowngrade = downgrade;
+        }
+
+        const DynamicResolutionState& state = controller.GetState();
+        const bool fullQuality = (state == DynamicResolutionState());
+        const float overBudgetFraction = judgedFrames > 0 ? float(overBudgetFrames) / float(judgedFrames) : 0.0f;
+
+        bool ok = overBudgetFraction <= maxOverBudgetFraction && oscillations <= maxOscillations;
+        if (trace->expectNoChanges) ok = ok && changes == 0;
+        if (trace->expectFullQualityAtEnd) ok = ok && fullQuality;
+        if (trace->expectStableTail) ok = ok && tailChanges == 0;
+        if (!ok)
+        {
+            fprintf(stderr, "dynamic resolution trace %s: %u changes, %u in the tail, %u oscillations, %.1f%% frames over budget\n",
+                trace->name, changes, tailChanges, oscillations, overBudgetFraction * 100.0f);
+            failedRuns++;
+        }
+
+        json.BeginObject();
+        json.Field("trace", trace->name);
+        json.Field("ok", ok);
+        json.Field("changes", changes);
+        json.Field("tailChanges", tailChanges);
+        json.Field("oscillations", oscillations);
+        json.Field("overBudgetFraction", overBudgetFraction);
+        json.Field("meanFrameMs", float(frameMsSum / frameCount));
+        json.Field("meanRenderScale", float(renderScaleSum / frameCount));
+        json.Field("minRenderScale", minRenderScale);
+        json.Key("final").BeginObject();
+        json.Field("renderScale", state.renderScale);
+        json.Field("shadowRays", GetRayScaleName(state.rayScales[uint32_t(DynamicEffect::Shadows)]));
+        json.Field("reflectionRays", GetRayScaleName(state.rayScales[uint32_t(DynamicEffect::Reflection)]));
+        json.Field("aoRays", GetRayScaleName(state.rayScales[uint32_t(DynamicEffect::AO)]));
+        json.Field("averageFrameMs", controller.GetAverageFrameMs());
+        json.EndObject();
+        json.EndObject();
+    }
+
+    json.EndArray();
+    json.Field("failedRuns", failedRuns);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedRuns > 0 ? 2 : 0;
+}
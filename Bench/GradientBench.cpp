@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include "Benchmarks.h"
+#include "../Cpu/AdaptiveSampling.h"
+#include "../Cpu/Bvh.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/RaytracedEffects.h"
+#include "../Cpu/SVGF.h"
+#include "../Cpu/SVGFSharedHistory.h"
+
+using namespace Cpu;
+
+namespace
+{
+    const float kAODistance = 3.0f;     // Same as the synthetic scene's analytic AO
+
+    enum class Effect : uint32_t
+    {
+        Shadows = 0,
+        Reflection,
+        AO,
+        Count
+    };
+
+    const uint32_t kEffectCount = uint32_t(Effect::Count);
+    const char* const kEffectNames[kEffectCount] = { "shadows", "reflection", "ao" };
+    const SVGFSignalType kSignalTypes[kEffectCount] = { SVGFSignalType::Scalar, SVGFSignalType::Color, SVGFSignalType::Scalar };
+
+    void Trace(RaytracedEffects& effects, Effect effect, const RtGBuffer& gBuffer, uint32_t frameCount, Image4F& output)
+    {
+        switch (effect)
+        {
+        case Effect::Shadows: effects.TraceShadows(gBuffer, RayScale::Full, frameCount, output); break;
+        case Effect::Reflection: effects.TraceReflection(gBuffer, RayScale::Full, frameCount, output); break;
+        default: effects.TraceAO(gBuffer, RayScale::Full, frameCount, kAODistance, output); break;
+        }
+    }
+
+    // Every pixel with the same number of rays
+    void BuildUniformWorkList(uint32_t width, uint32_t height, uint32_t rays, std::vector<uint32_t>& workList)
+    {
+        workList.clear();
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x) workList.push_back(x | (y << 14) | (rays << 28));
+        }
+    }
+
+    // Sum of squared rgb differences over the pixels with geometry, accumulated over frames
+    struct ErrorAccumulator
+    {
+        double sumSquared = 0.0;
+        double count = 0.0;
+
+        void Add(const Image4F& a, const Image4F& b, const Image4F& worldPosition)
+        {
+            for (size_t i = 0; i < a.GetPixelCount(); ++i)
+            {
+                if (worldPosition.GetData()[i].w == 0.0f) continue;
+                const float3 d = a.GetData()[i].rgb() - b.GetData()[i].rgb();
+                sumSquared += double(d.x) * d.x + double(d.y) * d.y + double(d.z) * d.z;
+                count += 3.0;
+            }
+        }
+
+        double GetRmse() const { return count > 0.0 ? std::sqrt(sumSquared / count) : 0.0; }
+    };
+
+    // Plain SVGF or A-SVGF, each with its own denoisers in the compact layout the app uses
+    struct FilterRun
+    {
+        std::string name;
+        bool temporalGradients = false;
+
+        std::unique_ptr<SVGFSharedHistory> history;
+        std::unique_ptr<SVGFPass> filters[kEffectCount];
+        Image4F traced[kEffectCount];
+
+        uint64_t rays[kEffectCount] = {};
+        double filterMs[kEffectCount] = {};
+        double gradientMs[kEffectCount] = {};
+        double projectionMs = 0.0;
+        double coveredStrata = 0.0;     // Summed over the measured frames, as are the two below
+        double meanLambda[kEffectCount] = {};
+        ErrorAccumulator error[kEffectCount];
+    };
+
+    // The light turned by angle around the vertical
+    SceneLight RotateLight(const SceneLight& light, float angle)
+    {
+        SceneLight rotated = light;
+        const float c = std::cos(angle);
+        const float s = std::sin(angle);
+        rotated.direction = float3(c * light.direction.x + s * light.direction.z, light.direction.y, c * light.direction.z - s * light.direction.x);
+        return rotated;
+    }
+
+    double GetCoveredStrata(const Image<GradientSample>& samples)
+    {
+        size_t covered = 0;
+        for (size_t i = 0; i < samples.GetPixelCount(); ++i) covered += samples.GetData()[i].claim != kNoGradientSample ? 1 : 0;
+        return samples.GetPixelCount() > 0 ? double(covered) / double(samples.GetPixelCount()) : 0.0;
+    }
+
+    double GetMeanLambda(const Image4F& gradient)
+    {
+        double sum = 0.0;
+        for (size_t i = 0; i < gradient.GetPixelCount(); ++i) sum += GetGradientLambda(gradient.GetData()[i]);
+        return gradient.GetPixelCount() > 0 ? sum / double(gradient.GetPixelCount()) : 0.0;
+    }
+}
+
+int RunGradientBench(const CommandLine& args)
+{
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolutions", "320x180");
+    const uint32_t frameCount = std::max(1u, args.GetUint("frames", 32));
+    const uint32_t warmupCount = args.GetUint("warmup", 8);
+    const uint32_t sphereSegments = args.GetUint("segments", 64);
+    const float lightSpeed = args.GetFloat("light-speed", 5.0f) * kPi / 180.0f;
+    const uint32_t referenceRays = std::max(1u, args.GetUint("reference-rays", 32));
+    const float minCoverage = args.GetFloat("min-coverage", 0.9f);
+    const std::string outputPath = args.GetString("output", "");
+
+    ThreadPool threadPool(args.GetUint("threads", 0));
+
+    uint32_t failedChecks = 0;
+    auto check = [&](bool condition, const std::string& name, const char* message)
+    {
+        if (condition) return;
+        fprintf(stderr, "gradient: %s: %s\n", name.c_str(), message);
+        failedChecks++;
+    };
+
+    SyntheticScene syntheticScene;
+    TriangleScene scene;
+    syntheticScene.BuildTriangleScene(sphereSegments, scene);
+    Bvh bvh;
+    bvh.Build(scene, BvhBuildSettings(), &threadPool);
+    RaytracedEffects effects(scene, bvh, threadPool);
+    const SceneLight baseLight = scene.GetLight(0);
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "gradient");
+    json.Field("threads", threadPool.GetThreadCount());
+    json.Field("frames", frameCount);
+    json.Field("warmup", warmupCount);
+    json.Field("lightSpeedDegrees", lightSpeed * 180.0f / kPi);
+    json.Field("referenceRays", referenceRays);
+    json.Key("runs").BeginArray();
+
+    FrameData frame;
+    for (const Resolution& resolution : resolutions)
+    {
+        const std::string resolutionName = std::to_string(resolution.width) + "x" + std::to_string(resolution.height);
+        fprintf(stderr, "gradient %s\n", resolutionName.c_str());
+
+        auto createRun = [&](const std::string& name, bool temporalGradients)
+        {
+            std::unique_ptr<FilterRun> run(new FilterRun());
+            run->name = name;
+            run->temporalGradients = temporalGradients;
+            run->history.reset(new SVGFSharedHistory(resolution.width, resolution.height, &threadPool));
+            run->history->EnableTemporalGradients(temporalGradients);
+            for (uint32_t e = 0; e < kEffectCount; ++e)
+            {
+                run->filters[e].reset(new SVGFPass(resolution.width, resolution.height, *run->history, kSignalTypes[e], &threadPool));
+            }
+            return run;
+        };
+
+        // One frame of a run. The ray tracers draw the frame's own seeds, except where a gradient sample landed.
+        auto runFrame = [&](FilterRun& run, uint32_t frameIndex, const RtGBuffer& gBuffer, bool measured)
+        {
+            const Image4F& motionVec = frame.Get(FrameTarget::MotionVector);
+            const Image4F& linearZ = frame.Get(FrameTarget::SVGF_LinearZ);
+            const Image4F& normalDepth = frame.Get(FrameTarget::SVGF_CompactNormDepth);
+
+            run.history->Update(motionVec, linearZ, frameIndex);
+            const Image<GradientSample>* samples = run.temporalGradients ? &run.history->GetGradientSamples() : nullptr;
+            effects.SetGradientSamples(samples);
+            if (measured) run.projectionMs += run.history->GetGradientMs();
+            if (measured && samples) run.coveredStrata += GetCoveredStrata(*samples);
+
+            for (uint32_t e = 0; e < kEffectCount; ++e)
+            {
+                Trace(effects, Effect(e), gBuffer, frameIndex, run.traced[e]);
+                run.filters[e]->Execute(run.traced[e], motionVec, linearZ, normalDepth, nullptr, samples);
+                if (!measured) continue;
+
+                run.rays[e] += effects.GetLastStats().rays;
+                run.filterMs[e] += run.filters[e]->GetTimings().totalMs;
+                run.gradientMs[e] += run.filters[e]->GetTimings().gradientMs;
+                if (samples) run.meanLambda[e] += GetMeanLambda(run.filters[e]->GetTemporalGradient());
+            }
+            effects.SetGradientSamples(nullptr);
+            run.history->EndFrame(linearZ);
+        };
+
+        auto getGBuffer = [&](uint32_t frameIndex)
+        {
+            RtGBuffer gBuffer;
+            gBuffer.worldPosition = &frame.Get(FrameTarget::WorldPosition);
+            gBuffer.normalRoughness = &frame.Get(FrameTarget::NormalRoughness);
+            gBuffer.albedo = &frame.Get(FrameTarget::Albedo);
+            gBuffer.cameraPosition = syntheticScene.GetCameraPosition(frameIndex);
+            return gBuffer;
+        };
+
+        // A still view of a still scene: every sample lands where it was picked and traces the same ray again, so
+        // each gradient is exactly 0. Anything else is a seed or a pixel the projection got wrong.
+        {
+            scene.SetLight(0, baseLight);
+            syntheticScene.RenderFrame(0, resolution.width, resolution.height, frame, threadPool);
+            const RtGBuffer gBuffer = getGBuffer(0);
+            const std::unique_ptr<FilterRun> still = createRun("still", true);
+            for (uint32_t frameIndex = 0; frameIndex < 3; ++frameIndex)
+            {
+                runFrame(*still, frameIndex, gBuffer, frameIndex == 2);
+            }
+            check(still->coveredStrata >= minCoverage, resolutionName, "gradient samples cover too few strata of a still view");
+            for (uint32_t e = 0; e < kEffectCount; ++e)
+            {
+                const Image4F& gradient = still->filters[e]->GetTemporalGradient();
+                bool zero = gradient.GetPixelCount() > 0;
+                for (size_t i = 0; i < gradient.GetPixelCount(); ++i) zero = zero && gradient.GetData()[i].x == 0.0f;
+                check(zero, resolutionName + " " + kEffectNames[e], "a still view has a nonzero temporal gradient");
+            }
+        }
+
+        std::vector<std::unique_ptr<FilterRun>> runs;
+        runs.push_back(createRun("svgf", false));
+        runs.push_back(createRun("asvgf", true));
+
+        // Converged per frame and not denoised, so lagging behind the light counts as error
+        Image4F reference[kEffectCount];
+        Image4F referencePass;
+        std::vector<uint32_t> workList;
+        for (uint32_t frameIndex = 0; frameIndex < frameCount; ++frameIndex)
+        {
+            scene.SetLight(0, RotateLight(baseLight, lightSpeed * float(frameIndex)));
+            syntheticScene.RenderFrame(frameIndex, resolution.width, resolution.height, frame, threadPool);
+            const RtGBuffer gBuffer = getGBuffer(frameIndex);
+            const bool measured = frameIndex >= warmupCount;
+
+            if (measured)
+            {
+                for (uint32_t e = 0; e < kEffectCount; ++e)
+                {
+                    Image4F& converged = reference[e];
+                    converged.Resize(resolution.width, resolution.height);
+                    std::fill(converged.GetData(), converged.GetData() + converged.GetPixelCount(), float4(0.0f));
+                    for (uint32_t first = 0, pass = 1; first < referenceRays; first += AdaptiveSampler::kMaxRaysPerPixel, ++pass)
+                    {
+                        const uint32_t rays = std::min(AdaptiveSampler::kMaxRaysPerPixel, referenceRays - first);
+                        BuildUniformWorkList(resolution.width, resolution.height, rays, workList);
+                        effects.SetWorkList(&workList);
+                        Trace(effects, Effect(e), gBuffer, frameIndex + (pass << 20), referencePass);
+                        for (size_t i = 0; i < referencePass.GetPixelCount(); ++i)
+                        {
+                            converged.GetData()[i] += referencePass.GetData()[i] * (float(rays) / float(referenceRays));
+                        }
+                    }
+                }
+                effects.SetWorkList(nullptr);
+            }
+
+            for (const auto& run : runs)
+            {
+                runFrame(*run, frameIndex, gBuffer, measured);
+                if (!measured) continue;
+                for (uint32_t e = 0; e < kEffectCount; ++e)
+                {
+                    run->error[e].Add(run->filters[e]->GetOutput(), reference[e], *gBuffer.worldPosition);
+                }
+            }
+        }
+        scene.SetLight(0, baseLight);
+
+        const FilterRun& svgf = *runs[0];
+        const FilterRun& asvgf = *runs[1];
+        const double measuredFrames = double(std::max(1u, frameCount - std::min(frameCount, warmupCount)));
+        // Bounces depend on the random numbers, so reflections only trace about as many rays
+        for (uint32_t e = 0; e < kEffectCount; ++e)
+        {
+            const double tolerance = Effect(e) == Effect::Reflection ? 0.01 * double(svgf.rays[e]) : 0.0;
+            check(double(asvgf.rays[e]) <= double(svgf.rays[e]) + tolerance, resolutionName + " " + kEffectNames[e], "temporal gradients traced extra rays");
+        }
+        check(asvgf.error[uint32_t(Effect::Shadows)].GetRmse() < svgf.error[uint32_t(Effect::Shadows)].GetRmse(), resolutionName,
+            "temporal gradients do not reduce the shadow error behind a moving light");
+
+        for (const auto& run : runs)
+        {
+            json.BeginObject();
+            json.Field("resolution", resolutionName);
+            json.Field("filter", run->name);
+            if (run->temporalGradients)
+            {
+                json.Field("projectionMs", float(run->projectionMs / measuredFrames));
+                json.Field("coveredStrata", float(run->coveredStrata / measuredFrames));
+            }
+            for (uint32_t e = 0; e < kEffectCount; ++e)
+            {
+                const double rmse = run->error[e].GetRmse();
+                json.Key(kEffectNames[e]).BeginObject();
+                json.Field("raysPerFrame", uint64_t(double(run->rays[e]) / measuredFrames));
+                json.Field("filterMs", float(run->filterMs[e] / measuredFrames));
+                json.Field("rmse", float(rmse));
+                if (run->temporalGradients)
+                {
+                    // The gradient passes and an equal share of the projection, against what they save over plain SVGF
+                    const double overheadMs = (run->gradientMs[e] + run->projectionMs / kEffectCount) / measuredFrames;
+                    const double svgfRmse = svgf.error[e].GetRmse();
+                    json.Field("gradientMs", float(run->gradientMs[e] / measuredFrames));
+                    json.Field("overheadMs", float(overheadMs));
+                    json.Field("overhead", float(overheadMs / std::max(1e-6, (svgf.filterMs[e] / measuredFrames))));
+                    json.Field("meanLambda", float(run->meanLambda[e] / measuredFrames));
+                    json.Field("errorReduction", float(svgfRmse > 0.0 ? 1.0 - rmse / svgfRmse : 0.0));
+                }
+                json.EndObject();
+            }
+            json.EndObject();
+        }
+    }
+
+    json.EndArray();
+    json.Field("failedChecks", failedChecks);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedChecks > 0 ? 2 : 0;
+}
@@ -0,0 +1,155 @@
+#include <cstdio>
+#include "Benchmarks.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/Timer.h"
+#include "MockRenderer.h"
+
+using namespace Cpu;
+
+namespace
+{
+    uint32_t FindPass(const RenderGraphCompiler& graph, const std::string& name)
+    {
+        for (uint32_t p = 0; p < graph.GetPassCount(); ++p)
+        {
+            if (graph.GetPassName(p) == name) return p;
+        }
+        return RenderGraphCompiler::kInvalidIndex;
+    }
+
+    // A declared pass has to be live exactly when expected, passes that are not declared are ignored
+    bool CheckPass(const RenderGraphCompiler& graph, const std::string& name, bool expectLive, std::string& error)
+    {
+        const uint32_t pass = FindPass(graph, name);
+        if (pass == RenderGraphCompiler::kInvalidIndex || graph.IsPassCulled(pass) != expectLive) return true;
+        error = name + (expectLive ? " was culled" : " was not culled");
+        return false;
+    }
+
+    bool Validate(const RenderGraphCompiler& graph, const MockGraphConfig& config, std::string& error)
+    {
+        if (graph.GetAliasedBytes() > graph.GetTransientBytes() || graph.GetPeakLiveBytes() > graph.GetAliasedBytes())
+        {
+            error = "aliasing increased memory";
+            return false;
+        }
+
+        // Resources sharing a texture must not be alive at the same time
+        for (uint32_t a = 0; a < graph.GetResourceCount(); ++a)
+        {
+            for (uint32_t b = a + 1; b < graph.GetResourceCount(); ++b)
+            {
+                const uint32_t physical = graph.GetPhysicalIndex(a);
+                if (physical == RenderGraphCompiler::kInvalidIndex || physical != graph.GetPhysicalIndex(b)) continue;
+                if (graph.GetFirstUse(a) <= graph.GetLastUse(b) && graph.GetFirstUse(b) <= graph.GetLastUse(a))
+                {
+                    error = graph.GetResourceName(a) + " and " + graph.GetResourceName(b) + " overlap";
+                    return false;
+                }
+            }
+        }
+
+        const bool hybrid = config.mode == MockRenderMode::Hybrid;
+        const bool separate = config.denoise && !(config.packed && config.shadows && config.reflection && config.ao && !config.sampleLights);
+        return CheckPass(graph, "RaytraceShadows", hybrid && config.shadows, error) &&
+            CheckPass(graph, "RaytraceReflection", hybrid && config.reflection, error) &&
+            CheckPass(graph, "RaytraceAO", hybrid && config.ao, error) &&
+            CheckPass(graph, "DenoiseShadows", hybrid && config.shadows && config.denoise, error) &&
+            CheckPass(graph, "DenoiseReflection", hybrid && config.reflection && config.denoise, error) &&
+            CheckPass(graph, "DenoiseAO", hybrid && config.ao && config.denoise, error) &&
+            CheckPass(graph, "DenoisePacked", hybrid && config.denoise, error) &&
+            CheckPass(graph, "SVGFHistory", hybrid && separate, error) &&
+            CheckPass(graph, "SVGFHistoryEnd", hybrid && separate, error) &&
+            CheckPass(graph, "RecordFrame", hybrid && config.recording, error) &&
+            CheckPass(graph, "UpdateProbes", hybrid && config.probeGI, error) &&
+            CheckPass(graph, "Upscale", true, error) &&
+            CheckPass(graph, "UpscaleMotion", true, error) &&
+            CheckPass(graph, "TAA", true, error);
+    }
+}
+
+int RunGraphBench(const CommandLine& args)
+{
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolutions", "1280x720,1920x1080");
+    const std::vector<std::string> configNames = args.GetStringList("configs", "hybrid,packed,no-ao,no-denoise,half-rays,quarter-rays,recording,deferred,forward,render-scale,forward-render-scale,adaptive,adaptive-half-rays,sampled-lights,probe-gi");
+    const std::string outputPath = args.GetString("output", "");
+
+    std::vector<const MockGraphConfig*> configs;
+    for (const std::string& name : configNames)
+    {
+        const MockGraphConfig* config = FindMockGraphConfig(name);
+        if (!config)
+        {
+            fprintf(stderr, "Unknown graph config '%s'\n", name.c_str());
+            return 1;
+        }
+        configs.push_back(config);
+    }
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "graph");
+    json.Key("runs").BeginArray();
+
+    uint32_t failedRuns = 0;
+
+    RenderGraphCompiler graph;
+    for (const Resolution& resolution : resolutions)
+    {
+        for (const MockGraphConfig* config : configs)
+        {
+            Timer timer;
+            BuildMockRenderGraph(graph, *config, resolution.width, resolution.height);
+            const bool compiled = graph.Compile();
+            const double compileMs = timer.GetElapsedMs();
+
+            std::string error = graph.GetError();
+            const bool valid = compiled && Validate(graph, *config, error);
+            if (!valid)
+            {
+                fprintf(stderr, "graph %s %ux%u: %s\n", config->name, resolution.width, resolution.height, error.c_str());
+                failedRuns++;
+            }
+
+            json.BeginObject();
+            json.Field("config", config->name);
+            json.Field("width", resolution.width);
+            json.Field("height", resolution.height);
+            json.Field("valid", valid);
+            json.Field("compileMs", compileMs);
+
+            json.Key("passes").BeginArray();
+            for (uint32_t pass : graph.GetExecutionOrder()) json.Value(graph.GetPassName(pass));
+            json.EndArray();
+            json.Key("culledPasses").BeginArray();
+            for (uint32_t pass = 0; pass < graph.GetPassCount(); ++pass)
+            {
+                if (graph.IsPassCulled(pass)) json.Value(graph.GetPassName(pass));
+            }
+            json.EndArray();
+
+            json.Field("physicalTextures", graph.GetPhysicalCount());
+            json.Field("transientBytes", graph.GetTransientBytes());
+            json.Field("aliasedBytes", graph.GetAliasedBytes());
+            json.Field("peakLiveBytes", graph.GetPeakLiveBytes());
+            json.EndObject();
+        }
+    }
+
+    json.EndArray();
+    json.Field("failedRuns", failedRuns);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedRuns > 0 ? 2 : 0;
+}
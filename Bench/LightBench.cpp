@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "Benchmarks.h"
+#include "../Cpu/Bvh.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/LightSampling.h"
+#include "../Cpu/RaytracedEffects.h"
+#include "../Cpu/Sampling.h"
+#include "../Cpu/SVGF.h"
+#include "../Cpu/SVGFSharedHistory.h"
+#include "../Cpu/Timer.h"
+
+using namespace Cpu;
+
+namespace
+{
+    // Seeds of the sampled passes that check the estimator, apart from the frame seeds
+    const uint32_t kMeanSeedOffset = 1u << 20;
+
+    // Sum of squared rgb differences over the pixels with geometry, accumulated over frames
+    struct ErrorAccumulator
+    {
+        double sumSquared = 0.0;
+        double count = 0.0;
+
+        void Add(const Image4F& a, const Image4F& b, const Image4F& worldPosition)
+        {
+            for (size_t i = 0; i < a.GetPixelCount(); ++i)
+            {
+                if (worldPosition.GetData()[i].w == 0.0f) continue;
+                const float3 d = a.GetData()[i].rgb() - b.GetData()[i].rgb();
+                sumSquared += double(d.x) * d.x + double(d.y) * d.y + double(d.z) * d.z;
+                count += 3.0;
+            }
+        }
+
+        double GetRmse() const { return count > 0.0 ? std::sqrt(sumSquared / count) : 0.0; }
+    };
+
+    double GetMeanLuminance(const Image4F& image, const Image4F& worldPosition)
+    {
+        double sum = 0.0;
+        double count = 0.0;
+        for (size_t i = 0; i < image.GetPixelCount(); ++i)
+        {
+            if (worldPosition.GetData()[i].w == 0.0f) continue;
+            sum += luminance(image.GetData()[i].rgb());
+            count += 1.0;
+        }
+        return count > 0.0 ? sum / count : 0.0;
+    }
+}
+
+int RunLightBench(const CommandLine& args)
+{
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolutions", "640x360");
+    const std::vector<uint32_t> lightCounts = args.GetUintList("light-counts", "1,10,100,1000");
+    const uint32_t frameCount = std::max(1u, args.GetUint("frames", 8));
+    const uint32_t warmupCount = args.GetUint("warmup", 2);
+    const uint32_t sphereSegments = args.GetUint("segments", 64);
+    const uint32_t sampleCount = std::max(1u, args.GetUint("samples", 1000000));
+    const uint32_t meanPasses = std::max(1u, args.GetUint("mean-passes", 64));
+    const float meanTolerance = args.GetFloat("mean-tolerance", 0.02f);
+    const std::string outputPath = args.GetString("output", "");
+
+    ThreadPool threadPool(args.GetUint("threads", 0));
+
+    uint32_t failedChecks = 0;
+    auto check = [&](bool condition, const std::string& name, const char* message)
+    {
+        if (condition) return;
+        fprintf(stderr, "lights: %s: %s\n", name.c_str(), message);
+        failedChecks++;
+    };
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "lights");
+    json.Field("threads", threadPool.GetThreadCount());
+    json.Field("frames", frameCount);
+    json.Field("warmup", warmupCount);
+    json.Field("samples", sampleCount);
+    json.Key("runs").BeginArray();
+
+    SyntheticScene syntheticScene;
+    FrameData frame;
+    for (uint32_t lightCount : lightCounts)
+    {
+        if (lightCount == 0)
+        {
+            fprintf(stderr, "Light counts have to be at least 1\n");
+            return 1;
+        }
+
+        TriangleScene scene;
+        syntheticScene.BuildTriangleScene(sphereSegments, scene);
+        syntheticScene.AddPointLights(lightCount, scene);
+        Bvh bvh;
+        bvh.Build(scene, BvhBuildSettings(), &threadPool);
+
+        LightSampler sampler;
+        sampler.Build(scene);
+        const std::string countName = std::to_string(lightCount) + " lights";
+        fprintf(stderr, "lights %u\n", lightCount);
+
+        // The table has to hold the weights: pdfs proportional to them, and every slot's split between its own light and
+        // its alias adding up to the same pdfs
+        double weightSum = 0.0;
+        for (uint32_t i = 0; i < lightCount; ++i) weightSum += GetLightSelectionWeight(scene.GetLight(i));
+        double pdfSum = 0.0;
+        double maxPdfError = 0.0;
+        std::vector<double> tablePdfs(lightCount, 0.0);
+        for (uint32_t i = 0; i < lightCount; ++i)
+        {
+            pdfSum += sampler.GetPdf(i);
+            maxPdfError = std::max(maxPdfError, std::fabs(sampler.GetPdf(i) - GetLightSelectionWeight(scene.GetLight(i)) / weightSum));
+
+            const LightAliasEntry& entry = sampler.GetEntries()[i];
+            tablePdfs[i] += double(entry.threshold) / lightCount;
+            tablePdfs[entry.alias] += (1.0 - double(entry.threshold)) / lightCount;
+            check(entry.pdf == sampler.GetPdf(i) && entry.aliasPdf == sampler.GetPdf(entry.alias), countName, "the table pdfs are not the light pdfs");
+        }
+        double maxTableError = 0.0;
+        for (uint32_t i = 0; i < lightCount; ++i) maxTableError = std::max(maxTableError, std::fabs(tablePdfs[i] - sampler.GetPdf(i)));
+        check(std::fabs(pdfSum - 1.0) < 1e-4, countName, "the pdfs do not sum to 1");
+        check(maxPdfError < 1e-5, countName, "the pdfs are not proportional to the light weights");
+        check(maxTableError < 1e-5, countName, "the alias table does not sample the pdfs");
+
+        // Histogram of random samples against the pdfs, within 5 standard deviations for every light
+        std::vector<uint32_t> histogram(lightCount, 0);
+        uint32_t sampleSeed = RandInit(lightCount, 1);
+        bool pdfsReturned = true;
+        Timer sampleTimer;
+        for (uint32_t i = 0; i < sampleCount; ++i)
+        {
+            const LightSample sample = sampler.Sample(RandNext(sampleSeed));
+            histogram[sample.index]++;
+            pdfsReturned = pdfsReturned && sample.pdf == sampler.GetPdf(sample.index);
+        }
+        const double sampleNs = sampleTimer.GetElapsedMs() * 1e6 / sampleCount;
+        double maxSigma = 0.0;
+        for (uint32_t i = 0; i < lightCount; ++i)
+        {
+            const double pdf = sampler.GetPdf(i);
+            const double frequency = double(histogram[i]) / sampleCount;
+            const double sigma = std::sqrt(pdf * (1.0 - pdf) / sampleCount);
+            if (pdf == 0.0) check(histogram[i] == 0, countName, "a light with zero weight was sampled");
+            else maxSigma = std::max(maxSigma, std::fabs(frequency - pdf) / std::max(sigma, 1e-12));
+        }
+        check(pdfsReturned, countName, "a sample returned a pdf other than its light's");
+        check(maxSigma < 5.0, countName, "the sample histogram does not match the pdfs");
+
+        for (const Resolution& resolution : resolutions)
+        {
+            const std::string resolutionName = std::to_string(resolution.width) + "x" + std::to_string(resolution.height);
+            const std::string runName = resolutionName + " " + countName;
+            RaytracedEffects effects(scene, bvh, threadPool);
+
+            SVGFSharedHistory history(resolution.width, resolution.height, &threadPool);
+            SVGFPass filter(resolution.width, resolution.height, history, SVGFSignalType::Color, &threadPool);
+
+            Image4F reference;
+            Image4F sampled;
+            Image4F reflection;
+            Image4F meanPass;
+            Image4F mean;
+            ErrorAccumulator noisyError;
+            ErrorAccumulator denoisedError;
+            double loopedMs = 0.0, sampledMs = 0.0, reflectionLoopedMs = 0.0, reflectionSampledMs = 0.0;
+            uint64_t loopedRays = 0, sampledRays = 0, reflectionLoopedRays = 0, reflectionSampledRays = 0;
+            double referenceMean = 0.0, estimatorMean = 0.0, meanRmse = 0.0;
+
+            for (uint32_t frameIndex = 0; frameIndex < frameCount; ++frameIndex)
+            {
+                syntheticScene.RenderFrame(frameIndex, resolution.width, resolution.height, frame, threadPool);
+                const Image4F& motionVec = frame.Get(FrameTarget::MotionVector);
+                const Image4F& linearZ = frame.Get(FrameTarget::SVGF_LinearZ);
+                const Image4F& normalDepth = frame.Get(FrameTarget::SVGF_CompactNormDepth);
+
+                RtGBuffer gBuffer;
+                gBuffer.worldPosition = &frame.Get(FrameTarget::WorldPosition);
+                gBuffer.normalRoughness = &frame.Get(FrameTarget::NormalRoughness);
+                gBuffer.albedo = &frame.Get(FrameTarget::Albedo);
+                gBuffer.cameraPosition = syntheticScene.GetCameraPosition(frameIndex);
+
+                const bool measured = frameIndex >= warmupCount;
+
+                effects.SetLightSampler(nullptr);
+                effects.TraceDirectLight(gBuffer, RayScale::Full, frameIndex, reference);
+                if (measured) loopedMs += effects.GetLastStats().elapsedMs;
+                if (measured) loopedRays += effects.GetLastStats().rays;
+                effects.TraceReflection(gBuffer, RayScale::Full, frameIndex, reflection);
+                if (measured) reflectionLoopedMs += effects.GetLastStats().elapsedMs;
+                if (measured) reflectionLoopedRays += effects.GetLastStats().rays;
+
+                effects.SetLightSampler(&sampler);
+                effects.TraceShadows(gBuffer, RayScale::Full, frameIndex, sampled);
+                if (measured) sampledMs += effects.GetLastStats().elapsedMs;
+                if (measured) sampledRays += effects.GetLastStats().rays;
+                effects.TraceReflection(gBuffer, RayScale::Full, frameIndex, reflection);
+                if (measured) reflectionSampledMs += effects.GetLastStats().elapsedMs;
+                if (measured) reflectionSampledRays += effects.GetLastStats().rays;
+
+                // One light per pixel has to average to the sum over all of them. The shadow rays of sampled lights are
+                // jittered in a cone, so soft edges leave a small difference.
+                if (frameIndex == 0)
+                {
+                    mean.Resize(resolution.width, resolution.height);
+                    for (uint32_t pass = 0; pass < meanPasses; ++pass)
+                    {
+                        effects.TraceShadows(gBuffer, RayScale::Full, kMeanSeedOffset + pass, meanPass);
+                        for (size_t i = 0; i < mean.GetPixelCount(); ++i) mean.GetData()[i] += meanPass.GetData()[i] / float(meanPasses);
+                    }
+                    referenceMean = GetMeanLuminance(reference, *gBuffer.worldPosition);
+                    estimatorMean = GetMeanLuminance(mean, *gBuffer.worldPosition);
+                    ErrorAccumulator error;
+                    error.Add(mean, reference, *gBuffer.worldPosition);
+                    meanRmse = error.GetRmse();
+                    check(std::fabs(estimatorMean - referenceMean) <= meanTolerance * std::max(referenceMean, 1e-6), runName,
+                        "sampled lights do not average to the sum over all lights");
+                }
+
+                history.Update(motionVec, linearZ);
+                const Image4F& denoised = filter.Execute(sampled, motionVec, linearZ, normalDepth);
+                history.EndFrame(linearZ);
+                if (measured) noisyError.Add(sampled, reference, *gBuffer.worldPosition);
+                if (measured) denoisedError.Add(denoised, reference, *gBuffer.worldPosition);
+            }
+
+            const uint32_t measuredFrames = std::max(1u, frameCount - std::min(frameCount, warmupCount));
+            json.BeginObject();
+            json.Field("resolution", resolutionName);
+            json.Field("lights", lightCount);
+            json.Field("buildMs", float(sampler.GetBuildMs()));
+            json.Field("sampleNs", float(sampleNs));
+            json.Field("tableBytes", uint64_t(sampler.GetEntries().size() * sizeof(LightAliasEntry)));
+            json.Field("maxPdfError", float(maxPdfError));
+            json.Field("maxTableError", float(maxTableError));
+            json.Field("maxHistogramSigma", float(maxSigma));
+
+            json.Key("shadows").BeginObject();
+            json.Field("loopedMs", float(loopedMs / measuredFrames));
+            json.Field("sampledMs", float(sampledMs / measuredFrames));
+            json.Field("loopedRaysPerFrame", loopedRays / measuredFrames);
+            json.Field("sampledRaysPerFrame", sampledRays / measuredFrames);
+            json.Field("speedup", float(sampledMs > 0.0 ? loopedMs / sampledMs : 0.0));
+            json.Field("referenceMean", float(referenceMean));
+            json.Field("estimatorMean", float(estimatorMean));
+            json.Field("estimatorRmse", float(meanRmse));
+            json.Field("noisyRmse", float(noisyError.GetRmse()));
+            json.Field("denoisedRmse", float(denoisedError.GetRmse()));
+            json.EndObject();
+
+            json.Key("reflection").BeginObject();
+            json.Field("loopedMs", float(reflectionLoopedMs / measuredFrames));
+            json.Field("sampledMs", float(reflectionSampledMs / measuredFrames));
+            json.Field("loopedRaysPerFrame", reflectionLoopedRays / measuredFrames);
+            json.Field("sampledRaysPerFrame", reflectionSampledRays / measuredFrames);
+            json.EndObject();
+            json.EndObject();
+        }
+    }
+
+    json.EndArray();
+    json.Field("failedChecks", failedChecks);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedChecks > 0 ? 2 : 0;
+}
@@ -0,0 +1,239 @@
+#include "MockRenderer.h"
+
+using namespace Cpu;
+
+namespace
+{
+    const uint32_t kRaytraceBindFlags = UnorderedAccess | ShaderResource | RenderTarget;
+    const uint32_t kTracedBindFlags = UnorderedAccess | ShaderResource;
+
+    // FboHelper::create2D / TexturePool::CreateFbo
+    const uint32_t kColorTargetBindFlags = RenderTarget | ShaderResource;
+    const uint32_t kUavColorTargetBindFlags = RenderTarget | ShaderResource | UnorderedAccess;
+    const uint32_t kDepthTargetBindFlags = DepthStencil | ShaderResource;
+
+    const MockGraphConfig kConfigs[] =
+    {
+        { "hybrid", MockRenderMode::Hybrid, true, true, true, true, false, RayScale::Full, false, 1.0f, false, false, false },
+        { "packed", MockRenderMode::Hybrid, true, true, true, true, true, RayScale::Full, false, 1.0f, false, false, false },
+        { "no-ao", MockRenderMode::Hybrid, true, true, false, true, false, RayScale::Full, false, 1.0f, false, false, false },
+        { "no-denoise", MockRenderMode::Hybrid, true, true, true, false, false, RayScale::Full, false, 1.0f, false, false, false },
+        { "half-rays", MockRenderMode::Hybrid, true, true, true, true, false, RayScale::Half, false, 1.0f, false, false, false },
+        { "quarter-rays", MockRenderMode::Hybrid, true, true, true, true, false, RayScale::Quarter, false, 1.0f, false, false, false },
+        { "recording", MockRenderMode::Hybrid, true, true, true, true, false, RayScale::Full, true, 1.0f, false, false, false },
+        { "deferred", MockRenderMode::Deferred, true, true, true, true, false, RayScale::Full, false, 1.0f, false, false, false },
+        { "forward", MockRenderMode::Forward, true, true, true, true, false, RayScale::Full, false, 1.0f, false, false, false },
+        { "render-scale", MockRenderMode::Hybrid, true, true, true, true, false, RayScale::Full, false, 0.7f, false, false, false },
+        { "forward-render-scale", MockRenderMode::Forward, true, true, true, true, false, RayScale::Full, false, 0.7f, false, false, false },
+        { "adaptive", MockRenderMode::Hybrid, true, true, true, true, false, RayScale::Full, false, 1.0f, true, false, false },
+        { "adaptive-half-rays", MockRenderMode::Hybrid, true, true, true, true, false, RayScale::Half, false, 1.0f, true, false, false },
+        { "sampled-lights", MockRenderMode::Hybrid, true, true, true, true, true, RayScale::Full, false, 1.0f, false, true, false },
+        { "probe-gi", MockRenderMode::Hybrid, true, true, true, true, false, RayScale::Full, false, 1.0f, false, false, true },
+    };
+
+    uint32_t GetBytesPerPixel(uint32_t format)
+    {
+        switch (format)
+        {
+        case R16Float: return 2;
+        case RG16Float: return 4;
+        case RGBA8Unorm: return 4;
+        case RGBA8UnormSrgb: return 4;
+        case RGBA16Float: return 8;
+        case RGBA32Float: return 16;
+        case D32Float: return 4;
+        default: return 1;
+        }
+    }
+
+    void AddRaytracePasses(RenderGraphCompiler& graph, const std::string& name, uint32_t format, RayScale scale, bool adaptive, uint32_t width, uint32_t height)
+    {
+        graph.AddResource(name, MakeMockTextureDesc(width, height, format, kRaytraceBindFlags));
+
+        if (scale == RayScale::Full)
+        {
+            graph.AddPass("Raytrace" + name, adaptive ? std::vector<std::string>{ "GBuffer", "SVGFHistory" } : std::vector<std::string>{ "GBuffer" }, { name });
+            return;
+        }
+
+        const int2 tracedSize = GetTracedSize(scale, width, height);
+        graph.AddResource(name + "Traced", MakeMockTextureDesc(uint32_t(tracedSize.x), uint32_t(tracedSize.y), format, kTracedBindFlags));
+        graph.AddPass("Raytrace" + name, { "GBuffer" }, { name + "Traced" });
+        graph.AddPass("Upsample" + name, { name + "Traced", "GBuffer" }, { name });
+    }
+
+    void AddFbo(std::vector<TextureDesc>& textures, uint32_t width, uint32_t height, const std::vector<uint32_t>& formats, uint32_t bindFlags = kColorTargetBindFlags)
+    {
+        for (uint32_t format : formats) textures.push_back(MakeMockTextureDesc(width, height, format, bindFlags));
+    }
+}
+
+TextureDesc MakeMockTextureDesc(uint32_t width, uint32_t height, uint32_t format, uint32_t bindFlags)
+{
+    TextureDesc desc;
+    desc.width = width;
+    desc.height = height;
+    desc.format = format;
+    desc.bindFlags = bindFlags;
+    desc.bytesPerPixel = GetBytesPerPixel(format);
+    return desc;
+}
+
+const MockGraphConfig* FindMockGraphConfig(const std::string& name)
+{
+    for (const MockGraphConfig& config : kConfigs)
+    {
+        if (name == config.name) return &config;
+    }
+    return nullptr;
+}
+
+void GetMockRenderSize(uint32_t outputWidth, uint32_t outputHeight, float renderScale, uint32_t& width, uint32_t& height)
+{
+    width = std::max(1u, uint32_t(outputWidth * renderScale + 0.5f));
+    height = std::max(1u, uint32_t(outputHeight * renderScale + 0.5f));
+}
+
+void BuildMockRenderGraph(RenderGraphCompiler& graph, const MockGraphConfig& config, uint32_t outputWidth, uint32_t outputHeight)
+{
+    uint32_t width;
+    uint32_t height;
+    GetMockRenderSize(outputWidth, outputHeight, config.renderScale, width, height);
+    const bool scaled = (width != outputWidth || height != outputHeight);
+    const bool upscale = scaled && config.mode != MockRenderMode::Forward;
+
+    graph.Clear();
+    graph.ImportResource("Backbuffer");
+    graph.ImportResource("GBuffer");
+    graph.MarkOutput("Backbuffer");
+
+    if (config.mode == MockRenderMode::Forward)
+    {
+        graph.AddPass("Forward", {}, { "Backbuffer" });
+    }
+    else
+    {
+        graph.AddPass("GBuffer", {}, { "GBuffer" });
+
+        std::vector<std::string> deferredInputs = { "GBuffer" };
+        if (config.mode == MockRenderMode::Hybrid)
+        {
+            const bool packed = config.packed && config.shadows && config.reflection && config.ao && !config.sampleLights;
+            const bool adaptive = config.adaptive && config.rayScale == RayScale::Full && config.denoise && !packed;
+
+            graph.ImportResource("SVGFHistory");
+            graph.ImportResource("DenoisedShadows");
+            graph.ImportResource("DenoisedReflection");
+            graph.ImportResource("DenoisedAO");
+
+            if (!packed) graph.AddPass("SVGFHistory", { "GBuffer" }, { "SVGFHistory" });
+
+            AddRaytracePasses(graph, "Shadows", config.sampleLights ? RGBA16Float : R8Unorm, config.rayScale, adaptive, width, height);
+            if (!packed) graph.AddPass("DenoiseShadows", { "Shadows", "GBuffer", "SVGFHistory" }, { "DenoisedShadows" });
+
+            AddRaytracePasses(graph, "Reflection", RGBA16Float, config.rayScale, adaptive, width, height);
+            if (!packed) graph.AddPass("DenoiseReflection", { "Reflection", "GBuffer", "SVGFHistory" }, { "DenoisedReflection" });
+
+            AddRaytracePasses(graph, "AO", R8Unorm, config.rayScale, adaptive, width, height);
+            if (!packed)
+            {
+                graph.AddPass("DenoiseAO", { "AO", "GBuffer", "SVGFHistory" }, { "DenoisedAO" });
+                graph.AddPass("SVGFHistoryEnd", { "SVGFHistory" }, {}, RenderGraphPassType::Epilogue);
+            }
+            else
+            {
+                graph.AddPass("DenoisePacked", { "Reflection", "Shadows", "AO", "GBuffer" }, { "DenoisedReflection", "DenoisedShadows", "DenoisedAO" });
+            }
+
+            if (config.recording)
+            {
+                std::vector<std::string> recorded;
+                if (config.shadows) recorded.push_back("Shadows");
+                if (config.reflection) recorded.push_back("Reflection");
+                if (config.ao) recorded.push_back("AO");
+                graph.AddPass("RecordFrame", recorded, {}, RenderGraphPassType::Epilogue);
+            }
+
+            graph.ImportResource("IrradianceProbes");
+            graph.AddPass("UpdateProbes", {}, { "IrradianceProbes" });
+
+            if (config.shadows) deferredInputs.push_back(config.denoise ? "DenoisedShadows" : "Shadows");
+            if (config.reflection) deferredInputs.push_back(config.denoise ? "DenoisedReflection" : "Reflection");
+            if (config.ao) deferredInputs.push_back(config.denoise ? "DenoisedAO" : "AO");
+            if (config.probeGI) deferredInputs.push_back("IrradianceProbes");
+        }
+
+        if (upscale)
+        {
+            graph.AddResource("SceneColor", MakeMockTextureDesc(width, height, RGBA8UnormSrgb, kColorTargetBindFlags));
+            graph.AddPass("DeferredPass", deferredInputs, { "SceneColor" });
+            graph.AddPass("Upscale", { "SceneColor" }, { "Backbuffer" });
+        }
+        else
+        {
+            graph.AddPass("DeferredPass", deferredInputs, { "Backbuffer" });
+        }
+    }
+
+    if (scaled)
+    {
+        graph.AddResource("UpscaledMotion", MakeMockTextureDesc(outputWidth, outputHeight, RGBA16Float, kColorTargetBindFlags));
+        graph.AddPass("UpscaleMotion", { "GBuffer" }, { "UpscaledMotion" });
+        graph.AddPass("TAA", { "Backbuffer", "UpscaledMotion" }, { "Backbuffer" });
+    }
+    else
+    {
+        graph.AddPass("TAA", { "Backbuffer", "GBuffer" }, { "Backbuffer" });
+    }
+}
+
+std::vector<TextureDesc> GetMockPersistentTextures(uint32_t outputWidth, uint32_t outputHeight, float renderScale)
+{
+    uint32_t width;
+    uint32_t height;
+    GetMockRenderSize(outputWidth, outputHeight, renderScale, width, height);
+
+    std::vector<TextureDesc> textures;
+
+    // G-buffer
+    AddFbo(textures, width, height, { RGBA32Float, RGBA32Float, RGBA8Unorm, RGBA16Float, RGBA16Float, RGBA16Float });
+    AddFbo(textures, width, height, { D32Float }, kDepthTargetBindFlags);
+
+    // SVGFSharedHistory
+    AddFbo(textures, width, height, { R8Unorm });
+    AddFbo(textures, width, height, { R8Unorm });
+    AddFbo(textures, width, height, { RGBA16Float });
+
+    // SVGFPass for shadows, reflection and AO
+    for (uint32_t filter = 0; filter < 3; ++filter)
+    {
+        const bool isScalar = (filter != 1);
+        const uint32_t filterFormat = isScalar ? RG16Float : RGBA16Float;
+        const std::vector<uint32_t> reprojFormats = isScalar ? std::vector<uint32_t>{ RGBA16Float } : std::vector<uint32_t>{ RGBA16Float, RG16Float };
+
+        AddFbo(textures, width, height, reprojFormats);
+        AddFbo(textures, width, height, reprojFormats);
+        AddFbo(textures, width, height, { filterFormat }, kUavColorTargetBindFlags);
+        AddFbo(textures, width, height, { filterFormat });
+        AddFbo(textures, width, height, { filterFormat }, kUavColorTargetBindFlags);
+        AddFbo(textures, width, height, { filterFormat }, kUavColorTargetBindFlags);
+    }
+
+    // AdaptiveSamplingPass ray counts, current and previous, for shadows, reflection and AO
+    for (uint32_t i = 0; i < 6; ++i) textures.push_back(MakeMockTextureDesc(width, height, R8Uint, ShaderResource | UnorderedAccess));
+
+    // LightResamplingPass reservoirs, and normal and depth of this frame and the last
+    for (uint32_t i = 0; i < 3; ++i) textures.push_back(MakeMockTextureDesc(width, height, RGBA32Float, ShaderResource | UnorderedAccess));
+    for (uint32_t i = 0; i < 2; ++i) textures.push_back(MakeMockTextureDesc(width, height, RGBA16Float, ShaderResource | UnorderedAccess));
+
+    // SVGFPackedPass
+    for (uint32_t i = 0; i < 2; ++i) AddFbo(textures, width, height, { RGBA16Float, RGBA16Float, RGBA16Float, RG16Float, R16Float });
+    for (uint32_t i = 0; i < 4; ++i) AddFbo(textures, width, height, { RGBA16Float, RGBA16Float });
+    AddFbo(textures, width, height, { RGBA16Float });
+
+    // TAA
+    AddFbo(textures, outputWidth, outputHeight, { RGBA8UnormSrgb });
+    AddFbo(textures, outputWidth, outputHeight, { RGBA8UnormSrgb });
+
+    return textures;
+}
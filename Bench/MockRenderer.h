@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "../Cpu/RayScale.h"
+#include "../Cpu/RenderGraphCompiler.h"
+#include "../Cpu/TextureDesc.h"
+
+// What RaysRenderer allocates and how it builds its render graph, with mock formats instead of Falcor's.
+// Lets RaysBench check the render graph and the texture pool without a GPU.
+
+// Stand-ins for the Falcor formats and bind flags
+enum MockFormat : uint32_t
+{
+    R8Unorm = 1,
+    R16Float,
+    RG16Float,
+    RGBA8Unorm,
+    RGBA8UnormSrgb,
+    RGBA16Float,
+    RGBA32Float,
+    D32Float,
+    R8Uint
+};
+
+enum MockBindFlags : uint32_t
+{
+    ShaderResource = 0x1,
+    UnorderedAccess = 0x2,
+    RenderTarget = 0x4,
+    DepthStencil = 0x8
+};
+
+Cpu::TextureDesc MakeMockTextureDesc(uint32_t width, uint32_t height, uint32_t format, uint32_t bindFlags);
+
+enum class MockRenderMode : uint32_t
+{
+    Forward = 0,
+    Deferred,
+    Hybrid
+};
+
+// The settings that change the pass sequence of RaysRenderer::BuildRenderGraph
+struct MockGraphConfig
+{
+    const char* name;
+    MockRenderMode mode;
+    bool shadows;
+    bool reflection;
+    bool ao;
+    bool denoise;
+    bool packed;
+    Cpu::RayScale rayScale;
+    bool recording;
+    float renderScale;      // Below 1 the frame is rendered smaller and upscaled to the output
+    bool adaptive;          // Adaptive sampling, full-res rays and separate denoising only
+    bool sampleLights;      // Sampled lights, RGBA16Float shadows and separate denoising
+    bool probeGI;           // Irradiance probes, their atlases are not size dependent
+};
+
+const MockGraphConfig* FindMockGraphConfig(const std::string& name);
+
+// Same as RaysRenderer::GetRenderSize
+void GetMockRenderSize(uint32_t outputWidth, uint32_t outputHeight, float renderScale, uint32_t& width, uint32_t& height);
+
+// Same declarations as RaysRenderer::BuildRenderGraph, without the callbacks. width and height are the output size.
+void BuildMockRenderGraph(Cpu::RenderGraphCompiler& graph, const MockGraphConfig& config, uint32_t width, uint32_t height);
+
+// Size dependent textures outside the render graph: G-buffer, SVGF history, filters, adaptive samplers and the light
+// resampler at the render size, TAA at the output size
+std::vector<Cpu::TextureDesc> GetMockPersistentTextures(uint32_t width, uint32_t height, float renderScale = 1.0f);
@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include "BenchUtils.h"
+#include "ObjScene.h"
+#include "../Cpu/Sampling.h"
+
+using namespace Cpu;
+
+namespace
+{
+    const float kGridSpacing = 4.0f;
+
+    void AppendFormat(std::string& text, const char* format, ...)
+    {
+        char line[256];
+        va_list args;
+        va_start(args, format);
+        const int length = vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+        if (length > 0) text.append(line, std::min(size_t(length), sizeof(line) - 1));
+    }
+
+    bool ReadWholeFile(const std::string& path, std::string& text)
+    {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) return false;
+        fseek(file, 0, SEEK_END);
+        text.resize(size_t(ftell(file)));
+        fseek(file, 0, SEEK_SET);
+        const bool ok = text.empty() || fread(&text[0], 1, text.size(), file) == text.size();
+        fclose(file);
+        return ok;
+    }
+
+    // Line by line over a file read in one go, the fields split in place
+    template<typename Fn>
+    void ForEachLine(std::string& text, const Fn& fn)
+    {
+        char* line = &text[0];
+        char* end = line + text.size();
+        while (line < end)
+        {
+            char* next = static_cast<char*>(memchr(line, '\n', size_t(end - line)));
+            if (!next) next = end;
+            *next = '\0';
+            fn(line);
+            line = next + 1;
+        }
+    }
+
+    uint32_t FindName(const std::vector<std::string>& names, const char* name)
+    {
+        for (uint32_t i = 0; i < names.size(); ++i)
+        {
+            if (names[i] == name) return i;
+        }
+        return ~0u;
+    }
+}
+
+ObjSceneFiles GetObjSceneFiles(const std::string& directory, const std::string& name)
+{
+    ObjSceneFiles files;
+    files.obj = directory + "/" + name + ".obj";
+    files.mtl = directory + "/" + name + ".mtl";
+    files.instances = directory + "/" + name + ".instances";
+    return files;
+}
+
+void BuildGridScene(uint32_t sphereSegments, uint32_t grid, SceneData& scene)
+{
+    SyntheticScene syntheticScene;
+    syntheticScene.BuildSceneData(sphereSegments, scene);
+
+    const std::vector<SceneInstance> baseInstances = scene.instances;
+    const uint32_t groundMesh = uint32_t(scene.meshes.size() - 1);
+    scene.instances.clear();
+    for (uint32_t z = 0; z < grid; ++z)
+    {
+        for (uint32_t x = 0; x < grid; ++x)
+        {
+            const float offsetX = (float(x) - float(grid - 1) * 0.5f) * kGridSpacing;
+            const float offsetZ = (float(z) - float(grid - 1) * 0.5f) * kGridSpacing;
+            for (const SceneInstance& base : baseInstances)
+            {
+                const bool isGround = base.meshId == groundMesh;
+                if (isGround && (x > 0 || z > 0)) continue;
+
+                SceneInstance instance = base;
+                if (!isGround)
+                {
+                    instance.transform[12] += offsetX;
+                    instance.transform[14] += offsetZ;
+                }
+                scene.instances.push_back(instance);
+            }
+        }
+    }
+}
+
+bool WriteObjScene(const SceneData& scene, const ObjSceneFiles& files)
+{
+    std::string obj;
+    const size_t slash = files.mtl.find_last_of("/\\");
+    AppendFormat(obj, "mtllib %s\n", files.mtl.substr(slash == std::string::npos ? 0 : slash + 1).c_str());
+    for (uint32_t m = 0; m < scene.meshes.size(); ++m)
+    {
+        const SceneMesh& mesh = scene.meshes[m];
+        AppendFormat(obj, "o mesh_%u\nusemtl material_%u\n", m, mesh.materialId);
+        for (uint32_t v = mesh.firstVertex; v < mesh.firstVertex + mesh.vertexCount; ++v)
+        {
+            const float3& p = scene.positions[v];
+            const float3& n = scene.normals[v];
+            AppendFormat(obj, "v %.9g %.9g %.9g\nvn %.9g %.9g %.9g\n", p.x, p.y, p.z, n.x, n.y, n.z);
+        }
+        // OBJ indices are global and one based
+        for (uint32_t i = mesh.firstIndex; i < mesh.firstIndex + mesh.indexCount; i += 3)
+        {
+            const uint32_t a = mesh.firstVertex + scene.indices[i] + 1, b = mesh.firstVertex + scene.indices[i + 1] + 1, c = mesh.firstVertex + scene.indices[i + 2] + 1;
+            AppendFormat(obj, "f %u//%u %u//%u %u//%u\n", a, a, b, b, c, c);
+        }
+    }
+
+    std::string mtl;
+    for (uint32_t m = 0; m < scene.materials.size(); ++m)
+    {
+        const SceneMaterial& material = scene.materials[m];
+        AppendFormat(mtl, "newmtl material_%u\nKd %.9g %.9g %.9g\nPr %.9g\nPm %.9g\n", m, material.baseColor.x, material.baseColor.y, material.baseColor.z,
+            material.linearRoughness, material.metalness);
+    }
+
+    std::string instances;
+    for (const SceneInstance& instance : scene.instances)
+    {
+        AppendFormat(instances, "mesh_%u", instance.meshId);
+        for (float value : instance.transform) AppendFormat(instances, " %.9g", value);
+        instances += "\n";
+    }
+
+    return WriteTextFile(files.obj, obj) && WriteTextFile(files.mtl, mtl) && WriteTextFile(files.instances, instances);
+}
+
+bool ParseObjScene(const ObjSceneFiles& files, const std::vector<SceneLight>& lights, SceneData& scene)
+{
+    scene.Clear();
+    std::string text;
+
+    std::vector<std::string> materialNames;
+    if (!ReadWholeFile(files.mtl, text)) return false;
+    ForEachLine(text, [&](char* line)
+    {
+        char name[64];
+        if (sscanf(line, "newmtl %63s", name) == 1)
+        {
+            materialNames.push_back(name);
+            scene.materials.emplace_back();
+        }
+        else if (!scene.materials.empty())
+        {
+            SceneMaterial& material = scene.materials.back();
+            if (strncmp(line, "Kd ", 3) == 0) sscanf(line + 3, "%f %f %f", &material.baseColor.x, &material.baseColor.y, &material.baseColor.z);
+            else if (strncmp(line, "Pr ", 3) == 0) material.linearRoughness = strtof(line + 3, nullptr);
+            else if (strncmp(line, "Pm ", 3) == 0) material.metalness = strtof(line + 3, nullptr);
+        }
+    });
+
+    if (!ReadWholeFile(files.obj, text)) return false;
+    std::vector<float3> filePositions, fileNormals;
+    std::vector<std::string> meshNames;
+    std::vector<float3> positions, normals;
+    std::vector<uint32_t> indices;
+    std::unordered_map<uint64_t, uint32_t> welded;
+    uint32_t materialId = 0;
+    bool ok = true;
+
+    auto flushMesh = [&]()
+    {
+        if (meshNames.size() == scene.meshes.size() + 1)
+        {
+            scene.AddMesh(positions.data(), normals.data(), nullptr, nullptr, uint32_t(positions.size()), indices.data(), uint32_t(indices.size()), materialId,
+                uint32_t(scene.meshes.size()));
+        }
+        positions.clear();
+        normals.clear();
+        indices.clear();
+        welded.clear();
+    };
+
+    ForEachLine(text, [&](char* line)
+    {
+        char* cursor = line + 2;
+        if (line[0] == 'v' && line[1] == ' ')
+        {
+            float3 p;
+            p.x = strtof(cursor, &cursor); p.y = strtof(cursor, &cursor); p.z = strtof(cursor, &cursor);
+            filePositions.push_back(p);
+        }
+        else if (line[0] == 'v' && line[1] == 'n')
+        {
+            cursor = line + 3;
+            float3 n;
+            n.x = strtof(cursor, &cursor); n.y = strtof(cursor, &cursor); n.z = strtof(cursor, &cursor);
+            fileNormals.push_back(n);
+        }
+        else if (line[0] == 'f' && line[1] == ' ')
+        {
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                const uint32_t p = uint32_t(strtoul(cursor, &cursor, 10)) - 1;
+                cursor += 2;    // "//"
+                const uint32_t n = uint32_t(strtoul(cursor, &cursor, 10)) - 1;
+                if (p >= filePositions.size() || n >= fileNormals.size())
+                {
+                    ok = false;
+                    return;
+                }
+
+                const auto inserted = welded.insert(std::make_pair((uint64_t(p) << 32) | n, uint32_t(positions.size())));
+                if (inserted.second)
+                {
+                    positions.push_back(filePositions[p]);
+                    normals.push_back(fileNormals[n]);
+                }
+                indices.push_back(inserted.first->second);
+            }
+        }
+        else if (line[0] == 'o' && line[1] == ' ')
+        {
+            flushMesh();
+            meshNames.push_back(cursor);
+        }
+        else if (strncmp(line, "usemtl ", 7) == 0)
+        {
+            materialId = FindName(materialNames, line + 7);
+            if (materialId == ~0u) ok = false;
+        }
+    });
+    flushMesh();
+    if (!ok) return false;
+
+    if (!ReadWholeFile(files.instances, text)) return false;
+    ForEachLine(text, [&](char* line)
+    {
+        char* cursor = strchr(line, ' ');
+        if (!cursor) return;
+        *cursor++ = '\0';
+
+        SceneInstance instance;
+        instance.meshId = FindName(meshNames, line);
+        if (instance.meshId == ~0u)
+        {
+            ok = false;
+            return;
+        }
+        for (float& value : instance.transform) value = strtof(cursor, &cursor);
+        scene.instances.push_back(instance);
+    });
+
+    // Lights come from the fscene itself
+    scene.lights = lights;
+    return ok;
+}
+
+uint32_t CompareSceneHits(const TriangleScene& coldScene, const Bvh& coldBvh, const TriangleScene& cachedScene, const Bvh& cachedBvh, uint32_t grid, uint32_t rayCount)
+{
+    const float extent = float(grid) * kGridSpacing * 0.5f + 2.0f;
+    uint32_t randState = RandInit(13, 5, 16);
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < rayCount; ++i)
+    {
+        Ray ray;
+        ray.origin = float3((RandNext(randState) * 2.0f - 1.0f) * extent, RandNext(randState) * 2.0f + 0.01f, (RandNext(randState) * 2.0f - 1.0f) * extent);
+        const float z = RandNext(randState) * 2.0f - 1.0f;
+        const float phi = RandNext(randState) * 2.0f * kPi;
+        const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        ray.direction = float3(r * std::cos(phi), z, r * std::sin(phi));
+        ray.tMin = 0.001f;
+
+        RayHit coldHit, cachedHit;
+        const bool coldFound = coldBvh.Intersect(ray, coldHit);
+        const bool cachedFound = cachedBvh.Intersect(ray, cachedHit);
+        bool same = coldFound == cachedFound;
+        if (same && coldFound)
+        {
+            const float3 coldNormal = coldScene.GetNormal(coldHit.triangle, coldHit.u, coldHit.v);
+            const float3 cachedNormal = cachedScene.GetNormal(cachedHit.triangle, cachedHit.u, cachedHit.v);
+            same = coldHit.t == cachedHit.t && coldHit.triangle == cachedHit.triangle && coldNormal.x == cachedNormal.x && coldNormal.y == cachedNormal.y &&
+                coldNormal.z == cachedNormal.z && coldScene.GetTriangleMaterial(coldHit.triangle).baseColor.x == cachedScene.GetTriangleMaterial(cachedHit.triangle).baseColor.x;
+        }
+        if (!same) mismatches++;
+    }
+    return mismatches;
+}
+
+uint64_t GetFileBytes(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return 0;
+    fseek(file, 0, SEEK_END);
+    const uint64_t size = uint64_t(ftell(file));
+    fclose(file);
+    return size;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../Cpu/Bvh.h"
+#include "../Cpu/SceneCache.h"
+#include "../Cpu/TriangleScene.h"
+
+// The source files the scene loading benchmarks parse: an OBJ with every mesh once in object space, its MTL with the
+// metal-rough constants (Kd, Pr, Pm) and an instance list standing in for the "instances" blocks of an fscene
+struct ObjSceneFiles
+{
+    std::string obj;
+    std::string mtl;
+    std::string instances;
+
+    std::vector<std::string> GetPaths() const { return { obj, mtl, instances }; }
+};
+
+ObjSceneFiles GetObjSceneFiles(const std::string& directory, const std::string& name);
+
+// The synthetic scene with its spheres repeated on a grid x grid layout, all copies instancing the same meshes
+void BuildGridScene(uint32_t sphereSegments, uint32_t grid, Cpu::SceneData& scene);
+
+bool WriteObjScene(const Cpu::SceneData& scene, const ObjSceneFiles& files);
+
+// The cold path: text parsing with (position, normal) pairs welded per object, as a model importer does. Lights come
+// from the fscene itself and are passed in.
+bool ParseObjScene(const ObjSceneFiles& files, const std::vector<Cpu::SceneLight>& lights, Cpu::SceneData& scene);
+
+// Rays over a grid scene that have to give bit identical hits in both, e.g. a parsed scene and the same one read from
+// a cache. Returns the number of rays that differ.
+uint32_t CompareSceneHits(const Cpu::TriangleScene& coldScene, const Cpu::Bvh& coldBvh, const Cpu::TriangleScene& cachedScene, const Cpu::Bvh& cachedBvh,
+    uint32_t grid, uint32_t rayCount);
+
+uint64_t GetFileBytes(const std::string& path);
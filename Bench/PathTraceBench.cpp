@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "Benchmarks.h"
+#include "../Cpu/Bvh.h"
+#include "../Cpu/ExrFile.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/PathTracer.h"
+#include "../Cpu/SceneCache.h"
+
+using namespace Cpu;
+
+namespace
+{
+    float GetRmse(const Image4F& a, const Image4F& b)
+    {
+        double sum = 0.0;
+        for (size_t i = 0; i < a.GetPixelCount(); ++i)
+        {
+            const float3 d = a.GetData()[i].rgb() - b.GetData()[i].rgb();
+            sum += double(dot(d, d)) / 3.0;
+        }
+        return float(std::sqrt(sum / double(std::max<size_t>(1, a.GetPixelCount()))));
+    }
+
+    bool IsIdentical(const Image4F& a, const Image4F& b)
+    {
+        return a.GetPixelCount() == b.GetPixelCount() && std::memcmp(a.GetData(), b.GetData(), a.GetSizeInBytes()) == 0;
+    }
+
+    void WriteStageTimes(JsonWriter& json, const PathTracerStats& stats, double scale)
+    {
+        json.Field("generateMs", float(stats.generateMs * scale));
+        json.Field("extendMs", float(stats.extendMs * scale));
+        json.Field("shadeMs", float(stats.shadeMs * scale));
+        json.Field("connectMs", float(stats.connectMs * scale));
+        json.Field("accumulateMs", float(stats.accumulateMs * scale));
+    }
+
+    // Per sample totals over a run
+    void AddStats(PathTracerStats& total, const PathTracerStats& stats)
+    {
+        total.paths += stats.paths;
+        total.extensionRays += stats.extensionRays;
+        total.shadowRays += stats.shadowRays;
+        total.steals += stats.steals;
+        total.generateMs += stats.generateMs;
+        total.extendMs += stats.extendMs;
+        total.shadeMs += stats.shadeMs;
+        total.connectMs += stats.connectMs;
+        total.accumulateMs += stats.accumulateMs;
+        total.elapsedMs += stats.elapsedMs;
+    }
+}
+
+int RunPathTraceBench(const CommandLine& args)
+{
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolutions", "320x180");
+    const uint32_t sampleCount = std::max(16u, args.GetUint("samples", 256));
+    const uint32_t bounces = std::max(1u, args.GetUint("bounces", 4));
+    const std::vector<uint32_t> threadCounts = args.GetUintList("thread-counts", "1,2,4,8,16,32,64");
+    const uint32_t scalingSamples = std::max(1u, args.GetUint("scaling-samples", 4));
+    const uint32_t sphereSegments = args.GetUint("segments", 64);
+    const std::string sceneCachePath = args.GetString("scene-cache", "");
+    const std::string referencePath = args.GetString("reference", "");
+    const std::string outputPath = args.GetString("output", "");
+
+    ThreadPool threadPool(args.GetUint("threads", 0));
+
+    uint32_t failedChecks = 0;
+    auto check = [&](bool condition, const std::string& name, const char* message)
+    {
+        if (condition) return;
+        fprintf(stderr, "pathtrace: %s: %s\n", name.c_str(), message);
+        failedChecks++;
+    };
+
+    std::string sceneName = "synthetic";
+    TriangleScene scene;
+    SceneCache sceneCache;
+    if (sceneCachePath.empty())
+    {
+        SyntheticScene().BuildTriangleScene(sphereSegments, scene);
+    }
+    else
+    {
+        sceneName = sceneCachePath;
+        const SceneCache::Status status = sceneCache.OpenAnySource(sceneCachePath);
+        if (status != SceneCache::Status::Ok)
+        {
+            fprintf(stderr, "Failed to open '%s': %s\n", sceneCachePath.c_str(), GetSceneCacheStatusName(status));
+            return 1;
+        }
+        BuildTriangleScene(sceneCache.GetView(), scene, &threadPool);
+    }
+    if (scene.GetTriangleCount() == 0)
+    {
+        fprintf(stderr, "pathtrace: %s has no triangles\n", sceneName.c_str());
+        return 1;
+    }
+
+    Bvh bvh;
+    bvh.Build(scene, BvhBuildSettings(), &threadPool);
+    PathTracerSettings settings;
+    settings.maxBounces = bounces;
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "pathtrace");
+    json.Field("scene", sceneName);
+    json.Field("triangles", scene.GetTriangleCount());
+    json.Field("lights", scene.GetLightCount());
+    json.Field("threads", threadPool.GetThreadCount());
+    json.Field("bounces", bounces);
+    json.Key("runs").BeginArray();
+
+    for (const Resolution& resolution : resolutions)
+    {
+        const std::string name = std::to_string(resolution.width) + "x" + std::to_string(resolution.height);
+        const PathCamera camera = GetGBufferCamera(bvh, resolution.width, resolution.height);
+
+        json.BeginObject();
+        json.Field("resolution", name);
+
+        // The same samples on 1 to 64 threads. A sample only depends on its pixel and index, so every image matches.
+        fprintf(stderr, "pathtrace %s scaling\n", name.c_str());
+        json.Key("scaling").BeginArray();
+        Image4F firstImage;
+        double firstSamplesPerSecond = 0.0;
+        for (uint32_t threadCount : threadCounts)
+        {
+            threadCount = std::max(1u, threadCount);
+            ThreadPool scalingPool(threadCount);
+            PathTracer pathTracer(scene, bvh, scalingPool);
+            pathTracer.SetSettings(settings);
+            pathTracer.SetCamera(camera);
+
+            PathTracerStats total;
+            for (uint32_t sample = 0; sample < scalingSamples; ++sample)
+            {
+                pathTracer.Render(resolution.width, resolution.height);
+                AddStats(total, pathTracer.GetLastStats());
+            }
+
+            if (firstImage.IsEmpty())
+            {
+                firstImage = pathTracer.GetImage();
+                firstSamplesPerSecond = total.GetSamplesPerSecond();
+            }
+            check(IsIdentical(pathTracer.GetImage(), firstImage), name + " " + std::to_string(threadCount) + " threads",
+                "the image depends on the thread count");
+
+            json.BeginObject();
+            json.Field("threads", threadCount);
+            json.Field("samplesPerSecond", float(total.GetSamplesPerSecond()));
+            json.Field("mraysPerSecond", float(total.GetRaysPerSecond() / 1e6));
+            json.Field("sampleMs", float(total.elapsedMs / scalingSamples));
+            json.Field("speedup", float(firstSamplesPerSecond > 0.0 ? total.GetSamplesPerSecond() / firstSamplesPerSecond : 0.0));
+            json.Field("steals", total.steals);
+            WriteStageTimes(json, total, 1.0 / scalingSamples);
+            json.EndObject();
+        }
+        json.EndArray();
+
+        // The reference, with the error of its early images against it falling as 1 / sqrt(samples)
+        fprintf(stderr, "pathtrace %s reference, %u samples\n", name.c_str(), sampleCount);
+        PathTracer pathTracer(scene, bvh, threadPool);
+        pathTracer.SetSettings(settings);
+        pathTracer.SetCamera(camera);
+        const uint32_t checkpoints[] = { sampleCount / 16, sampleCount / 4 };
+        Image4F checkpointImages[2];
+        PathTracerStats total;
+        for (uint32_t sample = 0; sample < sampleCount; ++sample)
+        {
+            pathTracer.Render(resolution.width, resolution.height);
+            AddStats(total, pathTracer.GetLastStats());
+            for (uint32_t c = 0; c < 2; ++c)
+            {
+                if (pathTracer.GetSampleCount() == checkpoints[c]) checkpointImages[c] = pathTracer.GetImage();
+            }
+        }
+        const Image4F& reference = pathTracer.GetImage();
+        const float rmse[2] = { GetRmse(checkpointImages[0], reference), GetRmse(checkpointImages[1], reference) };
+        check(rmse[1] < rmse[0], name, "more samples do not converge towards the reference");
+
+        json.Key("reference").BeginObject();
+        json.Field("samples", pathTracer.GetSampleCount());
+        json.Field("samplesPerSecond", float(total.GetSamplesPerSecond()));
+        json.Field("raysPerPath", float(double(total.extensionRays + total.shadowRays) / double(std::max<uint64_t>(1, total.paths))));
+        json.Field("totalMs", float(total.elapsedMs));
+        json.Field("rmseAtSixteenth", rmse[0]);
+        json.Field("rmseAtQuarter", rmse[1]);
+        // An image of N / 4 samples is off by sigma * sqrt(4 / N - 1 / N) against one of N, the reference by sigma / sqrt(N)
+        json.Field("referenceRmseEstimate", rmse[1] / std::sqrt(3.0f));
+
+        if (!referencePath.empty())
+        {
+            const std::string path = resolutions.size() == 1 ? referencePath : name + "_" + referencePath;
+            Image4F readBack;
+            if (!WriteExr(path, reference))
+            {
+                fprintf(stderr, "Failed to write '%s'\n", path.c_str());
+                return 1;
+            }
+            check(ReadExr(path, readBack) && IsIdentical(readBack, reference), name, "the EXR does not read back as written");
+            json.Field("path", path);
+        }
+        json.EndObject();
+        json.EndObject();
+    }
+
+    json.EndArray();
+    json.Field("failedChecks", failedChecks);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedChecks > 0 ? 2 : 0;
+}
@@ -0,0 +1,229 @@
+#include <cstdio>
+#include "Benchmarks.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/ResourcePool.h"
+#include "MockRenderer.h"
+
+using namespace Cpu;
+
+namespace
+{
+    struct MockTexture
+    {
+        TextureDesc desc;
+    };
+
+    using MockTexturePool = ResourcePool<MockTexture>;
+
+    // Allocates the way RaysRenderer does: persistent textures on resize, render graph textures on recompile
+    class PooledRenderer
+    {
+    public:
+        PooledRenderer(MockTexturePool& pool, const MockGraphConfig& config)
+            : mPool(pool),
+              mConfig(config)
+        {
+        }
+
+        // Also reallocates when the config changed the render scale
+        void Resize(uint32_t width, uint32_t height)
+        {
+            if (width == mWidth && height == mHeight && mConfig.renderScale == mRenderScale) return;
+
+            // RenderGraph::ReleaseTextures
+            for (const auto& texture : mGraphTextures) mPool.Release(texture);
+            mGraphTextures.clear();
+            for (const auto& texture : mPersistentTextures) mPool.Release(texture);
+            mPersistentTextures.clear();
+            for (const TextureDesc& desc : GetMockPersistentTextures(width, height, mConfig.renderScale)) mPersistentTextures.push_back(mPool.Acquire(desc));
+
+            mWidth = width;
+            mHeight = height;
+            mRenderScale = mConfig.renderScale;
+            mGraphDirty = true;
+        }
+
+        void SetConfig(const MockGraphConfig& config)
+        {
+            mConfig = config;
+            mGraphDirty = true;
+        }
+
+        // Loading a scene rebuilds the graph without changing it
+        void MarkGraphDirty() { mGraphDirty = true; }
+
+        void RenderFrame(uint32_t maxIdleFrames)
+        {
+            if (mGraphDirty)
+            {
+                BuildMockRenderGraph(mGraph, mConfig, mWidth, mHeight);
+                mGraph.Compile();
+
+                for (const auto& texture : mGraphTextures) mPool.Release(texture);
+                mGraphTextures.clear();
+                for (uint32_t i = 0; i < mGraph.GetPhysicalCount(); ++i) mGraphTextures.push_back(mPool.Acquire(mGraph.GetPhysicalDesc(i)));
+
+                mGraphDirty = false;
+            }
+
+            mPool.EndFrame(maxIdleFrames);
+        }
+
+    private:
+        MockTexturePool& mPool;
+        MockGraphConfig mConfig;
+        RenderGraphCompiler mGraph;
+        std::vector<std::shared_ptr<MockTexture>> mPersistentTextures;
+        std::vector<std::shared_ptr<MockTexture>> mGraphTextures;
+        uint32_t mWidth = 0;
+        uint32_t mHeight = 0;
+        float mRenderScale = 1.0f;
+        bool mGraphDirty = true;
+    };
+
+    enum class Expect : uint32_t
+    {
+        Any = 0,
+        NoAllocation,
+        Allocation,
+        Free            // Stays idle until the pool trims the textures of the other resolution
+    };
+
+    struct Step
+    {
+        const char* name;
+        const char* config;
+        uint32_t resolution;    // Index into --resolutions
+        bool sceneLoad;
+        Expect expect;
+    };
+
+    // Every step is followed by --frames steady frames, which must not allocate
+    const Step kSteps[] =
+    {
+        { "startup", "hybrid", 0, false, Expect::Allocation },
+        { "ao-off", "no-ao", 0, false, Expect::NoAllocation },
+        { "ao-on", "hybrid", 0, false, Expect::NoAllocation },
+        { "packed", "packed", 0, false, Expect::Any },
+        { "separate", "hybrid", 0, false, Expect::NoAllocation },
+        { "half-rays", "half-rays", 0, false, Expect::Allocation },
+        { "full-rays", "hybrid", 0, false, Expect::NoAllocation },
+        { "render-scale", "render-scale", 0, false, Expect::Allocation },
+        { "full-res", "hybrid", 0, false, Expect::NoAllocation },
+        { "scene-load", "hybrid", 0, true, Expect::NoAllocation },
+        { "resize", "hybrid", 1, false, Expect::Allocation },
+        { "resize-back", "hybrid", 0, false, Expect::NoAllocation },
+        { "idle", "hybrid", 0, false, Expect::Free },
+    };
+
+    const char* GetExpectName(Expect expect)
+    {
+        switch (expect)
+        {
+        case Expect::NoAllocation: return "noAllocation";
+        case Expect::Allocation: return "allocation";
+        case Expect::Free: return "free";
+        default: return "any";
+        }
+    }
+}
+
+int RunPoolBench(const CommandLine& args)
+{
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolutions", "1920x1080,1280x720");
+    const uint32_t steadyFrames = std::max(1u, args.GetUint("frames", 30));
+    const uint32_t maxIdleFrames = args.GetUint("max-idle-frames", 120);
+    const std::string outputPath = args.GetString("output", "");
+
+    if (resolutions.size() < 2)
+    {
+        fprintf(stderr, "--resolutions needs two resolutions to resize between\n");
+        return 1;
+    }
+
+    MockTexturePool pool([](const TextureDesc& desc)
+    {
+        std::shared_ptr<MockTexture> texture = std::make_shared<MockTexture>();
+        texture->desc = desc;
+        return texture;
+    });
+    PooledRenderer renderer(pool, *FindMockGraphConfig("hybrid"));
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "pool");
+    json.Field("steadyFrames", steadyFrames);
+    json.Field("maxIdleFrames", maxIdleFrames);
+    json.Key("steps").BeginArray();
+
+    uint32_t failedSteps = 0;
+
+    for (const Step& step : kSteps)
+    {
+        const Resolution& resolution = resolutions[step.resolution];
+        const uint64_t allocationsBefore = pool.GetAllocationCount();
+        const uint64_t freesBefore = pool.GetFreeCount();
+        const uint64_t reusesBefore = pool.GetReuseCount();
+        const uint64_t residentBefore = pool.GetResidentBytes();
+
+        renderer.SetConfig(*FindMockGraphConfig(step.config));
+        renderer.Resize(resolution.width, resolution.height);
+        if (step.sceneLoad) renderer.MarkGraphDirty();
+        renderer.RenderFrame(maxIdleFrames);
+
+        const uint64_t allocations = pool.GetAllocationCount() - allocationsBefore;
+        const uint64_t reuses = pool.GetReuseCount() - reusesBefore;
+
+        // Idling long enough lets the pool trim what the last resize left behind
+        const uint32_t frames = (step.expect == Expect::Free) ? maxIdleFrames + steadyFrames : steadyFrames;
+        const uint64_t steadyAllocationsBefore = pool.GetAllocationCount();
+        for (uint32_t i = 0; i < frames; ++i) renderer.RenderFrame(maxIdleFrames);
+        const uint64_t steadyAllocations = pool.GetAllocationCount() - steadyAllocationsBefore;
+        const uint64_t frees = pool.GetFreeCount() - freesBefore;
+
+        bool ok = (steadyAllocations == 0);
+        if (step.expect == Expect::NoAllocation) ok = ok && allocations == 0;
+        if (step.expect == Expect::Allocation) ok = ok && allocations > 0;
+        if (step.expect == Expect::Free) ok = ok && frees > 0 && pool.GetResidentBytes() < residentBefore && pool.GetResourceCount() == pool.GetInUseCount();
+        if (!ok)
+        {
+            fprintf(stderr, "pool step %s: %llu allocations, %llu in steady frames, %llu freed\n", step.name,
+                (unsigned long long)allocations, (unsigned long long)steadyAllocations, (unsigned long long)frees);
+            failedSteps++;
+        }
+
+        json.BeginObject();
+        json.Field("step", step.name);
+        json.Field("config", step.config);
+        json.Field("width", resolution.width);
+        json.Field("height", resolution.height);
+        json.Field("expect", GetExpectName(step.expect));
+        json.Field("ok", ok);
+        json.Field("allocations", allocations);
+        json.Field("reused", reuses);
+        json.Field("steadyAllocations", steadyAllocations);
+        json.Field("freed", frees);
+        json.Field("pooledTextures", pool.GetResourceCount());
+        json.Field("inUseTextures", pool.GetInUseCount());
+        json.Field("residentBytes", pool.GetResidentBytes());
+        json.EndObject();
+    }
+
+    json.EndArray();
+    json.Field("totalAllocations", pool.GetAllocationCount());
+    json.Field("failedSteps", failedSteps);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedSteps > 0 ? 2 : 0;
+}
@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "Benchmarks.h"
+#include "../Cpu/Bvh.h"
+#include "../Cpu/IrradianceProbes.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/Sampling.h"
+#include "../Cpu/Timer.h"
+
+using namespace Cpu;
+
+namespace
+{
+    // The part of the synthetic scene the camera orbits, the ground further out samples the outer probes
+    const float3 kGridMin(-4.0f, 0.1f, -4.0f);
+    const float3 kGridMax(4.0f, 2.5f, 4.0f);
+
+    // Apart from the seeds of the probe rays
+    const uint32_t kReferenceSeed = 0x52454649u;
+    const uint32_t kCheckSeed = 0x43484543u;
+
+    bool ParseProbeCounts(const std::string& text, int3& counts)
+    {
+        return sscanf(text.c_str(), "%dx%dx%d", &counts.x, &counts.y, &counts.z) == 3 && counts.x > 0 && counts.y > 0 && counts.z > 0;
+    }
+
+    float3 RandomDirection(uint32_t& seed)
+    {
+        const float z = 1.0f - 2.0f * RandNext(seed);
+        const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        const float phi = 2.0f * kPi * RandNext(seed);
+        return float3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+
+    // Largest error of a direction through OctEncode() and OctDecode(), including the axes and the folded corners
+    float GetOctRoundTripError(uint32_t samples)
+    {
+        const float3 axes[] = { float3(1, 0, 0), float3(-1, 0, 0), float3(0, 1, 0), float3(0, -1, 0), float3(0, 0, 1), float3(0, 0, -1) };
+        float maxError = 0.0f;
+        for (const float3& axis : axes) maxError = std::max(maxError, length(OctDecode(OctEncode(axis)) - axis));
+
+        uint32_t seed = RandInit(samples, kCheckSeed);
+        for (uint32_t i = 0; i < samples; ++i)
+        {
+            const float3 direction = RandomDirection(seed);
+            maxError = std::max(maxError, length(OctDecode(OctEncode(direction)) - direction));
+        }
+        return maxError;
+    }
+
+    // Largest relative error of PackR11G11B10() over a range of radiance values, per channel
+    float3 GetPackingError(uint32_t samples)
+    {
+        uint32_t seed = RandInit(samples, kCheckSeed + 1);
+        float3 maxError;
+        for (uint32_t i = 0; i < samples; ++i)
+        {
+            const float3 value(std::pow(10.0f, -3.0f + 6.0f * RandNext(seed)), std::pow(10.0f, -3.0f + 6.0f * RandNext(seed)),
+                std::pow(10.0f, -3.0f + 6.0f * RandNext(seed)));
+            const float3 error = abs(UnpackR11G11B10(PackR11G11B10(value)) - value) / value;
+            maxError = max(maxError, error);
+        }
+        return maxError;
+    }
+
+    // One bounce diffuse GI per pixel, referenceRays cosine distributed rays: albedo times the mean radiance they gather
+    void TraceReference(const IrradianceProbes& probes, const TriangleScene& scene, const Bvh& bvh, const RtGBuffer& gBuffer, uint32_t referenceRays,
+        ThreadPool& threadPool, Image4F& output)
+    {
+        const uint32_t width = gBuffer.worldPosition->GetWidth();
+        const uint32_t height = gBuffer.worldPosition->GetHeight();
+        output.Resize(width, height);
+
+        threadPool.ParallelForTiles(width, height, 16, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    const float4 posW = gBuffer.worldPosition->At(int(x), int(y));
+                    if (posW.w == 0.0f) continue;
+                    const float3 N = gBuffer.normalRoughness->At(int(x), int(y)).rgb();
+                    const float3 T = normalize(GetPerpendicularStark(N));
+
+                    uint32_t seed = RandInit(y * width + x, kReferenceSeed);
+                    float3 sum;
+                    uint64_t rays = 0;
+                    for (uint32_t i = 0; i < referenceRays; ++i)
+                    {
+                        Ray ray;
+                        ray.origin = posW.rgb();
+                        ray.direction = GetCosHemisphereSample(float2(RandNext(seed), RandNext(seed)), N, T);
+                        ray.tMin = 0.001f;
+                        ray.tMax = 100000.0f;
+                        float distance;
+                        sum += probes.TraceRadiance(scene, bvh, ray, false, distance, rays);
+                    }
+                    output.At(int(x), int(y)) = float4(gBuffer.albedo->At(int(x), int(y)).rgb() * sum / float(referenceRays), 1.0f);
+                }
+            }
+        });
+    }
+
+    double GetRmse(const Image4F& a, const Image4F& b, const Image4F& worldPosition)
+    {
+        double sumSquared = 0.0;
+        double count = 0.0;
+        for (size_t i = 0; i < a.GetPixelCount(); ++i)
+        {
+            if (worldPosition.GetData()[i].w == 0.0f) continue;
+            const float3 d = a.GetData()[i].rgb() - b.GetData()[i].rgb();
+            sumSquared += double(d.x) * d.x + double(d.y) * d.y + double(d.z) * d.z;
+            count += 3.0;
+        }
+        return count > 0.0 ? std::sqrt(sumSquared / count) : 0.0;
+    }
+
+    double GetMeanLuminance(const Image4F& image, const Image4F& worldPosition)
+    {
+        double sum = 0.0;
+        double count = 0.0;
+        for (size_t i = 0; i < image.GetPixelCount(); ++i)
+        {
+            if (worldPosition.GetData()[i].w == 0.0f) continue;
+            sum += luminance(image.GetData()[i].rgb());
+            count += 1.0;
+        }
+        return count > 0.0 ? sum / count : 0.0;
+    }
+}
+
+int RunProbeBench(const CommandLine& args)
+{
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolutions", "320x180");
+    const std::vector<std::string> probeCountNames = args.GetStringList("probe-counts", "4x2x4,8x4x8,16x8x16");
+    const uint32_t raysPerProbe = std::max(1u, args.GetUint("rays-per-probe", 64));
+    const uint32_t rayBudget = std::max(1u, args.GetUint("ray-budget", 4096));
+    const uint32_t cycles = std::max(1u, args.GetUint("cycles", 4));
+    const uint32_t sphereSegments = args.GetUint("segments", 64);
+    const uint32_t lightCount = std::max(1u, args.GetUint("lights", 1));
+    const uint32_t referenceRays = std::max(1u, args.GetUint("reference-rays", 64));
+    const bool multiBounce = args.GetUint("multi-bounce", 0) != 0;
+    const std::string outputPath = args.GetString("output", "");
+
+    std::vector<int3> probeCounts;
+    for (const std::string& name : probeCountNames)
+    {
+        int3 counts;
+        if (!ParseProbeCounts(name, counts))
+        {
+            fprintf(stderr, "Malformed probe count '%s', expected e.g. 8x4x8\n", name.c_str());
+            return 1;
+        }
+        probeCounts.push_back(counts);
+    }
+
+    ThreadPool threadPool(args.GetUint("threads", 0));
+
+    uint32_t failedChecks = 0;
+    auto check = [&](bool condition, const std::string& name, const char* message)
+    {
+        if (condition) return;
+        fprintf(stderr, "probes: %s: %s\n", name.c_str(), message);
+        failedChecks++;
+    };
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "probes");
+    json.Field("threads", threadPool.GetThreadCount());
+    json.Field("raysPerProbe", raysPerProbe);
+    json.Field("rayBudget", rayBudget);
+    json.Field("cycles", cycles);
+    json.Field("lights", lightCount);
+    json.Field("multiBounce", multiBounce);
+
+    // Encodings
+    const float octError = GetOctRoundTripError(100000);
+    const float3 packingError = GetPackingError(100000);
+    json.Field("octRoundTripError", octError);
+    json.Field("packingErrorRG", std::max(packingError.x, packingError.y));
+    json.Field("packingErrorB", packingError.z);
+    check(octError < 1e-5f, "octahedral", "directions do not survive OctEncode() and OctDecode()");
+    // 6 and 5 mantissa bits, rounded to nearest
+    check(packingError.x <= 1.0f / 64.0f && packingError.y <= 1.0f / 64.0f && packingError.z <= 1.0f / 32.0f, "r11g11b10",
+        "packing loses more than half a step of the mantissa");
+
+    // Without geometry in reach and without lights every probe sees the sky, after its first update already
+    {
+        TriangleScene emptyScene;
+        const float3 farAway[] = { float3(1000.0f, -1000.0f, 1000.0f), float3(1001.0f, -1000.0f, 1000.0f), float3(1000.0f, -1000.0f, 1001.0f) };
+        const uint32_t indices[] = { 0, 1, 2 };
+        emptyScene.AddTriangles(farAway, nullptr, 3, indices, 3, emptyScene.AddMaterial(SceneMaterial()));
+        Bvh emptyBvh;
+        emptyBvh.Build(emptyScene);
+
+        IrradianceProbes probes(&threadPool);
+        IrradianceProbeSettings& settings = probes.GetSettings();
+        settings.counts = int3(4, 2, 4);
+        settings.raysPerProbe = raysPerProbe;
+        settings.raysPerFrame = rayBudget;
+        FitProbeGrid(kGridMin, kGridMax, settings);
+        const uint32_t framesPerCycle = (probes.GetProbeCount() + probes.GetProbesPerFrame() - 1) / probes.GetProbesPerFrame();
+        for (uint32_t frameIndex = 0; frameIndex < framesPerCycle; ++frameIndex) probes.Update(emptyScene, emptyBvh, frameIndex);
+
+        float maxError = 0.0f;
+        uint32_t seed = RandInit(0, kCheckSeed + 2);
+        for (uint32_t i = 0; i < 1000; ++i)
+        {
+            const float3 p(lerp(kGridMin.x, kGridMax.x, RandNext(seed)), lerp(kGridMin.y, kGridMax.y, RandNext(seed)), lerp(kGridMin.z, kGridMax.z, RandNext(seed)));
+            const float3 irradiance = probes.Sample(p, RandomDirection(seed));
+            const float3 error = abs(irradiance - settings.skyColor) / settings.skyColor;
+            maxError = std::max(maxError, std::max(error.x, std::max(error.y, error.z)));
+        }
+        json.Field("skyError", maxError);
+        check(maxError <= 0.02f, "sky", "probes under an empty sky do not converge to its color");
+    }
+
+    json.Key("runs").BeginArray();
+
+    SyntheticScene syntheticScene;
+    TriangleScene scene;
+    syntheticScene.BuildTriangleScene(sphereSegments, scene);
+    syntheticScene.AddPointLights(lightCount, scene);
+    Bvh bvh;
+    bvh.Build(scene, BvhBuildSettings(), &threadPool);
+
+    FrameData frame;
+    for (const Resolution& resolution : resolutions)
+    {
+        const std::string resolutionName = std::to_string(resolution.width) + "x" + std::to_string(resolution.height);
+        syntheticScene.RenderFrame(0, resolution.width, resolution.height, frame, threadPool);
+        RtGBuffer gBuffer;
+        gBuffer.worldPosition = &frame.Get(FrameTarget::WorldPosition);
+        gBuffer.normalRoughness = &frame.Get(FrameTarget::NormalRoughness);
+        gBuffer.albedo = &frame.Get(FrameTarget::Albedo);
+        gBuffer.cameraPosition = syntheticScene.GetCameraPosition(0);
+
+        // What per-pixel rays would cost, and what the probes should converge to
+        fprintf(stderr, "probes %s reference\n", resolutionName.c_str());
+        IrradianceProbes referenceSettings(&threadPool);
+        FitProbeGrid(kGridMin, kGridMax, referenceSettings.GetSettings());
+        Image4F reference;
+        const Timer referenceTimer;
+        TraceReference(referenceSettings, scene, bvh, gBuffer, referenceRays, threadPool, reference);
+        const double referenceMs = referenceTimer.GetElapsedMs();
+        const double referenceLuminance = GetMeanLuminance(reference, *gBuffer.worldPosition);
+
+        json.BeginObject();
+        json.Field("resolution", resolutionName);
+        json.Field("referenceRays", referenceRays);
+        json.Field("referenceMs", float(referenceMs));
+        json.Field("perPixelRayMs", float(referenceMs / referenceRays));
+        json.Field("referenceLuminance", float(referenceLuminance));
+        json.Key("probeCounts").BeginArray();
+
+        for (size_t c = 0; c < probeCounts.size(); ++c)
+        {
+            const std::string runName = resolutionName + " " + probeCountNames[c];
+            fprintf(stderr, "probes %s\n", runName.c_str());
+
+            IrradianceProbes probes(&threadPool);
+            IrradianceProbeSettings& settings = probes.GetSettings();
+            settings.counts = probeCounts[c];
+            settings.raysPerProbe = raysPerProbe;
+            settings.raysPerFrame = rayBudget;
+            settings.multiBounce = multiBounce;
+            FitProbeGrid(kGridMin, kGridMax, settings);
+
+            const uint32_t probeCount = probes.GetProbeCount();
+            const uint32_t probesPerFrame = probes.GetProbesPerFrame();
+            const uint32_t framesPerCycle = (probeCount + probesPerFrame - 1) / probesPerFrame;
+            const uint32_t frameCount = framesPerCycle * cycles;
+
+            std::vector<uint32_t> updates(probeCount, 0);
+            double updateMs = 0.0;
+            uint64_t rays = 0;
+            for (uint32_t frameIndex = 0; frameIndex < frameCount; ++frameIndex)
+            {
+                probes.Update(scene, bvh, frameIndex);
+                const IrradianceProbeStats& stats = probes.GetStats();
+                updateMs += stats.elapsedMs;
+                rays += stats.rays;
+                for (uint32_t k = 0; k < stats.probes; ++k) updates[(stats.firstProbe + k) % probeCount]++;
+
+                // Every probe once per cycle, none twice before the others had their turn
+                if (frameIndex == framesPerCycle - 1)
+                {
+                    const auto range = std::minmax_element(updates.begin(), updates.end());
+                    check(*range.first >= 1 && *range.second - *range.first <= 1, runName, "the round robin skips probes");
+                }
+            }
+
+            Image4F shaded;
+            const Timer shadeTimer;
+            probes.Shade(gBuffer, shaded);
+            const double shadeMs = shadeTimer.GetElapsedMs();
+
+            json.BeginObject();
+            json.Field("probeCounts", probeCountNames[c]);
+            json.Field("probes", probeCount);
+            json.Field("probesPerFrame", probesPerFrame);
+            json.Field("framesPerCycle", framesPerCycle);
+            json.Field("updateMs", float(updateMs / frameCount));
+            json.Field("raysPerFrame", float(double(rays) / frameCount));
+            json.Field("shadeMs", float(shadeMs));
+            json.Field("atlasBytes", uint64_t(probes.GetSizeInBytes()));
+            json.Field("irradianceRmse", float(GetRmse(shaded, reference, *gBuffer.worldPosition)));
+            json.Field("luminance", float(GetMeanLuminance(shaded, *gBuffer.worldPosition)));
+            json.EndObject();
+        }
+        json.EndArray();
+        json.EndObject();
+    }
+
+    json.EndArray();
+    json.Field("failedChecks", failedChecks);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedChecks > 0 ? 2 : 0;
+}
@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include "Benchmarks.h"
+#include "../Cpu/FrameProfiler.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/SVGF.h"
+#include "../Cpu/SVGFSharedHistory.h"
+#include "../Cpu/Timer.h"
+
+using namespace Cpu;
+
+namespace
+{
+    struct SignalInfo
+    {
+        FrameTarget target;
+        SVGFSignalType signalType;
+        const char* scope;
+    };
+
+    // The compact filters with the pass names RaysRenderer profiles them under
+    const SignalInfo kSignals[] =
+    {
+        { FrameTarget::Shadow, SVGFSignalType::Scalar, "DenoiseShadows" },
+        { FrameTarget::Reflection, SVGFSignalType::Color, "DenoiseReflection" },
+        { FrameTarget::AO, SVGFSignalType::Scalar, "DenoiseAO" },
+    };
+
+    const uint32_t kSignalCount = sizeof(kSignals) / sizeof(kSignals[0]);
+
+    // Slack for the clock reads between a parent scope and its children
+    const double kNestingToleranceMs = 0.01;
+
+    // Nanoseconds per scope of two nested scopes opened scopeCount / 2 times
+    double MeasureScopeNs(uint32_t scopeCount)
+    {
+        Timer timer;
+        for (uint32_t i = 0; i < scopeCount / 2; ++i)
+        {
+            FRAME_PROFILE("Outer");
+            FRAME_PROFILE("Inner");
+        }
+        return timer.GetElapsedMs() * 1e6 / double(std::max(2u, scopeCount & ~1u));
+    }
+
+    // GPU times 1 to 100 ms over a ring that wrapped, the percentiles are known exactly
+    bool CheckStats()
+    {
+        FrameProfiler profiler(100);
+        FrameProfiler::SetActive(&profiler);
+        for (uint32_t frame = 0; frame < 140; ++frame)
+        {
+            profiler.BeginFrame(frame);
+            {
+                ProfileScope scope("Pass");
+                profiler.MarkGpuEvent(scope.GetNode());
+            }
+            profiler.ResolveGpuTimes([&](const ProfileNode&) { return double(frame % 100 + 1); });
+            profiler.EndFrame();
+        }
+        FrameProfiler::SetActive(nullptr);
+
+        const SampleStats stats = profiler.GetGpuStats(profiler.FindNode("Pass"));
+        return profiler.GetFrameCount() == 100 && profiler.GetFrame(0).frameIndex == 40 && profiler.GetFrame(99).frameIndex == 139 &&
+            stats.count == 100 && stats.mean == 50.5 && stats.min == 1.0 && stats.p50 == 50.0 && stats.p90 == 90.0 && stats.p99 == 99.0 && stats.max == 100.0;
+    }
+
+    // Every scope closed by a pool task is kept. Tasks the calling thread runs nest under Parallel, the workers' are roots.
+    bool CheckThreads(ThreadPool& threadPool, uint32_t& threadCount)
+    {
+        const uint32_t taskCount = 256;
+        FrameProfiler profiler(1);
+        FrameProfiler::SetActive(&profiler);
+        profiler.BeginFrame(0);
+        {
+            FRAME_PROFILE("Parallel");
+            threadPool.ParallelFor(taskCount, [](uint32_t, uint32_t)
+            {
+                FRAME_PROFILE("Task");
+                Timer timer;
+                while (timer.GetElapsedMs() < 0.01) {}
+            });
+        }
+        profiler.EndFrame();
+        FrameProfiler::SetActive(nullptr);
+
+        uint32_t calls = 0;
+        std::vector<bool> threads;
+        for (const ProfileEvent& event : profiler.GetFrame(0).events)
+        {
+            if (profiler.GetNode(event.node).name != "Task") continue;
+            calls++;
+            threads.resize(std::max<size_t>(threads.size(), event.thread + 1), false);
+            threads[event.thread] = true;
+        }
+        threadCount = uint32_t(std::count(threads.begin(), threads.end(), true));
+        return calls == taskCount;
+    }
+
+    // Children fit in their parent in every frame of the history
+    bool CheckNesting(const FrameProfiler& profiler)
+    {
+        for (uint32_t f = 0; f < profiler.GetFrameCount(); ++f)
+        {
+            const ProfileFrame& frame = profiler.GetFrame(f);
+            for (uint32_t n = 0; n < frame.cpuMs.size(); ++n)
+            {
+                if (frame.cpuMs[n] < 0.0f) continue;
+
+                double childrenMs = 0.0;
+                for (uint32_t child : profiler.GetNode(n).children)
+                {
+                    if (child < frame.cpuMs.size() && frame.cpuMs[child] > 0.0f) childrenMs += frame.cpuMs[child];
+                }
+                if (childrenMs > frame.cpuMs[n] + kNestingToleranceMs) return false;
+            }
+        }
+        return true;
+    }
+
+    uint32_t CountLines(const std::string& path)
+    {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) return 0;
+        uint32_t lines = 0;
+        for (int c = fgetc(file); c != EOF; c = fgetc(file)) lines += (c == '\n');
+        fclose(file);
+        return lines;
+    }
+
+    uint32_t CountOccurrences(const std::string& path, const std::string& pattern)
+    {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) return 0;
+        std::string text;
+        char buffer[65536];
+        for (size_t read = fread(buffer, 1, sizeof(buffer), file); read > 0; read = fread(buffer, 1, sizeof(buffer), file)) text.append(buffer, read);
+        fclose(file);
+
+        uint32_t count = 0;
+        for (size_t at = text.find(pattern); at != std::string::npos; at = text.find(pattern, at + pattern.size())) count++;
+        return count;
+    }
+}
+
+int RunProfileBench(const CommandLine& args)
+{
+    const std::string sequence = args.GetString("sequence", "");
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolutions", "320x180");
+    const uint32_t frameCount = std::max(1u, args.GetUint("frames", 30));
+    const uint32_t historyFrames = std::max(1u, args.GetUint("history", 16));
+    // The feedback tap is the second iteration
+    const uint32_t atrousIterations = std::max(2u, args.GetUint("iterations", 4));
+    const uint32_t scopeCount = std::max(2u, args.GetUint("scopes", 200000));
+    const double maxScopeNs = args.GetFloat("max-scope-ns", 2000.0f);
+    // The exports of the last resolution are only kept when asked for
+    const std::string tracePath = args.GetString("trace", "");
+    const std::string framesPath = args.GetString("csv", "");
+    const std::string statsPath = args.GetString("stats", "");
+    const std::string outputPath = args.GetString("output", "");
+
+    ThreadPool threadPool(args.GetUint("threads", 0));
+    FrameSource source(sequence, threadPool);
+    if (!source.IsValid())
+    {
+        fprintf(stderr, "No frames found in '%s'\n", sequence.c_str());
+        return 1;
+    }
+
+    uint32_t failedChecks = 0;
+
+    // The inactive cost is what every instrumented library call pays outside of profiled runs
+    FrameProfiler overheadProfiler(1);
+    FrameProfiler::SetActive(&overheadProfiler);
+    overheadProfiler.BeginFrame(0);
+    const double activeScopeNs = MeasureScopeNs(scopeCount);
+    overheadProfiler.EndFrame();
+    FrameProfiler::SetActive(nullptr);
+    const double inactiveScopeNs = MeasureScopeNs(scopeCount);
+    const bool overheadValid = activeScopeNs <= maxScopeNs && overheadProfiler.GetFrame(0).events.size() == (scopeCount & ~1u);
+    if (!overheadValid)
+    {
+        fprintf(stderr, "profile: %.0f ns per scope, %zu of %u scopes recorded\n", activeScopeNs, overheadProfiler.GetFrame(0).events.size(), scopeCount & ~1u);
+        failedChecks++;
+    }
+
+    const bool statsValid = CheckStats();
+    if (!statsValid)
+    {
+        fprintf(stderr, "profile: percentiles over the history do not match\n");
+        failedChecks++;
+    }
+
+    uint32_t profiledThreads = 0;
+    const bool threadsValid = CheckThreads(threadPool, profiledThreads);
+    if (!threadsValid)
+    {
+        fprintf(stderr, "profile: scopes of pool tasks were lost\n");
+        failedChecks++;
+    }
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "profile");
+    json.Field("source", source.GetName());
+    json.Field("threads", threadPool.GetThreadCount());
+    json.Field("frames", frameCount);
+    json.Field("history", historyFrames);
+    json.Field("activeScopeNs", activeScopeNs);
+    json.Field("inactiveScopeNs", inactiveScopeNs);
+    json.Field("overheadValid", overheadValid);
+    json.Field("statsValid", statsValid);
+    json.Field("threadsValid", threadsValid);
+    json.Field("profiledThreads", profiledThreads);
+    json.Key("runs").BeginArray();
+
+    FrameData frame;
+    for (const Resolution& resolution : resolutions)
+    {
+        fprintf(stderr, "profile %ux%u\n", resolution.width, resolution.height);
+
+        SVGFSharedHistory history(resolution.width, resolution.height, &threadPool);
+        std::unique_ptr<SVGFPass> filters[kSignalCount];
+        for (uint32_t s = 0; s < kSignalCount; ++s)
+        {
+            filters[s].reset(new SVGFPass(resolution.width, resolution.height, history, kSignals[s].signalType, &threadPool));
+            filters[s]->GetSettings().atrousIterations = atrousIterations;
+        }
+
+        // The filters as RaysRenderer runs them, one profiled frame each
+        FrameProfiler profiler(historyFrames);
+        FrameProfiler::SetActive(&profiler);
+        for (uint32_t i = 0; i < frameCount; ++i)
+        {
+            if (!source.GetFrame(i, resolution.width, resolution.height, frame))
+            {
+                FrameProfiler::SetActive(nullptr);
+                fprintf(stderr, "Failed to load frame %u\n", i);
+                return 1;
+            }
+            const Image4F& motionVec = frame.Get(FrameTarget::MotionVector);
+            const Image4F& linearZ = frame.Get(FrameTarget::SVGF_LinearZ);
+
+            profiler.BeginFrame(i);
+            {
+                FRAME_PROFILE("RenderFrame");
+                {
+                    FRAME_PROFILE("SVGFHistory");
+                    history.Update(motionVec, linearZ);
+                }
+                for (uint32_t s = 0; s < kSignalCount; ++s)
+                {
+                    FRAME_PROFILE(kSignals[s].scope);
+                    filters[s]->Execute(frame.Get(kSignals[s].target), motionVec, linearZ, frame.Get(FrameTarget::SVGF_CompactNormDepth));
+                }
+                {
+                    FRAME_PROFILE("SVGFHistoryEnd");
+                    history.EndFrame(linearZ);
+                }
+            }
+            profiler.EndFrame();
+        }
+        FrameProfiler::SetActive(nullptr);
+
+        // Every stage of every filter, each once per frame
+        std::vector<std::string> stages = { "RenderFrame/SVGFHistoryEnd/PrevLinearZBlit" };
+        for (const SignalInfo& signal : kSignals)
+        {
+            const std::string scope = std::string("RenderFrame/") + signal.scope + "/";
+            for (const char* stage : { "Decode", "Reprojection", "VarianceEstimation", "FeedbackBlit" }) stages.push_back(scope + stage);
+            for (uint32_t i = 0; i < atrousIterations; ++i) stages.push_back(scope + "Atrous" + std::to_string(i));
+        }
+
+        bool hierarchyValid = profiler.GetFrameCount() == std::min(frameCount, historyFrames) &&
+            profiler.GetFrame(profiler.GetFrameCount() - 1).frameIndex == frameCount - 1;
+        for (const std::string& stage : stages)
+        {
+            const uint32_t node = profiler.FindNode(stage);
+            hierarchyValid = hierarchyValid && node != kNoProfileNode && profiler.GetCpuStats(node).count == profiler.GetFrameCount();
+            for (uint32_t f = 0; hierarchyValid && f < profiler.GetFrameCount(); ++f) hierarchyValid = profiler.GetFrame(f).calls[node] == 1;
+        }
+        const bool nestingValid = CheckNesting(profiler);
+
+        // The exports hold what the history holds
+        const std::string trace = tracePath.empty() ? "profile_bench_trace.json" : tracePath;
+        const std::string frames = framesPath.empty() ? "profile_bench_frames.csv" : framesPath;
+        const std::string stats = statsPath.empty() ? "profile_bench_stats.csv" : statsPath;
+        uint32_t expectedEvents = 0;
+        uint32_t expectedRows = 0;
+        for (uint32_t f = 0; f < profiler.GetFrameCount(); ++f)
+        {
+            const ProfileFrame& profiled = profiler.GetFrame(f);
+            expectedEvents += uint32_t(profiled.events.size()) + 1;
+            expectedRows += uint32_t(std::count_if(profiled.cpuMs.begin(), profiled.cpuMs.end(), [](float ms) { return ms >= 0.0f; }));
+        }
+        const bool exportValid = profiler.WriteChromeTrace(trace) && profiler.WriteFramesCsv(frames) && profiler.WriteStatsCsv(stats) &&
+            CountOccurrences(trace, "\"ph\": \"X\"") == expectedEvents && CountLines(frames) == expectedRows + 1 && CountLines(stats) == profiler.GetNodeCount() + 2;
+        if (tracePath.empty()) remove(trace.c_str());
+        if (framesPath.empty()) remove(frames.c_str());
+        if (statsPath.empty()) remove(stats.c_str());
+
+        if (!hierarchyValid || !nestingValid || !exportValid)
+        {
+            fprintf(stderr, "profile %ux%u: %s\n", resolution.width, resolution.height,
+                !hierarchyValid ? "stages missing from the hierarchy" : !nestingValid ? "children outlast their parent" : "exports do not match the history");
+            failedChecks++;
+        }
+
+        const SampleStats frameStats = profiler.GetFrameStats();
+        json.BeginObject();
+        json.Field("width", resolution.width);
+        json.Field("height", resolution.height);
+        json.Field("nodes", profiler.GetNodeCount());
+        WriteStats(json, "frameMs", frameStats);
+        json.Key("scopes").BeginArray();
+        for (uint32_t n = 0; n < profiler.GetNodeCount(); ++n)
+        {
+            const SampleStats nodeStats = profiler.GetCpuStats(n);
+            json.BeginObject();
+            json.Field("path", profiler.GetNode(n).path);
+            json.Field("frames", nodeStats.count);
+            WriteStats(json, "cpuMs", nodeStats);
+            json.EndObject();
+        }
+        json.EndArray();
+        json.Field("hierarchyValid", hierarchyValid);
+        json.Field("nestingValid", nestingValid);
+        json.Field("exportValid", exportValid);
+        json.EndObject();
+    }
+
+    json.EndArray();
+    json.Field("failedChecks", failedChecks);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedChecks > 0 ? 2 : 0;
+}
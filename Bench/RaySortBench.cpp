@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "Benchmarks.h"
+#include "ObjScene.h"
+#include "../Cpu/Bvh.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/RaytracedEffects.h"
+#include "../Cpu/Sampling.h"
+#include "../Cpu/SceneCache.h"
+#include "../Cpu/Timer.h"
+
+using namespace Cpu;
+
+namespace
+{
+    enum class Effect : uint32_t { Shadows = 0, AO, Reflection, Count };
+    const char* const kEffectNames[] = { "shadows", "ao", "reflection" };
+
+    struct OrderInfo
+    {
+        const char* name;
+        RayOrder order;
+    };
+
+    const OrderInfo kOrders[] =
+    {
+        { "launch", RayOrder::Launch },
+        { "sorted", RayOrder::Sorted },
+        { "packets", RayOrder::SortedPackets },
+    };
+
+    void Trace(RaytracedEffects& effects, Effect effect, const RtGBuffer& gBuffer, uint32_t frame, float aoDistance, Image4F& output)
+    {
+        switch (effect)
+        {
+        case Effect::Shadows: effects.TraceShadows(gBuffer, RayScale::Full, frame, output); break;
+        case Effect::AO: effects.TraceAO(gBuffer, RayScale::Full, frame, aoDistance, output); break;
+        default: effects.TraceReflection(gBuffer, RayScale::Full, frame, output); break;
+        }
+    }
+
+    // Pixels with geometry whose output is not bitwise the same
+    uint32_t CountDifferentPixels(const Image4F& a, const Image4F& b, const Image4F& worldPosition)
+    {
+        uint32_t different = 0;
+        for (uint32_t y = 0; y < worldPosition.GetHeight(); ++y)
+        {
+            for (uint32_t x = 0; x < worldPosition.GetWidth(); ++x)
+            {
+                if (worldPosition.At(int(x), int(y)).w == 0.0f) continue;
+                if (std::memcmp(&a.At(int(x), int(y)), &b.At(int(x), int(y)), sizeof(float4)) != 0) different++;
+            }
+        }
+        return different;
+    }
+}
+
+int RunRaySortBench(const CommandLine& args)
+{
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolutions", "1280x720");
+    const uint32_t grid = std::max(1u, args.GetUint("grid", 4));
+    const uint32_t sphereSegments = args.GetUint("segments", 128);
+    const std::string sceneCachePath = args.GetString("scene-cache", "");
+    const uint32_t frameCount = std::max(1u, args.GetUint("frames", 3));
+    const float aoDistance = args.GetFloat("ao-distance", 1.0f);
+    const float maxMismatchFraction = args.GetFloat("max-mismatch-fraction", 1e-3f);
+    const std::string outputPath = args.GetString("output", "");
+
+    ThreadPool threadPool(args.GetUint("threads", 0));
+
+    uint32_t failedChecks = 0;
+    auto check = [&](bool condition, const std::string& name, const char* message)
+    {
+        if (condition) return;
+        fprintf(stderr, "raysort: %s: %s\n", name.c_str(), message);
+        failedChecks++;
+    };
+
+    // A grid of the synthetic scene, or e.g. the cache RaysRenderer writes next to Pica.fscene
+    std::string sceneName = "grid" + std::to_string(grid);
+    SceneData sceneData;
+    SceneCache sceneCache;
+    SceneView view;
+    if (sceneCachePath.empty())
+    {
+        BuildGridScene(sphereSegments, grid, sceneData);
+        view = sceneData.GetView();
+    }
+    else
+    {
+        sceneName = sceneCachePath;
+        const SceneCache::Status status = sceneCache.OpenAnySource(sceneCachePath);
+        if (status != SceneCache::Status::Ok)
+        {
+            fprintf(stderr, "Failed to open '%s': %s\n", sceneCachePath.c_str(), GetSceneCacheStatusName(status));
+            return 1;
+        }
+        view = sceneCache.GetView();
+    }
+
+    TriangleScene scene;
+    BuildTriangleScene(view, scene, &threadPool);
+    if (scene.GetTriangleCount() == 0)
+    {
+        fprintf(stderr, "raysort: %s has no triangles\n", sceneName.c_str());
+        return 1;
+    }
+    Bvh bvh;
+    bvh.Build(scene, BvhBuildSettings(), &threadPool);
+    RaytracedEffects effects(scene, bvh, threadPool);
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "raysort");
+    json.Field("scene", sceneName);
+    json.Field("triangles", scene.GetTriangleCount());
+    json.Field("threads", threadPool.GetThreadCount());
+    json.Field("frames", frameCount);
+    json.Key("runs").BeginArray();
+
+    for (const Resolution& resolution : resolutions)
+    {
+        const std::string resolutionName = std::to_string(resolution.width) + "x" + std::to_string(resolution.height);
+        GBuffer gBuffer;
+        RenderGBuffer(scene, bvh, resolution.width, resolution.height, threadPool, gBuffer);
+
+        for (uint32_t e = 0; e < uint32_t(Effect::Count); ++e)
+        {
+            const Effect effect = Effect(e);
+            if (effect == Effect::Shadows && scene.GetLightCount() == 0) continue;
+            const std::string name = resolutionName + " " + kEffectNames[e];
+
+            json.BeginObject();
+            json.Field("resolution", resolutionName);
+            json.Field("effect", kEffectNames[e]);
+            json.Key("orders").BeginArray();
+
+            // The best frame of each order; the outputs of the last frame are compared with launch order
+            Image4F launchOutput;
+            double launchMs = 0.0;
+            for (const OrderInfo& info : kOrders)
+            {
+                effects.SetRayOrder(info.order);
+                Image4F output;
+                RtTraceStats best;
+                for (uint32_t frame = 0; frame < frameCount; ++frame)
+                {
+                    Trace(effects, effect, gBuffer.view, frame, aoDistance, output);
+                    const RtTraceStats& stats = effects.GetLastStats();
+                    if (frame == 0 || stats.elapsedMs < best.elapsedMs) best = stats;
+                }
+
+                uint32_t differentPixels = 0;
+                if (info.order == RayOrder::Launch)
+                {
+                    launchOutput = output;
+                    launchMs = best.elapsedMs;
+                }
+                else
+                {
+                    differentPixels = CountDifferentPixels(launchOutput, output, gBuffer.worldPosition);
+                    // Sorting only reorders the rays. A packet may report the other one of two triangles at the same
+                    // distance, which only changes what a reflection ray shades.
+                    if (info.order == RayOrder::Sorted || effect != Effect::Reflection)
+                    {
+                        check(differentPixels == 0, name + " " + info.name, "the output differs from launch order");
+                    }
+                    else
+                    {
+                        check(float(differentPixels) <= maxMismatchFraction * float(resolution.width * resolution.height),
+                            name + " " + info.name, "too many pixels differ from launch order");
+                    }
+                }
+
+                json.BeginObject();
+                json.Field("order", info.name);
+                json.Field("ms", best.elapsedMs);
+                json.Field("binMs", best.binMs);
+                json.Field("rays", best.rays);
+                json.Field("mraysPerSecond", float(best.GetRaysPerSecond() * 1e-6));
+                json.Field("speedup", best.elapsedMs > 0.0 ? launchMs / best.elapsedMs : 0.0);
+                if (info.order != RayOrder::Launch) json.Field("occupiedBins", best.occupiedBins);
+                json.Field("differentPixels", differentPixels);
+                json.EndObject();
+            }
+            json.EndArray();
+            json.EndObject();
+        }
+    }
+    json.EndArray();
+    json.Field("failedChecks", failedChecks);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedChecks > 0 ? 2 : 0;
+}
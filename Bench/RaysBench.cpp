@@ -0,0 +1,135 @@
+#include <cstdio>
+#include <cstring>
+#include "Benchmarks.h"
+#include "../Cpu/FrameProfiler.h"
+
+namespace
+{
+    struct Command
+    {
+        const char* name;
+        int(*run)(const CommandLine& args);
+        const char* usage;
+    };
+
+    const Command kCommands[] =
+    {
+        { "denoise", RunDenoiseBench,
+          "[--sequence dir|capture.rcap] [--frames 60] [--warmup 5] [--resolutions 1280x720,1920x1080]\n"
+          "            [--iterations 2,4] [--radius 1,2] [--modes separate,packed,compact]\n"
+          "            [--atrous-paths pixel,tiled] [--tolerance 0.01] [--threads 0] [--output denoise.json]" },
+        { "upsample", RunUpsampleBench,
+          "[--sequence dir|capture.rcap] [--frames 60] [--warmup 5] [--resolutions 1280x720,1920x1080]\n"
+          "            [--scales full,half,checkerboard,quarter] [--threads 0] [--output upsample.json]" },
+        { "graph", RunGraphBench,
+          "[--resolutions 1280x720,1920x1080] [--configs hybrid,packed,no-ao,no-denoise,half-rays,quarter-rays,recording,deferred,forward,\n"
+          "            render-scale,forward-render-scale,adaptive,adaptive-half-rays,sampled-lights,probe-gi] [--output graph.json]" },
+        { "pool", RunPoolBench,
+          "[--resolutions 1920x1080,1280x720] [--frames 30] [--max-idle-frames 120] [--output pool.json]" },
+        { "dynres", RunDynamicResolutionBench,
+          "[--traces light,heavy,raster,noisy,spike,sweep] [--frames 1800] [--target-ms 16.6] [--output dynres.json]" },
+        { "rt", RunRtBench,
+          "[--resolutions 1280x720] [--scales full,half,quarter] [--frames 8] [--segments 64] [--validation-rays 20000]\n"
+          "            [--threads 0] [--output rt.json]" },
+        { "scenecache", RunSceneCacheBench,
+          "[--segments 256] [--grid 2] [--runs 3] [--validation-rays 20000] [--directory .] [--keep] [--output scenecache.json]" },
+        { "sceneload", RunSceneLoadBench,
+          "[--segments 256] [--grid 2] [--frame-ms 8] [--max-stall-ms 50] [--validation-rays 20000] [--threads 0]\n"
+          "            [--directory .] [--keep] [--output sceneload.json]" },
+        { "bvh", RunBvhBench,
+          "[--grids 2,4] [--segments 128] [--coarse-segments 16] [--scene-cache Data/Models/Pica.fscene.rayscache] [--rays 500000]\n"
+          "            [--validation-rays 20000] [--max-mismatch-fraction 0.001] [--threads 0] [--output bvh.json]" },
+        { "raysort", RunRaySortBench,
+          "[--resolutions 1280x720] [--grid 4] [--segments 128] [--scene-cache Data/Models/Pica.fscene.rayscache] [--frames 3]\n"
+          "            [--ao-distance 1] [--max-mismatch-fraction 0.001] [--threads 0] [--output raysort.json]" },
+        { "adaptive", RunAdaptiveBench,
+          "[--resolutions 640x360] [--frames 32] [--warmup 8] [--segments 64] [--uniform 1,2,4] [--targets 0.002,0.005,0.01,0.02]\n"
+          "            [--max-rays 4] [--reference-rays 32] [--threads 0] [--output adaptive.json]" },
+        { "lights", RunLightBench,
+          "[--resolutions 640x360] [--light-counts 1,10,100,1000] [--frames 8] [--warmup 2] [--segments 64] [--samples 1000000]\n"
+          "            [--mean-passes 64] [--mean-tolerance 0.02] [--threads 0] [--output lights.json]" },
+        { "restir", RunRestirBench,
+          "[--resolutions 320x180] [--light-counts 100] [--modes alias,ris,temporal,spatiotemporal] [--frames 16] [--warmup 4]\n"
+          "            [--segments 64] [--candidates 8] [--spatial-samples 4] [--mean-passes 32] [--mean-tolerance 0.02] [--threads 0]\n"
+          "            [--output restir.json]" },
+        { "probes", RunProbeBench,
+          "[--resolutions 320x180] [--probe-counts 4x2x4,8x4x8,16x8x16] [--rays-per-probe 64] [--ray-budget 4096] [--cycles 4]\n"
+          "            [--segments 64] [--lights 1] [--reference-rays 64] [--multi-bounce 0] [--threads 0] [--output probes.json]" },
+        { "capture", RunCaptureBench,
+          "[--sequence dir|capture.rcap] [--frames 30] [--resolutions 1280x720] [--compression none,shuffle-rle] [--queue 4]\n"
+          "            [--path capture_bench.rcap] [--keep 0] [--threads 0] [--output capture.json]" },
+        { "profile", RunProfileBench,
+          "[--sequence dir|capture.rcap] [--resolutions 320x180] [--frames 30] [--history 16] [--iterations 4] [--scopes 200000]\n"
+          "            [--max-scope-ns 2000] [--trace trace.json] [--csv frames.csv] [--stats stats.csv] [--threads 0] [--output profile.json]" },
+        { "gradient", RunGradientBench,
+          "[--resolutions 320x180] [--frames 32] [--warmup 8] [--segments 64] [--light-speed 5] [--reference-rays 32]\n"
+          "            [--min-coverage 0.9] [--threads 0] [--output gradient.json]" },
+        { "roughness", RunRoughnessBench,
+          "[--resolutions 320x180] [--roughness scene,0.05,0.2,0.35,0.5,0.8] [--frames 16] [--reference-frames 128] [--segments 64]\n"
+          "            [--scene-cache Data/Models/Pica.fscene.rayscache] [--probe-cycles 4] [--threads 0] [--output roughness.json]" },
+        { "bounces", RunBounceBench,
+          "[--resolutions 640x360] [--bounces 1,2,3,4] [--frames 4] [--segments 64] [--scene-cache Data/Models/Pica.fscene.rayscache]\n"
+          "            [--tolerance 0.0001] [--max-mismatch-fraction 0.001] [--threads 0] [--output bounces.json]" },
+        { "pathtrace", RunPathTraceBench,
+          "[--resolutions 320x180] [--samples 256] [--bounces 4] [--thread-counts 1,2,4,8,16,32,64] [--scaling-samples 4] [--segments 64]\n"
+          "            [--scene-cache Data/Models/Pica.fscene.rayscache] [--reference reference.exr] [--threads 0] [--output pathtrace.json]" },
+        { "sweep", RunSweepBench,
+          "[--sequence capture.rcap --scene-cache Data/Models/Pica.fscene.rayscache] [--resolution 320x180] [--frames 16] [--warmup 4]\n"
+          "            [--effects shadows,reflection,ao] [--rays 1,2,4] [--phi-color 4,10,32] [--phi-normal 128] [--alpha 0.05,0.15]\n"
+          "            [--atrous-iterations 3,4,5] [--feedback-tap 1] [--reference-rays 32] [--segments 64] [--csv sweep.csv]\n"
+          "            [--threads 0] [--output sweep.json]" },
+    };
+
+    void PrintUsage()
+    {
+        printf("Usage: RaysBench <command> [options]\n\nCommands:\n");
+        for (const Command& command : kCommands) printf("  %s %s\n", command.name, command.usage);
+        printf("\nEvery command also takes [--profile-trace trace.json] [--profile-csv frames.csv] [--profile-stats stats.csv]\n"
+            "[--profile-frames 100000], the FRAME_PROFILE scopes of its run as a Chrome trace and CSV.\n");
+    }
+
+    // Runs the command with a profiler active when any of the --profile outputs is asked for
+    int RunProfiled(const Command& command, const CommandLine& args)
+    {
+        const std::string tracePath = args.GetString("profile-trace", "");
+        const std::string framesPath = args.GetString("profile-csv", "");
+        const std::string statsPath = args.GetString("profile-stats", "");
+        if (tracePath.empty() && framesPath.empty() && statsPath.empty()) return command.run(args);
+
+        Cpu::FrameProfiler profiler(args.GetUint("profile-frames", 100000));
+        Cpu::FrameProfiler::SetActive(&profiler);
+        profiler.BeginFrame(0);
+        const int result = command.run(args);
+        profiler.EndFrame();
+        Cpu::FrameProfiler::SetActive(nullptr);
+
+        for (const auto& output : { std::make_pair(tracePath, &Cpu::FrameProfiler::WriteChromeTrace),
+            std::make_pair(framesPath, &Cpu::FrameProfiler::WriteFramesCsv), std::make_pair(statsPath, &Cpu::FrameProfiler::WriteStatsCsv) })
+        {
+            if (!output.first.empty() && !(profiler.*output.second)(output.first))
+            {
+                fprintf(stderr, "Failed to write '%s'\n", output.first.c_str());
+                return 1;
+            }
+        }
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    for (const Command& command : kCommands)
+    {
+        if (strcmp(argv[1], command.name) == 0) return RunProfiled(command, CommandLine(argc, argv, 2));
+    }
+
+    fprintf(stderr, "Unknown command '%s'\n\n", argv[1]);
+    PrintUsage();
+    return 1;
+}
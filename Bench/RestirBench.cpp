@@ -0,0 +1,319 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "Benchmarks.h"
+#include "../Cpu/Bvh.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/LightResampling.h"
+#include "../Cpu/LightSampling.h"
+#include "../Cpu/RaytracedEffects.h"
+#include "../Cpu/SVGF.h"
+#include "../Cpu/SVGFSharedHistory.h"
+
+using namespace Cpu;
+
+namespace
+{
+    // Seeds of the passes that check the estimator, apart from the frame seeds
+    const uint32_t kMeanSeedOffset = 1u << 20;
+
+    enum class ResamplingMode
+    {
+        Alias,              // One light from the alias table, what "Light Sampling" does without resampling
+        Ris,                // Candidates only, unbiased
+        Temporal,
+        Spatiotemporal
+    };
+
+    bool ParseMode(const std::string& name, ResamplingMode& mode)
+    {
+        if (name == "alias") mode = ResamplingMode::Alias;
+        else if (name == "ris") mode = ResamplingMode::Ris;
+        else if (name == "temporal") mode = ResamplingMode::Temporal;
+        else if (name == "spatiotemporal") mode = ResamplingMode::Spatiotemporal;
+        else return false;
+        return true;
+    }
+
+    // Sum of squared rgb differences over the pixels with geometry
+    struct ErrorAccumulator
+    {
+        double sumSquared = 0.0;
+        double count = 0.0;
+
+        void Add(const Image4F& a, const Image4F& b, const Image4F& worldPosition)
+        {
+            for (size_t i = 0; i < a.GetPixelCount(); ++i)
+            {
+                if (worldPosition.GetData()[i].w == 0.0f) continue;
+                const float3 d = a.GetData()[i].rgb() - b.GetData()[i].rgb();
+                sumSquared += double(d.x) * d.x + double(d.y) * d.y + double(d.z) * d.z;
+                count += 3.0;
+            }
+        }
+
+        double GetRmse() const { return count > 0.0 ? std::sqrt(sumSquared / count) : 0.0; }
+    };
+
+    double GetMeanLuminance(const Image4F& image, const Image4F& worldPosition)
+    {
+        double sum = 0.0;
+        double count = 0.0;
+        for (size_t i = 0; i < image.GetPixelCount(); ++i)
+        {
+            if (worldPosition.GetData()[i].w == 0.0f) continue;
+            sum += luminance(image.GetData()[i].rgb());
+            count += 1.0;
+        }
+        return count > 0.0 ? sum / count : 0.0;
+    }
+
+    bool AreReservoirsValid(const Image<LightReservoir>& reservoirs, uint32_t lightCount)
+    {
+        for (size_t i = 0; i < reservoirs.GetPixelCount(); ++i)
+        {
+            const LightReservoir& r = reservoirs.GetData()[i];
+            if (r.light >= lightCount || !std::isfinite(r.weight) || r.weight < 0.0f || !std::isfinite(r.m) || r.m < 0.0f) return false;
+        }
+        return true;
+    }
+
+    void MakeGBuffer(const SyntheticScene& syntheticScene, const FrameData& frame, uint32_t frameIndex, RtGBuffer& gBuffer)
+    {
+        gBuffer.worldPosition = &frame.Get(FrameTarget::WorldPosition);
+        gBuffer.normalRoughness = &frame.Get(FrameTarget::NormalRoughness);
+        gBuffer.albedo = &frame.Get(FrameTarget::Albedo);
+        gBuffer.cameraPosition = syntheticScene.GetCameraPosition(frameIndex);
+    }
+}
+
+int RunRestirBench(const CommandLine& args)
+{
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolutions", "320x180");
+    const std::vector<uint32_t> lightCounts = args.GetUintList("light-counts", "100");
+    const std::vector<std::string> modeNames = args.GetStringList("modes", "alias,ris,temporal,spatiotemporal");
+    const uint32_t frameCount = std::max(1u, args.GetUint("frames", 16));
+    const uint32_t warmupCount = args.GetUint("warmup", 4);
+    const uint32_t sphereSegments = args.GetUint("segments", 64);
+    const uint32_t candidateCount = std::max(1u, args.GetUint("candidates", 8));
+    const uint32_t spatialSamples = args.GetUint("spatial-samples", 4);
+    const uint32_t meanPasses = std::max(1u, args.GetUint("mean-passes", 32));
+    const float meanTolerance = args.GetFloat("mean-tolerance", 0.02f);
+    const std::string outputPath = args.GetString("output", "");
+
+    std::vector<ResamplingMode> modes;
+    for (const std::string& name : modeNames)
+    {
+        ResamplingMode mode;
+        if (!ParseMode(name, mode))
+        {
+            fprintf(stderr, "Unknown mode '%s'\n", name.c_str());
+            return 1;
+        }
+        modes.push_back(mode);
+    }
+
+    ThreadPool threadPool(args.GetUint("threads", 0));
+
+    uint32_t failedChecks = 0;
+    auto check = [&](bool condition, const std::string& name, const char* message)
+    {
+        if (condition) return;
+        fprintf(stderr, "restir: %s: %s\n", name.c_str(), message);
+        failedChecks++;
+    };
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "restir");
+    json.Field("threads", threadPool.GetThreadCount());
+    json.Field("frames", frameCount);
+    json.Field("warmup", warmupCount);
+    json.Field("candidates", candidateCount);
+    json.Field("spatialSamples", spatialSamples);
+    json.Key("runs").BeginArray();
+
+    SyntheticScene syntheticScene;
+    FrameData frame;
+    for (uint32_t lightCount : lightCounts)
+    {
+        if (lightCount == 0)
+        {
+            fprintf(stderr, "Light counts have to be at least 1\n");
+            return 1;
+        }
+
+        TriangleScene scene;
+        syntheticScene.BuildTriangleScene(sphereSegments, scene);
+        syntheticScene.AddPointLights(lightCount, scene);
+        Bvh bvh;
+        bvh.Build(scene, BvhBuildSettings(), &threadPool);
+        LightSampler sampler;
+        sampler.Build(scene);
+
+        for (const Resolution& resolution : resolutions)
+        {
+            const std::string resolutionName = std::to_string(resolution.width) + "x" + std::to_string(resolution.height);
+            const std::string runName = resolutionName + " " + std::to_string(lightCount) + " lights";
+            fprintf(stderr, "restir %s\n", runName.c_str());
+            RaytracedEffects effects(scene, bvh, threadPool);
+
+            // Shadowed light of every light, the same for every mode
+            std::vector<Image4F> references(frameCount);
+            for (uint32_t frameIndex = 0; frameIndex < frameCount; ++frameIndex)
+            {
+                syntheticScene.RenderFrame(frameIndex, resolution.width, resolution.height, frame, threadPool);
+                RtGBuffer gBuffer;
+                MakeGBuffer(syntheticScene, frame, frameIndex, gBuffer);
+                effects.TraceDirectLight(gBuffer, RayScale::Full, frameIndex, references[frameIndex]);
+            }
+
+            json.BeginObject();
+            json.Field("resolution", resolutionName);
+            json.Field("lights", lightCount);
+            json.Key("modes").BeginArray();
+
+            double aliasRmse = -1.0, spatiotemporalRmse = -1.0;
+            for (size_t m = 0; m < modes.size(); ++m)
+            {
+                const ResamplingMode mode = modes[m];
+                const std::string modeName = runName + " " + modeNames[m];
+                const bool checksMean = mode == ResamplingMode::Alias || mode == ResamplingMode::Ris;
+
+                LightResampler resampler(&threadPool);
+                LightResamplingSettings& settings = resampler.GetSettings();
+                settings.candidateCount = candidateCount;
+                settings.temporalReuse = mode == ResamplingMode::Temporal || mode == ResamplingMode::Spatiotemporal;
+                settings.spatialReuse = mode == ResamplingMode::Spatiotemporal;
+                settings.spatialSamples = spatialSamples;
+
+                SVGFSharedHistory history(resolution.width, resolution.height, &threadPool);
+                SVGFPass filter(resolution.width, resolution.height, history, SVGFSignalType::Color, &threadPool);
+
+                Image4F shadows;
+                Image4F meanPass;
+                Image4F mean;
+                ErrorAccumulator noisyError;
+                ErrorAccumulator denoisedError;
+                std::vector<double> frameRmse;
+                double resampleMs = 0.0, traceMs = 0.0;
+                double referenceMean = 0.0, estimatorMean = 0.0;
+                double shadowLuminance = 0.0, referenceLuminance = 0.0;
+                float temporalFraction = 0.0f;
+                bool reservoirsValid = true;
+
+                effects.SetLightSampler(&sampler);
+                for (uint32_t frameIndex = 0; frameIndex < frameCount; ++frameIndex)
+                {
+                    syntheticScene.RenderFrame(frameIndex, resolution.width, resolution.height, frame, threadPool);
+                    const Image4F& motionVec = frame.Get(FrameTarget::MotionVector);
+                    const Image4F& linearZ = frame.Get(FrameTarget::SVGF_LinearZ);
+                    const Image4F& normalDepth = frame.Get(FrameTarget::SVGF_CompactNormDepth);
+                    RtGBuffer gBuffer;
+                    MakeGBuffer(syntheticScene, frame, frameIndex, gBuffer);
+                    const bool measured = frameIndex >= warmupCount;
+
+                    // Candidates alone have to average to the sum over all lights, like sampling one light does. Run
+                    // on a separate resampler, reuse would carry the passes over into each other.
+                    if (frameIndex == 0 && checksMean)
+                    {
+                        LightResampler meanResampler(&threadPool);
+                        meanResampler.GetSettings() = settings;
+                        mean.Resize(resolution.width, resolution.height);
+                        for (uint32_t pass = 0; pass < meanPasses; ++pass)
+                        {
+                            if (mode == ResamplingMode::Ris)
+                            {
+                                meanResampler.Execute(scene, sampler, gBuffer, motionVec, linearZ, kMeanSeedOffset + pass);
+                                effects.SetLightReservoirs(&meanResampler.GetReservoirs());
+                            }
+                            effects.TraceShadows(gBuffer, RayScale::Full, kMeanSeedOffset + pass, meanPass);
+                            for (size_t i = 0; i < mean.GetPixelCount(); ++i) mean.GetData()[i] += meanPass.GetData()[i] / float(meanPasses);
+                        }
+                        effects.SetLightReservoirs(nullptr);
+                        referenceMean = GetMeanLuminance(references[0], *gBuffer.worldPosition);
+                        estimatorMean = GetMeanLuminance(mean, *gBuffer.worldPosition);
+                        check(std::fabs(estimatorMean - referenceMean) <= meanTolerance * std::max(referenceMean, 1e-6), modeName,
+                            "the estimator does not average to the sum over all lights");
+                    }
+
+                    if (mode != ResamplingMode::Alias)
+                    {
+                        resampler.Execute(scene, sampler, gBuffer, motionVec, linearZ, frameIndex);
+                        reservoirsValid = reservoirsValid && AreReservoirsValid(resampler.GetReservoirs(), lightCount);
+                        effects.SetLightReservoirs(&resampler.GetReservoirs());
+                        if (measured) resampleMs += resampler.GetStats().elapsedMs;
+                        if (measured) temporalFraction += resampler.GetStats().temporalFraction;
+                    }
+                    effects.TraceShadows(gBuffer, RayScale::Full, frameIndex, shadows);
+                    effects.SetLightReservoirs(nullptr);
+                    if (measured) traceMs += effects.GetLastStats().elapsedMs;
+
+                    ErrorAccumulator error;
+                    error.Add(shadows, references[frameIndex], *gBuffer.worldPosition);
+                    frameRmse.push_back(error.GetRmse());
+
+                    history.Update(motionVec, linearZ);
+                    const Image4F& denoised = filter.Execute(shadows, motionVec, linearZ, normalDepth);
+                    history.EndFrame(linearZ);
+                    if (measured) noisyError.Add(shadows, references[frameIndex], *gBuffer.worldPosition);
+                    if (measured) shadowLuminance += GetMeanLuminance(shadows, *gBuffer.worldPosition);
+                    if (measured) referenceLuminance += GetMeanLuminance(references[frameIndex], *gBuffer.worldPosition);
+                    if (measured) denoisedError.Add(denoised, references[frameIndex], *gBuffer.worldPosition);
+                }
+                check(reservoirsValid, modeName, "a reservoir holds an invalid light or weight");
+
+                if (mode == ResamplingMode::Alias) aliasRmse = noisyError.GetRmse();
+                if (mode == ResamplingMode::Spatiotemporal) spatiotemporalRmse = noisyError.GetRmse();
+
+                const uint32_t measuredFrames = std::max(1u, frameCount - std::min(frameCount, warmupCount));
+                json.BeginObject();
+                json.Field("mode", modeNames[m]);
+                json.Field("resampleMs", float(resampleMs / measuredFrames));
+                json.Field("traceMs", float(traceMs / measuredFrames));
+                json.Field("temporalFraction", temporalFraction / float(measuredFrames));
+                json.Field("reservoirBytes", uint64_t(resolution.width) * resolution.height * sizeof(LightReservoir));
+                json.Field("noisyRmse", float(noisyError.GetRmse()));
+                json.Field("denoisedRmse", float(denoisedError.GetRmse()));
+                // Below 1 where reuse darkens, reservoirs merged across a shadow edge are not traced at the pixel
+                json.Field("brightness", float(referenceLuminance > 0.0 ? shadowLuminance / referenceLuminance : 0.0));
+                if (checksMean)
+                {
+                    json.Field("referenceMean", float(referenceMean));
+                    json.Field("estimatorMean", float(estimatorMean));
+                }
+                json.Key("noisyRmsePerFrame").BeginArray();
+                for (double rmse : frameRmse) json.Value(float(rmse));
+                json.EndArray();
+                json.EndObject();
+            }
+            json.EndArray();
+
+            // Reuse has to pay off against one light per pixel from the table. A single light leaves only the noise of
+            // the shadow rays, which reuse does not touch.
+            if (aliasRmse >= 0.0 && spatiotemporalRmse >= 0.0)
+            {
+                json.Field("rmseReduction", float(spatiotemporalRmse > 0.0 ? aliasRmse / spatiotemporalRmse : 0.0));
+                if (lightCount > 1) check(spatiotemporalRmse < aliasRmse, runName, "spatiotemporal resampling is noisier than sampling the alias table");
+            }
+            json.EndObject();
+        }
+    }
+
+    json.EndArray();
+    json.Field("failedChecks", failedChecks);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedChecks > 0 ? 2 : 0;
+}
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "Benchmarks.h"
+#include "../Cpu/Bvh.h"
+#include "../Cpu/IrradianceProbes.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/RaytracedEffects.h"
+#include "../Cpu/ReflectionClassification.h"
+#include "../Cpu/SceneCache.h"
+
+using namespace Cpu;
+
+namespace
+{
+    // Frame indices of the reference start here, so its seeds differ from the measured frames'
+    const uint32_t kReferenceFirstFrame = 1 << 20;
+
+    // Running mean of the reflection term over the measured frames
+    struct Accumulator
+    {
+        Image4F sum;
+        uint32_t frames = 0;
+
+        void Add(const Image4F& image)
+        {
+            if (sum.GetPixelCount() != image.GetPixelCount()) sum.Resize(image.GetWidth(), image.GetHeight());
+            for (size_t i = 0; i < image.GetPixelCount(); ++i) sum.GetData()[i] += image.GetData()[i];
+            frames++;
+        }
+
+        float3 GetMean(size_t i) const { return sum.GetData()[i].rgb() / float(std::max(1u, frames)); }
+    };
+
+    // Over the rgb of the pixels with geometry
+    double GetRmse(const Accumulator& accumulated, const Image4F& reference, const Image4F& worldPosition)
+    {
+        double sumSquared = 0.0;
+        double count = 0.0;
+        for (size_t i = 0; i < reference.GetPixelCount(); ++i)
+        {
+            if (worldPosition.GetData()[i].w == 0.0f) continue;
+            const float3 d = accumulated.GetMean(i) - reference.GetData()[i].rgb();
+            sumSquared += double(d.x) * d.x + double(d.y) * d.y + double(d.z) * d.z;
+            count += 3.0;
+        }
+        return count > 0.0 ? std::sqrt(sumSquared / count) : 0.0;
+    }
+
+    // The traced reflection with the rough pixels shaded from prefiltered radiance, what Deferred.slang adds
+    template<typename GetRadiance>
+    void Composite(const Image4F& traced, const ReflectionClassifier& classifier, const RtGBuffer& gBuffer, const GetRadiance& getRadiance, Image4F& output)
+    {
+        output = traced;
+        const Image<uint8_t>& classes = classifier.GetClasses();
+        for (uint32_t y = 0; y < output.GetHeight(); ++y)
+        {
+            for (uint32_t x = 0; x < output.GetWidth(); ++x)
+            {
+                const int2 pixel = int2(int(x), int(y));
+                if (gBuffer.worldPosition->At(pixel).w == 0.0f || ReflectionClass(classes.At(pixel)) != ReflectionClass::Rough) continue;
+                const ShadingData sd = LoadShadingData(gBuffer, pixel);
+                output.At(pixel) = float4(GetPrefilteredReflection(sd, getRadiance(sd)), 1.0f);
+            }
+        }
+    }
+
+    // Overrides the linear roughness of every material, negative restores the scene's own
+    void SetRoughness(TriangleScene& scene, const std::vector<SceneMaterial>& materials, float linearRoughness)
+    {
+        for (uint32_t i = 0; i < scene.GetMaterialCount(); ++i)
+        {
+            SceneMaterial material = materials[i];
+            if (linearRoughness >= 0.0f) material.linearRoughness = linearRoughness;
+            scene.SetMaterial(i, material);
+        }
+    }
+}
+
+int RunRoughnessBench(const CommandLine& args)
+{
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolutions", "320x180");
+    const std::vector<std::string> roughnessNames = args.GetStringList("roughness", "scene,0.05,0.2,0.35,0.5,0.8");
+    const uint32_t sphereSegments = args.GetUint("segments", 64);
+    const std::string sceneCachePath = args.GetString("scene-cache", "");
+    const uint32_t frameCount = std::max(1u, args.GetUint("frames", 16));
+    const uint32_t referenceFrames = std::max(1u, args.GetUint("reference-frames", 128));
+    const uint32_t probeCycles = std::max(1u, args.GetUint("probe-cycles", 4));
+    const std::string outputPath = args.GetString("output", "");
+
+    ThreadPool threadPool(args.GetUint("threads", 0));
+
+    uint32_t failedChecks = 0;
+    auto check = [&](bool condition, const std::string& name, const char* message)
+    {
+        if (condition) return;
+        fprintf(stderr, "roughness: %s: %s\n", name.c_str(), message);
+        failedChecks++;
+    };
+
+    // The synthetic stand-in for Pica, or e.g. the cache RaysRenderer writes next to Pica.fscene
+    std::string sceneName = "synthetic";
+    SyntheticScene syntheticScene;
+    TriangleScene scene;
+    SceneCache sceneCache;
+    if (sceneCachePath.empty())
+    {
+        syntheticScene.BuildTriangleScene(sphereSegments, scene);
+    }
+    else
+    {
+        sceneName = sceneCachePath;
+        const SceneCache::Status status = sceneCache.OpenAnySource(sceneCachePath);
+        if (status != SceneCache::Status::Ok)
+        {
+            fprintf(stderr, "Failed to open '%s': %s\n", sceneCachePath.c_str(), GetSceneCacheStatusName(status));
+            return 1;
+        }
+        BuildTriangleScene(sceneCache.GetView(), scene, &threadPool);
+    }
+    if (scene.GetTriangleCount() == 0)
+    {
+        fprintf(stderr, "roughness: %s has no triangles\n", sceneName.c_str());
+        return 1;
+    }
+
+    std::vector<SceneMaterial> materials;
+    for (uint32_t i = 0; i < scene.GetMaterialCount(); ++i) materials.push_back(scene.GetMaterial(i));
+
+    Bvh bvh;
+    bvh.Build(scene, BvhBuildSettings(), &threadPool);
+    float3 boundsMin, boundsMax;
+    bvh.GetBounds(boundsMin, boundsMax);
+    RaytracedEffects effects(scene, bvh, threadPool);
+    ReflectionClassifier classifier(&threadPool);
+    const ReflectionClassificationSettings& settings = classifier.GetSettings();
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "roughness");
+    json.Field("scene", sceneName);
+    json.Field("triangles", scene.GetTriangleCount());
+    json.Field("threads", threadPool.GetThreadCount());
+    json.Field("frames", frameCount);
+    json.Field("referenceFrames", referenceFrames);
+    json.Field("glossyRoughness", settings.glossyRoughness);
+    json.Field("roughRoughness", settings.roughRoughness);
+    json.Key("runs").BeginArray();
+
+    FrameData frame;
+    GBuffer gBuffer;
+    for (const Resolution& resolution : resolutions)
+    {
+        const std::string resolutionName = std::to_string(resolution.width) + "x" + std::to_string(resolution.height);
+
+        for (const std::string& roughnessName : roughnessNames)
+        {
+            const float roughness = roughnessName == "scene" ? -1.0f : float(std::atof(roughnessName.c_str()));
+            const std::string name = resolutionName + " " + roughnessName;
+            fprintf(stderr, "roughness %s\n", name.c_str());
+
+            // The synthetic scene from the camera of the denoiser benchmarks, a cache from above its bounds
+            SetRoughness(scene, materials, roughness);
+            RtGBuffer view;
+            if (sceneCachePath.empty())
+            {
+                syntheticScene.RenderFrame(0, resolution.width, resolution.height, frame, threadPool);
+                Image4F& normalRoughness = frame.Get(FrameTarget::NormalRoughness);
+                for (size_t i = 0; i < normalRoughness.GetPixelCount() && roughness >= 0.0f; ++i) normalRoughness.GetData()[i].w = roughness;
+                view.worldPosition = &frame.Get(FrameTarget::WorldPosition);
+                view.normalRoughness = &normalRoughness;
+                view.albedo = &frame.Get(FrameTarget::Albedo);
+                view.cameraPosition = syntheticScene.GetCameraPosition(0);
+            }
+            else
+            {
+                RenderGBuffer(scene, bvh, resolution.width, resolution.height, threadPool, gBuffer);
+                view = gBuffer.view;
+            }
+
+            // The probes the rough pixels fall back to, converged over a few round robin cycles
+            IrradianceProbes probes(&threadPool);
+            FitProbeGrid(boundsMin, boundsMax, probes.GetSettings());
+            const uint32_t probeFrames = probeCycles * ((probes.GetProbeCount() + probes.GetProbesPerFrame() - 1) / probes.GetProbesPerFrame());
+            for (uint32_t frameIndex = 0; frameIndex < probeFrames; ++frameIndex) probes.Update(scene, bvh, frameIndex);
+
+            // Every pixel traced every frame, converged
+            Image4F traced;
+            Accumulator referenceSum;
+            for (uint32_t i = 0; i < referenceFrames; ++i)
+            {
+                effects.TraceReflection(view, RayScale::Full, kReferenceFirstFrame + i, traced);
+                referenceSum.Add(traced);
+            }
+            Image4F reference;
+            reference.Resize(resolution.width, resolution.height);
+            for (size_t i = 0; i < reference.GetPixelCount(); ++i) reference.GetData()[i] = float4(referenceSum.GetMean(i), 1.0f);
+
+            Accumulator full, environment, probed;
+            uint64_t fullRays = 0, classifiedRays = 0;
+            double fullMs = 0.0, classifiedMs = 0.0, classifyMs = 0.0;
+            Image4F classified, composite;
+            for (uint32_t frameIndex = 0; frameIndex < frameCount; ++frameIndex)
+            {
+                effects.TraceReflection(view, RayScale::Full, frameIndex, traced);
+                fullRays += effects.GetLastStats().rays;
+                fullMs += effects.GetLastStats().elapsedMs;
+                full.Add(traced);
+
+                classifier.Classify(view, frameIndex);
+                classifyMs += classifier.GetStats().elapsedMs;
+                effects.SetReflectionClassifier(&classifier);
+                effects.TraceReflection(view, RayScale::Full, frameIndex, classified);
+                effects.SetReflectionClassifier(nullptr);
+                classifiedRays += effects.GetLastStats().rays;
+                classifiedMs += effects.GetLastStats().elapsedMs;
+
+                // Mirror pixels trace the rays of a launch, every glossy pixel gets its quad's
+                uint32_t mirrorMismatches = 0, unwrittenGlossy = 0;
+                const Image<uint8_t>& classes = classifier.GetClasses();
+                for (size_t i = 0; i < classes.GetPixelCount(); ++i)
+                {
+                    const ReflectionClass reflectionClass = ReflectionClass(classes.GetData()[i]);
+                    if (reflectionClass == ReflectionClass::Mirror && std::memcmp(&traced.GetData()[i], &classified.GetData()[i], sizeof(float4)) != 0) mirrorMismatches++;
+                    if (reflectionClass == ReflectionClass::Glossy && classified.GetData()[i].w == 0.0f) unwrittenGlossy++;
+                }
+                check(mirrorMismatches == 0, name, "classification changes the reflection of mirror pixels");
+                check(unwrittenGlossy == 0, name, "glossy pixels are left without a reflection");
+
+                Composite(classified, classifier, view, [](const ShadingData&) { return kReflectionEnvironment; }, composite);
+                environment.Add(composite);
+                Composite(classified, classifier, view, [&](const ShadingData& sd) { return probes.Sample(sd.posW, GetMirrorDirection(sd)); }, composite);
+                probed.Add(composite);
+            }
+
+            const ReflectionClassificationStats& stats = classifier.GetStats();
+            const double pixels = double(std::max(1u, stats.mirrorPixels + stats.glossyPixels + stats.roughPixels));
+            check(classifiedRays <= fullRays, name, "classification traces more rays than every pixel");
+            if (stats.glossyPixels + stats.roughPixels == 0) check(classifiedRays == fullRays, name, "an all mirror frame traces fewer rays");
+
+            const double fullRmse = GetRmse(full, reference, *view.worldPosition);
+            json.BeginObject();
+            json.Field("resolution", resolutionName);
+            json.Field("roughness", roughnessName);
+            json.Field("mirrorFraction", float(stats.mirrorPixels / pixels));
+            json.Field("glossyFraction", float(stats.glossyPixels / pixels));
+            json.Field("roughFraction", float(stats.roughPixels / pixels));
+            json.Key("full").BeginObject();
+            json.Field("raysPerFrame", fullRays / frameCount);
+            json.Field("traceMs", float(fullMs / frameCount));
+            json.Field("rmse", float(fullRmse));
+            json.EndObject();
+            json.Key("classified").BeginObject();
+            json.Field("raysPerFrame", classifiedRays / frameCount);
+            json.Field("raysSavedPerFrame", (fullRays - std::min(fullRays, classifiedRays)) / frameCount);
+            json.Field("raysSaved", float(fullRays > 0 ? 1.0 - double(classifiedRays) / double(fullRays) : 0.0));
+            json.Field("classifyMs", float(classifyMs / frameCount));
+            json.Field("traceMs", float(classifiedMs / frameCount));
+            json.Field("rmseEnvironment", float(GetRmse(environment, reference, *view.worldPosition)));
+            json.Field("rmseProbes", float(GetRmse(probed, reference, *view.worldPosition)));
+            json.EndObject();
+            json.EndObject();
+        }
+        SetRoughness(scene, materials, -1.0f);
+    }
+
+    json.EndArray();
+    json.Field("failedChecks", failedChecks);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedChecks > 0 ? 2 : 0;
+}
@@ -0,0 +1,270 @@
+#include <cmath>
+#include <cstdio>
+#include "Benchmarks.h"
+#include "../Cpu/Bvh.h"
+#include "../Cpu/FrameProfiler.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/RaytracedEffects.h"
+#include "../Cpu/Sampling.h"
+
+using namespace Cpu;
+
+namespace
+{
+    const float kAODistance = 3.0f;     // Same as the synthetic scene's analytic AO
+
+    struct RayScaleInfo
+    {
+        const char* name;
+        RayScale scale;
+    };
+
+    const RayScaleInfo kRayScales[] =
+    {
+        { "full", RayScale::Full },
+        { "half", RayScale::Half },
+        { "checkerboard", RayScale::Checkerboard },
+        { "quarter", RayScale::Quarter },
+    };
+
+    enum class Effect : uint32_t
+    {
+        Shadows = 0,
+        Reflection,
+        AO,
+        Count
+    };
+
+    const uint32_t kEffectCount = uint32_t(Effect::Count);
+    const char* const kEffectNames[kEffectCount] = { "shadows", "reflection", "ao" };
+
+    // Reference closest hit over every triangle, the same Moller-Trumbore as the BVH leaves
+    bool IntersectBruteForce(const TriangleScene& scene, const Ray& ray, RayHit& hit)
+    {
+        bool found = false;
+        float tHit = ray.tMax;
+        for (uint32_t i = 0; i < scene.GetTriangleCount(); ++i)
+        {
+            const float3 v0 = scene.GetVertex(i, 0);
+            const float3 e1 = scene.GetVertex(i, 1) - v0;
+            const float3 e2 = scene.GetVertex(i, 2) - v0;
+            const float3 p = cross(ray.direction, e2);
+            const float det = dot(e1, p);
+            if (det == 0.0f) continue;
+
+            const float invDet = 1.0f / det;
+            const float3 s = ray.origin - v0;
+            const float u = dot(s, p) * invDet;
+            const float3 q = cross(s, e1);
+            const float v = dot(ray.direction, q) * invDet;
+            const float t = dot(e2, q) * invDet;
+            if (u < 0.0f || v < 0.0f || u + v > 1.0f || t <= ray.tMin || t >= tHit) continue;
+
+            tHit = t;
+            hit.t = t;
+            hit.triangle = i;
+            hit.u = u;
+            hit.v = v;
+            found = true;
+        }
+        return found;
+    }
+
+    // Random rays from around the spheres, compared against the brute force reference
+    uint32_t ValidateBvh(const TriangleScene& scene, const Bvh& bvh, uint32_t rayCount)
+    {
+        uint32_t randState = RandInit(7, 11, 16);
+        uint32_t mismatches = 0;
+        for (uint32_t i = 0; i < rayCount; ++i)
+        {
+            Ray ray;
+            ray.origin = float3(RandNext(randState) * 6.0f - 3.0f, RandNext(randState) * 2.0f + 0.01f, RandNext(randState) * 6.0f - 3.0f);
+            const float z = RandNext(randState) * 2.0f - 1.0f;
+            const float phi = RandNext(randState) * 2.0f * kPi;
+            const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+            ray.direction = float3(r * std::cos(phi), z, r * std::sin(phi));
+            ray.tMin = 0.001f;
+            ray.tMax = (i & 1) ? 1e5f : 2.0f;
+
+            RayHit expected, actual;
+            const bool expectedHit = IntersectBruteForce(scene, ray, expected);
+            const bool actualHit = bvh.Intersect(ray, actual);
+            const bool occluded = bvh.Occluded(ray);
+
+            bool ok = expectedHit == actualHit && expectedHit == occluded;
+            if (ok && expectedHit) ok = std::fabs(expected.t - actual.t) <= 1e-4f * std::max(1.0f, expected.t);
+            if (!ok) mismatches++;
+        }
+        return mismatches;
+    }
+
+    // Mean over the pixels with geometry, the signal in .x
+    double GetMeanSignal(const Image4F& signal, const Image4F& worldPosition)
+    {
+        double sum = 0.0;
+        uint64_t count = 0;
+        for (uint32_t y = 0; y < signal.GetHeight(); ++y)
+        {
+            for (uint32_t x = 0; x < signal.GetWidth(); ++x)
+            {
+                if (worldPosition.At(x, y).w == 0.0f) continue;
+                sum += signal.At(x, y).x;
+                count++;
+            }
+        }
+        return count > 0 ? sum / double(count) : 0.0;
+    }
+}
+
+int RunRtBench(const CommandLine& args)
+{
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolutions", "1280x720");
+    const std::vector<std::string> scaleNames = args.GetStringList("scales", "full,half,quarter");
+    const uint32_t frameCount = std::max(1u, args.GetUint("frames", 8));
+    const uint32_t sphereSegments = args.GetUint("segments", 64);
+    const uint32_t validationRays = args.GetUint("validation-rays", 20000);
+    const std::string outputPath = args.GetString("output", "");
+
+    ThreadPool threadPool(args.GetUint("threads", 0));
+
+    // Validation fails on any disagreement with the brute force reference beyond this fraction of rays,
+    // which leaves room for hits exactly on a shared edge
+    const float maxMismatchFraction = 1e-4f;
+    // The tessellated scene against the analytic one, full resolution shadows and AO
+    const double maxMeanDifference = 0.02;
+
+    SyntheticScene syntheticScene;
+    TriangleScene scene;
+    syntheticScene.BuildTriangleScene(sphereSegments, scene);
+
+    Bvh bvh;
+    bvh.Build(scene);
+
+    const uint32_t mismatches = ValidateBvh(scene, bvh, validationRays);
+    uint32_t failedRuns = 0;
+    if (float(mismatches) > maxMismatchFraction * float(validationRays))
+    {
+        fprintf(stderr, "rt: %u of %u validation rays disagree with the brute force reference\n", mismatches, validationRays);
+        failedRuns++;
+    }
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "rt");
+    json.Field("threads", threadPool.GetThreadCount());
+    json.Field("frames", frameCount);
+    json.Key("scene").BeginObject();
+    json.Field("triangles", scene.GetTriangleCount());
+    json.Field("sceneBytes", uint64_t(scene.GetSizeInBytes()));
+    json.Field("bvhNodes", bvh.GetNodeCount());
+    json.Field("bvhLeafBlocks", bvh.GetLeafBlockCount());
+    json.Field("bvhDepth", bvh.GetDepth());
+    json.Field("bvhBytes", uint64_t(bvh.GetSizeInBytes()));
+    json.Field("buildMs", bvh.GetBuildMs());
+    json.EndObject();
+    json.Key("validation").BeginObject();
+    json.Field("rays", validationRays);
+    json.Field("mismatches", mismatches);
+    json.EndObject();
+    json.Key("runs").BeginArray();
+
+    RaytracedEffects effects(scene, bvh, threadPool);
+    FrameData frame;
+    Image4F outputs[kEffectCount];
+
+    for (const Resolution& resolution : resolutions)
+    {
+        for (const std::string& scaleName : scaleNames)
+        {
+            const RayScaleInfo* scaleInfo = nullptr;
+            for (const RayScaleInfo& info : kRayScales)
+            {
+                if (scaleName == info.name) scaleInfo = &info;
+            }
+            if (!scaleInfo)
+            {
+                fprintf(stderr, "Unknown ray scale '%s'\n", scaleName.c_str());
+                return 1;
+            }
+
+            RtTraceStats totals[kEffectCount];
+            double meanDifference[kEffectCount] = {};
+
+            for (uint32_t frameIndex = 0; frameIndex < frameCount; ++frameIndex)
+            {
+                FrameProfiler::MarkFrame();
+                syntheticScene.RenderFrame(frameIndex, resolution.width, resolution.height, frame, threadPool);
+
+                RtGBuffer gBuffer;
+                gBuffer.worldPosition = &frame.Get(FrameTarget::WorldPosition);
+                gBuffer.normalRoughness = &frame.Get(FrameTarget::NormalRoughness);
+                gBuffer.albedo = &frame.Get(FrameTarget::Albedo);
+                gBuffer.cameraPosition = syntheticScene.GetCameraPosition(frameIndex);
+
+                for (uint32_t e = 0; e < kEffectCount; ++e)
+                {
+                    switch (Effect(e))
+                    {
+                    case Effect::Shadows: effects.TraceShadows(gBuffer, scaleInfo->scale, frameIndex, outputs[e]); break;
+                    case Effect::Reflection: effects.TraceReflection(gBuffer, scaleInfo->scale, frameIndex, outputs[e]); break;
+                    default: effects.TraceAO(gBuffer, scaleInfo->scale, frameIndex, kAODistance, outputs[e]); break;
+                    }
+                    totals[e].rays += effects.GetLastStats().rays;
+                    totals[e].elapsedMs += effects.GetLastStats().elapsedMs;
+                }
+
+                if (scaleInfo->scale == RayScale::Full && frameIndex == 0)
+                {
+                    meanDifference[uint32_t(Effect::Shadows)] = GetMeanSignal(outputs[uint32_t(Effect::Shadows)], *gBuffer.worldPosition) -
+                        GetMeanSignal(frame.Get(FrameTarget::Shadow), *gBuffer.worldPosition);
+                    meanDifference[uint32_t(Effect::AO)] = GetMeanSignal(outputs[uint32_t(Effect::AO)], *gBuffer.worldPosition) -
+                        GetMeanSignal(frame.Get(FrameTarget::AO), *gBuffer.worldPosition);
+                }
+            }
+
+            bool ok = true;
+            if (scaleInfo->scale == RayScale::Full)
+            {
+                ok = std::fabs(meanDifference[uint32_t(Effect::Shadows)]) <= maxMeanDifference && std::fabs(meanDifference[uint32_t(Effect::AO)]) <= maxMeanDifference;
+                if (!ok)
+                {
+                    fprintf(stderr, "rt %ux%u: mean shadow/AO differ from the analytic scene by %.4f/%.4f\n", resolution.width, resolution.height,
+                        meanDifference[uint32_t(Effect::Shadows)], meanDifference[uint32_t(Effect::AO)]);
+                    failedRuns++;
+                }
+            }
+
+            json.BeginObject();
+            json.Field("resolution", std::to_string(resolution.width) + "x" + std::to_string(resolution.height));
+            json.Field("rayScale", scaleInfo->name);
+            json.Field("ok", ok);
+            for (uint32_t e = 0; e < kEffectCount; ++e)
+            {
+                json.Key(kEffectNames[e]).BeginObject();
+                json.Field("raysPerFrame", totals[e].rays / frameCount);
+                json.Field("msPerFrame", float(totals[e].elapsedMs / frameCount));
+                json.Field("mraysPerSecond", float(totals[e].GetRaysPerSecond() / 1e6));
+                if (scaleInfo->scale == RayScale::Full && Effect(e) != Effect::Reflection) json.Field("meanDifferenceVsAnalytic", float(meanDifference[e]));
+                json.EndObject();
+            }
+            json.EndObject();
+        }
+    }
+
+    json.EndArray();
+    json.Field("failedRuns", failedRuns);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedRuns > 0 ? 2 : 0;
+}
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cstdio>
+#include "Benchmarks.h"
+#include "ObjScene.h"
+#include "../Cpu/Bvh.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/SceneCache.h"
+#include "../Cpu/Timer.h"
+
+using namespace Cpu;
+
+int RunSceneCacheBench(const CommandLine& args)
+{
+    const uint32_t sphereSegments = args.GetUint("segments", 256);
+    const uint32_t grid = std::max(1u, args.GetUint("grid", 2));
+    const uint32_t runs = std::max(1u, args.GetUint("runs", 3));
+    const uint32_t validationRays = args.GetUint("validation-rays", 20000);
+    const std::string directory = args.GetString("directory", ".");
+    const bool keepFiles = args.Has("keep");
+    const std::string outputPath = args.GetString("output", "");
+
+    const ObjSceneFiles files = GetObjSceneFiles(directory, "scenecache_bench");
+    const std::string cachePath = directory + "/scenecache_bench.rayscache";
+
+    SceneData generated;
+    BuildGridScene(sphereSegments, grid, generated);
+    if (!WriteObjScene(generated, files))
+    {
+        fprintf(stderr, "Failed to write the source files to '%s'\n", directory.c_str());
+        return 1;
+    }
+    std::remove(cachePath.c_str());
+
+    uint32_t failedChecks = 0;
+
+    // Cold: parse, expand the instances, build the BVH, then write the cache for the next start
+    Timer timer;
+    const uint64_t sourceHash = HashFiles(files.GetPaths());
+    const double coldHashMs = timer.GetElapsedMs();
+
+    timer.Reset();
+    SceneData parsed;
+    if (!ParseObjScene(files, generated.lights, parsed))
+    {
+        fprintf(stderr, "Failed to parse the source files\n");
+        return 1;
+    }
+    const double parseMs = timer.GetElapsedMs();
+
+    timer.Reset();
+    TriangleScene coldScene;
+    BuildTriangleScene(parsed.GetView(), coldScene);
+    const double coldExpandMs = timer.GetElapsedMs();
+
+    Bvh coldBvh;
+    coldBvh.Build(coldScene);
+
+    timer.Reset();
+    if (!WriteSceneCache(cachePath, parsed.GetView(), &coldBvh, sourceHash))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", cachePath.c_str());
+        return 1;
+    }
+    const double writeMs = timer.GetElapsedMs();
+    const double coldTotalMs = coldHashMs + parseMs + coldExpandMs + coldBvh.GetBuildMs();
+
+    // Warm: hash the sources, map the cache, expand the instances and attach the BVH in place. The file is in the OS
+    // cache after being written, so this is a warm start; the best of a few runs is reported.
+    double bestHashMs = 0.0, bestOpenMs = 0.0, bestExpandMs = 0.0, bestAttachMs = 0.0, bestTotalMs = 0.0;
+    SceneCache cache;
+    TriangleScene cachedScene;
+    Bvh cachedBvh;
+    SceneCache::Status status = SceneCache::Status::Missing;
+    for (uint32_t run = 0; run < runs; ++run)
+    {
+        cachedBvh = Bvh();
+        cache.Close();
+
+        Timer stepTimer;
+        const uint64_t hash = HashFiles(files.GetPaths());
+        const double hashMs = stepTimer.GetElapsedMs();
+
+        stepTimer.Reset();
+        status = cache.Open(cachePath, hash);
+        const double openMs = stepTimer.GetElapsedMs();
+        if (status != SceneCache::Status::Ok) break;
+
+        stepTimer.Reset();
+        BuildTriangleScene(cache.GetView(), cachedScene);
+        const double expandMs = stepTimer.GetElapsedMs();
+
+        stepTimer.Reset();
+        const bool attached = cache.AttachBvh(cachedBvh);
+        const double attachMs = stepTimer.GetElapsedMs();
+        if (!attached)
+        {
+            status = SceneCache::Status::Invalid;
+            break;
+        }
+
+        const double totalMs = hashMs + openMs + expandMs + attachMs;
+        if (run == 0 || totalMs < bestTotalMs)
+        {
+            bestHashMs = hashMs;
+            bestOpenMs = openMs;
+            bestExpandMs = expandMs;
+            bestAttachMs = attachMs;
+            bestTotalMs = totalMs;
+        }
+    }
+
+    uint32_t mismatches = 0;
+    if (status != SceneCache::Status::Ok)
+    {
+        fprintf(stderr, "scenecache: the cache just written does not load (%s)\n", GetSceneCacheStatusName(status));
+        failedChecks++;
+    }
+    else
+    {
+        const bool sameCounts = cachedScene.GetTriangleCount() == coldScene.GetTriangleCount() && cachedBvh.GetNodeCount() == coldBvh.GetNodeCount() &&
+            cachedBvh.GetLeafBlockCount() == coldBvh.GetLeafBlockCount() && cachedBvh.GetDepth() == coldBvh.GetDepth();
+        mismatches = CompareSceneHits(coldScene, coldBvh, cachedScene, cachedBvh, grid, validationRays);
+        if (!sameCounts || mismatches > 0)
+        {
+            fprintf(stderr, "scenecache: the cached scene differs from the parsed one (%u of %u rays)\n", mismatches, validationRays);
+            failedChecks++;
+        }
+    }
+
+    // Any change to a source file has to invalidate the cache
+    cachedBvh = Bvh();
+    cache.Close();
+    FILE* instancesFile = fopen(files.instances.c_str(), "ab");
+    if (instancesFile)
+    {
+        fputs("\n", instancesFile);
+        fclose(instancesFile);
+    }
+    const SceneCache::Status editedStatus = cache.Open(cachePath, HashFiles(files.GetPaths()));
+    cache.Close();
+    if (editedStatus != SceneCache::Status::Stale)
+    {
+        fprintf(stderr, "scenecache: editing a source file left the cache %s\n", GetSceneCacheStatusName(editedStatus));
+        failedChecks++;
+    }
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "scenecache");
+    json.Key("scene").BeginObject();
+    json.Field("meshes", uint32_t(parsed.meshes.size()));
+    json.Field("instances", uint32_t(parsed.instances.size()));
+    json.Field("meshTriangles", uint32_t(parsed.indices.size() / 3));
+    json.Field("triangles", coldScene.GetTriangleCount());
+    json.Field("bvhNodes", coldBvh.GetNodeCount());
+    json.Field("sourceBytes", GetFileBytes(files.obj) + GetFileBytes(files.mtl) + GetFileBytes(files.instances));
+    json.Field("cacheBytes", GetFileBytes(cachePath));
+    json.EndObject();
+    json.Key("cold").BeginObject();
+    json.Field("hashMs", float(coldHashMs));
+    json.Field("parseMs", float(parseMs));
+    json.Field("expandMs", float(coldExpandMs));
+    json.Field("bvhBuildMs", coldBvh.GetBuildMs());
+    json.Field("totalMs", float(coldTotalMs));
+    json.Field("cacheWriteMs", float(writeMs));
+    json.EndObject();
+    json.Key("cached").BeginObject();
+    json.Field("runs", runs);
+    json.Field("hashMs", float(bestHashMs));
+    json.Field("mapMs", float(bestOpenMs));
+    json.Field("expandMs", float(bestExpandMs));
+    json.Field("bvhAttachMs", float(bestAttachMs));
+    json.Field("totalMs", float(bestTotalMs));
+    json.EndObject();
+    json.Field("speedup", float(bestTotalMs > 0.0 ? coldTotalMs / bestTotalMs : 0.0));
+    json.Key("validation").BeginObject();
+    json.Field("rays", validationRays);
+    json.Field("mismatches", mismatches);
+    json.Field("statusAfterSourceEdit", GetSceneCacheStatusName(editedStatus));
+    json.EndObject();
+    json.Field("failedChecks", failedChecks);
+    json.EndObject();
+
+    if (!keepFiles)
+    {
+        for (const std::string& path : files.GetPaths()) std::remove(path.c_str());
+        std::remove(cachePath.c_str());
+    }
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedChecks > 0 ? 2 : 0;
+}
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include "Benchmarks.h"
+#include "ObjScene.h"
+#include "../Cpu/AsyncSceneLoader.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/Timer.h"
+
+using namespace Cpu;
+
+namespace
+{
+    const char* const kStageKeys[kSceneLoadStageCount] = { "hashMs", "openMs", "parseMs", "expandMs", "bvhMs", "writeMs" };
+
+    // What the frame loop saw while a load ran in the background
+    struct FrameLoopStats
+    {
+        uint32_t frames = 0;
+        double maxFrameMs = 0.0;
+        uint32_t progressSamples = 0;
+        uint32_t progressRegressions = 0;   // Stage going back, or the fraction going back within a stage
+        uint32_t stagesSeen = 0;            // Bit per SceneLoadStage
+    };
+
+    // Stands in for the render loop: every frame polls the loader, then spins for frameMs. A frame that takes much
+    // longer than frameMs means the loader held the render thread up.
+    std::unique_ptr<LoadedScene> RunFrameLoop(AsyncSceneLoader& loader, double frameMs, FrameLoopStats& stats)
+    {
+        SceneLoadProgress lastProgress;
+        Timer frameTimer;
+        while (true)
+        {
+            frameTimer.Reset();
+            std::unique_ptr<LoadedScene> result = loader.TakeResult();
+            const SceneLoadProgress progress = loader.GetProgress();
+            if (result || !progress.busy) return result;
+
+            if (stats.progressSamples > 0 && (progress.stage < lastProgress.stage ||
+                (progress.stage == lastProgress.stage && progress.stageFraction < lastProgress.stageFraction)))
+            {
+                stats.progressRegressions++;
+            }
+            stats.stagesSeen |= 1u << uint32_t(progress.stage);
+            stats.progressSamples++;
+            lastProgress = progress;
+
+            while (frameTimer.GetElapsedMs() < frameMs) std::this_thread::yield();
+            stats.frames++;
+            stats.maxFrameMs = std::max(stats.maxFrameMs, frameTimer.GetElapsedMs());
+        }
+    }
+
+    void WriteStages(JsonWriter& json, const LoadedScene& scene)
+    {
+        for (uint32_t i = 0; i < kSceneLoadStageCount; ++i) json.Field(kStageKeys[i], float(scene.stageMs[i]));
+        json.Field("totalMs", float(scene.totalMs));
+    }
+
+    void WriteFrameLoop(JsonWriter& json, const FrameLoopStats& stats)
+    {
+        json.Key("frameLoop").BeginObject();
+        json.Field("frames", stats.frames);
+        json.Field("maxFrameMs", float(stats.maxFrameMs));
+        json.Field("progressSamples", stats.progressSamples);
+        json.Field("progressRegressions", stats.progressRegressions);
+        json.Key("stagesSeen").BeginArray();
+        for (uint32_t i = 0; i < kSceneLoadStageCount; ++i)
+        {
+            if (stats.stagesSeen & (1u << i)) json.Value(GetSceneLoadStageName(SceneLoadStage(i)));
+        }
+        json.EndArray();
+        json.EndObject();
+    }
+}
+
+int RunSceneLoadBench(const CommandLine& args)
+{
+    const uint32_t sphereSegments = args.GetUint("segments", 256);
+    const uint32_t grid = std::max(1u, args.GetUint("grid", 2));
+    const float frameMs = args.GetFloat("frame-ms", 8.0f);
+    const float maxStallMs = args.GetFloat("max-stall-ms", 50.0f);
+    const uint32_t validationRays = args.GetUint("validation-rays", 20000);
+    const uint32_t threadCount = args.GetUint("threads", 0);
+    const std::string directory = args.GetString("directory", ".");
+    const bool keepFiles = args.Has("keep");
+    const std::string outputPath = args.GetString("output", "");
+
+    const ObjSceneFiles files = GetObjSceneFiles(directory, "sceneload_bench");
+    const std::string cachePath = directory + "/sceneload_bench.rayscache";
+
+    SceneData generated;
+    BuildGridScene(sphereSegments, grid, generated);
+    if (!WriteObjScene(generated, files))
+    {
+        fprintf(stderr, "Failed to write the source files to '%s'\n", directory.c_str());
+        return 1;
+    }
+    std::remove(cachePath.c_str());
+
+    const std::vector<SceneLight> lights = generated.lights;
+    SceneLoadRequest request;
+    request.sourceFiles = files.GetPaths();
+    request.cachePath = cachePath;
+    request.parse = [&files, &lights](SceneData& data) { return ParseObjScene(files, lights, data); };
+
+    uint32_t failedChecks = 0;
+    auto check = [&](bool condition, const char* message)
+    {
+        if (condition) return;
+        fprintf(stderr, "sceneload: %s\n", message);
+        failedChecks++;
+    };
+
+    // Reference: the same stages one after the other on this thread, without a cache
+    SceneLoadRequest serialRequest = request;
+    serialRequest.cachePath.clear();
+    const std::unique_ptr<LoadedScene> serial = LoadScene(serialRequest);
+    if (!serial || !serial->succeeded)
+    {
+        fprintf(stderr, "Failed to parse the source files\n");
+        return 1;
+    }
+
+    AsyncSceneLoader loader(threadCount);
+    auto matchesSerial = [&](const LoadedScene& scene)
+    {
+        return scene.triangles.GetTriangleCount() == serial->triangles.GetTriangleCount() && scene.bvh.GetNodeCount() == serial->bvh.GetNodeCount() &&
+            CompareSceneHits(serial->triangles, serial->bvh, scene.triangles, scene.bvh, grid, validationRays) == 0;
+    };
+
+    // Cold: parse, expand, build and write the cache while the frame loop keeps going
+    FrameLoopStats coldLoop;
+    loader.Start(request);
+    std::unique_ptr<LoadedScene> cold = RunFrameLoop(loader, frameMs, coldLoop);
+    check(cold && cold->succeeded && !cold->fromCache && cold->cacheWritten, "the cold load did not parse and write the cache");
+    check(cold && cold->succeeded && matchesSerial(*cold), "the cold load differs from the serial one");
+
+    // Warm: the cache just written is mapped and the BVH attached
+    FrameLoopStats warmLoop;
+    loader.Start(request);
+    std::unique_ptr<LoadedScene> warm = RunFrameLoop(loader, frameMs, warmLoop);
+    check(warm && warm->succeeded && warm->fromCache, "the warm load did not come from the cache");
+    check(warm && warm->succeeded && matchesSerial(*warm), "the warm load differs from the serial one");
+
+    for (const FrameLoopStats* stats : { &coldLoop, &warmLoop })
+    {
+        check(stats->progressRegressions == 0, "progress went backwards");
+        check(stats->maxFrameMs <= frameMs + maxStallMs, "the frame loop stalled while loading");
+    }
+    check(coldLoop.frames > 0, "no frame ran during the cold load");
+
+    // A second request replaces the first, only its result comes back
+    loader.Start(serialRequest);
+    const uint64_t replacingId = loader.Start(request);
+    loader.Wait();
+    const std::unique_ptr<LoadedScene> replaced = loader.TakeResult();
+    check(replaced && replaced->requestId == replacingId && replaced->fromCache && !loader.TakeResult(), "a replaced load still delivered a result");
+
+    loader.Start(serialRequest);
+    loader.Cancel();
+    loader.Wait();
+    check(!loader.TakeResult() && !loader.IsBusy(), "a cancelled load delivered a result");
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "sceneload");
+    json.Key("scene").BeginObject();
+    json.Field("instances", uint32_t(generated.instances.size()));
+    json.Field("triangles", serial->triangles.GetTriangleCount());
+    json.Field("bvhNodes", serial->bvh.GetNodeCount());
+    json.EndObject();
+    json.Field("frameMs", frameMs);
+    json.Key("serial").BeginObject();
+    WriteStages(json, *serial);
+    json.EndObject();
+    if (cold)
+    {
+        json.Key("cold").BeginObject();
+        WriteStages(json, *cold);
+        WriteFrameLoop(json, coldLoop);
+        json.EndObject();
+    }
+    if (warm)
+    {
+        json.Key("warm").BeginObject();
+        WriteStages(json, *warm);
+        WriteFrameLoop(json, warmLoop);
+        json.EndObject();
+    }
+    json.Field("failedChecks", failedChecks);
+    json.EndObject();
+
+    // The results map the cache, which has to be closed before it can be removed
+    cold.reset();
+    warm.reset();
+    if (!keepFiles)
+    {
+        for (const std::string& path : files.GetPaths()) std::remove(path.c_str());
+        std::remove(cachePath.c_str());
+    }
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedChecks > 0 ? 2 : 0;
+}
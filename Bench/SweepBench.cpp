@@ -0,0 +1,542 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "Benchmarks.h"
+#include "../Cpu/AdaptiveSampling.h"
+#include "../Cpu/Bvh.h"
+#include "../Cpu/ImageMetrics.h"
+#include "../Cpu/JsonWriter.h"
+#include "../Cpu/RaytracedEffects.h"
+#include "../Cpu/SVGF.h"
+#include "../Cpu/SVGFSharedHistory.h"
+#include "../Cpu/SceneCache.h"
+#include "../Cpu/Timer.h"
+
+using namespace Cpu;
+
+namespace
+{
+    const float kAODistance = 3.0f;     // Same as the synthetic scene's analytic AO
+
+    enum class Effect : uint32_t
+    {
+        Shadows = 0,
+        Reflection,
+        AO,
+        Count
+    };
+
+    const uint32_t kEffectCount = uint32_t(Effect::Count);
+    const char* const kEffectNames[kEffectCount] = { "shadows", "reflection", "ao" };
+    const SVGFSignalType kSignalTypes[kEffectCount] = { SVGFSignalType::Scalar, SVGFSignalType::Color, SVGFSignalType::Scalar };
+
+    enum class Metric : uint32_t
+    {
+        Rmse = 0,
+        Ssim,
+        Flip,
+        Flicker,
+        Count
+    };
+
+    const uint32_t kMetricCount = uint32_t(Metric::Count);
+    const char* const kMetricNames[kMetricCount] = { "rmse", "ssim", "flip", "flicker" };
+
+    void Trace(RaytracedEffects& effects, Effect effect, const RtGBuffer& gBuffer, uint32_t frameCount, Image4F& output)
+    {
+        switch (effect)
+        {
+        case Effect::Shadows: effects.TraceShadows(gBuffer, RayScale::Full, frameCount, output); break;
+        case Effect::Reflection: effects.TraceReflection(gBuffer, RayScale::Full, frameCount, output); break;
+        default: effects.TraceAO(gBuffer, RayScale::Full, frameCount, kAODistance, output); break;
+        }
+    }
+
+    // Every pixel with the same number of rays
+    void BuildUniformWorkList(uint32_t width, uint32_t height, uint32_t rays, std::vector<uint32_t>& workList)
+    {
+        workList.clear();
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x) workList.push_back(x | (y << 14) | (rays << 28));
+        }
+    }
+
+    // What SVGFPass needs of a frame, kept for every configuration to run over
+    struct SweepFrame
+    {
+        Image4F motionVec;
+        Image4F linearZ;
+        Image4F normalDepth;
+        Image4F worldPosition;  // w = 0 where there is no geometry, which the metrics leave out
+    };
+
+    // Scalar signals only carry .x, shown as gray so every metric sees them the way color is seen
+    const Image4F& GetDisplayed(const Image4F& image, Effect effect, Image4F& gray)
+    {
+        if (kSignalTypes[uint32_t(effect)] != SVGFSignalType::Scalar) return image;
+        gray.Resize(image.GetWidth(), image.GetHeight());
+        for (size_t i = 0; i < image.GetPixelCount(); ++i)
+        {
+            const float x = image.GetData()[i].x;
+            gray.GetData()[i] = float4(x, x, x, 1.0f);
+        }
+        return gray;
+    }
+
+    // Metrics of one configuration over the measured frames. Flicker needs the frame before, so starts one frame later.
+    struct QualityAccumulator
+    {
+        double sums[kMetricCount] = {};
+        uint32_t counts[kMetricCount] = {};
+        Image4F prevTest;
+
+        void Add(const Image4F& test, const Image4F& reference, const Image4F* prevReference, const Image4F& mask, ThreadPool& threadPool)
+        {
+            const float rmse = GetRmse(test, reference, &mask);
+            AddMetric(Metric::Rmse, double(rmse) * rmse);
+            AddMetric(Metric::Ssim, GetSsim(test, reference, &mask, &threadPool));
+            AddMetric(Metric::Flip, GetFlip(test, reference, kFlipPixelsPerDegree, &mask, &threadPool));
+            if (prevReference && !prevTest.IsEmpty()) AddMetric(Metric::Flicker, GetFlicker(test, prevTest, reference, *prevReference, &mask));
+            prevTest = test;
+        }
+
+        void AddMetric(Metric metric, double value)
+        {
+            sums[uint32_t(metric)] += value;
+            counts[uint32_t(metric)]++;
+        }
+
+        // RMSE pools the squared error of every frame, the others are means over frames
+        float Get(Metric metric) const
+        {
+            const uint32_t m = uint32_t(metric);
+            const double mean = counts[m] > 0 ? sums[m] / double(counts[m]) : 0.0;
+            return float(metric == Metric::Rmse ? std::sqrt(mean) : mean);
+        }
+    };
+
+    // One point of the sweep: a ray count and the filter settings, or the ray count alone without filtering
+    struct SweepConfig
+    {
+        std::string name;
+        uint32_t rays = 1;
+        bool denoised = true;
+        SVGFSettings settings;
+
+        double raysPerFrame = 0.0;
+        double traceMs = 0.0;       // Per measured frame, as are the two below
+        double filterMs = 0.0;
+        double totalMs = 0.0;
+        float quality[kMetricCount] = {};
+    };
+
+    bool IsHigherBetter(Metric metric) { return metric == Metric::Ssim; }
+
+    // a at most as costly and as good as b in a metric, and better in one of the two
+    bool Dominates(const SweepConfig& a, const SweepConfig& b, Metric metric)
+    {
+        const uint32_t m = uint32_t(metric);
+        const float qa = IsHigherBetter(metric) ? -a.quality[m] : a.quality[m];
+        const float qb = IsHigherBetter(metric) ? -b.quality[m] : b.quality[m];
+        return a.totalMs <= b.totalMs && qa <= qb && (a.totalMs < b.totalMs || qa < qb);
+    }
+
+    // The configurations no other one dominates, cheapest first, so quality improves along the list
+    std::vector<uint32_t> GetParetoFrontier(const std::vector<SweepConfig>& configs, Metric metric)
+    {
+        std::vector<uint32_t> frontier;
+        for (uint32_t i = 0; i < configs.size(); ++i)
+        {
+            bool dominated = false;
+            for (uint32_t j = 0; j < configs.size() && !dominated; ++j) dominated = j != i && Dominates(configs[j], configs[i], metric);
+            if (!dominated) frontier.push_back(i);
+        }
+        std::sort(frontier.begin(), frontier.end(), [&](uint32_t a, uint32_t b) { return configs[a].totalMs < configs[b].totalMs; });
+        return frontier;
+    }
+
+    std::string FormatFloat(float value)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "%g", value);
+        return text;
+    }
+
+    std::string GetConfigName(uint32_t rays, const SVGFSettings* settings)
+    {
+        std::string name = std::to_string(rays) + "spp";
+        if (!settings) return name + " unfiltered";
+        return name + " c" + FormatFloat(settings->phiColor) + " n" + FormatFloat(settings->phiNormal) + " a" + FormatFloat(settings->alpha) +
+            " i" + std::to_string(settings->atrousIterations) + " t" + std::to_string(settings->feedbackTap);
+    }
+}
+
+int RunSweepBench(const CommandLine& args)
+{
+    const std::string sequence = args.GetString("sequence", "");
+    const std::string sceneCachePath = args.GetString("scene-cache", "");
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolution", "320x180");
+    const uint32_t frameCount = std::max(2u, args.GetUint("frames", 16));
+    const uint32_t warmupCount = std::min(frameCount - 2, args.GetUint("warmup", 4));
+    const std::vector<std::string> effectNames = args.GetStringList("effects", "shadows,reflection,ao");
+    const std::vector<uint32_t> rayCounts = args.GetUintList("rays", "1,2,4");
+    const std::vector<float> phiColors = args.GetFloatList("phi-color", "4,10,32");
+    const std::vector<float> phiNormals = args.GetFloatList("phi-normal", "128");
+    const std::vector<float> alphas = args.GetFloatList("alpha", "0.05,0.15");
+    const std::vector<uint32_t> atrousIterations = args.GetUintList("atrous-iterations", "3,4,5");
+    const std::vector<uint32_t> feedbackTaps = args.GetUintList("feedback-tap", "1");
+    const uint32_t referenceRays = std::max(1u, args.GetUint("reference-rays", 32));
+    const uint32_t sphereSegments = args.GetUint("segments", 64);
+    const std::string csvPath = args.GetString("csv", "");
+    const std::string outputPath = args.GetString("output", "");
+
+    if (resolutions.empty()) return 1;
+    const uint32_t width = resolutions[0].width;
+    const uint32_t height = resolutions[0].height;
+
+    std::vector<Effect> sweptEffects;
+    for (const std::string& name : effectNames)
+    {
+        const char* const* found = std::find_if(kEffectNames, kEffectNames + kEffectCount, [&](const char* effectName) { return name == effectName; });
+        if (found == kEffectNames + kEffectCount)
+        {
+            fprintf(stderr, "Unknown effect '%s'\n", name.c_str());
+            return 1;
+        }
+        sweptEffects.push_back(Effect(found - kEffectNames));
+    }
+    for (uint32_t rays : rayCounts)
+    {
+        if (rays == 0 || rays > AdaptiveSampler::kMaxRaysPerPixel)
+        {
+            fprintf(stderr, "Rays have to be between 1 and %u\n", AdaptiveSampler::kMaxRaysPerPixel);
+            return 1;
+        }
+    }
+
+    ThreadPool threadPool(args.GetUint("threads", 0));
+
+    uint32_t failedChecks = 0;
+    auto check = [&](bool condition, const std::string& name, const char* message)
+    {
+        if (condition) return;
+        fprintf(stderr, "sweep: %s: %s\n", name.c_str(), message);
+        failedChecks++;
+    };
+
+    // Recorded camera paths are traced against the scene they were recorded in
+    FrameSource source(sequence, threadPool);
+    if (!source.IsValid())
+    {
+        fprintf(stderr, "No frames found in '%s'\n", sequence.c_str());
+        return 1;
+    }
+    if (!sequence.empty() && sceneCachePath.empty())
+    {
+        fprintf(stderr, "sweep: a recorded sequence needs --scene-cache with the scene it was recorded in\n");
+        return 1;
+    }
+
+    TriangleScene scene;
+    SceneCache sceneCache;
+    if (sceneCachePath.empty())
+    {
+        SyntheticScene().BuildTriangleScene(sphereSegments, scene);
+    }
+    else
+    {
+        const SceneCache::Status status = sceneCache.OpenAnySource(sceneCachePath);
+        if (status != SceneCache::Status::Ok)
+        {
+            fprintf(stderr, "Failed to open '%s': %s\n", sceneCachePath.c_str(), GetSceneCacheStatusName(status));
+            return 1;
+        }
+        BuildTriangleScene(sceneCache.GetView(), scene, &threadPool);
+    }
+    Bvh bvh;
+    bvh.Build(scene, BvhBuildSettings(), &threadPool);
+    RaytracedEffects effects(scene, bvh, threadPool);
+
+    // Trace every frame once per ray count, and converged per measured frame, so every filter setting denoises the
+    // same rays. The traces are timed here and their time charged to every configuration that uses them.
+    const std::string resolutionName = std::to_string(width) + "x" + std::to_string(height);
+    fprintf(stderr, "sweep %s %s, tracing %u frames\n", source.GetName().c_str(), resolutionName.c_str(), frameCount);
+
+    std::vector<SweepFrame> frames(frameCount);
+    std::vector<Image4F> references[kEffectCount];
+    std::vector<std::vector<Image4F>> traced[kEffectCount];
+    std::vector<double> traceMs[kEffectCount];
+    std::vector<uint64_t> tracedRays[kEffectCount];
+    for (Effect effect : sweptEffects)
+    {
+        const uint32_t e = uint32_t(effect);
+        references[e].resize(frameCount);
+        traced[e].assign(rayCounts.size(), std::vector<Image4F>(frameCount));
+        traceMs[e].assign(rayCounts.size(), 0.0);
+        tracedRays[e].assign(rayCounts.size(), 0);
+    }
+
+    FrameData frame;
+    Image4F referencePass;
+    std::vector<uint32_t> workList;
+    for (uint32_t frameIndex = 0; frameIndex < frameCount; ++frameIndex)
+    {
+        RtGBuffer gBuffer;
+        if (!source.GetFrame(frameIndex, width, height, frame) || !source.GetCameraPosition(frameIndex, gBuffer.cameraPosition))
+        {
+            fprintf(stderr, "Failed to load frame %u of '%s' with its camera\n", frameIndex, source.GetName().c_str());
+            return 1;
+        }
+        gBuffer.worldPosition = &frame.Get(FrameTarget::WorldPosition);
+        gBuffer.normalRoughness = &frame.Get(FrameTarget::NormalRoughness);
+        gBuffer.albedo = &frame.Get(FrameTarget::Albedo);
+
+        SweepFrame& sweepFrame = frames[frameIndex];
+        sweepFrame.motionVec = frame.Get(FrameTarget::MotionVector);
+        sweepFrame.linearZ = frame.Get(FrameTarget::SVGF_LinearZ);
+        sweepFrame.normalDepth = frame.Get(FrameTarget::SVGF_CompactNormDepth);
+        sweepFrame.worldPosition = frame.Get(FrameTarget::WorldPosition);
+        const bool measured = frameIndex >= warmupCount;
+
+        for (Effect effect : sweptEffects)
+        {
+            const uint32_t e = uint32_t(effect);
+            if (measured)
+            {
+                // Passes of up to kMaxRaysPerPixel rays per pixel, seeds apart from the ones the configurations draw
+                Image4F& converged = references[e][frameIndex];
+                converged.Resize(width, height);
+                for (uint32_t first = 0, pass = 1; first < referenceRays; first += AdaptiveSampler::kMaxRaysPerPixel, ++pass)
+                {
+                    const uint32_t rays = std::min(AdaptiveSampler::kMaxRaysPerPixel, referenceRays - first);
+                    BuildUniformWorkList(width, height, rays, workList);
+                    effects.SetWorkList(&workList);
+                    Trace(effects, effect, gBuffer, frameIndex + (pass << 20), referencePass);
+                    for (size_t i = 0; i < referencePass.GetPixelCount(); ++i)
+                    {
+                        converged.GetData()[i] += referencePass.GetData()[i] * (float(rays) / float(referenceRays));
+                    }
+                }
+            }
+
+            for (uint32_t r = 0; r < rayCounts.size(); ++r)
+            {
+                BuildUniformWorkList(width, height, rayCounts[r], workList);
+                effects.SetWorkList(&workList);
+                Timer timer;
+                Trace(effects, effect, gBuffer, frameIndex, traced[e][r][frameIndex]);
+                if (!measured) continue;
+                traceMs[e][r] += timer.GetElapsedMs();
+                tracedRays[e][r] += effects.GetLastStats().rays;
+            }
+        }
+        effects.SetWorkList(nullptr);
+    }
+
+    // The settings to sweep; a feedback tap past the last iteration would never store the history
+    std::vector<SVGFSettings> settingsList;
+    for (float phiColor : phiColors)
+    {
+        for (float phiNormal : phiNormals)
+        {
+            for (float alpha : alphas)
+            {
+                for (uint32_t iterations : atrousIterations)
+                {
+                    for (uint32_t feedbackTap : feedbackTaps)
+                    {
+                        if (iterations == 0 || feedbackTap >= iterations) continue;
+                        SVGFSettings settings;
+                        settings.phiColor = phiColor;
+                        settings.phiNormal = phiNormal;
+                        settings.alpha = alpha;
+                        settings.atrousIterations = iterations;
+                        settings.feedbackTap = feedbackTap;
+                        settingsList.push_back(settings);
+                    }
+                }
+            }
+        }
+    }
+
+    const double measuredFrames = double(frameCount - warmupCount);
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "sweep");
+    json.Field("source", source.GetName());
+    json.Field("resolution", resolutionName);
+    json.Field("threads", threadPool.GetThreadCount());
+    json.Field("frames", frameCount);
+    json.Field("warmup", warmupCount);
+    json.Field("referenceRays", referenceRays);
+    json.Field("filterSettings", uint32_t(settingsList.size()));
+    json.Key("effects").BeginArray();
+
+    std::string csv = "effect,config,rays,denoised,phiColor,phiNormal,alpha,atrousIterations,feedbackTap,raysPerFrame,traceMs,filterMs,totalMs,"
+        "rmse,ssim,flip,flicker\n";
+
+    Image4F testGray, referenceGray, prevReferenceGray;
+    for (Effect effect : sweptEffects)
+    {
+        const uint32_t e = uint32_t(effect);
+        const std::string effectName = kEffectNames[e];
+        fprintf(stderr, "sweep %s, %u configurations\n", effectName.c_str(), uint32_t(rayCounts.size() * (settingsList.size() + 1)));
+
+        // Identical images have to score perfectly, and the metrics have to see the noise of a single ray
+        {
+            const Image4F& reference = references[e][warmupCount];
+            const Image4F& mask = frames[warmupCount].worldPosition;
+            const Image4F& displayed = GetDisplayed(reference, effect, referenceGray);
+            check(GetRmse(displayed, displayed, &mask) == 0.0f && std::abs(GetSsim(displayed, displayed, &mask, &threadPool) - 1.0f) < 1e-4f &&
+                GetFlip(displayed, displayed, kFlipPixelsPerDegree, &mask, &threadPool) == 0.0f, effectName, "an image does not score perfectly against itself");
+            const Image4F& noisy = GetDisplayed(traced[e][0][warmupCount], effect, testGray);
+            check(GetFlip(noisy, displayed, kFlipPixelsPerDegree, &mask, &threadPool) > 0.0f && GetSsim(noisy, displayed, &mask, &threadPool) < 1.0f,
+                effectName, "the metrics do not see the noise of the traced rays");
+        }
+
+        // Runs frames through a filter, or the raw traces when filter is null, and scores the measured ones
+        auto runFrames = [&](SweepConfig& config, uint32_t r, SVGFPass* filter, SVGFSharedHistory* history)
+        {
+            QualityAccumulator quality;
+            for (uint32_t frameIndex = 0; frameIndex < frameCount; ++frameIndex)
+            {
+                const SweepFrame& sweepFrame = frames[frameIndex];
+                const Image4F* output = &traced[e][r][frameIndex];
+                if (filter)
+                {
+                    history->Update(sweepFrame.motionVec, sweepFrame.linearZ, frameIndex);
+                    output = &filter->Execute(*output, sweepFrame.motionVec, sweepFrame.linearZ, sweepFrame.normalDepth);
+                    history->EndFrame(sweepFrame.linearZ);
+                }
+                if (frameIndex < warmupCount) continue;
+
+                if (filter) config.filterMs += filter->GetTimings().totalMs;
+                const Image4F* prevReference = frameIndex > warmupCount ? &GetDisplayed(references[e][frameIndex - 1], effect, prevReferenceGray) : nullptr;
+                quality.Add(GetDisplayed(*output, effect, testGray), GetDisplayed(references[e][frameIndex], effect, referenceGray), prevReference,
+                    sweepFrame.worldPosition, threadPool);
+            }
+
+            config.raysPerFrame = double(tracedRays[e][r]) / measuredFrames;
+            config.traceMs = traceMs[e][r] / measuredFrames;
+            config.filterMs /= measuredFrames;
+            config.totalMs = config.traceMs + config.filterMs;
+            for (uint32_t m = 0; m < kMetricCount; ++m) config.quality[m] = quality.Get(Metric(m));
+        };
+
+        std::vector<SweepConfig> configs;
+        for (uint32_t r = 0; r < rayCounts.size(); ++r)
+        {
+            SweepConfig unfiltered;
+            unfiltered.name = GetConfigName(rayCounts[r], nullptr);
+            unfiltered.rays = rayCounts[r];
+            unfiltered.denoised = false;
+            runFrames(unfiltered, r, nullptr, nullptr);
+            configs.push_back(unfiltered);
+
+            for (const SVGFSettings& settings : settingsList)
+            {
+                SweepConfig config;
+                config.name = GetConfigName(rayCounts[r], &settings);
+                config.rays = rayCounts[r];
+                config.settings = settings;
+
+                // The compact layout the app filters with, with a fresh history per configuration
+                SVGFSharedHistory history(width, height, &threadPool);
+                SVGFPass filter(width, height, history, kSignalTypes[e], &threadPool);
+                filter.GetSettings().phiColor = settings.phiColor;
+                filter.GetSettings().phiNormal = settings.phiNormal;
+                filter.GetSettings().alpha = settings.alpha;
+                filter.GetSettings().atrousIterations = settings.atrousIterations;
+                filter.GetSettings().feedbackTap = settings.feedbackTap;
+                runFrames(config, r, &filter, &history);
+                configs.push_back(config);
+            }
+
+            // Whatever a setting blurs, accumulating over frames has to steady the rays. A filter that does not lost its history.
+            const SweepConfig& raw = configs[configs.size() - settingsList.size() - 1];
+            for (size_t i = configs.size() - settingsList.size(); i < configs.size(); ++i)
+            {
+                check(configs[i].quality[uint32_t(Metric::Flicker)] < raw.quality[uint32_t(Metric::Flicker)], effectName + " " + configs[i].name,
+                    "the filter flickers as much as the rays it filters");
+            }
+        }
+
+        json.BeginObject();
+        json.Field("effect", effectName);
+        json.Key("configs").BeginArray();
+        for (const SweepConfig& config : configs)
+        {
+            json.BeginObject();
+            json.Field("name", config.name);
+            json.Field("rays", config.rays);
+            json.Field("denoised", config.denoised);
+            if (config.denoised)
+            {
+                json.Field("phiColor", config.settings.phiColor);
+                json.Field("phiNormal", config.settings.phiNormal);
+                json.Field("alpha", config.settings.alpha);
+                json.Field("atrousIterations", config.settings.atrousIterations);
+                json.Field("feedbackTap", config.settings.feedbackTap);
+            }
+            json.Field("raysPerFrame", uint64_t(config.raysPerFrame));
+            json.Field("traceMs", float(config.traceMs));
+            json.Field("filterMs", float(config.filterMs));
+            json.Field("totalMs", float(config.totalMs));
+            for (uint32_t m = 0; m < kMetricCount; ++m) json.Field(kMetricNames[m], config.quality[m]);
+            json.EndObject();
+
+            char row[512];
+            snprintf(row, sizeof(row), "%s,%s,%u,%u,%g,%g,%g,%u,%u,%.0f,%.4f,%.4f,%.4f,%.6f,%.6f,%.6f,%.6f\n", effectName.c_str(), config.name.c_str(),
+                config.rays, config.denoised ? 1 : 0, config.denoised ? config.settings.phiColor : 0.0f, config.denoised ? config.settings.phiNormal : 0.0f,
+                config.denoised ? config.settings.alpha : 0.0f, config.denoised ? config.settings.atrousIterations : 0, config.denoised ? config.settings.feedbackTap : 0,
+                config.raysPerFrame, config.traceMs, config.filterMs, config.totalMs, config.quality[0], config.quality[1], config.quality[2], config.quality[3]);
+            csv += row;
+        }
+        json.EndArray();
+
+        // Cost against each metric: the settings worth shipping at some frame budget, cheapest first
+        json.Key("pareto").BeginObject();
+        for (uint32_t m = 0; m < kMetricCount; ++m)
+        {
+            const std::vector<uint32_t> frontier = GetParetoFrontier(configs, Metric(m));
+            check(!frontier.empty(), effectName + " " + kMetricNames[m], "the Pareto frontier is empty");
+            json.Key(kMetricNames[m]).BeginArray();
+            for (uint32_t i : frontier)
+            {
+                json.BeginObject();
+                json.Field("name", configs[i].name);
+                json.Field("totalMs", float(configs[i].totalMs));
+                json.Field(kMetricNames[m], configs[i].quality[m]);
+                json.EndObject();
+            }
+            json.EndArray();
+        }
+        json.EndObject();
+        json.EndObject();
+    }
+
+    json.EndArray();
+    json.Field("failedChecks", failedChecks);
+    json.EndObject();
+
+    if (!csvPath.empty() && !WriteTextFile(csvPath, csv))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", csvPath.c_str());
+        return 1;
+    }
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedChecks > 0 ? 2 : 0;
+}
@@ -0,0 +1,376 @@
+#include "SyntheticScene.h"
+#include "../Cpu/LightSampling.h"
+#include "../Cpu/Sampling.h"
+#include "../Cpu/SVGFUtils.h"
+
+using namespace Cpu;
+
+namespace
+{
+    const float3 kSkyColor(0.2f, 0.6f, 0.9f);
+    const float3 kLightDirection(-0.1889593f, -0.7416323f, -0.6436427f); // DirLight0 from Pica.fscene
+    const float kLightIntensity = 1.2f;
+    const float kGroundExtent = 30.0f;
+    const float kAODistance = 3.0f;
+
+    struct Sphere
+    {
+        float3 center;
+        float radius;
+        float3 albedo;
+        float linearRoughness;
+    };
+
+    const Sphere kSpheres[] =
+    {
+        { float3(0.0f, 0.5f, 0.0f), 0.5f, float3(0.95f, 0.0f, 0.0f), 0.08f },
+        { float3(1.2f, 0.3f, 0.4f), 0.3f, float3(0.1f, 0.8f, 0.1f), 0.3f },
+        { float3(-1.0f, 0.4f, -0.8f), 0.4f, float3(0.8f, 0.8f, 0.8f), 0.6f },
+    };
+
+    const float3 kGroundAlbedo(0.03f, 0.0f, 0.0f);
+    const float kGroundRoughness = 0.54f;
+
+    // Total luminance of the point lights at unit distance, so the image stays about as bright at every count
+    const float kPointLightPower = 6.0f;
+
+    struct Hit
+    {
+        float t;
+        float3 position;
+        float3 normal;
+        float3 albedo;
+        float linearRoughness;
+    };
+
+    struct View
+    {
+        float3 position;
+        float3 forward;
+        float3 right;
+        float3 up;
+        float tanHalfFovY;
+        float aspectRatio;
+
+        float3 GetRayDirection(float px, float py, uint32_t width, uint32_t height) const
+        {
+            const float dx = (px / width) * 2.0f - 1.0f;
+            const float dy = (py / height) * 2.0f - 1.0f;
+            return normalize(right * (dx * tanHalfFovY * aspectRatio) - up * (dy * tanHalfFovY) + forward);
+        }
+
+        float GetLinearZ(const float3& p) const { return dot(p - position, forward); }
+
+        float2 Project(const float3& p) const
+        {
+            const float3 v = p - position;
+            const float z = dot(v, forward);
+            const float sx = dot(v, right) / (z * tanHalfFovY * aspectRatio);
+            const float sy = dot(v, up) / (z * tanHalfFovY);
+            return float2(sx * 0.5f + 0.5f, -sy * 0.5f + 0.5f);
+        }
+    };
+
+    View MakeView(uint32_t frameIndex, uint32_t width, uint32_t height)
+    {
+        const float angle = 0.6f + 0.01f * float(frameIndex);
+        const float3 target(0.0f, 0.4f, 0.0f);
+
+        View view;
+        view.position = float3(4.0f * std::cos(angle), 1.8f, 4.0f * std::sin(angle));
+        view.forward = normalize(target - view.position);
+        view.right = normalize(cross(view.forward, float3(0.0f, 1.0f, 0.0f)));
+        view.up = cross(view.right, view.forward);
+        view.tanHalfFovY = std::tan(0.5f * 45.0f * kPi / 180.0f);
+        view.aspectRatio = float(width) / float(height);
+        return view;
+    }
+
+    bool IntersectScene(const float3& origin, const float3& direction, float tMin, float tMax, Hit* hit)
+    {
+        bool found = false;
+
+        for (const Sphere& sphere : kSpheres)
+        {
+            const float3 oc = origin - sphere.center;
+            const float b = dot(oc, direction);
+            const float c = dot(oc, oc) - sphere.radius * sphere.radius;
+            const float discriminant = b * b - c;
+            if (discriminant < 0.0f) continue;
+
+            const float sq = std::sqrt(discriminant);
+            float t = -b - sq;
+            if (t < tMin) t = -b + sq;
+            if (t < tMin || t > tMax) continue;
+
+            if (!hit) return true;
+            tMax = t;
+            found = true;
+            hit->t = t;
+            hit->position = origin + direction * t;
+            hit->normal = normalize(hit->position - sphere.center);
+            hit->albedo = sphere.albedo;
+            hit->linearRoughness = sphere.linearRoughness;
+        }
+
+        if (std::fabs(direction.y) > 1e-8f)
+        {
+            const float t = -origin.y / direction.y;
+            const float3 p = origin + direction * t;
+            if (t >= tMin && t <= tMax && std::fabs(p.x) < kGroundExtent && std::fabs(p.z) < kGroundExtent)
+            {
+                if (!hit) return true;
+                found = true;
+                hit->t = t;
+                hit->position = p;
+                hit->normal = float3(0.0f, 1.0f, 0.0f);
+                hit->albedo = kGroundAlbedo;
+                hit->linearRoughness = kGroundRoughness;
+            }
+        }
+
+        return found;
+    }
+
+    float FresnelSchlick(float f0, float cosTheta)
+    {
+        const float m = 1.0f - saturate(cosTheta);
+        return f0 + (1.0f - f0) * m * m * m * m * m;
+    }
+
+    float3 ShadeReflectionHit(const Hit& hit)
+    {
+        const float3 L = -kLightDirection;
+        const float NdotL = saturate(dot(hit.normal, L));
+        if (NdotL <= 0.0f || IntersectScene(hit.position, L, 0.001f, 1000.0f, nullptr)) return float3();
+        return hit.albedo * (kLightIntensity * NdotL / kPi);
+    }
+}
+
+void SyntheticScene::RenderFrame(uint32_t frameIndex, uint32_t width, uint32_t height, FrameData& frame, ThreadPool& threadPool) const
+{
+    frame.targetMask = (1u << kFrameTargetCount) - 1;
+    frame.Resize(width, height);
+
+    const View view = MakeView(frameIndex, width, height);
+    const View prevView = MakeView(frameIndex > 0 ? frameIndex - 1 : 0, width, height);
+
+    Image4F& worldPosition = frame.Get(FrameTarget::WorldPosition);
+    Image4F& normalRoughness = frame.Get(FrameTarget::NormalRoughness);
+    Image4F& albedo = frame.Get(FrameTarget::Albedo);
+    Image4F& motionVector = frame.Get(FrameTarget::MotionVector);
+    Image4F& linearZ = frame.Get(FrameTarget::SVGF_LinearZ);
+    Image4F& compactNormDepth = frame.Get(FrameTarget::SVGF_CompactNormDepth);
+    Image4F& shadow = frame.Get(FrameTarget::Shadow);
+    Image4F& reflection = frame.Get(FrameTarget::Reflection);
+    Image4F& ao = frame.Get(FrameTarget::AO);
+
+    // Primary visibility. Sky pixels keep the G-buffer clear color (all zero).
+    threadPool.ParallelForTiles(width, height, 32, [&](const TileRect& tile, uint32_t)
+    {
+        for (uint32_t y = tile.y0; y < tile.y1; ++y)
+        {
+            for (uint32_t x = tile.x0; x < tile.x1; ++x)
+            {
+                const float3 direction = view.GetRayDirection(x + 0.5f, y + 0.5f, width, height);
+
+                Hit hit;
+                if (!IntersectScene(view.position, direction, 0.0f, 1e30f, &hit)) continue;
+
+                const float2 uv = float2((x + 0.5f) / width, (y + 0.5f) / height);
+                const float2 prevUV = prevView.Project(hit.position);
+
+                worldPosition.At(x, y) = float4(hit.position, 1.0f);
+                normalRoughness.At(x, y) = float4(hit.normal, hit.linearRoughness);
+                albedo.At(x, y) = float4(hit.albedo, 1.0f);
+                motionVector.At(x, y) = float4(prevUV.x - uv.x, prevUV.y - uv.y, 0.0f, 0.0f);
+                linearZ.At(x, y) = float4(view.GetLinearZ(hit.position), 0.0f, prevView.GetLinearZ(hit.position), asfloat(DirToOct(hit.normal)));
+            }
+        }
+    });
+
+    // Screen space derivatives, the equivalent of ddx/ddy/fwidth in GBuffer.slang
+    threadPool.ParallelForTiles(width, height, 32, [&](const TileRect& tile, uint32_t)
+    {
+        for (uint32_t y = tile.y0; y < tile.y1; ++y)
+        {
+            for (uint32_t x = tile.x0; x < tile.x1; ++x)
+            {
+                const float4 center = worldPosition.At(x, y);
+                if (center.w == 0.0f) continue;
+
+                const int nx = (x + 1 < width) ? int(x) + 1 : int(x) - 1;
+                const int ny = (y + 1 < height) ? int(y) + 1 : int(y) - 1;
+                const bool validX = nx >= 0 && worldPosition.At(nx, y).w != 0.0f;
+                const bool validY = ny >= 0 && worldPosition.At(x, ny).w != 0.0f;
+
+                const float z = linearZ.At(x, y).x;
+                const float dzdx = validX ? std::fabs(linearZ.At(nx, y).x - z) : 0.0f;
+                const float dzdy = validY ? std::fabs(linearZ.At(x, ny).x - z) : 0.0f;
+                const float maxChangeZ = std::max(dzdx, dzdy);
+
+                const float3 p = center.rgb();
+                const float3 n = normalRoughness.At(x, y).rgb();
+                const float3 dpdx = validX ? abs(worldPosition.At(nx, y).rgb() - p) : float3();
+                const float3 dpdy = validY ? abs(worldPosition.At(x, ny).rgb() - p) : float3();
+                const float3 dndx = validX ? abs(normalRoughness.At(nx, y).rgb() - n) : float3();
+                const float3 dndy = validY ? abs(normalRoughness.At(x, ny).rgb() - n) : float3();
+
+                motionVector.At(x, y).z = length(dpdx + dpdy);
+                motionVector.At(x, y).w = length(dndx + dndy);
+                linearZ.At(x, y).y = maxChangeZ;
+                compactNormDepth.At(x, y) = float4(asfloat(DirToOct(n)), z, maxChangeZ, 0.0f);
+            }
+        }
+    });
+
+    // One noisy sample per pixel for each ray traced effect
+    threadPool.ParallelForTiles(width, height, 32, [&](const TileRect& tile, uint32_t)
+    {
+        for (uint32_t y = tile.y0; y < tile.y1; ++y)
+        {
+            for (uint32_t x = tile.x0; x < tile.x1; ++x)
+            {
+                const float4 position = worldPosition.At(x, y);
+                if (position.w == 0.0f) continue;
+
+                const float3 posW = position.rgb();
+                const float3 N = normalRoughness.At(x, y).rgb();
+                const float linearRoughness = std::max(0.08f, normalRoughness.At(x, y).w);
+                uint32_t randSeed = RandInit(x + y * width, frameIndex, 16);
+
+                const float2 shadowRand(RandNext(randSeed), RandNext(randSeed));
+                const float3 shadowDir = SampleLightCone(shadowRand, -kLightDirection, 0.02f);
+                const bool shadowed = IntersectScene(posW, shadowDir, 0.01f, 1000.0f, nullptr);
+                shadow.At(x, y) = float4(shadowed ? 0.0f : 1.0f, 0.0f, 0.0f, 1.0f);
+
+                const float2 aoRand(RandNext(randSeed), RandNext(randSeed));
+                const float3 aoDir = GetCosHemisphereSample(aoRand, N, GetPerpendicularStark(N));
+                const bool occluded = IntersectScene(posW, aoDir, 0.01f, kAODistance, nullptr);
+                ao.At(x, y) = float4(occluded ? 0.0f : 1.0f, 0.0f, 0.0f, 1.0f);
+
+                const float3 V = normalize(view.position - posW);
+                const float2 reflectionRand(RandNext(randSeed), RandNext(randSeed));
+                const float3 H = GetGGXMicrofacet(reflectionRand, N, linearRoughness * linearRoughness);
+                const float3 L = reflect(-V, H);
+
+                float3 color;
+                if (dot(L, N) > 0.0f)
+                {
+                    Hit hit;
+                    color = IntersectScene(posW, L, 0.001f, 100000.0f, &hit) ? ShadeReflectionHit(hit) : kSkyColor;
+                    color *= FresnelSchlick(0.04f, dot(L, H));
+                }
+                reflection.At(x, y) = float4(color, 1.0f);
+            }
+        }
+    });
+}
+
+float3 SyntheticScene::GetCameraPosition(uint32_t frameIndex) const
+{
+    return MakeView(frameIndex, 1, 1).position;
+}
+
+void SyntheticScene::BuildSceneData(uint32_t sphereSegments, SceneData& scene) const
+{
+    scene.Clear();
+
+    const uint32_t slices = std::max(3u, sphereSegments);
+    const uint32_t stacks = std::max(2u, sphereSegments / 2);
+
+    std::vector<float3> positions, normals;
+    std::vector<uint32_t> indices;
+    for (const Sphere& sphere : kSpheres)
+    {
+        positions.clear();
+        normals.clear();
+        indices.clear();
+
+        for (uint32_t stack = 0; stack <= stacks; ++stack)
+        {
+            const float theta = kPi * float(stack) / float(stacks);
+            for (uint32_t slice = 0; slice <= slices; ++slice)
+            {
+                const float phi = 2.0f * kPi * float(slice) / float(slices);
+                const float3 n(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+                positions.push_back(n * sphere.radius);
+                normals.push_back(n);
+            }
+        }
+        for (uint32_t stack = 0; stack < stacks; ++stack)
+        {
+            for (uint32_t slice = 0; slice < slices; ++slice)
+            {
+                const uint32_t i0 = stack * (slices + 1) + slice;
+                const uint32_t i1 = i0 + slices + 1;
+                const uint32_t quad[6] = { i0, i1, i0 + 1, i0 + 1, i1, i1 + 1 };
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+
+        SceneMaterial material;
+        material.baseColor = sphere.albedo;
+        material.linearRoughness = sphere.linearRoughness;
+        scene.materials.push_back(material);
+
+        // Spheres are modelled around the origin and placed by their instance
+        SceneInstance instance;
+        instance.meshId = scene.AddMesh(positions.data(), normals.data(), nullptr, nullptr, uint32_t(positions.size()), indices.data(), uint32_t(indices.size()),
+            uint32_t(scene.materials.size() - 1), uint32_t(scene.meshes.size()));
+        instance.transform[12] = sphere.center.x;
+        instance.transform[13] = sphere.center.y;
+        instance.transform[14] = sphere.center.z;
+        scene.instances.push_back(instance);
+    }
+
+    const float e = kGroundExtent;
+    const float3 groundPositions[4] = { float3(-e, 0.0f, -e), float3(e, 0.0f, -e), float3(e, 0.0f, e), float3(-e, 0.0f, e) };
+    const float3 groundNormals[4] = { float3(0.0f, 1.0f, 0.0f), float3(0.0f, 1.0f, 0.0f), float3(0.0f, 1.0f, 0.0f), float3(0.0f, 1.0f, 0.0f) };
+    const uint32_t groundIndices[6] = { 0, 2, 1, 0, 3, 2 };
+    SceneMaterial ground;
+    ground.baseColor = kGroundAlbedo;
+    ground.linearRoughness = kGroundRoughness;
+    scene.materials.push_back(ground);
+
+    SceneInstance groundInstance;
+    groundInstance.meshId = scene.AddMesh(groundPositions, groundNormals, nullptr, nullptr, 4, groundIndices, 6, uint32_t(scene.materials.size() - 1), uint32_t(scene.meshes.size()));
+    scene.instances.push_back(groundInstance);
+
+    SceneLight light;
+    light.type = SceneLight::Type::Directional;
+    light.direction = kLightDirection;
+    light.intensity = float3(kLightIntensity);
+    scene.lights.push_back(light);
+}
+
+void SyntheticScene::BuildTriangleScene(uint32_t sphereSegments, TriangleScene& scene) const
+{
+    SceneData data;
+    BuildSceneData(sphereSegments, data);
+    Cpu::BuildTriangleScene(data.GetView(), scene);
+}
+
+void SyntheticScene::AddPointLights(uint32_t lightCount, TriangleScene& scene) const
+{
+    if (lightCount <= 1) return;
+
+    uint32_t seed = RandInit(lightCount, 0x4C494748u);
+    std::vector<SceneLight> lights(lightCount - 1);
+    float totalWeight = 0.0f;
+    for (SceneLight& light : lights)
+    {
+        const float angle = RandNext(seed) * 2.0f * kPi;
+        const float radius = 1.0f + 7.0f * std::sqrt(RandNext(seed));
+        light.type = SceneLight::Type::Point;
+        light.position = float3(radius * std::cos(angle), 0.5f + 2.5f * RandNext(seed), radius * std::sin(angle));
+        const float3 tint(0.6f + 0.4f * RandNext(seed), 0.6f + 0.4f * RandNext(seed), 0.6f + 0.4f * RandNext(seed));
+        light.intensity = tint * (0.05f + 0.95f * RandNext(seed) * RandNext(seed));
+        totalWeight += GetLightSelectionWeight(light);
+    }
+    for (SceneLight& light : lights)
+    {
+        light.intensity = light.intensity * (kPointLightPower / totalWeight);
+        scene.AddLight(light);
+    }
+}
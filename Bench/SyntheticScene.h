@@ -0,0 +1,26 @@
+#pragma once
+
+#include "../Cpu/FrameSequence.h"
+#include "../Cpu/SceneCache.h"
+#include "../Cpu/ThreadPool.h"
+#include "../Cpu/TriangleScene.h"
+
+// Analytic stand-in for a recorded sequence: a ground plane and a few spheres under a directional light,
+// seen from a slowly orbiting camera. Produces every FrameTarget with one noisy sample per pixel for
+// shadow, AO and reflection, so the denoiser benchmarks run without any captured data.
+class SyntheticScene
+{
+public:
+    void RenderFrame(uint32_t frameIndex, uint32_t width, uint32_t height, Cpu::FrameData& frame, Cpu::ThreadPool& threadPool) const;
+
+    Cpu::float3 GetCameraPosition(uint32_t frameIndex) const;
+
+    // The same scene as triangles, spheres tessellated with sphereSegments around the equator. As SceneData every
+    // sphere is a mesh around the origin placed by its instance, like a model loaded from an fscene.
+    void BuildSceneData(uint32_t sphereSegments, Cpu::SceneData& scene) const;
+    void BuildTriangleScene(uint32_t sphereSegments, Cpu::TriangleScene& scene) const;
+
+    // Keeps the directional light and adds lightCount - 1 point lights scattered over the ground, with luminances that
+    // differ by up to 20x and a few colors, the same for every run
+    void AddPointLights(uint32_t lightCount, Cpu::TriangleScene& scene) const;
+};
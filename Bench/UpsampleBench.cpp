@@ -0,0 +1,278 @@
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include "Benchmarks.h"
+#include "../Cpu/FrameProfiler.h"
+#include "../Cpu/RayUpsample.h"
+#include "../Cpu/SVGF.h"
+#include "../Cpu/SVGFSharedHistory.h"
+#include "../Cpu/Statistics.h"
+
+using namespace Cpu;
+
+namespace
+{
+    struct SignalInfo
+    {
+        const char* name;
+        FrameTarget target;
+        SVGFSignalType signalType;
+        const char* scope;      // RaysRenderer's pass
+    };
+
+    const SignalInfo kSignals[] =
+    {
+        { "shadow", FrameTarget::Shadow, SVGFSignalType::Scalar, "UpsampleShadows" },
+        { "reflection", FrameTarget::Reflection, SVGFSignalType::Color, "UpsampleReflection" },
+        { "ao", FrameTarget::AO, SVGFSignalType::Scalar, "UpsampleAO" },
+    };
+
+    const uint32_t kSignalCount = sizeof(kSignals) / sizeof(kSignals[0]);
+
+    struct RayScaleInfo
+    {
+        const char* name;
+        RayScale scale;
+    };
+
+    const RayScaleInfo kRayScales[] =
+    {
+        { "full", RayScale::Full },
+        { "half", RayScale::Half },
+        { "checkerboard", RayScale::Checkerboard },
+        { "quarter", RayScale::Quarter },
+    };
+
+    const RayScaleInfo* FindRayScale(const std::string& name)
+    {
+        for (const RayScaleInfo& info : kRayScales)
+        {
+            if (name == info.name) return &info;
+        }
+        return nullptr;
+    }
+
+    // The three compact SVGF filters as RaysRenderer runs them
+    class DenoiseChain
+    {
+    public:
+        DenoiseChain(uint32_t width, uint32_t height, ThreadPool& threadPool)
+            : mHistory(width, height, &threadPool)
+        {
+            for (uint32_t s = 0; s < kSignalCount; ++s)
+            {
+                mFilters[s].reset(new SVGFPass(width, height, mHistory, kSignals[s].signalType, &threadPool));
+            }
+        }
+
+        void Execute(const Image4F* const signals[kSignalCount], const FrameData& frame)
+        {
+            const Image4F& motionVec = frame.Get(FrameTarget::MotionVector);
+            const Image4F& linearZ = frame.Get(FrameTarget::SVGF_LinearZ);
+
+            mHistory.Update(motionVec, linearZ);
+            for (uint32_t s = 0; s < kSignalCount; ++s)
+            {
+                mFilters[s]->Execute(*signals[s], motionVec, linearZ, frame.Get(FrameTarget::SVGF_CompactNormDepth));
+            }
+            mHistory.EndFrame(linearZ);
+        }
+
+        const Image4F& GetOutput(uint32_t signal) const { return mFilters[signal]->GetOutput(); }
+
+    private:
+        SVGFSharedHistory mHistory;
+        std::unique_ptr<SVGFPass> mFilters[kSignalCount];
+    };
+
+    // Sum of squared rgb differences, accumulated over frames
+    struct ErrorAccumulator
+    {
+        double sumSquared = 0.0;
+        double count = 0.0;
+
+        void Add(const Image4F& a, const Image4F& b)
+        {
+            for (size_t i = 0; i < a.GetPixelCount(); ++i)
+            {
+                const float3 d = a.GetData()[i].rgb() - b.GetData()[i].rgb();
+                sumSquared += double(d.x) * d.x + double(d.y) * d.y + double(d.z) * d.z;
+            }
+            count += double(a.GetPixelCount()) * 3.0;
+        }
+
+        double GetRmse() const { return count > 0.0 ? std::sqrt(sumSquared / count) : 0.0; }
+    };
+
+    struct ScaleRun
+    {
+        const RayScaleInfo* info;
+        std::unique_ptr<DenoiseChain> denoiser;
+        std::unique_ptr<RayUpsamplePass> upsamplers[kSignalCount];
+        Image4F traced[kSignalCount];
+        std::vector<double> upsampleMs;
+        ErrorAccumulator upsampledError[kSignalCount];
+        ErrorAccumulator denoisedError[kSignalCount];
+    };
+}
+
+int RunUpsampleBench(const CommandLine& args)
+{
+    const std::string sequence = args.GetString("sequence", "");
+    const uint32_t frameCount = std::max(1u, args.GetUint("frames", 60));
+    const uint32_t warmupCount = args.GetUint("warmup", 5);
+    const std::vector<Resolution> resolutions = args.GetResolutions("resolutions", "1280x720,1920x1080");
+    const std::vector<std::string> scaleNames = args.GetStringList("scales", "full,half,checkerboard,quarter");
+    const std::string outputPath = args.GetString("output", "");
+
+    ThreadPool threadPool(args.GetUint("threads", 0));
+    FrameSource source(sequence, threadPool);
+    if (!source.IsValid())
+    {
+        fprintf(stderr, "No frames found in '%s'\n", sequence.c_str());
+        return 1;
+    }
+
+    std::vector<const RayScaleInfo*> scales;
+    for (const std::string& name : scaleNames)
+    {
+        const RayScaleInfo* info = FindRayScale(name);
+        if (!info)
+        {
+            fprintf(stderr, "Unknown ray scale '%s'\n", name.c_str());
+            return 1;
+        }
+        scales.push_back(info);
+    }
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("benchmark", "upsample");
+    json.Field("source", source.GetName());
+    json.Field("threads", threadPool.GetThreadCount());
+    json.Field("frames", frameCount);
+    json.Field("warmup", warmupCount);
+    json.Key("runs").BeginArray();
+
+    // Tracing at full resolution has to reproduce the reference exactly
+    uint32_t failedRuns = 0;
+
+    FrameData frame;
+    for (const Resolution& resolution : resolutions)
+    {
+        fprintf(stderr, "upsample %ux%u\n", resolution.width, resolution.height);
+
+        // Every scale sees the same frames, the reference is the same chain fed with the full-res signals
+        DenoiseChain reference(resolution.width, resolution.height, threadPool);
+        std::vector<std::unique_ptr<ScaleRun>> runs;
+        for (const RayScaleInfo* info : scales)
+        {
+            std::unique_ptr<ScaleRun> run(new ScaleRun());
+            run->info = info;
+            run->denoiser.reset(new DenoiseChain(resolution.width, resolution.height, threadPool));
+            for (auto& upsampler : run->upsamplers) upsampler.reset(new RayUpsamplePass(resolution.width, resolution.height, &threadPool));
+            runs.push_back(std::move(run));
+        }
+
+        for (uint32_t i = 0; i < warmupCount + frameCount; ++i)
+        {
+            FrameProfiler::MarkFrame();
+            if (!source.GetFrame(i, resolution.width, resolution.height, frame))
+            {
+                fprintf(stderr, "Failed to load frame %u\n", i);
+                return 1;
+            }
+
+            const Image4F* fullSignals[kSignalCount];
+            for (uint32_t s = 0; s < kSignalCount; ++s)
+            {
+                if (!frame.HasTarget(kSignals[s].target))
+                {
+                    fprintf(stderr, "Frame %u has no %s target\n", i, GetFrameTargetName(kSignals[s].target));
+                    return 1;
+                }
+                fullSignals[s] = &frame.Get(kSignals[s].target);
+            }
+            reference.Execute(fullSignals, frame);
+
+            for (auto& run : runs)
+            {
+                FRAME_PROFILE(run->info->name);
+                const Image4F* upsampled[kSignalCount];
+                double upsampleMs = 0.0;
+                for (uint32_t s = 0; s < kSignalCount; ++s)
+                {
+                    DecimateSignal(*fullSignals[s], run->info->scale, i, run->traced[s]);
+                    FRAME_PROFILE(kSignals[s].scope);
+                    upsampled[s] = &run->upsamplers[s]->Execute(run->traced[s], frame.Get(FrameTarget::SVGF_CompactNormDepth), run->info->scale, i);
+                    upsampleMs += run->upsamplers[s]->GetElapsedMs();
+                }
+                run->denoiser->Execute(upsampled, frame);
+
+                if (i < warmupCount) continue;
+                run->upsampleMs.push_back(upsampleMs);
+                for (uint32_t s = 0; s < kSignalCount; ++s)
+                {
+                    run->upsampledError[s].Add(*upsampled[s], *fullSignals[s]);
+                    run->denoisedError[s].Add(run->denoiser->GetOutput(s), reference.GetOutput(s));
+                }
+            }
+        }
+
+        const uint64_t fullRays = uint64_t(resolution.width) * resolution.height * kSignalCount;
+        for (const auto& run : runs)
+        {
+            const int2 tracedSize = GetTracedSize(run->info->scale, resolution.width, resolution.height);
+            const uint64_t rays = uint64_t(tracedSize.x) * tracedSize.y * kSignalCount;
+
+            json.BeginObject();
+            json.Field("scale", run->info->name);
+            json.Field("width", resolution.width);
+            json.Field("height", resolution.height);
+            json.Field("tracedWidth", tracedSize.x);
+            json.Field("tracedHeight", tracedSize.y);
+            json.Field("raysPerFrame", rays);
+            json.Field("rayFraction", double(rays) / double(fullRays));
+            WriteStats(json, "upsampleMs", ComputeStats(run->upsampleMs));
+
+            double maxDenoisedRmse = 0.0;
+            json.Key("signals").BeginArray();
+            for (uint32_t s = 0; s < kSignalCount; ++s)
+            {
+                maxDenoisedRmse = std::max(maxDenoisedRmse, run->denoisedError[s].GetRmse());
+
+                json.BeginObject();
+                json.Field("name", kSignals[s].name);
+                json.Field("upsampledRmse", run->upsampledError[s].GetRmse());
+                json.Field("denoisedRmse", run->denoisedError[s].GetRmse());
+                json.EndObject();
+            }
+            json.EndArray();
+            json.EndObject();
+
+            if (run->info->scale == RayScale::Full && maxDenoisedRmse > 0.0)
+            {
+                fprintf(stderr, "upsample full %ux%u differs from the reference (rmse %g)\n", resolution.width, resolution.height, maxDenoisedRmse);
+                failedRuns++;
+            }
+        }
+    }
+
+    json.EndArray();
+    json.Field("peakResidentBytes", uint64_t(GetPeakResidentBytes()));
+    json.Field("failedRuns", failedRuns);
+    json.EndObject();
+
+    const std::string report = json.GetString() + "\n";
+    if (outputPath.empty())
+    {
+        fputs(report.c_str(), stdout);
+    }
+    else if (!WriteTextFile(outputPath, report))
+    {
+        fprintf(stderr, "Failed to write '%s'\n", outputPath.c_str());
+        return 1;
+    }
+
+    return failedRuns > 0 ? 2 : 0;
+}
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cmath>
+#include "AdaptiveSampling.h"
+#include "SVGF.h"
+#include "SVGFSharedHistory.h"
+#include "Timer.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        // Work list tiles, the thread group size of AdaptiveSampling.slang
+        const uint32_t kTileSize = 16;
+
+        // Rounds the ray counts and spreads the refresh of pixels that need no rays over the interval
+        const uint32_t kBayer4x4[16] = { 0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5 };
+
+        // SVGF keeps the moments of luminance(float3(v, 0, 0)) for scalar signals
+        const float kScalarLuminance = 0.2126f;
+    }
+
+    AdaptiveSampler::AdaptiveSampler(ThreadPool* threadPool)
+        : mThreadPool(threadPool ? threadPool : &ThreadPool::GetDefault())
+    {
+    }
+
+    void AdaptiveSampler::Update(const SVGFSharedHistory& history, const SVGFPass& filter, const Image4F& motionVec, const Image4F& linearZ, uint32_t frameCount)
+    {
+        Timer timer;
+
+        const uint32_t width = motionVec.GetWidth();
+        const uint32_t height = motionVec.GetHeight();
+        const uint32_t tilesX = (width + kTileSize - 1) / kTileSize;
+        const uint32_t tilesY = (height + kTileSize - 1) / kTileSize;
+
+        std::swap(mRayCounts, mPrevRayCounts);
+        if (mPrevRayCounts.GetWidth() != width || mPrevRayCounts.GetHeight() != height) mPrevRayCounts.Resize(width, height);
+        mRayCounts.Resize(width, height);
+        mTileOffsets.assign(size_t(tilesX) * tilesY + 1, 0);
+
+        const uint32_t maxRays = std::min(mSettings.maxRaysPerPixel, kMaxRaysPerPixel);
+        const bool useHistory = filter.HasValidHistory() && filter.GetSettings().enableTemporalReprojection;
+        // Frames in the exponential moving average of the reprojection once the history is long enough
+        const float alpha = filter.GetSettings().alpha;
+        const float maxEffectiveFrames = alpha > 0.0f ? (2.0f - alpha) / alpha : 1e30f;
+        const float targetStdDev = mSettings.targetStdDev * (filter.GetSignalType() == SVGFSignalType::Scalar ? kScalarLuminance : 1.0f);
+        const float targetVariance = std::max(1e-12f, targetStdDev * targetStdDev);
+        const uint32_t refreshInterval = std::max(1u, mSettings.refreshInterval);
+
+        auto getRayCount = [&](uint32_t x, uint32_t y)
+        {
+            const int2 ipos = int2(int(x), int(y));
+
+            // Nothing rasterized, the ray generation shaders skip it anyway
+            if (linearZ.At(ipos).x <= 0.0f) return 0u;
+            if (!useHistory || history.GetHistoryLength(ipos) < float(mSettings.minHistoryLength)) return maxRays;
+
+            const float2 motion = motionVec.At(ipos).xy();
+            const int2 iposPrev = int2(int(float(x) + motion.x * float(width) + 0.5f), int(float(y) + motion.y * float(height) + 0.5f));
+
+            // The moments were accumulated from averages of the rays traced last time, which hides part of the variance
+            // of a single ray
+            const float prevRays = float(std::max<uint8_t>(1, mPrevRayCounts.Load(iposPrev)));
+            const float variance = std::max(0.0f, filter.GetLastFilteredVariance(iposPrev)) * prevRays;
+            const float frames = std::min(history.GetHistoryLength(ipos), maxEffectiveFrames);
+
+            const uint32_t dither = kBayer4x4[(y & 3) * 4 + (x & 3)];
+            const float threshold = float((dither + frameCount * 7) & 15) / 16.0f + 1.0f / 32.0f;
+            const uint32_t rays = uint32_t(std::min(float(maxRays), std::floor(variance / (frames * targetVariance) + threshold)));
+            if (rays == 0 && (dither + frameCount) % refreshInterval == 0) return 1u;
+            return rays;
+        };
+
+        mThreadPool->ParallelForTiles(width, height, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            uint32_t tilePixels = 0;
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    const uint32_t rays = getRayCount(x, y);
+                    mRayCounts.At(int(x), int(y)) = uint8_t(rays);
+                    tilePixels += rays > 0 ? 1 : 0;
+                }
+            }
+            mTileOffsets[(tile.y0 / kTileSize) * tilesX + tile.x0 / kTileSize + 1] = tilePixels;
+        });
+
+        for (size_t i = 1; i < mTileOffsets.size(); ++i) mTileOffsets[i] += mTileOffsets[i - 1];
+        mWorkList.resize(mTileOffsets.back());
+
+        std::vector<uint64_t> threadRays(mThreadPool->GetThreadCount(), 0);
+        mThreadPool->ParallelForTiles(width, height, kTileSize, [&](const TileRect& tile, uint32_t threadIndex)
+        {
+            uint32_t index = mTileOffsets[(tile.y0 / kTileSize) * tilesX + tile.x0 / kTileSize];
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    const uint32_t rays = mRayCounts.At(int(x), int(y));
+                    if (rays == 0) continue;
+                    mWorkList[index++] = x | (y << 14) | (rays << 28);
+                    threadRays[threadIndex] += rays;
+                }
+            }
+        });
+
+        mStats = AdaptiveSamplingStats();
+        for (uint64_t rays : threadRays) mStats.listedRays += rays;
+        mStats.activePixels = uint32_t(mWorkList.size());
+        mStats.elapsedMs = timer.GetElapsedMs();
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Image.h"
+#include "ThreadPool.h"
+
+namespace Cpu
+{
+    class SVGFPass;
+    class SVGFSharedHistory;
+
+    // Same knobs as ::AdaptiveSamplingPass, with the same defaults
+    struct AdaptiveSamplingSettings
+    {
+        uint32_t maxRaysPerPixel = 4;       // Up to AdaptiveSampler::kMaxRaysPerPixel
+        float targetStdDev = 0.02f;         // Standard deviation of the accumulated signal a pixel is sampled down to,
+                                            // of its luminance for color signals
+        uint32_t minHistoryLength = 4;      // Younger pixels get maxRaysPerPixel
+        uint32_t refreshInterval = 8;       // Pixels that need no rays still get one every this many frames
+    };
+
+    struct AdaptiveSamplingStats
+    {
+        uint64_t listedRays = 0;            // Sum of the ray counts in the work list
+        uint32_t activePixels = 0;          // Work list entries
+        double elapsedMs = 0.0;
+    };
+
+    // Headless implementation of ::AdaptiveSamplingPass. Picks 0 to maxRaysPerPixel rays for every pixel from what one
+    // SVGF filter knows about it: the variance at its feedback tap, reprojected from last frame, and the shared history
+    // length. A pixel gets the rays that bring the standard deviation of its temporally accumulated mean down to the
+    // target, rounded up or down with an ordered dither so fractions still add up over the frames. Pixels with rays are
+    // compacted into a work list, 16x16 tiles in raster order and pixels in raster order within a tile, which
+    // RaytracedEffects::SetWorkList() traces instead of the launch grid. The filter gets the ray counts too, so pixels
+    // without rays keep their history.
+    class AdaptiveSampler
+    {
+    public:
+        static const uint32_t kMaxRaysPerPixel = 15;
+
+        explicit AdaptiveSampler(ThreadPool* threadPool = nullptr);
+
+        // After the shared history was updated and before tracing. A filter that has no valid history, or does not
+        // reproject, gets maxRaysPerPixel everywhere.
+        void Update(const SVGFSharedHistory& history, const SVGFPass& filter, const Image4F& motionVec, const Image4F& linearZ, uint32_t frameCount);
+
+        // Work list entries are x | y << 14 | rays << 28
+        static int2 GetWorkListPixel(uint32_t entry) { return int2(int(entry & 0x3FFFu), int((entry >> 14) & 0x3FFFu)); }
+        static uint32_t GetWorkListRayCount(uint32_t entry) { return entry >> 28; }
+
+        AdaptiveSamplingSettings& GetSettings() { return mSettings; }
+        const AdaptiveSamplingSettings& GetSettings() const { return mSettings; }
+        const Image<uint8_t>& GetRayCounts() const { return mRayCounts; }
+        const std::vector<uint32_t>& GetWorkList() const { return mWorkList; }
+        const AdaptiveSamplingStats& GetStats() const { return mStats; }
+
+    private:
+        ThreadPool* mThreadPool;
+        AdaptiveSamplingSettings mSettings;
+        AdaptiveSamplingStats mStats;
+
+        Image<uint8_t> mRayCounts;
+        Image<uint8_t> mPrevRayCounts;
+        std::vector<uint32_t> mTileOffsets;
+        std::vector<uint32_t> mWorkList;
+    };
+}
@@ -0,0 +1,248 @@
+#include <algorithm>
+#include "AsyncSceneLoader.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        const char* const kStageNames[kSceneLoadStageCount] = { "hash sources", "open cache", "parse", "expand", "build BVH", "write cache" };
+
+        uint32_t GetLoaderThreadCount(uint32_t threadCount)
+        {
+            if (threadCount > 0) return threadCount;
+            const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+            return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+    }
+
+    const char* GetSceneLoadStageName(SceneLoadStage stage)
+    {
+        return stage < SceneLoadStage::Count ? kStageNames[uint32_t(stage)] : "done";
+    }
+
+    std::unique_ptr<LoadedScene> LoadScene(const SceneLoadRequest& request, ThreadPool* pool, SceneLoadStatus* status)
+    {
+        std::unique_ptr<LoadedScene> result(new LoadedScene());
+        Timer totalTimer;
+        Timer stageTimer;
+        SceneLoadStage currentStage = SceneLoadStage::HashSources;
+
+        auto beginStage = [&](SceneLoadStage stage, uint32_t itemCount)
+        {
+            currentStage = stage;
+            if (status)
+            {
+                status->itemsTotal = 0;
+                status->itemsDone = 0;
+                status->itemsTotal = itemCount;
+                status->stage = uint32_t(stage);
+            }
+            stageTimer.Reset();
+        };
+        // False when the load was cancelled meanwhile
+        auto endStage = [&]()
+        {
+            result->stageMs[uint32_t(currentStage)] += stageTimer.GetElapsedMs();
+            return !status || !status->cancel;
+        };
+        std::atomic<uint32_t>* itemsDone = status ? &status->itemsDone : nullptr;
+
+        const bool useCache = !request.cachePath.empty();
+        uint64_t sourceHash = 0;
+        if (useCache)
+        {
+            beginStage(SceneLoadStage::HashSources, uint32_t(request.sourceFiles.size()));
+            sourceHash = HashFiles(request.sourceFiles, pool, itemsDone);
+            if (!endStage()) return nullptr;
+        }
+
+        if (request.data)
+        {
+            result->data = request.data;
+        }
+        else if (useCache)
+        {
+            beginStage(SceneLoadStage::OpenCache, 0);
+            std::shared_ptr<SceneCache> cache = std::make_shared<SceneCache>();
+            result->cacheStatus = cache->Open(request.cachePath, sourceHash);
+            if (result->cacheStatus == SceneCache::Status::Ok)
+            {
+                result->cache = cache;
+                result->fromCache = true;
+            }
+            if (!endStage()) return nullptr;
+        }
+
+        if (!result->fromCache && !result->data)
+        {
+            if (!request.parse)
+            {
+                result->needsParse = true;
+                result->totalMs = totalTimer.GetElapsedMs();
+                return result;
+            }
+
+            beginStage(SceneLoadStage::Parse, 0);
+            std::shared_ptr<SceneData> parsed = std::make_shared<SceneData>();
+            const bool parsedOk = request.parse(*parsed);
+            if (!endStage()) return nullptr;
+            if (!parsedOk)
+            {
+                result->totalMs = totalTimer.GetElapsedMs();
+                return result;
+            }
+            result->data = parsed;
+        }
+        result->view = result->fromCache ? result->cache->GetView() : result->data->GetView();
+
+        beginStage(SceneLoadStage::Expand, result->view.instances.count);
+        BuildTriangleScene(result->view, result->triangles, pool, itemsDone);
+        if (!endStage()) return nullptr;
+
+        beginStage(SceneLoadStage::BuildBvh, 0);
+        if (!result->fromCache || !result->cache->AttachBvh(result->bvh)) result->bvh.Build(result->triangles, BvhBuildSettings(), pool);
+        if (!endStage()) return nullptr;
+
+        if (!result->fromCache && useCache && request.writeCache)
+        {
+            // Reopened so the result reads the mapping like a warm load does and the parsed copy can go
+            beginStage(SceneLoadStage::WriteCache, 0);
+            std::shared_ptr<SceneCache> cache = std::make_shared<SceneCache>();
+            if (WriteSceneCache(request.cachePath, result->view, &result->bvh, sourceHash) && cache->Open(request.cachePath, sourceHash) == SceneCache::Status::Ok)
+            {
+                Bvh mappedBvh;
+                if (cache->AttachBvh(mappedBvh))
+                {
+                    result->bvh = std::move(mappedBvh);
+                    result->view = cache->GetView();
+                    result->cache = cache;
+                    result->data.reset();
+                }
+                result->cacheWritten = true;
+            }
+            if (!endStage()) return nullptr;
+        }
+
+        result->succeeded = true;
+        result->totalMs = totalTimer.GetElapsedMs();
+        return result;
+    }
+
+    AsyncSceneLoader::AsyncSceneLoader(uint32_t threadCount)
+        : mPool(GetLoaderThreadCount(threadCount))
+        , mThread(&AsyncSceneLoader::WorkerLoop, this)
+    {
+    }
+
+    AsyncSceneLoader::~AsyncSceneLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mShutdown = true;
+            mStatus.cancel = true;
+        }
+        mWakeCondition.notify_all();
+        mThread.join();
+    }
+
+    uint64_t AsyncSceneLoader::Start(SceneLoadRequest request)
+    {
+        uint64_t requestId = 0;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPendingRequest = std::move(request);
+            mHasPendingRequest = true;
+            mPendingRequestId = mNextRequestId++;
+            requestId = mPendingRequestId;
+            mResult.reset();
+            mStatus.cancel = true;
+            if (!mRunning)
+            {
+                // A running load still reports its own stage until it sees the cancel
+                mStatus.stage = 0;
+                mStatus.itemsTotal = 0;
+                mStatus.itemsDone = 0;
+            }
+            mLoadTimer.Reset();
+        }
+        mWakeCondition.notify_all();
+        return requestId;
+    }
+
+    void AsyncSceneLoader::Cancel()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mHasPendingRequest = false;
+        mPendingRequest = SceneLoadRequest();
+        mStatus.cancel = true;
+    }
+
+    bool AsyncSceneLoader::IsBusy() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mRunning || mHasPendingRequest;
+    }
+
+    SceneLoadProgress AsyncSceneLoader::GetProgress() const
+    {
+        SceneLoadProgress progress;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            progress.busy = mRunning || mHasPendingRequest;
+            progress.elapsedMs = mLoadTimer.GetElapsedMs();
+        }
+        if (!progress.busy) return progress;
+
+        // Read without the lock, the counters can be one item apart but never past each other's stage
+        progress.stage = SceneLoadStage(std::min(mStatus.stage.load(), kSceneLoadStageCount - 1));
+        const uint32_t total = mStatus.itemsTotal;
+        const uint32_t done = mStatus.itemsDone;
+        progress.stageFraction = total > 0 ? std::min(1.0f, float(done) / float(total)) : 0.0f;
+        return progress;
+    }
+
+    std::unique_ptr<LoadedScene> AsyncSceneLoader::TakeResult()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return std::move(mResult);
+    }
+
+    void AsyncSceneLoader::Wait()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mIdleCondition.wait(lock, [this] { return !mRunning && !mHasPendingRequest; });
+    }
+
+    void AsyncSceneLoader::WorkerLoop()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true)
+        {
+            mWakeCondition.wait(lock, [this] { return mShutdown || mHasPendingRequest; });
+            if (mShutdown) return;
+
+            const SceneLoadRequest request = std::move(mPendingRequest);
+            const uint64_t requestId = mPendingRequestId;
+            mPendingRequest = SceneLoadRequest();
+            mHasPendingRequest = false;
+            mRunning = true;
+            mStatus.cancel = false;
+            mStatus.stage = 0;
+            mStatus.itemsTotal = 0;
+            mStatus.itemsDone = 0;
+            lock.unlock();
+
+            std::unique_ptr<LoadedScene> result = LoadScene(request, &mPool, &mStatus);
+
+            lock.lock();
+            mRunning = false;
+            // A request that came in meanwhile replaces this one, even if it finished first
+            if (result && !mHasPendingRequest)
+            {
+                result->requestId = requestId;
+                mResult = std::move(result);
+            }
+            mIdleCondition.notify_all();
+        }
+    }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Bvh.h"
+#include "SceneCache.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+#include "TriangleScene.h"
+
+namespace Cpu
+{
+    enum class SceneLoadStage : uint32_t
+    {
+        HashSources = 0,
+        OpenCache,
+        Parse,
+        Expand,         // Instances into the world space TriangleScene
+        BuildBvh,       // Or attach the cached one
+        WriteCache,
+        Count
+    };
+
+    const uint32_t kSceneLoadStageCount = uint32_t(SceneLoadStage::Count);
+
+    const char* GetSceneLoadStageName(SceneLoadStage stage);
+
+    struct SceneLoadRequest
+    {
+        std::vector<std::string> sourceFiles;       // Hashed to key the cache
+        std::string cachePath;                      // Empty to neither read nor write a cache
+
+        // Fills the scene when the cache cannot be used. Runs on the loading thread, returns false on failure. Without
+        // a parser a load that misses the cache finishes early with needsParse set.
+        std::function<bool(SceneData& data)> parse;
+
+        // An already parsed scene, e.g. read back from the GPU. Skips the cache lookup and the parse.
+        std::shared_ptr<const SceneData> data;
+
+        bool writeCache = true;
+    };
+
+    // The CPU side of a loaded scene. view points into cache when the scene came from it or was written to it, into
+    // data otherwise; bvh may traverse the mapping, so the three are kept together.
+    struct LoadedScene
+    {
+        uint64_t requestId = 0;
+        bool succeeded = false;
+        bool needsParse = false;
+        bool fromCache = false;
+        bool cacheWritten = false;
+        SceneCache::Status cacheStatus = SceneCache::Status::Missing;     // Of the lookup
+
+        std::shared_ptr<SceneCache> cache;
+        std::shared_ptr<const SceneData> data;
+        SceneView view;
+        TriangleScene triangles;
+        Bvh bvh;
+
+        double stageMs[kSceneLoadStageCount] = {};
+        double totalMs = 0.0;
+    };
+
+    // Counters a load updates as it goes, readable from any thread. Items are files while hashing and instances while
+    // expanding; other stages do not count and leave itemsTotal at 0.
+    struct SceneLoadStatus
+    {
+        std::atomic<uint32_t> stage{ 0 };
+        std::atomic<uint32_t> itemsDone{ 0 };
+        std::atomic<uint32_t> itemsTotal{ 0 };
+        std::atomic<bool> cancel{ false };
+    };
+
+    // Loads on the calling thread, parallel parts on the pool. Returns null when cancelled through status.
+    std::unique_ptr<LoadedScene> LoadScene(const SceneLoadRequest& request, ThreadPool* pool = nullptr, SceneLoadStatus* status = nullptr);
+
+    struct SceneLoadProgress
+    {
+        bool busy = false;
+        SceneLoadStage stage = SceneLoadStage::HashSources;
+        float stageFraction = 0.0f;     // 0 for stages that do not count their work
+        double elapsedMs = 0.0;
+    };
+
+    // Runs LoadScene() on a thread of its own so the render loop keeps going, with a pool separate from
+    // ThreadPool::GetDefault() since a pool cannot take ParallelFor() calls from two threads. One load at a time: Start()
+    // while busy cancels the running load at its next stage boundary and only the latest request produces a result.
+    // The owner polls TakeResult() once per frame and swaps the scene in when one is there.
+    class AsyncSceneLoader
+    {
+    public:
+        // threadCount == 0 leaves one hardware thread for the render loop
+        explicit AsyncSceneLoader(uint32_t threadCount = 0);
+        ~AsyncSceneLoader();
+
+        AsyncSceneLoader(const AsyncSceneLoader&) = delete;
+        AsyncSceneLoader& operator=(const AsyncSceneLoader&) = delete;
+
+        // Returns the id the result will carry. Drops a result not taken yet.
+        uint64_t Start(SceneLoadRequest request);
+        void Cancel();
+
+        bool IsBusy() const;
+        SceneLoadProgress GetProgress() const;
+
+        // The finished load, or null. Never waits for the loading thread.
+        std::unique_ptr<LoadedScene> TakeResult();
+        // Blocks until the loader is idle, for loads that have to finish before the first frame
+        void Wait();
+
+    private:
+        void WorkerLoop();
+
+        ThreadPool mPool;
+        SceneLoadStatus mStatus;
+
+        mutable std::mutex mMutex;
+        std::condition_variable mWakeCondition;
+        std::condition_variable mIdleCondition;
+        SceneLoadRequest mPendingRequest;
+        bool mHasPendingRequest = false;
+        bool mRunning = false;
+        bool mShutdown = false;
+        uint64_t mNextRequestId = 1;
+        uint64_t mPendingRequestId = 0;
+        Timer mLoadTimer;
+        std::unique_ptr<LoadedScene> mResult;
+
+        std::thread mThread;            // Last, so it starts after everything it uses
+    };
+}
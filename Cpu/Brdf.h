@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Sampling.h"
+
+// CPU mirror of the BRDF terms the ray tracing shaders import from Falcor's BRDF.slang
+namespace Cpu
+{
+    // GGX NDF without the 1/pi, same as evalGGX()
+    inline float EvalGGX(float roughness, float NdotH)
+    {
+        const float a2 = roughness * roughness;
+        const float d = ((NdotH * a2 - NdotH) * NdotH + 1.0f);
+        return a2 / (d * d);
+    }
+
+    // Height correlated Smith G including the 1 / (4 * NdotL * NdotV), same as evalSmithGGX()
+    inline float EvalSmithGGX(float NdotL, float NdotV, float roughness)
+    {
+        const float a2 = roughness * roughness;
+        const float ggxv = NdotL * std::sqrt((-NdotV * a2 + NdotV) * NdotV + a2);
+        const float ggxl = NdotV * std::sqrt((-NdotL * a2 + NdotL) * NdotL + a2);
+        return 0.5f / (ggxv + ggxl);
+    }
+
+    inline float3 FresnelSchlick(const float3& f0, const float3& f90, float u)
+    {
+        const float m = 1.0f - u;
+        return f0 + (f90 - f0) * (m * m * m * m * m);
+    }
+}
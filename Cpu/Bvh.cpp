@@ -0,0 +1,988 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "Bvh.h"
+#include "Simd.h"
+#include "Timer.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        // Past this depth the build splits at the median, which bounds the depth and with it the traversal stack
+        const uint32_t kMaxSahDepth = 40;
+        const uint32_t kTraversalStackSize = 256;
+        // Ranges at least this large compute bounds and bins in parallel chunks, smaller ones are not worth waking the pool for
+        const uint32_t kParallelRangeSize = 1 << 16;
+        const uint32_t kParallelChunkSize = 1 << 14;
+        // Below the top levels the tree is built as independent subtree tasks, several per thread so they balance
+        const uint32_t kSubtreesPerThread = 8;
+        const uint32_t kMinSubtreeSize = 1 << 12;
+        const uint32_t kMortonBitsPerAxis = 10;
+
+        struct Bounds
+        {
+            float3 min = float3(std::numeric_limits<float>::max());
+            float3 max = float3(-std::numeric_limits<float>::max());
+
+            void Grow(const float3& p) { min = Cpu::min(min, p); max = Cpu::max(max, p); }
+            void Grow(const Bounds& b) { min = Cpu::min(min, b.min); max = Cpu::max(max, b.max); }
+
+            float GetHalfArea() const
+            {
+                if (min.x > max.x) return 0.0f;
+                const float3 e = max - min;
+                return e.x * e.y + e.y * e.z + e.z * e.x;
+            }
+        };
+
+        uint32_t GetBlockCount(uint32_t triangles) { return (triangles + 3) / 4; }
+
+        // Spreads the low 10 bits so two zero bits follow each
+        uint32_t SpreadBits(uint32_t v)
+        {
+            v = (v | (v << 16)) & 0x030000FFu;
+            v = (v | (v << 8)) & 0x0300F00Fu;
+            v = (v | (v << 4)) & 0x030C30C3u;
+            v = (v | (v << 2)) & 0x09249249u;
+            return v;
+        }
+
+        // Stable LSD radix sort of the 30 bit codes, carrying the primitives along
+        void SortByCode(std::vector<uint32_t>& codes, std::vector<uint32_t>& primitives)
+        {
+            std::vector<uint32_t> codesTemp(codes.size()), primitivesTemp(primitives.size());
+            for (uint32_t shift = 0; shift < kMortonBitsPerAxis * 3; shift += 8)
+            {
+                uint32_t offsets[256] = {};
+                for (uint32_t code : codes) offsets[(code >> shift) & 0xFF]++;
+                uint32_t sum = 0;
+                for (uint32_t& offset : offsets)
+                {
+                    const uint32_t count = offset;
+                    offset = sum;
+                    sum += count;
+                }
+                for (size_t i = 0; i < codes.size(); ++i)
+                {
+                    const uint32_t slot = offsets[(codes[i] >> shift) & 0xFF]++;
+                    codesTemp[slot] = codes[i];
+                    primitivesTemp[slot] = primitives[i];
+                }
+                codes.swap(codesTemp);
+                primitives.swap(primitivesTemp);
+            }
+        }
+
+        const float kNoHit = std::numeric_limits<float>::max();
+        // 1 + 2 gamma(3), the error bound of a slab distance (b - o) / d computed as (b - o) * (1 / d)
+        const float kBoxTFarScale = 1.0000004f;
+
+        // One ray splatted across the four lanes, what the box and triangle tests need of it
+        struct RaySimd
+        {
+            SimdFloat ox, oy, oz;
+            SimdFloat idx, idy, idz;
+            SimdFloat tMin;
+            // Watertight triangle test: kz is the dominant axis of the direction, the shear maps the ray onto +z
+            uint32_t kx, ky, kz;
+            SimdFloat sx, sy, sz;
+
+            RaySimd() = default;
+            explicit RaySimd(const Ray& ray)
+            {
+                auto safeInverse = [](float d) { return 1.0f / (std::fabs(d) > 1e-20f ? d : std::copysign(1e-20f, d)); };
+                ox = ray.origin.x; oy = ray.origin.y; oz = ray.origin.z;
+                idx = safeInverse(ray.direction.x); idy = safeInverse(ray.direction.y); idz = safeInverse(ray.direction.z);
+                tMin = ray.tMin;
+
+                const float d[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+                kz = std::fabs(d[0]) > std::fabs(d[1]) ? (std::fabs(d[0]) > std::fabs(d[2]) ? 0 : 2) : (std::fabs(d[1]) > std::fabs(d[2]) ? 1 : 2);
+                kx = (kz + 1) % 3;
+                ky = (kx + 1) % 3;
+                // Keeps the winding, so the sign of the determinant still tells front from back
+                if (d[kz] < 0.0f) std::swap(kx, ky);
+                sx = d[kx] / d[kz];
+                sy = d[ky] / d[kz];
+                sz = 1.0f / d[kz];
+            }
+        };
+
+        // The four child boxes against one ray, a bit per box hit in (tMin, tHit). The slab distances are rounded at most
+        // twice, and tFar is widened by that bound (Ize 2013) so a hit on a face or edge of the box is never culled.
+        template<typename NodeType>
+        int IntersectBoxes(const NodeType& node, const RaySimd& r, float tHit, float* tNearLanes)
+        {
+            const SimdFloat x0 = (SimdFloat::Load(node.minX) - r.ox) * r.idx, x1 = (SimdFloat::Load(node.maxX) - r.ox) * r.idx;
+            const SimdFloat y0 = (SimdFloat::Load(node.minY) - r.oy) * r.idy, y1 = (SimdFloat::Load(node.maxY) - r.oy) * r.idy;
+            const SimdFloat z0 = (SimdFloat::Load(node.minZ) - r.oz) * r.idz, z1 = (SimdFloat::Load(node.maxZ) - r.oz) * r.idz;
+            const SimdFloat tNear = Max(Max(Min(x0, x1), Min(y0, y1)), Max(Min(z0, z1), r.tMin));
+            const SimdFloat tFar = Min(Min(Min(Max(x0, x1), Max(y0, y1)), Max(z0, z1)) * SimdFloat(kBoxTFarScale), SimdFloat(tHit));
+            tNear.Store(tNearLanes);
+            return (tNear <= tFar).GetBits();
+        }
+
+        // A leaf block loaded once, tested against any number of rays
+        struct BlockSimd
+        {
+            SimdFloat v0[3], v1[3], v2[3];
+
+            template<typename BlockType>
+            explicit BlockSimd(const BlockType& block)
+                : v0{ SimdFloat::Load(block.v0x), SimdFloat::Load(block.v0y), SimdFloat::Load(block.v0z) }
+                , v1{ SimdFloat::Load(block.v1x), SimdFloat::Load(block.v1y), SimdFloat::Load(block.v1z) }
+                , v2{ SimdFloat::Load(block.v2x), SimdFloat::Load(block.v2y), SimdFloat::Load(block.v2z) }
+            {
+            }
+
+            // Watertight test (Woop et al. 2013) on four triangles at once, a bit per triangle hit in (tMin, tHit). The
+            // vertices are moved into the ray's sheared space, where the ray is the +z axis, and the edge functions are
+            // evaluated there. A shared edge gives its two triangles edge functions of opposite sign bit for bit, so a
+            // ray through it hits at least one of them. Points on an edge count as inside, degenerate triangles miss.
+            int Intersect(const RaySimd& r, float tHit, SimdFloat& t, SimdFloat& u, SimdFloat& v) const
+            {
+                const SimdFloat o[3] = { r.ox, r.oy, r.oz };
+                const SimdFloat az = v0[r.kz] - o[r.kz], bz = v1[r.kz] - o[r.kz], cz = v2[r.kz] - o[r.kz];
+                const SimdFloat ax = (v0[r.kx] - o[r.kx]) - r.sx * az, ay = (v0[r.ky] - o[r.ky]) - r.sy * az;
+                const SimdFloat bx = (v1[r.kx] - o[r.kx]) - r.sx * bz, by = (v1[r.ky] - o[r.ky]) - r.sy * bz;
+                const SimdFloat cx = (v2[r.kx] - o[r.kx]) - r.sx * cz, cy = (v2[r.ky] - o[r.ky]) - r.sy * cz;
+
+                const SimdFloat e0 = cx * by - cy * bx;
+                const SimdFloat e1 = ax * cy - ay * cx;
+                const SimdFloat e2 = bx * ay - by * ax;
+                const SimdFloat zero(0.0f);
+                const SimdMask inside = ((e0 >= zero) & (e1 >= zero) & (e2 >= zero)) | ((e0 <= zero) & (e1 <= zero) & (e2 <= zero));
+
+                const SimdFloat det = e0 + e1 + e2;
+                const SimdFloat invDet = SimdFloat(1.0f) / det;
+                t = (e0 * az + e1 * bz + e2 * cz) * r.sz * invDet;
+                u = e1 * invDet;
+                v = e2 * invDet;
+
+                const SimdMask mask = AndNot(inside, det == zero) & (t > r.tMin) & (t < SimdFloat(tHit));
+                return mask.GetBits();
+            }
+        };
+
+        template<typename BlockType>
+        void SetBlockTriangle(BlockType& block, uint32_t lane, const TriangleScene& scene, uint32_t triangle)
+        {
+            const float3 v0 = scene.GetVertex(triangle, 0);
+            const float3 v1 = scene.GetVertex(triangle, 1);
+            const float3 v2 = scene.GetVertex(triangle, 2);
+            block.v0x[lane] = v0.x; block.v0y[lane] = v0.y; block.v0z[lane] = v0.z;
+            block.v1x[lane] = v1.x; block.v1y[lane] = v1.y; block.v1z[lane] = v1.z;
+            block.v2x[lane] = v2.x; block.v2y[lane] = v2.y; block.v2z[lane] = v2.z;
+            block.ids[lane] = triangle;
+        }
+
+        void SetChildBounds(float* minX, float* minY, float* minZ, float* maxX, float* maxY, float* maxZ, uint32_t i, const Bounds& b)
+        {
+            minX[i] = b.min.x; minY[i] = b.min.y; minZ[i] = b.min.z;
+            maxX[i] = b.max.x; maxY[i] = b.max.y; maxZ[i] = b.max.z;
+        }
+    }
+
+    struct Bvh::BuildNode
+    {
+        Bounds bounds;
+        uint32_t left = 0;
+        uint32_t right = 0;
+        uint32_t first = 0;
+        uint32_t count = 0;     // Non-zero for leaves
+    };
+
+    // A range left for later by the top levels. Its nodes are built into a vector of their own and spliced in at node.
+    struct Bvh::SubtreeTask
+    {
+        uint32_t node = 0;
+        uint32_t begin = 0;
+        uint32_t end = 0;
+        uint32_t depth = 0;
+        uint32_t maxDepth = 0;
+        std::vector<BuildNode> nodes;
+    };
+
+    struct Bvh::BuildContext
+    {
+        const TriangleScene* scene;
+        BvhBuildSettings settings;
+        ThreadPool* pool = nullptr;
+        std::vector<Bounds> primitiveBounds;
+        std::vector<float3> centroids;
+        std::vector<uint32_t> primitives;
+        std::vector<uint32_t> mortonCodes;      // Sorted along with primitives, Morton builder only
+        std::vector<BuildNode> nodes;
+        std::vector<SubtreeTask> subtrees;
+        uint32_t subtreeSize = 0;               // Ranges up to this size become subtree tasks, 0 builds everything in place
+
+        // Chunks [begin, end) is split into for fn(chunk, first, last). Parallel only for large ranges of the top levels,
+        // the subtree tasks already run on the pool.
+        uint32_t GetChunkCount(uint32_t begin, uint32_t end, bool parallel) const
+        {
+            return (parallel && pool && end - begin >= kParallelRangeSize) ? (end - begin + kParallelChunkSize - 1) / kParallelChunkSize : 1;
+        }
+
+        template<typename Fn>
+        void ForEachChunk(uint32_t begin, uint32_t end, uint32_t chunkCount, const Fn& fn) const
+        {
+            if (chunkCount == 1)
+            {
+                fn(0u, begin, end);
+                return;
+            }
+            pool->ParallelFor(chunkCount, [&](uint32_t chunk, uint32_t)
+            {
+                const uint32_t first = begin + chunk * kParallelChunkSize;
+                fn(chunk, first, std::min(end, first + kParallelChunkSize));
+            });
+        }
+
+        void GetRangeBounds(uint32_t begin, uint32_t end, bool parallel, Bounds& bounds, Bounds& centroidBounds) const;
+        bool FindSahSplit(uint32_t begin, uint32_t end, bool parallel, const Bounds& centroidBounds, uint32_t& bestAxis, uint32_t& bestSplit, float& bestCost) const;
+        uint32_t FindMortonSplit(uint32_t begin, uint32_t end) const;
+        uint32_t BuildBinary(std::vector<BuildNode>& nodes, uint32_t begin, uint32_t end, uint32_t depth, uint32_t& maxDepth, bool topLevels);
+    };
+
+    void Bvh::BuildContext::GetRangeBounds(uint32_t begin, uint32_t end, bool parallel, Bounds& bounds, Bounds& centroidBounds) const
+    {
+        // Min and max do not depend on the order, so the chunks give the same boxes as one pass
+        const uint32_t chunkCount = GetChunkCount(begin, end, parallel);
+        std::vector<Bounds> chunkBounds(chunkCount * 2);
+        ForEachChunk(begin, end, chunkCount, [&](uint32_t chunk, uint32_t first, uint32_t last)
+        {
+            Bounds& b = chunkBounds[chunk * 2];
+            Bounds& c = chunkBounds[chunk * 2 + 1];
+            for (uint32_t i = first; i < last; ++i)
+            {
+                const uint32_t p = primitives[i];
+                b.Grow(primitiveBounds[p]);
+                c.Grow(centroids[p]);
+            }
+        });
+        for (uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+        {
+            bounds.Grow(chunkBounds[chunk * 2]);
+            centroidBounds.Grow(chunkBounds[chunk * 2 + 1]);
+        }
+    }
+
+    bool Bvh::BuildContext::FindSahSplit(uint32_t begin, uint32_t end, bool parallel, const Bounds& centroidBounds, uint32_t& bestAxis, uint32_t& bestSplit, float& bestCost) const
+    {
+        // Binned SAH over the centroids, all three axes binned in one pass. Costs count 4-wide triangle tests, not triangles.
+        const float3 extent = centroidBounds.max - centroidBounds.min;
+        const uint32_t binCount = settings.binCount;
+        float scale[3];
+        for (uint32_t axis = 0; axis < 3; ++axis) scale[axis] = extent[axis] > 0.0f ? float(binCount) * (1.0f - 1e-5f) / extent[axis] : 0.0f;
+
+        const uint32_t chunkCount = GetChunkCount(begin, end, parallel);
+        const uint32_t binsPerChunk = binCount * 3;
+        std::vector<Bounds> binBounds(chunkCount * binsPerChunk);
+        std::vector<uint32_t> binCounts(chunkCount * binsPerChunk);
+        ForEachChunk(begin, end, chunkCount, [&](uint32_t chunk, uint32_t first, uint32_t last)
+        {
+            Bounds* chunkBounds = &binBounds[chunk * binsPerChunk];
+            uint32_t* chunkCounts = &binCounts[chunk * binsPerChunk];
+            for (uint32_t i = first; i < last; ++i)
+            {
+                const uint32_t p = primitives[i];
+                for (uint32_t axis = 0; axis < 3; ++axis)
+                {
+                    if (scale[axis] == 0.0f) continue;
+                    const uint32_t bin = axis * binCount + std::min(binCount - 1, uint32_t((centroids[p][axis] - centroidBounds.min[axis]) * scale[axis]));
+                    chunkBounds[bin].Grow(primitiveBounds[p]);
+                    chunkCounts[bin]++;
+                }
+            }
+        });
+        for (uint32_t chunk = 1; chunk < chunkCount; ++chunk)
+        {
+            for (uint32_t bin = 0; bin < binsPerChunk; ++bin)
+            {
+                binBounds[bin].Grow(binBounds[chunk * binsPerChunk + bin]);
+                binCounts[bin] += binCounts[chunk * binsPerChunk + bin];
+            }
+        }
+
+        std::vector<float> rightArea(binCount);
+        std::vector<uint32_t> rightCount(binCount);
+        bestCost = std::numeric_limits<float>::max();
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            if (scale[axis] == 0.0f) continue;
+            const Bounds* axisBounds = &binBounds[axis * binCount];
+            const uint32_t* axisCounts = &binCounts[axis * binCount];
+
+            Bounds right;
+            uint32_t rightSum = 0;
+            for (uint32_t b = binCount - 1; b > 0; --b)
+            {
+                right.Grow(axisBounds[b]);
+                rightSum += axisCounts[b];
+                rightArea[b] = right.GetHalfArea();
+                rightCount[b] = rightSum;
+            }
+
+            Bounds left;
+            uint32_t leftSum = 0;
+            for (uint32_t b = 0; b + 1 < binCount; ++b)
+            {
+                left.Grow(axisBounds[b]);
+                leftSum += axisCounts[b];
+                if (leftSum == 0 || rightCount[b + 1] == 0) continue;
+
+                const float cost = left.GetHalfArea() * float(GetBlockCount(leftSum)) + rightArea[b + 1] * float(GetBlockCount(rightCount[b + 1]));
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b;
+                }
+            }
+        }
+        return bestCost < std::numeric_limits<float>::max();
+    }
+
+    uint32_t Bvh::BuildContext::FindMortonSplit(uint32_t begin, uint32_t end) const
+    {
+        // The codes are sorted, so the highest bit where the first and last differ splits the range in two runs
+        const uint32_t firstCode = mortonCodes[begin];
+        const uint32_t lastCode = mortonCodes[end - 1];
+        if (firstCode == lastCode) return begin + (end - begin) / 2;
+
+        uint32_t bit = 31;
+        while (!(((firstCode ^ lastCode) >> bit) & 1)) bit--;
+        const uint32_t prefix = lastCode >> bit;
+        return uint32_t(std::lower_bound(mortonCodes.begin() + begin, mortonCodes.begin() + end, prefix << bit) - mortonCodes.begin());
+    }
+
+    uint32_t Bvh::BuildContext::BuildBinary(std::vector<BuildNode>& nodes, uint32_t begin, uint32_t end, uint32_t depth, uint32_t& maxDepth, bool topLevels)
+    {
+        const uint32_t index = uint32_t(nodes.size());
+        nodes.emplace_back();
+        const uint32_t count = end - begin;
+
+        if (topLevels && count <= subtreeSize)
+        {
+            SubtreeTask task;
+            task.node = index;
+            task.begin = begin;
+            task.end = end;
+            task.depth = depth;
+            subtrees.push_back(std::move(task));
+            return index;
+        }
+        maxDepth = std::max(maxDepth, depth + 1);
+
+        Bounds bounds, centroidBounds;
+        GetRangeBounds(begin, end, topLevels, bounds, centroidBounds);
+        nodes[index].bounds = bounds;
+
+        auto makeLeaf = [&]()
+        {
+            nodes[index].first = begin;
+            nodes[index].count = count;
+            return index;
+        };
+
+        if (count == 1) return makeLeaf();
+
+        uint32_t mid = 0;
+        if (settings.builder == BvhBuilder::Morton)
+        {
+            if (count <= settings.maxLeafSize) return makeLeaf();
+            mid = FindMortonSplit(begin, end);
+        }
+        else
+        {
+            uint32_t bestAxis = 0;
+            uint32_t bestSplit = 0;
+            float bestCost = std::numeric_limits<float>::max();
+            const bool foundSplit = depth < kMaxSahDepth && FindSahSplit(begin, end, topLevels, centroidBounds, bestAxis, bestSplit, bestCost);
+
+            const float parentArea = bounds.GetHalfArea();
+            const float leafCost = float(GetBlockCount(count)) * settings.intersectionCost;
+            if (foundSplit && parentArea > 0.0f) bestCost = settings.traversalCost + bestCost / parentArea * settings.intersectionCost;
+
+            if (count <= settings.maxLeafSize && (!foundSplit || leafCost <= bestCost)) return makeLeaf();
+
+            const float3 extent = centroidBounds.max - centroidBounds.min;
+            uint32_t* first = primitives.data() + begin;
+            uint32_t* last = primitives.data() + end;
+            uint32_t* middle = first;
+            if (foundSplit)
+            {
+                const uint32_t binCount = settings.binCount;
+                const float scale = float(binCount) * (1.0f - 1e-5f) / extent[bestAxis];
+                const float axisMin = centroidBounds.min[bestAxis];
+                middle = std::partition(first, last, [&](uint32_t p)
+                {
+                    return std::min(binCount - 1, uint32_t((centroids[p][bestAxis] - axisMin) * scale)) <= bestSplit;
+                });
+            }
+
+            if (middle == first || middle == last)
+            {
+                // No usable SAH split, e.g. coincident centroids or too deep. Median on the widest axis.
+                const uint32_t axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+                middle = first + count / 2;
+                std::nth_element(first, middle, last, [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+            }
+            mid = begin + uint32_t(middle - first);
+        }
+
+        const uint32_t left = BuildBinary(nodes, begin, mid, depth + 1, maxDepth, topLevels);
+        const uint32_t right = BuildBinary(nodes, mid, end, depth + 1, maxDepth, topLevels);
+        nodes[index].left = left;
+        nodes[index].right = right;
+        return index;
+    }
+
+    void Bvh::Build(const TriangleScene& scene, const BvhBuildSettings& settings, ThreadPool* pool)
+    {
+        Timer timer;
+
+        mNodes.clear();
+        mTriangles.clear();
+        mDepth = 0;
+        UpdateDataPointers();
+
+        const uint32_t triangleCount = scene.GetTriangleCount();
+        if (triangleCount == 0)
+        {
+            mBuildMs = float(timer.GetElapsedMs());
+            return;
+        }
+
+        BuildContext context;
+        context.scene = &scene;
+        context.settings = settings;
+        context.settings.binCount = std::max(2u, settings.binCount);
+        context.settings.maxLeafSize = std::max(1u, settings.maxLeafSize);
+        context.pool = (pool && pool->GetThreadCount() > 1) ? pool : nullptr;
+        context.primitiveBounds.resize(triangleCount);
+        context.centroids.resize(triangleCount);
+        context.primitives.resize(triangleCount);
+        context.nodes.reserve(triangleCount * 2);
+
+        context.ForEachChunk(0, triangleCount, context.GetChunkCount(0, triangleCount, true), [&](uint32_t, uint32_t first, uint32_t last)
+        {
+            for (uint32_t i = first; i < last; ++i)
+            {
+                Bounds& b = context.primitiveBounds[i];
+                for (uint32_t c = 0; c < 3; ++c) b.Grow(scene.GetVertex(i, c));
+                context.centroids[i] = (b.min + b.max) * 0.5f;
+                context.primitives[i] = i;
+            }
+        });
+
+        if (settings.builder == BvhBuilder::Morton)
+        {
+            Bounds bounds, centroidBounds;
+            context.GetRangeBounds(0, triangleCount, true, bounds, centroidBounds);
+            const float3 extent = centroidBounds.max - centroidBounds.min;
+            const float cells = float((1 << kMortonBitsPerAxis) - 1);
+            float scale[3];
+            for (uint32_t axis = 0; axis < 3; ++axis) scale[axis] = extent[axis] > 0.0f ? cells / extent[axis] : 0.0f;
+
+            context.mortonCodes.resize(triangleCount);
+            context.ForEachChunk(0, triangleCount, context.GetChunkCount(0, triangleCount, true), [&](uint32_t, uint32_t first, uint32_t last)
+            {
+                for (uint32_t i = first; i < last; ++i)
+                {
+                    uint32_t code = 0;
+                    for (uint32_t axis = 0; axis < 3; ++axis)
+                    {
+                        const uint32_t cell = std::min(uint32_t(cells), uint32_t((context.centroids[i][axis] - centroidBounds.min[axis]) * scale[axis]));
+                        code |= SpreadBits(cell) << (2 - axis);
+                    }
+                    context.mortonCodes[i] = code;
+                }
+            });
+            SortByCode(context.mortonCodes, context.primitives);
+        }
+
+        // The top levels split ranges in place with parallel binning. Ranges small enough to balance as tasks are left
+        // for the pool, each building its own node vector, and spliced in afterwards. Every range is split exactly as it
+        // would be in one serial pass, so the tree does not depend on the thread count.
+        if (context.pool) context.subtreeSize = std::max(kMinSubtreeSize, triangleCount / (context.pool->GetThreadCount() * kSubtreesPerThread));
+        uint32_t depth = 0;
+        context.BuildBinary(context.nodes, 0, triangleCount, 0, depth, context.subtreeSize > 0);
+
+        if (!context.subtrees.empty())
+        {
+            // Largest first so a long task does not start last
+            std::vector<SubtreeTask>& tasks = context.subtrees;
+            std::sort(tasks.begin(), tasks.end(), [](const SubtreeTask& a, const SubtreeTask& b) { return a.end - a.begin > b.end - b.begin; });
+            context.pool->ParallelFor(uint32_t(tasks.size()), [&](uint32_t i, uint32_t)
+            {
+                SubtreeTask& task = tasks[i];
+                task.nodes.reserve((task.end - task.begin) * 2);
+                context.BuildBinary(task.nodes, task.begin, task.end, task.depth, task.maxDepth, false);
+            });
+
+            for (SubtreeTask& task : tasks)
+            {
+                // The task root replaces the placeholder, the rest is appended
+                const uint32_t base = uint32_t(context.nodes.size());
+                auto remap = [&](uint32_t local) { return local == 0 ? task.node : base + local - 1; };
+                for (uint32_t local = 0; local < task.nodes.size(); ++local)
+                {
+                    BuildNode node = task.nodes[local];
+                    if (node.count == 0)
+                    {
+                        node.left = remap(node.left);
+                        node.right = remap(node.right);
+                    }
+                    if (local == 0) context.nodes[task.node] = node;
+                    else context.nodes.push_back(node);
+                }
+                depth = std::max(depth, task.maxDepth);
+                std::vector<BuildNode>().swap(task.nodes);
+            }
+        }
+        mDepth = depth;
+
+        mNodes.reserve(context.nodes.size() / 2 + 1);
+        mTriangles.reserve(GetBlockCount(triangleCount) * 2);
+        if (context.nodes[0].count > 0)
+        {
+            // A single leaf still needs a root node to hang off
+            Node root = {};
+            uint32_t blockCount = 0;
+            root.children[0] = EmitLeaf(context, 0, blockCount);
+            root.childCounts[0] = blockCount;
+            SetChildBounds(root.minX, root.minY, root.minZ, root.maxX, root.maxY, root.maxZ, 0, context.nodes[0].bounds);
+            for (uint32_t i = 1; i < 4; ++i) root.children[i] = kEmptyChild;
+            mNodes.push_back(root);
+        }
+        else
+        {
+            Collapse(context, 0);
+        }
+
+        UpdateDataPointers();
+        mBuildMs = float(timer.GetElapsedMs());
+    }
+
+    bool Bvh::Refit(const TriangleScene& scene, ThreadPool* pool)
+    {
+        if (IsAttached()) return false;
+        Timer timer;
+
+        // Leaf blocks first, each on its own
+        const uint32_t blockCount = uint32_t(mTriangles.size());
+        auto refitBlocks = [&](uint32_t first, uint32_t last)
+        {
+            for (uint32_t b = first; b < last; ++b)
+            {
+                TriangleBlock& block = mTriangles[b];
+                for (uint32_t lane = 0; lane < 4; ++lane)
+                {
+                    if (block.ids[lane] != ~0u) SetBlockTriangle(block, lane, scene, block.ids[lane]);
+                }
+            }
+        };
+        if (pool && pool->GetThreadCount() > 1 && blockCount >= kParallelRangeSize)
+        {
+            pool->ParallelFor((blockCount + kParallelChunkSize - 1) / kParallelChunkSize, [&](uint32_t chunk, uint32_t)
+            {
+                const uint32_t first = chunk * kParallelChunkSize;
+                refitBlocks(first, std::min(blockCount, first + kParallelChunkSize));
+            });
+        }
+        else
+        {
+            refitBlocks(0, blockCount);
+        }
+
+        // Collapse() emits a node before the nodes below it, so walking backwards sees every child done before its parent.
+        // Leaf boxes come from the vertices like in Build(), so an unchanged scene refits to the same bits.
+        for (uint32_t n = uint32_t(mNodes.size()); n-- > 0;)
+        {
+            Node& node = mNodes[n];
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                if (node.children[i] == kEmptyChild) continue;
+
+                Bounds b;
+                if (node.children[i] & kLeafFlag)
+                {
+                    const uint32_t firstBlock = node.children[i] & ~kLeafFlag;
+                    for (uint32_t blockIndex = firstBlock; blockIndex < firstBlock + node.childCounts[i]; ++blockIndex)
+                    {
+                        for (uint32_t triangle : mTriangles[blockIndex].ids)
+                        {
+                            if (triangle == ~0u) continue;
+                            for (uint32_t c = 0; c < 3; ++c) b.Grow(scene.GetVertex(triangle, c));
+                        }
+                    }
+                }
+                else
+                {
+                    const Node& child = mNodes[node.children[i]];
+                    for (uint32_t j = 0; j < 4; ++j)
+                    {
+                        if (child.children[j] == kEmptyChild) continue;
+                        b.min = min(b.min, float3(child.minX[j], child.minY[j], child.minZ[j]));
+                        b.max = max(b.max, float3(child.maxX[j], child.maxY[j], child.maxZ[j]));
+                    }
+                }
+                SetChildBounds(node.minX, node.minY, node.minZ, node.maxX, node.maxY, node.maxZ, i, b);
+            }
+        }
+
+        mRefitMs = float(timer.GetElapsedMs());
+        return true;
+    }
+
+    float Bvh::GetSahCost(const BvhBuildSettings& settings) const
+    {
+        float3 rootMin, rootMax;
+        GetBounds(rootMin, rootMax);
+        Bounds root;
+        root.min = rootMin;
+        root.max = rootMax;
+        const float rootArea = root.GetHalfArea();
+        if (mNodeCount == 0 || rootArea <= 0.0f) return 0.0f;
+
+        // Every box a ray tests is reached with probability area / root area
+        float cost = settings.traversalCost;
+        for (uint32_t n = 0; n < mNodeCount; ++n)
+        {
+            const Node& node = mNodeData[n];
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                if (node.children[i] == kEmptyChild) continue;
+                Bounds b;
+                b.min = float3(node.minX[i], node.minY[i], node.minZ[i]);
+                b.max = float3(node.maxX[i], node.maxY[i], node.maxZ[i]);
+                const float probability = b.GetHalfArea() / rootArea;
+                cost += (node.children[i] & kLeafFlag) ? probability * float(node.childCounts[i]) * settings.intersectionCost : probability * settings.traversalCost;
+            }
+        }
+        return cost;
+    }
+
+    void Bvh::GetBounds(float3& boundsMin, float3& boundsMax) const
+    {
+        Bounds b;
+        if (mNodeCount > 0)
+        {
+            const Node& root = mNodeData[0];
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                if (root.children[i] == kEmptyChild) continue;
+                b.min = min(b.min, float3(root.minX[i], root.minY[i], root.minZ[i]));
+                b.max = max(b.max, float3(root.maxX[i], root.maxY[i], root.maxZ[i]));
+            }
+        }
+        boundsMin = b.min;
+        boundsMax = b.max;
+    }
+
+    bool Bvh::Attach(const void* nodes, uint32_t nodeCount, const void* leafBlocks, uint32_t leafBlockCount, uint32_t depth)
+    {
+        const bool aligned = (reinterpret_cast<uintptr_t>(nodes) % alignof(Node)) == 0 && (reinterpret_cast<uintptr_t>(leafBlocks) % alignof(TriangleBlock)) == 0;
+        if (!aligned || (nodeCount > 0 && (!nodes || !leafBlocks || leafBlockCount == 0))) return false;
+
+        mNodes.clear();
+        mNodes.shrink_to_fit();
+        mTriangles.clear();
+        mTriangles.shrink_to_fit();
+        mNodeData = static_cast<const Node*>(nodes);
+        mLeafData = static_cast<const TriangleBlock*>(leafBlocks);
+        mNodeCount = nodeCount;
+        mLeafBlockCount = leafBlockCount;
+        mDepth = depth;
+        mBuildMs = 0.0f;
+        return true;
+    }
+
+    void Bvh::UpdateDataPointers()
+    {
+        mNodeData = mNodes.data();
+        mLeafData = mTriangles.data();
+        mNodeCount = uint32_t(mNodes.size());
+        mLeafBlockCount = uint32_t(mTriangles.size());
+    }
+
+    uint32_t Bvh::Collapse(const BuildContext& context, uint32_t binaryIndex)
+    {
+        // Pull grandchildren up until there are four children, opening the largest inner child first
+        uint32_t children[4] = { context.nodes[binaryIndex].left, context.nodes[binaryIndex].right, 0, 0 };
+        uint32_t childCount = 2;
+        while (childCount < 4)
+        {
+            int best = -1;
+            float bestArea = -1.0f;
+            for (uint32_t i = 0; i < childCount; ++i)
+            {
+                const BuildNode& child = context.nodes[children[i]];
+                if (child.count == 0 && child.bounds.GetHalfArea() > bestArea)
+                {
+                    bestArea = child.bounds.GetHalfArea();
+                    best = int(i);
+                }
+            }
+            if (best < 0) break;
+
+            const BuildNode& opened = context.nodes[children[best]];
+            children[best] = opened.left;
+            children[childCount++] = opened.right;
+        }
+
+        const uint32_t nodeIndex = uint32_t(mNodes.size());
+        mNodes.emplace_back();
+
+        Node node = {};
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            if (i >= childCount)
+            {
+                node.children[i] = kEmptyChild;
+                continue;
+            }
+
+            const BuildNode& child = context.nodes[children[i]];
+            SetChildBounds(node.minX, node.minY, node.minZ, node.maxX, node.maxY, node.maxZ, i, child.bounds);
+            if (child.count > 0)
+            {
+                uint32_t blockCount = 0;
+                node.children[i] = EmitLeaf(context, children[i], blockCount);
+                node.childCounts[i] = blockCount;
+            }
+            else
+            {
+                node.children[i] = Collapse(context, children[i]);
+            }
+        }
+
+        // Assigned last, the recursion above may have reallocated mNodes
+        mNodes[nodeIndex] = node;
+        return nodeIndex;
+    }
+
+    uint32_t Bvh::EmitLeaf(const BuildContext& context, uint32_t binaryIndex, uint32_t& blockCount)
+    {
+        const BuildNode& leaf = context.nodes[binaryIndex];
+        const uint32_t firstBlock = uint32_t(mTriangles.size());
+        blockCount = GetBlockCount(leaf.count);
+
+        for (uint32_t b = 0; b < blockCount; ++b)
+        {
+            TriangleBlock block = {};
+            for (uint32_t lane = 0; lane < 4; ++lane)
+            {
+                const uint32_t i = b * 4 + lane;
+                if (i >= leaf.count)
+                {
+                    block.ids[lane] = ~0u;
+                    continue;
+                }
+
+                SetBlockTriangle(block, lane, *context.scene, context.primitives[leaf.first + i]);
+            }
+            mTriangles.push_back(block);
+        }
+
+        return kLeafFlag | firstBlock;
+    }
+
+    template<bool AnyHit>
+    bool Bvh::Traverse(const Ray& ray, RayHit* hit) const
+    {
+        if (mNodeCount == 0) return false;
+
+        struct StackEntry
+        {
+            uint32_t ref;
+            uint32_t count;
+            float tNear;
+        };
+
+        const RaySimd r(ray);
+        float tHit = ray.tMax;
+        bool found = false;
+
+        StackEntry stack[kTraversalStackSize];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = { 0, 0, ray.tMin };
+
+        while (stackSize > 0)
+        {
+            const StackEntry entry = stack[--stackSize];
+            if (entry.tNear > tHit) continue;
+
+            if (entry.ref & kLeafFlag)
+            {
+                const uint32_t firstBlock = entry.ref & ~kLeafFlag;
+                for (uint32_t b = 0; b < entry.count; ++b)
+                {
+                    const TriangleBlock& block = mLeafData[firstBlock + b];
+                    SimdFloat t, u, v;
+                    int bits = BlockSimd(block).Intersect(r, tHit, t, u, v);
+                    if (bits == 0) continue;
+                    if (AnyHit) return true;
+
+                    for (int lane = 0; bits != 0; ++lane, bits >>= 1)
+                    {
+                        if (!(bits & 1) || t[lane] >= tHit) continue;
+                        tHit = t[lane];
+                        hit->t = tHit;
+                        hit->triangle = block.ids[lane];
+                        hit->u = u[lane];
+                        hit->v = v[lane];
+                        found = true;
+                    }
+                }
+                continue;
+            }
+
+            const Node& node = mNodeData[entry.ref];
+            alignas(16) float tNearLanes[4];
+            int bits = IntersectBoxes(node, r, tHit, tNearLanes);
+
+            // Push far to near so the nearest child is popped first
+            StackEntry hitChildren[4];
+            uint32_t hitCount = 0;
+            for (uint32_t i = 0; bits != 0; ++i, bits >>= 1)
+            {
+                if (!(bits & 1) || node.children[i] == kEmptyChild) continue;
+                StackEntry child = { node.children[i], node.childCounts[i], tNearLanes[i] };
+                uint32_t j = hitCount++;
+                for (; j > 0 && hitChildren[j - 1].tNear < child.tNear; --j) hitChildren[j] = hitChildren[j - 1];
+                hitChildren[j] = child;
+            }
+            for (uint32_t i = 0; i < hitCount; ++i) stack[stackSize++] = hitChildren[i];
+        }
+
+        return found;
+    }
+
+    template<bool AnyHit>
+    uint32_t Bvh::TraversePacket(const Ray* rays, uint32_t count, RayHit* hits) const
+    {
+        count = std::min(count, kMaxPacketSize);
+        if (mNodeCount == 0 || count == 0) return 0;
+
+        // A child is visited with the rays whose box test passed; rays that already found a hit drop out for any-hit
+        struct StackEntry
+        {
+            uint32_t ref;
+            uint32_t count;
+            uint32_t rayMask;
+        };
+
+        RaySimd r[kMaxPacketSize];
+        float tHit[kMaxPacketSize];
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            r[i] = RaySimd(rays[i]);
+            tHit[i] = rays[i].tMax;
+        }
+        uint32_t active = (1u << count) - 1;
+        uint32_t found = 0;
+
+        StackEntry stack[kTraversalStackSize];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = { 0, 0, active };
+
+        while (stackSize > 0)
+        {
+            const StackEntry entry = stack[--stackSize];
+            const uint32_t rayMask = entry.rayMask & active;
+            if (rayMask == 0) continue;
+
+            if (entry.ref & kLeafFlag)
+            {
+                const uint32_t firstBlock = entry.ref & ~kLeafFlag;
+                for (uint32_t b = 0; b < entry.count; ++b)
+                {
+                    const TriangleBlock& block = mLeafData[firstBlock + b];
+                    const BlockSimd blockSimd(block);
+                    for (uint32_t pending = rayMask & active, i = 0; pending != 0; ++i, pending >>= 1)
+                    {
+                        if (!(pending & 1)) continue;
+                        SimdFloat t, u, v;
+                        int bits = blockSimd.Intersect(r[i], tHit[i], t, u, v);
+                        if (bits == 0) continue;
+                        if (AnyHit)
+                        {
+                            found |= 1u << i;
+                            active &= ~(1u << i);
+                            continue;
+                        }
+
+                        for (int lane = 0; bits != 0; ++lane, bits >>= 1)
+                        {
+                            if (!(bits & 1) || t[lane] >= tHit[i]) continue;
+                            tHit[i] = t[lane];
+                            hits[i].t = tHit[i];
+                            hits[i].triangle = block.ids[lane];
+                            hits[i].u = u[lane];
+                            hits[i].v = v[lane];
+                            found |= 1u << i;
+                        }
+                    }
+                }
+                if (AnyHit && active == 0) return found;
+                continue;
+            }
+
+            const Node& node = mNodeData[entry.ref];
+            uint32_t childMasks[4] = {};
+            float childNear[4] = { kNoHit, kNoHit, kNoHit, kNoHit };
+            for (uint32_t pending = rayMask, i = 0; pending != 0; ++i, pending >>= 1)
+            {
+                if (!(pending & 1)) continue;
+                alignas(16) float tNearLanes[4];
+                for (int bits = IntersectBoxes(node, r[i], tHit[i], tNearLanes), c = 0; bits != 0; ++c, bits >>= 1)
+                {
+                    if (!(bits & 1)) continue;
+                    childMasks[c] |= 1u << i;
+                    childNear[c] = std::min(childNear[c], tNearLanes[c]);
+                }
+            }
+
+            // Far to near by the nearest ray of each child
+            uint32_t order[4];
+            uint32_t hitCount = 0;
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                if (childMasks[c] == 0 || node.children[c] == kEmptyChild) continue;
+                uint32_t j = hitCount++;
+                for (; j > 0 && childNear[order[j - 1]] < childNear[c]; --j) order[j] = order[j - 1];
+                order[j] = c;
+            }
+            for (uint32_t i = 0; i < hitCount; ++i) stack[stackSize++] = { node.children[order[i]], node.childCounts[order[i]], childMasks[order[i]] };
+        }
+
+        return found;
+    }
+
+    bool Bvh::Intersect(const Ray& ray, RayHit& hit) const
+    {
+        return Traverse<false>(ray, &hit);
+    }
+
+    bool Bvh::Occluded(const Ray& ray) const
+    {
+        return Traverse<true>(ray, nullptr);
+    }
+
+    uint32_t Bvh::IntersectPacket(const Ray* rays, uint32_t count, RayHit* hits) const
+    {
+        return TraversePacket<false>(rays, count, hits);
+    }
+
+    uint32_t Bvh::OccludedPacket(const Ray* rays, uint32_t count) const
+    {
+        return TraversePacket<true>(rays, count, nullptr);
+    }
+
+    size_t Bvh::GetSizeInBytes() const
+    {
+        return size_t(mNodeCount) * sizeof(Node) + size_t(mLeafBlockCount) * sizeof(TriangleBlock);
+    }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "ThreadPool.h"
+#include "TriangleScene.h"
+
+namespace Cpu
+{
+    struct Ray
+    {
+        float3 origin;
+        float3 direction;
+        float tMin = 0.0f;
+        float tMax = 1e30f;
+    };
+
+    struct RayHit
+    {
+        float t = 0.0f;
+        uint32_t triangle = ~0u;
+        float u = 0.0f;     // Barycentrics of vertices 1 and 2, the same convention as BuiltInTriangleIntersectionAttributes
+        float v = 0.0f;
+    };
+
+    enum class BvhBuilder : uint32_t
+    {
+        BinnedSah = 0,      // Best traversal
+        Morton              // LBVH: triangles sorted along a Morton curve and split at the highest differing bit, builds far faster
+    };
+
+    struct BvhBuildSettings
+    {
+        BvhBuilder builder = BvhBuilder::BinnedSah;
+        uint32_t binCount = 16;
+        uint32_t maxLeafSize = 4;       // Triangles, a leaf of up to 4 is one SIMD test
+        float traversalCost = 1.0f;     // SAH costs relative to one 4-wide triangle test
+        float intersectionCost = 1.0f;
+    };
+
+    // 4-wide BVH over a TriangleScene. Built with a binned SAH or along a Morton curve into a binary tree which is then
+    // collapsed, so every inner node tests four child boxes and every leaf up to four triangles in one SIMD operation.
+    // Traversal is single ray by default: AO and glossy reflection rays in launch order diverge and packets would run
+    // mostly empty, while the wide node keeps all lanes busy for any ray. Packets are there for rays binned by RayBinning.
+    class Bvh
+    {
+    public:
+        Bvh() = default;
+        // Moves only, a copy would traverse the arrays of the original
+        Bvh(const Bvh&) = delete;
+        Bvh& operator=(const Bvh&) = delete;
+        Bvh(Bvh&&) = default;
+        Bvh& operator=(Bvh&&) = default;
+
+        // The scene has to outlive the Bvh only for RayHit::triangle to stay meaningful. With a pool the top levels bin in
+        // parallel and the subtrees below are built as tasks; the tree is the same as without one.
+        void Build(const TriangleScene& scene, const BvhBuildSettings& settings = BvhBuildSettings(), ThreadPool* pool = nullptr);
+
+        // Moves every box to the current positions of its triangles, keeping the tree: O(n) for meshes that deform without
+        // changing topology. Traversal gets slower the further the triangles move from where they were built. Fails on an
+        // attached Bvh.
+        bool Refit(const TriangleScene& scene, ThreadPool* pool = nullptr);
+
+        // Expected cost of a random ray: node tests and 4-wide triangle tests weighted by the area they cover
+        float GetSahCost(const BvhBuildSettings& settings = BvhBuildSettings()) const;
+        void GetBounds(float3& boundsMin, float3& boundsMax) const;
+
+        // Closest hit in (tMin, tMax)
+        bool Intersect(const Ray& ray, RayHit& hit) const;
+        // Any hit in (tMin, tMax), for shadow and AO rays
+        bool Occluded(const Ray& ray) const;
+
+        // Up to kMaxPacketSize rays traversed together: each node and leaf block is loaded once for all the rays that
+        // reach it, which pays off for coherent rays such as the bins of RayBinning. Hits are the same as one ray at a
+        // time, up to which of two triangles at the same distance is reported. Return a bit per ray that hit.
+        static const uint32_t kMaxPacketSize = 16;
+        uint32_t IntersectPacket(const Ray* rays, uint32_t count, RayHit* hits) const;
+        uint32_t OccludedPacket(const Ray* rays, uint32_t count) const;
+
+        // The node and leaf block arrays as they are in memory, which is the serialized form. Attach() traverses
+        // arrays owned by someone else, e.g. a mapped cache file, which have to stay alive and unchanged. Fails on
+        // sizes or alignment the arrays cannot have.
+        const void* GetNodeData() const { return mNodeData; }
+        const void* GetLeafData() const { return mLeafData; }
+        static size_t GetNodeSize() { return sizeof(Node); }
+        static size_t GetLeafBlockSize() { return sizeof(TriangleBlock); }
+        bool Attach(const void* nodes, uint32_t nodeCount, const void* leafBlocks, uint32_t leafBlockCount, uint32_t depth);
+
+        bool IsEmpty() const { return mNodeCount == 0; }
+        bool IsAttached() const { return mNodeCount > 0 && mNodes.empty(); }
+        uint32_t GetNodeCount() const { return mNodeCount; }
+        uint32_t GetLeafBlockCount() const { return mLeafBlockCount; }
+        uint32_t GetDepth() const { return mDepth; }
+        size_t GetSizeInBytes() const;
+        float GetBuildMs() const { return mBuildMs; }
+        float GetRefitMs() const { return mRefitMs; }
+
+    private:
+        static const uint32_t kLeafFlag = 0x80000000u;
+        static const uint32_t kEmptyChild = 0xFFFFFFFFu;
+
+        // Four child boxes in SoA layout. A child is an inner node index, or kLeafFlag | first triangle block
+        // with childCounts[i] blocks.
+        struct alignas(16) Node
+        {
+            float minX[4], minY[4], minZ[4];
+            float maxX[4], maxY[4], maxZ[4];
+            uint32_t children[4];
+            uint32_t childCounts[4];
+        };
+
+        // Four triangles in SoA layout. The vertices are kept as they are, not as edges, so that triangles sharing an
+        // edge see bit-identical vertices and the watertight test leaves no cracks. Unused lanes are all zero and never hit.
+        struct alignas(16) TriangleBlock
+        {
+            float v0x[4], v0y[4], v0z[4];
+            float v1x[4], v1y[4], v1z[4];
+            float v2x[4], v2y[4], v2z[4];
+            uint32_t ids[4];
+        };
+
+        struct BuildNode;
+        struct SubtreeTask;
+        struct BuildContext;
+
+        uint32_t Collapse(const BuildContext& context, uint32_t binaryIndex);
+        uint32_t EmitLeaf(const BuildContext& context, uint32_t binaryIndex, uint32_t& blockCount);
+        void UpdateDataPointers();
+
+        template<bool AnyHit>
+        bool Traverse(const Ray& ray, RayHit* hit) const;
+        template<bool AnyHit>
+        uint32_t TraversePacket(const Ray* rays, uint32_t count, RayHit* hits) const;
+
+        std::vector<Node> mNodes;
+        std::vector<TriangleBlock> mTriangles;
+        // What traversal reads, the vectors above after Build() or the arrays given to Attach()
+        const Node* mNodeData = nullptr;
+        const TriangleBlock* mLeafData = nullptr;
+        uint32_t mNodeCount = 0;
+        uint32_t mLeafBlockCount = 0;
+        uint32_t mDepth = 0;
+        float mBuildMs = 0.0f;
+        float mRefitMs = 0.0f;
+    };
+}
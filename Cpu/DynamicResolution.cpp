@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cmath>
+#include "DynamicResolution.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        // Downgrade order, from the least visible loss of rays to the most
+        const RayScale kRayScaleLadder[] = { RayScale::Full, RayScale::Checkerboard, RayScale::Half, RayScale::Quarter };
+        const uint32_t kRayScaleLadderSize = sizeof(kRayScaleLadder) / sizeof(kRayScaleLadder[0]);
+
+        uint32_t GetLadderIndex(RayScale scale)
+        {
+            for (uint32_t i = 0; i < kRayScaleLadderSize; ++i)
+            {
+                if (kRayScaleLadder[i] == scale) return i;
+            }
+            return 0;
+        }
+    }
+
+    bool DynamicResolutionState::operator==(const DynamicResolutionState& other) const
+    {
+        if (renderScale != other.renderScale) return false;
+        for (uint32_t i = 0; i < kDynamicEffectCount; ++i)
+        {
+            if (rayScales[i] != other.rayScales[i]) return false;
+        }
+        return true;
+    }
+
+    DynamicResolutionController::DynamicResolutionController(const DynamicResolutionSettings& settings)
+        : mSettings(settings)
+    {
+        Reset();
+    }
+
+    float DynamicResolutionController::GetRayFraction(RayScale scale)
+    {
+        const int2 factor = GetRayScaleFactor(scale);
+        return 1.0f / float(factor.x * factor.y);
+    }
+
+    void DynamicResolutionController::Reset()
+    {
+        mState = DynamicResolutionState();
+        mAverage = DynamicResolutionTimings();
+        mDowngrades.clear();
+        mRenderScaleLevel = 0;
+        mFramesSinceChange = 0;
+        mFramesOverBudget = 0;
+        mChangeCount = 0;
+        UpdateRenderScale();
+    }
+
+    bool DynamicResolutionController::Update(const DynamicResolutionTimings& timings)
+    {
+        // The averages restart after every change, so that they only see frames rendered with the current state
+        mFramesSinceChange++;
+        if (mFramesSinceChange == 1)
+        {
+            mAverage = timings;
+        }
+        else
+        {
+            const float w = mSettings.smoothing;
+            mAverage.frameMs += (timings.frameMs - mAverage.frameMs) * w;
+            for (uint32_t i = 0; i < kDynamicEffectCount; ++i)
+            {
+                mAverage.traceMs[i] += (timings.traceMs[i] - mAverage.traceMs[i]) * w;
+                mAverage.denoiseMs[i] += (timings.denoiseMs[i] - mAverage.denoiseMs[i]) * w;
+            }
+        }
+
+        mFramesOverBudget = (timings.frameMs > mSettings.targetFrameMs) ? mFramesOverBudget + 1 : 0;
+
+        if (mFramesSinceChange < mSettings.settleFrames) return false;
+
+        if (mAverage.frameMs > mSettings.targetFrameMs && mFramesOverBudget >= mSettings.overBudgetFrames)
+        {
+            return TryDowngrade();
+        }
+        return TryUpgrade();
+    }
+
+    bool DynamicResolutionController::TryDowngrade()
+    {
+        const uint32_t minLadderIndex = GetLadderIndex(mSettings.minRayScale);
+
+        // The effect where one step down the ladder saves the most
+        uint32_t bestEffect = kDynamicEffectCount;
+        float bestSaving = 0.0f;
+        for (uint32_t i = 0; i < kDynamicEffectCount; ++i)
+        {
+            const uint32_t index = GetLadderIndex(mState.rayScales[i]);
+            if (index >= minLadderIndex || mAverage.traceMs[i] <= 0.0f) continue;
+
+            const float fraction = GetRayFraction(kRayScaleLadder[index + 1]) / GetRayFraction(kRayScaleLadder[index]);
+            const float saving = mAverage.traceMs[i] * (1.0f - fraction);
+            if (saving > bestSaving)
+            {
+                bestSaving = saving;
+                bestEffect = i;
+            }
+        }
+
+        const float currentScale = mState.renderScale;
+        const bool canLowerResolution = currentScale > mSettings.minRenderScale;
+        // Fewer rays leave the denoisers' cost as is, a lower resolution cuts it too. When the denoisers dominate, the
+        // render scale step is the better deal even though rays would save minRaySaving.
+        const bool raysSaveEnough = bestSaving >= mSettings.minRaySaving * mAverage.frameMs &&
+            (!canLowerResolution || bestSaving >= PredictRenderScaleSaving());
+
+        Downgrade downgrade;
+        if (bestEffect < kDynamicEffectCount && (raysSaveEnough || !canLowerResolution))
+        {
+            downgrade.type = ChangeType::RayScale;
+            downgrade.effect = bestEffect;
+            downgrade.previousRayScale = mState.rayScales[bestEffect];
+            mState.rayScales[bestEffect] = kRayScaleLadder[GetLadderIndex(downgrade.previousRayScale) + 1];
+        }
+        else if (canLowerResolution)
+        {
+            downgrade.type = ChangeType::RenderScale;
+            downgrade.effect = 0;
+            downgrade.previousRayScale = RayScale::Full;
+            mRenderScaleLevel++;
+            UpdateRenderScale();
+        }
+        else
+        {
+            return false;
+        }
+
+        mDowngrades.push_back(downgrade);
+        ChangeApplied();
+        return true;
+    }
+
+    // Predicted from the current averages rather than from what the downgrade saved, since the load may have
+    // changed since. A render scale upgrade scales the whole frame, which overestimates and errs on the stable side.
+    float DynamicResolutionController::PredictUpgradeCost(const Downgrade& downgrade) const
+    {
+        if (downgrade.type == ChangeType::RayScale)
+        {
+            const float ratio = GetRayFraction(downgrade.previousRayScale) / GetRayFraction(mState.rayScales[downgrade.effect]);
+            return mAverage.traceMs[downgrade.effect] * (ratio - 1.0f);
+        }
+
+        const float previousScale = std::max(mSettings.minRenderScale, mSettings.maxRenderScale - float(mRenderScaleLevel - 1) * mSettings.renderScaleStep);
+        const float ratio = previousScale / mState.renderScale;
+        return mAverage.frameMs * (ratio * ratio - 1.0f);
+    }
+
+    // Lower bound from the measured passes that scale with the pixel count. The rasterization scales as well but has
+    // no timing of its own.
+    float DynamicResolutionController::PredictRenderScaleSaving() const
+    {
+        const float nextScale = std::max(mSettings.minRenderScale, mSettings.maxRenderScale - float(mRenderScaleLevel + 1) * mSettings.renderScaleStep);
+        const float ratio = nextScale / mState.renderScale;
+
+        float scaledMs = 0.0f;
+        for (uint32_t i = 0; i < kDynamicEffectCount; ++i) scaledMs += mAverage.traceMs[i] + mAverage.denoiseMs[i];
+        return scaledMs * (1.0f - ratio * ratio);
+    }
+
+    bool DynamicResolutionController::TryUpgrade()
+    {
+        if (mDowngrades.empty()) return false;
+
+        const Downgrade& last = mDowngrades.back();
+        const float predictedMs = mAverage.frameMs + PredictUpgradeCost(last);
+        if (mFramesOverBudget > 0 || predictedMs >= mSettings.targetFrameMs * (1.0f - mSettings.upgradeHeadroom)) return false;
+
+        if (last.type == ChangeType::RayScale)
+        {
+            mState.rayScales[last.effect] = last.previousRayScale;
+        }
+        else
+        {
+            mRenderScaleLevel--;
+            UpdateRenderScale();
+        }
+
+        mDowngrades.pop_back();
+        ChangeApplied();
+        return true;
+    }
+
+    void DynamicResolutionController::UpdateRenderScale()
+    {
+        mState.renderScale = std::max(mSettings.minRenderScale, mSettings.maxRenderScale - float(mRenderScaleLevel) * mSettings.renderScaleStep);
+    }
+
+    void DynamicResolutionController::ChangeApplied()
+    {
+        mFramesSinceChange = 0;
+        mFramesOverBudget = 0;
+        mChangeCount++;
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "RayScale.h"
+
+namespace Cpu
+{
+    enum class DynamicEffect : uint32_t
+    {
+        Shadows = 0,
+        Reflection,
+        AO,
+        Count
+    };
+
+    const uint32_t kDynamicEffectCount = uint32_t(DynamicEffect::Count);
+
+    struct DynamicResolutionSettings
+    {
+        float targetFrameMs = 16.6f;
+        float upgradeHeadroom = 0.1f;       // An upgrade has to leave the predicted frame this fraction below target
+        float smoothing = 0.1f;             // Weight of the newest frame in the moving averages
+        uint32_t settleFrames = 30;         // Frames to wait after a change before measuring it and deciding again
+        uint32_t overBudgetFrames = 5;      // Consecutive frames over target before downgrading
+        float minRenderScale = 0.5f;
+        float maxRenderScale = 1.0f;
+        float renderScaleStep = 0.1f;
+        RayScale minRayScale = RayScale::Quarter;
+        float minRaySaving = 0.05f;         // Fewer rays are preferred over a lower resolution when saving this fraction of the frame
+    };
+
+    // GPU time of one frame. Only the tracing scales with the ray count, upsampling and denoising do not. Tracing and
+    // denoising both scale with the render resolution.
+    struct DynamicResolutionTimings
+    {
+        float frameMs = 0.0f;
+        float traceMs[kDynamicEffectCount] = {};    // Zero when the effect is disabled
+        float denoiseMs[kDynamicEffectCount] = {};  // Zero when the effect is disabled or not filtered
+    };
+
+    struct DynamicResolutionState
+    {
+        float renderScale = 1.0f;
+        RayScale rayScales[kDynamicEffectCount] = { RayScale::Full, RayScale::Full, RayScale::Full };
+
+        bool operator==(const DynamicResolutionState& other) const;
+        bool operator!=(const DynamicResolutionState& other) const { return !(*this == other); }
+    };
+
+    // Holds a frame time budget by lowering the internal render resolution and the ray counts of the traced
+    // effects. Over budget, the cheapest step is taken first: fewer rays for the most expensive effect when that
+    // saves enough, and at least what the next render scale would save of the tracing and denoising, otherwise a
+    // lower render scale. Downgrades are undone in reverse order, and only once the
+    // predicted cost of undoing one fits below the target with headroom. That gap between the downgrade and
+    // upgrade thresholds keeps the controller from oscillating between two levels.
+    // Has no API dependencies, RaysRenderer feeds it the PROFILE timings.
+    class DynamicResolutionController
+    {
+    public:
+        explicit DynamicResolutionController(const DynamicResolutionSettings& settings = DynamicResolutionSettings());
+
+        // Call once per frame. True when GetState() changed.
+        bool Update(const DynamicResolutionTimings& timings);
+
+        // Back to full quality, e.g. after a scene load or when the controller gets enabled
+        void Reset();
+
+        DynamicResolutionSettings& GetSettings() { return mSettings; }
+        const DynamicResolutionState& GetState() const { return mState; }
+        float GetAverageFrameMs() const { return mAverage.frameMs; }
+        uint32_t GetDowngradeCount() const { return uint32_t(mDowngrades.size()); }
+        uint64_t GetChangeCount() const { return mChangeCount; }
+
+        static float GetRayFraction(RayScale scale);
+
+    private:
+        enum class ChangeType : uint32_t
+        {
+            RenderScale = 0,
+            RayScale
+        };
+
+        struct Downgrade
+        {
+            ChangeType type;
+            uint32_t effect;
+            RayScale previousRayScale;
+        };
+
+        bool TryDowngrade();
+        bool TryUpgrade();
+        float PredictUpgradeCost(const Downgrade& downgrade) const;
+        float PredictRenderScaleSaving() const;
+        void UpdateRenderScale();
+        void ChangeApplied();
+
+        DynamicResolutionSettings mSettings;
+        DynamicResolutionState mState;
+        DynamicResolutionTimings mAverage;
+        std::vector<Downgrade> mDowngrades;
+        uint32_t mRenderScaleLevel = 0;
+        uint32_t mFramesSinceChange = 0;
+        uint32_t mFramesOverBudget = 0;
+        uint64_t mChangeCount = 0;
+    };
+}
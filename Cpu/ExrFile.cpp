@@ -0,0 +1,248 @@
+#include "ExrFile.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+// Layout from "The OpenEXR File Layout": magic and version, a header of (name, type, size, value) attributes ended by
+// an empty name, a table with the file offset of every line, then per line its y, byte count and the line of every
+// channel in channel order. Everything is little endian, as are the machines this runs on.
+namespace Cpu
+{
+    namespace
+    {
+        const uint32_t kMagic = 20000630;
+        const uint32_t kVersion = 2;
+        const uint32_t kUnsupportedFlags = 0x1A00;  // Tiled, deep and multi-part files
+        const int32_t kPixelTypeHalf = 1;
+        const int32_t kPixelTypeFloat = 2;
+        const uint8_t kNoCompression = 0;
+
+        struct FileCloser
+        {
+            void operator()(FILE* file) const { if (file) fclose(file); }
+        };
+
+        template<typename T>
+        void Append(std::vector<uint8_t>& bytes, const T& value)
+        {
+            const uint8_t* data = reinterpret_cast<const uint8_t*>(&value);
+            bytes.insert(bytes.end(), data, data + sizeof(T));
+        }
+
+        void AppendString(std::vector<uint8_t>& bytes, const char* text)
+        {
+            bytes.insert(bytes.end(), text, text + std::strlen(text) + 1);
+        }
+
+        void AppendAttribute(std::vector<uint8_t>& bytes, const char* name, const char* type, const std::vector<uint8_t>& value)
+        {
+            AppendString(bytes, name);
+            AppendString(bytes, type);
+            Append(bytes, int32_t(value.size()));
+            bytes.insert(bytes.end(), value.begin(), value.end());
+        }
+
+        std::vector<uint8_t> GetBox(int32_t xMax, int32_t yMax)
+        {
+            std::vector<uint8_t> box;
+            Append(box, int32_t(0));
+            Append(box, int32_t(0));
+            Append(box, xMax);
+            Append(box, yMax);
+            return box;
+        }
+
+        // Bounds checked reads from a whole file
+        class Reader
+        {
+        public:
+            Reader(const std::vector<uint8_t>& bytes, size_t offset) : mBytes(bytes), mOffset(offset) {}
+
+            template<typename T>
+            bool Read(T& value)
+            {
+                if (mOffset + sizeof(T) > mBytes.size()) return false;
+                std::memcpy(&value, mBytes.data() + mOffset, sizeof(T));
+                mOffset += sizeof(T);
+                return true;
+            }
+
+            bool ReadString(std::string& text)
+            {
+                if (mOffset >= mBytes.size() || !std::memchr(mBytes.data() + mOffset, 0, mBytes.size() - mOffset)) return false;
+                text.assign(reinterpret_cast<const char*>(mBytes.data() + mOffset));
+                mOffset += text.size() + 1;
+                return true;
+            }
+
+            bool Skip(size_t size)
+            {
+                if (mOffset + size > mBytes.size()) return false;
+                mOffset += size;
+                return true;
+            }
+
+            size_t GetOffset() const { return mOffset; }
+
+        private:
+            const std::vector<uint8_t>& mBytes;
+            size_t mOffset;
+        };
+
+        struct Channel
+        {
+            std::string name;
+            int32_t pixelType = 0;
+        };
+    }
+
+    bool WriteExr(const std::string& path, const Image4F& image)
+    {
+        const uint32_t width = image.GetWidth();
+        const uint32_t height = image.GetHeight();
+        if (width == 0 || height == 0) return false;
+
+        std::vector<uint8_t> bytes;
+        Append(bytes, kMagic);
+        Append(bytes, kVersion);
+
+        // Channels in alphabetical order, as the format requires
+        std::vector<uint8_t> channels;
+        for (const char* name : { "B", "G", "R" })
+        {
+            AppendString(channels, name);
+            Append(channels, kPixelTypeFloat);
+            Append(channels, uint32_t(0));  // pLinear and reserved
+            Append(channels, int32_t(1));   // xSampling
+            Append(channels, int32_t(1));   // ySampling
+        }
+        channels.push_back(0);
+        AppendAttribute(bytes, "channels", "chlist", channels);
+        AppendAttribute(bytes, "compression", "compression", { kNoCompression });
+        AppendAttribute(bytes, "dataWindow", "box2i", GetBox(int32_t(width) - 1, int32_t(height) - 1));
+        AppendAttribute(bytes, "displayWindow", "box2i", GetBox(int32_t(width) - 1, int32_t(height) - 1));
+        AppendAttribute(bytes, "lineOrder", "lineOrder", { 0 });   // Increasing y
+        std::vector<uint8_t> one, center;
+        Append(one, 1.0f);
+        Append(center, 0.0f);
+        Append(center, 0.0f);
+        AppendAttribute(bytes, "pixelAspectRatio", "float", one);
+        AppendAttribute(bytes, "screenWindowCenter", "v2f", center);
+        AppendAttribute(bytes, "screenWindowWidth", "float", one);
+        bytes.push_back(0);
+
+        const uint32_t lineBytes = width * 3 * sizeof(float);
+        const uint64_t firstLine = bytes.size() + uint64_t(height) * sizeof(uint64_t);
+        for (uint32_t y = 0; y < height; ++y) Append(bytes, firstLine + uint64_t(y) * (8 + lineBytes));
+
+        bytes.reserve(bytes.size() + size_t(height) * (8 + lineBytes));
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            Append(bytes, int32_t(y));
+            Append(bytes, lineBytes);
+            const float4* row = image.GetRow(int(y));
+            for (uint32_t x = 0; x < width; ++x) Append(bytes, row[x].z);
+            for (uint32_t x = 0; x < width; ++x) Append(bytes, row[x].y);
+            for (uint32_t x = 0; x < width; ++x) Append(bytes, row[x].x);
+        }
+
+        std::unique_ptr<FILE, FileCloser> file(fopen(path.c_str(), "wb"));
+        return file && fwrite(bytes.data(), 1, bytes.size(), file.get()) == bytes.size();
+    }
+
+    bool ReadExr(const std::string& path, Image4F& image)
+    {
+        std::vector<uint8_t> bytes;
+        {
+            std::unique_ptr<FILE, FileCloser> file(fopen(path.c_str(), "rb"));
+            if (!file) return false;
+            uint8_t buffer[65536];
+            size_t size;
+            while ((size = fread(buffer, 1, sizeof(buffer), file.get())) > 0) bytes.insert(bytes.end(), buffer, buffer + size);
+        }
+
+        Reader reader(bytes, 0);
+        uint32_t magic, version;
+        if (!reader.Read(magic) || !reader.Read(version) || magic != kMagic || (version & 0xFF) != kVersion || (version & kUnsupportedFlags) != 0) return false;
+
+        std::vector<Channel> channels;
+        uint8_t compression = 0xFF;
+        int32_t window[4] = { 0, 0, -1, -1 };
+        while (true)
+        {
+            std::string name, type;
+            if (!reader.ReadString(name)) return false;
+            if (name.empty()) break;
+            int32_t size;
+            if (!reader.ReadString(type) || !reader.Read(size) || size < 0) return false;
+
+            const size_t end = reader.GetOffset() + size_t(size);
+            if (name == "channels")
+            {
+                while (true)
+                {
+                    Channel channel;
+                    int32_t sampling[2];
+                    if (!reader.ReadString(channel.name)) return false;
+                    if (channel.name.empty()) break;
+                    if (!reader.Read(channel.pixelType) || !reader.Skip(4) || !reader.Read(sampling[0]) || !reader.Read(sampling[1])) return false;
+                    if (sampling[0] != 1 || sampling[1] != 1) return false;
+                    if (channel.pixelType != kPixelTypeHalf && channel.pixelType != kPixelTypeFloat) return false;
+                    channels.push_back(channel);
+                }
+            }
+            else if (name == "compression")
+            {
+                if (!reader.Read(compression)) return false;
+            }
+            else if (name == "dataWindow")
+            {
+                for (int32_t& value : window)
+                {
+                    if (!reader.Read(value)) return false;
+                }
+            }
+            if (reader.GetOffset() > end || !reader.Skip(end - reader.GetOffset())) return false;
+        }
+        if (compression != kNoCompression || channels.empty() || window[2] < window[0] || window[3] < window[1]) return false;
+
+        const uint32_t width = uint32_t(window[2] - window[0] + 1);
+        const uint32_t height = uint32_t(window[3] - window[1] + 1);
+        size_t lineBytes = 0;
+        for (const Channel& channel : channels) lineBytes += size_t(width) * (channel.pixelType == kPixelTypeFloat ? 4 : 2);
+
+        image.Resize(width, height, float4(0.0f, 0.0f, 0.0f, 1.0f));
+        for (uint32_t line = 0; line < height; ++line)
+        {
+            uint64_t offset;
+            if (!reader.Read(offset)) return false;
+
+            Reader lineReader(bytes, size_t(offset));
+            int32_t y;
+            uint32_t size;
+            if (!lineReader.Read(y) || !lineReader.Read(size) || size != lineBytes || y < window[1] || y > window[3]) return false;
+
+            float4* row = image.GetRow(y - window[1]);
+            for (const Channel& channel : channels)
+            {
+                const int component = channel.name == "R" ? 0 : channel.name == "G" ? 1 : channel.name == "B" ? 2 : channel.name == "A" ? 3 : -1;
+                for (uint32_t x = 0; x < width; ++x)
+                {
+                    float value;
+                    if (channel.pixelType == kPixelTypeFloat)
+                    {
+                        if (!lineReader.Read(value)) return false;
+                    }
+                    else
+                    {
+                        uint16_t half;
+                        if (!lineReader.Read(half)) return false;
+                        value = f16tof32(half);
+                    }
+                    if (component >= 0) (&row[x].x)[component] = value;
+                }
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+#include "Image.h"
+
+// Minimal OpenEXR for the reference renders: single part scanline files without compression, what every EXR viewer
+// and image tool opens.
+namespace Cpu
+{
+    // Writes the rgb of image as 32-bit float R, G and B channels
+    bool WriteExr(const std::string& path, const Image4F& image);
+
+    // Reads an uncompressed scanline file with half or float channels, e.g. one WriteExr() wrote. R, G and B land in
+    // rgb, A in w when present, 1 otherwise; missing color channels are 0.
+    bool ReadExr(const std::string& path, Image4F& image);
+}
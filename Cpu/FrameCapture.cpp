@@ -0,0 +1,561 @@
+#include "FrameCapture.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include "Timer.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        const char kMagic[4] = { 'R', 'C', 'A', 'P' };
+        const uint32_t kVersion = 1;
+        const uint64_t kChunkAlignment = 16;
+
+        struct FileHeader
+        {
+            char magic[4];
+            uint32_t version;
+            uint32_t reserved[2];
+        };
+
+        struct ChunkHeader
+        {
+            char type[4];
+            uint32_t reserved;
+            uint64_t size;          // Payload bytes, the payload is padded to kChunkAlignment
+        };
+
+        struct FrameChunk
+        {
+            uint32_t frameIndex;
+            uint32_t width;
+            uint32_t height;
+            uint32_t targetMask;
+            uint32_t targetCount;   // TRGT chunks that follow
+            uint32_t reserved[3];
+            CaptureCamera camera;
+        };
+
+        struct TargetChunk
+        {
+            uint32_t target;
+            uint32_t format;
+            uint32_t compression;
+            uint32_t width;
+            uint32_t height;
+            uint32_t reserved;
+            uint64_t rawSize;
+        };
+
+        static_assert(sizeof(FileHeader) % kChunkAlignment == 0, "Chunks must start aligned");
+        static_assert(sizeof(ChunkHeader) % kChunkAlignment == 0, "Payloads must start aligned");
+        static_assert(sizeof(TargetChunk) % kChunkAlignment == 0, "Texels must start aligned");
+
+        const char kFrameChunk[4] = { 'F', 'R', 'A', 'M' };
+        const char kTargetChunk[4] = { 'T', 'R', 'G', 'T' };
+
+        const uint32_t kFormatBytes[uint32_t(CaptureFormat::Count)] = { 16, 8, 4, 1 };
+        const char* const kFormatNames[uint32_t(CaptureFormat::Count)] = { "RGBA32Float", "RGBA16Float", "RGBA8Unorm", "R8Unorm" };
+        const char* const kCompressionNames[uint32_t(CaptureCompression::Count)] = { "none", "shuffle-rle" };
+
+        // Run-length code: a control byte below 128 is followed by that many plus one literal bytes, one of 128 or more
+        // by a byte repeated control - 125 times
+        const uint32_t kMaxLiteralRun = 128;
+        const uint32_t kMinRepeatRun = 3;
+        const uint32_t kMaxRepeatRun = 130;
+
+        uint64_t AlignUp(uint64_t value) { return (value + kChunkAlignment - 1) / kChunkAlignment * kChunkAlignment; }
+
+        uint8_t ToUnorm8(float value)
+        {
+            return uint8_t(saturate(value) * 255.0f + 0.5f);
+        }
+
+        struct FileCloser
+        {
+            void operator()(FILE* file) const { if (file) fclose(file); }
+        };
+    }
+
+    uint32_t GetCaptureFormatBytes(CaptureFormat format)
+    {
+        return kFormatBytes[uint32_t(format)];
+    }
+
+    const char* GetCaptureFormatName(CaptureFormat format)
+    {
+        return kFormatNames[uint32_t(format)];
+    }
+
+    const char* GetCaptureCompressionName(CaptureCompression compression)
+    {
+        return kCompressionNames[uint32_t(compression)];
+    }
+
+    void PackCaptureTarget(const Image4F& image, CaptureFormat format, std::vector<uint8_t>& texels)
+    {
+        const size_t pixelCount = image.GetPixelCount();
+        texels.resize(pixelCount * GetCaptureFormatBytes(format));
+        const float4* src = image.GetData();
+
+        for (size_t i = 0; i < pixelCount; ++i)
+        {
+            switch (format)
+            {
+            case CaptureFormat::RGBA32Float:
+                std::memcpy(texels.data() + i * 16, &src[i], 16);
+                break;
+            case CaptureFormat::RGBA16Float:
+                for (int c = 0; c < 4; ++c)
+                {
+                    const uint16_t half = uint16_t(f32tof16(src[i][c]));
+                    std::memcpy(texels.data() + i * 8 + c * 2, &half, 2);
+                }
+                break;
+            case CaptureFormat::RGBA8Unorm:
+                for (int c = 0; c < 4; ++c) texels[i * 4 + c] = ToUnorm8(src[i][c]);
+                break;
+            default:
+                texels[i] = ToUnorm8(src[i].x);
+                break;
+            }
+        }
+    }
+
+    void UnpackCaptureTarget(const uint8_t* texels, CaptureFormat format, uint32_t width, uint32_t height, Image4F& image)
+    {
+        image.Resize(width, height);
+        const size_t pixelCount = image.GetPixelCount();
+        float4* dst = image.GetData();
+
+        for (size_t i = 0; i < pixelCount; ++i)
+        {
+            switch (format)
+            {
+            case CaptureFormat::RGBA32Float:
+                std::memcpy(&dst[i], texels + i * 16, 16);
+                break;
+            case CaptureFormat::RGBA16Float:
+                for (int c = 0; c < 4; ++c)
+                {
+                    uint16_t half;
+                    std::memcpy(&half, texels + i * 8 + c * 2, 2);
+                    dst[i][c] = f16tof32(half);
+                }
+                break;
+            case CaptureFormat::RGBA8Unorm:
+                for (int c = 0; c < 4; ++c) dst[i][c] = texels[i * 4 + c] / 255.0f;
+                break;
+            default:
+                dst[i] = float4(texels[i] / 255.0f, 0.0f, 0.0f, 1.0f);
+                break;
+            }
+        }
+    }
+
+    void CompressTexels(const uint8_t* texels, size_t size, uint32_t texelBytes, std::vector<uint8_t>& compressed)
+    {
+        // Byte planes of deltas, every plane starts from 0
+        const size_t texelCount = size / texelBytes;
+        std::vector<uint8_t> planes(size);
+        for (uint32_t b = 0; b < texelBytes; ++b)
+        {
+            uint8_t* plane = planes.data() + b * texelCount;
+            uint8_t previous = 0;
+            for (size_t i = 0; i < texelCount; ++i)
+            {
+                const uint8_t value = texels[i * texelBytes + b];
+                plane[i] = uint8_t(value - previous);
+                previous = value;
+            }
+        }
+
+        // Worst case is all literals, one control byte per kMaxLiteralRun bytes
+        compressed.resize(size + size / kMaxLiteralRun + 1);
+        const uint8_t* in = planes.data();
+        uint8_t* out = compressed.data();
+        size_t literalStart = 0;
+        size_t i = 0;
+        auto flushLiterals = [&](size_t end)
+        {
+            while (literalStart < end)
+            {
+                const size_t count = std::min<size_t>(end - literalStart, kMaxLiteralRun);
+                *out++ = uint8_t(count - 1);
+                std::memcpy(out, in + literalStart, count);
+                out += count;
+                literalStart += count;
+            }
+        };
+
+        while (i < size)
+        {
+            const uint8_t value = in[i];
+            const size_t runEnd = std::min(size, i + kMaxRepeatRun);
+            size_t end = i + 1;
+            while (end < runEnd && in[end] == value) end++;
+
+            if (end - i >= kMinRepeatRun)
+            {
+                flushLiterals(i);
+                *out++ = uint8_t(end - i + 125);
+                *out++ = value;
+                literalStart = end;
+            }
+            i = end;
+        }
+        flushLiterals(size);
+        compressed.resize(size_t(out - compressed.data()));
+    }
+
+    bool DecompressTexels(const uint8_t* compressed, size_t compressedSize, uint32_t texelBytes, uint8_t* texels, size_t size)
+    {
+        if (texelBytes == 0 || size % texelBytes != 0) return false;
+
+        std::vector<uint8_t> planes(size);
+        size_t in = 0;
+        size_t out = 0;
+        while (in < compressedSize)
+        {
+            const uint32_t control = compressed[in++];
+            if (control < 128)
+            {
+                const size_t count = control + 1;
+                if (in + count > compressedSize || out + count > size) return false;
+                std::memcpy(planes.data() + out, compressed + in, count);
+                in += count;
+                out += count;
+            }
+            else
+            {
+                const size_t count = control - 125;
+                if (in >= compressedSize || out + count > size) return false;
+                std::memset(planes.data() + out, compressed[in++], count);
+                out += count;
+            }
+        }
+        if (out != size) return false;
+
+        const size_t texelCount = size / texelBytes;
+        for (uint32_t b = 0; b < texelBytes; ++b)
+        {
+            const uint8_t* plane = planes.data() + b * texelCount;
+            uint8_t value = 0;
+            for (size_t i = 0; i < texelCount; ++i)
+            {
+                value = uint8_t(value + plane[i]);
+                texels[i * texelBytes + b] = value;
+            }
+        }
+        return true;
+    }
+
+    bool FrameCaptureWriter::Open(const std::string& path, CaptureCompression compression, uint32_t maxQueuedFrames)
+    {
+        Close();
+
+        mFile = fopen(path.c_str(), "wb");
+        if (!mFile) return false;
+
+        FileHeader header = {};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        if (fwrite(&header, sizeof(header), 1, mFile) != 1)
+        {
+            fclose(mFile);
+            mFile = nullptr;
+            return false;
+        }
+
+        mCompression = compression;
+        mMaxQueuedFrames = std::max(1u, maxQueuedFrames);
+        mQueue.clear();
+        mWriting = false;
+        mShutdown = false;
+        mFailed = false;
+        mStats = FrameCaptureStats();
+        mStats.fileBytes = sizeof(header);
+        mThread = std::thread(&FrameCaptureWriter::WriterLoop, this);
+        return true;
+    }
+
+    void FrameCaptureWriter::Close()
+    {
+        if (!mThread.joinable()) return;
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mShutdown = true;
+        }
+        mWakeCondition.notify_all();
+        mThread.join();
+
+        fclose(mFile);
+        mFile = nullptr;
+    }
+
+    bool FrameCaptureWriter::HasFailed() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mFailed;
+    }
+
+    bool FrameCaptureWriter::Submit(CaptureFrame&& frame)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStats.submittedFrames++;
+            if (!mThread.joinable() || mFailed || mQueue.size() >= mMaxQueuedFrames)
+            {
+                mStats.droppedFrames++;
+                return false;
+            }
+            mQueue.push_back(std::move(frame));
+        }
+        mWakeCondition.notify_one();
+        return true;
+    }
+
+    void FrameCaptureWriter::Flush()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mIdleCondition.wait(lock, [this]() { return mQueue.empty() && !mWriting; });
+    }
+
+    FrameCaptureStats FrameCaptureWriter::GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mStats;
+    }
+
+    void FrameCaptureWriter::WriterLoop()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true)
+        {
+            mWakeCondition.wait(lock, [this]() { return mShutdown || !mQueue.empty(); });
+            if (mQueue.empty()) break;
+
+            CaptureFrame frame = std::move(mQueue.front());
+            mQueue.pop_front();
+            mWriting = true;
+            lock.unlock();
+
+            const bool written = WriteFrame(frame);
+
+            lock.lock();
+            mWriting = false;
+            if (written)
+            {
+                mStats.writtenFrames++;
+            }
+            else
+            {
+                mFailed = true;
+                mStats.droppedFrames += mQueue.size() + 1;
+                mQueue.clear();
+            }
+            if (mQueue.empty()) mIdleCondition.notify_all();
+        }
+        fflush(mFile);
+    }
+
+    // Only the writer thread touches mFile and mCompressed, the stats it updates are taken under the lock
+    bool FrameCaptureWriter::WriteFrame(const CaptureFrame& frame)
+    {
+        const uint8_t padding[kChunkAlignment] = {};
+        uint64_t fileBytes = 0;
+        auto writeChunk = [&](const char type[4], const void* header, size_t headerSize, const uint8_t* data, size_t dataSize)
+        {
+            ChunkHeader chunk = {};
+            std::memcpy(chunk.type, type, 4);
+            chunk.size = headerSize + dataSize;
+            const size_t paddingSize = size_t(AlignUp(chunk.size) - chunk.size);
+            if (fwrite(&chunk, sizeof(chunk), 1, mFile) != 1 || fwrite(header, headerSize, 1, mFile) != 1) return false;
+            if (dataSize > 0 && fwrite(data, 1, dataSize, mFile) != dataSize) return false;
+            if (paddingSize > 0 && fwrite(padding, 1, paddingSize, mFile) != paddingSize) return false;
+            fileBytes += sizeof(chunk) + AlignUp(chunk.size);
+            return true;
+        };
+
+        FrameChunk frameChunk = {};
+        frameChunk.frameIndex = frame.frameIndex;
+        frameChunk.targetCount = uint32_t(frame.targets.size());
+        frameChunk.camera = frame.camera;
+        for (const CaptureTarget& target : frame.targets)
+        {
+            if (frameChunk.targetMask == 0)
+            {
+                frameChunk.width = target.width;
+                frameChunk.height = target.height;
+            }
+            frameChunk.targetMask |= 1u << uint32_t(target.target);
+        }
+
+        double compressMs = 0.0;
+        uint64_t rawBytes = 0;
+        Timer writeTimer;
+        if (!writeChunk(kFrameChunk, &frameChunk, sizeof(frameChunk), nullptr, 0)) return false;
+
+        for (const CaptureTarget& target : frame.targets)
+        {
+            TargetChunk targetChunk = {};
+            targetChunk.target = uint32_t(target.target);
+            targetChunk.format = uint32_t(target.format);
+            targetChunk.compression = uint32_t(mCompression);
+            targetChunk.width = target.width;
+            targetChunk.height = target.height;
+            targetChunk.rawSize = target.texels.size();
+            rawBytes += target.texels.size();
+
+            const uint8_t* data = target.texels.data();
+            size_t dataSize = target.texels.size();
+            if (mCompression == CaptureCompression::ShuffleRle)
+            {
+                Timer compressTimer;
+                CompressTexels(target.texels.data(), target.texels.size(), GetCaptureFormatBytes(target.format), mCompressed);
+                compressMs += compressTimer.GetElapsedMs();
+                data = mCompressed.data();
+                dataSize = mCompressed.size();
+            }
+
+            if (!writeChunk(kTargetChunk, &targetChunk, sizeof(targetChunk), data, dataSize)) return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.rawBytes += rawBytes;
+        mStats.fileBytes += fileBytes;
+        mStats.compressMs += compressMs;
+        mStats.writeMs += writeTimer.GetElapsedMs() - compressMs;
+        return true;
+    }
+
+    bool FrameCaptureReader::Open(const std::string& path)
+    {
+        Close();
+        if (!mFile.Open(path)) return false;
+
+        const uint8_t* data = mFile.GetData();
+        const uint64_t size = mFile.GetSize();
+        FileHeader header;
+        if (size < sizeof(header)) return false;
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion)
+        {
+            Close();
+            return false;
+        }
+
+        CaptureFrameInfo frame;
+        uint32_t pendingTargets = 0;
+        bool inFrame = false;
+        uint64_t offset = sizeof(header);
+        while (offset + sizeof(ChunkHeader) <= size)
+        {
+            ChunkHeader chunk;
+            std::memcpy(&chunk, data + offset, sizeof(chunk));
+            const uint64_t payload = offset + sizeof(chunk);
+            if (chunk.size > size - payload) break;     // Cut short
+            offset = payload + AlignUp(chunk.size);
+
+            if (std::memcmp(chunk.type, kFrameChunk, 4) == 0)
+            {
+                if (chunk.size < sizeof(FrameChunk)) break;
+                FrameChunk frameChunk;
+                std::memcpy(&frameChunk, data + payload, sizeof(frameChunk));
+
+                frame = CaptureFrameInfo();
+                frame.frameIndex = frameChunk.frameIndex;
+                frame.width = frameChunk.width;
+                frame.height = frameChunk.height;
+                frame.camera = frameChunk.camera;
+                pendingTargets = frameChunk.targetCount;
+                inFrame = true;
+            }
+            else if (std::memcmp(chunk.type, kTargetChunk, 4) == 0)
+            {
+                if (!inFrame || chunk.size < sizeof(TargetChunk)) break;
+                TargetChunk targetChunk;
+                std::memcpy(&targetChunk, data + payload, sizeof(targetChunk));
+                if (targetChunk.target >= kFrameTargetCount || targetChunk.format >= uint32_t(CaptureFormat::Count) ||
+                    targetChunk.compression >= uint32_t(CaptureCompression::Count)) break;
+
+                CaptureTargetView& view = frame.targets[targetChunk.target];
+                view.target = FrameTarget(targetChunk.target);
+                view.format = CaptureFormat(targetChunk.format);
+                view.compression = CaptureCompression(targetChunk.compression);
+                view.width = targetChunk.width;
+                view.height = targetChunk.height;
+                view.data = data + payload + sizeof(targetChunk);
+                view.size = chunk.size - sizeof(targetChunk);
+                view.rawSize = targetChunk.rawSize;
+                if (view.rawSize != uint64_t(view.width) * view.height * GetCaptureFormatBytes(view.format)) break;
+                if (view.compression == CaptureCompression::None && view.size != view.rawSize) break;
+                frame.targetMask |= 1u << targetChunk.target;
+                pendingTargets--;
+            }
+            // Unknown chunks are skipped
+
+            if (inFrame && pendingTargets == 0)
+            {
+                mFrames.push_back(frame);
+                inFrame = false;
+            }
+        }
+
+        return true;
+    }
+
+    void FrameCaptureReader::Close()
+    {
+        mFrames.clear();
+        mFile.Close();
+    }
+
+    bool FrameCaptureReader::ReadTexels(const CaptureTargetView& view, std::vector<uint8_t>& texels) const
+    {
+        texels.resize(size_t(view.rawSize));
+        if (view.compression == CaptureCompression::None)
+        {
+            std::memcpy(texels.data(), view.data, texels.size());
+            return true;
+        }
+        return DecompressTexels(view.data, size_t(view.size), GetCaptureFormatBytes(view.format), texels.data(), texels.size());
+    }
+
+    bool FrameCaptureReader::LoadFrame(uint32_t index, FrameData& frame) const
+    {
+        if (index >= mFrames.size()) return false;
+        const CaptureFrameInfo& info = mFrames[index];
+
+        frame.targetMask = info.targetMask;
+        frame.Resize(info.width, info.height);
+
+        std::vector<uint8_t> texels;
+        for (uint32_t i = 0; i < kFrameTargetCount; ++i)
+        {
+            if ((info.targetMask & (1u << i)) == 0) continue;
+
+            const CaptureTargetView& view = info.targets[i];
+            if (view.width != info.width || view.height != info.height) return false;
+
+            // Uncompressed texels are converted straight out of the mapping
+            const uint8_t* src = view.data;
+            if (view.compression != CaptureCompression::None)
+            {
+                if (!ReadTexels(view, texels)) return false;
+                src = texels.data();
+            }
+            UnpackCaptureTarget(src, view.format, view.width, view.height, frame.targets[i]);
+        }
+        return true;
+    }
+
+    bool IsFrameCapture(const std::string& path)
+    {
+        std::unique_ptr<FILE, FileCloser> file(fopen(path.c_str(), "rb"));
+        char magic[4];
+        return file && fread(magic, sizeof(magic), 1, file.get()) == 1 && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+    }
+}
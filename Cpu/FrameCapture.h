@@ -0,0 +1,184 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FrameSequence.h"
+#include "MappedFile.h"
+
+namespace Cpu
+{
+    // Texel layout of a captured target, the GPU format it was read back from
+    enum class CaptureFormat : uint32_t
+    {
+        RGBA32Float = 0,
+        RGBA16Float,
+        RGBA8Unorm,
+        R8Unorm,
+        Count
+    };
+
+    uint32_t GetCaptureFormatBytes(CaptureFormat format);
+    const char* GetCaptureFormatName(CaptureFormat format);
+
+    // Lossless, chosen per capture. ShuffleRle splits the texels into byte planes, stores each byte as the difference to
+    // the one on its left and run-length encodes the result, which collapses the sky, flat walls and constant channels.
+    enum class CaptureCompression : uint32_t
+    {
+        None = 0,
+        ShuffleRle,
+        Count
+    };
+
+    const char* GetCaptureCompressionName(CaptureCompression compression);
+
+    struct CaptureCamera
+    {
+        float view[16] = {};                // Column major, like glm::mat4
+        float projection[16] = {};
+        float prevViewProjection[16] = {};
+        float position[3] = {};
+        float nearZ = 0.0f;
+        float farZ = 0.0f;
+        float jitter[2] = {};               // Camera::getJitterX/Y()
+        float padding = 0.0f;
+    };
+
+    // Tightly packed texels of one target, rows top to bottom
+    struct CaptureTarget
+    {
+        FrameTarget target = FrameTarget::WorldPosition;
+        CaptureFormat format = CaptureFormat::RGBA32Float;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> texels;
+    };
+
+    struct CaptureFrame
+    {
+        uint32_t frameIndex = 0;
+        CaptureCamera camera;
+        std::vector<CaptureTarget> targets;
+    };
+
+    // Same conversion the GPU does when it writes image to a target of that format, and the float4 expansion of a
+    // Texture2D load back. Single channel formats keep .x and read back as (x, 0, 0, 1).
+    void PackCaptureTarget(const Image4F& image, CaptureFormat format, std::vector<uint8_t>& texels);
+    void UnpackCaptureTarget(const uint8_t* texels, CaptureFormat format, uint32_t width, uint32_t height, Image4F& image);
+
+    // ShuffleRle of texels made of texelBytes bytes. Decompress returns false on a malformed stream.
+    void CompressTexels(const uint8_t* texels, size_t size, uint32_t texelBytes, std::vector<uint8_t>& compressed);
+    bool DecompressTexels(const uint8_t* compressed, size_t compressedSize, uint32_t texelBytes, uint8_t* texels, size_t size);
+
+    // A capture is one file of chunks: "RCAP" and the version, then per frame a FRAM chunk (index, size, camera, the
+    // targets that follow) and one TRGT chunk per target (target, format, compression, size, texels). Chunk payloads
+    // are 16 byte aligned, so uncompressed texels can be used straight from a mapping. A capture cut short by a crash
+    // stays readable up to its last complete frame.
+    struct FrameCaptureStats
+    {
+        uint64_t submittedFrames = 0;
+        uint64_t writtenFrames = 0;
+        uint64_t droppedFrames = 0;     // Submitted while the queue was full
+        uint64_t rawBytes = 0;          // Texels before compression
+        uint64_t fileBytes = 0;
+        double compressMs = 0.0;        // On the writer thread
+        double writeMs = 0.0;
+    };
+
+    // Compresses and writes frames on a thread of its own. Submit() only moves the frame into a bounded queue, a
+    // frame submitted while the queue is full is dropped rather than stalling the caller.
+    class FrameCaptureWriter
+    {
+    public:
+        FrameCaptureWriter() = default;
+        ~FrameCaptureWriter() { Close(); }
+
+        FrameCaptureWriter(const FrameCaptureWriter&) = delete;
+        FrameCaptureWriter& operator=(const FrameCaptureWriter&) = delete;
+
+        bool Open(const std::string& path, CaptureCompression compression, uint32_t maxQueuedFrames = 4);
+        // Writes the queued frames and closes the file
+        void Close();
+
+        bool IsOpen() const { return mThread.joinable(); }
+        // A write failed, later frames are dropped
+        bool HasFailed() const;
+
+        // False when the frame was dropped
+        bool Submit(CaptureFrame&& frame);
+        // Blocks until the queue is empty
+        void Flush();
+
+        FrameCaptureStats GetStats() const;
+
+    private:
+        void WriterLoop();
+        bool WriteFrame(const CaptureFrame& frame);
+
+        FILE* mFile = nullptr;
+        CaptureCompression mCompression = CaptureCompression::None;
+        uint32_t mMaxQueuedFrames = 4;
+        std::vector<uint8_t> mCompressed;
+
+        mutable std::mutex mMutex;
+        std::condition_variable mWakeCondition;
+        std::condition_variable mIdleCondition;
+        std::deque<CaptureFrame> mQueue;
+        bool mWriting = false;
+        bool mShutdown = false;
+        bool mFailed = false;
+        FrameCaptureStats mStats;
+
+        std::thread mThread;
+    };
+
+    struct CaptureTargetView
+    {
+        FrameTarget target = FrameTarget::WorldPosition;
+        CaptureFormat format = CaptureFormat::RGBA32Float;
+        CaptureCompression compression = CaptureCompression::None;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        const uint8_t* data = nullptr;  // Into the mapping
+        uint64_t size = 0;              // Stored bytes
+        uint64_t rawSize = 0;           // Texel bytes once decompressed
+    };
+
+    struct CaptureFrameInfo
+    {
+        uint32_t frameIndex = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t targetMask = 0;
+        CaptureCamera camera;
+        CaptureTargetView targets[kFrameTargetCount];
+    };
+
+    // Maps a capture and indexes its chunks on Open(), without touching the texels. Frames can be read in any order.
+    class FrameCaptureReader
+    {
+    public:
+        bool Open(const std::string& path);
+        void Close();
+
+        uint32_t GetFrameCount() const { return uint32_t(mFrames.size()); }
+        const CaptureFrameInfo& GetFrame(uint32_t index) const { return mFrames[index]; }
+
+        // Packed texels of a target, decompressed into texels when needed
+        bool ReadTexels(const CaptureTargetView& view, std::vector<uint8_t>& texels) const;
+        // Every target of a frame as float4, like LoadFrame() does for a recorded sequence
+        bool LoadFrame(uint32_t index, FrameData& frame) const;
+
+    private:
+        MappedFile mFile;
+        std::vector<CaptureFrameInfo> mFrames;
+    };
+
+    // True for files starting with the capture magic
+    bool IsFrameCapture(const std::string& path);
+}
@@ -0,0 +1,378 @@
+#include "FrameProfiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <set>
+#include <sstream>
+#include "JsonWriter.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        // Chrome trace track of the GPU times, far above any thread index
+        const uint32_t kGpuTrack = 1000;
+
+        std::atomic<uint32_t> sThreadCount(0);
+
+        // Open scopes of the calling thread, innermost last
+        thread_local std::vector<uint32_t> tScopeStack;
+        thread_local uint32_t tThreadIndex = ~0u;
+
+        uint32_t GetThreadIndex()
+        {
+            if (tThreadIndex == ~0u) tThreadIndex = sThreadCount.fetch_add(1);
+            return tThreadIndex;
+        }
+
+        bool WriteFile(const std::string& path, const std::string& text)
+        {
+            FILE* file = fopen(path.c_str(), "wb");
+            if (!file) return false;
+            const bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+            return fclose(file) == 0 && written;
+        }
+
+        // Paths may hold anything the callers named their scopes
+        std::string CsvField(const std::string& value)
+        {
+            if (value.find_first_of(",\"\n") == std::string::npos) return value;
+
+            std::string quoted = "\"";
+            for (char c : value)
+            {
+                if (c == '"') quoted += '"';
+                quoted += c;
+            }
+            return quoted + "\"";
+        }
+
+        void WriteCsvStats(std::ostringstream& csv, const SampleStats& stats)
+        {
+            csv << "," << stats.mean << "," << stats.min << "," << stats.p50 << "," << stats.p90 << "," << stats.p99 << "," << stats.max;
+        }
+
+        void WriteTraceEvent(JsonWriter& json, const std::string& name, const char* category, uint32_t track, double startMs, double durationMs, uint64_t frameIndex)
+        {
+            json.BeginObject();
+            json.Field("name", name);
+            json.Field("cat", category);
+            json.Field("ph", "X");
+            json.Field("pid", 0u);
+            json.Field("tid", track);
+            json.Field("ts", startMs * 1000.0);
+            json.Field("dur", durationMs * 1000.0);
+            json.Key("args").BeginObject();
+            json.Field("frame", frameIndex);
+            json.EndObject();
+            json.EndObject();
+        }
+
+        void WriteTrackName(JsonWriter& json, uint32_t track, const std::string& name)
+        {
+            json.BeginObject();
+            json.Field("name", "thread_name");
+            json.Field("ph", "M");
+            json.Field("pid", 0u);
+            json.Field("tid", track);
+            json.Key("args").BeginObject();
+            json.Field("name", name);
+            json.EndObject();
+            json.EndObject();
+        }
+    }
+
+    std::atomic<FrameProfiler*> FrameProfiler::sActive(nullptr);
+
+    FrameProfiler::FrameProfiler(uint32_t historyFrames)
+        : mFrames(std::max(1u, historyFrames))
+    {
+    }
+
+    FrameProfiler::~FrameProfiler()
+    {
+        FrameProfiler* self = this;
+        sActive.compare_exchange_strong(self, nullptr);
+    }
+
+    void FrameProfiler::SetActive(FrameProfiler* profiler)
+    {
+        sActive.store(profiler, std::memory_order_release);
+    }
+
+    void FrameProfiler::BeginFrame(uint64_t frameIndex)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        // The oldest frame of a full ring is recycled, keeping its allocations
+        mCurrentFrame = &mFrames[mCompletedFrames % mFrames.size()];
+        mCurrentFrame->frameIndex = frameIndex;
+        mCurrentFrame->startMs = GetTimeMs();
+        mCurrentFrame->endMs = mCurrentFrame->startMs;
+        mCurrentFrame->events.clear();
+        mCurrentFrame->cpuMs.clear();
+        mCurrentFrame->gpuMs.clear();
+        mCurrentFrame->calls.clear();
+        mNextFrameIndex = frameIndex + 1;
+        mFrameOpen = true;
+    }
+
+    void FrameProfiler::EndFrame()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mFrameOpen) return;
+
+        ProfileFrame& frame = *mCurrentFrame;
+        frame.endMs = GetTimeMs();
+
+        const size_t nodeCount = mNodes.size();
+        frame.cpuMs.assign(nodeCount, -1.0f);
+        frame.calls.assign(nodeCount, 0);
+        frame.gpuMs.resize(nodeCount, -1.0f);
+        for (const ProfileEvent& event : frame.events)
+        {
+            float& ms = frame.cpuMs[event.node];
+            ms = std::max(ms, 0.0f) + float(event.endMs - event.startMs);
+            frame.calls[event.node]++;
+        }
+
+        mCompletedFrames++;
+        mFrameOpen = false;
+    }
+
+    void FrameProfiler::MarkFrame()
+    {
+        FrameProfiler* profiler = GetActive();
+        if (!profiler) return;
+
+        profiler->EndFrame();
+        profiler->BeginFrame(profiler->mNextFrameIndex);
+    }
+
+    uint32_t FrameProfiler::BeginScope(const char* name)
+    {
+        const uint32_t parent = tScopeStack.empty() ? kNoProfileNode : tScopeStack.back();
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        const std::vector<uint32_t>& siblings = (parent == kNoProfileNode) ? mRoots : mNodes[parent].children;
+        uint32_t node = kNoProfileNode;
+        for (uint32_t sibling : siblings)
+        {
+            if (mNodes[sibling].name == name)
+            {
+                node = sibling;
+                break;
+            }
+        }
+
+        if (node == kNoProfileNode)
+        {
+            node = uint32_t(mNodes.size());
+            ProfileNode created;
+            created.name = name;
+            created.parent = parent;
+            if (parent == kNoProfileNode)
+            {
+                created.path = name;
+                mRoots.push_back(node);
+            }
+            else
+            {
+                created.path = mNodes[parent].path + "/" + name;
+                created.depth = mNodes[parent].depth + 1;
+                mNodes[parent].children.push_back(node);
+            }
+            mNodes.push_back(std::move(created));
+        }
+
+        tScopeStack.push_back(node);
+        return node;
+    }
+
+    void FrameProfiler::EndScope(uint32_t node, double startMs)
+    {
+        const double endMs = GetTimeMs();
+        if (!tScopeStack.empty()) tScopeStack.pop_back();
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mFrameOpen) mCurrentFrame->events.push_back({ node, GetThreadIndex(), startMs, endMs });
+    }
+
+    void FrameProfiler::MarkGpuEvent(uint32_t node)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mNodes[node].hasGpuEvent = true;
+    }
+
+    void FrameProfiler::ResolveGpuTimes(const std::function<double(const ProfileNode& node)>& query)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mFrameOpen) return;
+
+        ProfileFrame& frame = *mCurrentFrame;
+        frame.gpuMs.assign(mNodes.size(), -1.0f);
+        for (const ProfileEvent& event : frame.events)
+        {
+            float& ms = frame.gpuMs[event.node];
+            if (ms < 0.0f && mNodes[event.node].hasGpuEvent) ms = float(query(mNodes[event.node]));
+        }
+    }
+
+    uint32_t FrameProfiler::FindNode(const std::string& path) const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (uint32_t i = 0; i < mNodes.size(); ++i)
+        {
+            if (mNodes[i].path == path) return i;
+        }
+        return kNoProfileNode;
+    }
+
+    uint32_t FrameProfiler::GetFrameCount() const
+    {
+        return uint32_t(std::min<uint64_t>(mCompletedFrames, mFrames.size()));
+    }
+
+    const ProfileFrame& FrameProfiler::GetFrame(uint32_t index) const
+    {
+        const uint64_t first = mCompletedFrames - GetFrameCount();
+        return mFrames[(first + index) % mFrames.size()];
+    }
+
+    SampleStats FrameProfiler::GetStats(uint32_t node, bool gpu) const
+    {
+        std::vector<double> samples;
+        for (uint32_t i = 0; i < GetFrameCount(); ++i)
+        {
+            const std::vector<float>& ms = gpu ? GetFrame(i).gpuMs : GetFrame(i).cpuMs;
+            if (node < ms.size() && ms[node] >= 0.0f) samples.push_back(ms[node]);
+        }
+        return ComputeStats(samples);
+    }
+
+    SampleStats FrameProfiler::GetCpuStats(uint32_t node) const
+    {
+        return GetStats(node, false);
+    }
+
+    SampleStats FrameProfiler::GetGpuStats(uint32_t node) const
+    {
+        return GetStats(node, true);
+    }
+
+    SampleStats FrameProfiler::GetFrameStats() const
+    {
+        std::vector<double> samples;
+        for (uint32_t i = 0; i < GetFrameCount(); ++i) samples.push_back(GetFrame(i).endMs - GetFrame(i).startMs);
+        return ComputeStats(samples);
+    }
+
+    bool FrameProfiler::WriteChromeTrace(const std::string& path) const
+    {
+        std::set<uint32_t> threads;
+        bool hasGpu = false;
+
+        JsonWriter json;
+        json.BeginObject();
+        json.Field("displayTimeUnit", "ms");
+        json.Key("traceEvents").BeginArray();
+        for (uint32_t f = 0; f < GetFrameCount(); ++f)
+        {
+            const ProfileFrame& frame = GetFrame(f);
+            WriteTraceEvent(json, "Frame " + std::to_string(frame.frameIndex), "frame", kGpuTrack + 1, frame.startMs, frame.endMs - frame.startMs, frame.frameIndex);
+
+            for (const ProfileEvent& event : frame.events)
+            {
+                WriteTraceEvent(json, mNodes[event.node].name, "cpu", event.thread, event.startMs, event.endMs - event.startMs, frame.frameIndex);
+                threads.insert(event.thread);
+            }
+
+            // The GPU reports durations only. In the order the CPU opened them, each node starts with its first CPU scope,
+            // but not before the GPU finished the previous node at its depth or before its parent started on the GPU.
+            std::vector<const ProfileEvent*> firstEvents;
+            std::vector<bool> seen(mNodes.size(), false);
+            for (const ProfileEvent& event : frame.events)
+            {
+                if (seen[event.node] || event.node >= frame.gpuMs.size() || frame.gpuMs[event.node] < 0.0f) continue;
+                seen[event.node] = true;
+                firstEvents.push_back(&event);
+            }
+            std::sort(firstEvents.begin(), firstEvents.end(), [this](const ProfileEvent* a, const ProfileEvent* b)
+            {
+                return a->startMs != b->startMs ? a->startMs < b->startMs : mNodes[a->node].depth < mNodes[b->node].depth;
+            });
+
+            std::vector<double> gpuStartMs(mNodes.size(), -1.0);
+            std::vector<double> depthEndMs;
+            for (const ProfileEvent* firstEvent : firstEvents)
+            {
+                const ProfileEvent& event = *firstEvent;
+                const ProfileNode& node = mNodes[event.node];
+                double startMs = event.startMs;
+                if (node.parent != kNoProfileNode && gpuStartMs[node.parent] >= 0.0) startMs = std::max(startMs, gpuStartMs[node.parent]);
+                if (node.depth < depthEndMs.size()) startMs = std::max(startMs, depthEndMs[node.depth]);
+                gpuStartMs[event.node] = startMs;
+
+                depthEndMs.resize(std::max<size_t>(depthEndMs.size(), node.depth + 1), 0.0);
+                depthEndMs[node.depth] = startMs + frame.gpuMs[event.node];
+
+                WriteTraceEvent(json, node.name, "gpu", kGpuTrack, startMs, frame.gpuMs[event.node], frame.frameIndex);
+                hasGpu = true;
+            }
+        }
+
+        for (uint32_t thread : threads) WriteTrackName(json, thread, "Thread " + std::to_string(thread));
+        if (hasGpu) WriteTrackName(json, kGpuTrack, "GPU");
+        WriteTrackName(json, kGpuTrack + 1, "Frames");
+        json.EndArray();
+        json.EndObject();
+
+        return WriteFile(path, json.GetString() + "\n");
+    }
+
+    bool FrameProfiler::WriteFramesCsv(const std::string& path) const
+    {
+        std::ostringstream csv;
+        csv.precision(9);
+        csv << "frame,frameMs,path,depth,calls,cpuMs,gpuMs\n";
+        for (uint32_t f = 0; f < GetFrameCount(); ++f)
+        {
+            const ProfileFrame& frame = GetFrame(f);
+            for (uint32_t n = 0; n < frame.cpuMs.size(); ++n)
+            {
+                if (frame.cpuMs[n] < 0.0f) continue;
+                csv << frame.frameIndex << "," << (frame.endMs - frame.startMs) << "," << CsvField(mNodes[n].path) << "," << mNodes[n].depth << ","
+                    << frame.calls[n] << "," << frame.cpuMs[n] << ",";
+                if (frame.gpuMs[n] >= 0.0f) csv << frame.gpuMs[n];
+                csv << "\n";
+            }
+        }
+        return WriteFile(path, csv.str());
+    }
+
+    bool FrameProfiler::WriteStatsCsv(const std::string& path) const
+    {
+        std::ostringstream csv;
+        csv.precision(9);
+        csv << "path,depth,frames,cpuMean,cpuMin,cpuP50,cpuP90,cpuP99,cpuMax,gpuFrames,gpuMean,gpuMin,gpuP50,gpuP90,gpuP99,gpuMax\n";
+
+        const SampleStats frameStats = GetFrameStats();
+        csv << "Frame,0," << frameStats.count;
+        WriteCsvStats(csv, frameStats);
+        csv << ",0,,,,,,\n";
+
+        for (uint32_t n = 0; n < mNodes.size(); ++n)
+        {
+            const SampleStats cpuStats = GetCpuStats(n);
+            if (cpuStats.count == 0) continue;
+            const SampleStats gpuStats = GetGpuStats(n);
+
+            csv << CsvField(mNodes[n].path) << "," << mNodes[n].depth << "," << cpuStats.count;
+            WriteCsvStats(csv, cpuStats);
+            csv << "," << gpuStats.count;
+            if (gpuStats.count > 0) WriteCsvStats(csv, gpuStats);
+            else csv << ",,,,,,";
+            csv << "\n";
+        }
+        return WriteFile(path, csv.str());
+    }
+}
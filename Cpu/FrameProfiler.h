@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Statistics.h"
+#include "Timer.h"
+
+namespace Cpu
+{
+    const uint32_t kNoProfileNode = ~0u;
+
+    // A scope name at one place in the hierarchy. The same name under two parents is two nodes.
+    struct ProfileNode
+    {
+        std::string name;
+        std::string path;                   // Names from the outermost scope down, "RenderFrame/DenoiseAO/Atrous0"
+        uint32_t parent = kNoProfileNode;
+        uint32_t depth = 0;
+        std::vector<uint32_t> children;
+        bool hasGpuEvent = false;           // Set by MarkGpuEvent()
+    };
+
+    // One closed scope, times in ms since the profiler was created
+    struct ProfileEvent
+    {
+        uint32_t node;
+        uint32_t thread;                    // Sequential per thread that ever opened a scope
+        double startMs;
+        double endMs;
+    };
+
+    struct ProfileFrame
+    {
+        uint64_t frameIndex = 0;
+        double startMs = 0.0;
+        double endMs = 0.0;
+        std::vector<ProfileEvent> events;   // In the order they closed
+        // Indexed by node, sized to the nodes that existed when the frame ended. Negative for nodes that did not run.
+        std::vector<float> cpuMs;           // Summed over the node's events
+        std::vector<float> gpuMs;           // From ResolveGpuTimes()
+        std::vector<uint32_t> calls;
+    };
+
+    // Hierarchical CPU timings of the last historyFrames frames, with GPU timings attached by the caller. Scopes are
+    // opened with FRAME_PROFILE on the active profiler from any thread, each thread nests its own scopes. Without an
+    // active profiler a scope costs one atomic load, so library code is instrumented unconditionally.
+    class FrameProfiler
+    {
+    public:
+        explicit FrameProfiler(uint32_t historyFrames = 240);
+        ~FrameProfiler();
+
+        FrameProfiler(const FrameProfiler&) = delete;
+        FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+        // The profiler scopes are recorded into, null to stop profiling. Set it while no scope is open.
+        static void SetActive(FrameProfiler* profiler);
+        static FrameProfiler* GetActive() { return sActive.load(std::memory_order_acquire); }
+
+        // Scopes closing outside a frame are dropped
+        void BeginFrame(uint64_t frameIndex);
+        void EndFrame();
+        bool IsFrameOpen() const { return mFrameOpen; }
+
+        // Ends the active profiler's open frame and begins the next one, for loops that have no frame index of
+        // their own. Does nothing without an active profiler.
+        static void MarkFrame();
+
+        // Used by ProfileScope. BeginScope() returns the node and pushes it on the calling thread's stack.
+        uint32_t BeginScope(const char* name);
+        void EndScope(uint32_t node, double startMs);
+
+        // The node's scopes also time GPU work, ResolveGpuTimes() asks for the times of these nodes only
+        void MarkGpuEvent(uint32_t node);
+        // Attaches a GPU time to every marked node of the open frame. query returns a negative value when it has none.
+        void ResolveGpuTimes(const std::function<double(const ProfileNode& node)>& query);
+
+        double GetTimeMs() const { return mClock.GetElapsedMs(); }
+
+        uint32_t GetNodeCount() const { return uint32_t(mNodes.size()); }
+        const ProfileNode& GetNode(uint32_t node) const { return mNodes[node]; }
+        uint32_t FindNode(const std::string& path) const;
+
+        // Completed frames in the history, 0 is the oldest
+        uint32_t GetFrameCount() const;
+        const ProfileFrame& GetFrame(uint32_t index) const;
+        uint64_t GetTotalFrameCount() const { return mCompletedFrames; }
+
+        // Over the frames in the history in which the node ran
+        SampleStats GetCpuStats(uint32_t node) const;
+        SampleStats GetGpuStats(uint32_t node) const;
+        SampleStats GetFrameStats() const;
+
+        // chrome://tracing and Perfetto. Each thread is a track, GPU times go on a track of their own.
+        bool WriteChromeTrace(const std::string& path) const;
+        // frame,frameMs,path,depth,calls,cpuMs,gpuMs per node that ran in a frame
+        bool WriteFramesCsv(const std::string& path) const;
+        // path,depth,frames and the CPU and GPU statistics per node, the first row is the whole frame
+        bool WriteStatsCsv(const std::string& path) const;
+
+    private:
+        SampleStats GetStats(uint32_t node, bool gpu) const;
+
+        static std::atomic<FrameProfiler*> sActive;
+
+        Timer mClock;
+        mutable std::mutex mMutex;
+        std::vector<ProfileNode> mNodes;
+        std::vector<uint32_t> mRoots;
+
+        std::vector<ProfileFrame> mFrames;  // Ring of the history
+        uint64_t mCompletedFrames = 0;
+        uint64_t mNextFrameIndex = 0;
+        ProfileFrame* mCurrentFrame = nullptr;
+        bool mFrameOpen = false;
+    };
+
+    // Times its lifetime on the active profiler, if there is one
+    class ProfileScope
+    {
+    public:
+        explicit ProfileScope(const char* name)
+            : mProfiler(FrameProfiler::GetActive())
+        {
+            if (mProfiler)
+            {
+                mNode = mProfiler->BeginScope(name);
+                mStartMs = mProfiler->GetTimeMs();
+            }
+        }
+
+        explicit ProfileScope(const std::string& name) : ProfileScope(name.c_str()) {}
+
+        ~ProfileScope()
+        {
+            if (mProfiler) mProfiler->EndScope(mNode, mStartMs);
+        }
+
+        ProfileScope(const ProfileScope&) = delete;
+        ProfileScope& operator=(const ProfileScope&) = delete;
+
+        // kNoProfileNode without an active profiler
+        uint32_t GetNode() const { return mProfiler ? mNode : kNoProfileNode; }
+        FrameProfiler* GetProfiler() const { return mProfiler; }
+
+    private:
+        FrameProfiler* mProfiler;
+        uint32_t mNode = kNoProfileNode;
+        double mStartMs = 0.0;
+    };
+}
+
+#define FRAME_PROFILE_CONCAT_(a, b) a##b
+#define FRAME_PROFILE_CONCAT(a, b) FRAME_PROFILE_CONCAT_(a, b)
+
+// Times the rest of the enclosing block as `name` on the active Cpu::FrameProfiler
+#define FRAME_PROFILE(name) Cpu::ProfileScope FRAME_PROFILE_CONCAT(_frameProfileScope, __LINE__)(name)
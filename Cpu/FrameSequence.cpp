@@ -0,0 +1,168 @@
+#include "FrameSequence.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+namespace Cpu
+{
+    namespace
+    {
+        const char kMagic[4] = { 'R', 'A', 'Y', 'S' };
+        const uint32_t kVersion = 1;
+
+        struct FileHeader
+        {
+            char magic[4];
+            uint32_t version;
+            uint32_t width;
+            uint32_t height;
+            uint32_t targetMask;
+        };
+
+        const char* kTargetNames[kFrameTargetCount] =
+        {
+            "WorldPosition",
+            "NormalRoughness",
+            "Albedo",
+            "MotionVector",
+            "SVGF_LinearZ",
+            "SVGF_CompactNormDepth",
+            "Shadow",
+            "Reflection",
+            "AO",
+        };
+
+        struct FileCloser
+        {
+            void operator()(FILE* file) const { if (file) fclose(file); }
+        };
+    }
+
+    const char* GetFrameTargetName(FrameTarget target)
+    {
+        return kTargetNames[uint32_t(target)];
+    }
+
+    void FrameData::Resize(uint32_t w, uint32_t h)
+    {
+        width = w;
+        height = h;
+        for (uint32_t i = 0; i < kFrameTargetCount; ++i)
+        {
+            if (targetMask & (1u << i)) targets[i].Resize(w, h);
+            else targets[i] = Image4F();
+        }
+    }
+
+    size_t FrameData::GetSizeInBytes() const
+    {
+        size_t bytes = 0;
+        for (const auto& target : targets) bytes += target.GetSizeInBytes();
+        return bytes;
+    }
+
+    std::string GetFramePath(const std::string& directory, uint32_t frameIndex)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "frame_%05u.rays", frameIndex);
+        return directory.empty() ? std::string(name) : directory + "/" + name;
+    }
+
+    bool SaveFrame(const std::string& path, const FrameData& frame)
+    {
+        std::unique_ptr<FILE, FileCloser> file(fopen(path.c_str(), "wb"));
+        if (!file) return false;
+
+        FileHeader header;
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.width = frame.width;
+        header.height = frame.height;
+        header.targetMask = frame.targetMask;
+        if (fwrite(&header, sizeof(header), 1, file.get()) != 1) return false;
+
+        for (uint32_t i = 0; i < kFrameTargetCount; ++i)
+        {
+            if ((frame.targetMask & (1u << i)) == 0) continue;
+
+            const Image4F& image = frame.targets[i];
+            if (image.GetWidth() != frame.width || image.GetHeight() != frame.height) return false;
+            if (fwrite(image.GetData(), sizeof(float4), image.GetPixelCount(), file.get()) != image.GetPixelCount()) return false;
+        }
+
+        return true;
+    }
+
+    bool LoadFrame(const std::string& path, FrameData& frame)
+    {
+        std::unique_ptr<FILE, FileCloser> file(fopen(path.c_str(), "rb"));
+        if (!file) return false;
+
+        FileHeader header;
+        if (fread(&header, sizeof(header), 1, file.get()) != 1) return false;
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion) return false;
+
+        frame.targetMask = header.targetMask & ((1u << kFrameTargetCount) - 1);
+        frame.Resize(header.width, header.height);
+
+        for (uint32_t i = 0; i < kFrameTargetCount; ++i)
+        {
+            if ((frame.targetMask & (1u << i)) == 0) continue;
+
+            Image4F& image = frame.targets[i];
+            if (fread(image.GetData(), sizeof(float4), image.GetPixelCount(), file.get()) != image.GetPixelCount()) return false;
+        }
+
+        return true;
+    }
+
+    uint32_t CountSequenceFrames(const std::string& directory)
+    {
+        uint32_t count = 0;
+        while (true)
+        {
+            std::unique_ptr<FILE, FileCloser> file(fopen(GetFramePath(directory, count).c_str(), "rb"));
+            if (!file) break;
+            count++;
+        }
+        return count;
+    }
+
+    void ResampleFrame(const FrameData& source, uint32_t width, uint32_t height, FrameData& result)
+    {
+        result.targetMask = source.targetMask;
+        result.Resize(width, height);
+
+        // Derivatives are per pixel, so they grow as pixels get bigger
+        const float derivativeScale = float(source.width) / float(width);
+
+        for (uint32_t i = 0; i < kFrameTargetCount; ++i)
+        {
+            if ((source.targetMask & (1u << i)) == 0) continue;
+
+            const FrameTarget target = FrameTarget(i);
+            const Image4F& src = source.targets[i];
+            Image4F& dst = result.targets[i];
+
+            for (uint32_t y = 0; y < height; ++y)
+            {
+                const uint32_t sy = std::min(source.height - 1, uint32_t((y + 0.5f) * source.height / height));
+                for (uint32_t x = 0; x < width; ++x)
+                {
+                    const uint32_t sx = std::min(source.width - 1, uint32_t((x + 0.5f) * source.width / width));
+                    float4 value = src.At(sx, sy);
+
+                    if (target == FrameTarget::SVGF_LinearZ) value.y *= derivativeScale;
+                    else if (target == FrameTarget::SVGF_CompactNormDepth) value.z *= derivativeScale;
+                    else if (target == FrameTarget::MotionVector)
+                    {
+                        value.z *= derivativeScale;
+                        value.w *= derivativeScale;
+                    }
+
+                    dst.At(x, y) = value;
+                }
+            }
+        }
+    }
+}
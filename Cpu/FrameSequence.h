@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include "Image.h"
+
+namespace Cpu
+{
+    // The G-buffer targets written by RaysRenderer::RenderGBuffer followed by the noisy ray traced signals
+    enum class FrameTarget : uint32_t
+    {
+        WorldPosition = 0,
+        NormalRoughness,
+        Albedo,
+        MotionVector,
+        SVGF_LinearZ,
+        SVGF_CompactNormDepth,
+        Shadow,
+        Reflection,
+        AO,
+        Count
+    };
+
+    const uint32_t kFrameTargetCount = uint32_t(FrameTarget::Count);
+
+    const char* GetFrameTargetName(FrameTarget target);
+
+    // One recorded frame. Every target is stored as float4 regardless of its GPU format;
+    // single channel targets (R8Unorm shadow/AO) land in .x with .yzw = (0, 0, 1), like a Texture2D load.
+    struct FrameData
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t targetMask = 0;
+        std::array<Image4F, kFrameTargetCount> targets;
+
+        void Resize(uint32_t w, uint32_t h);
+        bool HasTarget(FrameTarget target) const { return (targetMask & (1u << uint32_t(target))) != 0; }
+        Image4F& Get(FrameTarget target) { return targets[uint32_t(target)]; }
+        const Image4F& Get(FrameTarget target) const { return targets[uint32_t(target)]; }
+        size_t GetSizeInBytes() const;
+    };
+
+    // A recorded sequence is a directory of frame_00000.rays, frame_00001.rays, ... files.
+    // File layout: "RAYS", version, width, height, target mask, then width * height float4 per present target in FrameTarget order.
+    std::string GetFramePath(const std::string& directory, uint32_t frameIndex);
+    bool SaveFrame(const std::string& path, const FrameData& frame);
+    bool LoadFrame(const std::string& path, FrameData& frame);
+
+    // Counts consecutive frames starting at frame_00000
+    uint32_t CountSequenceFrames(const std::string& directory);
+
+    // Nearest neighbour resample to another resolution. Per-pixel derivatives (linearZ.y, compactNormDepth.z,
+    // motion.zw) are rescaled so the edge-stopping functions see the same geometry.
+    void ResampleFrame(const FrameData& source, uint32_t width, uint32_t height, FrameData& result);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstring>
+#include "Image.h"
+
+namespace Cpu
+{
+    // IEEE 754 binary16 conversion with round to nearest even, like the GPU does when writing a 16F target
+    inline uint16_t FloatToHalf(float value)
+    {
+        uint32_t f;
+        std::memcpy(&f, &value, sizeof(f));
+
+        const uint32_t sign = (f >> 16) & 0x8000u;
+        const uint32_t absF = f & 0x7fffffffu;
+
+        if (absF >= 0x7f800000u) return uint16_t(sign | 0x7c00u | (absF > 0x7f800000u ? 0x200u : 0u)); // Inf, NaN
+        if (absF >= 0x477ff000u) return uint16_t(sign | 0x7c00u); // Rounds past the largest half
+
+        if (absF < 0x38800000u) // Denormal or zero
+        {
+            if (absF < 0x33000000u) return uint16_t(sign);
+            const uint32_t mantissa = (absF & 0x007fffffu) | 0x00800000u;
+            const uint32_t shift = 126u - (absF >> 23);
+            const uint32_t halfMantissa = mantissa >> shift;
+            const uint32_t remainder = mantissa & ((1u << shift) - 1u);
+            const uint32_t halfway = 1u << (shift - 1u);
+            const uint32_t round = (remainder > halfway || (remainder == halfway && (halfMantissa & 1u))) ? 1u : 0u;
+            return uint16_t(sign | (halfMantissa + round));
+        }
+
+        const uint32_t rounded = absF + 0x00000fffu + ((absF >> 13) & 1u);
+        return uint16_t(sign | ((rounded - 0x38000000u) >> 13));
+    }
+
+    inline float HalfToFloat(uint16_t value)
+    {
+        const uint32_t sign = uint32_t(value & 0x8000u) << 16;
+        const uint32_t exponent = (value >> 10) & 0x1fu;
+        uint32_t mantissa = value & 0x3ffu;
+        uint32_t f;
+
+        if (exponent == 0x1fu)
+        {
+            f = sign | 0x7f800000u | (mantissa << 13);
+        }
+        else if (exponent != 0)
+        {
+            f = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+        }
+        else if (mantissa != 0)
+        {
+            uint32_t e = 113u;
+            while (!(mantissa & 0x400u))
+            {
+                mantissa <<= 1;
+                --e;
+            }
+            f = sign | (e << 23) | ((mantissa & 0x3ffu) << 13);
+        }
+        else
+        {
+            f = sign;
+        }
+
+        float result;
+        std::memcpy(&result, &f, sizeof(result));
+        return result;
+    }
+
+    // fp16 image with 1 to 4 channels, the CPU stand-in for an R16F/RG16F/RGBA16F texture
+    class HalfImage
+    {
+    public:
+        void Resize(uint32_t width, uint32_t height, uint32_t channelCount)
+        {
+            mChannelCount = channelCount;
+            mData.Resize(width * channelCount, height);
+        }
+
+        uint32_t GetWidth() const { return mChannelCount ? mData.GetWidth() / mChannelCount : 0; }
+        uint32_t GetHeight() const { return mData.GetHeight(); }
+        size_t GetSizeInBytes() const { return mData.GetSizeInBytes(); }
+        void Fill(float value) { mData.Fill(FloatToHalf(value)); }
+
+        // Missing channels and out of bounds loads read zero, same as Texture2D.Load
+        float4 Load(const int2& p) const
+        {
+            if (p.x < 0 || p.y < 0 || p.x >= int(GetWidth()) || p.y >= int(GetHeight())) return float4();
+
+            const uint16_t* texel = mData.GetRow(p.y) + size_t(p.x) * mChannelCount;
+            float channels[4] = {};
+            for (uint32_t i = 0; i < mChannelCount; ++i) channels[i] = HalfToFloat(texel[i]);
+            return float4(channels[0], channels[1], channels[2], channels[3]);
+        }
+
+        // Channels past mChannelCount are dropped
+        void Store(const int2& p, const float4& value)
+        {
+            uint16_t* texel = mData.GetRow(p.y) + size_t(p.x) * mChannelCount;
+            const float channels[4] = { value.x, value.y, value.z, value.w };
+            for (uint32_t i = 0; i < mChannelCount; ++i) texel[i] = FloatToHalf(channels[i]);
+        }
+
+    private:
+        uint32_t mChannelCount = 0;
+        Image<uint16_t> mData;
+    };
+}
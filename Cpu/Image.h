@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "VectorMath.h"
+
+namespace Cpu
+{
+    // Plain 2D pixel buffer, the CPU stand-in for a Texture2D
+    template<typename T>
+    class Image
+    {
+    public:
+        Image() = default;
+        Image(uint32_t width, uint32_t height, const T& value = T()) { Resize(width, height, value); }
+
+        void Resize(uint32_t width, uint32_t height, const T& value = T())
+        {
+            mWidth = width;
+            mHeight = height;
+            mData.assign(size_t(width) * height, value);
+        }
+
+        void Fill(const T& value) { std::fill(mData.begin(), mData.end(), value); }
+
+        uint32_t GetWidth() const { return mWidth; }
+        uint32_t GetHeight() const { return mHeight; }
+        size_t GetPixelCount() const { return mData.size(); }
+        size_t GetSizeInBytes() const { return mData.size() * sizeof(T); }
+        bool IsEmpty() const { return mData.empty(); }
+
+        bool IsInside(int x, int y) const { return x >= 0 && y >= 0 && x < int(mWidth) && y < int(mHeight); }
+
+        T& At(int x, int y) { return mData[size_t(y) * mWidth + x]; }
+        const T& At(int x, int y) const { return mData[size_t(y) * mWidth + x]; }
+        T& At(const int2& p) { return At(p.x, p.y); }
+        const T& At(const int2& p) const { return At(p.x, p.y); }
+
+        // Out of bounds loads return zero, same as Texture2D.Load
+        T Load(int x, int y) const { return IsInside(x, y) ? At(x, y) : T(); }
+        T Load(const int2& p) const { return Load(p.x, p.y); }
+
+        T* GetRow(int y) { return mData.data() + size_t(y) * mWidth; }
+        const T* GetRow(int y) const { return mData.data() + size_t(y) * mWidth; }
+        T* GetData() { return mData.data(); }
+        const T* GetData() const { return mData.data(); }
+
+    private:
+        uint32_t mWidth = 0;
+        uint32_t mHeight = 0;
+        std::vector<T> mData;
+    };
+
+    using ImageF = Image<float>;
+    using Image4F = Image<float4>;
+}
@@ -0,0 +1,335 @@
+#include "ImageMetrics.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include "Sampling.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        // LDR-FLIP's constants, named as in the paper
+        const float kQc = 0.7f;     // Color difference exponent
+        const float kQf = 0.5f;     // Feature difference exponent
+        const float kPc = 0.4f;     // Share of the largest color difference mapped below pt
+        const float kPt = 0.95f;
+        const float kGw = 0.082f;   // Feature detector width in degrees
+
+        // One contrast sensitivity function, a sum of two Gaussians over the distance in degrees
+        struct Csf
+        {
+            float a1, b1, a2, b2;
+        };
+
+        const Csf kCsfAchromatic = { 1.0f, 0.0047f, 0.0f, 1e-5f };
+        const Csf kCsfRedGreen = { 1.0f, 0.0053f, 0.0f, 1e-5f };
+        const Csf kCsfBlueYellow = { 34.1f, 0.04f, 13.5f, 0.025f };
+
+        // SSIM's stabilizers for a dynamic range of 1
+        const float kSsimC1 = 0.01f * 0.01f;
+        const float kSsimC2 = 0.03f * 0.03f;
+
+        bool IsMasked(const Image4F* mask, size_t i) { return mask && mask->GetData()[i].w == 0.0f; }
+
+        void ForEachRow(ThreadPool* threadPool, uint32_t height, const std::function<void(int y)>& fn)
+        {
+            if (threadPool)
+            {
+                threadPool->ParallelFor(height, [&](uint32_t y, uint32_t) { fn(int(y)); });
+            }
+            else
+            {
+                for (uint32_t y = 0; y < height; ++y) fn(int(y));
+            }
+        }
+
+        // Separable convolution with a kernel of its own per channel, 2 * radius + 1 taps along x and along y
+        void Convolve(const Image4F& source, const std::vector<float4>& kernelX, const std::vector<float4>& kernelY, Image4F& result, ThreadPool* threadPool)
+        {
+            const int width = int(source.GetWidth());
+            const int height = int(source.GetHeight());
+            const int radius = int(kernelX.size() / 2);
+
+            Image4F horizontal(source.GetWidth(), source.GetHeight());
+            ForEachRow(threadPool, source.GetHeight(), [&](int y)
+            {
+                const float4* row = source.GetRow(y);
+                float4* out = horizontal.GetRow(y);
+                for (int x = 0; x < width; ++x)
+                {
+                    float4 sum(0.0f);
+                    for (int k = -radius; k <= radius; ++k)
+                    {
+                        const float4& v = row[std::min(std::max(x + k, 0), width - 1)];
+                        const float4& w = kernelX[k + radius];
+                        sum = sum + float4(v.x * w.x, v.y * w.y, v.z * w.z, v.w * w.w);
+                    }
+                    out[x] = sum;
+                }
+            });
+
+            result.Resize(source.GetWidth(), source.GetHeight());
+            ForEachRow(threadPool, horizontal.GetHeight(), [&](int y)
+            {
+                float4* out = result.GetRow(y);
+                for (int x = 0; x < width; ++x)
+                {
+                    float4 sum(0.0f);
+                    for (int k = -radius; k <= radius; ++k)
+                    {
+                        const float4& v = horizontal.At(x, std::min(std::max(y + k, 0), height - 1));
+                        const float4& w = kernelY[k + radius];
+                        sum = sum + float4(v.x * w.x, v.y * w.y, v.z * w.z, v.w * w.w);
+                    }
+                    out[x] = sum;
+                }
+            });
+        }
+
+        // exp(-x^2 / (2 sigma^2)) over [-radius, radius], taps summing to 1
+        std::vector<float> GetGaussian(int radius, float sigma)
+        {
+            std::vector<float> taps(size_t(2 * radius + 1));
+            float sum = 0.0f;
+            for (int x = -radius; x <= radius; ++x)
+            {
+                taps[x + radius] = std::exp(-float(x * x) / (2.0f * sigma * sigma));
+                sum += taps[x + radius];
+            }
+            for (float& tap : taps) tap /= sum;
+            return taps;
+        }
+
+        // Positive taps summing to 1 and negative ones to -1, as FLIP normalizes its feature detectors
+        void NormalizeSigned(std::vector<float>& taps)
+        {
+            float positive = 0.0f, negative = 0.0f;
+            for (float tap : taps) (tap > 0.0f ? positive : negative) += tap;
+            for (float& tap : taps) tap = tap > 0.0f ? tap / positive : tap < 0.0f ? tap / -negative : 0.0f;
+        }
+
+        // Linear sRGB to CIE XYZ and back, D65
+        float3 LinearToXyz(const float3& c)
+        {
+            return float3(0.4123908f * c.x + 0.3575843f * c.y + 0.1804808f * c.z,
+                0.2126390f * c.x + 0.7151687f * c.y + 0.0721923f * c.z,
+                0.0193308f * c.x + 0.1191948f * c.y + 0.9505322f * c.z);
+        }
+
+        float3 XyzToLinear(const float3& c)
+        {
+            return float3(3.2409699f * c.x - 1.5373832f * c.y - 0.4986108f * c.z,
+                -0.9692436f * c.x + 1.8759675f * c.y + 0.0415551f * c.z,
+                0.0556301f * c.x - 0.2039770f * c.y + 1.0569715f * c.z);
+        }
+
+        const float3 kWhite(0.9505559f, 1.0f, 1.0890578f);
+
+        // The opponent space FLIP filters in: Y like L*, Cx red-green and Cz blue-yellow
+        float3 XyzToYcxcz(const float3& c)
+        {
+            const float3 n(c.x / kWhite.x, c.y / kWhite.y, c.z / kWhite.z);
+            return float3(116.0f * n.y - 16.0f, 500.0f * (n.x - n.y), 200.0f * (n.y - n.z));
+        }
+
+        float3 YcxczToXyz(const float3& c)
+        {
+            const float y = (c.x + 16.0f) / 116.0f;
+            return float3((c.y / 500.0f + y) * kWhite.x, y * kWhite.y, (y - c.z / 200.0f) * kWhite.z);
+        }
+
+        float LabF(float t)
+        {
+            const float delta = 6.0f / 29.0f;
+            return t > delta * delta * delta ? std::cbrt(t) : t / (3.0f * delta * delta) + 4.0f / 29.0f;
+        }
+
+        // L*a*b* with a* and b* scaled by L* / 100, so dark colors differ less (the Hunt effect)
+        float3 LinearToHuntLab(const float3& c)
+        {
+            const float3 xyz = LinearToXyz(c);
+            const float fx = LabF(xyz.x / kWhite.x);
+            const float fy = LabF(xyz.y / kWhite.y);
+            const float fz = LabF(xyz.z / kWhite.z);
+            const float L = 116.0f * fy - 16.0f;
+            return float3(L, 0.01f * L * 500.0f * (fx - fy), 0.01f * L * 200.0f * (fy - fz));
+        }
+
+        float GetHyab(const float3& a, const float3& b)
+        {
+            const float da = a.y - b.y;
+            const float db = a.z - b.z;
+            return std::abs(a.x - b.x) + std::sqrt(da * da + db * db);
+        }
+
+        float3 Saturate(const float3& c)
+        {
+            return float3(std::min(std::max(c.x, 0.0f), 1.0f), std::min(std::max(c.y, 0.0f), 1.0f), std::min(std::max(c.z, 0.0f), 1.0f));
+        }
+
+        float GetLength(float x, float y) { return std::sqrt(x * x + y * y); }
+
+        // Mean of value(i) over the pixels the mask keeps
+        float GetMaskedMean(size_t pixelCount, const Image4F* mask, const std::function<double(size_t i)>& value)
+        {
+            double sum = 0.0;
+            size_t count = 0;
+            for (size_t i = 0; i < pixelCount; ++i)
+            {
+                if (IsMasked(mask, i)) continue;
+                sum += value(i);
+                count++;
+            }
+            return count > 0 ? float(sum / double(count)) : 0.0f;
+        }
+    }
+
+    float GetRmse(const Image4F& test, const Image4F& reference, const Image4F* mask)
+    {
+        const float meanSquared = GetMaskedMean(test.GetPixelCount(), mask, [&](size_t i)
+        {
+            const float3 d = test.GetData()[i].rgb() - reference.GetData()[i].rgb();
+            return double(dot(d, d)) / 3.0;
+        });
+        return std::sqrt(meanSquared);
+    }
+
+    float GetSsim(const Image4F& test, const Image4F& reference, const Image4F* mask, ThreadPool* threadPool)
+    {
+        const uint32_t width = test.GetWidth();
+        const uint32_t height = test.GetHeight();
+
+        // Local means of t, r, t^2, r^2 and t * r
+        Image4F moments(width, height), crossMoments(width, height);
+        for (size_t i = 0; i < test.GetPixelCount(); ++i)
+        {
+            const float t = luminance(test.GetData()[i].rgb());
+            const float r = luminance(reference.GetData()[i].rgb());
+            moments.GetData()[i] = float4(t, r, t * t, r * r);
+            crossMoments.GetData()[i] = float4(t * r, 0.0f, 0.0f, 0.0f);
+        }
+        std::vector<float4> window;
+        for (float tap : GetGaussian(5, 1.5f)) window.push_back(float4(tap));
+        Convolve(moments, window, window, moments, threadPool);
+        Convolve(crossMoments, window, window, crossMoments, threadPool);
+
+        return GetMaskedMean(test.GetPixelCount(), mask, [&](size_t i)
+        {
+            const float4& m = moments.GetData()[i];
+            const float varianceT = m.z - m.x * m.x;
+            const float varianceR = m.w - m.y * m.y;
+            const float covariance = crossMoments.GetData()[i].x - m.x * m.y;
+            return double((2.0f * m.x * m.y + kSsimC1) * (2.0f * covariance + kSsimC2)) /
+                double((m.x * m.x + m.y * m.y + kSsimC1) * (varianceT + varianceR + kSsimC2));
+        });
+    }
+
+    float GetFlip(const Image4F& test, const Image4F& reference, float pixelsPerDegree, const Image4F* mask, ThreadPool* threadPool)
+    {
+        const uint32_t width = test.GetWidth();
+        const uint32_t height = test.GetHeight();
+        const size_t pixelCount = test.GetPixelCount();
+
+        // Displayed colors, and the relative luminance the feature detectors run on. Decoding the sRGB a display is sent
+        // gives back the clamped linear color, so there is no encoding round trip.
+        Image4F opponent[2], luma[2];
+        const Image4F* images[2] = { &test, &reference };
+        for (uint32_t j = 0; j < 2; ++j)
+        {
+            opponent[j].Resize(width, height);
+            luma[j].Resize(width, height);
+            for (size_t i = 0; i < pixelCount; ++i)
+            {
+                const float3 c = XyzToYcxcz(LinearToXyz(Saturate(images[j]->GetData()[i].rgb())));
+                opponent[j].GetData()[i] = float4(c.x, c.y, c.z, c.z);     // Cz twice, once per Gaussian of its CSF
+                luma[j].GetData()[i] = float4((c.x + 16.0f) / 116.0f);
+            }
+        }
+
+        // The CSFs sampled at pixel distances over the reach of the widest one. A sum of two Gaussians is the weighted
+        // sum of the two normalized Gaussians' separable filters.
+        const float degreesPerPixel = 1.0f / pixelsPerDegree;
+        const int csfRadius = int(std::ceil(3.0f * std::sqrt(kCsfBlueYellow.b1 / (2.0f * kPi * kPi)) * pixelsPerDegree));
+        auto getCsfTaps = [&](float b, float& sum)
+        {
+            std::vector<float> taps;
+            sum = 0.0f;
+            for (int x = -csfRadius; x <= csfRadius; ++x)
+            {
+                const float d = float(x) * degreesPerPixel;
+                taps.push_back(std::exp(-kPi * kPi * d * d / b));
+                sum += taps.back();
+            }
+            for (float& tap : taps) tap /= sum;
+            return taps;
+        };
+        float sums[4];
+        const std::vector<float> achromatic = getCsfTaps(kCsfAchromatic.b1, sums[0]);
+        const std::vector<float> redGreen = getCsfTaps(kCsfRedGreen.b1, sums[1]);
+        const std::vector<float> blueYellow1 = getCsfTaps(kCsfBlueYellow.b1, sums[2]);
+        const std::vector<float> blueYellow2 = getCsfTaps(kCsfBlueYellow.b2, sums[3]);
+        const float mass1 = kCsfBlueYellow.a1 * std::sqrt(kPi / kCsfBlueYellow.b1) * sums[2] * sums[2];
+        const float mass2 = kCsfBlueYellow.a2 * std::sqrt(kPi / kCsfBlueYellow.b2) * sums[3] * sums[3];
+        const float blueYellowWeight1 = mass1 / (mass1 + mass2);
+
+        std::vector<float4> csf;
+        for (size_t k = 0; k < achromatic.size(); ++k) csf.push_back(float4(achromatic[k], redGreen[k], blueYellow1[k], blueYellow2[k]));
+        for (uint32_t j = 0; j < 2; ++j) Convolve(opponent[j], csf, csf, opponent[j], threadPool);
+
+        // Edges are the first derivative of a Gaussian, points the second, along x in (x, z) and along y in (y, w)
+        const float featureSigma = 0.5f * kGw * pixelsPerDegree;
+        const int featureRadius = int(std::ceil(3.0f * featureSigma));
+        const std::vector<float> gaussian = GetGaussian(featureRadius, featureSigma);
+        std::vector<float> edge, point;
+        for (int x = -featureRadius; x <= featureRadius; ++x)
+        {
+            const float g = std::exp(-float(x * x) / (2.0f * featureSigma * featureSigma));
+            edge.push_back(-float(x) * g);
+            point.push_back((float(x * x) / (featureSigma * featureSigma) - 1.0f) * g);
+        }
+        NormalizeSigned(edge);
+        NormalizeSigned(point);
+        std::vector<float4> featureX, featureY;
+        for (size_t k = 0; k < gaussian.size(); ++k)
+        {
+            featureX.push_back(float4(edge[k], gaussian[k], point[k], gaussian[k]));
+            featureY.push_back(float4(gaussian[k], edge[k], gaussian[k], point[k]));
+        }
+        for (uint32_t j = 0; j < 2; ++j) Convolve(luma[j], featureX, featureY, luma[j], threadPool);
+
+        const float maxColorDifference = std::pow(GetHyab(LinearToHuntLab(float3(0.0f, 1.0f, 0.0f)), LinearToHuntLab(float3(0.0f, 0.0f, 1.0f))), kQc);
+        const float knee = kPc * maxColorDifference;
+
+        return GetMaskedMean(pixelCount, mask, [&](size_t i)
+        {
+            float3 lab[2];
+            for (uint32_t j = 0; j < 2; ++j)
+            {
+                const float4& c = opponent[j].GetData()[i];
+                const float3 filtered(c.x, c.y, blueYellowWeight1 * c.z + (1.0f - blueYellowWeight1) * c.w);
+                lab[j] = LinearToHuntLab(Saturate(XyzToLinear(YcxczToXyz(filtered))));
+            }
+            // Differences up to pc of the largest map to [0, pt], the rest to [pt, 1]
+            const float color = std::pow(GetHyab(lab[0], lab[1]), kQc);
+            const float colorError = color < knee ? kPt / knee * color : kPt + (color - knee) / (maxColorDifference - knee) * (1.0f - kPt);
+
+            const float4& t = luma[0].GetData()[i];
+            const float4& r = luma[1].GetData()[i];
+            const float feature = std::max(std::abs(GetLength(t.x, t.y) - GetLength(r.x, r.y)), std::abs(GetLength(t.z, t.w) - GetLength(r.z, r.w)));
+            const float featureError = std::pow(std::min(1.0f, feature / std::sqrt(2.0f)), kQf);
+            return double(std::pow(std::min(1.0f, colorError), 1.0f - featureError));
+        });
+    }
+
+    float GetFlicker(const Image4F& test, const Image4F& prevTest, const Image4F& reference, const Image4F& prevReference, const Image4F* mask)
+    {
+        const float meanSquared = GetMaskedMean(test.GetPixelCount(), mask, [&](size_t i)
+        {
+            const float3 testChange = test.GetData()[i].rgb() - prevTest.GetData()[i].rgb();
+            const float3 referenceChange = reference.GetData()[i].rgb() - prevReference.GetData()[i].rgb();
+            const float d = luminance(testChange - referenceChange);
+            return double(d) * d;
+        });
+        return std::sqrt(meanSquared);
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Image.h"
+#include "ThreadPool.h"
+
+// Full-reference image quality, for sweeps of the denoiser and ray budgets against converged references. Every metric
+// compares a test image with a reference of the same size over the pixels mask has w != 0 in, all of them when mask is
+// null. Filters run over the whole image and clamp at its borders.
+namespace Cpu
+{
+    // FLIP's default viewing setup: 0.7 m from a 0.7 m wide monitor of 3840 pixels
+    const float kFlipPixelsPerDegree = 67.0206f;
+
+    // Root mean square difference of rgb
+    float GetRmse(const Image4F& test, const Image4F& reference, const Image4F* mask = nullptr);
+
+    // Mean SSIM of the luminance (Wang et al. 2004) with the usual 11x11 Gaussian window of sigma 1.5 and a dynamic
+    // range of 1. 1 for identical images.
+    float GetSsim(const Image4F& test, const Image4F& reference, const Image4F* mask = nullptr, ThreadPool* threadPool = nullptr);
+
+    // Mean LDR-FLIP (Andersson et al. 2020): the HyAB difference of the images filtered by the contrast sensitivity of
+    // the eye, raised by how much their edges and points differ. rgb is linear and clamped to [0, 1], then encoded as
+    // sRGB the way a display shows it. 0 for identical images, 1 at most.
+    float GetFlip(const Image4F& test, const Image4F& reference, float pixelsPerDegree = kFlipPixelsPerDegree,
+        const Image4F* mask = nullptr, ThreadPool* threadPool = nullptr);
+
+    // Temporal instability: root mean square luminance of how much test changed since prevTest beyond what reference
+    // changed since prevReference. Flicker and lag count, what the camera moved in both images does not.
+    float GetFlicker(const Image4F& test, const Image4F& prevTest, const Image4F& reference, const Image4F& prevReference,
+        const Image4F* mask = nullptr);
+}
@@ -0,0 +1,411 @@
+#include <algorithm>
+#include <cmath>
+#include "IrradianceProbes.h"
+#include "Sampling.h"
+#include "Timer.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        // The thread group size of the shading pass
+        const uint32_t kTileSize = 16;
+
+        // Seed of the per-frame ray rotation, apart from the other RandInit(pixel, frameCount) users. Must match
+        // Data/IrradianceProbes.h.
+        const uint32_t kRotationSeed = 0x50524f42u;
+
+        // Exponent of the cosine that weights a ray's distance into a visibility texel, sharper than the irradiance
+        // weight so moments stay local
+        const float kDepthSharpness = 50.0f;
+
+        // DDGI shortens the distance of back face hits so probes inside geometry look occluded from outside
+        const float kBackfaceDistanceScale = 0.2f;
+
+        float3 SphericalFibonacci(uint32_t index, uint32_t count)
+        {
+            const float kGoldenRatio = 1.61803398875f;
+            const float phi = 2.0f * kPi * frac(float(index) / kGoldenRatio);
+            const float cosTheta = 1.0f - (2.0f * float(index) + 1.0f) / float(count);
+            const float sinTheta = std::sqrt(saturate(1.0f - cosTheta * cosTheta));
+            return float3(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta);
+        }
+
+        // Uniformly random unit quaternion (Shoemake), xyz the vector part
+        float4 GetRayRotation(uint32_t frameCount)
+        {
+            uint32_t seed = RandInit(frameCount, kRotationSeed);
+            const float u1 = RandNext(seed);
+            const float u2 = RandNext(seed) * 2.0f * kPi;
+            const float u3 = RandNext(seed) * 2.0f * kPi;
+            const float a = std::sqrt(1.0f - u1);
+            const float b = std::sqrt(u1);
+            return float4(a * std::sin(u2), a * std::cos(u2), b * std::sin(u3), b * std::cos(u3));
+        }
+
+        float3 Rotate(const float4& q, const float3& v)
+        {
+            const float3 u = q.rgb();
+            const float3 t = 2.0f * cross(u, v);
+            return v + q.w * t + cross(u, t);
+        }
+
+        // Center of an interior texel as a direction
+        float3 GetTexelDirection(uint32_t x, uint32_t y, uint32_t texels)
+        {
+            return OctDecode(float2((float(x) + 0.5f) / float(texels) * 2.0f - 1.0f, (float(y) + 0.5f) / float(texels) * 2.0f - 1.0f));
+        }
+
+        // Fills the border of the tile at `origin` from the opposite edges of the octahedral map
+        template<typename Copy>
+        void CopyTileBorder(const int2& origin, uint32_t texels, const Copy& copy)
+        {
+            const int n = int(texels);
+            for (int i = 1; i <= n; ++i)
+            {
+                copy(origin + int2(n + 1 - i, 1), origin + int2(i, 0));
+                copy(origin + int2(n + 1 - i, n), origin + int2(i, n + 1));
+                copy(origin + int2(1, n + 1 - i), origin + int2(0, i));
+                copy(origin + int2(n, n + 1 - i), origin + int2(n + 1, i));
+            }
+            copy(origin + int2(n, n), origin + int2(0, 0));
+            copy(origin + int2(1, n), origin + int2(n + 1, 0));
+            copy(origin + int2(n, 1), origin + int2(0, n + 1));
+            copy(origin + int2(1, 1), origin + int2(n + 1, n + 1));
+        }
+
+        // Bilinear sample of a tile at a continuous texel position, what a linear sampler does
+        template<typename T, typename Load>
+        T SampleBilinear(const float2& texel, const Load& load)
+        {
+            const float x = texel.x - 0.5f;
+            const float y = texel.y - 0.5f;
+            const int x0 = int(std::floor(x));
+            const int y0 = int(std::floor(y));
+            const float fx = x - float(x0);
+            const float fy = y - float(y0);
+            const T top = load(int2(x0, y0)) * (1.0f - fx) + load(int2(x0 + 1, y0)) * fx;
+            const T bottom = load(int2(x0, y0 + 1)) * (1.0f - fx) + load(int2(x0 + 1, y0 + 1)) * fx;
+            return top * (1.0f - fy) + bottom * fy;
+        }
+    }
+
+    void FitProbeGrid(const float3& boundsMin, const float3& boundsMax, IrradianceProbeSettings& settings)
+    {
+        settings.origin = boundsMin;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const int count = axis == 0 ? settings.counts.x : (axis == 1 ? settings.counts.y : settings.counts.z);
+            const float extent = std::max(boundsMax[axis] - boundsMin[axis], 1e-3f);
+            settings.spacing[axis] = count > 1 ? extent / float(count - 1) : extent;
+        }
+        settings.maxDistance = 1.5f * length(settings.spacing);
+    }
+
+    IrradianceProbes::IrradianceProbes(ThreadPool* threadPool)
+        : mThreadPool(threadPool ? threadPool : &ThreadPool::GetDefault())
+    {
+    }
+
+    uint32_t IrradianceProbes::GetProbeCount() const
+    {
+        const int3& c = mSettings.counts;
+        return uint32_t(std::max(c.x, 1) * std::max(c.y, 1) * std::max(c.z, 1));
+    }
+
+    uint32_t IrradianceProbes::GetProbesPerFrame() const
+    {
+        const uint32_t raysPerProbe = std::max(1u, mSettings.raysPerProbe);
+        return std::min(GetProbeCount(), std::max(1u, mSettings.raysPerFrame / raysPerProbe));
+    }
+
+    float3 IrradianceProbes::GetProbePosition(const int3& coords) const
+    {
+        return mSettings.origin + float3(float(coords.x), float(coords.y), float(coords.z)) * mSettings.spacing;
+    }
+
+    int3 IrradianceProbes::GetProbeCoords(uint32_t index) const
+    {
+        const int3 c(std::max(mSettings.counts.x, 1), std::max(mSettings.counts.y, 1), std::max(mSettings.counts.z, 1));
+        return int3(int(index % c.x), int((index / c.x) % c.y), int(index / (c.x * c.y)));
+    }
+
+    void IrradianceProbes::Reset()
+    {
+        mAllocatedCounts = int3(std::max(mSettings.counts.x, 1), std::max(mSettings.counts.y, 1), std::max(mSettings.counts.z, 1));
+        const uint32_t columns = uint32_t(mAllocatedCounts.x * mAllocatedCounts.y);
+        const uint32_t rows = uint32_t(mAllocatedCounts.z);
+        mIrradiance.Resize(columns * (kProbeIrradianceTexels + 2), rows * (kProbeIrradianceTexels + 2));
+        mVisibility.Resize(columns * (kProbeVisibilityTexels + 2), rows * (kProbeVisibilityTexels + 2), 2);
+        mVisibility.Fill(0.0f);
+        mDecodedIrradiance.Resize(mIrradiance.GetWidth(), mIrradiance.GetHeight());
+        mDecodedVisibility.Resize(mVisibility.GetWidth(), mVisibility.GetHeight());
+        mCursor = 0;
+        mUpdatedProbes = 0;
+    }
+
+    float3 IrradianceProbes::TraceRadiance(const TriangleScene& scene, const Bvh& bvh, const Ray& ray, bool multiBounce, float& distance, uint64_t& rays) const
+    {
+        RayHit hit;
+        rays++;
+        if (!bvh.Intersect(ray, hit))
+        {
+            distance = mSettings.maxDistance;
+            return mSettings.skyColor;
+        }
+
+        const float3 N = scene.GetNormal(hit.triangle, hit.u, hit.v);
+        if (dot(N, ray.direction) > 0.0f)
+        {
+            distance = std::min(hit.t, mSettings.maxDistance) * kBackfaceDistanceScale;
+            return float3();
+        }
+        distance = std::min(hit.t, mSettings.maxDistance);
+
+        const SceneMaterial& material = scene.GetTriangleMaterial(hit.triangle);
+        const float3 albedo = material.baseColor * (1.0f - material.metalness);
+        const float3 posW = ray.origin + ray.direction * hit.t;
+
+        float3 radiance;
+        for (uint32_t i = 0; i < scene.GetLightCount(); ++i)
+        {
+            const SceneLight& light = scene.GetLight(i);
+            Ray shadowRay;
+            float maxT;
+            GetLightDirection(light, posW, shadowRay.direction, maxT);
+            shadowRay.origin = posW;
+            shadowRay.direction = normalize(shadowRay.direction);
+            shadowRay.tMin = 0.001f;
+            shadowRay.tMax = std::max(0.01f, maxT);
+
+            const float NdotL = saturate(dot(N, shadowRay.direction));
+            if (NdotL <= 0.0f) continue;
+            rays++;
+            if (bvh.Occluded(shadowRay)) continue;
+
+            const float3 intensity = light.type == SceneLight::Type::Point ? light.intensity / std::max(1e-8f, maxT * maxT) : light.intensity;
+            radiance += albedo / kPi * intensity * NdotL;
+        }
+
+        if (multiBounce) radiance += albedo * Sample(posW, N);
+        return radiance;
+    }
+
+    void IrradianceProbes::Update(const TriangleScene& scene, const Bvh& bvh, uint32_t frameCount)
+    {
+        const Timer timer;
+
+        const int3 counts(std::max(mSettings.counts.x, 1), std::max(mSettings.counts.y, 1), std::max(mSettings.counts.z, 1));
+        if (mIrradiance.IsEmpty() || counts.x != mAllocatedCounts.x || counts.y != mAllocatedCounts.y || counts.z != mAllocatedCounts.z) Reset();
+
+        const uint32_t probeCount = GetProbeCount();
+        const uint32_t probesPerFrame = GetProbesPerFrame();
+        const uint32_t raysPerProbe = std::max(1u, mSettings.raysPerProbe);
+
+        const float4 rotation = GetRayRotation(frameCount);
+        std::vector<float3> directions(raysPerProbe);
+        for (uint32_t i = 0; i < raysPerProbe; ++i) directions[i] = Rotate(rotation, SphericalFibonacci(i, raysPerProbe));
+
+        // Trace every ray of the frame against the tiles as they were
+        mRayResults.resize(size_t(probesPerFrame) * raysPerProbe);
+        std::vector<uint64_t> threadRays(mThreadPool->GetThreadCount(), 0);
+        mThreadPool->ParallelFor(probesPerFrame, [&](uint32_t k, uint32_t threadIndex)
+        {
+            const uint32_t index = (mCursor + k) % probeCount;
+            Ray ray;
+            ray.origin = GetProbePosition(GetProbeCoords(index));
+            ray.tMin = 0.0f;
+            ray.tMax = 100000.0f;
+            for (uint32_t i = 0; i < raysPerProbe; ++i)
+            {
+                ray.direction = directions[i];
+                float distance;
+                const float3 radiance = TraceRadiance(scene, bvh, ray, mSettings.multiBounce, distance, threadRays[threadIndex]);
+                mRayResults[size_t(k) * raysPerProbe + i] = float4(radiance, distance);
+            }
+        });
+
+        // Tiles of different probes do not overlap
+        mThreadPool->ParallelFor(probesPerFrame, [&](uint32_t k, uint32_t)
+        {
+            const uint32_t index = (mCursor + k) % probeCount;
+            const float hysteresis = mUpdatedProbes + k < probeCount ? 0.0f : saturate(mSettings.hysteresis);
+            BlendProbe(index, &mRayResults[size_t(k) * raysPerProbe], directions, hysteresis);
+        });
+
+        mStats.firstProbe = mCursor;
+        mStats.probes = probesPerFrame;
+        mStats.rays = 0;
+        for (uint64_t rays : threadRays) mStats.rays += rays;
+
+        mCursor = (mCursor + probesPerFrame) % probeCount;
+        mUpdatedProbes += probesPerFrame;
+        mStats.elapsedMs = timer.GetElapsedMs();
+    }
+
+    void IrradianceProbes::BlendProbe(uint32_t index, const float4* rayResults, const std::vector<float3>& directions, float hysteresis)
+    {
+        const uint32_t columns = uint32_t(mAllocatedCounts.x * mAllocatedCounts.y);
+        const uint32_t rayCount = uint32_t(directions.size());
+
+        const uint32_t irradianceTile = kProbeIrradianceTexels + 2;
+        const int2 irradianceOrigin(int(index % columns * irradianceTile), int(index / columns * irradianceTile));
+        for (uint32_t y = 0; y < kProbeIrradianceTexels; ++y)
+        {
+            for (uint32_t x = 0; x < kProbeIrradianceTexels; ++x)
+            {
+                const float3 texelDirection = GetTexelDirection(x, y, kProbeIrradianceTexels);
+                float3 sum;
+                float weightSum = 0.0f;
+                for (uint32_t i = 0; i < rayCount; ++i)
+                {
+                    const float weight = std::max(0.0f, dot(texelDirection, directions[i]));
+                    sum += rayResults[i].rgb() * weight;
+                    weightSum += weight;
+                }
+                if (weightSum <= 0.0f) continue;
+
+                uint32_t& texel = mIrradiance.At(irradianceOrigin + int2(int(x) + 1, int(y) + 1));
+                texel = PackR11G11B10(lerp(sum / weightSum, UnpackR11G11B10(texel), hysteresis));
+            }
+        }
+        CopyTileBorder(irradianceOrigin, kProbeIrradianceTexels, [this](const int2& from, const int2& to) { mIrradiance.At(to) = mIrradiance.At(from); });
+        for (uint32_t y = 0; y < irradianceTile; ++y)
+        {
+            for (uint32_t x = 0; x < irradianceTile; ++x)
+            {
+                const int2 p = irradianceOrigin + int2(int(x), int(y));
+                mDecodedIrradiance.At(p) = UnpackR11G11B10(mIrradiance.At(p));
+            }
+        }
+
+        const uint32_t visibilityTile = kProbeVisibilityTexels + 2;
+        const int2 visibilityOrigin(int(index % columns * visibilityTile), int(index / columns * visibilityTile));
+        for (uint32_t y = 0; y < kProbeVisibilityTexels; ++y)
+        {
+            for (uint32_t x = 0; x < kProbeVisibilityTexels; ++x)
+            {
+                const float3 texelDirection = GetTexelDirection(x, y, kProbeVisibilityTexels);
+                float2 sum;
+                float weightSum = 0.0f;
+                for (uint32_t i = 0; i < rayCount; ++i)
+                {
+                    const float weight = std::pow(std::max(0.0f, dot(texelDirection, directions[i])), kDepthSharpness);
+                    const float distance = rayResults[i].w;
+                    sum += float2(distance, distance * distance) * weight;
+                    weightSum += weight;
+                }
+                if (weightSum <= 0.0f) continue;
+
+                const int2 p = visibilityOrigin + int2(int(x) + 1, int(y) + 1);
+                const float2 moments = lerp(sum / weightSum, mVisibility.Load(p).xy(), hysteresis);
+                mVisibility.Store(p, float4(moments.x, moments.y, 0.0f, 0.0f));
+            }
+        }
+        CopyTileBorder(visibilityOrigin, kProbeVisibilityTexels, [this](const int2& from, const int2& to) { mVisibility.Store(to, mVisibility.Load(from)); });
+        for (uint32_t y = 0; y < visibilityTile; ++y)
+        {
+            for (uint32_t x = 0; x < visibilityTile; ++x)
+            {
+                const int2 p = visibilityOrigin + int2(int(x), int(y));
+                mDecodedVisibility.At(p) = mVisibility.Load(p).xy();
+            }
+        }
+    }
+
+    float3 IrradianceProbes::SampleIrradianceTile(uint32_t index, const float3& direction) const
+    {
+        const uint32_t columns = uint32_t(mAllocatedCounts.x * mAllocatedCounts.y);
+        const uint32_t tile = kProbeIrradianceTexels + 2;
+        const float2 oct = OctEncode(direction);
+        const float2 texel(float(index % columns * tile) + 1.0f + (oct.x * 0.5f + 0.5f) * float(kProbeIrradianceTexels),
+            float(index / columns * tile) + 1.0f + (oct.y * 0.5f + 0.5f) * float(kProbeIrradianceTexels));
+        return SampleBilinear<float3>(texel, [this](const int2& p) { return mDecodedIrradiance.At(p); });
+    }
+
+    float2 IrradianceProbes::SampleVisibilityTile(uint32_t index, const float3& direction) const
+    {
+        const uint32_t columns = uint32_t(mAllocatedCounts.x * mAllocatedCounts.y);
+        const uint32_t tile = kProbeVisibilityTexels + 2;
+        const float2 oct = OctEncode(direction);
+        const float2 texel(float(index % columns * tile) + 1.0f + (oct.x * 0.5f + 0.5f) * float(kProbeVisibilityTexels),
+            float(index / columns * tile) + 1.0f + (oct.y * 0.5f + 0.5f) * float(kProbeVisibilityTexels));
+        return SampleBilinear<float2>(texel, [this](const int2& p) { return mDecodedVisibility.At(p); });
+    }
+
+    // SampleProbeIrradiance() in Data/IrradianceProbes.h
+    float3 IrradianceProbes::Sample(const float3& position, const float3& normal) const
+    {
+        if (mIrradiance.IsEmpty()) return float3();
+
+        const int3& counts = mAllocatedCounts;
+        const float3 biasedPosition = position + normal * mSettings.normalBias;
+        const float3 gridPosition = (biasedPosition - mSettings.origin) / mSettings.spacing;
+        const int3 baseCoords(std::min(std::max(int(std::floor(gridPosition.x)), 0), std::max(counts.x - 2, 0)),
+            std::min(std::max(int(std::floor(gridPosition.y)), 0), std::max(counts.y - 2, 0)),
+            std::min(std::max(int(std::floor(gridPosition.z)), 0), std::max(counts.z - 2, 0)));
+        const float3 basePosition = GetProbePosition(baseCoords);
+        const float3 alpha((biasedPosition.x - basePosition.x) / mSettings.spacing.x, (biasedPosition.y - basePosition.y) / mSettings.spacing.y,
+            (biasedPosition.z - basePosition.z) / mSettings.spacing.z);
+
+        float3 sum;
+        float weightSum = 0.0f;
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            const int3 offset(int(i & 1), int((i >> 1) & 1), int((i >> 2) & 1));
+            const int3 coords(std::min(baseCoords.x + offset.x, counts.x - 1), std::min(baseCoords.y + offset.y, counts.y - 1),
+                std::min(baseCoords.z + offset.z, counts.z - 1));
+            const uint32_t index = uint32_t(coords.x + counts.x * (coords.y + counts.y * coords.z));
+            const float3 probePosition = GetProbePosition(coords);
+
+            // Probes behind the surface count less
+            const float3 toProbe = probePosition - position;
+            const float toProbeLength = length(toProbe);
+            const float facing = toProbeLength > 1e-4f ? dot(toProbe / toProbeLength, normal) : 1.0f;
+            float weight = (facing + 1.0f) * (facing + 1.0f) * 0.25f + 0.2f;
+
+            // Chebyshev test against the probe's distance moments
+            const float3 probeToPoint = biasedPosition - probePosition;
+            const float distance = length(probeToPoint);
+            const float2 moments = SampleVisibilityTile(index, distance > 1e-4f ? probeToPoint / distance : normal);
+            if (distance > moments.x)
+            {
+                const float variance = std::fabs(moments.x * moments.x - moments.y);
+                const float d = distance - moments.x;
+                const float chebyshev = variance / (variance + d * d);
+                weight *= std::max(chebyshev * chebyshev * chebyshev, 0.05f);
+            }
+
+            const float tx = offset.x ? saturate(alpha.x) : 1.0f - saturate(alpha.x);
+            const float ty = offset.y ? saturate(alpha.y) : 1.0f - saturate(alpha.y);
+            const float tz = offset.z ? saturate(alpha.z) : 1.0f - saturate(alpha.z);
+            weight *= tx * ty * tz;
+
+            sum += SampleIrradianceTile(index, normal) * weight;
+            weightSum += weight;
+        }
+        return weightSum > 0.0f ? sum / weightSum : float3();
+    }
+
+    void IrradianceProbes::Shade(const RtGBuffer& gBuffer, Image4F& output) const
+    {
+        const uint32_t width = gBuffer.worldPosition->GetWidth();
+        const uint32_t height = gBuffer.worldPosition->GetHeight();
+        if (output.GetWidth() != width || output.GetHeight() != height) output.Resize(width, height);
+
+        mThreadPool->ParallelForTiles(width, height, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    const float4 posW = gBuffer.worldPosition->At(int(x), int(y));
+                    if (posW.w == 0.0f) continue;
+                    const float3 N = gBuffer.normalRoughness->At(int(x), int(y)).rgb();
+                    const float3 albedo = gBuffer.albedo->At(int(x), int(y)).rgb();
+                    output.At(int(x), int(y)) = float4(albedo * Sample(posW.rgb(), N), 1.0f);
+                }
+            }
+        });
+    }
+}
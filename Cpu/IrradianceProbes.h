@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Bvh.h"
+#include "HalfImage.h"
+#include "Image.h"
+#include "Shading.h"
+#include "ThreadPool.h"
+
+// CPU mirror of Data/IrradianceProbes.h. Keep the two in sync.
+namespace Cpu
+{
+    // Interior texels per side of a probe's octahedral tiles, the tiles have a one texel border on top
+    const uint32_t kProbeIrradianceTexels = 6;
+    const uint32_t kProbeVisibilityTexels = 14;
+
+    inline float2 SignNotZero(const float2& v)
+    {
+        return float2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+    }
+
+    // Unit direction to [-1, 1]^2, the lower hemisphere folded over the corners
+    inline float2 OctEncode(const float3& n)
+    {
+        const float invL1 = 1.0f / (std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z));
+        const float2 p(n.x * invL1, n.y * invL1);
+        if (n.z >= 0.0f) return p;
+        return float2(1.0f - std::fabs(p.y), 1.0f - std::fabs(p.x)) * SignNotZero(p);
+    }
+
+    inline float3 OctDecode(const float2& e)
+    {
+        float3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+        if (n.z < 0.0f)
+        {
+            const float2 folded = float2(1.0f - std::fabs(n.y), 1.0f - std::fabs(n.x)) * SignNotZero(float2(n.x, n.y));
+            n.x = folded.x;
+            n.y = folded.y;
+        }
+        return normalize(n);
+    }
+
+    // R11G11B10_FLOAT as the GPU stores it: fp16 without the sign and the low mantissa bits, rounded to nearest even.
+    // Negative values and NaN store 0, values past the largest one store the largest one.
+    inline uint32_t PackR11G11B10(const float3& value)
+    {
+        auto pack = [](float v, uint32_t droppedBits, uint32_t maxValue)
+        {
+            if (!(v > 0.0f)) return 0u;
+            const uint32_t half = FloatToHalf(v);
+            if (half >= 0x7c00u) return maxValue;
+            const uint32_t rounded = (half + (1u << (droppedBits - 1)) - 1u + ((half >> droppedBits) & 1u)) >> droppedBits;
+            return std::min(rounded, maxValue);
+        };
+        return pack(value.x, 4, 0x7bfu) | (pack(value.y, 4, 0x7bfu) << 11) | (pack(value.z, 5, 0x3dfu) << 22);
+    }
+
+    inline float3 UnpackR11G11B10(uint32_t packed)
+    {
+        return float3(HalfToFloat(uint16_t((packed & 0x7ffu) << 4)), HalfToFloat(uint16_t(((packed >> 11) & 0x7ffu) << 4)),
+            HalfToFloat(uint16_t(((packed >> 22) & 0x3ffu) << 5)));
+    }
+
+    // Same knobs as ::IrradianceProbePass, with the same defaults
+    struct IrradianceProbeSettings
+    {
+        float3 origin;                          // Position of probe (0, 0, 0)
+        float3 spacing = float3(1.0f);
+        int3 counts = int3(8, 4, 8);
+        uint32_t raysPerProbe = 64;
+        uint32_t raysPerFrame = 4096;           // Budget, raysPerFrame / raysPerProbe probes are updated per frame (at least one)
+        float hysteresis = 0.9f;                // Weight of a probe's old value when it is updated
+        float maxDistance = 4.0f;               // Distance stored for rays that miss
+        float normalBias = 0.1f;                // Lookups move this far along the normal, off the surface the probes saw
+        float3 skyColor = float3(0.2f, 0.6f, 0.9f); // Radiance of rays that miss, the miss color of the reflection rays
+        bool multiBounce = true;                // Hits add the probes' own irradiance, one more bounce per update
+    };
+
+    // Spreads the grid over a box, probes on its corners, and scales maxDistance with the spacing
+    void FitProbeGrid(const float3& boundsMin, const float3& boundsMax, IrradianceProbeSettings& settings);
+
+    struct IrradianceProbeStats
+    {
+        double elapsedMs = 0.0;
+        uint64_t rays = 0;          // Probe rays and the shadow rays of their hits
+        uint32_t firstProbe = 0;    // The round robin updated probes firstProbe onwards, wrapping around
+        uint32_t probes = 0;
+    };
+
+    // Headless implementation of ::IrradianceProbePass, a world-space probe grid caching diffuse GI (DDGI, Majercik et
+    // al. 2019). Every frame the next raysPerFrame / raysPerProbe probes of a round robin trace raysPerProbe rays in
+    // spherical Fibonacci directions, rotated randomly each frame. Hits gather the shadowed diffuse light of every
+    // light and, with multiBounce, the probes' own irradiance at the hit; misses see the sky. The results are blended
+    // into each probe's octahedral irradiance and distance tiles with hysteresis. Shading is a lookup of 8 probes,
+    // without a single ray per pixel. Update() traces and then blends, so lookups during tracing never see a half
+    // written tile.
+    class IrradianceProbes
+    {
+    public:
+        explicit IrradianceProbes(ThreadPool* threadPool = nullptr);
+
+        // Reallocates the atlases for the settings' counts and drops every probe. Update() does this too when the
+        // counts changed.
+        void Reset();
+
+        // The scene and bvh may change between frames, the probes catch up over the next cycles
+        void Update(const TriangleScene& scene, const Bvh& bvh, uint32_t frameCount);
+
+        // Irradiance / pi at a surface, the irradiance of probes not updated since Reset() is 0
+        float3 Sample(const float3& position, const float3& normal) const;
+
+        // Diffuse albedo * Sample() in .rgb for every pixel with geometry, the term Deferred.slang adds with PROBE_GI.
+        // Other pixels keep the clear value.
+        void Shade(const RtGBuffer& gBuffer, Image4F& output) const;
+
+        // Radiance a probe ray gathers and the distance it stores, shared with references that trace per pixel.
+        // rays counts the traced ray and its shadow rays.
+        float3 TraceRadiance(const TriangleScene& scene, const Bvh& bvh, const Ray& ray, bool multiBounce, float& distance, uint64_t& rays) const;
+
+        uint32_t GetProbeCount() const;
+        uint32_t GetProbesPerFrame() const;
+        float3 GetProbePosition(const int3& coords) const;
+        int3 GetProbeCoords(uint32_t index) const;
+
+        IrradianceProbeSettings& GetSettings() { return mSettings; }
+        const IrradianceProbeSettings& GetSettings() const { return mSettings; }
+        const IrradianceProbeStats& GetStats() const { return mStats; }
+
+        // R11G11B10 irradiance tiles and RG16 distance moment tiles, laid out as in Data/IrradianceProbes.h
+        const Image<uint32_t>& GetIrradianceAtlas() const { return mIrradiance; }
+        const HalfImage& GetVisibilityAtlas() const { return mVisibility; }
+        size_t GetSizeInBytes() const { return mIrradiance.GetSizeInBytes() + mVisibility.GetSizeInBytes(); }
+
+    private:
+        void BlendProbe(uint32_t index, const float4* rayResults, const std::vector<float3>& directions, float hysteresis);
+        float3 SampleIrradianceTile(uint32_t index, const float3& direction) const;
+        float2 SampleVisibilityTile(uint32_t index, const float3& direction) const;
+
+        ThreadPool* mThreadPool;
+        IrradianceProbeSettings mSettings;
+        IrradianceProbeStats mStats;
+
+        Image<uint32_t> mIrradiance;
+        HalfImage mVisibility;
+        // The tiles decoded, what a texture unit hands the shader, so lookups do not convert every tap
+        Image<float3> mDecodedIrradiance;
+        Image<float2> mDecodedVisibility;
+        int3 mAllocatedCounts;
+        uint32_t mCursor = 0;           // Next probe of the round robin
+        uint64_t mUpdatedProbes = 0;    // Probe updates since Reset(), a probe's first one takes the new value as is
+
+        std::vector<float4> mRayResults;    // Radiance and distance of the frame's rays, probe by probe
+    };
+}
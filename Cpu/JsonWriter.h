@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace Cpu
+{
+    // Minimal streaming JSON writer for machine readable reports. Commas and indentation are handled automatically.
+    class JsonWriter
+    {
+    public:
+        JsonWriter() { mStream.precision(9); }
+
+        JsonWriter& BeginObject() { Prefix(); mStream << "{"; Push(false); return *this; }
+        JsonWriter& EndObject() { Pop(); mStream << "}"; return *this; }
+        JsonWriter& BeginArray() { Prefix(); mStream << "["; Push(true); return *this; }
+        JsonWriter& EndArray() { Pop(); mStream << "]"; return *this; }
+
+        JsonWriter& Key(const std::string& key)
+        {
+            Prefix();
+            WriteString(key);
+            mStream << ": ";
+            mPendingKey = true;
+            return *this;
+        }
+
+        JsonWriter& Value(const std::string& value) { Prefix(); WriteString(value); return *this; }
+        JsonWriter& Value(const char* value) { return Value(std::string(value)); }
+        JsonWriter& Value(bool value) { Prefix(); mStream << (value ? "true" : "false"); return *this; }
+        JsonWriter& Value(int32_t value) { Prefix(); mStream << value; return *this; }
+        JsonWriter& Value(uint32_t value) { Prefix(); mStream << value; return *this; }
+        JsonWriter& Value(int64_t value) { Prefix(); mStream << value; return *this; }
+        JsonWriter& Value(uint64_t value) { Prefix(); mStream << value; return *this; }
+        JsonWriter& Value(double value)
+        {
+            Prefix();
+            if (std::isfinite(value)) mStream << value;
+            else mStream << "null";
+            return *this;
+        }
+
+        template<typename T>
+        JsonWriter& Field(const std::string& key, const T& value) { return Key(key).Value(value); }
+
+        std::string GetString() const { return mStream.str(); }
+
+    private:
+        struct Scope
+        {
+            bool isArray;
+            bool empty;
+        };
+
+        void Prefix()
+        {
+            if (mPendingKey)
+            {
+                mPendingKey = false;
+                return;
+            }
+            if (mScopes.empty()) return;
+
+            Scope& scope = mScopes.back();
+            if (!scope.empty) mStream << ",";
+            scope.empty = false;
+            NewLine();
+        }
+
+        void Push(bool isArray) { mScopes.push_back({ isArray, true }); }
+
+        void Pop()
+        {
+            const bool empty = mScopes.back().empty;
+            mScopes.pop_back();
+            if (!empty) NewLine();
+        }
+
+        void NewLine()
+        {
+            mStream << "\n";
+            for (size_t i = 0; i < mScopes.size(); ++i) mStream << "  ";
+        }
+
+        void WriteString(const std::string& s)
+        {
+            mStream << '"';
+            for (char c : s)
+            {
+                switch (c)
+                {
+                case '"': mStream << "\\\""; break;
+                case '\\': mStream << "\\\\"; break;
+                case '\n': mStream << "\\n"; break;
+                case '\t': mStream << "\\t"; break;
+                case '\r': mStream << "\\r"; break;
+                default:
+                    if (uint8_t(c) < 0x20)
+                    {
+                        const char* hex = "0123456789abcdef";
+                        mStream << "\\u00" << hex[(c >> 4) & 0xF] << hex[c & 0xF];
+                    }
+                    else
+                    {
+                        mStream << c;
+                    }
+                }
+            }
+            mStream << '"';
+        }
+
+        std::ostringstream mStream;
+        std::vector<Scope> mScopes;
+        bool mPendingKey = false;
+    };
+}
@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <cmath>
+#include "LightResampling.h"
+#include "Sampling.h"
+#include "Timer.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        // The thread group size of LightResampling.slang
+        const uint32_t kTileSize = 16;
+
+        // Seeds of the candidates and of the neighbor picks, apart from the shadow rays' RandInit(pixel, frameCount)
+        const uint32_t kCandidateSeedOffset = 0x40000000u;
+        const uint32_t kSpatialSeedOffset = 0x80000000u;
+
+        // Geometry a reservoir can be merged across
+        const float kMaxDepthDifference = 0.1f;     // Relative to the pixel's linear depth
+        const float kMinNormalCos = 0.906f;         // 25 degrees
+
+        // A reservoir while samples stream through it
+        struct StreamReservoir
+        {
+            uint32_t light = 0;
+            float weightSum = 0.0f;
+            float m = 0.0f;
+            float targetPdf = 0.0f;
+
+            void Add(uint32_t candidate, float weight, float candidateTargetPdf, float count, float u)
+            {
+                weightSum += weight;
+                m += count;
+                if (weight > 0.0f && u * weightSum < weight)
+                {
+                    light = candidate;
+                    targetPdf = candidateTargetPdf;
+                }
+            }
+
+            LightReservoir Finalize() const
+            {
+                LightReservoir r;
+                r.light = light;
+                r.m = m;
+                r.targetPdf = targetPdf;
+                r.weight = (targetPdf > 0.0f && m > 0.0f) ? weightSum / (m * targetPdf) : 0.0f;
+                if (!std::isfinite(r.weight)) r.weight = 0.0f;
+                return r;
+            }
+        };
+
+        float GetTargetPdf(const ShadingData& sd, const SceneLight& light)
+        {
+            const float p = luminance(EvalLight(sd, light));
+            return std::isfinite(p) ? std::max(0.0f, p) : 0.0f;
+        }
+
+        bool IsSimilarGeometry(const float4& center, const float4& other)
+        {
+            if (other.w <= 0.0f) return false;
+            if (std::fabs(center.w - other.w) > kMaxDepthDifference * center.w) return false;
+            return dot(center.rgb(), other.rgb()) >= kMinNormalCos;
+        }
+
+        // Merges another pixel's reservoir, re-weighted by its light's target pdf at this pixel
+        void Merge(StreamReservoir& stream, const LightReservoir& other, float maxM, const ShadingData& sd, const TriangleScene& scene, float u)
+        {
+            if (other.m <= 0.0f || other.light >= scene.GetLightCount()) return;
+            const float m = std::min(other.m, maxM);
+            const float targetPdf = other.weight > 0.0f ? GetTargetPdf(sd, scene.GetLight(other.light)) : 0.0f;
+            stream.Add(other.light, targetPdf * other.weight * m, targetPdf, m, u);
+        }
+    }
+
+    LightResampler::LightResampler(ThreadPool* threadPool)
+        : mThreadPool(threadPool ? threadPool : &ThreadPool::GetDefault())
+    {
+    }
+
+    void LightResampler::Execute(const TriangleScene& scene, const LightSampler& sampler, const RtGBuffer& gBuffer, const Image4F& motionVec,
+        const Image4F& linearZ, uint32_t frameCount)
+    {
+        Timer timer;
+
+        const uint32_t width = motionVec.GetWidth();
+        const uint32_t height = motionVec.GetHeight();
+
+        std::swap(mReservoirs, mPrevReservoirs);
+        std::swap(mNormalDepth, mPrevNormalDepth);
+        const bool useHistory = mSettings.temporalReuse && mHasHistory && mPrevReservoirs.GetWidth() == width && mPrevReservoirs.GetHeight() == height;
+        mTemporalReservoirs.Resize(width, height);
+        mReservoirs.Resize(width, height);
+        mNormalDepth.Resize(width, height);
+
+        const uint32_t candidateCount = sampler.GetLightCount() > 0 ? std::max(1u, mSettings.candidateCount) : 0;
+        const float maxHistoryM = float(std::max(1u, mSettings.maxHistory) * std::max(1u, candidateCount));
+        std::vector<uint32_t> threadGeometry(mThreadPool->GetThreadCount(), 0);
+        std::vector<uint32_t> threadTemporal(mThreadPool->GetThreadCount(), 0);
+
+        // Candidates and last frame's reservoir
+        mThreadPool->ParallelForTiles(width, height, kTileSize, [&](const TileRect& tile, uint32_t threadIndex)
+        {
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    const int2 ipos = int2(int(x), int(y));
+                    if (gBuffer.worldPosition->At(ipos).w == 0.0f)
+                    {
+                        mTemporalReservoirs.At(ipos) = LightReservoir();
+                        mNormalDepth.At(ipos) = float4();
+                        continue;
+                    }
+
+                    const ShadingData sd = LoadShadingData(gBuffer, ipos);
+                    const float4 normalDepth = float4(sd.N, linearZ.At(ipos).x);
+                    mNormalDepth.At(ipos) = normalDepth;
+                    threadGeometry[threadIndex]++;
+
+                    uint32_t randSeed = RandInit(y * width + x, frameCount + kCandidateSeedOffset, 16);
+                    StreamReservoir stream;
+                    for (uint32_t i = 0; i < candidateCount; ++i)
+                    {
+                        const LightSample sample = sampler.Sample(RandNext(randSeed));
+                        const float u = RandNext(randSeed);
+                        if (sample.pdf <= 0.0f)
+                        {
+                            stream.m += 1.0f;
+                            continue;
+                        }
+                        const float targetPdf = GetTargetPdf(sd, scene.GetLight(sample.index));
+                        stream.Add(sample.index, targetPdf / sample.pdf, targetPdf, 1.0f, u);
+                    }
+
+                    if (useHistory)
+                    {
+                        const float2 motion = motionVec.At(ipos).xy();
+                        const int2 iposPrev = int2(int(float(x) + motion.x * float(width) + 0.5f), int(float(y) + motion.y * float(height) + 0.5f));
+                        if (mPrevNormalDepth.IsInside(iposPrev.x, iposPrev.y) && IsSimilarGeometry(normalDepth, mPrevNormalDepth.At(iposPrev)))
+                        {
+                            Merge(stream, mPrevReservoirs.At(iposPrev), maxHistoryM, sd, scene, RandNext(randSeed));
+                            threadTemporal[threadIndex]++;
+                        }
+                    }
+
+                    mTemporalReservoirs.At(ipos) = stream.Finalize();
+                }
+            }
+        });
+
+        // Neighbors in a disk, merged from the reservoirs above so every pixel reads the same frame
+        const bool useSpatial = mSettings.spatialReuse && mSettings.spatialSamples > 0;
+        mThreadPool->ParallelForTiles(width, height, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    const int2 ipos = int2(int(x), int(y));
+                    const LightReservoir& center = mTemporalReservoirs.At(ipos);
+                    const float4 normalDepth = mNormalDepth.At(ipos);
+                    if (!useSpatial || normalDepth.w <= 0.0f)
+                    {
+                        mReservoirs.At(ipos) = center;
+                        continue;
+                    }
+
+                    const ShadingData sd = LoadShadingData(gBuffer, ipos);
+                    uint32_t randSeed = RandInit(y * width + x, frameCount + kSpatialSeedOffset, 16);
+                    StreamReservoir stream;
+                    stream.Add(center.light, center.targetPdf * center.weight * center.m, center.targetPdf, center.m, RandNext(randSeed));
+
+                    for (uint32_t i = 0; i < mSettings.spatialSamples; ++i)
+                    {
+                        const float r = mSettings.spatialRadius * std::sqrt(RandNext(randSeed));
+                        const float phi = 2.0f * kPi * RandNext(randSeed);
+                        const int2 q = int2(int(float(x) + r * std::cos(phi) + 0.5f), int(float(y) + r * std::sin(phi) + 0.5f));
+                        const float u = RandNext(randSeed);
+                        if ((q.x == ipos.x && q.y == ipos.y) || !mNormalDepth.IsInside(q.x, q.y)) continue;
+                        if (!IsSimilarGeometry(normalDepth, mNormalDepth.At(q))) continue;
+                        Merge(stream, mTemporalReservoirs.At(q), maxHistoryM, sd, scene, u);
+                    }
+
+                    mReservoirs.At(ipos) = stream.Finalize();
+                }
+            }
+        });
+
+        mHasHistory = true;
+
+        mStats = LightResamplingStats();
+        uint32_t geometryPixels = 0, temporalPixels = 0;
+        for (uint32_t count : threadGeometry) geometryPixels += count;
+        for (uint32_t count : threadTemporal) temporalPixels += count;
+        mStats.temporalFraction = geometryPixels > 0 ? float(temporalPixels) / float(geometryPixels) : 0.0f;
+        mStats.elapsedMs = timer.GetElapsedMs();
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include "Image.h"
+#include "LightSampling.h"
+#include "Shading.h"
+#include "ThreadPool.h"
+
+namespace Cpu
+{
+    // One pixel's reservoir. LightResamplingPass keeps the same four values in RGBA32Float textures, the light as a float.
+    struct LightReservoir
+    {
+        uint32_t light = 0;
+        float weight = 0.0f;        // Unbiased contribution weight, the pixel's estimate is EvalLight() * visibility * weight
+        float m = 0.0f;             // Candidates behind it
+        float targetPdf = 0.0f;     // Luminance of EvalLight() of the light at the pixel, 0 for an empty reservoir
+    };
+
+    // Same knobs as ::LightResamplingPass, with the same defaults
+    struct LightResamplingSettings
+    {
+        uint32_t candidateCount = 8;    // Lights drawn from the LightSampler per pixel and frame
+        bool temporalReuse = true;
+        bool spatialReuse = true;
+        uint32_t spatialSamples = 4;    // Neighbors merged per pixel
+        float spatialRadius = 16.0f;    // In pixels
+        uint32_t maxHistory = 20;       // Last frame's reservoir counts as at most this many times candidateCount
+    };
+
+    struct LightResamplingStats
+    {
+        double elapsedMs = 0.0;
+        float temporalFraction = 0.0f;  // Of the pixels with geometry, those that merged last frame's reservoir
+    };
+
+    // Headless implementation of ::LightResamplingPass, spatiotemporal reservoir resampling of direct lighting (ReSTIR,
+    // Bitterli et al. 2020). Every pixel draws candidateCount lights from the alias table and keeps one in proportion to
+    // the luminance of its unshadowed light (resampled importance sampling), merges the reservoir its motion vector
+    // points at last frame, then the reservoirs of a few neighbors. Neighbors whose depth or normal differ too much are
+    // skipped. This is the biased variant: merged samples are not checked for visibility at the pixel, which darkens
+    // contact shadows a little. RaytracedEffects::SetLightReservoirs() then traces one shadow ray towards each pixel's
+    // light.
+    class LightResampler
+    {
+    public:
+        explicit LightResampler(ThreadPool* threadPool = nullptr);
+
+        // linearZ is the SVGF_LinearZ target, linear depth in .x. The scene and sampler must not change between frames
+        // without Reset().
+        void Execute(const TriangleScene& scene, const LightSampler& sampler, const RtGBuffer& gBuffer, const Image4F& motionVec,
+            const Image4F& linearZ, uint32_t frameCount);
+
+        // Drops last frame's reservoirs, e.g. after a camera cut or when the lights changed
+        void Reset() { mHasHistory = false; }
+
+        LightResamplingSettings& GetSettings() { return mSettings; }
+        const LightResamplingSettings& GetSettings() const { return mSettings; }
+        const Image<LightReservoir>& GetReservoirs() const { return mReservoirs; }
+        const LightResamplingStats& GetStats() const { return mStats; }
+
+    private:
+        ThreadPool* mThreadPool;
+        LightResamplingSettings mSettings;
+        LightResamplingStats mStats;
+
+        Image<LightReservoir> mTemporalReservoirs;  // Before spatial reuse
+        Image<LightReservoir> mReservoirs;
+        Image<LightReservoir> mPrevReservoirs;
+        Image4F mNormalDepth;                       // Normal and linear depth the reservoirs were made for
+        Image4F mPrevNormalDepth;
+        bool mHasHistory = false;
+    };
+}
@@ -0,0 +1,75 @@
+#include <algorithm>
+#include "LightSampling.h"
+#include "Timer.h"
+
+namespace Cpu
+{
+    float GetLightSelectionWeight(const SceneLight& light)
+    {
+        return std::max(0.0f, luminance(light.intensity));
+    }
+
+    void LightSampler::Build(const TriangleScene& scene)
+    {
+        std::vector<float> weights(scene.GetLightCount());
+        for (uint32_t i = 0; i < scene.GetLightCount(); ++i) weights[i] = GetLightSelectionWeight(scene.GetLight(i));
+        Build(weights);
+    }
+
+    void LightSampler::Build(const std::vector<float>& weights)
+    {
+        Timer timer;
+
+        const uint32_t count = uint32_t(weights.size());
+        mEntries.assign(count, LightAliasEntry());
+        mPdfs.assign(count, 0.0f);
+
+        double total = 0.0;
+        for (float weight : weights) total += std::max(0.0f, weight);
+
+        // Without any weight every light is as likely
+        for (uint32_t i = 0; i < count; ++i) mPdfs[i] = total > 0.0 ? float(std::max(0.0f, weights[i]) / total) : 1.0f / float(count);
+
+        // Scaled so that the average slot holds 1, slots below 1 are topped up by one above
+        mScaled.resize(count);
+        mSmall.clear();
+        mLarge.clear();
+        uint32_t mostLikely = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            mScaled[i] = mPdfs[i] * float(count);
+            (mScaled[i] < 1.0f ? mSmall : mLarge).push_back(i);
+            if (mPdfs[i] > mPdfs[mostLikely]) mostLikely = i;
+        }
+
+        while (!mSmall.empty() && !mLarge.empty())
+        {
+            const uint32_t small = mSmall.back();
+            const uint32_t large = mLarge.back();
+            mSmall.pop_back();
+
+            mEntries[small].threshold = mScaled[small];
+            mEntries[small].alias = large;
+
+            mScaled[large] -= 1.0f - mScaled[small];
+            if (mScaled[large] < 1.0f)
+            {
+                mLarge.pop_back();
+                mSmall.push_back(large);
+            }
+        }
+
+        // What is left is 1 up to rounding and keeps its own light, unless rounding left a light that must never be
+        // picked without a partner
+        for (uint32_t i : mLarge) mEntries[i] = LightAliasEntry{ 1.0f, i, 0.0f, 0.0f };
+        for (uint32_t i : mSmall) mEntries[i] = mPdfs[i] > 0.0f ? LightAliasEntry{ 1.0f, i, 0.0f, 0.0f } : LightAliasEntry{ 0.0f, mostLikely, 0.0f, 0.0f };
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            mEntries[i].pdf = mPdfs[i];
+            mEntries[i].aliasPdf = mPdfs[mEntries[i].alias];
+        }
+
+        mBuildMs = timer.GetElapsedMs();
+    }
+}
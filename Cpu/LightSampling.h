@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "TriangleScene.h"
+
+namespace Cpu
+{
+    // One slot of a LightSampler alias table, the layout Data/LightSampling.h reads. pdf and aliasPdf are the
+    // selection probabilities of the slot's own light and of its alias, so a sample needs one load.
+    struct LightAliasEntry
+    {
+        float threshold = 1.0f;     // Below it the slot picks its own light, otherwise the alias
+        uint32_t alias = 0;
+        float pdf = 0.0f;
+        float aliasPdf = 0.0f;
+    };
+
+    struct LightSample
+    {
+        uint32_t index = 0;
+        float pdf = 0.0f;
+    };
+
+    // Selection weight of a light: the luminance of its intensity. Point light intensity is taken at unit distance,
+    // so the weight ignores where the shading point is.
+    float GetLightSelectionWeight(const SceneLight& light);
+
+    // Picks one light in proportion to its weight in O(1) with Vose's alias method, so a shading point traces one
+    // shadow ray however many lights there are. Lights with zero weight are never picked. Built on the CPU and
+    // uploaded as is for the ray tracing shaders.
+    class LightSampler
+    {
+    public:
+        void Build(const std::vector<float>& weights);
+        void Build(const TriangleScene& scene);
+
+        // u in [0, 1). An empty sampler returns pdf 0.
+        LightSample Sample(float u) const
+        {
+            LightSample sample;
+            if (mEntries.empty()) return sample;
+
+            const float scaled = u * float(mEntries.size());
+            const uint32_t slot = std::min(uint32_t(scaled), uint32_t(mEntries.size()) - 1);
+            const LightAliasEntry& entry = mEntries[slot];
+            const bool own = scaled - float(slot) < entry.threshold;
+            sample.index = own ? slot : entry.alias;
+            sample.pdf = own ? entry.pdf : entry.aliasPdf;
+            return sample;
+        }
+
+        float GetPdf(uint32_t index) const { return mPdfs[index]; }
+        uint32_t GetLightCount() const { return uint32_t(mEntries.size()); }
+        const std::vector<LightAliasEntry>& GetEntries() const { return mEntries; }
+        double GetBuildMs() const { return mBuildMs; }
+
+    private:
+        std::vector<LightAliasEntry> mEntries;
+        std::vector<float> mPdfs;
+        std::vector<float> mScaled;
+        std::vector<uint32_t> mSmall;
+        std::vector<uint32_t> mLarge;
+        double mBuildMs = 0.0;
+    };
+}
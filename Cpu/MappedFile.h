@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Cpu
+{
+    // Read-only memory mapping of a whole file. Pages are faulted in on first access, so opening costs the same
+    // for any file size and only what is read comes off the disk.
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile() { Close(); }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool Open(const std::string& path);
+        void Close();
+
+        bool IsOpen() const { return mData != nullptr; }
+        const uint8_t* GetData() const { return mData; }
+        size_t GetSize() const { return mSize; }
+
+    private:
+        const uint8_t* mData = nullptr;
+        size_t mSize = 0;
+#ifdef _WIN32
+        void* mFile = nullptr;
+        void* mMapping = nullptr;
+#endif
+    };
+}
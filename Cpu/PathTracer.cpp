@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "PathTracer.h"
+#include "ReflectionClassification.h"
+#include "Timer.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        // Queue entries per range of a stage, small enough for 64 threads to share a 640x360 frame's last bounces
+        const uint32_t kPathsPerRange = 256;
+        const float kRayOffset = 0.001f;
+        const float kMaxT = 100000.0f;
+
+        bool IsSameCamera(const PathCamera& a, const PathCamera& b)
+        {
+            return std::memcmp(&a, &b, sizeof(PathCamera)) == 0;
+        }
+
+        bool IsNan(const float3& v) { return std::isnan(v.x) || std::isnan(v.y) || std::isnan(v.z); }
+
+        float MaxComponent(const float3& v) { return std::max(v.x, std::max(v.y, v.z)); }
+    }
+
+    void PathTracer::PathQueue::Resize(uint32_t capacity)
+    {
+        origins.resize(capacity);
+        directions.resize(capacity);
+        throughputs.resize(capacity);
+        pixels.resize(capacity);
+        seeds.resize(capacity);
+        hits.resize(capacity);
+        found.resize(capacity);
+    }
+
+    void PathTracer::PathQueue::Set(uint32_t i, const float3& origin, const float3& direction, const float3& throughput, uint32_t pixel, uint32_t seed)
+    {
+        origins[i] = origin;
+        directions[i] = direction;
+        throughputs[i] = throughput;
+        pixels[i] = pixel;
+        seeds[i] = seed;
+    }
+
+    void PathTracer::ShadowQueue::Resize(uint32_t capacity)
+    {
+        origins.resize(capacity);
+        directions.resize(capacity);
+        maxT.resize(capacity);
+        contributions.resize(capacity);
+        pixels.resize(capacity);
+    }
+
+    void PathTracer::ShadowQueue::Set(uint32_t i, const Ray& ray, const float3& contribution, uint32_t pixel)
+    {
+        origins[i] = ray.origin;
+        directions[i] = ray.direction;
+        maxT[i] = ray.tMax;
+        contributions[i] = contribution;
+        pixels[i] = pixel;
+    }
+
+    PathTracer::PathTracer(const TriangleScene& scene, const Bvh& bvh, ThreadPool& threadPool)
+        : mScene(scene), mBvh(bvh), mThreadPool(threadPool), mNextPathCount(0), mShadowRayCount(0)
+    {
+    }
+
+    void PathTracer::SetCamera(const PathCamera& camera)
+    {
+        if (!IsSameCamera(camera, mCamera)) Reset();
+        mCamera = camera;
+    }
+
+    void PathTracer::SetSettings(const PathTracerSettings& settings)
+    {
+        if (settings.maxBounces != mSettings.maxBounces || settings.russianRouletteBounce != mSettings.russianRouletteBounce) Reset();
+        mSettings = settings;
+    }
+
+    void PathTracer::SetLightSampler(const LightSampler* lightSampler)
+    {
+        if (lightSampler != mLightSampler) Reset();
+        mLightSampler = lightSampler;
+    }
+
+    void PathTracer::Render(uint32_t width, uint32_t height)
+    {
+        Timer timer;
+        mStats = PathTracerStats();
+
+        if (mSum.GetWidth() != width || mSum.GetHeight() != height) Reset();
+        if (mSampleCount == 0)
+        {
+            mSum.Resize(width, height);
+            mImage.Resize(width, height);
+        }
+
+        const uint32_t pixelCount = width * height;
+        mPaths.Resize(pixelCount);
+        mNextPaths.Resize(pixelCount);
+        mShadowRays.Resize(pixelCount);
+        mRadiance.assign(pixelCount, float3());
+        mScratch.resize(mThreadPool.GetThreadCount());
+        for (ShadeScratch& scratch : mScratch)
+        {
+            scratch.paths.Resize(kPathsPerRange);
+            scratch.shadowRays.Resize(kPathsPerRange);
+        }
+
+        Generate(width, height);
+        for (uint32_t bounce = 0; bounce < std::max(1u, mSettings.maxBounces) && mPaths.count > 0; ++bounce)
+        {
+            Extend(bounce);
+            Shade(bounce);
+            Connect();
+            std::swap(mPaths, mNextPaths);
+        }
+        Accumulate();
+
+        mStats.paths = pixelCount;
+        mStats.elapsedMs = timer.GetElapsedMs();
+    }
+
+    // Camera rays through a random position in every pixel, seeded by pixel and sample
+    void PathTracer::Generate(uint32_t width, uint32_t height)
+    {
+        Timer timer;
+        mPaths.count = width * height;
+        mStats.steals += mThreadPool.ParallelForStealing(mPaths.count, kPathsPerRange, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                uint32_t seed = RandInit(i, mSampleCount, 16);
+                const float x = float(i % width) + RandNext(seed);
+                const float y = float(i / width) + RandNext(seed);
+                mPaths.Set(i, mCamera.position, mCamera.GetDirection(x, y, width, height), float3(1.0f), i, seed);
+            }
+        });
+        mStats.generateMs += timer.GetElapsedMs();
+    }
+
+    void PathTracer::Extend(uint32_t bounce)
+    {
+        Timer timer;
+        mStats.steals += mThreadPool.ParallelForStealing(mPaths.count, kPathsPerRange, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                Ray ray;
+                ray.origin = mPaths.origins[i];
+                ray.direction = mPaths.directions[i];
+                ray.tMin = bounce == 0 ? 0.0f : kRayOffset;
+                ray.tMax = kMaxT;
+                mPaths.found[i] = mBvh.Intersect(ray, mPaths.hits[i]) ? 1 : 0;
+            }
+        });
+        mStats.extensionRays += mPaths.count;
+        mStats.extendMs += timer.GetElapsedMs();
+    }
+
+    // A miss adds the sky. A hit queues a shadow ray towards one light with what the light adds when visible, picks the
+    // diffuse or the GGX lobe by their estimated albedos and samples it, and rolls for survival once deep enough.
+    void PathTracer::Shade(uint32_t bounce)
+    {
+        Timer timer;
+        const uint32_t lightCount = mScene.GetLightCount();
+        const bool extends = bounce + 1 < mSettings.maxBounces;
+        const bool roulette = bounce + 1 >= mSettings.russianRouletteBounce;
+        mNextPathCount = 0;
+        mShadowRayCount = 0;
+
+        mStats.steals += mThreadPool.ParallelForStealing(mPaths.count, kPathsPerRange, [&](uint32_t begin, uint32_t end, uint32_t threadIndex)
+        {
+            ShadeScratch& scratch = mScratch[threadIndex];
+            scratch.paths.count = 0;
+            scratch.shadowRays.count = 0;
+
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                const uint32_t pixel = mPaths.pixels[i];
+                const float3& throughput = mPaths.throughputs[i];
+                if (!mPaths.found[i])
+                {
+                    mRadiance[pixel] += throughput * kReflectionEnvironment;
+                    continue;
+                }
+
+                Ray ray;
+                ray.origin = mPaths.origins[i];
+                ray.direction = mPaths.directions[i];
+                ShadingData sd = LoadHitShadingData(mScene, ray, mPaths.hits[i]);
+                if (dot(sd.N, sd.V) < 0.0f) sd.N = -sd.N;
+                uint32_t seed = mPaths.seeds[i];
+
+                if (lightCount > 0)
+                {
+                    const float u = RandNext(seed);
+                    LightSample sample;
+                    if (mLightSampler)
+                    {
+                        sample = mLightSampler->Sample(u);
+                    }
+                    else
+                    {
+                        sample.index = std::min(uint32_t(u * float(lightCount)), lightCount - 1);
+                        sample.pdf = 1.0f / float(lightCount);
+                    }
+
+                    const SceneLight& light = mScene.GetLight(sample.index);
+                    const float3 contribution = sample.pdf > 0.0f ? throughput * EvalLight(sd, light) / sample.pdf : float3();
+                    if (MaxComponent(contribution) > 0.0f)
+                    {
+                        scratch.shadowRays.Set(scratch.shadowRays.count++, GetShadowRay(light, sd.posW), contribution, pixel);
+                    }
+                }
+                if (!extends) continue;
+
+                const float3 F = FresnelSchlick(sd.specular, float3(1.0f), sd.NdotV);
+                const float diffuseAlbedo = luminance(sd.diffuse);
+                const float specularAlbedo = luminance(F);
+                const float specularProbability = diffuseAlbedo > 0.0f ? std::min(0.9f, std::max(0.1f, specularAlbedo / (specularAlbedo + diffuseAlbedo))) : 1.0f;
+
+                float3 L, weight;
+                if (RandNext(seed) < specularProbability)
+                {
+                    const float2 u(RandNext(seed), RandNext(seed));
+                    const float3 H = GetGGXMicrofacet(u, sd.N, sd.roughness);
+                    L = reflect(-sd.V, H);
+                    if (dot(sd.N, L) <= 0.0f || dot(L, H) <= 0.0f) continue;
+                    weight = GetReflectionWeight(sd, H, L) / specularProbability;
+                }
+                else
+                {
+                    const float2 u(RandNext(seed), RandNext(seed));
+                    L = GetCosHemisphereSample(u, sd.N, normalize(GetPerpendicularStark(sd.N)));
+                    weight = sd.diffuse / (1.0f - specularProbability);
+                }
+
+                float3 nextThroughput = throughput * weight;
+                if (roulette)
+                {
+                    const float survival = std::min(0.95f, MaxComponent(nextThroughput));
+                    if (!(RandNext(seed) < survival)) continue;
+                    nextThroughput = nextThroughput / survival;
+                }
+                scratch.paths.Set(scratch.paths.count++, sd.posW, L, nextThroughput, pixel, seed);
+            }
+
+            const uint32_t pathBase = mNextPathCount.fetch_add(scratch.paths.count);
+            for (uint32_t i = 0; i < scratch.paths.count; ++i)
+            {
+                mNextPaths.Set(pathBase + i, scratch.paths.origins[i], scratch.paths.directions[i], scratch.paths.throughputs[i], scratch.paths.pixels[i], scratch.paths.seeds[i]);
+            }
+            const uint32_t shadowBase = mShadowRayCount.fetch_add(scratch.shadowRays.count);
+            for (uint32_t i = 0; i < scratch.shadowRays.count; ++i)
+            {
+                const uint32_t j = shadowBase + i;
+                mShadowRays.origins[j] = scratch.shadowRays.origins[i];
+                mShadowRays.directions[j] = scratch.shadowRays.directions[i];
+                mShadowRays.maxT[j] = scratch.shadowRays.maxT[i];
+                mShadowRays.contributions[j] = scratch.shadowRays.contributions[i];
+                mShadowRays.pixels[j] = scratch.shadowRays.pixels[i];
+            }
+        });
+        mNextPaths.count = mNextPathCount;
+        mShadowRays.count = mShadowRayCount;
+        mStats.shadeMs += timer.GetElapsedMs();
+    }
+
+    // Every path queues at most one shadow ray per bounce, so no two in flight add to the same pixel
+    void PathTracer::Connect()
+    {
+        Timer timer;
+        mStats.steals += mThreadPool.ParallelForStealing(mShadowRays.count, kPathsPerRange, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                Ray ray;
+                ray.origin = mShadowRays.origins[i];
+                ray.direction = mShadowRays.directions[i];
+                ray.tMin = kRayOffset;
+                ray.tMax = mShadowRays.maxT[i];
+                if (!mBvh.Occluded(ray)) mRadiance[mShadowRays.pixels[i]] += mShadowRays.contributions[i];
+            }
+        });
+        mStats.shadowRays += mShadowRays.count;
+        mStats.connectMs += timer.GetElapsedMs();
+    }
+
+    // NaN samples count as black, as in the shaders
+    void PathTracer::Accumulate()
+    {
+        Timer timer;
+        mSampleCount++;
+        const float scale = 1.0f / float(mSampleCount);
+        mStats.steals += mThreadPool.ParallelForStealing(uint32_t(mRadiance.size()), kPathsPerRange, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                float4& sum = mSum.GetData()[i];
+                if (!IsNan(mRadiance[i])) sum = float4(sum.rgb() + mRadiance[i], 1.0f);
+                mImage.GetData()[i] = float4(sum.rgb() * scale, 1.0f);
+            }
+        });
+        mStats.accumulateMs += timer.GetElapsedMs();
+    }
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "Bvh.h"
+#include "Image.h"
+#include "LightSampling.h"
+#include "Shading.h"
+#include "ThreadPool.h"
+
+namespace Cpu
+{
+    // A pinhole camera as RaysRenderer's Falcor camera rasterizes the G-buffer, y pointing down the image
+    struct PathCamera
+    {
+        float3 position;
+        float3 right;       // Unit length view basis
+        float3 up;
+        float3 forward;
+        float tanHalfFovY = 0.41421356f;
+        float aspectRatio = 1.0f;   // Width over height
+
+        // Direction through the image position (x, y) in pixels, (x + 0.5, y + 0.5) being the center of pixel (x, y)
+        float3 GetDirection(float x, float y, uint32_t width, uint32_t height) const
+        {
+            const float sx = (x / float(width) * 2.0f - 1.0f) * tanHalfFovY * aspectRatio;
+            const float sy = (1.0f - y / float(height) * 2.0f) * tanHalfFovY;
+            return normalize(forward + right * sx + up * sy);
+        }
+    };
+
+    struct PathTracerSettings
+    {
+        uint32_t maxBounces = 4;            // Surfaces a path shades, the one the camera sees included
+        uint32_t russianRouletteBounce = 3; // From which paths survive by their throughput
+    };
+
+    struct PathTracerStats
+    {
+        uint64_t paths = 0;             // One sample per pixel
+        uint64_t extensionRays = 0;
+        uint64_t shadowRays = 0;
+        uint32_t steals = 0;            // Ranges threads took from each other, see ThreadPool::ParallelForStealing()
+        double generateMs = 0.0;
+        double extendMs = 0.0;
+        double shadeMs = 0.0;
+        double connectMs = 0.0;
+        double accumulateMs = 0.0;
+        double elapsedMs = 0.0;
+
+        double GetSamplesPerSecond() const { return elapsedMs > 0.0 ? double(paths) / (elapsedMs * 1e-3) : 0.0; }
+        double GetRaysPerSecond() const { return elapsedMs > 0.0 ? double(extensionRays + shadowRays) / (elapsedMs * 1e-3) : 0.0; }
+    };
+
+    // Progressive multi-bounce path tracer for ground truth images. Every Render() adds one path per pixel, traced as a
+    // wavefront: generate writes the camera rays of all pixels into a queue, then every bounce extends the queued paths
+    // to their closest hits, shades the hits, which queues a shadow ray to one light and compacts the surviving paths'
+    // next rays into the other queue, and connects the shadow rays. Queues are structures of arrays, so a stage only
+    // touches the fields it needs, and every stage runs over ThreadPool::ParallelForStealing(). Surfaces are
+    // evalMaterial() of the metal-rough material the ray tracing shaders shade with, two sided, and misses see the sky.
+    // A pixel's sample only depends on the pixel and the sample index, so images do not depend on the thread count.
+    // Samples accumulate until the camera, the settings or the size change, or Reset().
+    class PathTracer
+    {
+    public:
+        PathTracer(const TriangleScene& scene, const Bvh& bvh, ThreadPool& threadPool);
+
+        void SetCamera(const PathCamera& camera);
+        const PathCamera& GetCamera() const { return mCamera; }
+        void SetSettings(const PathTracerSettings& settings);
+        const PathTracerSettings& GetSettings() const { return mSettings; }
+
+        // Picks the light of every shadow ray by its weight instead of uniformly, see LightSampler
+        void SetLightSampler(const LightSampler* lightSampler);
+
+        // Drops the accumulated samples
+        void Reset() { mSampleCount = 0; }
+
+        void Render(uint32_t width, uint32_t height);
+
+        uint32_t GetSampleCount() const { return mSampleCount; }
+        // The mean of the samples so far, w = 1
+        const Image4F& GetImage() const { return mImage; }
+        const PathTracerStats& GetLastStats() const { return mStats; }
+
+    private:
+        // Paths of one bounce. Extend fills the hits of the rays, shade reads them.
+        struct PathQueue
+        {
+            std::vector<float3> origins;
+            std::vector<float3> directions;
+            std::vector<float3> throughputs;    // Up to the sample of the ray
+            std::vector<uint32_t> pixels;
+            std::vector<uint32_t> seeds;
+            std::vector<RayHit> hits;
+            std::vector<uint8_t> found;
+            uint32_t count = 0;
+
+            void Resize(uint32_t capacity);
+            void Set(uint32_t i, const float3& origin, const float3& direction, const float3& throughput, uint32_t pixel, uint32_t seed);
+        };
+
+        struct ShadowQueue
+        {
+            std::vector<float3> origins;
+            std::vector<float3> directions;
+            std::vector<float> maxT;
+            std::vector<float3> contributions;  // Added to the pixel when the light is visible
+            std::vector<uint32_t> pixels;
+            uint32_t count = 0;
+
+            void Resize(uint32_t capacity);
+            void Set(uint32_t i, const Ray& ray, const float3& contribution, uint32_t pixel);
+        };
+
+        // What one range of the shade stage queues, copied into the shared queues in one piece
+        struct ShadeScratch
+        {
+            PathQueue paths;
+            ShadowQueue shadowRays;
+        };
+
+        void Generate(uint32_t width, uint32_t height);
+        void Extend(uint32_t bounce);
+        void Shade(uint32_t bounce);
+        void Connect();
+        void Accumulate();
+
+        const TriangleScene& mScene;
+        const Bvh& mBvh;
+        ThreadPool& mThreadPool;
+        const LightSampler* mLightSampler = nullptr;
+        PathCamera mCamera;
+        PathTracerSettings mSettings;
+        PathTracerStats mStats;
+
+        PathQueue mPaths;
+        PathQueue mNextPaths;
+        ShadowQueue mShadowRays;
+        std::atomic<uint32_t> mNextPathCount;
+        std::atomic<uint32_t> mShadowRayCount;
+        std::vector<ShadeScratch> mScratch;     // Per thread
+        std::vector<float3> mRadiance;          // This sample's, per pixel
+
+        Image4F mSum;
+        Image4F mImage;
+        uint32_t mSampleCount = 0;
+    };
+}
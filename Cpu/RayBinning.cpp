@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include "RayBinning.h"
+#include "Timer.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        // Spreads the low 4 bits so two zero bits follow each
+        uint32_t SpreadBits(uint32_t v)
+        {
+            v = (v | (v << 4)) & 0x0C3u;
+            v = (v | (v << 2)) & 0x249u;
+            return v;
+        }
+    }
+
+    void RayBinner::Sort(const Ray* rays, const uint8_t* valid, uint32_t count, ThreadPool& threadPool)
+    {
+        Timer timer;
+
+        // Contiguous chunks, one per thread, so the scatter keeps the order within a bin
+        const uint32_t chunkCount = std::max(1u, std::min(threadPool.GetThreadCount(), count / 4096));
+        const uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+        auto forEachChunk = [&](const std::function<void(uint32_t chunk, uint32_t first, uint32_t last)>& fn)
+        {
+            threadPool.ParallelFor(chunkCount, [&](uint32_t chunk, uint32_t)
+            {
+                const uint32_t first = std::min(count, chunk * chunkSize);
+                fn(chunk, first, std::min(count, first + chunkSize));
+            });
+        };
+
+        std::vector<float3> chunkMin(chunkCount, float3(std::numeric_limits<float>::max()));
+        std::vector<float3> chunkMax(chunkCount, float3(-std::numeric_limits<float>::max()));
+        forEachChunk([&](uint32_t chunk, uint32_t first, uint32_t last)
+        {
+            for (uint32_t i = first; i < last; ++i)
+            {
+                if (!valid[i]) continue;
+                chunkMin[chunk] = min(chunkMin[chunk], rays[i].origin);
+                chunkMax[chunk] = max(chunkMax[chunk], rays[i].origin);
+            }
+        });
+        float3 originMin = chunkMin[0], originMax = chunkMax[0];
+        for (uint32_t chunk = 1; chunk < chunkCount; ++chunk)
+        {
+            originMin = min(originMin, chunkMin[chunk]);
+            originMax = max(originMax, chunkMax[chunk]);
+        }
+
+        const float cells = float((1 << kOriginBitsPerAxis) - 1);
+        const float3 extent = originMax - originMin;
+        const float3 scale(extent.x > 0.0f ? cells / extent.x : 0.0f, extent.y > 0.0f ? cells / extent.y : 0.0f, extent.z > 0.0f ? cells / extent.z : 0.0f);
+
+        mBins.resize(count);
+        mOffsets.assign(size_t(chunkCount) * kBinCount, 0);
+        forEachChunk([&](uint32_t chunk, uint32_t first, uint32_t last)
+        {
+            uint32_t* counts = &mOffsets[size_t(chunk) * kBinCount];
+            for (uint32_t i = first; i < last; ++i)
+            {
+                if (!valid[i]) continue;
+                const Ray& ray = rays[i];
+                const uint32_t octant = (ray.direction.x < 0.0f ? 1 : 0) | (ray.direction.y < 0.0f ? 2 : 0) | (ray.direction.z < 0.0f ? 4 : 0);
+                const float3 cell = (ray.origin - originMin) * scale;
+                const uint32_t morton = (SpreadBits(std::min(uint32_t(cell.x), uint32_t(cells))) << 2) | (SpreadBits(std::min(uint32_t(cell.y), uint32_t(cells))) << 1) |
+                    SpreadBits(std::min(uint32_t(cell.z), uint32_t(cells)));
+                const uint32_t bin = (octant << (3 * kOriginBitsPerAxis)) | morton;
+                mBins[i] = uint16_t(bin);
+                counts[bin]++;
+            }
+        });
+
+        // Bin major, chunk minor, so every chunk writes its part of a bin after the chunks before it
+        uint32_t total = 0;
+        mOccupiedBinCount = 0;
+        for (uint32_t bin = 0; bin < kBinCount; ++bin)
+        {
+            const uint32_t binStart = total;
+            for (uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+            {
+                uint32_t& offset = mOffsets[size_t(chunk) * kBinCount + bin];
+                const uint32_t binCount = offset;
+                offset = total;
+                total += binCount;
+            }
+            if (total > binStart) mOccupiedBinCount++;
+        }
+
+        mOrder.resize(total);
+        forEachChunk([&](uint32_t chunk, uint32_t first, uint32_t last)
+        {
+            uint32_t* offsets = &mOffsets[size_t(chunk) * kBinCount];
+            for (uint32_t i = first; i < last; ++i)
+            {
+                if (valid[i]) mOrder[offsets[mBins[i]]++] = i;
+            }
+        });
+
+        mSortMs = float(timer.GetElapsedMs());
+    }
+}
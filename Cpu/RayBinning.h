@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Bvh.h"
+#include "ThreadPool.h"
+
+namespace Cpu
+{
+    // Coherence binning for secondary rays. A counting sort by direction octant first and by the Morton code of the
+    // origin on a 16^3 grid over the origins second, so rays next to each other in the order leave from nearby points
+    // in similar directions and traverse mostly the same nodes. The sort is stable, a bin keeps the launch order.
+    class RayBinner
+    {
+    public:
+        static const uint32_t kOriginBitsPerAxis = 4;
+        static const uint32_t kBinCount = 8u << (3 * kOriginBitsPerAxis);
+
+        // Rays with valid[i] == 0 are left out. The order holds indices into rays.
+        void Sort(const Ray* rays, const uint8_t* valid, uint32_t count, ThreadPool& threadPool);
+
+        const std::vector<uint32_t>& GetOrder() const { return mOrder; }
+        uint32_t GetOccupiedBinCount() const { return mOccupiedBinCount; }
+        float GetSortMs() const { return mSortMs; }
+
+    private:
+        std::vector<uint16_t> mBins;
+        std::vector<uint32_t> mOffsets;     // Per chunk and bin, counts first
+        std::vector<uint32_t> mOrder;
+        uint32_t mOccupiedBinCount = 0;
+        float mSortMs = 0.0f;
+    };
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "VectorMath.h"
+
+// CPU mirror of Data/RayScale.h. Keep the two in sync.
+namespace Cpu
+{
+    // Mirrors ::RayScale
+    enum class RayScale : uint32_t
+    {
+        Full = 0,
+        Half,           // One ray per 2x2 block
+        Checkerboard,   // One ray per 2x1 block, alternating rows
+        Quarter         // One ray per 4x4 block
+    };
+
+    inline int2 GetRayScaleFactor(RayScale scale)
+    {
+        switch (scale)
+        {
+        case RayScale::Half: return int2(2, 2);
+        case RayScale::Checkerboard: return int2(2, 1);
+        case RayScale::Quarter: return int2(4, 4);
+        default: return int2(1, 1);
+        }
+    }
+
+    // Same as RayUpsamplePass::GetTracedSize
+    inline int2 GetTracedSize(RayScale scale, uint32_t width, uint32_t height)
+    {
+        const int2 factor = GetRayScaleFactor(scale);
+        return int2(std::max(1, int(width) / factor.x), std::max(1, int(height) / factor.y));
+    }
+
+    inline int2 GetTracedPixel(int2 tracedPos, RayScale scale, uint32_t frameCount)
+    {
+        if (scale == RayScale::Half)
+        {
+            const int2 offsets[4] = { int2(0, 0), int2(1, 1), int2(1, 0), int2(0, 1) };
+            const int2 offset = offsets[frameCount & 3];
+            return int2(tracedPos.x * 2 + offset.x, tracedPos.y * 2 + offset.y);
+        }
+        if (scale == RayScale::Checkerboard)
+        {
+            return int2(tracedPos.x * 2 + int((uint32_t(tracedPos.y) + frameCount) & 1), tracedPos.y);
+        }
+        if (scale == RayScale::Quarter)
+        {
+            // 4x4 Bayer order
+            const uint32_t bayer[16] = { 0, 10, 2, 8, 5, 15, 7, 13, 1, 11, 3, 9, 4, 14, 6, 12 };
+            const uint32_t index = bayer[frameCount & 15];
+            return int2(tracedPos.x * 4 + int(index & 3), tracedPos.y * 4 + int(index >> 2));
+        }
+        return tracedPos;
+    }
+
+    inline uint32_t GetTracedPixelIndex(int2 tracedPos, int2 tracedDim, RayScale scale, uint32_t frameCount)
+    {
+        const int2 pixel = GetTracedPixel(tracedPos, scale, frameCount);
+        return uint32_t(pixel.x) + uint32_t(pixel.y) * uint32_t(tracedDim.x * GetRayScaleFactor(scale).x);
+    }
+}
@@ -0,0 +1,106 @@
+#include "RayUpsample.h"
+#include "SVGFUtils.h"
+#include "Timer.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        const uint32_t kTileSize = 64;
+    }
+
+    RayUpsamplePass::RayUpsamplePass(uint32_t width, uint32_t height, ThreadPool* threadPool)
+        : mWidth(width),
+          mHeight(height),
+          mThreadPool(threadPool ? threadPool : &ThreadPool::GetDefault())
+    {
+        mOutput.Resize(width, height);
+    }
+
+    const Image4F& RayUpsamplePass::Execute(const Image4F& tracedSignal, const Image4F& normalDepth, RayScale scale, uint32_t frameCount)
+    {
+        Timer timer;
+
+        const int2 factor = GetRayScaleFactor(scale);
+        const int2 tracedDim = int2(int(tracedSignal.GetWidth()), int(tracedSignal.GetHeight()));
+        const float sigma = float(std::max(factor.x, factor.y));
+
+        mThreadPool->ParallelForTiles(mWidth, mHeight, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    const int2 ipos = int2(int(x), int(y));
+                    const int2 tracedCenter = int2(std::min(ipos.x / factor.x, tracedDim.x - 1), std::min(ipos.y / factor.y, tracedDim.y - 1));
+
+                    // Pixels that were traced this frame keep their own sample
+                    const int2 centerPixel = GetTracedPixel(tracedCenter, scale, frameCount);
+                    if (centerPixel.x == ipos.x && centerPixel.y == ipos.y)
+                    {
+                        mOutput.At(ipos) = tracedSignal.At(tracedCenter);
+                        continue;
+                    }
+
+                    const float4 nd = normalDepth.At(ipos);
+                    const float3 normal = normalize(OctToDir(asuint(nd.x)));
+                    const float linearZ = nd.y;
+                    const float phiDepth = std::max(nd.z, 1e-8f) * mSettings.phiDepth;
+
+                    float4 sumSignal;
+                    float sumWeight = 0.0f;
+                    float4 nearestSignal;
+                    float nearestDistance = 1e30f;
+
+                    for (int yy = -1; yy <= 1; ++yy)
+                    {
+                        for (int xx = -1; xx <= 1; ++xx)
+                        {
+                            const int2 q = tracedCenter + int2(xx, yy);
+                            if (q.x < 0 || q.y < 0 || q.x > tracedDim.x - 1 || q.y > tracedDim.y - 1) continue;
+
+                            const int2 p = GetTracedPixel(q, scale, frameCount);
+                            const float4 signalP = tracedSignal.At(q);
+                            const float4 ndP = normalDepth.Load(p);
+
+                            const float dist = length(float2(float(p.x - ipos.x), float(p.y - ipos.y)));
+                            if (dist < nearestDistance)
+                            {
+                                nearestDistance = dist;
+                                nearestSignal = signalP;
+                            }
+
+                            const float wSpatial = std::exp(-0.5f * dist * dist / (sigma * sigma));
+                            const float wZ = std::fabs(linearZ - ndP.y) / (phiDepth * dist);
+                            const float wNormal = NormalDistanceCos(normal, normalize(OctToDir(asuint(ndP.x))), mSettings.phiNormal);
+                            const float w = wSpatial * std::exp(-wZ) * wNormal;
+
+                            sumSignal += signalP * w;
+                            sumWeight += w;
+                        }
+                    }
+
+                    // No sample on the same surface, e.g. thin features that fell between the traced pixels
+                    mOutput.At(ipos) = (sumWeight > 1e-4f) ? sumSignal / sumWeight : nearestSignal;
+                }
+            }
+        });
+
+        mElapsedMs = timer.GetElapsedMs();
+        return mOutput;
+    }
+
+    void DecimateSignal(const Image4F& signal, RayScale scale, uint32_t frameCount, Image4F& traced)
+    {
+        const int2 size = GetTracedSize(scale, signal.GetWidth(), signal.GetHeight());
+        traced.Resize(uint32_t(size.x), uint32_t(size.y));
+
+        for (int y = 0; y < size.y; ++y)
+        {
+            for (int x = 0; x < size.x; ++x)
+            {
+                traced.At(x, y) = signal.Load(GetTracedPixel(int2(x, y), scale, frameCount));
+            }
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Image.h"
+#include "RayScale.h"
+#include "ThreadPool.h"
+
+namespace Cpu
+{
+    // Same knobs as ::RayUpsamplePass, with the same defaults
+    struct RayUpsampleSettings
+    {
+        float phiDepth = 3.0f;
+        float phiNormal = 128.0f;
+    };
+
+    // Headless implementation of ::RayUpsamplePass (Data/RayUpsample.slang). normalDepth = SVGF_CompactNormDepth at full res.
+    class RayUpsamplePass
+    {
+    public:
+        RayUpsamplePass(uint32_t width, uint32_t height, ThreadPool* threadPool = nullptr);
+
+        const Image4F& Execute(const Image4F& tracedSignal, const Image4F& normalDepth, RayScale scale, uint32_t frameCount);
+
+        RayUpsampleSettings& GetSettings() { return mSettings; }
+        const Image4F& GetOutput() const { return mOutput; }
+        double GetElapsedMs() const { return mElapsedMs; }
+        size_t GetAllocatedBytes() const { return mOutput.GetSizeInBytes(); }
+
+    private:
+        uint32_t mWidth;
+        uint32_t mHeight;
+        ThreadPool* mThreadPool;
+        RayUpsampleSettings mSettings;
+        Image4F mOutput;
+        double mElapsedMs = 0.0;
+    };
+
+    // Picks the traced pixels out of a full-res signal. Effects seed their random numbers per full-res pixel,
+    // so this is exactly what tracing at the reduced resolution produces.
+    void DecimateSignal(const Image4F& signal, RayScale scale, uint32_t frameCount, Image4F& traced);
+}
@@ -0,0 +1,696 @@
+#include <cmath>
+#include "RaytracedEffects.h"
+#include "AdaptiveSampling.h"
+#include "FrameProfiler.h"
+#include "LightSampling.h"
+#include "Timer.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        const uint32_t kTileSize = 16;
+        // Binned rays per task of a sorted dispatch
+        const uint32_t kRaysPerTask = 4096;
+        // Work list entries per task of an adaptive dispatch
+        const uint32_t kPixelsPerTask = 1024;
+        const float3 kMissColor(0.2f, 0.6f, 0.9f);
+
+        // The recursive closest-hit shader RaytracedReflection.slang had before its bounce loop, see ReflectionTracing
+        class ReflectionTracer
+        {
+        public:
+            ReflectionTracer(const TriangleScene& scene, const Bvh& bvh, const LightSampler* lightSampler, uint32_t bounces, uint64_t& rays)
+                : mScene(scene), mBvh(bvh), mLightSampler(lightSampler), mBounces(bounces), mRays(rays) {}
+
+            // TraceReflectionRay() in RaytracedReflection.slang
+            float3 TraceReflectionRay(const ShadingData& sd, uint32_t rayDepth, uint32_t randSeed) const
+            {
+                float3 H;
+                const Ray ray = GenerateReflectionRay(sd, randSeed, H);
+                RayHit hit;
+                mRays++;
+                const bool found = mBvh.Intersect(ray, hit);
+                return ShadeReflectionRay(sd, H, ray, found, hit, rayDepth, randSeed);
+            }
+
+            // The GGX sampled ray of TraceReflectionRay(), randSeed advanced past the sample
+            static Ray GenerateReflectionRay(const ShadingData& sd, uint32_t& randSeed, float3& H)
+            {
+                const float2 randVal(RandNext(randSeed), RandNext(randSeed));
+                H = GetGGXMicrofacet(randVal, sd.N, sd.roughness);
+
+                Ray ray;
+                ray.origin = sd.posW;
+                ray.direction = reflect(-sd.V, H);
+                ray.tMin = 0.001f;
+                ray.tMax = 100000.0f;
+                return ray;
+            }
+
+            // The rest of TraceReflectionRay() once its ray is traced
+            float3 ShadeReflectionRay(const ShadingData& sd, const float3& H, const Ray& ray, bool found, const RayHit& hit, uint32_t rayDepth, uint32_t randSeed) const
+            {
+                const float3 color = found ? ShadeHit(ray, hit, rayDepth + 1, randSeed) : kMissColor;
+                return color * GetReflectionWeight(sd, H, ray.direction);
+            }
+
+        private:
+            // PrimaryCHS(), with evalMaterial() for a metal-rough material
+            float3 ShadeHit(const Ray& ray, const RayHit& hit, uint32_t depth, uint32_t randSeed) const
+            {
+                const ShadingData sd = LoadHitShadingData(mScene, ray, hit);
+
+                float3 color;
+                if (mLightSampler)
+                {
+                    // One light picked by its weight instead of a shadow ray per light
+                    const LightSample sample = mLightSampler->Sample(RandNext(randSeed));
+                    const SceneLight& light = mScene.GetLight(sample.index);
+                    if (sample.pdf > 0.0f && !TraceShadowRay(light, sd.posW)) color += EvalLight(sd, light) / sample.pdf;
+                }
+                else
+                {
+                    for (uint32_t i = 0; i < mScene.GetLightCount(); ++i)
+                    {
+                        if (!TraceShadowRay(mScene.GetLight(i), sd.posW)) color += EvalLight(sd, mScene.GetLight(i));
+                    }
+                }
+
+                if (depth < mBounces)
+                {
+                    color += TraceReflectionRay(sd, depth, randSeed);
+                }
+                return color;
+            }
+
+            bool TraceShadowRay(const SceneLight& light, const float3& origin) const
+            {
+                mRays++;
+                return mBvh.Occluded(GetShadowRay(light, origin));
+            }
+
+            const TriangleScene& mScene;
+            const Bvh& mBvh;
+            const LightSampler* mLightSampler;
+            uint32_t mBounces;
+            uint64_t& mRays;
+        };
+
+        // The bounce loop of RaytracedReflection.slang over a batch of paths. Every bounce traces the rays of all live
+        // paths into bare hit records, shades the hits, which queues their shadow rays and samples the next bounce
+        // into a compacted batch, then traces the shadow rays. Same rays, seeds and sampling as ReflectionTracer.
+        class ReflectionWavefront
+        {
+        public:
+            ReflectionWavefront(const TriangleScene& scene, const Bvh& bvh, const LightSampler* lightSampler, uint32_t bounces)
+                : mScene(scene), mBvh(bvh), mLightSampler(lightSampler), mBounces(bounces) {}
+
+            void Clear()
+            {
+                mPaths.clear();
+                mColors.clear();
+                mTags.clear();
+            }
+
+            // A path from a G-buffer surface, with the seed a recursive trace would start from. The tag is the caller's.
+            void Add(const ShadingData& sd, uint32_t randSeed, uint32_t tag)
+            {
+                Path path;
+                float3 H;
+                path.ray = ReflectionTracer::GenerateReflectionRay(sd, randSeed, H);
+                path.throughput = GetReflectionWeight(sd, H, path.ray.direction);
+                path.randSeed = randSeed;
+                path.index = uint32_t(mColors.size());
+                mPaths.push_back(path);
+                mColors.push_back(float3());
+                mTags.push_back(tag);
+            }
+
+            // Traces every added path to its end and returns the rays traced. NaN colors are zeroed as the shader does.
+            uint64_t Trace()
+            {
+                uint64_t rays = 0;
+                for (uint32_t bounce = 0; bounce < mBounces && !mPaths.empty(); ++bounce)
+                {
+                    mHits.resize(mPaths.size());
+                    mFound.resize(mPaths.size());
+                    for (size_t i = 0; i < mPaths.size(); ++i) mFound[i] = mBvh.Intersect(mPaths[i].ray, mHits[i]) ? 1 : 0;
+                    rays += mPaths.size();
+
+                    mShadowRays.clear();
+                    mNextPaths.clear();
+                    for (size_t i = 0; i < mPaths.size(); ++i)
+                    {
+                        Path& path = mPaths[i];
+                        if (!mFound[i])
+                        {
+                            mColors[path.index] += path.throughput * kMissColor;
+                            continue;
+                        }
+
+                        const ShadingData sd = LoadHitShadingData(mScene, path.ray, mHits[i]);
+                        if (mLightSampler)
+                        {
+                            const LightSample sample = mLightSampler->Sample(RandNext(path.randSeed));
+                            const SceneLight& light = mScene.GetLight(sample.index);
+                            if (sample.pdf > 0.0f) AddShadowRay(light, sd.posW, path.throughput * (EvalLight(sd, light) / sample.pdf), path.index);
+                        }
+                        else
+                        {
+                            for (uint32_t l = 0; l < mScene.GetLightCount(); ++l)
+                            {
+                                AddShadowRay(mScene.GetLight(l), sd.posW, path.throughput * EvalLight(sd, mScene.GetLight(l)), path.index);
+                            }
+                        }
+
+                        if (bounce + 1 < mBounces)
+                        {
+                            float3 H;
+                            Path next = path;
+                            next.ray = ReflectionTracer::GenerateReflectionRay(sd, next.randSeed, H);
+                            next.throughput = path.throughput * GetReflectionWeight(sd, H, next.ray.direction);
+                            mNextPaths.push_back(next);
+                        }
+                    }
+
+                    for (const ShadowRay& shadowRay : mShadowRays)
+                    {
+                        if (!mBvh.Occluded(shadowRay.ray)) mColors[shadowRay.index] += shadowRay.contribution;
+                    }
+                    rays += mShadowRays.size();
+                    std::swap(mPaths, mNextPaths);
+                }
+                mPaths.clear();
+
+                for (float3& color : mColors)
+                {
+                    if (std::isnan(color.x) || std::isnan(color.y) || std::isnan(color.z)) color = float3();
+                }
+                return rays;
+            }
+
+            // In the order of Add()
+            size_t GetPathCount() const { return mColors.size(); }
+            const float3& GetColor(size_t i) const { return mColors[i]; }
+            uint32_t GetTag(size_t i) const { return mTags[i]; }
+
+        private:
+            struct Path
+            {
+                Ray ray;
+                float3 throughput;  // Up to and including the BRDF sample of ray
+                uint32_t randSeed;
+                uint32_t index;     // Into mColors
+            };
+
+            struct ShadowRay
+            {
+                Ray ray;
+                float3 contribution;
+                uint32_t index;
+            };
+
+            void AddShadowRay(const SceneLight& light, const float3& origin, const float3& contribution, uint32_t index)
+            {
+                mShadowRays.push_back({ GetShadowRay(light, origin), contribution, index });
+            }
+
+            const TriangleScene& mScene;
+            const Bvh& mBvh;
+            const LightSampler* mLightSampler;
+            uint32_t mBounces;
+
+            std::vector<Path> mPaths;
+            std::vector<Path> mNextPaths;
+            std::vector<RayHit> mHits;          // The compact payload, hit distance, barycentrics and triangle
+            std::vector<uint8_t> mFound;
+            std::vector<ShadowRay> mShadowRays;
+            std::vector<float3> mColors;
+            std::vector<uint32_t> mTags;
+        };
+
+        bool IsNan(const float3& v) { return std::isnan(v.x) || std::isnan(v.y) || std::isnan(v.z); }
+    }
+
+    RaytracedEffects::RaytracedEffects(const TriangleScene& scene, const Bvh& bvh, ThreadPool& threadPool)
+        : mScene(scene), mBvh(bvh), mThreadPool(threadPool)
+    {
+    }
+
+    template<bool AnyHit, typename MakeRay, typename Shade>
+    void RaytracedEffects::Dispatch(const RtGBuffer& gBuffer, RayScale scale, uint32_t frameCount, Image4F& output, const MakeRay& makeRay, const Shade& shade)
+    {
+        Timer timer;
+
+        const int2 tracedSize = GetTracedSize(scale, gBuffer.worldPosition->GetWidth(), gBuffer.worldPosition->GetHeight());
+        output.Resize(tracedSize.x, tracedSize.y);
+        auto getSeed = [&](const int2& launchIndex)
+        {
+            const uint32_t seed = RandInit(GetTracedPixelIndex(launchIndex, tracedSize, scale, frameCount), frameCount, 16);
+            return (mGradientSamples && scale == RayScale::Full) ? GetGradientSeed(*mGradientSamples, launchIndex, seed) : seed;
+        };
+        auto trace = [this](const Ray& ray, RayHit& hit) { return AnyHit ? mBvh.Occluded(ray) : mBvh.Intersect(ray, hit); };
+
+        mLastStats = RtTraceStats();
+        std::vector<uint64_t> threadRays(mThreadPool.GetThreadCount(), 0);
+        if (mWorkList && scale == RayScale::Full)
+        {
+            const std::vector<uint32_t>& workList = *mWorkList;
+            mThreadPool.ParallelFor(uint32_t((workList.size() + kPixelsPerTask - 1) / kPixelsPerTask), [&](uint32_t task, uint32_t threadIndex)
+            {
+                uint64_t rays = 0;
+                const uint32_t last = std::min(uint32_t(workList.size()), (task + 1) * kPixelsPerTask);
+                for (uint32_t i = task * kPixelsPerTask; i < last; ++i)
+                {
+                    const int2 pixel = AdaptiveSampler::GetWorkListPixel(workList[i]);
+                    const uint32_t rayCount = AdaptiveSampler::GetWorkListRayCount(workList[i]);
+                    if (gBuffer.worldPosition->Load(pixel).w == 0.0f) continue;
+
+                    float4 sum;
+                    for (uint32_t k = 0; k < rayCount; ++k)
+                    {
+                        const uint32_t randSeed = RandInit(uint32_t(pixel.y * tracedSize.x + pixel.x), frameCount + (k << 16), 16);
+                        uint32_t raySeed = randSeed;
+                        const Ray ray = makeRay(pixel, raySeed);
+                        RayHit hit;
+                        const bool found = trace(ray, hit);
+                        rays++;
+                        sum += shade(pixel, randSeed, ray, found, hit, rays);
+                    }
+                    output.At(pixel) = sum / float(rayCount);
+                }
+                threadRays[threadIndex] += rays;
+            });
+        }
+        else if (mRayOrder == RayOrder::Launch)
+        {
+            mThreadPool.ParallelForTiles(tracedSize.x, tracedSize.y, kTileSize, [&](const TileRect& tile, uint32_t threadIndex)
+            {
+                uint64_t rays = 0;
+                for (uint32_t y = tile.y0; y < tile.y1; ++y)
+                {
+                    for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                    {
+                        const int2 launchIndex = int2(int(x), int(y));
+                        const int2 pixel = GetTracedPixel(launchIndex, scale, frameCount);
+                        if (gBuffer.worldPosition->Load(pixel).w == 0.0f) continue;
+
+                        const uint32_t randSeed = getSeed(launchIndex);
+                        uint32_t raySeed = randSeed;
+                        const Ray ray = makeRay(pixel, raySeed);
+                        RayHit hit;
+                        const bool found = trace(ray, hit);
+                        rays++;
+                        output.At(launchIndex) = shade(pixel, randSeed, ray, found, hit, rays);
+                    }
+                }
+                threadRays[threadIndex] += rays;
+            });
+        }
+        else
+        {
+            // Every ray is generated into the stream and binned, then the bins are traced in order and every result is
+            // written back to its launch index. The stream is tile by tile, so a bin keeps the rays of a tile together.
+            const uint32_t width = uint32_t(tracedSize.x);
+            const uint32_t launchCount = width * uint32_t(tracedSize.y);
+            mStreamRays.resize(launchCount);
+            mStreamValid.resize(launchCount);
+            mStreamLaunchIndices.resize(launchCount);
+            mThreadPool.ParallelForTiles(tracedSize.x, tracedSize.y, kTileSize, [&](const TileRect& tile, uint32_t)
+            {
+                uint32_t index = tile.y0 * width + tile.x0 * (tile.y1 - tile.y0);
+                for (uint32_t y = tile.y0; y < tile.y1; ++y)
+                {
+                    for (uint32_t x = tile.x0; x < tile.x1; ++x, ++index)
+                    {
+                        const int2 launchIndex = int2(int(x), int(y));
+                        const int2 pixel = GetTracedPixel(launchIndex, scale, frameCount);
+                        mStreamLaunchIndices[index] = y * width + x;
+                        mStreamValid[index] = gBuffer.worldPosition->Load(pixel).w != 0.0f;
+                        if (!mStreamValid[index]) continue;
+
+                        uint32_t raySeed = getSeed(launchIndex);
+                        mStreamRays[index] = makeRay(pixel, raySeed);
+                    }
+                }
+            });
+            mBinner.Sort(mStreamRays.data(), mStreamValid.data(), launchCount, mThreadPool);
+            mLastStats.binMs = timer.GetElapsedMs();
+            mLastStats.occupiedBins = mBinner.GetOccupiedBinCount();
+
+            const std::vector<uint32_t>& order = mBinner.GetOrder();
+            const uint32_t packetSize = mRayOrder == RayOrder::SortedPackets ? Bvh::kMaxPacketSize : 1;
+            mThreadPool.ParallelFor(uint32_t((order.size() + kRaysPerTask - 1) / kRaysPerTask), [&](uint32_t task, uint32_t threadIndex)
+            {
+                uint64_t rays = 0;
+                const uint32_t last = std::min(uint32_t(order.size()), (task + 1) * kRaysPerTask);
+                Ray packet[Bvh::kMaxPacketSize];
+                RayHit hits[Bvh::kMaxPacketSize];
+                for (uint32_t first = task * kRaysPerTask; first < last; first += packetSize)
+                {
+                    const uint32_t count = std::min(packetSize, last - first);
+                    uint32_t foundMask = 0;
+                    if (packetSize == 1)
+                    {
+                        foundMask = trace(mStreamRays[order[first]], hits[0]) ? 1 : 0;
+                    }
+                    else
+                    {
+                        for (uint32_t i = 0; i < count; ++i) packet[i] = mStreamRays[order[first + i]];
+                        foundMask = AnyHit ? mBvh.OccludedPacket(packet, count) : mBvh.IntersectPacket(packet, count, hits);
+                    }
+
+                    for (uint32_t i = 0; i < count; ++i)
+                    {
+                        const uint32_t index = order[first + i];
+                        const int2 launchIndex = int2(int(mStreamLaunchIndices[index] % width), int(mStreamLaunchIndices[index] / width));
+                        rays++;
+                        output.At(launchIndex) = shade(GetTracedPixel(launchIndex, scale, frameCount), getSeed(launchIndex), mStreamRays[index],
+                            ((foundMask >> i) & 1) != 0, hits[i], rays);
+                    }
+                }
+                threadRays[threadIndex] += rays;
+            });
+        }
+
+        for (uint64_t rays : threadRays) mLastStats.rays += rays;
+        mLastStats.elapsedMs = timer.GetElapsedMs();
+    }
+
+    void RaytracedEffects::TraceShadows(const RtGBuffer& gBuffer, RayScale scale, uint32_t frameCount, Image4F& output)
+    {
+        FRAME_PROFILE("RaytraceShadows");
+        if (mScene.GetLightCount() == 0)
+        {
+            output.Resize(0, 0);
+            mLastStats = RtTraceStats();
+            return;
+        }
+
+        // Without a light sampler only the first light casts shadows, and the output is its visibility. A resampled
+        // light is weighted by its reservoir instead of a selection probability and draws no random number.
+        auto pickLight = [&](const int2& pixel, uint32_t& randSeed)
+        {
+            if (mLightReservoirs)
+            {
+                const LightReservoir& reservoir = mLightReservoirs->At(pixel);
+                return LightSample{ reservoir.light, reservoir.weight > 0.0f ? 1.0f / reservoir.weight : 0.0f };
+            }
+            if (!mLightSampler) return LightSample{ 0, 1.0f };
+            return mLightSampler->Sample(RandNext(randSeed));
+        };
+        auto makeRay = [&](const int2& pixel, uint32_t& randSeed)
+        {
+            const SceneLight& light = mScene.GetLight(pickLight(pixel, randSeed).index);
+            const float2 randVal(RandNext(randSeed), RandNext(randSeed));
+            const float3 posW = gBuffer.worldPosition->At(pixel).rgb();
+
+            float3 direction;
+            float maxT;
+            GetLightDirection(light, posW, direction, maxT);
+
+            Ray ray;
+            ray.origin = posW;
+            ray.direction = normalize(SampleLightCone(randVal, direction, 0.02f));
+            ray.tMin = 0.01f;
+            ray.tMax = std::max(0.01f, maxT);
+            return ray;
+        };
+        auto shade = [&](const int2& pixel, uint32_t randSeed, const Ray&, bool occluded, const RayHit&, uint64_t&)
+        {
+            if (!mLightSampler && !mLightReservoirs) return float4(occluded ? 0.0f : 1.0f, 0.0f, 0.0f, 1.0f);
+
+            // The shadowed light of one light over its selection probability
+            const LightSample sample = pickLight(pixel, randSeed);
+            if (occluded || sample.pdf <= 0.0f) return float4(0.0f, 0.0f, 0.0f, 1.0f);
+            const float3 color = EvalLight(LoadShadingData(gBuffer, pixel), mScene.GetLight(sample.index)) / sample.pdf;
+            return float4(IsNan(color) ? float3() : color, 1.0f);
+        };
+        Dispatch<true>(gBuffer, scale, frameCount, output, makeRay, shade);
+    }
+
+    void RaytracedEffects::TraceDirectLight(const RtGBuffer& gBuffer, RayScale scale, uint32_t frameCount, Image4F& output)
+    {
+        // Same scope as the renderer's pass, direct light replaces the shadow pass there
+        FRAME_PROFILE("RaytraceShadows");
+        if (mScene.GetLightCount() == 0)
+        {
+            output.Resize(0, 0);
+            mLastStats = RtTraceStats();
+            return;
+        }
+
+        // The first light's ray goes through the dispatch, the others are traced from the shade callback
+        auto makeRay = [&](const int2& pixel, uint32_t&)
+        {
+            const float3 posW = gBuffer.worldPosition->At(pixel).rgb();
+            float3 direction;
+            float maxT;
+            GetLightDirection(mScene.GetLight(0), posW, direction, maxT);
+
+            Ray ray;
+            ray.origin = posW;
+            ray.direction = normalize(direction);
+            ray.tMin = 0.001f;
+            ray.tMax = std::max(0.01f, maxT);
+            return ray;
+        };
+        auto shade = [&](const int2& pixel, uint32_t, const Ray&, bool occluded, const RayHit&, uint64_t& rays)
+        {
+            const ShadingData sd = LoadShadingData(gBuffer, pixel);
+            float3 color = occluded ? float3() : EvalLight(sd, mScene.GetLight(0));
+            for (uint32_t i = 1; i < mScene.GetLightCount(); ++i)
+            {
+                const SceneLight& light = mScene.GetLight(i);
+                float3 direction;
+                float maxT;
+                GetLightDirection(light, sd.posW, direction, maxT);
+
+                Ray ray;
+                ray.origin = sd.posW;
+                ray.direction = normalize(direction);
+                ray.tMin = 0.001f;
+                ray.tMax = std::max(0.01f, maxT);
+                rays++;
+                if (!mBvh.Occluded(ray)) color += EvalLight(sd, light);
+            }
+            return float4(IsNan(color) ? float3() : color, 1.0f);
+        };
+        Dispatch<true>(gBuffer, scale, frameCount, output, makeRay, shade);
+    }
+
+    void RaytracedEffects::TraceAO(const RtGBuffer& gBuffer, RayScale scale, uint32_t frameCount, float aoDistance, Image4F& output)
+    {
+        FRAME_PROFILE("RaytraceAO");
+        auto makeRay = [&](const int2& pixel, uint32_t& randSeed)
+        {
+            const float2 randVal(RandNext(randSeed), RandNext(randSeed));
+            const float3 normalW = gBuffer.normalRoughness->At(pixel).rgb();
+
+            Ray ray;
+            ray.origin = gBuffer.worldPosition->At(pixel).rgb();
+            ray.direction = GetCosHemisphereSample(randVal, normalW, GetPerpendicularStark(normalW));
+            ray.tMin = 0.01f;
+            ray.tMax = std::max(0.01f, aoDistance);
+            return ray;
+        };
+        auto shade = [](const int2&, uint32_t, const Ray&, bool occluded, const RayHit&, uint64_t&)
+        {
+            return float4(occluded ? 0.0f : 1.0f, 0.0f, 0.0f, 1.0f);
+        };
+        Dispatch<true>(gBuffer, scale, frameCount, output, makeRay, shade);
+    }
+
+    void RaytracedEffects::TraceReflection(const RtGBuffer& gBuffer, RayScale scale, uint32_t frameCount, Image4F& output)
+    {
+        FRAME_PROFILE("RaytraceReflection");
+        if (mReflectionTracing == ReflectionTracing::Wavefront)
+        {
+            TraceWavefrontReflection(gBuffer, scale, frameCount, output);
+            return;
+        }
+        if (mReflectionClassifier && scale == RayScale::Full)
+        {
+            TraceClassifiedReflection(gBuffer, frameCount, output);
+            return;
+        }
+
+        auto makeRay = [&](const int2& pixel, uint32_t& randSeed)
+        {
+            float3 H;
+            return ReflectionTracer::GenerateReflectionRay(LoadShadingData(gBuffer, pixel), randSeed, H);
+        };
+        auto shade = [&](const int2& pixel, uint32_t randSeed, const Ray& ray, bool found, const RayHit& hit, uint64_t& rays)
+        {
+            // The sample is drawn again for its half vector and the seed after it
+            const ShadingData sd = LoadShadingData(gBuffer, pixel);
+            float3 H;
+            ReflectionTracer::GenerateReflectionRay(sd, randSeed, H);
+            const ReflectionTracer tracer(mScene, mBvh, mLightSampler, mReflectionBounces, rays);
+            const float3 color = tracer.ShadeReflectionRay(sd, H, ray, found, hit, 0, randSeed);
+            return float4(IsNan(color) ? float3() : color, 1.0f);
+        };
+        Dispatch<false>(gBuffer, scale, frameCount, output, makeRay, shade);
+    }
+
+    void RaytracedEffects::TraceClassifiedReflection(const RtGBuffer& gBuffer, uint32_t frameCount, Image4F& output)
+    {
+        Timer timer;
+
+        const uint32_t width = gBuffer.worldPosition->GetWidth();
+        const uint32_t height = gBuffer.worldPosition->GetHeight();
+        const std::vector<uint32_t>& workList = mReflectionClassifier->GetWorkList();
+        const Image<uint8_t>& classes = mReflectionClassifier->GetClasses();
+        output.Resize(width, height);
+
+        mLastStats = RtTraceStats();
+        std::vector<uint64_t> threadRays(mThreadPool.GetThreadCount(), 0);
+        mThreadPool.ParallelFor(uint32_t((workList.size() + kPixelsPerTask - 1) / kPixelsPerTask), [&](uint32_t task, uint32_t threadIndex)
+        {
+            uint64_t rays = 0;
+            const ReflectionTracer tracer(mScene, mBvh, mLightSampler, mReflectionBounces, rays);
+            const uint32_t last = std::min(uint32_t(workList.size()), (task + 1) * kPixelsPerTask);
+            for (uint32_t i = task * kPixelsPerTask; i < last; ++i)
+            {
+                const int2 pixel = ReflectionClassifier::GetWorkListPixel(workList[i]);
+                const uint32_t randSeed = RandInit(uint32_t(pixel.y) * width + uint32_t(pixel.x), frameCount, 16);
+                const float3 color = tracer.TraceReflectionRay(LoadShadingData(gBuffer, pixel), 0, randSeed);
+                const float4 value(IsNan(color) ? float3() : color, 1.0f);
+                if (ReflectionClassifier::GetWorkListClass(workList[i]) == ReflectionClass::Mirror)
+                {
+                    output.At(pixel) = value;
+                    continue;
+                }
+
+                // The quad's other glossy pixels are not listed, this ray stands for them
+                const int2 quad(pixel.x / 2, pixel.y / 2);
+                for (uint32_t k = 0; k < 4; ++k)
+                {
+                    const int2 quadPixel = GetGlossyQuadPixel(quad, 0, k);
+                    if (uint32_t(quadPixel.x) >= width || uint32_t(quadPixel.y) >= height) continue;
+                    if (ReflectionClass(classes.At(quadPixel)) == ReflectionClass::Glossy) output.At(quadPixel) = value;
+                }
+            }
+            threadRays[threadIndex] += rays;
+        });
+
+        for (uint64_t rays : threadRays) mLastStats.rays += rays;
+        mLastStats.elapsedMs = timer.GetElapsedMs();
+    }
+
+    void RaytracedEffects::TraceWavefrontReflection(const RtGBuffer& gBuffer, RayScale scale, uint32_t frameCount, Image4F& output)
+    {
+        Timer timer;
+
+        const uint32_t width = gBuffer.worldPosition->GetWidth();
+        const uint32_t height = gBuffer.worldPosition->GetHeight();
+        const int2 tracedSize = GetTracedSize(scale, width, height);
+        output.Resize(tracedSize.x, tracedSize.y);
+
+        mLastStats = RtTraceStats();
+        std::vector<uint64_t> threadRays(mThreadPool.GetThreadCount(), 0);
+        std::vector<ReflectionWavefront> wavefronts(mThreadPool.GetThreadCount(), ReflectionWavefront(mScene, mBvh, mLightSampler, mReflectionBounces));
+
+        // A batch is a task of list entries or a tile of launch indices, the same split as the other paths
+        if (mReflectionClassifier && scale == RayScale::Full)
+        {
+            const std::vector<uint32_t>& workList = mReflectionClassifier->GetWorkList();
+            const Image<uint8_t>& classes = mReflectionClassifier->GetClasses();
+            mThreadPool.ParallelFor(uint32_t((workList.size() + kPixelsPerTask - 1) / kPixelsPerTask), [&](uint32_t task, uint32_t threadIndex)
+            {
+                ReflectionWavefront& wavefront = wavefronts[threadIndex];
+                wavefront.Clear();
+                const uint32_t last = std::min(uint32_t(workList.size()), (task + 1) * kPixelsPerTask);
+                for (uint32_t i = task * kPixelsPerTask; i < last; ++i)
+                {
+                    const int2 pixel = ReflectionClassifier::GetWorkListPixel(workList[i]);
+                    wavefront.Add(LoadShadingData(gBuffer, pixel), RandInit(uint32_t(pixel.y) * width + uint32_t(pixel.x), frameCount, 16), workList[i]);
+                }
+                threadRays[threadIndex] += wavefront.Trace();
+
+                for (size_t i = 0; i < wavefront.GetPathCount(); ++i)
+                {
+                    const int2 pixel = ReflectionClassifier::GetWorkListPixel(wavefront.GetTag(i));
+                    const float4 value(wavefront.GetColor(i), 1.0f);
+                    if (ReflectionClassifier::GetWorkListClass(wavefront.GetTag(i)) == ReflectionClass::Mirror)
+                    {
+                        output.At(pixel) = value;
+                        continue;
+                    }
+
+                    const int2 quad(pixel.x / 2, pixel.y / 2);
+                    for (uint32_t k = 0; k < 4; ++k)
+                    {
+                        const int2 quadPixel = GetGlossyQuadPixel(quad, 0, k);
+                        if (uint32_t(quadPixel.x) >= width || uint32_t(quadPixel.y) >= height) continue;
+                        if (ReflectionClass(classes.At(quadPixel)) == ReflectionClass::Glossy) output.At(quadPixel) = value;
+                    }
+                }
+            });
+        }
+        else if (mWorkList && scale == RayScale::Full)
+        {
+            // The rays of a pixel are consecutive paths, averaged as they come out
+            const std::vector<uint32_t>& workList = *mWorkList;
+            mThreadPool.ParallelFor(uint32_t((workList.size() + kPixelsPerTask - 1) / kPixelsPerTask), [&](uint32_t task, uint32_t threadIndex)
+            {
+                ReflectionWavefront& wavefront = wavefronts[threadIndex];
+                wavefront.Clear();
+                const uint32_t last = std::min(uint32_t(workList.size()), (task + 1) * kPixelsPerTask);
+                for (uint32_t i = task * kPixelsPerTask; i < last; ++i)
+                {
+                    const int2 pixel = AdaptiveSampler::GetWorkListPixel(workList[i]);
+                    if (gBuffer.worldPosition->Load(pixel).w == 0.0f) continue;
+
+                    const ShadingData sd = LoadShadingData(gBuffer, pixel);
+                    for (uint32_t k = 0; k < AdaptiveSampler::GetWorkListRayCount(workList[i]); ++k)
+                    {
+                        wavefront.Add(sd, RandInit(uint32_t(pixel.y * tracedSize.x + pixel.x), frameCount + (k << 16), 16), workList[i]);
+                    }
+                }
+                threadRays[threadIndex] += wavefront.Trace();
+
+                for (size_t i = 0; i < wavefront.GetPathCount();)
+                {
+                    const uint32_t entry = wavefront.GetTag(i);
+                    const uint32_t rayCount = AdaptiveSampler::GetWorkListRayCount(entry);
+                    float3 sum;
+                    for (uint32_t k = 0; k < rayCount; ++k) sum += wavefront.GetColor(i++);
+                    output.At(AdaptiveSampler::GetWorkListPixel(entry)) = float4(sum / float(rayCount), 1.0f);
+                }
+            });
+        }
+        else
+        {
+            mThreadPool.ParallelForTiles(tracedSize.x, tracedSize.y, kTileSize, [&](const TileRect& tile, uint32_t threadIndex)
+            {
+                ReflectionWavefront& wavefront = wavefronts[threadIndex];
+                wavefront.Clear();
+                for (uint32_t y = tile.y0; y < tile.y1; ++y)
+                {
+                    for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                    {
+                        const int2 launchIndex = int2(int(x), int(y));
+                        const int2 pixel = GetTracedPixel(launchIndex, scale, frameCount);
+                        if (gBuffer.worldPosition->Load(pixel).w == 0.0f) continue;
+
+                        uint32_t randSeed = RandInit(GetTracedPixelIndex(launchIndex, tracedSize, scale, frameCount), frameCount, 16);
+                        if (mGradientSamples && scale == RayScale::Full) randSeed = GetGradientSeed(*mGradientSamples, launchIndex, randSeed);
+                        wavefront.Add(LoadShadingData(gBuffer, pixel), randSeed, y * uint32_t(tracedSize.x) + x);
+                    }
+                }
+                threadRays[threadIndex] += wavefront.Trace();
+
+                for (size_t i = 0; i < wavefront.GetPathCount(); ++i)
+                {
+                    const uint32_t index = wavefront.GetTag(i);
+                    output.At(int(index % uint32_t(tracedSize.x)), int(index / uint32_t(tracedSize.x))) = float4(wavefront.GetColor(i), 1.0f);
+                }
+            });
+        }
+
+        for (uint64_t rays : threadRays) mLastStats.rays += rays;
+        mLastStats.elapsedMs = timer.GetElapsedMs();
+    }
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include "Bvh.h"
+#include "Image.h"
+#include "LightResampling.h"
+#include "LightSampling.h"
+#include "RayBinning.h"
+#include "RayScale.h"
+#include "ReflectionClassification.h"
+#include "Shading.h"
+#include "TemporalGradient.h"
+#include "ThreadPool.h"
+
+namespace Cpu
+{
+    // The order the launched rays are traced in. Sorted generates every ray first, bins them with a RayBinner and
+    // scatters the results back to their pixels; the output is the same as in launch order. SortedPackets traces the
+    // binned rays Bvh::kMaxPacketSize at a time.
+    enum class RayOrder : uint32_t
+    {
+        Launch = 0,
+        Sorted,
+        SortedPackets
+    };
+
+    // How reflection bounces are traced. Recursive is the closest-hit shader RaytracedReflection.slang used to have,
+    // which shaded its hit and traced the shadow rays and the next bounce from there. Wavefront is the bounce loop of its
+    // ray generation shader: every bounce of a batch of paths is traced into bare hit records, then shaded, its shadow
+    // rays traced together and the live paths compacted for the next bounce. Same rays and seeds, the colors only differ
+    // by float rounding. Wavefront batches are tiles or work list tasks, the ray order does not apply.
+    enum class ReflectionTracing : uint32_t
+    {
+        Recursive = 0,
+        Wavefront
+    };
+
+    struct RtTraceStats
+    {
+        uint64_t rays = 0;          // Every traced ray, shadow rays of reflection hits included
+        double elapsedMs = 0.0;
+        double binMs = 0.0;         // Generating and binning the rays of a sorted order, part of elapsedMs
+        uint32_t occupiedBins = 0;
+
+        double GetRaysPerSecond() const { return elapsedMs > 0.0 ? double(rays) * 1000.0 / elapsedMs : 0.0; }
+    };
+
+    // CPU port of RaytracedShadows.slang, RaytracedAO.slang and RaytracedReflection.slang. Same seeds, same
+    // sampling and the same launch layout: the output is the traced size of the ray scale and holds what the
+    // shader writes to gOutput, in .x for shadows (.rgb with a light sampler) and AO. Pixels without geometry are
+    // skipped and keep the clear value. Tiles are spread over the thread pool.
+    class RaytracedEffects
+    {
+    public:
+        RaytracedEffects(const TriangleScene& scene, const Bvh& bvh, ThreadPool& threadPool);
+
+        void TraceShadows(const RtGBuffer& gBuffer, RayScale scale, uint32_t frameCount, Image4F& output);
+        void TraceAO(const RtGBuffer& gBuffer, RayScale scale, uint32_t frameCount, float aoDistance, Image4F& output);
+        void TraceReflection(const RtGBuffer& gBuffer, RayScale scale, uint32_t frameCount, Image4F& output);
+        // Shadowed direct light of every light in .rgb, one shadow ray per light as the reflection closest-hit shader
+        // traces them. The reference sampled shadows converge to, there is no GPU counterpart.
+        void TraceDirectLight(const RtGBuffer& gBuffer, RayScale scale, uint32_t frameCount, Image4F& output);
+
+        void SetRayOrder(RayOrder order) { mRayOrder = order; }
+        RayOrder GetRayOrder() const { return mRayOrder; }
+
+        // Traces the pixels of an AdaptiveSampler work list instead of the launch grid, in list order and with the listed
+        // number of rays each, averaged into the output. Ray k of a pixel draws the seed of frame frameCount + (k << 16),
+        // so the first one is the ray a launch traces. Unlisted pixels keep the clear value. Full ray scale only, the
+        // ray order does not apply. nullptr goes back to the launch grid.
+        void SetWorkList(const std::vector<uint32_t>* workList) { mWorkList = workList; }
+
+        // Picks one light per shading point from the sampler, which has to be built over the scene's lights. Shadows
+        // then write the shadowed direct light of the picked light over its probability (.rgb, a color signal for the
+        // denoiser) instead of the visibility of the first light, and reflection hits trace one shadow ray instead of
+        // one per light. nullptr goes back to that.
+        void SetLightSampler(const LightSampler* lightSampler) { mLightSampler = lightSampler; }
+
+        // Shadows trace towards the light of each pixel's LightResampler reservoir and weight it by the reservoir
+        // instead of picking one from the light sampler. The reservoirs are at G-buffer size and take precedence over
+        // the sampler, reflections still use the sampler. nullptr goes back to it.
+        void SetLightReservoirs(const Image<LightReservoir>* reservoirs) { mLightReservoirs = reservoirs; }
+
+        // A-SVGF gradient samples of a SVGFSharedHistory. A pixel a sample landed on traces with the seed the sample
+        // was traced with last frame instead of its own. Full ray scale launches only, nullptr goes back to own seeds.
+        void SetGradientSamples(const Image<GradientSample>* samples) { mGradientSamples = samples; }
+
+        // Reflections trace the classifier's work list instead of the launch grid: a mirror pixel as a launch would, the
+        // ray of a glossy one into every glossy pixel of its quad. Rough pixels keep the clear value. Full ray scale
+        // only, takes precedence over the work list and the ray order. nullptr goes back to the launch grid.
+        void SetReflectionClassifier(const ReflectionClassifier* classifier) { mReflectionClassifier = classifier; }
+
+        void SetReflectionTracing(ReflectionTracing tracing) { mReflectionTracing = tracing; }
+        ReflectionTracing GetReflectionTracing() const { return mReflectionTracing; }
+
+        // Reflection rays per path, the one from the G-buffer included. The default traces one bounce off the first hit.
+        void SetReflectionBounces(uint32_t bounces) { mReflectionBounces = std::max(1u, bounces); }
+        uint32_t GetReflectionBounces() const { return mReflectionBounces; }
+
+        const RtTraceStats& GetLastStats() const { return mLastStats; }
+
+    private:
+        // makeRay(pixel, randSeed) returns the ray a launch index traces first, advancing randSeed past its samples.
+        // shade(pixel, randSeed, ray, found, hit, rays) returns the gOutput value once it is traced, given the seed
+        // makeRay started from. AnyHit traces with Occluded() and leaves hit unset.
+        template<bool AnyHit, typename MakeRay, typename Shade>
+        void Dispatch(const RtGBuffer& gBuffer, RayScale scale, uint32_t frameCount, Image4F& output, const MakeRay& makeRay, const Shade& shade);
+        void TraceClassifiedReflection(const RtGBuffer& gBuffer, uint32_t frameCount, Image4F& output);
+        void TraceWavefrontReflection(const RtGBuffer& gBuffer, RayScale scale, uint32_t frameCount, Image4F& output);
+
+        const TriangleScene& mScene;
+        const Bvh& mBvh;
+        ThreadPool& mThreadPool;
+        RayOrder mRayOrder = RayOrder::Launch;
+        const std::vector<uint32_t>* mWorkList = nullptr;
+        const LightSampler* mLightSampler = nullptr;
+        const Image<LightReservoir>* mLightReservoirs = nullptr;
+        const Image<GradientSample>* mGradientSamples = nullptr;
+        const ReflectionClassifier* mReflectionClassifier = nullptr;
+        ReflectionTracing mReflectionTracing = ReflectionTracing::Recursive;
+        uint32_t mReflectionBounces = 2;
+        RtTraceStats mLastStats;
+
+        // The rays of a sorted dispatch tile by tile, reused across dispatches
+        std::vector<Ray> mStreamRays;
+        std::vector<uint8_t> mStreamValid;
+        std::vector<uint32_t> mStreamLaunchIndices;     // y * width + x
+        RayBinner mBinner;
+    };
+}
@@ -0,0 +1,99 @@
+#include "ReflectionClassification.h"
+#include "Timer.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        // Work list tiles, the thread group size of ReflectionClassification.slang. Even, so no quad straddles two.
+        const uint32_t kTileSize = 16;
+    }
+
+    ReflectionClassifier::ReflectionClassifier(ThreadPool* threadPool)
+        : mThreadPool(threadPool ? threadPool : &ThreadPool::GetDefault())
+    {
+    }
+
+    void ReflectionClassifier::Classify(const RtGBuffer& gBuffer, uint32_t frameCount)
+    {
+        Timer timer;
+
+        const uint32_t width = gBuffer.worldPosition->GetWidth();
+        const uint32_t height = gBuffer.worldPosition->GetHeight();
+        const uint32_t tilesX = (width + kTileSize - 1) / kTileSize;
+        const uint32_t tilesY = (height + kTileSize - 1) / kTileSize;
+
+        mClasses.Resize(width, height);
+        mTileOffsets.assign(size_t(tilesX) * tilesY + 1, 0);
+
+        auto isTraced = [&](uint32_t x, uint32_t y)
+        {
+            const ReflectionClass reflectionClass = ReflectionClass(mClasses.At(int(x), int(y)));
+            if (reflectionClass != ReflectionClass::Glossy) return reflectionClass == ReflectionClass::Mirror;
+
+            // The first glossy pixel of the quad in this frame's order traces for the others
+            const int2 quad(int(x / 2), int(y / 2));
+            for (uint32_t k = 0; k < 4; ++k)
+            {
+                const int2 pixel = GetGlossyQuadPixel(quad, frameCount, k);
+                if (uint32_t(pixel.x) >= width || uint32_t(pixel.y) >= height) continue;
+                if (ReflectionClass(mClasses.At(pixel)) == ReflectionClass::Glossy) return pixel.x == int(x) && pixel.y == int(y);
+            }
+            return false;
+        };
+
+        std::vector<ReflectionClassificationStats> threadStats(mThreadPool->GetThreadCount());
+        mThreadPool->ParallelForTiles(width, height, kTileSize, [&](const TileRect& tile, uint32_t threadIndex)
+        {
+            ReflectionClassificationStats& stats = threadStats[threadIndex];
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    const int2 pixel = int2(int(x), int(y));
+                    ReflectionClass reflectionClass = ReflectionClass::Rough;
+                    if (gBuffer.worldPosition->At(pixel).w != 0.0f)
+                    {
+                        reflectionClass = GetReflectionClass(gBuffer.normalRoughness->At(pixel).w, mSettings.glossyRoughness, mSettings.roughRoughness);
+                        stats.mirrorPixels += reflectionClass == ReflectionClass::Mirror ? 1 : 0;
+                        stats.glossyPixels += reflectionClass == ReflectionClass::Glossy ? 1 : 0;
+                        stats.roughPixels += reflectionClass == ReflectionClass::Rough ? 1 : 0;
+                    }
+                    mClasses.At(pixel) = uint8_t(reflectionClass);
+                }
+            }
+
+            uint32_t tilePixels = 0;
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x) tilePixels += isTraced(x, y) ? 1 : 0;
+            }
+            mTileOffsets[(tile.y0 / kTileSize) * tilesX + tile.x0 / kTileSize + 1] = tilePixels;
+        });
+
+        for (size_t i = 1; i < mTileOffsets.size(); ++i) mTileOffsets[i] += mTileOffsets[i - 1];
+        mWorkList.resize(mTileOffsets.back());
+
+        mThreadPool->ParallelForTiles(width, height, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            uint32_t index = mTileOffsets[(tile.y0 / kTileSize) * tilesX + tile.x0 / kTileSize];
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    if (isTraced(x, y)) mWorkList[index++] = x | (y << 14) | (uint32_t(mClasses.At(int(x), int(y))) << 28);
+                }
+            }
+        });
+
+        mStats = ReflectionClassificationStats();
+        for (const ReflectionClassificationStats& stats : threadStats)
+        {
+            mStats.mirrorPixels += stats.mirrorPixels;
+            mStats.glossyPixels += stats.glossyPixels;
+            mStats.roughPixels += stats.roughPixels;
+        }
+        mStats.tracedPixels = uint32_t(mWorkList.size());
+        mStats.elapsedMs = timer.GetElapsedMs();
+    }
+}
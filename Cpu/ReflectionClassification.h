@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "Image.h"
+#include "RayScale.h"
+#include "Shading.h"
+#include "ThreadPool.h"
+
+// CPU mirror of Data/ReflectionClassification.h. Keep the two in sync.
+namespace Cpu
+{
+    enum class ReflectionClass : uint8_t
+    {
+        Mirror = 0,     // A ray every frame
+        Glossy,         // The glossy pixels of a 2x2 quad share one ray
+        Rough           // No rays, GetPrefilteredReflection(). Pixels without geometry too.
+    };
+
+    // The miss color of the reflection rays, the environment rough pixels see without probes
+    const float3 kReflectionEnvironment(0.2f, 0.6f, 0.9f);
+
+    // From the G-buffer's linear roughness, before the 0.08 clamp of LoadShadingData()
+    inline ReflectionClass GetReflectionClass(float linearRoughness, float glossyRoughness, float roughRoughness)
+    {
+        if (linearRoughness >= roughRoughness) return ReflectionClass::Rough;
+        return linearRoughness >= glossyRoughness ? ReflectionClass::Glossy : ReflectionClass::Mirror;
+    }
+
+    // The k-th pixel of a 2x2 quad in the order its glossy pixels take turns tracing, starting at the one RayScale::Half
+    // traces this frame
+    inline int2 GetGlossyQuadPixel(const int2& quad, uint32_t frameCount, uint32_t k)
+    {
+        return GetTracedPixel(quad, RayScale::Half, frameCount + k);
+    }
+
+    // Directional albedo of the specular lobe, Karis' analytic fit of the split sum environment BRDF ("Physically Based
+    // Shading on Mobile"). What a traced reflection converges to under a constant environment of radiance 1.
+    inline float3 EnvBRDFApprox(const float3& specular, float linearRoughness, float NdotV)
+    {
+        const float4 r = float4(-1.0f, -0.0275f, -0.572f, 0.022f) * linearRoughness + float4(1.0f, 0.0425f, 1.04f, -0.04f);
+        const float a004 = std::min(r.x * r.x, std::exp2(-9.28f * NdotV)) * r.x + r.y;
+        const float a = -1.04f * a004 + r.z;
+        const float b = 1.04f * a004 + r.w;
+        return specular * a + float3(b);
+    }
+
+    // Reflection of a rough pixel from the radiance prefiltered around its mirror direction
+    inline float3 GetPrefilteredReflection(const ShadingData& sd, const float3& prefilteredRadiance)
+    {
+        return prefilteredRadiance * EnvBRDFApprox(sd.specular, std::sqrt(sd.roughness), sd.NdotV);
+    }
+
+    // The mirror direction of GetPrefilteredReflection()
+    inline float3 GetMirrorDirection(const ShadingData& sd)
+    {
+        return reflect(-sd.V, sd.N);
+    }
+
+    // Same knobs as ::ReflectionClassificationPass, with the same defaults
+    struct ReflectionClassificationSettings
+    {
+        float glossyRoughness = 0.15f;  // Linear roughness from which a pixel is glossy
+        float roughRoughness = 0.45f;   // and from which it is rough
+    };
+
+    struct ReflectionClassificationStats
+    {
+        uint32_t mirrorPixels = 0;
+        uint32_t glossyPixels = 0;
+        uint32_t roughPixels = 0;       // With geometry
+        uint32_t tracedPixels = 0;      // Work list entries
+        double elapsedMs = 0.0;
+    };
+
+    // Headless implementation of ::ReflectionClassificationPass. Sorts the pixels by the linear roughness in the
+    // G-buffer: mirror pixels trace a reflection ray every frame, the glossy pixels of each 2x2 quad take turns tracing
+    // one ray that stands for all of them, and rough pixels trace none and are shaded from a prefiltered environment or
+    // the irradiance probes instead. The pixels that trace are compacted into a work list, 16x16 tiles in raster order
+    // and pixels in raster order within a tile, which RaytracedEffects::SetReflectionClassifier() traces instead of the
+    // launch grid.
+    class ReflectionClassifier
+    {
+    public:
+        explicit ReflectionClassifier(ThreadPool* threadPool = nullptr);
+
+        void Classify(const RtGBuffer& gBuffer, uint32_t frameCount);
+
+        // Work list entries are x | y << 14 | class << 28
+        static int2 GetWorkListPixel(uint32_t entry) { return int2(int(entry & 0x3FFFu), int((entry >> 14) & 0x3FFFu)); }
+        static ReflectionClass GetWorkListClass(uint32_t entry) { return ReflectionClass(entry >> 28); }
+
+        ReflectionClassificationSettings& GetSettings() { return mSettings; }
+        const ReflectionClassificationSettings& GetSettings() const { return mSettings; }
+        // ReflectionClass of every pixel
+        const Image<uint8_t>& GetClasses() const { return mClasses; }
+        const std::vector<uint32_t>& GetWorkList() const { return mWorkList; }
+        const ReflectionClassificationStats& GetStats() const { return mStats; }
+
+    private:
+        ThreadPool* mThreadPool;
+        ReflectionClassificationSettings mSettings;
+        ReflectionClassificationStats mStats;
+
+        Image<uint8_t> mClasses;
+        std::vector<uint32_t> mTileOffsets;
+        std::vector<uint32_t> mWorkList;
+    };
+}
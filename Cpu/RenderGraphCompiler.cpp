@@ -0,0 +1,263 @@
+#include <algorithm>
+#include "RenderGraphCompiler.h"
+
+namespace Cpu
+{
+    void RenderGraphCompiler::Clear()
+    {
+        mResources.clear();
+        mPasses.clear();
+        mPassReadNames.clear();
+        mPassWriteNames.clear();
+        mOutputNames.clear();
+        mResourceIndices.clear();
+        mExecutionOrder.clear();
+        mPhysicalDescs.clear();
+        mTransientBytes = 0;
+        mAliasedBytes = 0;
+        mPeakLiveBytes = 0;
+        mError.clear();
+    }
+
+    uint32_t RenderGraphCompiler::AddResource(const std::string& name, const TextureDesc& desc)
+    {
+        Resource resource;
+        resource.name = name;
+        resource.desc = desc;
+        mResources.push_back(resource);
+        mResourceIndices[name] = uint32_t(mResources.size() - 1);
+        return uint32_t(mResources.size() - 1);
+    }
+
+    uint32_t RenderGraphCompiler::ImportResource(const std::string& name)
+    {
+        Resource resource;
+        resource.name = name;
+        resource.imported = true;
+        mResources.push_back(resource);
+        mResourceIndices[name] = uint32_t(mResources.size() - 1);
+        return uint32_t(mResources.size() - 1);
+    }
+
+    uint32_t RenderGraphCompiler::AddPass(const std::string& name, const std::vector<std::string>& reads, const std::vector<std::string>& writes, RenderGraphPassType type)
+    {
+        Pass pass;
+        pass.name = name;
+        pass.type = type;
+        mPasses.push_back(pass);
+        mPassReadNames.push_back(reads);
+        mPassWriteNames.push_back(writes);
+        return uint32_t(mPasses.size() - 1);
+    }
+
+    void RenderGraphCompiler::MarkOutput(const std::string& name)
+    {
+        mOutputNames.push_back(name);
+    }
+
+    uint32_t RenderGraphCompiler::FindResource(const std::string& name) const
+    {
+        auto it = mResourceIndices.find(name);
+        return it != mResourceIndices.end() ? it->second : kInvalidIndex;
+    }
+
+    bool RenderGraphCompiler::ResolveNames(const std::vector<std::string>& names, std::vector<uint32_t>& indices)
+    {
+        indices.clear();
+        for (const std::string& name : names)
+        {
+            const uint32_t index = FindResource(name);
+            if (index == kInvalidIndex)
+            {
+                mError = "Unknown resource '" + name + "'";
+                return false;
+            }
+            indices.push_back(index);
+        }
+        return true;
+    }
+
+    bool RenderGraphCompiler::Compile()
+    {
+        mError.clear();
+        mExecutionOrder.clear();
+        mPhysicalDescs.clear();
+        mTransientBytes = 0;
+        mAliasedBytes = 0;
+        mPeakLiveBytes = 0;
+
+        for (Resource& resource : mResources)
+        {
+            resource.output = false;
+            resource.firstUse = kInvalidIndex;
+            resource.lastUse = kInvalidIndex;
+            resource.physicalIndex = kInvalidIndex;
+        }
+
+        std::vector<uint32_t> outputs;
+        if (!ResolveNames(mOutputNames, outputs)) return false;
+        for (uint32_t output : outputs) mResources[output].output = true;
+
+        // Producer of every read: the last earlier pass that wrote the resource
+        std::vector<uint32_t> lastWriter(mResources.size(), kInvalidIndex);
+        for (uint32_t p = 0; p < mPasses.size(); ++p)
+        {
+            Pass& pass = mPasses[p];
+            if (!ResolveNames(mPassReadNames[p], pass.reads) || !ResolveNames(mPassWriteNames[p], pass.writes))
+            {
+                mError = "Pass '" + pass.name + "': " + mError;
+                return false;
+            }
+
+            pass.producers.clear();
+            for (uint32_t r : pass.reads)
+            {
+                if (lastWriter[r] == kInvalidIndex && !mResources[r].imported)
+                {
+                    mError = "Pass '" + pass.name + "' reads '" + mResources[r].name + "' before any pass writes it";
+                    return false;
+                }
+                pass.producers.push_back(lastWriter[r]);
+            }
+            for (uint32_t w : pass.writes) lastWriter[w] = p;
+        }
+
+        CullPasses();
+
+        for (uint32_t p = 0; p < mPasses.size(); ++p)
+        {
+            if (mPasses[p].live) mExecutionOrder.push_back(p);
+        }
+
+        ComputeLifetimes();
+        AssignPhysicalResources();
+        return true;
+    }
+
+    void RenderGraphCompiler::CullPasses()
+    {
+        for (Pass& pass : mPasses) pass.live = false;
+
+        std::vector<uint32_t> stack;
+        auto markLive = [&](uint32_t p)
+        {
+            if (p == kInvalidIndex || mPasses[p].live) return;
+            mPasses[p].live = true;
+            stack.push_back(p);
+        };
+
+        // Seed with the final writer of every output
+        for (const Resource& resource : mResources)
+        {
+            if (!resource.output) continue;
+            const uint32_t r = uint32_t(&resource - mResources.data());
+            for (uint32_t p = uint32_t(mPasses.size()); p-- > 0;)
+            {
+                const auto& writes = mPasses[p].writes;
+                if (std::find(writes.begin(), writes.end(), r) != writes.end())
+                {
+                    markLive(p);
+                    break;
+                }
+            }
+        }
+
+        auto propagate = [&]()
+        {
+            while (!stack.empty())
+            {
+                const uint32_t p = stack.back();
+                stack.pop_back();
+                for (uint32_t producer : mPasses[p].producers) markLive(producer);
+            }
+        };
+        propagate();
+
+        // Epilogues only depend on what survived without them
+        for (uint32_t p = 0; p < mPasses.size(); ++p)
+        {
+            Pass& pass = mPasses[p];
+            if (pass.type != RenderGraphPassType::Epilogue || pass.live) continue;
+
+            bool inputsLive = !pass.producers.empty();
+            for (uint32_t producer : pass.producers)
+            {
+                inputsLive = inputsLive && producer != kInvalidIndex && mPasses[producer].live;
+            }
+            if (inputsLive) markLive(p);
+        }
+        propagate();
+    }
+
+    void RenderGraphCompiler::ComputeLifetimes()
+    {
+        for (uint32_t i = 0; i < mExecutionOrder.size(); ++i)
+        {
+            const Pass& pass = mPasses[mExecutionOrder[i]];
+            for (const auto* list : { &pass.reads, &pass.writes })
+            {
+                for (uint32_t r : *list)
+                {
+                    Resource& resource = mResources[r];
+                    if (resource.firstUse == kInvalidIndex) resource.firstUse = i;
+                    resource.lastUse = i;
+                }
+            }
+        }
+
+        // Outputs are read after the graph ran
+        for (Resource& resource : mResources)
+        {
+            if (resource.output && resource.firstUse != kInvalidIndex) resource.lastUse = uint32_t(mExecutionOrder.size());
+        }
+    }
+
+    void RenderGraphCompiler::AssignPhysicalResources()
+    {
+        std::vector<uint32_t> transients;
+        for (uint32_t r = 0; r < mResources.size(); ++r)
+        {
+            if (!mResources[r].imported && mResources[r].firstUse != kInvalidIndex) transients.push_back(r);
+        }
+
+        // Greedy interval assignment in order of first use. A texture is free again once the last pass
+        // of its current resource has run; a resource first written by the pass that last reads another
+        // one may not reuse it, since both are bound to that pass.
+        std::stable_sort(transients.begin(), transients.end(), [&](uint32_t a, uint32_t b) { return mResources[a].firstUse < mResources[b].firstUse; });
+
+        std::vector<uint32_t> physicalLastUse;
+        for (uint32_t r : transients)
+        {
+            Resource& resource = mResources[r];
+            mTransientBytes += resource.desc.GetSizeInBytes();
+
+            for (uint32_t i = 0; i < mPhysicalDescs.size(); ++i)
+            {
+                if (mPhysicalDescs[i] == resource.desc && physicalLastUse[i] < resource.firstUse)
+                {
+                    resource.physicalIndex = i;
+                    physicalLastUse[i] = resource.lastUse;
+                    break;
+                }
+            }
+
+            if (resource.physicalIndex == kInvalidIndex)
+            {
+                resource.physicalIndex = uint32_t(mPhysicalDescs.size());
+                mPhysicalDescs.push_back(resource.desc);
+                physicalLastUse.push_back(resource.lastUse);
+                mAliasedBytes += resource.desc.GetSizeInBytes();
+            }
+        }
+
+        for (uint32_t i = 0; i <= mExecutionOrder.size(); ++i)
+        {
+            uint64_t liveBytes = 0;
+            for (uint32_t r : transients)
+            {
+                if (mResources[r].firstUse <= i && i <= mResources[r].lastUse) liveBytes += mResources[r].desc.GetSizeInBytes();
+            }
+            mPeakLiveBytes = std::max(mPeakLiveBytes, liveBytes);
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "TextureDesc.h"
+
+namespace Cpu
+{
+    enum class RenderGraphPassType : uint32_t
+    {
+        Normal = 0,
+
+        // Kept when every resource it reads was produced by a surviving pass, whether or not anything
+        // reads its outputs. For passes that only have side effects, e.g. ending the frame of a history or recording.
+        Epilogue
+    };
+
+    // Resolves a frame of passes that declare what they read and write. Passes run in declaration order,
+    // so they have to be declared in a valid order. Compile() culls every pass that does not contribute to an
+    // output and assigns the transient resources to physical textures, reusing a texture once the last pass
+    // that uses one resource has run. Only identical descs are aliased, since Falcor textures cannot be placed in
+    // a common heap. Has no API dependencies, ::RenderGraph drives it with Falcor textures.
+    class RenderGraphCompiler
+    {
+    public:
+        static const uint32_t kInvalidIndex = ~0u;
+
+        void Clear();
+
+        // Transient resources are owned and aliased by the graph, imported ones by the caller.
+        // Imports may also be pure ordering tokens without any texture behind them.
+        uint32_t AddResource(const std::string& name, const TextureDesc& desc);
+        uint32_t ImportResource(const std::string& name);
+        uint32_t AddPass(const std::string& name, const std::vector<std::string>& reads, const std::vector<std::string>& writes, RenderGraphPassType type = RenderGraphPassType::Normal);
+        void MarkOutput(const std::string& name);
+
+        // False with GetError() set when a pass uses an undeclared resource or reads a transient before any pass wrote it
+        bool Compile();
+        const std::string& GetError() const { return mError; }
+
+        uint32_t FindResource(const std::string& name) const;
+        uint32_t GetPassCount() const { return uint32_t(mPasses.size()); }
+        const std::string& GetPassName(uint32_t pass) const { return mPasses[pass].name; }
+        bool IsPassCulled(uint32_t pass) const { return !mPasses[pass].live; }
+        const std::vector<uint32_t>& GetExecutionOrder() const { return mExecutionOrder; }
+
+        uint32_t GetResourceCount() const { return uint32_t(mResources.size()); }
+        const std::string& GetResourceName(uint32_t resource) const { return mResources[resource].name; }
+        bool IsResourceImported(uint32_t resource) const { return mResources[resource].imported; }
+
+        // kInvalidIndex for imported and unused resources
+        uint32_t GetPhysicalIndex(uint32_t resource) const { return mResources[resource].physicalIndex; }
+        uint32_t GetPhysicalCount() const { return uint32_t(mPhysicalDescs.size()); }
+        const TextureDesc& GetPhysicalDesc(uint32_t physical) const { return mPhysicalDescs[physical]; }
+
+        // First and last entry of the execution order that touches a resource, kInvalidIndex if unused
+        uint32_t GetFirstUse(uint32_t resource) const { return mResources[resource].firstUse; }
+        uint32_t GetLastUse(uint32_t resource) const { return mResources[resource].lastUse; }
+
+        // Every used transient in its own texture, after aliasing, and the largest set alive at any one pass
+        uint64_t GetTransientBytes() const { return mTransientBytes; }
+        uint64_t GetAliasedBytes() const { return mAliasedBytes; }
+        uint64_t GetPeakLiveBytes() const { return mPeakLiveBytes; }
+
+    private:
+        struct Resource
+        {
+            std::string name;
+            TextureDesc desc;
+            bool imported = false;
+            bool output = false;
+            uint32_t firstUse = kInvalidIndex;
+            uint32_t lastUse = kInvalidIndex;
+            uint32_t physicalIndex = kInvalidIndex;
+        };
+
+        struct Pass
+        {
+            std::string name;
+            std::vector<uint32_t> reads;
+            std::vector<uint32_t> writes;
+            std::vector<uint32_t> producers;    // Pass that last wrote reads[i] before this one, kInvalidIndex if none
+            RenderGraphPassType type = RenderGraphPassType::Normal;
+            bool live = false;
+        };
+
+        bool ResolveNames(const std::vector<std::string>& names, std::vector<uint32_t>& indices);
+        void CullPasses();
+        void ComputeLifetimes();
+        void AssignPhysicalResources();
+
+        std::vector<Resource> mResources;
+        std::vector<Pass> mPasses;
+        std::vector<std::vector<std::string>> mPassReadNames;
+        std::vector<std::vector<std::string>> mPassWriteNames;
+        std::vector<std::string> mOutputNames;
+        std::unordered_map<std::string, uint32_t> mResourceIndices;
+
+        std::vector<uint32_t> mExecutionOrder;
+        std::vector<TextureDesc> mPhysicalDescs;
+        uint64_t mTransientBytes = 0;
+        uint64_t mAliasedBytes = 0;
+        uint64_t mPeakLiveBytes = 0;
+        std::string mError;
+    };
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "TextureDesc.h"
+
+namespace Cpu
+{
+    // Keeps released textures around so that a later request with the same desc (a resize back, a scene load,
+    // a render graph recompile) reuses them instead of allocating. Owners release explicitly: API objects such as
+    // bound shader variables keep references to textures long after their owner dropped them.
+    // T is the texture type, Falcor::Texture in the app and anything default constructible in RaysBench.
+    template<typename T>
+    class ResourcePool
+    {
+    public:
+        using Factory = std::function<std::shared_ptr<T>(const TextureDesc& desc)>;
+
+        explicit ResourcePool(Factory factory) : mFactory(factory) {}
+
+        std::shared_ptr<T> Acquire(const TextureDesc& desc)
+        {
+            for (Entry& entry : mEntries)
+            {
+                if (entry.inUse || entry.desc != desc) continue;
+                entry.inUse = true;
+                entry.lastUsedFrame = mFrameIndex;
+                mReuseCount++;
+                return entry.resource;
+            }
+
+            Entry entry;
+            entry.desc = desc;
+            entry.resource = mFactory(desc);
+            entry.inUse = true;
+            entry.lastUsedFrame = mFrameIndex;
+            mEntries.push_back(entry);
+            mAllocationCount++;
+            return entry.resource;
+        }
+
+        // Null and foreign resources are ignored
+        void Release(const std::shared_ptr<T>& resource)
+        {
+            if (!resource) return;
+            for (Entry& entry : mEntries)
+            {
+                if (entry.resource != resource) continue;
+                entry.inUse = false;
+                entry.lastUsedFrame = mFrameIndex;
+                return;
+            }
+        }
+
+        // Once per frame. Frees what was not acquired for more than maxIdleFrames frames.
+        void EndFrame(uint32_t maxIdleFrames)
+        {
+            size_t kept = 0;
+            for (size_t i = 0; i < mEntries.size(); ++i)
+            {
+                Entry& entry = mEntries[i];
+                if (!entry.inUse && mFrameIndex - entry.lastUsedFrame > maxIdleFrames)
+                {
+                    mFreeCount++;
+                    continue;
+                }
+                if (kept != i) mEntries[kept] = entry;
+                kept++;
+            }
+            mEntries.resize(kept);
+            mFrameIndex++;
+        }
+
+        uint64_t GetAllocationCount() const { return mAllocationCount; }
+        uint64_t GetReuseCount() const { return mReuseCount; }
+        uint64_t GetFreeCount() const { return mFreeCount; }
+        uint32_t GetResourceCount() const { return uint32_t(mEntries.size()); }
+
+        uint32_t GetInUseCount() const
+        {
+            uint32_t count = 0;
+            for (const Entry& entry : mEntries) count += entry.inUse ? 1 : 0;
+            return count;
+        }
+
+        uint64_t GetResidentBytes() const
+        {
+            uint64_t bytes = 0;
+            for (const Entry& entry : mEntries) bytes += entry.desc.GetSizeInBytes();
+            return bytes;
+        }
+
+    private:
+        struct Entry
+        {
+            TextureDesc desc;
+            std::shared_ptr<T> resource;
+            bool inUse = false;
+            uint64_t lastUsedFrame = 0;
+        };
+
+        Factory mFactory;
+        std::vector<Entry> mEntries;
+        uint64_t mFrameIndex = 0;
+        uint64_t mAllocationCount = 0;
+        uint64_t mReuseCount = 0;
+        uint64_t mFreeCount = 0;
+    };
+}
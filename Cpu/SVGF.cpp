@@ -0,0 +1,1017 @@
+#include "SVGF.h"
+#include "FrameProfiler.h"
+#include "SVGFSharedHistory.h"
+#include "SVGFUtils.h"
+#include "SimdImage.h"
+#include "Timer.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        const uint32_t kTileSize = 64; // Multiple of the SIMD width so only the last tile in a row has partial quads
+        const uint32_t kAtrousMaxApron = 8; // ::SVGFPass' groupshared apron, wider steps run the pixel kernel
+
+        // Planes staged per tile by AtrousFilterTiled
+        enum TileCachePlane : uint32_t
+        {
+            CacheR = 0,
+            CacheG,
+            CacheB,
+            CacheVariance,
+            CacheLuminance,
+            CacheNormalX,
+            CacheNormalY,
+            CacheNormalZ,
+            CacheLinearZ,
+            CachePlaneCount
+        };
+
+        // The compact history keeps (m1, m2 - m1^2) instead of (m1, m2). In fp16 both moments of a converged pixel
+        // round to about 1e-3 of their value, which m2 - m1^2 turns into a variance error larger than the variance
+        // itself. Stored directly, the variance keeps its own 11-bit precision.
+        float2 EncodeCompactMoments(const float2& moments)
+        {
+            return float2(moments.x, std::max(0.0f, moments.y - moments.x * moments.x));
+        }
+
+        float2 DecodeCompactMoments(const float2& encoded)
+        {
+            return float2(encoded.x, encoded.y + encoded.x * encoded.x);
+        }
+    }
+
+    void SVGFPass::SignalPlanes::Resize(uint32_t width, uint32_t height)
+    {
+        r.Resize(width, height);
+        g.Resize(width, height);
+        b.Resize(width, height);
+        variance.Resize(width, height);
+    }
+
+    size_t SVGFPass::SignalPlanes::GetSizeInBytes() const
+    {
+        return r.GetSizeInBytes() + g.GetSizeInBytes() + b.GetSizeInBytes() + variance.GetSizeInBytes();
+    }
+
+    void SVGFPass::ReprojectionBuffers::Resize(uint32_t width, uint32_t height)
+    {
+        signal.Resize(width, height);
+        moments.Resize(width, height);
+        historyLength.Resize(width, height);
+    }
+
+    size_t SVGFPass::ReprojectionBuffers::GetSizeInBytes() const
+    {
+        return signal.GetSizeInBytes() + moments.GetSizeInBytes() + historyLength.GetSizeInBytes();
+    }
+
+    void SVGFPass::CompactReprojectionBuffers::Resize(uint32_t width, uint32_t height, SVGFSignalType signalType)
+    {
+        signal.Resize(width, height, 4);
+        if (signalType == SVGFSignalType::Color)
+        {
+            moments.Resize(width, height, 2);
+        }
+    }
+
+    size_t SVGFPass::CompactReprojectionBuffers::GetSizeInBytes() const
+    {
+        return signal.GetSizeInBytes() + moments.GetSizeInBytes();
+    }
+
+    SVGFPass::SVGFPass(uint32_t width, uint32_t height, ThreadPool* threadPool)
+        : mWidth(width),
+          mHeight(height),
+          mThreadPool(threadPool ? threadPool : &ThreadPool::GetDefault())
+    {
+        mCurrReproj.Resize(width, height);
+        mPrevReproj.Resize(width, height);
+        mAtrousPing.Resize(width, height);
+        mAtrousPong.Resize(width, height);
+        mLastFiltered.Resize(width, height);
+        mOutput.Resize(width, height);
+        mPrevLinearZ.Resize(width, height);
+
+        mNormalX.Resize(width, height);
+        mNormalY.Resize(width, height);
+        mNormalZ.Resize(width, height);
+        mLinearZ.Resize(width, height);
+        mZDerivative.Resize(width, height);
+    }
+
+    SVGFPass::SVGFPass(uint32_t width, uint32_t height, SVGFSharedHistory& history, SVGFSignalType signalType, ThreadPool* threadPool)
+        : mWidth(width),
+          mHeight(height),
+          mThreadPool(threadPool ? threadPool : &ThreadPool::GetDefault()),
+          mHistory(&history),
+          mSignalType(signalType)
+    {
+        mCurrCompactReproj.Resize(width, height, signalType);
+        mPrevCompactReproj.Resize(width, height, signalType);
+        mCompactLastFiltered.Resize(width, height, signalType == SVGFSignalType::Scalar ? 2 : 4);
+        mGradient.Resize(GetGradientStrataCount(width), GetGradientStrataCount(height));
+        mGradientFiltered.Resize(GetGradientStrataCount(width), GetGradientStrataCount(height));
+        mCurrGradientLuminance.Resize(GetGradientStrataCount(width), GetGradientStrataCount(height));
+        mPrevGradientLuminance.Resize(GetGradientStrataCount(width), GetGradientStrataCount(height));
+        mAtrousPing.Resize(width, height);
+        mAtrousPong.Resize(width, height);
+        mOutput.Resize(width, height);
+
+        mNormalX.Resize(width, height);
+        mNormalY.Resize(width, height);
+        mNormalZ.Resize(width, height);
+        mLinearZ.Resize(width, height);
+        mZDerivative.Resize(width, height);
+    }
+
+    void SVGFPass::Reset()
+    {
+        if (IsCompact())
+        {
+            mHasHistory = false;
+            mHasGradientLuminance = false;
+            mCompactLastFiltered.Fill(0.0f);
+            return;
+        }
+
+        mCurrReproj.Resize(mWidth, mHeight);
+        mPrevReproj.Resize(mWidth, mHeight);
+        mLastFiltered.Fill(float4());
+        mPrevLinearZ.Fill(float4());
+    }
+
+    size_t SVGFPass::GetAllocatedBytes() const
+    {
+        size_t bytes = mCurrReproj.GetSizeInBytes() + mPrevReproj.GetSizeInBytes() +
+            mCurrCompactReproj.GetSizeInBytes() + mPrevCompactReproj.GetSizeInBytes() + mCompactLastFiltered.GetSizeInBytes() +
+            mGradient.GetSizeInBytes() + mGradientFiltered.GetSizeInBytes() + mCurrGradientLuminance.GetSizeInBytes() + mPrevGradientLuminance.GetSizeInBytes() +
+            mAtrousPing.GetSizeInBytes() + mAtrousPong.GetSizeInBytes() +
+            mLastFiltered.GetSizeInBytes() + mOutput.GetSizeInBytes() + mPrevLinearZ.GetSizeInBytes() +
+            mNormalX.GetSizeInBytes() + mNormalY.GetSizeInBytes() + mNormalZ.GetSizeInBytes() +
+            mLinearZ.GetSizeInBytes() + mZDerivative.GetSizeInBytes();
+
+        for (const auto& cache : mAtrousTileCaches) bytes += cache.size() * sizeof(float);
+        return bytes;
+    }
+
+    bool SVGFPass::IsAtrousTiled(uint32_t iteration) const
+    {
+        // The 3x3 variance gather needs an apron of at least one pixel. Like the compute shader, steps whose apron is
+        // wider than kAtrousMaxApron fall back to the pixel kernel.
+        const uint32_t apron = mSettings.atrousRadius << iteration;
+        return mSettings.atrousPath == AtrousPath::Tiled && apron > 0 && apron <= kAtrousMaxApron;
+    }
+
+    bool SVGFPass::HasValidHistory() const
+    {
+        return IsCompact() && mHasHistory && mLastHistoryFrame + 1 == mHistory->GetFrameIndex();
+    }
+
+    const Image4F& SVGFPass::Execute(const Image4F& inputSignal, const Image4F& motionVec, const Image4F& linearZ, const Image4F& normalDepth,
+        const Image<uint8_t>* rayCounts, const Image<GradientSample>* gradientSamples)
+    {
+        Timer totalTimer;
+
+        mGBufferInput.inputSignal = &inputSignal;
+        mGBufferInput.linearZ = &linearZ;
+        mGBufferInput.motionVec = &motionVec;
+        mGBufferInput.compactNormalDepth = &normalDepth;
+        mGBufferInput.rayCounts = rayCounts;
+
+        if (IsCompact())
+        {
+            // Own history is only usable if this filter also ran last frame
+            const uint64_t historyFrame = mHistory->GetFrameIndex();
+            mHistoryReset = !mHasHistory || (mLastHistoryFrame + 1 != historyFrame);
+            mLastHistoryFrame = historyFrame;
+            mHasHistory = true;
+        }
+
+        // Scope names match the GPU filter's, so headless and renderer timings line up
+        Timer timer;
+        {
+            FRAME_PROFILE("Decode");
+            DecodeNormalDepth();
+        }
+        mTimings.decodeMs = timer.GetElapsedMs();
+
+        timer.Reset();
+        mUseGradient = IsCompact() && gradientSamples && mSettings.enableTemporalReprojection;
+        if (mUseGradient)
+        {
+            FRAME_PROFILE("TemporalGradient");
+            ComputeTemporalGradient(*gradientSamples);
+            for (uint32_t i = 0; i < mSettings.gradientFilterIterations; ++i)
+            {
+                FilterTemporalGradient(i);
+                std::swap(mGradient, mGradientFiltered);
+            }
+        }
+        else
+        {
+            mGradient.Fill(float4());
+        }
+        mHasGradientLuminance = mUseGradient;
+        mTimings.gradientMs = timer.GetElapsedMs();
+
+        timer.Reset();
+        {
+            FRAME_PROFILE("Reprojection");
+            TemporalReprojection();
+        }
+        mTimings.reprojectionMs = timer.GetElapsedMs();
+
+        timer.Reset();
+        {
+            FRAME_PROFILE("VarianceEstimation");
+            SpatialVarianceEstimation();
+        }
+        mTimings.varianceEstimationMs = timer.GetElapsedMs();
+
+        mTimings.atrousMs.assign(mSettings.atrousIterations, 0.0);
+        mTimings.feedbackMs = 0.0;
+
+        for (uint32_t i = 0; i < mSettings.atrousIterations; ++i)
+        {
+            timer.Reset();
+            {
+                FRAME_PROFILE("Atrous" + std::to_string(i));
+                if (IsAtrousTiled(i))
+                {
+                    AtrousFilterTiled(i, mAtrousPing, mAtrousPong);
+                }
+                else
+                {
+                    AtrousFilter(i, mAtrousPing, mAtrousPong);
+                }
+                if (i == mSettings.atrousIterations - 1)
+                {
+                    Interleave(mAtrousPong, mOutput);
+                }
+            }
+            mTimings.atrousMs[i] = timer.GetElapsedMs();
+
+            if (i == mSettings.feedbackTap)
+            {
+                FRAME_PROFILE("FeedbackBlit");
+                timer.Reset();
+                if (IsCompact())
+                {
+                    StoreCompactLastFiltered(mAtrousPong);
+                }
+                else
+                {
+                    Interleave(mAtrousPong, mLastFiltered);
+                }
+                mTimings.feedbackMs = timer.GetElapsedMs();
+            }
+
+            std::swap(mAtrousPing, mAtrousPong);
+        }
+
+        if (IsCompact())
+        {
+            std::swap(mCurrCompactReproj, mPrevCompactReproj);
+            std::swap(mCurrGradientLuminance, mPrevGradientLuminance);
+        }
+        else
+        {
+            std::swap(mCurrReproj, mPrevReproj);
+            mPrevLinearZ = linearZ;
+        }
+
+        mTimings.totalMs = totalTimer.GetElapsedMs();
+        mTimings.megapixelsPerSecond = (double(mWidth) * mHeight * 1e-6) / (mTimings.totalMs * 1e-3);
+
+        return mOutput;
+    }
+
+    void SVGFPass::DecodeNormalDepth()
+    {
+        const Image4F& normalDepth = *mGBufferInput.compactNormalDepth;
+
+        mThreadPool->ParallelForTiles(mWidth, mHeight, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    const float4 nd = normalDepth.At(x, y);
+                    const float3 normal = normalize(OctToDir(asuint(nd.x)));
+                    mNormalX.At(x, y) = normal.x;
+                    mNormalY.At(x, y) = normal.y;
+                    mNormalZ.At(x, y) = normal.z;
+                    mLinearZ.At(x, y) = nd.y;
+                    mZDerivative.At(x, y) = nd.z;
+                }
+            }
+        });
+    }
+
+    const Image4F& SVGFPass::GetPrevLinearZ() const
+    {
+        return IsCompact() ? mHistory->GetPrevLinearZ() : mPrevLinearZ;
+    }
+
+    float4 SVGFPass::LoadLastFiltered(int2 p) const
+    {
+        if (!IsCompact()) return mLastFiltered.Load(p);
+
+        const float4 value = mCompactLastFiltered.Load(p);
+        return mSignalType == SVGFSignalType::Scalar ? float4(value.x, 0.0f, 0.0f, value.y) : value;
+    }
+
+    float2 SVGFPass::LoadPrevMoments(int2 p) const
+    {
+        if (!IsCompact()) return mPrevReproj.moments.Load(p);
+
+        return DecodeCompactMoments(mSignalType == SVGFSignalType::Scalar ? mPrevCompactReproj.signal.Load(p).zw() : mPrevCompactReproj.moments.Load(p).xy());
+    }
+
+    float4 SVGFPass::LoadReprojSignal(int2 p) const
+    {
+        if (!IsCompact()) return mCurrReproj.signal.At(p);
+
+        const float4 value = mCurrCompactReproj.signal.Load(p);
+        return mSignalType == SVGFSignalType::Scalar ? float4(value.x, 0.0f, 0.0f, value.y) : value;
+    }
+
+    float2 SVGFPass::LoadReprojMoments(int2 p) const
+    {
+        if (!IsCompact()) return mCurrReproj.moments.At(p);
+
+        return DecodeCompactMoments(mSignalType == SVGFSignalType::Scalar ? mCurrCompactReproj.signal.Load(p).zw() : mCurrCompactReproj.moments.Load(p).xy());
+    }
+
+    float SVGFPass::LoadHistoryLength(int2 p) const
+    {
+        if (!IsCompact()) return mCurrReproj.historyLength.At(p);
+
+        if (mHistoryReset || !mSettings.enableTemporalReprojection) return 1.0f;
+        return GetGradientHistoryLength(mHistory->GetHistoryLength(p), LoadGradientLambda(p));
+    }
+
+    float SVGFPass::LoadGradientLambda(int2 p) const
+    {
+        return mUseGradient ? GetGradientLambda(mGradient.At(p.x / kGradientStratumSize, p.y / kGradientStratumSize)) : 0.0f;
+    }
+
+    void SVGFPass::StoreReprojection(int2 p, const float4& signal, const float2& moments, float historyLength)
+    {
+        if (!IsCompact())
+        {
+            mCurrReproj.signal.At(p) = signal;
+            mCurrReproj.moments.At(p) = moments;
+            mCurrReproj.historyLength.At(p) = historyLength;
+        }
+        else if (mSignalType == SVGFSignalType::Scalar)
+        {
+            const float2 encoded = EncodeCompactMoments(moments);
+            mCurrCompactReproj.signal.Store(p, float4(signal.x, signal.w, encoded.x, encoded.y));
+        }
+        else
+        {
+            const float2 encoded = EncodeCompactMoments(moments);
+            mCurrCompactReproj.signal.Store(p, signal);
+            mCurrCompactReproj.moments.Store(p, float4(encoded.x, encoded.y, 0.0f, 0.0f));
+        }
+    }
+
+    bool SVGFPass::ReprojectLastFilteredData(int2 ipos, float3& prevSignal, float2& prevMoments, float& historyLength) const
+    {
+        const float2 imageDim = float2(float(mWidth), float(mHeight));
+
+        // .xy motion, .z position derivative (unused), .w normal derivative
+        const float4 motion = mGBufferInput.motionVec->At(ipos);
+
+        // .x Z, .y Z derivative, .z last frame Z, .w world normal
+        const float4 depth = mGBufferInput.linearZ->At(ipos);
+        const float3 normal = OctToDir(asuint(depth.w));
+
+        const float2 offsetPrev = motion.xy() * imageDim;
+        const int2 iposPrev = int2(int(float(ipos.x) + offsetPrev.x + 0.5f), int(float(ipos.y) + offsetPrev.y + 0.5f));
+        const float2 posPrev = float2(float(ipos.x), float(ipos.y)) + offsetPrev;
+
+        prevSignal = float3();
+        prevMoments = float2();
+        historyLength = IsCompact() ? 0.0f : mPrevReproj.historyLength.Load(iposPrev);
+
+        bool v[4];
+        const int2 offset[4] = { int2(0, 0), int2(1, 0), int2(0, 1), int2(1, 1) };
+        const int2 base = int2(int(posPrev.x), int(posPrev.y));
+
+        // Check for all 4 taps of the bilinear filter for validity
+        bool valid = false;
+        for (int sampleIdx = 0; sampleIdx < 4; ++sampleIdx)
+        {
+            const int2 loc = base + offset[sampleIdx];
+            const float4 depthPrev = GetPrevLinearZ().Load(loc);
+            const float3 normalPrev = OctToDir(asuint(depthPrev.w));
+
+            v[sampleIdx] = IsReprjValid(iposPrev, int2(mWidth, mHeight), depth.z, depthPrev.x, depth.y, normal, normalPrev, motion.w);
+
+            valid = valid || v[sampleIdx];
+        }
+
+        // Perform bilinear interpolation
+        if (valid)
+        {
+            float sumWeights = 0.0f;
+            const float x = frac(posPrev.x);
+            const float y = frac(posPrev.y);
+
+            const float w[4] = { (1 - x) * (1 - y),
+                                      x  * (1 - y),
+                                 (1 - x) *      y,
+                                      x  *      y };
+
+            for (int sampleIdx = 0; sampleIdx < 4; ++sampleIdx)
+            {
+                if (v[sampleIdx])
+                {
+                    const int2 loc = base + offset[sampleIdx];
+                    prevSignal  += w[sampleIdx] * LoadLastFiltered(loc).rgb();
+                    prevMoments += w[sampleIdx] * LoadPrevMoments(loc);
+                    sumWeights  += w[sampleIdx];
+                }
+            }
+
+            // Redistribute weights in case not all taps were used
+            valid = (sumWeights >= 0.01f);
+            prevSignal = valid ? prevSignal / sumWeights : float3();
+            prevMoments = valid ? prevMoments / sumWeights : float2();
+        }
+
+        // Perform a cross-bilateral filter with binary decision to find some suitable samples spatially
+        if (!valid)
+        {
+            float cnt = 0.0f;
+            const int radius = 1;
+            for (int yy = -radius; yy <= radius; ++yy)
+            {
+                for (int xx = -radius; xx <= radius; ++xx)
+                {
+                    const int2 p = iposPrev + int2(xx, yy);
+                    const float4 depthP = GetPrevLinearZ().Load(p);
+                    const float3 normalP = OctToDir(asuint(depthP.w));
+
+                    if (IsReprjValid(iposPrev, int2(mWidth, mHeight), depth.z, depthP.x, depth.y, normal, normalP, motion.w))
+                    {
+                        prevSignal += LoadLastFiltered(p).rgb();
+                        prevMoments += LoadPrevMoments(p);
+                        cnt += 1.0f;
+                    }
+                }
+            }
+
+            if (cnt > 0.0f)
+            {
+                valid = true;
+                prevSignal /= cnt;
+                prevMoments /= cnt;
+            }
+        }
+
+        if (!valid)
+        {
+            prevSignal = float3();
+            prevMoments = float2();
+            historyLength = 0.0f;
+        }
+
+        return valid;
+    }
+
+    // SVGF_TemporalGradient.slang
+    void SVGFPass::ComputeTemporalGradient(const Image<GradientSample>& samples)
+    {
+        const uint32_t strataWidth = samples.GetWidth();
+        const uint32_t frameCount = mHistory->GetGradientFrameCount();
+        const Image4F& inputSignal = *mGBufferInput.inputSignal;
+
+        // The samples re-shade what this filter saw last frame, only if it ran last frame
+        const uint64_t historyFrame = mHistory->GetFrameIndex();
+        const bool hasPrevLuminance = mHasGradientLuminance && mLastGradientFrame + 1 == historyFrame;
+        mLastGradientFrame = historyFrame;
+
+        mThreadPool->ParallelForTiles(strataWidth, samples.GetHeight(), kTileSize / kGradientStratumSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t sy = tile.y0; sy < tile.y1; ++sy)
+            {
+                for (uint32_t sx = tile.x0; sx < tile.x1; ++sx)
+                {
+                    const int2 stratum = int2(int(sx), int(sy));
+                    const GradientSample& sample = samples.At(stratum);
+
+                    // Change against last frame's shade with the same seed, normalized by the larger of the two
+                    float4 gradient;
+                    if (hasPrevLuminance && sample.claim != kNoGradientSample)
+                    {
+                        const float current = luminance(inputSignal.At(GetGradientStratumPixel(stratum, sample.claim & 0xF)).rgb());
+                        const float prev = mPrevGradientLuminance.GetData()[sample.claim >> 4];
+                        gradient = float4(current - prev, std::max(current, prev), 1.0f, 0.0f);
+                    }
+                    mGradient.At(stratum) = gradient;
+
+                    // The sample this stratum picks for next frame
+                    const int2 picked = GetGradientStratumPixel(stratum, GetGradientSampleOffset(stratum, strataWidth, frameCount, sample.claim));
+                    mCurrGradientLuminance.At(stratum) = luminance(inputSignal.Load(picked).rgb());
+                }
+            }
+        });
+    }
+
+    // SVGF_GradientAtrous.slang. The gradients are sparse and noisy, an a-trous pass over the strata averages the ones
+    // with a sample, stopped at depth edges by each stratum's center pixel.
+    void SVGFPass::FilterTemporalGradient(uint32_t iteration)
+    {
+        const int stepSize = 1 << iteration;
+        const float kernel[2][2] = { { 1.0f / 4.0f, 1.0f / 8.0f }, { 1.0f / 8.0f, 1.0f / 16.0f } };
+        const uint32_t strataWidth = mGradient.GetWidth();
+
+        mThreadPool->ParallelForTiles(strataWidth, mGradient.GetHeight(), kTileSize / kGradientStratumSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t sy = tile.y0; sy < tile.y1; ++sy)
+            {
+                for (uint32_t sx = tile.x0; sx < tile.x1; ++sx)
+                {
+                    const int2 stratum = int2(int(sx), int(sy));
+                    const int2 center = GetGradientStratumPixel(stratum, 4);
+                    const float centerZ = mLinearZ.Load(center);
+                    const float phiDepth = std::max(mZDerivative.Load(center), 1e-8f) * float(kGradientStratumSize * stepSize);
+
+                    float sumWeight = 0.0f;
+                    float2 sumGradient;
+                    for (int yy = -1; yy <= 1; ++yy)
+                    {
+                        for (int xx = -1; xx <= 1; ++xx)
+                        {
+                            const int2 p = int2(stratum.x + xx * stepSize, stratum.y + yy * stepSize);
+                            if (!mGradient.IsInside(p.x, p.y)) continue;
+
+                            const float4 gradient = mGradient.At(p);
+                            if (gradient.z == 0.0f) continue;
+
+                            const float z = mLinearZ.Load(GetGradientStratumPixel(p, 4));
+                            const float distance = std::sqrt(float(xx * xx + yy * yy));
+                            const float weight = kernel[std::abs(xx)][std::abs(yy)] * std::exp(-std::fabs(centerZ - z) / (phiDepth * std::max(distance, 1.0f)));
+                            sumGradient += gradient.xy() * weight;
+                            sumWeight += weight;
+                        }
+                    }
+
+                    mGradientFiltered.At(stratum) = sumWeight > 0.0f ? float4(sumGradient.x / sumWeight, sumGradient.y / sumWeight, 1.0f, 0.0f) : float4();
+                }
+            }
+        });
+    }
+
+    void SVGFPass::TemporalReprojection()
+    {
+        mThreadPool->ParallelForTiles(mWidth, mHeight, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    const int2 ipos = int2(int(x), int(y));
+                    const float3 signal = mGBufferInput.inputSignal->At(ipos).rgb();
+
+                    if (!mSettings.enableTemporalReprojection)
+                    {
+                        StoreReprojection(ipos, float4(signal, 1.0f), float2(), 1.0f); // Performs uniform bilateral filter with variance = 1.0
+                        continue;
+                    }
+
+                    float historyLength;
+                    float3 prevSignal;
+                    float2 prevMoments;
+                    bool success = ReprojectLastFilteredData(ipos, prevSignal, prevMoments, historyLength);
+
+                    // A-SVGF: the history is kept as far as the temporal gradient finds the signal unchanged
+                    const float lambda = LoadGradientLambda(ipos);
+                    const float baseAlpha = lerp(mSettings.alpha, 1.0f, lambda);
+                    const float baseMomentsAlpha = lerp(mSettings.momentsAlpha, 1.0f, lambda);
+
+                    if (IsCompact())
+                    {
+                        // The shared pass already counted this frame
+                        success = success && !mHistoryReset;
+                        historyLength = success ? GetGradientHistoryLength(mHistory->GetHistoryLength(ipos), lambda) : 1.0f;
+                    }
+                    else
+                    {
+                        historyLength = std::min(32.0f, success ? historyLength + 1.0f : 1.0f);
+                    }
+
+                    // No ray this frame, the history stands in for the sample
+                    if (success && mGBufferInput.rayCounts && mGBufferInput.rayCounts->At(ipos) == 0)
+                    {
+                        StoreReprojection(ipos, float4(prevSignal, std::max(0.0f, prevMoments.y - prevMoments.x * prevMoments.x)), prevMoments, historyLength);
+                        continue;
+                    }
+
+                    // This adjusts the alpha for the case where insufficient history is available.
+                    // It boosts the temporal accumulation to give the samples equal weights in the beginning.
+                    const float alpha = success ? std::max(baseAlpha, 1.0f / historyLength) : 1.0f;
+                    const float alphaMoments = success ? std::max(baseMomentsAlpha, 1.0f / historyLength) : 1.0f;
+
+                    float2 moments;
+                    moments.x = luminance(signal);
+                    moments.y = moments.x * moments.x;
+                    moments = lerp(prevMoments, moments, alphaMoments);
+
+                    StoreReprojection(ipos, float4(lerp(prevSignal, signal, alpha), std::max(0.0f, moments.y - moments.x * moments.x)), moments, historyLength);
+                }
+            }
+        });
+    }
+
+    void SVGFPass::SpatialVarianceEstimation()
+    {
+        auto loadSample = [&](int2 p)
+        {
+            const float4 signal = LoadReprojSignal(p);
+
+            SVGFSample s;
+            s.signal = signal.rgb();
+            s.variance = signal.w;
+            s.normal = float3(mNormalX.At(p), mNormalY.At(p), mNormalZ.At(p));
+            s.linearZ = mLinearZ.At(p);
+            s.zDerivative = mZDerivative.At(p);
+            s.luminance = luminance(s.signal);
+            return s;
+        };
+
+        auto store = [&](int2 p, const float4& value)
+        {
+            mAtrousPing.r.At(p) = value.x;
+            mAtrousPing.g.At(p) = value.y;
+            mAtrousPing.b.At(p) = value.z;
+            mAtrousPing.variance.At(p) = value.w;
+        };
+
+        mThreadPool->ParallelForTiles(mWidth, mHeight, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    const int2 ipos = int2(int(x), int(y));
+
+                    const float h = LoadHistoryLength(ipos);
+                    if (h >= 4.0f || !mSettings.enableSpatialVarianceEstimation)
+                    {
+                        store(ipos, LoadReprojSignal(ipos));
+                        continue;
+                    }
+
+                    const SVGFSample sampleCenter = loadSample(ipos);
+                    if (sampleCenter.linearZ < 0) // not valid depth, must be skybox
+                    {
+                        store(ipos, float4(sampleCenter.signal, sampleCenter.variance));
+                        continue;
+                    }
+
+                    const float phiColor = mSettings.phiColor;
+                    const float phiDepth = std::max(sampleCenter.zDerivative, 1e-8f) * 3.0f;
+
+                    float sumWeight = 0.0f;
+                    float3 sumSignal;
+                    float2 sumMoments;
+
+                    // Compute first and second moment spatially. This code also applies cross-bilateral filtering on the input color samples
+                    const int radius = 3;
+                    for (int yy = -radius; yy <= radius; ++yy)
+                    {
+                        for (int xx = -radius; xx <= radius; ++xx)
+                        {
+                            const int2 p = ipos + int2(xx, yy);
+                            if (p.x < 0 || p.y < 0 || p.x >= int(mWidth) || p.y >= int(mHeight)) continue;
+
+                            const SVGFSample sampleP = loadSample(p);
+                            const float2 momentsP = LoadReprojMoments(p);
+
+                            const float weight = ComputeWeight(sampleCenter, sampleP, phiDepth * length(float2(float(xx), float(yy))), mSettings.phiNormal, phiColor);
+
+                            sumWeight += weight;
+                            sumSignal += sampleP.signal * weight;
+                            sumMoments += momentsP * weight;
+                        }
+                    }
+
+                    sumWeight = std::max(sumWeight, 1e-6f);
+                    sumSignal /= sumWeight;
+                    sumMoments /= sumWeight;
+
+                    float variance = sumMoments.y - sumMoments.x * sumMoments.x;
+                    variance *= 4.0f / h; // Boost variance for first few frames
+
+                    store(ipos, float4(sumSignal, variance));
+                }
+            }
+        });
+    }
+
+    void SVGFPass::AtrousFilter(uint32_t iteration, const SignalPlanes& input, SignalPlanes& output)
+    {
+        const int stepSize = 1 << iteration;
+        const int radius = int(mSettings.atrousRadius);
+        const SimdFloat phiNormal = mSettings.phiNormal;
+        const SimdFloat gPhiColor = mSettings.phiColor;
+        const float kernelWeights[3] = { 1.0f, 2.0f / 3.0f, 1.0f / 6.0f };
+        const float varianceKernel[2][2] =
+        {
+            { 1.0f / 4.0f, 1.0f / 8.0f },
+            { 1.0f / 8.0f, 1.0f / 16.0f }
+        };
+
+        mThreadPool->ParallelForTiles(mWidth, mHeight, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (int y = int(tile.y0); y < int(tile.y1); ++y)
+            {
+                for (int x = int(tile.x0); x < int(tile.x1); x += SimdFloat::kWidth)
+                {
+                    const int laneCount = std::min(SimdFloat::kWidth, int(tile.x1) - x);
+
+                    const SimdFloat centerR = LoadQuad(input.r, x, y);
+                    const SimdFloat centerG = LoadQuad(input.g, x, y);
+                    const SimdFloat centerB = LoadQuad(input.b, x, y);
+                    const SimdFloat centerVariance = LoadQuad(input.variance, x, y);
+                    const SimdFloat centerZ = LoadQuad(mLinearZ, x, y);
+                    const SimdMask skybox = centerZ < 0.0f; // not valid depth, must be skybox
+
+                    if (skybox.GetBits() == (1 << laneCount) - 1)
+                    {
+                        StoreQuad(output.r, x, y, centerR, laneCount);
+                        StoreQuad(output.g, x, y, centerG, laneCount);
+                        StoreQuad(output.b, x, y, centerB, laneCount);
+                        StoreQuad(output.variance, x, y, centerVariance, laneCount);
+                        continue;
+                    }
+
+                    const SimdFloat centerNX = LoadQuad(mNormalX, x, y);
+                    const SimdFloat centerNY = LoadQuad(mNormalY, x, y);
+                    const SimdFloat centerNZ = LoadQuad(mNormalZ, x, y);
+                    const SimdFloat centerLuminance = Luminance(centerR, centerG, centerB);
+
+                    // ComputeVarianceCenter: 3x3 gaussian on the variance, out of bounds taps read zero
+                    SimdFloat variance = 0.0f;
+                    for (int yy = -1; yy <= 1; ++yy)
+                    {
+                        for (int xx = -1; xx <= 1; ++xx)
+                        {
+                            variance += LoadQuad(input.variance, x + xx, y + yy) * varianceKernel[std::abs(xx)][std::abs(yy)];
+                        }
+                    }
+
+                    const SimdFloat phiColor = gPhiColor * Sqrt(Max(0.0f, variance + 1e-10f));
+                    const SimdFloat phiDepth = Max(LoadQuad(mZDerivative, x, y), 1e-8f) * float(stepSize);
+
+                    SimdFloat sumWeight = 1.0f;
+                    SimdFloat sumR = centerR;
+                    SimdFloat sumG = centerG;
+                    SimdFloat sumB = centerB;
+                    SimdFloat sumVariance = centerVariance;
+
+                    for (int yy = -radius; yy <= radius; ++yy)
+                    {
+                        for (int xx = -radius; xx <= radius; ++xx)
+                        {
+                            if (xx == 0 && yy == 0) continue;
+
+                            const int px = x + xx * stepSize;
+                            const int py = y + yy * stepSize;
+                            const SimdMask inside = InsideQuad(px, py, mWidth, mHeight);
+                            if (!inside.Any()) continue;
+
+                            const SimdFloat r = LoadQuad(input.r, px, py);
+                            const SimdFloat g = LoadQuad(input.g, px, py);
+                            const SimdFloat b = LoadQuad(input.b, px, py);
+                            const SimdFloat v = LoadQuad(input.variance, px, py);
+
+                            // ComputeWeight, with pow(n, phiNormal) folded into the same exp: exp(a) * exp(phi * log(n))
+                            const SimdFloat nDotN = Min(centerNX * LoadQuad(mNormalX, px, py) + centerNY * LoadQuad(mNormalY, px, py) + centerNZ * LoadQuad(mNormalZ, px, py), 1.0f);
+                            const SimdMask facing = nDotN > 0.0f;
+                            const SimdFloat wNormalLog = phiNormal * Log(Select(facing, nDotN, 1.0f));
+                            const SimdFloat wZ = Abs(centerZ - LoadQuad(mLinearZ, px, py)) / (phiDepth * std::sqrt(float(xx * xx + yy * yy)));
+                            const SimdFloat wLdirect = Abs(centerLuminance - Luminance(r, g, b)) / phiColor;
+                            const SimdFloat edgeStopping = Select(facing, Exp(SimdFloat(0.0f) - Max(wLdirect, 0.0f) - Max(wZ, 0.0f) + wNormalLog));
+
+                            const float kernel = kernelWeights[std::abs(xx)] * kernelWeights[std::abs(yy)];
+                            const SimdFloat weight = Select(inside, edgeStopping * kernel);
+
+                            sumWeight += weight;
+                            sumR += r * weight;
+                            sumG += g * weight;
+                            sumB += b * weight;
+                            sumVariance += v * weight * weight;
+                        }
+                    }
+
+                    StoreQuad(output.r, x, y, Select(skybox, centerR, sumR / sumWeight), laneCount);
+                    StoreQuad(output.g, x, y, Select(skybox, centerG, sumG / sumWeight), laneCount);
+                    StoreQuad(output.b, x, y, Select(skybox, centerB, sumB / sumWeight), laneCount);
+                    StoreQuad(output.variance, x, y, Select(skybox, centerVariance, sumVariance / (sumWeight * sumWeight)), laneCount);
+                }
+            }
+        });
+    }
+
+    // Same filter as AtrousFilter. Each tile and its apron are first copied into a per-thread cache with the luminance
+    // precomputed, so the taps read one small contiguous block and need no border handling: the padding outside the
+    // image is left at zero, and a zero normal gives the tap zero weight just like the inside test does.
+    void SVGFPass::AtrousFilterTiled(uint32_t iteration, const SignalPlanes& input, SignalPlanes& output)
+    {
+        const int stepSize = 1 << iteration;
+        const int radius = int(mSettings.atrousRadius);
+        const int apron = radius * stepSize;
+        const int side = int(kTileSize) + 2 * apron;
+        const size_t planeSize = size_t(side) * side;
+        const SimdFloat phiNormal = mSettings.phiNormal;
+        const SimdFloat gPhiColor = mSettings.phiColor;
+        const float kernelWeights[3] = { 1.0f, 2.0f / 3.0f, 1.0f / 6.0f };
+        const float varianceKernel[2][2] =
+        {
+            { 1.0f / 4.0f, 1.0f / 8.0f },
+            { 1.0f / 8.0f, 1.0f / 16.0f }
+        };
+
+        struct Tap
+        {
+            int offset;
+            float kernel;
+            float distance;
+        };
+
+        std::vector<Tap> taps;
+        for (int yy = -radius; yy <= radius; ++yy)
+        {
+            for (int xx = -radius; xx <= radius; ++xx)
+            {
+                if (xx == 0 && yy == 0) continue;
+                taps.push_back({ (yy * side + xx) * stepSize, kernelWeights[std::abs(xx)] * kernelWeights[std::abs(yy)], std::sqrt(float(xx * xx + yy * yy)) });
+            }
+        }
+
+        const ImageF* sources[CachePlaneCount] = { &input.r, &input.g, &input.b, &input.variance, nullptr, &mNormalX, &mNormalY, &mNormalZ, &mLinearZ };
+
+        mAtrousTileCaches.resize(mThreadPool->GetThreadCount());
+
+        mThreadPool->ParallelForTiles(mWidth, mHeight, kTileSize, [&](const TileRect& tile, uint32_t threadIndex)
+        {
+            std::vector<float>& cache = mAtrousTileCaches[threadIndex];
+            if (cache.size() < CachePlaneCount * planeSize) cache.resize(CachePlaneCount * planeSize);
+
+            float* planes[CachePlaneCount];
+            for (uint32_t i = 0; i < CachePlaneCount; ++i) planes[i] = cache.data() + i * planeSize;
+            auto load = [&](uint32_t plane, size_t i) { return SimdFloat::Load(planes[plane] + i); };
+
+            // Stage the tile plus apron
+            const int x0 = int(tile.x0) - apron;
+            const int y0 = int(tile.y0) - apron;
+            const int cachedWidth = int(tile.x1 - tile.x0) + 2 * apron;
+            const int cachedHeight = int(tile.y1 - tile.y0) + 2 * apron;
+            const int copyBegin = std::max(0, -x0);
+            const int copyEnd = std::min(cachedWidth, int(mWidth) - x0);
+
+            for (int ly = 0; ly < cachedHeight; ++ly)
+            {
+                const int gy = y0 + ly;
+                const bool rowInside = gy >= 0 && gy < int(mHeight);
+
+                for (uint32_t i = 0; i < CachePlaneCount; ++i)
+                {
+                    float* dst = planes[i] + size_t(ly) * side;
+                    if (!rowInside)
+                    {
+                        std::fill(dst, dst + cachedWidth, 0.0f);
+                        continue;
+                    }
+
+                    std::fill(dst, dst + copyBegin, 0.0f);
+                    std::fill(dst + copyEnd, dst + cachedWidth, 0.0f);
+                    if (sources[i]) std::copy(sources[i]->GetRow(gy) + x0 + copyBegin, sources[i]->GetRow(gy) + x0 + copyEnd, dst + copyBegin);
+                }
+
+                if (!rowInside) continue;
+
+                const size_t row = size_t(ly) * side;
+                for (int lx = copyBegin; lx < copyEnd; ++lx)
+                {
+                    const size_t i = row + lx;
+                    planes[CacheLuminance][i] = planes[CacheR][i] * 0.2126f + planes[CacheG][i] * 0.7152f + planes[CacheB][i] * 0.0722f;
+                }
+            }
+
+            for (int y = int(tile.y0); y < int(tile.y1); ++y)
+            {
+                for (int x = int(tile.x0); x < int(tile.x1); x += SimdFloat::kWidth)
+                {
+                    const int laneCount = std::min(SimdFloat::kWidth, int(tile.x1) - x);
+                    const size_t center = size_t(y - y0) * side + (x - x0);
+
+                    const SimdFloat centerR = load(CacheR, center);
+                    const SimdFloat centerG = load(CacheG, center);
+                    const SimdFloat centerB = load(CacheB, center);
+                    const SimdFloat centerVariance = load(CacheVariance, center);
+                    const SimdFloat centerZ = load(CacheLinearZ, center);
+                    const SimdMask skybox = centerZ < 0.0f; // not valid depth, must be skybox
+
+                    if (skybox.GetBits() == (1 << laneCount) - 1)
+                    {
+                        StoreQuad(output.r, x, y, centerR, laneCount);
+                        StoreQuad(output.g, x, y, centerG, laneCount);
+                        StoreQuad(output.b, x, y, centerB, laneCount);
+                        StoreQuad(output.variance, x, y, centerVariance, laneCount);
+                        continue;
+                    }
+
+                    const SimdFloat centerNX = load(CacheNormalX, center);
+                    const SimdFloat centerNY = load(CacheNormalY, center);
+                    const SimdFloat centerNZ = load(CacheNormalZ, center);
+                    const SimdFloat centerLuminance = load(CacheLuminance, center);
+
+                    // ComputeVarianceCenter, the apron is at least one pixel wide
+                    SimdFloat variance = 0.0f;
+                    for (int yy = -1; yy <= 1; ++yy)
+                    {
+                        for (int xx = -1; xx <= 1; ++xx)
+                        {
+                            variance += load(CacheVariance, center + yy * side + xx) * varianceKernel[std::abs(xx)][std::abs(yy)];
+                        }
+                    }
+
+                    const SimdFloat phiColor = gPhiColor * Sqrt(Max(0.0f, variance + 1e-10f));
+                    const SimdFloat phiDepth = Max(LoadQuad(mZDerivative, x, y), 1e-8f) * float(stepSize);
+
+                    SimdFloat sumWeight = 1.0f;
+                    SimdFloat sumR = centerR;
+                    SimdFloat sumG = centerG;
+                    SimdFloat sumB = centerB;
+                    SimdFloat sumVariance = centerVariance;
+
+                    for (const Tap& tap : taps)
+                    {
+                        const size_t p = center + tap.offset;
+                        const SimdFloat r = load(CacheR, p);
+                        const SimdFloat g = load(CacheG, p);
+                        const SimdFloat b = load(CacheB, p);
+                        const SimdFloat v = load(CacheVariance, p);
+
+                        const SimdFloat nDotN = Min(centerNX * load(CacheNormalX, p) + centerNY * load(CacheNormalY, p) + centerNZ * load(CacheNormalZ, p), 1.0f);
+                        const SimdMask facing = nDotN > 0.0f;
+                        const SimdFloat wNormalLog = phiNormal * Log(Select(facing, nDotN, 1.0f));
+                        const SimdFloat wZ = Abs(centerZ - load(CacheLinearZ, p)) / (phiDepth * tap.distance);
+                        const SimdFloat wLdirect = Abs(centerLuminance - load(CacheLuminance, p)) / phiColor;
+                        const SimdFloat weight = Select(facing, Exp(SimdFloat(0.0f) - Max(wLdirect, 0.0f) - Max(wZ, 0.0f) + wNormalLog)) * tap.kernel;
+
+                        sumWeight += weight;
+                        sumR += r * weight;
+                        sumG += g * weight;
+                        sumB += b * weight;
+                        sumVariance += v * weight * weight;
+                    }
+
+                    StoreQuad(output.r, x, y, Select(skybox, centerR, sumR / sumWeight), laneCount);
+                    StoreQuad(output.g, x, y, Select(skybox, centerG, sumG / sumWeight), laneCount);
+                    StoreQuad(output.b, x, y, Select(skybox, centerB, sumB / sumWeight), laneCount);
+                    StoreQuad(output.variance, x, y, Select(skybox, centerVariance, sumVariance / (sumWeight * sumWeight)), laneCount);
+                }
+            }
+        });
+    }
+
+    void SVGFPass::Interleave(const SignalPlanes& planes, Image4F& output)
+    {
+        mThreadPool->ParallelForTiles(mWidth, mHeight, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    output.At(x, y) = float4(planes.r.At(x, y), planes.g.At(x, y), planes.b.At(x, y), planes.variance.At(x, y));
+                }
+            }
+        });
+    }
+
+    // Feedback into the fp16 target, RG16F (signal, variance) for scalar signals
+    void SVGFPass::StoreCompactLastFiltered(const SignalPlanes& planes)
+    {
+        mThreadPool->ParallelForTiles(mWidth, mHeight, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    const float4 value = (mSignalType == SVGFSignalType::Scalar) ?
+                        float4(planes.r.At(x, y), planes.variance.At(x, y), 0.0f, 0.0f) :
+                        float4(planes.r.At(x, y), planes.g.At(x, y), planes.b.At(x, y), planes.variance.At(x, y));
+                    mCompactLastFiltered.Store(int2(int(x), int(y)), value);
+                }
+            }
+        });
+    }
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <vector>
+#include "HalfImage.h"
+#include "Image.h"
+#include "TemporalGradient.h"
+#include "ThreadPool.h"
+
+namespace Cpu
+{
+    // A-trous kernel selection, mirrors ::SVGFPass::AtrousPath. Tiled stages every tile plus its apron in a per-thread
+    // cache with the luminance precomputed, the way the groupshared compute shader does, and falls back to Pixel for the
+    // iterations whose apron is wider than the shader's 8 pixels.
+    enum class AtrousPath : uint32_t
+    {
+        Pixel = 0,
+        Tiled
+    };
+
+    // Mirrors ::SVGFPass::SignalType. Scalar signals (shadow, AO) are read from .x and keep (signal, variance) only.
+    enum class SVGFSignalType : uint32_t
+    {
+        Color = 0,
+        Scalar
+    };
+
+    class SVGFSharedHistory;
+
+    // Same knobs as ::SVGFPass, with the same defaults
+    struct SVGFSettings
+    {
+        uint32_t atrousIterations = 4;
+        uint32_t feedbackTap = 1;
+        uint32_t atrousRadius = 2;
+        float alpha = 0.15f;
+        float momentsAlpha = 0.2f;
+        float phiColor = 10.0f;
+        float phiNormal = 128.0f;
+        bool enableTemporalReprojection = true;
+        bool enableSpatialVarianceEstimation = true;
+        AtrousPath atrousPath = AtrousPath::Tiled;
+        // A-SVGF, with gradient samples passed to Execute(). The alphas rise to 1 with the change the filtered
+        // gradient sees.
+        uint32_t gradientFilterIterations = 3;
+    };
+
+    struct SVGFTimings
+    {
+        double decodeMs = 0.0;
+        double gradientMs = 0.0;
+        double reprojectionMs = 0.0;
+        double varianceEstimationMs = 0.0;
+        std::vector<double> atrousMs;
+        double feedbackMs = 0.0;
+        double totalMs = 0.0;
+        double megapixelsPerSecond = 0.0;
+    };
+
+    // Headless implementation of ::SVGFPass. Inputs are float4 images laid out exactly like the G-buffer targets:
+    // motion = MotionVector, linearZ = SVGF_LinearZ, normalDepth = SVGF_CompactNormDepth.
+    class SVGFPass
+    {
+    public:
+        // Full fp32 history owned by the pass, the layout the GPU filter used before the shared history
+        SVGFPass(uint32_t width, uint32_t height, ThreadPool* threadPool = nullptr);
+
+        // Compact layout of the GPU filter: fp16 history, history length and previous linear Z taken from
+        // a SVGFSharedHistory that is updated once per frame before any filter runs
+        SVGFPass(uint32_t width, uint32_t height, SVGFSharedHistory& history, SVGFSignalType signalType, ThreadPool* threadPool = nullptr);
+
+        // rayCounts are the rays an AdaptiveSampler traced per pixel. Pixels without rays keep their reprojected history
+        // instead of taking the cleared input as a sample.
+        // gradientSamples are the shared history's, for a signal that was traced with them. The filter then drops as much
+        // of each pixel's history as the temporal gradient says the signal changed. Compact layout only.
+        const Image4F& Execute(const Image4F& inputSignal, const Image4F& motionVec, const Image4F& linearZ, const Image4F& normalDepth,
+            const Image<uint8_t>* rayCounts = nullptr, const Image<GradientSample>* gradientSamples = nullptr);
+
+        // Drops all temporal history, as after a camera cut
+        void Reset();
+
+        SVGFSignalType GetSignalType() const { return mSignalType; }
+        SVGFSettings& GetSettings() { return mSettings; }
+        const SVGFSettings& GetSettings() const { return mSettings; }
+        const SVGFTimings& GetTimings() const { return mTimings; }
+        const Image4F& GetOutput() const { return mOutput; }
+        uint32_t GetWidth() const { return mWidth; }
+        uint32_t GetHeight() const { return mHeight; }
+        size_t GetAllocatedBytes() const;
+
+        // Whether a-trous iteration i runs the tiled kernel under the current settings
+        bool IsAtrousTiled(uint32_t iteration) const;
+
+        // Whether the next Execute() reprojects its own history, i.e. this filter ran last frame. Compact layout only.
+        bool HasValidHistory() const;
+        // Variance at the feedback tap of the last Execute(), in last frame's pixels
+        float GetLastFilteredVariance(const int2& p) const { return LoadLastFiltered(p).w; }
+        // Filtered gradient of the last Execute() per stratum: change, normalization and whether any sample reached it
+        const Image4F& GetTemporalGradient() const { return mGradient; }
+
+    private:
+        // Structure of arrays so the a-trous kernel can filter 4 adjacent pixels per SIMD op
+        struct SignalPlanes
+        {
+            ImageF r, g, b, variance;
+
+            void Resize(uint32_t width, uint32_t height);
+            size_t GetSizeInBytes() const;
+        };
+
+        struct ReprojectionBuffers
+        {
+            Image4F signal;         // Input signal, variance
+            Image<float2> moments;  // 1st and 2nd moments
+            ImageF historyLength;
+
+            void Resize(uint32_t width, uint32_t height);
+            size_t GetSizeInBytes() const;
+        };
+
+        // Same targets as the GPU filter: RGBA16F (signal, variance) + RG16F moments for color,
+        // a single RGBA16F (signal, variance, moments) for scalar signals. The moments are stored as 1st moment and variance,
+        // see EncodeCompactMoments() in SVGF.cpp
+        struct CompactReprojectionBuffers
+        {
+            HalfImage signal;
+            HalfImage moments;
+
+            void Resize(uint32_t width, uint32_t height, SVGFSignalType signalType);
+            size_t GetSizeInBytes() const;
+        };
+
+        void DecodeNormalDepth();
+        void ComputeTemporalGradient(const Image<GradientSample>& samples);
+        void FilterTemporalGradient(uint32_t iteration);
+        void TemporalReprojection();
+        void SpatialVarianceEstimation();
+        void AtrousFilter(uint32_t iteration, const SignalPlanes& input, SignalPlanes& output);
+        void AtrousFilterTiled(uint32_t iteration, const SignalPlanes& input, SignalPlanes& output);
+        void Interleave(const SignalPlanes& planes, Image4F& output);
+        void StoreCompactLastFiltered(const SignalPlanes& planes);
+
+        bool ReprojectLastFilteredData(int2 ipos, float3& prevSignal, float2& prevMoments, float& historyLength) const;
+
+        // Storage accessors, so the kernels read the same whichever layout is in use
+        bool IsCompact() const { return mHistory != nullptr; }
+        const Image4F& GetPrevLinearZ() const;
+        float4 LoadLastFiltered(int2 p) const;
+        float2 LoadPrevMoments(int2 p) const;
+        float4 LoadReprojSignal(int2 p) const;
+        float2 LoadReprojMoments(int2 p) const;
+        float LoadHistoryLength(int2 p) const;
+        float LoadGradientLambda(int2 p) const;
+        void StoreReprojection(int2 p, const float4& signal, const float2& moments, float historyLength);
+
+        uint32_t mWidth;
+        uint32_t mHeight;
+        ThreadPool* mThreadPool;
+        SVGFSettings mSettings;
+        SVGFTimings mTimings;
+
+        ReprojectionBuffers mCurrReproj;
+        ReprojectionBuffers mPrevReproj;
+        SignalPlanes mAtrousPing;
+        SignalPlanes mAtrousPong;
+        Image4F mLastFiltered;
+        Image4F mOutput;
+        Image4F mPrevLinearZ;
+
+        SVGFSharedHistory* mHistory = nullptr;
+        SVGFSignalType mSignalType = SVGFSignalType::Color;
+        CompactReprojectionBuffers mCurrCompactReproj;
+        CompactReprojectionBuffers mPrevCompactReproj;
+        HalfImage mCompactLastFiltered;
+        uint64_t mLastHistoryFrame = 0;
+        bool mHasHistory = false;
+        bool mHistoryReset = true;
+
+        // A-SVGF, per stratum. The luminance of the sample each stratum picked, compared against next frame.
+        Image4F mGradient;
+        Image4F mGradientFiltered;
+        ImageF mCurrGradientLuminance;
+        ImageF mPrevGradientLuminance;
+        uint64_t mLastGradientFrame = 0;
+        bool mHasGradientLuminance = false;
+        bool mUseGradient = false;
+
+        // SVGF_CompactNormDepth decoded once per frame instead of once per tap
+        ImageF mNormalX;
+        ImageF mNormalY;
+        ImageF mNormalZ;
+        ImageF mLinearZ;
+        ImageF mZDerivative;
+
+        // Per-thread staging area of AtrousFilterTiled
+        std::vector<std::vector<float>> mAtrousTileCaches;
+
+        struct
+        {
+            const Image4F* inputSignal;
+            const Image4F* linearZ;
+            const Image4F* motionVec;
+            const Image4F* compactNormalDepth;
+            const Image<uint8_t>* rayCounts;
+        } mGBufferInput;
+    };
+}
@@ -0,0 +1,583 @@
+#include "SVGFPacked.h"
+#include "SVGFUtils.h"
+#include "SimdImage.h"
+#include "Timer.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        const uint32_t kTileSize = 64;
+
+        void Accumulate(float3& sumReflection, float2& sumScalar, float4& sumMoments, float2& sumAOMoments,
+            const float3& reflection, const float2& scalar, const float4& moments, const float2& aoMoments, float w)
+        {
+            sumReflection += reflection * w;
+            sumScalar += scalar * w;
+            sumMoments += moments * w;
+            sumAOMoments += aoMoments * w;
+        }
+    }
+
+    void SVGFPackedPass::SignalPlanes::Resize(uint32_t width, uint32_t height)
+    {
+        for (ImageF& plane : planes) plane.Resize(width, height);
+    }
+
+    size_t SVGFPackedPass::SignalPlanes::GetSizeInBytes() const
+    {
+        size_t bytes = 0;
+        for (const ImageF& plane : planes) bytes += plane.GetSizeInBytes();
+        return bytes;
+    }
+
+    void SVGFPackedPass::ReprojectionBuffers::Resize(uint32_t width, uint32_t height)
+    {
+        reflection.Resize(width, height);
+        scalar.Resize(width, height);
+        moments.Resize(width, height);
+        aoMoments.Resize(width, height);
+        historyLength.Resize(width, height);
+    }
+
+    size_t SVGFPackedPass::ReprojectionBuffers::GetSizeInBytes() const
+    {
+        return reflection.GetSizeInBytes() + scalar.GetSizeInBytes() + moments.GetSizeInBytes() +
+            aoMoments.GetSizeInBytes() + historyLength.GetSizeInBytes();
+    }
+
+    SVGFPackedPass::SVGFPackedPass(uint32_t width, uint32_t height, ThreadPool* threadPool)
+        : mWidth(width),
+          mHeight(height),
+          mThreadPool(threadPool ? threadPool : &ThreadPool::GetDefault())
+    {
+        mCurrReproj.Resize(width, height);
+        mPrevReproj.Resize(width, height);
+        mAtrousPing.Resize(width, height);
+        mAtrousPong.Resize(width, height);
+        mLastFilteredReflection.Resize(width, height);
+        mLastFilteredScalar.Resize(width, height);
+        mReflectionOutput.Resize(width, height);
+        mScalarOutput.Resize(width, height);
+        mPrevLinearZ.Resize(width, height);
+
+        mNormalX.Resize(width, height);
+        mNormalY.Resize(width, height);
+        mNormalZ.Resize(width, height);
+        mLinearZ.Resize(width, height);
+        mZDerivative.Resize(width, height);
+    }
+
+    void SVGFPackedPass::Reset()
+    {
+        mCurrReproj.Resize(mWidth, mHeight);
+        mPrevReproj.Resize(mWidth, mHeight);
+        mLastFilteredReflection.Fill(float4());
+        mLastFilteredScalar.Fill(float4());
+        mPrevLinearZ.Fill(float4());
+    }
+
+    size_t SVGFPackedPass::GetAllocatedBytes() const
+    {
+        return mCurrReproj.GetSizeInBytes() + mPrevReproj.GetSizeInBytes() +
+            mAtrousPing.GetSizeInBytes() + mAtrousPong.GetSizeInBytes() +
+            mLastFilteredReflection.GetSizeInBytes() + mLastFilteredScalar.GetSizeInBytes() +
+            mReflectionOutput.GetSizeInBytes() + mScalarOutput.GetSizeInBytes() + mPrevLinearZ.GetSizeInBytes() +
+            mNormalX.GetSizeInBytes() + mNormalY.GetSizeInBytes() + mNormalZ.GetSizeInBytes() +
+            mLinearZ.GetSizeInBytes() + mZDerivative.GetSizeInBytes();
+    }
+
+    void SVGFPackedPass::Execute(const Image4F& reflection, const Image4F& shadow, const Image4F& ao, const Image4F& motionVec, const Image4F& linearZ, const Image4F& normalDepth)
+    {
+        Timer totalTimer;
+
+        mGBufferInput.reflection = &reflection;
+        mGBufferInput.shadow = &shadow;
+        mGBufferInput.ao = &ao;
+        mGBufferInput.linearZ = &linearZ;
+        mGBufferInput.motionVec = &motionVec;
+        mGBufferInput.compactNormalDepth = &normalDepth;
+
+        Timer timer;
+        DecodeNormalDepth();
+        mTimings.decodeMs = timer.GetElapsedMs();
+
+        timer.Reset();
+        TemporalReprojection();
+        mTimings.reprojectionMs = timer.GetElapsedMs();
+
+        timer.Reset();
+        SpatialVarianceEstimation();
+        mTimings.varianceEstimationMs = timer.GetElapsedMs();
+
+        mTimings.atrousMs.assign(mSettings.atrousIterations, 0.0);
+        mTimings.feedbackMs = 0.0;
+
+        for (uint32_t i = 0; i < mSettings.atrousIterations; ++i)
+        {
+            timer.Reset();
+            AtrousFilter(i, mAtrousPing, mAtrousPong);
+            if (i == mSettings.atrousIterations - 1)
+            {
+                Interleave(mAtrousPong, mReflectionOutput, mScalarOutput);
+            }
+            mTimings.atrousMs[i] = timer.GetElapsedMs();
+
+            if (i == mSettings.feedbackTap)
+            {
+                timer.Reset();
+                Interleave(mAtrousPong, mLastFilteredReflection, mLastFilteredScalar);
+                mTimings.feedbackMs = timer.GetElapsedMs();
+            }
+
+            std::swap(mAtrousPing, mAtrousPong);
+        }
+
+        std::swap(mCurrReproj, mPrevReproj);
+
+        mPrevLinearZ = linearZ;
+
+        mTimings.totalMs = totalTimer.GetElapsedMs();
+        mTimings.megapixelsPerSecond = (double(mWidth) * mHeight * 1e-6) / (mTimings.totalMs * 1e-3);
+    }
+
+    void SVGFPackedPass::DecodeNormalDepth()
+    {
+        const Image4F& normalDepth = *mGBufferInput.compactNormalDepth;
+
+        mThreadPool->ParallelForTiles(mWidth, mHeight, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    const float4 nd = normalDepth.At(x, y);
+                    const float3 normal = normalize(OctToDir(asuint(nd.x)));
+                    mNormalX.At(x, y) = normal.x;
+                    mNormalY.At(x, y) = normal.y;
+                    mNormalZ.At(x, y) = normal.z;
+                    mLinearZ.At(x, y) = nd.y;
+                    mZDerivative.At(x, y) = nd.z;
+                }
+            }
+        });
+    }
+
+    SVGFPackedPass::History SVGFPackedPass::LoadHistory(int2 p) const
+    {
+        const float4 scalar = mLastFilteredScalar.Load(p);
+
+        History h;
+        h.reflection = mLastFilteredReflection.Load(p).rgb();
+        h.scalar = float2(scalar.x, scalar.z);
+        h.moments = mPrevReproj.moments.Load(p);
+        h.aoMoments = mPrevReproj.aoMoments.Load(p);
+        return h;
+    }
+
+    bool SVGFPackedPass::ReprojectLastFilteredData(int2 ipos, History& prev, float& historyLength) const
+    {
+        const float2 imageDim = float2(float(mWidth), float(mHeight));
+
+        // .xy motion, .z position derivative (unused), .w normal derivative
+        const float4 motion = mGBufferInput.motionVec->At(ipos);
+
+        // .x Z, .y Z derivative, .z last frame Z, .w world normal
+        const float4 depth = mGBufferInput.linearZ->At(ipos);
+        const float3 normal = OctToDir(asuint(depth.w));
+
+        const float2 offsetPrev = motion.xy() * imageDim;
+        const int2 iposPrev = int2(int(float(ipos.x) + offsetPrev.x + 0.5f), int(float(ipos.y) + offsetPrev.y + 0.5f));
+        const float2 posPrev = float2(float(ipos.x), float(ipos.y)) + offsetPrev;
+
+        prev = History();
+        historyLength = mPrevReproj.historyLength.Load(iposPrev);
+
+        bool v[4];
+        const int2 offset[4] = { int2(0, 0), int2(1, 0), int2(0, 1), int2(1, 1) };
+        const int2 base = int2(int(posPrev.x), int(posPrev.y));
+
+        // Check for all 4 taps of the bilinear filter for validity
+        bool valid = false;
+        for (int sampleIdx = 0; sampleIdx < 4; ++sampleIdx)
+        {
+            const int2 loc = base + offset[sampleIdx];
+            const float4 depthPrev = mPrevLinearZ.Load(loc);
+            const float3 normalPrev = OctToDir(asuint(depthPrev.w));
+
+            v[sampleIdx] = IsReprjValid(iposPrev, int2(mWidth, mHeight), depth.z, depthPrev.x, depth.y, normal, normalPrev, motion.w);
+
+            valid = valid || v[sampleIdx];
+        }
+
+        // Perform bilinear interpolation, the weights are shared by every signal
+        if (valid)
+        {
+            float sumWeights = 0.0f;
+            const float x = frac(posPrev.x);
+            const float y = frac(posPrev.y);
+
+            const float w[4] = { (1 - x) * (1 - y),
+                                      x  * (1 - y),
+                                 (1 - x) *      y,
+                                      x  *      y };
+
+            for (int sampleIdx = 0; sampleIdx < 4; ++sampleIdx)
+            {
+                if (v[sampleIdx])
+                {
+                    const History h = LoadHistory(base + offset[sampleIdx]);
+                    Accumulate(prev.reflection, prev.scalar, prev.moments, prev.aoMoments, h.reflection, h.scalar, h.moments, h.aoMoments, w[sampleIdx]);
+                    sumWeights += w[sampleIdx];
+                }
+            }
+
+            // Redistribute weights in case not all taps were used
+            valid = (sumWeights >= 0.01f);
+            if (valid)
+            {
+                prev.reflection /= sumWeights;
+                prev.scalar /= sumWeights;
+                prev.moments = prev.moments / sumWeights;
+                prev.aoMoments /= sumWeights;
+            }
+            else
+            {
+                prev = History();
+            }
+        }
+
+        // Perform a cross-bilateral filter with binary decision to find some suitable samples spatially
+        if (!valid)
+        {
+            float cnt = 0.0f;
+            const int radius = 1;
+            for (int yy = -radius; yy <= radius; ++yy)
+            {
+                for (int xx = -radius; xx <= radius; ++xx)
+                {
+                    const int2 p = iposPrev + int2(xx, yy);
+                    const float4 depthP = mPrevLinearZ.Load(p);
+                    const float3 normalP = OctToDir(asuint(depthP.w));
+
+                    if (IsReprjValid(iposPrev, int2(mWidth, mHeight), depth.z, depthP.x, depth.y, normal, normalP, motion.w))
+                    {
+                        const History h = LoadHistory(p);
+                        Accumulate(prev.reflection, prev.scalar, prev.moments, prev.aoMoments, h.reflection, h.scalar, h.moments, h.aoMoments, 1.0f);
+                        cnt += 1.0f;
+                    }
+                }
+            }
+
+            if (cnt > 0.0f)
+            {
+                valid = true;
+                prev.reflection /= cnt;
+                prev.scalar /= cnt;
+                prev.moments = prev.moments / cnt;
+                prev.aoMoments /= cnt;
+            }
+        }
+
+        if (!valid)
+        {
+            prev = History();
+            historyLength = 0.0f;
+        }
+
+        return valid;
+    }
+
+    void SVGFPackedPass::TemporalReprojection()
+    {
+        mThreadPool->ParallelForTiles(mWidth, mHeight, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    const int2 ipos = int2(int(x), int(y));
+                    const float3 reflection = mGBufferInput.reflection->At(ipos).rgb();
+                    const float2 scalar = float2(mGBufferInput.shadow->At(ipos).x, mGBufferInput.ao->At(ipos).x);
+
+                    if (!mSettings.enableTemporalReprojection)
+                    {
+                        // Performs uniform bilateral filter with variance = 1.0
+                        mCurrReproj.reflection.At(ipos) = float4(reflection, 1.0f);
+                        mCurrReproj.scalar.At(ipos) = float4(scalar.x, 1.0f, scalar.y, 1.0f);
+                        mCurrReproj.moments.At(ipos) = float4();
+                        mCurrReproj.aoMoments.At(ipos) = float2();
+                        mCurrReproj.historyLength.At(ipos) = 1.0f;
+                        continue;
+                    }
+
+                    float historyLength;
+                    History prev;
+                    const bool success = ReprojectLastFilteredData(ipos, prev, historyLength);
+
+                    historyLength = std::min(32.0f, success ? historyLength + 1.0f : 1.0f);
+
+                    const float alpha = success ? std::max(mSettings.alpha, 1.0f / historyLength) : 1.0f;
+                    const float alphaMoments = success ? std::max(mSettings.momentsAlpha, 1.0f / historyLength) : 1.0f;
+
+                    const float3 lum = float3(luminance(reflection), ScalarLuminance(scalar.x), ScalarLuminance(scalar.y));
+                    const float4 moments = lerp(prev.moments, float4(lum.x, lum.x * lum.x, lum.y, lum.y * lum.y), alphaMoments);
+                    const float2 aoMoments = lerp(prev.aoMoments, float2(lum.z, lum.z * lum.z), alphaMoments);
+                    const float2 filteredScalar = lerp(prev.scalar, scalar, alpha);
+
+                    mCurrReproj.reflection.At(ipos) = float4(lerp(prev.reflection, reflection, alpha), std::max(0.0f, moments.y - moments.x * moments.x));
+                    mCurrReproj.scalar.At(ipos) = float4(
+                        filteredScalar.x, std::max(0.0f, moments.w - moments.z * moments.z),
+                        filteredScalar.y, std::max(0.0f, aoMoments.y - aoMoments.x * aoMoments.x));
+                    mCurrReproj.moments.At(ipos) = moments;
+                    mCurrReproj.aoMoments.At(ipos) = aoMoments;
+                    mCurrReproj.historyLength.At(ipos) = historyLength;
+                }
+            }
+        });
+    }
+
+    void SVGFPackedPass::SpatialVarianceEstimation()
+    {
+        const Image4F& reflection = mCurrReproj.reflection;
+        const Image4F& scalar = mCurrReproj.scalar;
+
+        auto store = [&](int2 p, const float4& reflectionValue, const float4& scalarValue)
+        {
+            mAtrousPing.planes[ReflectionR].At(p) = reflectionValue.x;
+            mAtrousPing.planes[ReflectionG].At(p) = reflectionValue.y;
+            mAtrousPing.planes[ReflectionB].At(p) = reflectionValue.z;
+            mAtrousPing.planes[ReflectionVariance].At(p) = reflectionValue.w;
+            mAtrousPing.planes[Shadow].At(p) = scalarValue.x;
+            mAtrousPing.planes[ShadowVariance].At(p) = scalarValue.y;
+            mAtrousPing.planes[AO].At(p) = scalarValue.z;
+            mAtrousPing.planes[AOVariance].At(p) = scalarValue.w;
+        };
+
+        auto computeLuminance = [&](int2 p)
+        {
+            const float4 s = scalar.At(p);
+            return float3(luminance(reflection.At(p).rgb()), ScalarLuminance(s.x), ScalarLuminance(s.z));
+        };
+
+        mThreadPool->ParallelForTiles(mWidth, mHeight, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    const int2 ipos = int2(int(x), int(y));
+
+                    const float h = mCurrReproj.historyLength.At(ipos);
+                    const float linearZCenter = mLinearZ.At(ipos);
+                    if (h >= 4.0f || !mSettings.enableSpatialVarianceEstimation || linearZCenter < 0) // skybox has no valid depth
+                    {
+                        store(ipos, reflection.At(ipos), scalar.At(ipos));
+                        continue;
+                    }
+
+                    const float3 normalCenter = float3(mNormalX.At(ipos), mNormalY.At(ipos), mNormalZ.At(ipos));
+                    const float3 luminanceCenter = computeLuminance(ipos);
+                    const float phiDepth = std::max(mZDerivative.At(ipos), 1e-8f) * 3.0f;
+
+                    float3 sumWeight;
+                    float3 sumReflection;
+                    float2 sumScalar;
+                    float4 sumMoments;
+                    float2 sumAOMoments;
+
+                    // Compute first and second moment spatially. This code also applies cross-bilateral filtering on the input color samples
+                    const int radius = 3;
+                    for (int yy = -radius; yy <= radius; ++yy)
+                    {
+                        for (int xx = -radius; xx <= radius; ++xx)
+                        {
+                            const int2 p = ipos + int2(xx, yy);
+                            if (!reflection.IsInside(p.x, p.y)) continue;
+
+                            const float3 normalP = float3(mNormalX.At(p), mNormalY.At(p), mNormalZ.At(p));
+                            const float geometry = ComputeGeometryWeight(normalCenter, linearZCenter, normalP, mLinearZ.At(p),
+                                phiDepth * length(float2(float(xx), float(yy))), mSettings.phiNormal);
+                            if (geometry == 0.0f) continue;
+
+                            const float3 luminanceP = computeLuminance(p);
+                            const float3 weight = float3(
+                                geometry * ComputeLuminanceWeight(luminanceCenter.x, luminanceP.x, mSettings.phiColor[0]),
+                                geometry * ComputeLuminanceWeight(luminanceCenter.y, luminanceP.y, mSettings.phiColor[1]),
+                                geometry * ComputeLuminanceWeight(luminanceCenter.z, luminanceP.z, mSettings.phiColor[2]));
+
+                            const float4 scalarP = scalar.At(p);
+                            const float4 momentsP = mCurrReproj.moments.At(p);
+
+                            sumWeight += weight;
+                            sumReflection += reflection.At(p).rgb() * weight.x;
+                            sumScalar += float2(scalarP.x * weight.y, scalarP.z * weight.z);
+                            sumMoments += float4(momentsP.x * weight.x, momentsP.y * weight.x, momentsP.z * weight.y, momentsP.w * weight.y);
+                            sumAOMoments += mCurrReproj.aoMoments.At(p) * weight.z;
+                        }
+                    }
+
+                    sumWeight = max(sumWeight, float3(1e-6f, 1e-6f, 1e-6f));
+                    sumReflection /= sumWeight.x;
+                    sumScalar = float2(sumScalar.x / sumWeight.y, sumScalar.y / sumWeight.z);
+                    sumMoments = float4(sumMoments.x / sumWeight.x, sumMoments.y / sumWeight.x, sumMoments.z / sumWeight.y, sumMoments.w / sumWeight.y);
+                    sumAOMoments /= sumWeight.z;
+
+                    // Boost variance for first few frames
+                    const float boost = 4.0f / h;
+                    const float reflectionVariance = (sumMoments.y - sumMoments.x * sumMoments.x) * boost;
+                    const float shadowVariance = (sumMoments.w - sumMoments.z * sumMoments.z) * boost;
+                    const float aoVariance = (sumAOMoments.y - sumAOMoments.x * sumAOMoments.x) * boost;
+
+                    store(ipos, float4(sumReflection, reflectionVariance), float4(sumScalar.x, shadowVariance, sumScalar.y, aoVariance));
+                }
+            }
+        });
+    }
+
+    void SVGFPackedPass::AtrousFilter(uint32_t iteration, const SignalPlanes& input, SignalPlanes& output)
+    {
+        const int stepSize = 1 << iteration;
+        const int radius = int(mSettings.atrousRadius);
+        const SimdFloat phiNormal = mSettings.phiNormal;
+        const float kernelWeights[3] = { 1.0f, 2.0f / 3.0f, 1.0f / 6.0f };
+        const float varianceKernel[2][2] =
+        {
+            { 1.0f / 4.0f, 1.0f / 8.0f },
+            { 1.0f / 8.0f, 1.0f / 16.0f }
+        };
+
+        // Signal planes and the variance plane each one is weighted by
+        const Plane signalPlanes[] = { ReflectionR, ReflectionG, ReflectionB, Shadow, AO };
+        const uint32_t signalOf[] = { 0, 0, 0, 1, 2 };
+        const Plane variancePlanes[kPackedSignalCount] = { ReflectionVariance, ShadowVariance, AOVariance };
+        const uint32_t signalPlaneCount = sizeof(signalPlanes) / sizeof(signalPlanes[0]);
+
+        mThreadPool->ParallelForTiles(mWidth, mHeight, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (int y = int(tile.y0); y < int(tile.y1); ++y)
+            {
+                for (int x = int(tile.x0); x < int(tile.x1); x += SimdFloat::kWidth)
+                {
+                    const int laneCount = std::min(SimdFloat::kWidth, int(tile.x1) - x);
+
+                    SimdFloat center[PlaneCount];
+                    for (uint32_t i = 0; i < PlaneCount; ++i) center[i] = LoadQuad(input.planes[i], x, y);
+
+                    const SimdFloat centerZ = LoadQuad(mLinearZ, x, y);
+                    const SimdMask skybox = centerZ < 0.0f; // not valid depth, must be skybox
+
+                    if (skybox.GetBits() == (1 << laneCount) - 1)
+                    {
+                        for (uint32_t i = 0; i < PlaneCount; ++i) StoreQuad(output.planes[i], x, y, center[i], laneCount);
+                        continue;
+                    }
+
+                    const SimdFloat centerNX = LoadQuad(mNormalX, x, y);
+                    const SimdFloat centerNY = LoadQuad(mNormalY, x, y);
+                    const SimdFloat centerNZ = LoadQuad(mNormalZ, x, y);
+                    const SimdFloat centerLuminance[kPackedSignalCount] =
+                    {
+                        Luminance(center[ReflectionR], center[ReflectionG], center[ReflectionB]),
+                        center[Shadow] * 0.2126f,
+                        center[AO] * 0.2126f,
+                    };
+
+                    // ComputeVarianceCenter per signal, then the per-signal color edge-stopping strength
+                    SimdFloat phiColor[kPackedSignalCount];
+                    for (uint32_t s = 0; s < kPackedSignalCount; ++s)
+                    {
+                        SimdFloat variance = 0.0f;
+                        for (int yy = -1; yy <= 1; ++yy)
+                        {
+                            for (int xx = -1; xx <= 1; ++xx)
+                            {
+                                variance += LoadQuad(input.planes[variancePlanes[s]], x + xx, y + yy) * varianceKernel[std::abs(xx)][std::abs(yy)];
+                            }
+                        }
+                        phiColor[s] = SimdFloat(mSettings.phiColor[s]) * Sqrt(Max(0.0f, variance + 1e-10f));
+                    }
+
+                    const SimdFloat phiDepth = Max(LoadQuad(mZDerivative, x, y), 1e-8f) * float(stepSize);
+
+                    SimdFloat sumWeight[kPackedSignalCount] = { 1.0f, 1.0f, 1.0f };
+                    SimdFloat sum[PlaneCount];
+                    for (uint32_t i = 0; i < PlaneCount; ++i) sum[i] = center[i];
+
+                    for (int yy = -radius; yy <= radius; ++yy)
+                    {
+                        for (int xx = -radius; xx <= radius; ++xx)
+                        {
+                            if (xx == 0 && yy == 0) continue;
+
+                            const int px = x + xx * stepSize;
+                            const int py = y + yy * stepSize;
+                            const SimdMask inside = InsideQuad(px, py, mWidth, mHeight);
+                            if (!inside.Any()) continue;
+
+                            // Depth and normal terms once per tap, pow(n, phiNormal) folded into the exp as in SVGFPass
+                            const SimdFloat nDotN = Min(centerNX * LoadQuad(mNormalX, px, py) + centerNY * LoadQuad(mNormalY, px, py) + centerNZ * LoadQuad(mNormalZ, px, py), 1.0f);
+                            const SimdMask facing = nDotN > 0.0f;
+                            const SimdFloat wNormalLog = phiNormal * Log(Select(facing, nDotN, 1.0f));
+                            const SimdFloat wZ = Abs(centerZ - LoadQuad(mLinearZ, px, py)) / (phiDepth * std::sqrt(float(xx * xx + yy * yy)));
+                            const float kernel = kernelWeights[std::abs(xx)] * kernelWeights[std::abs(yy)];
+                            const SimdFloat geometry = Select(inside & facing, Exp(wNormalLog - Max(wZ, 0.0f)) * kernel);
+
+                            SimdFloat tap[PlaneCount];
+                            for (uint32_t i = 0; i < PlaneCount; ++i) tap[i] = LoadQuad(input.planes[i], px, py);
+
+                            const SimdFloat tapLuminance[kPackedSignalCount] =
+                            {
+                                Luminance(tap[ReflectionR], tap[ReflectionG], tap[ReflectionB]),
+                                tap[Shadow] * 0.2126f,
+                                tap[AO] * 0.2126f,
+                            };
+
+                            SimdFloat weight[kPackedSignalCount];
+                            for (uint32_t s = 0; s < kPackedSignalCount; ++s)
+                            {
+                                const SimdFloat wLdirect = Abs(centerLuminance[s] - tapLuminance[s]) / phiColor[s];
+                                weight[s] = geometry * Exp(SimdFloat(0.0f) - Max(wLdirect, 0.0f));
+                                sumWeight[s] += weight[s];
+                                sum[variancePlanes[s]] += tap[variancePlanes[s]] * weight[s] * weight[s];
+                            }
+
+                            for (uint32_t i = 0; i < signalPlaneCount; ++i)
+                            {
+                                sum[signalPlanes[i]] += tap[signalPlanes[i]] * weight[signalOf[i]];
+                            }
+                        }
+                    }
+
+                    for (uint32_t i = 0; i < signalPlaneCount; ++i)
+                    {
+                        const Plane plane = signalPlanes[i];
+                        StoreQuad(output.planes[plane], x, y, Select(skybox, center[plane], sum[plane] / sumWeight[signalOf[i]]), laneCount);
+                    }
+                    for (uint32_t s = 0; s < kPackedSignalCount; ++s)
+                    {
+                        const Plane plane = variancePlanes[s];
+                        StoreQuad(output.planes[plane], x, y, Select(skybox, center[plane], sum[plane] / (sumWeight[s] * sumWeight[s])), laneCount);
+                    }
+                }
+            }
+        });
+    }
+
+    void SVGFPackedPass::Interleave(const SignalPlanes& input, Image4F& reflection, Image4F& scalar)
+    {
+        const ImageF* p = input.planes;
+
+        mThreadPool->ParallelForTiles(mWidth, mHeight, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    reflection.At(x, y) = float4(p[ReflectionR].At(x, y), p[ReflectionG].At(x, y), p[ReflectionB].At(x, y), p[ReflectionVariance].At(x, y));
+                    scalar.At(x, y) = float4(p[Shadow].At(x, y), p[ShadowVariance].At(x, y), p[AO].At(x, y), p[AOVariance].At(x, y));
+                }
+            }
+        });
+    }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <array>
+#include "SVGF.h"
+
+namespace Cpu
+{
+    enum class PackedSignal : uint32_t
+    {
+        Reflection = 0,
+        Shadow,
+        AO,
+        Count
+    };
+
+    const uint32_t kPackedSignalCount = uint32_t(PackedSignal::Count);
+
+    // Same knobs as SVGFSettings, except that every signal keeps its own color edge-stopping strength
+    struct SVGFPackedSettings
+    {
+        uint32_t atrousIterations = 4;
+        uint32_t feedbackTap = 1;
+        uint32_t atrousRadius = 2;
+        float alpha = 0.15f;
+        float momentsAlpha = 0.2f;
+        std::array<float, kPackedSignalCount> phiColor = { { 10.0f, 10.0f, 10.0f } };
+        float phiNormal = 128.0f;
+        bool enableTemporalReprojection = true;
+        bool enableSpatialVarianceEstimation = true;
+    };
+
+    // Headless implementation of ::SVGFPackedPass: filters reflection, shadow and AO in one pass chain.
+    // Reprojection validity, history length and the depth/normal edge-stopping weights are computed once and
+    // shared by the three signals. Outputs: reflection = (rgb, variance), scalar = (shadow, variance, AO, variance).
+    class SVGFPackedPass
+    {
+    public:
+        SVGFPackedPass(uint32_t width, uint32_t height, ThreadPool* threadPool = nullptr);
+
+        // Shadow and AO are read from .x, the way the R8Unorm targets load
+        void Execute(const Image4F& reflection, const Image4F& shadow, const Image4F& ao, const Image4F& motionVec, const Image4F& linearZ, const Image4F& normalDepth);
+
+        void Reset();
+
+        SVGFPackedSettings& GetSettings() { return mSettings; }
+        const SVGFPackedSettings& GetSettings() const { return mSettings; }
+        const SVGFTimings& GetTimings() const { return mTimings; }
+        const Image4F& GetReflectionOutput() const { return mReflectionOutput; }
+        const Image4F& GetScalarOutput() const { return mScalarOutput; }
+        uint32_t GetWidth() const { return mWidth; }
+        uint32_t GetHeight() const { return mHeight; }
+        size_t GetAllocatedBytes() const;
+
+    private:
+        enum Plane : uint32_t
+        {
+            ReflectionR = 0,
+            ReflectionG,
+            ReflectionB,
+            ReflectionVariance,
+            Shadow,
+            ShadowVariance,
+            AO,
+            AOVariance,
+            PlaneCount
+        };
+
+        struct SignalPlanes
+        {
+            ImageF planes[PlaneCount];
+
+            void Resize(uint32_t width, uint32_t height);
+            size_t GetSizeInBytes() const;
+        };
+
+        struct ReprojectionBuffers
+        {
+            Image4F reflection;     // Signal, variance
+            Image4F scalar;         // Shadow, shadow variance, AO, AO variance
+            Image4F moments;        // Reflection 1st/2nd moments, shadow 1st/2nd moments
+            Image<float2> aoMoments;
+            ImageF historyLength;
+
+            void Resize(uint32_t width, uint32_t height);
+            size_t GetSizeInBytes() const;
+        };
+
+        // Everything reprojected from the last frame, gathered with one set of bilinear weights
+        struct History
+        {
+            float3 reflection;
+            float2 scalar;          // Shadow, AO
+            float4 moments;
+            float2 aoMoments;
+        };
+
+        void DecodeNormalDepth();
+        void TemporalReprojection();
+        void SpatialVarianceEstimation();
+        void AtrousFilter(uint32_t iteration, const SignalPlanes& input, SignalPlanes& output);
+        void Interleave(const SignalPlanes& input, Image4F& reflection, Image4F& scalar);
+
+        bool ReprojectLastFilteredData(int2 ipos, History& prev, float& historyLength) const;
+        History LoadHistory(int2 p) const;
+
+        uint32_t mWidth;
+        uint32_t mHeight;
+        ThreadPool* mThreadPool;
+        SVGFPackedSettings mSettings;
+        SVGFTimings mTimings;
+
+        ReprojectionBuffers mCurrReproj;
+        ReprojectionBuffers mPrevReproj;
+        SignalPlanes mAtrousPing;
+        SignalPlanes mAtrousPong;
+        Image4F mLastFilteredReflection;
+        Image4F mLastFilteredScalar;
+        Image4F mReflectionOutput;
+        Image4F mScalarOutput;
+        Image4F mPrevLinearZ;
+
+        ImageF mNormalX;
+        ImageF mNormalY;
+        ImageF mNormalZ;
+        ImageF mLinearZ;
+        ImageF mZDerivative;
+
+        struct
+        {
+            const Image4F* reflection;
+            const Image4F* shadow;
+            const Image4F* ao;
+            const Image4F* linearZ;
+            const Image4F* motionVec;
+            const Image4F* compactNormalDepth;
+        } mGBufferInput;
+    };
+}
@@ -0,0 +1,198 @@
+#include "SVGFSharedHistory.h"
+#include "FrameProfiler.h"
+#include "SVGFUtils.h"
+#include "Timer.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        const uint32_t kTileSize = 64;
+    }
+
+    SVGFSharedHistory::SVGFSharedHistory(uint32_t width, uint32_t height, ThreadPool* threadPool)
+        : mWidth(width),
+          mHeight(height),
+          mThreadPool(threadPool ? threadPool : &ThreadPool::GetDefault()),
+          mGradientClaims(size_t(GetGradientStrataCount(width)) * GetGradientStrataCount(height))
+    {
+        mCurrHistoryLength.Resize(width, height);
+        mPrevHistoryLength.Resize(width, height);
+        mPrevLinearZ.Resize(width, height);
+        mCurrGradientSamples.Resize(GetGradientStrataCount(width), GetGradientStrataCount(height));
+        mPrevGradientSamples.Resize(GetGradientStrataCount(width), GetGradientStrataCount(height));
+    }
+
+    void SVGFSharedHistory::Reset()
+    {
+        mCurrHistoryLength.Fill(0);
+        mPrevHistoryLength.Fill(0);
+        mPrevLinearZ.Fill(float4());
+        mHasGradientSamples = false;
+    }
+
+    size_t SVGFSharedHistory::GetAllocatedBytes() const
+    {
+        return mCurrHistoryLength.GetSizeInBytes() + mPrevHistoryLength.GetSizeInBytes() + mPrevLinearZ.GetSizeInBytes() +
+            mCurrGradientSamples.GetSizeInBytes() + mPrevGradientSamples.GetSizeInBytes() + mGradientClaims.size() * sizeof(uint32_t);
+    }
+
+    // SVGF_HistoryLength.slang
+    void SVGFSharedHistory::Update(const Image4F& motionVec, const Image4F& linearZ, uint32_t frameCount)
+    {
+        Timer timer;
+        const float2 imageDim = float2(float(mWidth), float(mHeight));
+
+        mThreadPool->ParallelForTiles(mWidth, mHeight, kTileSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t y = tile.y0; y < tile.y1; ++y)
+            {
+                for (uint32_t x = tile.x0; x < tile.x1; ++x)
+                {
+                    const int2 ipos = int2(int(x), int(y));
+                    const float4 motion = motionVec.At(ipos);
+                    const float4 depth = linearZ.At(ipos);
+                    const float3 normal = OctToDir(asuint(depth.w));
+
+                    const float2 offsetPrev = motion.xy() * imageDim;
+                    const int2 iposPrev = int2(int(float(ipos.x) + offsetPrev.x + 0.5f), int(float(ipos.y) + offsetPrev.y + 0.5f));
+                    const float2 posPrev = float2(float(ipos.x), float(ipos.y)) + offsetPrev;
+                    const int2 base = int2(int(posPrev.x), int(posPrev.y));
+
+                    const int2 offset[4] = { int2(0, 0), int2(1, 0), int2(0, 1), int2(1, 1) };
+                    const float fx = frac(posPrev.x);
+                    const float fy = frac(posPrev.y);
+                    const float w[4] = { (1 - fx) * (1 - fy),
+                                              fx  * (1 - fy),
+                                         (1 - fx) *      fy,
+                                              fx  *      fy };
+
+                    // Bilinear taps, valid if they carry enough weight
+                    float sumWeights = 0.0f;
+                    for (int sampleIdx = 0; sampleIdx < 4; ++sampleIdx)
+                    {
+                        const float4 depthPrev = mPrevLinearZ.Load(base + offset[sampleIdx]);
+                        if (IsReprjValid(iposPrev, int2(mWidth, mHeight), depth.z, depthPrev.x, depth.y, normal, OctToDir(asuint(depthPrev.w)), motion.w))
+                        {
+                            sumWeights += w[sampleIdx];
+                        }
+                    }
+                    bool valid = (sumWeights >= 0.01f);
+
+                    // Otherwise any valid sample of the cross-bilateral fallback
+                    for (int yy = -1; yy <= 1 && !valid; ++yy)
+                    {
+                        for (int xx = -1; xx <= 1 && !valid; ++xx)
+                        {
+                            const float4 depthP = mPrevLinearZ.Load(iposPrev + int2(xx, yy));
+                            valid = IsReprjValid(iposPrev, int2(mWidth, mHeight), depth.z, depthP.x, depth.y, normal, OctToDir(asuint(depthP.w)), motion.w);
+                        }
+                    }
+
+                    mCurrHistoryLength.At(ipos) = valid ? uint8_t(std::min(32, mPrevHistoryLength.Load(iposPrev) + 1)) : uint8_t(1);
+                }
+            }
+        });
+
+        mGradientMs = 0.0;
+        if (mEnableTemporalGradients)
+        {
+            FRAME_PROFILE("GradientProjection");
+            Timer gradientTimer;
+            ForwardProjectGradientSamples(motionVec, linearZ);
+            mGradientMs = gradientTimer.GetElapsedMs();
+        }
+        mHasGradientSamples = mEnableTemporalGradients;
+        mGradientFrameCount = frameCount;
+
+        mUpdateMs = timer.GetElapsedMs();
+    }
+
+    // SVGF_GradientProjection.slang
+    void SVGFSharedHistory::ForwardProjectGradientSamples(const Image4F& motionVec, const Image4F& linearZ)
+    {
+        const uint32_t strataWidth = mCurrGradientSamples.GetWidth();
+        const uint32_t strataHeight = mCurrGradientSamples.GetHeight();
+        const float2 imageDim = float2(float(mWidth), float(mHeight));
+
+        for (std::atomic<uint32_t>& claim : mGradientClaims) claim.store(kNoGradientSample, std::memory_order_relaxed);
+
+        // Last frame's sample of every stratum looks for the pixel whose motion leads back to it: p = q - motion(p)
+        // settles in a few steps wherever the motion is smooth. Taken if that pixel reprojects onto the sample exactly
+        // and passes the history's depth and normal test, so it shows the same surface.
+        auto getSample = [&](const int2& stratum)
+        {
+            return GetGradientStratumPixel(stratum, GetGradientSampleOffset(stratum, strataWidth, mGradientFrameCount, mPrevGradientSamples.At(stratum).claim));
+        };
+
+        if (mHasGradientSamples)
+        {
+            mThreadPool->ParallelForTiles(strataWidth, strataHeight, kTileSize / kGradientStratumSize, [&](const TileRect& tile, uint32_t)
+            {
+                for (uint32_t sy = tile.y0; sy < tile.y1; ++sy)
+                {
+                    for (uint32_t sx = tile.x0; sx < tile.x1; ++sx)
+                    {
+                        const int2 prevPixel = getSample(int2(int(sx), int(sy)));
+                        if (!mPrevLinearZ.IsInside(prevPixel.x, prevPixel.y)) continue;
+
+                        int2 ipos = prevPixel;
+                        for (int i = 0; i < 3; ++i)
+                        {
+                            const float2 offset = motionVec.Load(ipos).xy() * imageDim;
+                            ipos = int2(int(std::floor(float(prevPixel.x) - offset.x + 0.5f)), int(std::floor(float(prevPixel.y) - offset.y + 0.5f)));
+                        }
+                        if (!linearZ.IsInside(ipos.x, ipos.y)) continue;
+
+                        const float4 motion = motionVec.At(ipos);
+                        const float2 offsetPrev = motion.xy() * imageDim;
+                        const int2 iposPrev = int2(int(float(ipos.x) + offsetPrev.x + 0.5f), int(float(ipos.y) + offsetPrev.y + 0.5f));
+                        if (iposPrev.x != prevPixel.x || iposPrev.y != prevPixel.y) continue;
+
+                        const float4 depth = linearZ.At(ipos);
+                        const float4 depthPrev = mPrevLinearZ.At(prevPixel);
+                        if (!IsReprjValid(iposPrev, int2(mWidth, mHeight), depth.z, depthPrev.x, depth.y, OctToDir(asuint(depth.w)), OctToDir(asuint(depthPrev.w)), motion.w)) continue;
+
+                        const int2 stratum = int2(ipos.x / kGradientStratumSize, ipos.y / kGradientStratumSize);
+                        const uint32_t offset = uint32_t(ipos.x % kGradientStratumSize + (ipos.y % kGradientStratumSize) * kGradientStratumSize);
+                        const uint32_t claim = PackGradientClaim(sy * strataWidth + sx, offset);
+
+                        std::atomic<uint32_t>& target = mGradientClaims[size_t(stratum.y) * strataWidth + stratum.x];
+                        uint32_t current = target.load(std::memory_order_relaxed);
+                        while (claim < current && !target.compare_exchange_weak(current, claim, std::memory_order_relaxed)) {}
+                    }
+                }
+            });
+        }
+
+        // The winning sample's seed, the one a full scale launch drew for its pixel last frame
+        mThreadPool->ParallelForTiles(strataWidth, strataHeight, kTileSize / kGradientStratumSize, [&](const TileRect& tile, uint32_t)
+        {
+            for (uint32_t sy = tile.y0; sy < tile.y1; ++sy)
+            {
+                for (uint32_t sx = tile.x0; sx < tile.x1; ++sx)
+                {
+                    GradientSample& sample = mCurrGradientSamples.At(int(sx), int(sy));
+                    sample.claim = mGradientClaims[size_t(sy) * strataWidth + sx].load(std::memory_order_relaxed);
+                    sample.seed = 0;
+                    if (sample.claim == kNoGradientSample) continue;
+
+                    const uint32_t prevStratum = sample.claim >> 4;
+                    const int2 prevPixel = getSample(int2(int(prevStratum % strataWidth), int(prevStratum / strataWidth)));
+                    sample.seed = RandInit(uint32_t(prevPixel.y) * mWidth + uint32_t(prevPixel.x), mGradientFrameCount, 16);
+                }
+            }
+        });
+    }
+
+    void SVGFSharedHistory::EndFrame(const Image4F& linearZ)
+    {
+        std::swap(mCurrHistoryLength, mPrevHistoryLength);
+        std::swap(mCurrGradientSamples, mPrevGradientSamples);
+        {
+            FRAME_PROFILE("PrevLinearZBlit");
+            mPrevLinearZ = linearZ;
+        }
+        mFrameIndex++;
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include "Image.h"
+#include "TemporalGradient.h"
+#include "ThreadPool.h"
+
+namespace Cpu
+{
+    // Headless implementation of ::SVGFSharedHistory: previous linear Z and the per-pixel history length
+    // (R8Unorm on the GPU, stored as bytes here), shared by every SVGFPass that uses the compact layout.
+    class SVGFSharedHistory
+    {
+    public:
+        SVGFSharedHistory(uint32_t width, uint32_t height, ThreadPool* threadPool = nullptr);
+
+        // Once per frame before the filters run. frameCount is the frame the ray tracers seed this frame's rays with.
+        void Update(const Image4F& motionVec, const Image4F& linearZ, uint32_t frameCount = 0);
+
+        // Once per frame after the filters ran
+        void EndFrame(const Image4F& linearZ);
+
+        void Reset();
+
+        // A-SVGF, see TemporalGradient.h. Update() forward projects last frame's gradient samples into this frame.
+        // The samples are for ray tracers launched at full scale and for every SVGFPass::Execute() of the frame.
+        void EnableTemporalGradients(bool enable) { mEnableTemporalGradients = enable; }
+        bool AreTemporalGradientsEnabled() const { return mEnableTemporalGradients; }
+        const Image<GradientSample>& GetGradientSamples() const { return mCurrGradientSamples; }
+        uint32_t GetGradientFrameCount() const { return mGradientFrameCount; }
+        double GetGradientMs() const { return mGradientMs; }
+
+        float GetHistoryLength(const int2& p) const { return float(mCurrHistoryLength.At(p)); }
+        const Image4F& GetPrevLinearZ() const { return mPrevLinearZ; }
+        uint64_t GetFrameIndex() const { return mFrameIndex; }
+        double GetUpdateMs() const { return mUpdateMs; }
+        size_t GetAllocatedBytes() const;
+
+    private:
+        void ForwardProjectGradientSamples(const Image4F& motionVec, const Image4F& linearZ);
+
+        uint32_t mWidth;
+        uint32_t mHeight;
+        ThreadPool* mThreadPool;
+
+        Image<uint8_t> mCurrHistoryLength;
+        Image<uint8_t> mPrevHistoryLength;
+        Image4F mPrevLinearZ;
+
+        // Strata claimed by the forward projection, atomically since samples from different tiles land in the same one
+        std::vector<std::atomic<uint32_t>> mGradientClaims;
+        Image<GradientSample> mCurrGradientSamples;
+        Image<GradientSample> mPrevGradientSamples;
+        uint32_t mGradientFrameCount = 0;
+        bool mEnableTemporalGradients = false;
+        bool mHasGradientSamples = false;   // Last frame picked samples
+
+        uint64_t mFrameIndex = 0;
+        double mUpdateMs = 0.0;
+        double mGradientMs = 0.0;
+    };
+}
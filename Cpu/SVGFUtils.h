@@ -0,0 +1,108 @@
+#pragma once
+
+#include "Image.h"
+
+// CPU mirror of Data/SVGFUtils.h. Keep the two in sync.
+namespace Cpu
+{
+    inline float3 OctToDir(uint32_t octo)
+    {
+        const float2 e = float2(f16tof32(octo & 0xFFFF), f16tof32((octo >> 16) & 0xFFFF));
+        float3 v = float3(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+        if (v.z < 0.0f)
+        {
+            const float vx = v.x;
+            v.x = (1.0f - std::fabs(v.y)) * (vx >= 0.0f ? 1.0f : -1.0f);
+            v.y = (1.0f - std::fabs(vx)) * (v.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        return normalize(v);
+    }
+
+    inline uint32_t DirToOct(const float3& normal)
+    {
+        const float invL1 = 1.0f / (std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z));
+        float2 e = float2(normal.x * invL1, normal.y * invL1);
+        if (normal.z <= 0.0f)
+        {
+            const float px = e.x;
+            e.x = (1.0f - std::fabs(e.y)) * (px >= 0.0f ? 1.0f : -1.0f);
+            e.y = (1.0f - std::fabs(px)) * (e.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        return (f32tof16(e.y) << 16) + f32tof16(e.x);
+    }
+
+    struct SVGFSample
+    {
+        float3 signal; float variance;
+        float3 normal; float linearZ;
+        float zDerivative;
+        float luminance;
+    };
+
+    inline SVGFSample FetchSignalSample(const Image4F& signalTexture, const Image4F& ndTexture, int2 ipos)
+    {
+        const float4 signal = signalTexture.Load(ipos);
+        const float4 nd = ndTexture.Load(ipos);
+
+        SVGFSample s;
+        s.signal = signal.rgb();
+        s.variance = signal.w;
+        s.normal = normalize(OctToDir(asuint(nd.x)));
+        s.linearZ = nd.y;
+        s.zDerivative = nd.z;
+        s.luminance = luminance(s.signal);
+        return s;
+    }
+
+    inline float NormalDistanceCos(const float3& n1, const float3& n2, float power)
+    {
+        return std::pow(saturate(dot(n1, n2)), power);
+    }
+
+    inline float ComputeWeight(const SVGFSample& sampleCenter, const SVGFSample& sampleP, float phiDepth, float phiNormal, float phiColor)
+    {
+        const float wNormal = NormalDistanceCos(sampleCenter.normal, sampleP.normal, phiNormal);
+        const float wZ = (phiDepth == 0) ? 0.0f : std::fabs(sampleCenter.linearZ - sampleP.linearZ) / phiDepth;
+        const float wLdirect = std::fabs(sampleCenter.luminance - sampleP.luminance) / phiColor;
+
+        return std::exp(0.0f - std::max(wLdirect, 0.0f) - std::max(wZ, 0.0f)) * wNormal;
+    }
+
+    // Packed (multi-signal) filter helpers, see SVGFPackedPass
+
+    // Scalar signals are weighted like the float3(v, 0, 0) an R8 load gives the single-signal filter, so both modes match
+    inline float ScalarLuminance(float v)
+    {
+        return luminance(float3(v, 0.0f, 0.0f));
+    }
+
+    // Depth and normal part of ComputeWeight, shared by every signal at a tap
+    inline float ComputeGeometryWeight(const float3& normalCenter, float linearZCenter, const float3& normalP, float linearZP, float phiDepth, float phiNormal)
+    {
+        const float wNormal = NormalDistanceCos(normalCenter, normalP, phiNormal);
+        const float wZ = (phiDepth == 0) ? 0.0f : std::fabs(linearZCenter - linearZP) / phiDepth;
+
+        return std::exp(0.0f - std::max(wZ, 0.0f)) * wNormal;
+    }
+
+    inline float ComputeLuminanceWeight(float luminanceCenter, float luminanceP, float phiColor)
+    {
+        return std::exp(0.0f - std::max(std::fabs(luminanceCenter - luminanceP) / phiColor, 0.0f));
+    }
+
+    // Whether last frame's sample at coord can be reused for a pixel: inside the screen, and with depth and normal within
+    // the pixel's screen space derivatives. Shared by every reprojection so the chains agree on what is disoccluded.
+    inline bool IsReprjValid(int2 coord, int2 imageDim, float Z, float Zprev, float zDeriv, const float3& normal, const float3& normalPrev, float normalDeriv)
+    {
+        // check whether reprojected pixel is inside of the screen
+        if (coord.x < 1 || coord.y < 1 || coord.x > imageDim.x - 1 || coord.y > imageDim.y - 1) return false;
+
+        // check if deviation of depths is acceptable
+        if (std::fabs(Zprev - Z) / (zDeriv + 1e-4f) > 2.0f) return false;
+
+        // check normals for compatibility
+        if (distance(normal, normalPrev) / (normalDeriv + 1e-2f) > 16.0f) return false;
+
+        return true;
+    }
+}
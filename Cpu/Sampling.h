@@ -0,0 +1,74 @@
+#pragma once
+
+#include "VectorMath.h"
+
+// CPU mirror of the random number and sampling helpers the ray tracing shaders import from Falcor's Helpers.slang
+namespace Cpu
+{
+    const float kPi = 3.14159265358979323846f;
+
+    // Tiny encryption algorithm based seed, same as rand_init()
+    inline uint32_t RandInit(uint32_t val0, uint32_t val1, uint32_t backoff = 16)
+    {
+        uint32_t v0 = val0, v1 = val1, s0 = 0;
+        for (uint32_t n = 0; n < backoff; n++)
+        {
+            s0 += 0x9e3779b9;
+            v0 += ((v1 << 4) + 0xa341316c) ^ (v1 + s0) ^ ((v1 >> 5) + 0xc8013ea4);
+            v1 += ((v0 << 4) + 0xad90777d) ^ (v0 + s0) ^ ((v0 >> 5) + 0x7e95761e);
+        }
+        return v0;
+    }
+
+    // LCG step returning a float in [0, 1), same as rand_next()
+    inline float RandNext(uint32_t& s)
+    {
+        s = (1664525u * s + 1013904223u);
+        return float(s & 0x00FFFFFF) / float(0x01000000);
+    }
+
+    inline float3 GetPerpendicularStark(const float3& u)
+    {
+        const float3 a = abs(u);
+        const uint32_t xm = ((a.x - a.y) < 0 && (a.x - a.z) < 0) ? 1 : 0;
+        const uint32_t ym = (a.y - a.z) < 0 ? (1 ^ xm) : 0;
+        const uint32_t zm = 1 ^ (xm | ym);
+        return cross(u, float3(float(xm), float(ym), float(zm)));
+    }
+
+    inline float3 GetCosHemisphereSample(float2 u, const float3& N, const float3& T)
+    {
+        const float3 B = normalize(cross(N, T));
+        const float r = std::sqrt(u.x);
+        const float phi = u.y * 2.0f * kPi;
+        const float3 L = float3(r * std::cos(phi), r * std::sin(phi), std::sqrt(std::max(0.0f, 1.0f - u.x)));
+        return normalize(T * L.x + B * L.y + N * L.z);
+    }
+
+    // SampleLightCone() from RaytracedShadows.slang
+    inline float3 SampleLightCone(float2 u, const float3& N, float spread)
+    {
+        const float3 T = GetPerpendicularStark(N);
+        const float3 B = normalize(cross(N, T));
+
+        u.x *= spread;
+
+        const float r = std::sqrt(u.x);
+        const float phi = u.y * 2.0f * kPi;
+        const float3 L = float3(r * std::cos(phi), r * std::sin(phi), std::sqrt(std::max(0.0f, 1.0f - u.x)));
+        return normalize(T * L.x + B * L.y + N * L.z);
+    }
+
+    // GGX half vector sample around N, roughness is alpha (linearRoughness^2)
+    inline float3 GetGGXMicrofacet(float2 u, const float3& N, float roughness)
+    {
+        const float a2 = roughness * roughness;
+        const float cosThetaH = std::sqrt(std::max(0.0f, (1.0f - u.x) / ((a2 - 1.0f) * u.x + 1.0f)));
+        const float sinThetaH = std::sqrt(std::max(0.0f, 1.0f - cosThetaH * cosThetaH));
+        const float phiH = u.y * kPi * 2.0f;
+
+        const float3 T = normalize(GetPerpendicularStark(N));
+        const float3 B = cross(N, T);
+        return normalize(T * (sinThetaH * std::cos(phiH)) + B * (sinThetaH * std::sin(phiH)) + N * cosThetaH);
+    }
+}
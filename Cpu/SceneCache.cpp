@@ -0,0 +1,467 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include "SceneCache.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        const char kMagic[8] = { 'R', 'A', 'Y', 'S', 'S', 'C', 'N', '\0' };
+        const uint32_t kVersion = 2;
+        const uint64_t kSectionAlignment = 64;
+        const uint64_t kFnvPrime = 0x100000001b3ull;
+
+        enum class Section : uint32_t
+        {
+            Positions = 0,
+            Normals,
+            Bitangents,
+            TexCoords,
+            Indices,
+            Meshes,
+            Instances,
+            Materials,
+            Lights,
+            BvhNodes,
+            BvhLeafBlocks,
+            Count
+        };
+
+        const uint32_t kSectionCount = uint32_t(Section::Count);
+
+        struct SectionEntry
+        {
+            uint64_t offset;
+            uint64_t count;
+            uint32_t elementSize;
+            uint32_t reserved;
+        };
+
+        struct FileHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t sectionCount;
+            uint64_t sourceHash;
+            uint32_t bvhDepth;
+            uint32_t reserved;
+            SectionEntry sections[kSectionCount];
+        };
+
+        static_assert(std::is_trivially_copyable<SceneMesh>::value && std::is_trivially_copyable<SceneInstance>::value &&
+            std::is_trivially_copyable<SceneMaterial>::value && std::is_trivially_copyable<SceneLight>::value, "Cached types are written as bytes");
+
+        struct FileCloser
+        {
+            void operator()(FILE* file) const { if (file) fclose(file); }
+        };
+
+        struct SectionData
+        {
+            const void* data;
+            uint64_t count;
+            uint32_t elementSize;
+        };
+
+        template<typename T>
+        SectionData GetSection(const ArrayView<T>& view)
+        {
+            return { view.data, view.count, uint32_t(sizeof(T)) };
+        }
+
+        uint64_t AlignUp(uint64_t value) { return (value + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment; }
+
+        template<typename T>
+        bool MapSection(const MappedFile& file, const FileHeader& header, Section section, ArrayView<T>& view)
+        {
+            const SectionEntry& entry = header.sections[uint32_t(section)];
+            if (entry.elementSize != sizeof(T) || entry.count > UINT32_MAX) return false;
+            if (entry.count == 0)
+            {
+                view = ArrayView<T>();
+                return true;
+            }
+            if (entry.offset % kSectionAlignment != 0 || entry.offset > file.GetSize() || entry.count > (file.GetSize() - entry.offset) / sizeof(T)) return false;
+
+            view = ArrayView<T>(reinterpret_cast<const T*>(file.GetData() + entry.offset), uint32_t(entry.count));
+            return true;
+        }
+
+        bool IsIdentity(const float* m)
+        {
+            for (uint32_t i = 0; i < 16; ++i)
+            {
+                if (m[i] != ((i % 5 == 0) ? 1.0f : 0.0f)) return false;
+            }
+            return true;
+        }
+    }
+
+    void SceneData::Clear()
+    {
+        positions.clear();
+        normals.clear();
+        bitangents.clear();
+        texCoords.clear();
+        indices.clear();
+        meshes.clear();
+        instances.clear();
+        materials.clear();
+        lights.clear();
+    }
+
+    uint32_t SceneData::AddMesh(const float3* meshPositions, const float3* meshNormals, const float3* meshBitangents, const float2* meshTexCoords, uint32_t vertexCount,
+        const uint32_t* meshIndices, uint32_t indexCount, uint32_t materialId, uint32_t modelId)
+    {
+        SceneMesh mesh;
+        mesh.firstVertex = uint32_t(positions.size());
+        mesh.vertexCount = vertexCount;
+        mesh.firstIndex = uint32_t(indices.size());
+        mesh.indexCount = indexCount - indexCount % 3;
+        mesh.materialId = materialId;
+        mesh.modelId = modelId;
+        mesh.boundsMin = vertexCount > 0 ? meshPositions[0] : float3();
+        mesh.boundsMax = mesh.boundsMin;
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            mesh.boundsMin = min(mesh.boundsMin, meshPositions[v]);
+            mesh.boundsMax = max(mesh.boundsMax, meshPositions[v]);
+        }
+
+        positions.insert(positions.end(), meshPositions, meshPositions + vertexCount);
+        if (meshNormals) normals.insert(normals.end(), meshNormals, meshNormals + vertexCount);
+        if (meshBitangents) bitangents.insert(bitangents.end(), meshBitangents, meshBitangents + vertexCount);
+        if (meshTexCoords) texCoords.insert(texCoords.end(), meshTexCoords, meshTexCoords + vertexCount);
+        indices.insert(indices.end(), meshIndices, meshIndices + mesh.indexCount);
+
+        meshes.push_back(mesh);
+        return uint32_t(meshes.size() - 1);
+    }
+
+    SceneView SceneData::GetView() const
+    {
+        SceneView view;
+        view.positions = positions;
+        view.normals = normals;
+        view.bitangents = bitangents;
+        view.texCoords = texCoords;
+        view.indices = indices;
+        view.meshes = meshes;
+        view.instances = instances;
+        view.materials = materials;
+        view.lights = lights;
+        return view;
+    }
+
+    void BuildTriangleScene(const SceneView& view, TriangleScene& scene, ThreadPool* pool, std::atomic<uint32_t>* instancesDone)
+    {
+        scene.Clear();
+        for (const SceneMesh& mesh : view.meshes) scene.AddMaterial(view.materials[mesh.materialId]);
+        for (const SceneLight& light : view.lights) scene.AddLight(light);
+
+        // Every instance gets its range up front, so they can be expanded in any order
+        std::vector<uint32_t> firstVertices(view.instances.count), firstTriangles(view.instances.count);
+        uint32_t vertexCount = 0, triangleCount = 0;
+        for (uint32_t i = 0; i < view.instances.count; ++i)
+        {
+            const SceneMesh& mesh = view.meshes[view.instances[i].meshId];
+            firstVertices[i] = vertexCount;
+            firstTriangles[i] = triangleCount;
+            vertexCount += mesh.vertexCount;
+            triangleCount += mesh.indexCount / 3;
+        }
+        scene.Resize(vertexCount, triangleCount);
+
+        const bool hasNormals = view.normals.count == view.positions.count;
+        const uint32_t threadCount = pool ? pool->GetThreadCount() : 1;
+        std::vector<std::vector<float3>> positions(threadCount), normals(threadCount);
+        auto expand = [&](uint32_t index, uint32_t threadIndex)
+        {
+            const SceneInstance& instance = view.instances[index];
+            const SceneMesh& mesh = view.meshes[instance.meshId];
+            const float3* meshPositions = view.positions.data + mesh.firstVertex;
+            const float3* meshNormals = hasNormals ? view.normals.data + mesh.firstVertex : nullptr;
+            const float* m = instance.transform;
+
+            if (!IsIdentity(m))
+            {
+                // Normals go through the cofactor matrix, the inverse transpose up to scale, flipped for mirroring transforms
+                const float3 a0(m[0], m[1], m[2]), a1(m[4], m[5], m[6]), a2(m[8], m[9], m[10]);
+                const float3 c0 = cross(a1, a2), c1 = cross(a2, a0), c2 = cross(a0, a1);
+                const float normalSign = dot(a0, c0) < 0.0f ? -1.0f : 1.0f;
+
+                std::vector<float3>& worldPositions = positions[threadIndex];
+                worldPositions.resize(mesh.vertexCount);
+                for (uint32_t v = 0; v < mesh.vertexCount; ++v)
+                {
+                    const float3& p = meshPositions[v];
+                    worldPositions[v] = a0 * p.x + a1 * p.y + a2 * p.z + float3(m[12], m[13], m[14]);
+                }
+                meshPositions = worldPositions.data();
+
+                if (meshNormals)
+                {
+                    std::vector<float3>& worldNormals = normals[threadIndex];
+                    worldNormals.resize(mesh.vertexCount);
+                    for (uint32_t v = 0; v < mesh.vertexCount; ++v)
+                    {
+                        const float3& n = meshNormals[v];
+                        const float3 transformed = (c0 * n.x + c1 * n.y + c2 * n.z) * normalSign;
+                        const float len = length(transformed);
+                        worldNormals[v] = len > 0.0f ? transformed / len : transformed;
+                    }
+                    meshNormals = worldNormals.data();
+                }
+            }
+
+            scene.SetTriangles(firstVertices[index], firstTriangles[index], meshPositions, meshNormals, mesh.vertexCount, view.indices.data + mesh.firstIndex,
+                mesh.indexCount, instance.meshId);
+            if (instancesDone) instancesDone->fetch_add(1);
+        };
+
+        if (pool)
+        {
+            pool->ParallelFor(view.instances.count, expand);
+        }
+        else
+        {
+            for (uint32_t i = 0; i < view.instances.count; ++i) expand(i, 0);
+        }
+    }
+
+    uint64_t HashBytes(const void* data, size_t size, uint64_t hash)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, sizeof(word));
+            hash = (hash ^ word) * kFnvPrime;
+        }
+        for (; i < size; ++i) hash = (hash ^ bytes[i]) * kFnvPrime;
+        return hash;
+    }
+
+    uint64_t HashFiles(const std::vector<std::string>& paths, ThreadPool* pool, std::atomic<uint32_t>* filesDone)
+    {
+        std::vector<uint64_t> fileHashes(paths.size());
+        auto hashFile = [&](uint32_t index, uint32_t)
+        {
+            const std::string& path = paths[index];
+            uint64_t hash = HashBytes(path.data(), path.size());
+
+            std::unique_ptr<FILE, FileCloser> file(fopen(path.c_str(), "rb"));
+            if (!file)
+            {
+                const char missing[] = "<missing>";
+                fileHashes[index] = HashBytes(missing, sizeof(missing), hash);
+                if (filesDone) filesDone->fetch_add(1);
+                return;
+            }
+
+            // Chunks are a multiple of 8 bytes, so the hash does not depend on how the file is read
+            const size_t kChunkSize = 1 << 20;
+            std::vector<uint8_t> chunk(kChunkSize);
+            uint64_t fileSize = 0;
+            size_t read = 0;
+            while ((read = fread(chunk.data(), 1, kChunkSize, file.get())) > 0)
+            {
+                hash = HashBytes(chunk.data(), read, hash);
+                fileSize += read;
+            }
+            // Separates the files, otherwise moving bytes from the end of one file to the start of the next keeps the hash
+            fileHashes[index] = HashBytes(&fileSize, sizeof(fileSize), hash);
+            if (filesDone) filesDone->fetch_add(1);
+        };
+
+        if (pool)
+        {
+            pool->ParallelFor(uint32_t(paths.size()), hashFile);
+        }
+        else
+        {
+            for (uint32_t i = 0; i < paths.size(); ++i) hashFile(i, 0);
+        }
+        return HashBytes(fileHashes.data(), fileHashes.size() * sizeof(uint64_t));
+    }
+
+    bool WriteSceneCache(const std::string& path, const SceneView& scene, const Bvh* bvh, uint64_t sourceHash)
+    {
+        SectionData sections[kSectionCount] =
+        {
+            GetSection(scene.positions),
+            GetSection(scene.normals),
+            GetSection(scene.bitangents),
+            GetSection(scene.texCoords),
+            GetSection(scene.indices),
+            GetSection(scene.meshes),
+            GetSection(scene.instances),
+            GetSection(scene.materials),
+            GetSection(scene.lights),
+            { nullptr, 0, uint32_t(Bvh::GetNodeSize()) },
+            { nullptr, 0, uint32_t(Bvh::GetLeafBlockSize()) },
+        };
+        if (bvh && !bvh->IsEmpty())
+        {
+            sections[uint32_t(Section::BvhNodes)].data = bvh->GetNodeData();
+            sections[uint32_t(Section::BvhNodes)].count = bvh->GetNodeCount();
+            sections[uint32_t(Section::BvhLeafBlocks)].data = bvh->GetLeafData();
+            sections[uint32_t(Section::BvhLeafBlocks)].count = bvh->GetLeafBlockCount();
+        }
+
+        FileHeader header = {};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.sectionCount = kSectionCount;
+        header.sourceHash = sourceHash;
+        header.bvhDepth = (bvh && !bvh->IsEmpty()) ? bvh->GetDepth() : 0;
+
+        uint64_t offset = AlignUp(sizeof(FileHeader));
+        for (uint32_t i = 0; i < kSectionCount; ++i)
+        {
+            header.sections[i].offset = sections[i].count > 0 ? offset : 0;
+            header.sections[i].count = sections[i].count;
+            header.sections[i].elementSize = sections[i].elementSize;
+            offset = AlignUp(offset + sections[i].count * sections[i].elementSize);
+        }
+
+        // Written next to the target and renamed, so a reader never maps a half written cache
+        const std::string tempPath = path + ".tmp";
+        {
+            std::unique_ptr<FILE, FileCloser> file(fopen(tempPath.c_str(), "wb"));
+            if (!file) return false;
+
+            const uint8_t padding[kSectionAlignment] = {};
+            uint64_t position = 0;
+            auto write = [&](const void* data, uint64_t size)
+            {
+                position += size;
+                return size == 0 || fwrite(data, 1, size_t(size), file.get()) == size;
+            };
+
+            bool ok = write(&header, sizeof(header));
+            for (uint32_t i = 0; ok && i < kSectionCount; ++i)
+            {
+                if (sections[i].count == 0) continue;
+                ok = write(padding, header.sections[i].offset - position) && write(sections[i].data, sections[i].count * sections[i].elementSize);
+            }
+            if (!ok || fflush(file.get()) != 0)
+            {
+                file.reset();
+                std::remove(tempPath.c_str());
+                return false;
+            }
+        }
+
+        std::remove(path.c_str());
+        if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+        {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    SceneCache::Status SceneCache::Open(const std::string& path, uint64_t sourceHash)
+    {
+        return OpenMapping(path, &sourceHash);
+    }
+
+    SceneCache::Status SceneCache::OpenAnySource(const std::string& path)
+    {
+        return OpenMapping(path, nullptr);
+    }
+
+    SceneCache::Status SceneCache::OpenMapping(const std::string& path, const uint64_t* sourceHash)
+    {
+        Close();
+        if (!mFile.Open(path)) return Status::Missing;
+
+        auto fail = [this](Status status)
+        {
+            Close();
+            return status;
+        };
+
+        if (mFile.GetSize() < sizeof(FileHeader)) return fail(Status::Invalid);
+        FileHeader header;
+        std::memcpy(&header, mFile.GetData(), sizeof(header));
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion || header.sectionCount != kSectionCount) return fail(Status::Invalid);
+
+        SceneView view;
+        const SectionEntry& nodeEntry = header.sections[uint32_t(Section::BvhNodes)];
+        const SectionEntry& leafEntry = header.sections[uint32_t(Section::BvhLeafBlocks)];
+        bool ok = MapSection(mFile, header, Section::Positions, view.positions) &&
+            MapSection(mFile, header, Section::Normals, view.normals) &&
+            MapSection(mFile, header, Section::Bitangents, view.bitangents) &&
+            MapSection(mFile, header, Section::TexCoords, view.texCoords) &&
+            MapSection(mFile, header, Section::Indices, view.indices) &&
+            MapSection(mFile, header, Section::Meshes, view.meshes) &&
+            MapSection(mFile, header, Section::Instances, view.instances) &&
+            MapSection(mFile, header, Section::Materials, view.materials) &&
+            MapSection(mFile, header, Section::Lights, view.lights);
+
+        // BVH sections are checked as bytes, the element types are private to Bvh
+        ok = ok && nodeEntry.elementSize == Bvh::GetNodeSize() && leafEntry.elementSize == Bvh::GetLeafBlockSize();
+        for (const SectionEntry* entry : { &nodeEntry, &leafEntry })
+        {
+            ok = ok && entry->count <= UINT32_MAX && (entry->count == 0 || (entry->offset % kSectionAlignment == 0 && entry->offset <= mFile.GetSize() &&
+                entry->count <= (mFile.GetSize() - entry->offset) / entry->elementSize));
+        }
+        ok = ok && (nodeEntry.count == 0) == (leafEntry.count == 0);
+        if (!ok) return fail(Status::Invalid);
+
+        // Ranges are checked so a damaged cache cannot index out of the mapping, vertex indices are trusted
+        const uint32_t vertexCount = view.positions.count;
+        ok = (view.normals.empty() || view.normals.count == vertexCount) && (view.bitangents.empty() || view.bitangents.count == vertexCount) &&
+            (view.texCoords.empty() || view.texCoords.count == vertexCount);
+        for (const SceneMesh& mesh : view.meshes)
+        {
+            ok = ok && uint64_t(mesh.firstVertex) + mesh.vertexCount <= vertexCount && uint64_t(mesh.firstIndex) + mesh.indexCount <= view.indices.count &&
+                mesh.indexCount % 3 == 0 && mesh.materialId < view.materials.count;
+        }
+        for (const SceneInstance& instance : view.instances) ok = ok && instance.meshId < view.meshes.count;
+        if (!ok) return fail(Status::Invalid);
+
+        if (sourceHash && header.sourceHash != *sourceHash) return fail(Status::Stale);
+
+        mView = view;
+        mBvhNodes = nodeEntry.count > 0 ? mFile.GetData() + nodeEntry.offset : nullptr;
+        mBvhLeafBlocks = leafEntry.count > 0 ? mFile.GetData() + leafEntry.offset : nullptr;
+        mBvhNodeCount = uint32_t(nodeEntry.count);
+        mBvhLeafBlockCount = uint32_t(leafEntry.count);
+        mBvhDepth = header.bvhDepth;
+        return Status::Ok;
+    }
+
+    void SceneCache::Close()
+    {
+        mFile.Close();
+        mView = SceneView();
+        mBvhNodes = nullptr;
+        mBvhLeafBlocks = nullptr;
+        mBvhNodeCount = 0;
+        mBvhLeafBlockCount = 0;
+        mBvhDepth = 0;
+    }
+
+    bool SceneCache::AttachBvh(Bvh& bvh) const
+    {
+        return HasBvh() && bvh.Attach(mBvhNodes, mBvhNodeCount, mBvhLeafBlocks, mBvhLeafBlockCount, mBvhDepth);
+    }
+
+    const char* GetSceneCacheStatusName(SceneCache::Status status)
+    {
+        switch (status)
+        {
+        case SceneCache::Status::Ok: return "ok";
+        case SceneCache::Status::Missing: return "missing";
+        case SceneCache::Status::Invalid: return "invalid";
+        default: return "stale";
+        }
+    }
+}
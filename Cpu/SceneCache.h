@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Bvh.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "TriangleScene.h"
+
+namespace Cpu
+{
+    template<typename T>
+    struct ArrayView
+    {
+        const T* data = nullptr;
+        uint32_t count = 0;
+
+        ArrayView() = default;
+        ArrayView(const T* d, uint32_t c) : data(d), count(c) {}
+        ArrayView(const std::vector<T>& v) : data(v.data()), count(uint32_t(v.size())) {}
+
+        const T& operator[](uint32_t i) const { return data[i]; }
+        const T* begin() const { return data; }
+        const T* end() const { return data + count; }
+        bool empty() const { return count == 0; }
+    };
+
+    // A range of the shared vertex and index arrays. Indices are relative to firstVertex.
+    struct SceneMesh
+    {
+        uint32_t firstVertex = 0;
+        uint32_t vertexCount = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        uint32_t materialId = 0;
+        uint32_t modelId = 0;           // The fscene model the mesh came from
+        float3 boundsMin;               // Object space
+        float3 boundsMax;
+    };
+
+    // A mesh placed in the world, the model instance and mesh instance transforms combined
+    struct SceneInstance
+    {
+        uint32_t meshId = 0;
+        float transform[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };    // Column major, like glm::mat4
+    };
+
+    // Flattened scene: meshes in object space placed by instances, with metal-rough material constants and lights.
+    // Either points into a SceneData or into a mapped SceneCache.
+    struct SceneView
+    {
+        ArrayView<float3> positions;
+        ArrayView<float3> normals;          // Empty or one per position, the same for the two below
+        ArrayView<float3> bitangents;
+        ArrayView<float2> texCoords;
+        ArrayView<uint32_t> indices;
+        ArrayView<SceneMesh> meshes;
+        ArrayView<SceneInstance> instances;
+        ArrayView<SceneMaterial> materials;
+        ArrayView<SceneLight> lights;
+    };
+
+    struct SceneData
+    {
+        std::vector<float3> positions;
+        std::vector<float3> normals;
+        std::vector<float3> bitangents;
+        std::vector<float2> texCoords;
+        std::vector<uint32_t> indices;
+        std::vector<SceneMesh> meshes;
+        std::vector<SceneInstance> instances;
+        std::vector<SceneMaterial> materials;
+        std::vector<SceneLight> lights;
+
+        void Clear();
+
+        // Optional attributes may be null, but have to be given for every mesh or for none
+        uint32_t AddMesh(const float3* meshPositions, const float3* meshNormals, const float3* meshBitangents, const float2* meshTexCoords, uint32_t vertexCount,
+            const uint32_t* meshIndices, uint32_t indexCount, uint32_t materialId, uint32_t modelId = 0);
+
+        SceneView GetView() const;
+    };
+
+    // Expands the instances into a world space TriangleScene, triangles in instance order. Every mesh gets its own
+    // TriangleScene material so meshes sharing a material in the cache can still be re-materialed separately.
+    // With a pool the instances are expanded in parallel, the result is the same. instancesDone counts up as they finish.
+    void BuildTriangleScene(const SceneView& view, TriangleScene& scene, ThreadPool* pool = nullptr, std::atomic<uint32_t>* instancesDone = nullptr);
+
+    // 64 bit FNV-1a, over 8 byte words where it can so hashing keeps up with reading the file
+    uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull);
+    // Paths and contents of every file. A file that cannot be read hashes as missing, so creating it invalidates too.
+    // Files are hashed separately and combined in order, so a pool reads them in parallel.
+    uint64_t HashFiles(const std::vector<std::string>& paths, ThreadPool* pool = nullptr, std::atomic<uint32_t>* filesDone = nullptr);
+
+    // File layout: a header with magic, version, source hash and a table of sections, then the sections, each 64 byte
+    // aligned so the mapping can be used in place. Element sizes are stored per section and checked on load, so a
+    // layout change that forgets to bump the version is still rejected.
+    bool WriteSceneCache(const std::string& path, const SceneView& scene, const Bvh* bvh, uint64_t sourceHash);
+
+    // Zero-copy reader. Open() maps the file and checks the header, section table and mesh ranges; the contents are
+    // used in place and only touched when read.
+    class SceneCache
+    {
+    public:
+        enum class Status
+        {
+            Ok = 0,
+            Missing,        // No cache file
+            Invalid,        // Not a cache, another version, or truncated
+            Stale           // Written for different source files
+        };
+
+        Status Open(const std::string& path, uint64_t sourceHash);
+        // Without the source check, for tools that look at a cache the app wrote
+        Status OpenAnySource(const std::string& path);
+        void Close();
+
+        bool IsOpen() const { return mFile.IsOpen(); }
+        const SceneView& GetView() const { return mView; }
+        size_t GetSizeInBytes() const { return mFile.GetSize(); }
+
+        // The Bvh traverses the mapping and the SceneCache has to outlive it. Triangles are numbered as in BuildTriangleScene().
+        bool HasBvh() const { return mBvhNodeCount > 0; }
+        bool AttachBvh(Bvh& bvh) const;
+
+    private:
+        Status OpenMapping(const std::string& path, const uint64_t* sourceHash);
+
+        MappedFile mFile;
+        SceneView mView;
+        const void* mBvhNodes = nullptr;
+        const void* mBvhLeafBlocks = nullptr;
+        uint32_t mBvhNodeCount = 0;
+        uint32_t mBvhLeafBlockCount = 0;
+        uint32_t mBvhDepth = 0;
+    };
+
+    const char* GetSceneCacheStatusName(SceneCache::Status status);
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include "Brdf.h"
+#include "Bvh.h"
+#include "Image.h"
+#include "TriangleScene.h"
+
+// G-buffer loads and light evaluation shared by the CPU ports of the ray tracing shaders
+namespace Cpu
+{
+    // The G-buffer targets the ray generation shaders load, see GBufferUtils.slang
+    struct RtGBuffer
+    {
+        const Image4F* worldPosition = nullptr;     // gGBuf0, w == 0 where nothing was rasterized
+        const Image4F* normalRoughness = nullptr;   // gGBuf1
+        const Image4F* albedo = nullptr;            // gGBuf2
+        float3 cameraPosition;
+    };
+
+    // The subset of Falcor's ShadingData the shaders read
+    struct ShadingData
+    {
+        float3 posW;
+        float3 V;
+        float3 N;
+        float NdotV;
+        float roughness;
+        float3 diffuse;
+        float3 specular;
+    };
+
+    // LoadGBuffer()
+    inline ShadingData LoadShadingData(const RtGBuffer& gBuffer, const int2& pixel)
+    {
+        const float4 normalRoughness = gBuffer.normalRoughness->At(pixel);
+        const float linearRoughness = std::max(0.08f, normalRoughness.w);
+
+        ShadingData sd;
+        sd.posW = gBuffer.worldPosition->At(pixel).rgb();
+        sd.V = normalize(gBuffer.cameraPosition - sd.posW);
+        sd.N = normalRoughness.rgb();
+        sd.NdotV = std::fabs(dot(sd.V, sd.N));
+        sd.roughness = linearRoughness * linearRoughness;
+        sd.diffuse = gBuffer.albedo->At(pixel).rgb();
+        sd.specular = float3(0.04f);
+        return sd;
+    }
+
+    // prepareShadingData() for a metal-rough material, from the hit record alone
+    inline ShadingData LoadHitShadingData(const TriangleScene& scene, const Ray& ray, const RayHit& hit)
+    {
+        const SceneMaterial& material = scene.GetTriangleMaterial(hit.triangle);
+        const float linearRoughness = std::max(0.08f, material.linearRoughness);
+
+        ShadingData sd;
+        sd.posW = ray.origin + ray.direction * hit.t;
+        sd.V = normalize(ray.origin - sd.posW);
+        sd.N = scene.GetNormal(hit.triangle, hit.u, hit.v);
+        sd.NdotV = std::fabs(dot(sd.V, sd.N));
+        sd.roughness = linearRoughness * linearRoughness;
+        sd.diffuse = material.baseColor * (1.0f - material.metalness);
+        sd.specular = lerp(float3(0.04f), material.baseColor, material.metalness);
+        return sd;
+    }
+
+    // The light sample the shaders trace towards. Mirrors the light.type branches in the ray generation shaders.
+    inline void GetLightDirection(const SceneLight& light, const float3& origin, float3& direction, float& maxT)
+    {
+        if (light.type == SceneLight::Type::Point)
+        {
+            direction = light.position - origin;
+            maxT = length(direction);
+        }
+        else
+        {
+            direction = -light.direction;
+            maxT = 1000.0f;
+        }
+    }
+
+    inline Ray GetShadowRay(const SceneLight& light, const float3& origin)
+    {
+        float3 direction;
+        float maxT;
+        GetLightDirection(light, origin, direction, maxT);
+
+        Ray ray;
+        ray.origin = origin;
+        ray.direction = normalize(direction);
+        ray.tMin = 0.001f;
+        ray.tMax = std::max(0.01f, maxT);
+        return ray;
+    }
+
+    // BRDF * NdotL / pdf of a reflection ray along L, sampled with the GGX half vector H
+    inline float3 GetReflectionWeight(const ShadingData& sd, const float3& H, const float3& L)
+    {
+        const float NdotL = saturate(dot(sd.N, L));
+        const float NdotV = saturate(dot(sd.N, sd.V));
+        const float NdotH = saturate(dot(sd.N, H));
+        const float LdotH = saturate(dot(L, H));
+
+        const float D = EvalGGX(sd.roughness, NdotH) / kPi;
+        const float G = EvalSmithGGX(NdotL, NdotV, sd.roughness);
+        const float3 F = FresnelSchlick(sd.specular, float3(1.0f), std::max(0.0f, LdotH));
+        const float3 brdf = F * (D * G);
+        const float ggxProb = D * NdotH / (4.0f * LdotH);
+
+        return brdf * (NdotL / ggxProb);
+    }
+
+    // evalMaterial() for one light, unshadowed
+    inline float3 EvalLight(const ShadingData& sd, const SceneLight& light)
+    {
+        float3 L, intensity = light.intensity;
+        if (light.type == SceneLight::Type::Point)
+        {
+            const float3 toLight = light.position - sd.posW;
+            const float distanceSquared = std::max(1e-8f, dot(toLight, toLight));
+            L = toLight / std::sqrt(distanceSquared);
+            intensity = intensity / distanceSquared;
+        }
+        else
+        {
+            L = -light.direction;
+        }
+
+        const float NdotL = saturate(dot(sd.N, L));
+        if (NdotL <= 0.0f) return float3();
+
+        const float3 H = normalize(sd.V + L);
+        const float NdotH = saturate(dot(sd.N, H));
+        const float LdotH = saturate(dot(L, H));
+
+        const float3 diffuse = sd.diffuse / kPi;
+        const float D = EvalGGX(sd.roughness, NdotH);
+        const float G = EvalSmithGGX(NdotL, sd.NdotV, sd.roughness);
+        const float3 F = FresnelSchlick(sd.specular, float3(1.0f), LdotH);
+        const float3 specular = F * (D * G / kPi);
+
+        return (diffuse + specular) * intensity * NdotL;
+    }
+}
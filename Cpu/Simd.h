@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#ifndef CPU_SIMD_SSE
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CPU_SIMD_SSE 1
+#else
+#define CPU_SIMD_SSE 0
+#endif
+#endif
+
+#if CPU_SIMD_SSE
+#include <emmintrin.h>
+#endif
+
+namespace Cpu
+{
+    // 4-wide float vector. Lanes map to 4 horizontally adjacent pixels in the filter kernels.
+#if CPU_SIMD_SSE
+    struct SimdFloat
+    {
+        static const int kWidth = 4;
+        __m128 v;
+
+        SimdFloat() : v(_mm_setzero_ps()) {}
+        SimdFloat(__m128 v_) : v(v_) {}
+        SimdFloat(float s) : v(_mm_set1_ps(s)) {}
+
+        static SimdFloat Load(const float* p) { return _mm_loadu_ps(p); }
+        void Store(float* p) const { _mm_storeu_ps(p, v); }
+        float operator[](int i) const { alignas(16) float f[4]; _mm_store_ps(f, v); return f[i]; }
+    };
+
+    struct SimdMask
+    {
+        __m128 v;
+
+        SimdMask() : v(_mm_setzero_ps()) {}
+        SimdMask(__m128 v_) : v(v_) {}
+
+        static SimdMask FromBits(int bits)
+        {
+            return _mm_castsi128_ps(_mm_set_epi32(bits & 8 ? -1 : 0, bits & 4 ? -1 : 0, bits & 2 ? -1 : 0, bits & 1 ? -1 : 0));
+        }
+        int GetBits() const { return _mm_movemask_ps(v); }
+        bool Any() const { return GetBits() != 0; }
+        bool All() const { return GetBits() == 0xF; }
+    };
+
+    inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return _mm_add_ps(a.v, b.v); }
+    inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return _mm_sub_ps(a.v, b.v); }
+    inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return _mm_mul_ps(a.v, b.v); }
+    inline SimdFloat operator/(SimdFloat a, SimdFloat b) { return _mm_div_ps(a.v, b.v); }
+    inline SimdFloat operator-(SimdFloat a) { return _mm_sub_ps(_mm_setzero_ps(), a.v); }
+
+    inline SimdMask operator<(SimdFloat a, SimdFloat b) { return _mm_cmplt_ps(a.v, b.v); }
+    inline SimdMask operator<=(SimdFloat a, SimdFloat b) { return _mm_cmple_ps(a.v, b.v); }
+    inline SimdMask operator>(SimdFloat a, SimdFloat b) { return _mm_cmpgt_ps(a.v, b.v); }
+    inline SimdMask operator>=(SimdFloat a, SimdFloat b) { return _mm_cmpge_ps(a.v, b.v); }
+    inline SimdMask operator==(SimdFloat a, SimdFloat b) { return _mm_cmpeq_ps(a.v, b.v); }
+    inline SimdMask operator&(SimdMask a, SimdMask b) { return _mm_and_ps(a.v, b.v); }
+    inline SimdMask operator|(SimdMask a, SimdMask b) { return _mm_or_ps(a.v, b.v); }
+    inline SimdMask AndNot(SimdMask a, SimdMask b) { return _mm_andnot_ps(b.v, a.v); } // a & ~b
+
+    inline SimdFloat Min(SimdFloat a, SimdFloat b) { return _mm_min_ps(a.v, b.v); }
+    inline SimdFloat Max(SimdFloat a, SimdFloat b) { return _mm_max_ps(a.v, b.v); }
+    inline SimdFloat Abs(SimdFloat a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+    inline SimdFloat Sqrt(SimdFloat a) { return _mm_sqrt_ps(a.v); }
+    inline SimdFloat Select(SimdMask m, SimdFloat a, SimdFloat b) { return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)); }
+    inline SimdFloat Floor(SimdFloat a)
+    {
+        // Valid for |a| < 2^31, which is all the exp range reduction needs
+        const __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f)));
+    }
+
+    // 2^n for integral n in [-126, 127]
+    inline SimdFloat Exp2Int(SimdFloat n)
+    {
+        const __m128i e = _mm_add_epi32(_mm_cvttps_epi32(n.v), _mm_set1_epi32(127));
+        return _mm_castsi128_ps(_mm_slli_epi32(e, 23));
+    }
+
+    // Splits a positive float into mantissa in [0.5, 1) and exponent
+    inline SimdFloat Frexp(SimdFloat a, SimdFloat& exponent)
+    {
+        const __m128i bits = _mm_castps_si128(a.v);
+        exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+        const __m128i mantissa = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F000000));
+        return _mm_castsi128_ps(mantissa);
+    }
+#else
+    struct SimdFloat
+    {
+        static const int kWidth = 4;
+        float v[4];
+
+        SimdFloat() : v{ 0.0f, 0.0f, 0.0f, 0.0f } {}
+        SimdFloat(float s) : v{ s, s, s, s } {}
+
+        static SimdFloat Load(const float* p) { SimdFloat r; for (int i = 0; i < 4; ++i) r.v[i] = p[i]; return r; }
+        void Store(float* p) const { for (int i = 0; i < 4; ++i) p[i] = v[i]; }
+        float operator[](int i) const { return v[i]; }
+    };
+
+    struct SimdMask
+    {
+        bool v[4];
+
+        SimdMask() : v{ false, false, false, false } {}
+
+        static SimdMask FromBits(int bits) { SimdMask m; for (int i = 0; i < 4; ++i) m.v[i] = (bits >> i) & 1; return m; }
+        int GetBits() const { int bits = 0; for (int i = 0; i < 4; ++i) bits |= v[i] ? (1 << i) : 0; return bits; }
+        bool Any() const { return GetBits() != 0; }
+        bool All() const { return GetBits() == 0xF; }
+    };
+
+#define CPU_SIMD_BINARY_OP(RET, NAME, EXPR) \
+    inline RET NAME(SimdFloat a, SimdFloat b) { RET r; for (int i = 0; i < 4; ++i) r.v[i] = EXPR; return r; }
+
+    CPU_SIMD_BINARY_OP(SimdFloat, operator+, a.v[i] + b.v[i])
+    CPU_SIMD_BINARY_OP(SimdFloat, operator-, a.v[i] - b.v[i])
+    CPU_SIMD_BINARY_OP(SimdFloat, operator*, a.v[i] * b.v[i])
+    CPU_SIMD_BINARY_OP(SimdFloat, operator/, a.v[i] / b.v[i])
+    CPU_SIMD_BINARY_OP(SimdMask, operator<, a.v[i] < b.v[i])
+    CPU_SIMD_BINARY_OP(SimdMask, operator<=, a.v[i] <= b.v[i])
+    CPU_SIMD_BINARY_OP(SimdMask, operator>, a.v[i] > b.v[i])
+    CPU_SIMD_BINARY_OP(SimdMask, operator>=, a.v[i] >= b.v[i])
+    CPU_SIMD_BINARY_OP(SimdMask, operator==, a.v[i] == b.v[i])
+    CPU_SIMD_BINARY_OP(SimdFloat, Min, std::min(a.v[i], b.v[i]))
+    CPU_SIMD_BINARY_OP(SimdFloat, Max, std::max(a.v[i], b.v[i]))
+
+#undef CPU_SIMD_BINARY_OP
+
+    inline SimdFloat operator-(SimdFloat a) { return SimdFloat(0.0f) - a; }
+    inline SimdMask operator&(SimdMask a, SimdMask b) { return SimdMask::FromBits(a.GetBits() & b.GetBits()); }
+    inline SimdMask operator|(SimdMask a, SimdMask b) { return SimdMask::FromBits(a.GetBits() | b.GetBits()); }
+    inline SimdMask AndNot(SimdMask a, SimdMask b) { return SimdMask::FromBits(a.GetBits() & ~b.GetBits()); }
+    inline SimdFloat Abs(SimdFloat a) { SimdFloat r; for (int i = 0; i < 4; ++i) r.v[i] = std::fabs(a.v[i]); return r; }
+    inline SimdFloat Sqrt(SimdFloat a) { SimdFloat r; for (int i = 0; i < 4; ++i) r.v[i] = std::sqrt(a.v[i]); return r; }
+    inline SimdFloat Floor(SimdFloat a) { SimdFloat r; for (int i = 0; i < 4; ++i) r.v[i] = std::floor(a.v[i]); return r; }
+    inline SimdFloat Select(SimdMask m, SimdFloat a, SimdFloat b) { SimdFloat r; for (int i = 0; i < 4; ++i) r.v[i] = m.v[i] ? a.v[i] : b.v[i]; return r; }
+    inline SimdFloat Exp2Int(SimdFloat n) { SimdFloat r; for (int i = 0; i < 4; ++i) r.v[i] = std::ldexp(1.0f, int(n.v[i])); return r; }
+    inline SimdFloat Frexp(SimdFloat a, SimdFloat& exponent)
+    {
+        SimdFloat r;
+        for (int i = 0; i < 4; ++i)
+        {
+            int e;
+            r.v[i] = std::frexp(a.v[i], &e);
+            exponent.v[i] = float(e);
+        }
+        return r;
+    }
+#endif
+
+    inline SimdFloat& operator+=(SimdFloat& a, SimdFloat b) { a = a + b; return a; }
+    inline SimdFloat& operator*=(SimdFloat& a, SimdFloat b) { a = a * b; return a; }
+    inline SimdFloat Saturate(SimdFloat a) { return Min(Max(a, 0.0f), 1.0f); }
+    inline SimdFloat Select(SimdMask m, SimdFloat a) { return Select(m, a, 0.0f); }
+
+    // Cephes style polynomial exp, ~1 ulp over the range the filters use
+    inline SimdFloat Exp(SimdFloat x)
+    {
+        x = Min(Max(x, -87.3f), 88.3f);
+
+        const SimdFloat n = Floor(x * 1.44269504088896341f + 0.5f);
+        x = x - n * 0.693359375f;
+        x = x + n * 2.12194440e-4f;
+
+        SimdFloat y = 1.9875691500E-4f;
+        y = y * x + 1.3981999507E-3f;
+        y = y * x + 8.3334519073E-3f;
+        y = y * x + 4.1665795894E-2f;
+        y = y * x + 1.6666665459E-1f;
+        y = y * x + 5.0000001201E-1f;
+        y = y * (x * x) + x + 1.0f;
+
+        return y * Exp2Int(n);
+    }
+
+    // Natural log for positive finite inputs, Cephes style
+    inline SimdFloat Log(SimdFloat x)
+    {
+        SimdFloat e;
+        x = Frexp(x, e);
+
+        const SimdMask small = x < 0.707106781186547524f;
+        e = e - Select(small, 1.0f);
+        x = x + Select(small, x) - 1.0f;
+
+        const SimdFloat z = x * x;
+        SimdFloat y = 7.0376836292E-2f;
+        y = y * x - 1.1514610310E-1f;
+        y = y * x + 1.1676998740E-1f;
+        y = y * x - 1.2420140846E-1f;
+        y = y * x + 1.4249322787E-1f;
+        y = y * x - 1.6668057665E-1f;
+        y = y * x + 2.0000714765E-1f;
+        y = y * x - 2.4999993993E-1f;
+        y = y * x + 3.3333331174E-1f;
+        y = y * x * z;
+
+        y = y + e * -2.12194440e-4f;
+        y = y - z * 0.5f;
+        x = x + y;
+        return x + e * 0.693359375f;
+    }
+
+    // pow(x, p) for x >= 0, returning 0 for x == 0 like the shader's pow(saturate(...), p)
+    inline SimdFloat Pow(SimdFloat x, SimdFloat p)
+    {
+        const SimdMask positive = x > 0.0f;
+        return Select(positive, Exp(p * Log(Select(positive, x, 1.0f))));
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Image.h"
+#include "Simd.h"
+
+// Quad (4 horizontally adjacent pixel) access to float planes with Texture2D.Load semantics at the borders
+namespace Cpu
+{
+    inline SimdFloat LoadQuad(const ImageF& plane, int x, int y)
+    {
+        if (y < 0 || y >= int(plane.GetHeight())) return SimdFloat(0.0f);
+        if (x >= 0 && x + 4 <= int(plane.GetWidth())) return SimdFloat::Load(plane.GetRow(y) + x);
+
+        float v[4];
+        for (int i = 0; i < 4; ++i) v[i] = plane.Load(x + i, y);
+        return SimdFloat::Load(v);
+    }
+
+    inline SimdMask InsideQuad(int x, int y, uint32_t width, uint32_t height)
+    {
+        if (y < 0 || y >= int(height)) return SimdMask();
+
+        int bits = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            if (x + i >= 0 && x + i < int(width)) bits |= 1 << i;
+        }
+        return SimdMask::FromBits(bits);
+    }
+
+    inline void StoreQuad(ImageF& plane, int x, int y, SimdFloat value, int laneCount)
+    {
+        float* row = plane.GetRow(y) + x;
+        if (laneCount == 4)
+        {
+            value.Store(row);
+            return;
+        }
+
+        float v[4];
+        value.Store(v);
+        for (int i = 0; i < laneCount; ++i) row[i] = v[i];
+    }
+
+    inline SimdFloat Luminance(SimdFloat r, SimdFloat g, SimdFloat b)
+    {
+        return r * 0.2126f + g * 0.7152f + b * 0.0722f;
+    }
+}
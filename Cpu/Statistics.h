@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "JsonWriter.h"
+
+namespace Cpu
+{
+    struct SampleStats
+    {
+        uint32_t count = 0;
+        double mean = 0.0;
+        double min = 0.0;
+        double max = 0.0;
+        double p50 = 0.0;
+        double p90 = 0.0;
+        double p99 = 0.0;
+    };
+
+    // Nearest-rank percentile of already sorted samples, p in [0, 100]
+    inline double PercentileSorted(const std::vector<double>& sorted, double p)
+    {
+        if (sorted.empty()) return 0.0;
+        const size_t rank = size_t(std::ceil(p / 100.0 * double(sorted.size())));
+        return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+    }
+
+    inline double Percentile(std::vector<double> samples, double p)
+    {
+        std::sort(samples.begin(), samples.end());
+        return PercentileSorted(samples, p);
+    }
+
+    inline SampleStats ComputeStats(const std::vector<double>& samples)
+    {
+        SampleStats stats;
+        if (samples.empty()) return stats;
+
+        std::vector<double> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+
+        double sum = 0.0;
+        for (double s : sorted) sum += s;
+
+        stats.count = uint32_t(sorted.size());
+        stats.mean = sum / double(sorted.size());
+        stats.min = sorted.front();
+        stats.max = sorted.back();
+        stats.p50 = PercentileSorted(sorted, 50.0);
+        stats.p90 = PercentileSorted(sorted, 90.0);
+        stats.p99 = PercentileSorted(sorted, 99.0);
+        return stats;
+    }
+
+    inline void WriteStats(JsonWriter& json, const std::string& key, const SampleStats& stats)
+    {
+        json.Key(key).BeginObject();
+        json.Field("mean", stats.mean);
+        json.Field("min", stats.min);
+        json.Field("max", stats.max);
+        json.Field("p50", stats.p50);
+        json.Field("p90", stats.p90);
+        json.Field("p99", stats.p99);
+        json.EndObject();
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include "Image.h"
+#include "Sampling.h"
+
+// CPU mirror of Data/TemporalGradient.h. Keep the two in sync.
+//
+// A-SVGF temporal gradients (Schied 18). The screen is split into 3x3 strata and every frame one pixel per stratum is
+// picked to be shaded again next frame. SVGFSharedHistory forward projects the picked pixels into the next frame,
+// where the ray tracers trace the pixel a sample lands on with the seed the sample was traced with. Each SVGFPass then
+// compares the two shades: with the same random numbers on the same surface they only differ where the signal changed.
+namespace Cpu
+{
+    const int kGradientStratumSize = 3;
+    const uint32_t kNoGradientSample = ~0u;
+
+    // Entry of SVGFSharedHistory::GetGradientSamples(), one per stratum of this frame
+    struct GradientSample
+    {
+        // Last frame's stratum whose sample landed in this one << 4 | the pixel inside this stratum, x + 3 * y.
+        // The lowest claim wins when several land in the same stratum.
+        uint32_t claim = kNoGradientSample;
+        uint32_t seed = 0;  // The seed the sample was traced with last frame
+    };
+
+    inline uint32_t GetGradientStrataCount(uint32_t size)
+    {
+        return (size + kGradientStratumSize - 1) / kGradientStratumSize;
+    }
+
+    inline int2 GetGradientStratumPixel(const int2& stratum, uint32_t offset)
+    {
+        return int2(stratum.x * kGradientStratumSize + int(offset % 3), stratum.y * kGradientStratumSize + int(offset / 3));
+    }
+
+    inline uint32_t PackGradientClaim(uint32_t prevStratumIndex, uint32_t offset)
+    {
+        return (prevStratumIndex << 4) | offset;
+    }
+
+    // The pixel of a stratum that frame frameCount picks to be shaded again. Never the pixel that re-shaded last
+    // frame's sample (claim), that one was not traced with its own seed.
+    inline uint32_t GetGradientSampleOffset(const int2& stratum, uint32_t strataWidth, uint32_t frameCount, uint32_t claim)
+    {
+        uint32_t offset = RandInit(uint32_t(stratum.y) * strataWidth + uint32_t(stratum.x), frameCount, 8) % 9;
+        if (claim != kNoGradientSample && offset == (claim & 0xF)) offset = (offset + 1) % 9;
+        return offset;
+    }
+
+    // The seed a launch at full ray scale draws for the pixel, overridden where a gradient sample landed
+    inline uint32_t GetGradientSeed(const Image<GradientSample>& samples, const int2& pixel, uint32_t seed)
+    {
+        const GradientSample& sample = samples.At(pixel.x / kGradientStratumSize, pixel.y / kGradientStratumSize);
+        const uint32_t offset = uint32_t(pixel.x % kGradientStratumSize + (pixel.y % kGradientStratumSize) * kGradientStratumSize);
+        return (sample.claim != kNoGradientSample && (sample.claim & 0xF) == offset) ? sample.seed : seed;
+    }
+
+    // How much of the history to drop for a filtered gradient (change, normalization, whether any sample contributed)
+    inline float GetGradientLambda(const float4& gradient)
+    {
+        return gradient.z > 0.0f ? saturate(std::fabs(gradient.x) / std::max(gradient.y, 1e-4f)) : 0.0f;
+    }
+
+    // History length the filter keeps after dropping lambda of it
+    inline float GetGradientHistoryLength(float historyLength, float lambda)
+    {
+        return std::max(1.0f, historyLength * (1.0f - lambda));
+    }
+}
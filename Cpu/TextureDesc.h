@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Cpu
+{
+    // What a texture needs to be, without API types: format and bindFlags are the opaque Falcor enum values.
+    // Textures with equal descs are interchangeable, which is what pooling and aliasing go by.
+    struct TextureDesc
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t format = 0;
+        uint32_t bindFlags = 0;
+        uint32_t bytesPerPixel = 0;
+
+        uint64_t GetSizeInBytes() const { return uint64_t(width) * height * bytesPerPixel; }
+
+        bool operator==(const TextureDesc& other) const
+        {
+            return width == other.width && height == other.height && format == other.format &&
+                bindFlags == other.bindFlags && bytesPerPixel == other.bytesPerPixel;
+        }
+
+        bool operator!=(const TextureDesc& other) const { return !(*this == other); }
+    };
+}
@@ -0,0 +1,185 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace Cpu
+{
+    namespace
+    {
+        // A share of ParallelForStealing, [begin, end) in one word so that its owner and a thief never both take an index
+        uint64_t PackRange(uint32_t begin, uint32_t end) { return uint64_t(begin) | (uint64_t(end) << 32); }
+        uint32_t GetRangeBegin(uint64_t range) { return uint32_t(range); }
+        uint32_t GetRangeEnd(uint64_t range) { return uint32_t(range >> 32); }
+    }
+
+    ThreadPool::ThreadPool(uint32_t threadCount)
+        : mNextIndex(0)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        for (uint32_t i = 1; i < threadCount; ++i)
+        {
+            mWorkers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mShutdown = true;
+        }
+        mWakeCondition.notify_all();
+
+        for (auto& worker : mWorkers)
+        {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::ParallelFor(uint32_t count, const Task& fn)
+    {
+        if (count == 0) return;
+
+        if (mWorkers.empty() || count == 1)
+        {
+            for (uint32_t i = 0; i < count; ++i) fn(i, 0);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mTask = &fn;
+            mTaskCount = count;
+            mNextIndex = 0;
+            mActiveWorkers = uint32_t(mWorkers.size());
+            mGeneration++;
+        }
+        mWakeCondition.notify_all();
+
+        RunTasks(0);
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDoneCondition.wait(lock, [this] { return mActiveWorkers == 0; });
+        mTask = nullptr;
+    }
+
+    void ThreadPool::ParallelForTiles(uint32_t width, uint32_t height, uint32_t tileSize, const std::function<void(const TileRect& tile, uint32_t threadIndex)>& fn)
+    {
+        const uint32_t tilesX = (width + tileSize - 1) / tileSize;
+        const uint32_t tilesY = (height + tileSize - 1) / tileSize;
+
+        ParallelFor(tilesX * tilesY, [&](uint32_t index, uint32_t threadIndex)
+        {
+            TileRect tile;
+            tile.x0 = (index % tilesX) * tileSize;
+            tile.y0 = (index / tilesX) * tileSize;
+            tile.x1 = std::min(tile.x0 + tileSize, width);
+            tile.y1 = std::min(tile.y0 + tileSize, height);
+            fn(tile, threadIndex);
+        });
+    }
+
+    uint32_t ThreadPool::ParallelForStealing(uint32_t count, uint32_t grainSize, const RangeTask& fn)
+    {
+        grainSize = std::max(1u, grainSize);
+        const uint32_t shareCount = GetThreadCount();
+        if (shareCount == 1 || count <= grainSize)
+        {
+            for (uint32_t begin = 0; begin < count; begin += grainSize) fn(begin, std::min(begin + grainSize, count), 0);
+            return 0;
+        }
+
+        std::vector<std::atomic<uint64_t>> shares(shareCount);
+        for (uint32_t i = 0; i < shareCount; ++i)
+        {
+            shares[i].store(PackRange(uint32_t(uint64_t(count) * i / shareCount), uint32_t(uint64_t(count) * (i + 1) / shareCount)));
+        }
+
+        std::atomic<uint32_t> steals(0);
+        ParallelFor(shareCount, [&](uint32_t share, uint32_t threadIndex)
+        {
+            while (true)
+            {
+                uint64_t range = shares[share].load();
+                const uint32_t begin = GetRangeBegin(range);
+                const uint32_t end = GetRangeEnd(range);
+                if (begin < end)
+                {
+                    const uint32_t next = std::min(begin + grainSize, end);
+                    if (shares[share].compare_exchange_weak(range, PackRange(next, end))) fn(begin, next, threadIndex);
+                    continue;
+                }
+
+                // A last range is left to its owner, which is running or yet to start
+                uint32_t victim = shareCount;
+                uint32_t victimSize = grainSize;
+                for (uint32_t i = 0; i < shareCount; ++i)
+                {
+                    const uint64_t other = shares[i].load();
+                    const uint32_t size = GetRangeEnd(other) - std::min(GetRangeBegin(other), GetRangeEnd(other));
+                    if (size > victimSize)
+                    {
+                        victim = i;
+                        victimSize = size;
+                    }
+                }
+                if (victim == shareCount) break;
+
+                uint64_t other = shares[victim].load();
+                const uint32_t otherBegin = GetRangeBegin(other);
+                const uint32_t otherEnd = GetRangeEnd(other);
+                if (otherBegin >= otherEnd || otherEnd - otherBegin <= grainSize) continue;
+                const uint32_t middle = otherEnd - (otherEnd - otherBegin) / 2;
+                if (shares[victim].compare_exchange_strong(other, PackRange(otherBegin, middle)))
+                {
+                    // Nobody steals from an empty share, so nobody else writes this one
+                    shares[share].store(PackRange(middle, otherEnd));
+                    steals++;
+                }
+            }
+        });
+        return steals.load();
+    }
+
+    ThreadPool& ThreadPool::GetDefault()
+    {
+        static ThreadPool sPool;
+        return sPool;
+    }
+
+    void ThreadPool::WorkerLoop(uint32_t threadIndex)
+    {
+        uint64_t seenGeneration = 0;
+
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mWakeCondition.wait(lock, [&] { return mShutdown || mGeneration != seenGeneration; });
+                if (mShutdown) return;
+                seenGeneration = mGeneration;
+            }
+
+            RunTasks(threadIndex);
+
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (--mActiveWorkers == 0)
+            {
+                mDoneCondition.notify_one();
+            }
+        }
+    }
+
+    void ThreadPool::RunTasks(uint32_t threadIndex)
+    {
+        while (true)
+        {
+            const uint32_t index = mNextIndex.fetch_add(1);
+            if (index >= mTaskCount) break;
+            (*mTask)(index, threadIndex);
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Cpu
+{
+    struct TileRect
+    {
+        uint32_t x0, y0, x1, y1; // [x0, x1) x [y0, y1)
+    };
+
+    // Persistent worker pool. ParallelFor hands out indices through an atomic counter, so uneven tiles balance themselves.
+    class ThreadPool
+    {
+    public:
+        using Task = std::function<void(uint32_t index, uint32_t threadIndex)>;
+        using RangeTask = std::function<void(uint32_t begin, uint32_t end, uint32_t threadIndex)>;
+
+        // threadCount == 0 uses every hardware thread. The calling thread counts as one of them.
+        explicit ThreadPool(uint32_t threadCount = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        uint32_t GetThreadCount() const { return uint32_t(mWorkers.size()) + 1; }
+
+        // Blocks until fn has run for every index in [0, count)
+        void ParallelFor(uint32_t count, const Task& fn);
+
+        // Splits the image into tileSize^2 tiles and runs fn for each
+        void ParallelForTiles(uint32_t width, uint32_t height, uint32_t tileSize, const std::function<void(const TileRect& tile, uint32_t threadIndex)>& fn);
+
+        // Blocks until fn has run over all of [0, count), in ranges of up to grainSize. Every thread starts on its own
+        // contiguous share and takes ranges from its front; a thread that runs dry steals the back half of the largest
+        // share left. Work stays with the thread it was given to until it has to move, unlike ParallelFor's shared
+        // counter. Returns the number of steals.
+        uint32_t ParallelForStealing(uint32_t count, uint32_t grainSize, const RangeTask& fn);
+
+        static ThreadPool& GetDefault();
+
+    private:
+        void WorkerLoop(uint32_t threadIndex);
+        void RunTasks(uint32_t threadIndex);
+
+        std::vector<std::thread> mWorkers;
+        std::mutex mMutex;
+        std::condition_variable mWakeCondition;
+        std::condition_variable mDoneCondition;
+
+        const Task* mTask = nullptr;
+        uint32_t mTaskCount = 0;
+        uint64_t mGeneration = 0;
+        uint32_t mActiveWorkers = 0;
+        bool mShutdown = false;
+        std::atomic<uint32_t> mNextIndex;
+    };
+}
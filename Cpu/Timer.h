@@ -0,0 +1,22 @@
+#pragma once
+
+#include <chrono>
+
+namespace Cpu
+{
+    class Timer
+    {
+    public:
+        Timer() { Reset(); }
+
+        void Reset() { mStart = std::chrono::high_resolution_clock::now(); }
+
+        double GetElapsedMs() const
+        {
+            return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - mStart).count();
+        }
+
+    private:
+        std::chrono::high_resolution_clock::time_point mStart;
+    };
+}
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include "TriangleScene.h"
+
+namespace Cpu
+{
+    void TriangleScene::Clear()
+    {
+        mPositions.clear();
+        mNormals.clear();
+        mIndices.clear();
+        mTriangleMaterials.clear();
+        mMaterials.clear();
+        mLights.clear();
+    }
+
+    uint32_t TriangleScene::AddMaterial(const SceneMaterial& material)
+    {
+        mMaterials.push_back(material);
+        return uint32_t(mMaterials.size() - 1);
+    }
+
+    void TriangleScene::AddTriangles(const float3* positions, const float3* normals, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, uint32_t materialId)
+    {
+        const uint32_t firstVertex = GetVertexCount();
+        const uint32_t firstTriangle = GetTriangleCount();
+        Resize(firstVertex + vertexCount, firstTriangle + indexCount / 3);
+        SetTriangles(firstVertex, firstTriangle, positions, normals, vertexCount, indices, indexCount, materialId);
+    }
+
+    void TriangleScene::Resize(uint32_t vertexCount, uint32_t triangleCount)
+    {
+        mPositions.resize(vertexCount);
+        mNormals.resize(vertexCount);
+        mIndices.resize(size_t(triangleCount) * 3);
+        mTriangleMaterials.resize(triangleCount);
+    }
+
+    void TriangleScene::SetTriangles(uint32_t firstVertex, uint32_t firstTriangle, const float3* positions, const float3* normals, uint32_t vertexCount,
+        const uint32_t* indices, uint32_t indexCount, uint32_t materialId)
+    {
+        std::copy(positions, positions + vertexCount, mPositions.begin() + firstVertex);
+
+        if (normals)
+        {
+            std::copy(normals, normals + vertexCount, mNormals.begin() + firstVertex);
+        }
+        else
+        {
+            // Accumulated face normals, which gives flat shading for unshared vertices
+            std::fill(mNormals.begin() + firstVertex, mNormals.begin() + firstVertex + vertexCount, float3());
+            for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+            {
+                const float3& p0 = positions[indices[i]];
+                const float3 faceNormal = cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+                for (uint32_t c = 0; c < 3; ++c) mNormals[firstVertex + indices[i + c]] += faceNormal;
+            }
+            for (uint32_t v = firstVertex; v < firstVertex + vertexCount; ++v)
+            {
+                const float len = length(mNormals[v]);
+                mNormals[v] = (len > 0.0f) ? mNormals[v] / len : float3(0.0f, 1.0f, 0.0f);
+            }
+        }
+
+        uint32_t* triangleIndices = &mIndices[size_t(firstTriangle) * 3];
+        for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+        {
+            for (uint32_t c = 0; c < 3; ++c) *triangleIndices++ = firstVertex + indices[i + c];
+            mTriangleMaterials[firstTriangle + i / 3] = materialId;
+        }
+    }
+
+    float3 TriangleScene::GetNormal(uint32_t triangle, float u, float v) const
+    {
+        const uint32_t* index = &mIndices[triangle * 3];
+        const float3 n = mNormals[index[0]] * (1.0f - u - v) + mNormals[index[1]] * u + mNormals[index[2]] * v;
+        const float len = length(n);
+        return (len > 0.0f) ? n / len : n;
+    }
+
+    size_t TriangleScene::GetSizeInBytes() const
+    {
+        return (mPositions.size() + mNormals.size()) * sizeof(float3) + (mIndices.size() + mTriangleMaterials.size()) * sizeof(uint32_t) +
+            mMaterials.size() * sizeof(SceneMaterial) + mLights.size() * sizeof(SceneLight);
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "VectorMath.h"
+
+namespace Cpu
+{
+    // Metal-rough material, the same parameters Falcor's prepareShadingData reads
+    struct SceneMaterial
+    {
+        float3 baseColor = float3(1.0f);
+        float linearRoughness = 0.5f;
+        float metalness = 0.0f;
+    };
+
+    // Mirrors the LightData fields the ray tracing shaders read
+    struct SceneLight
+    {
+        enum class Type : uint32_t
+        {
+            Point = 0,
+            Directional
+        };
+
+        Type type = Type::Directional;
+        float3 position;
+        float3 direction;   // Direction the light travels, i.e. LightData::dirW
+        float3 intensity = float3(1.0f);
+    };
+
+    // World space triangle soup with per-vertex normals and per-triangle materials. The CPU counterpart of the
+    // geometry an RtScene puts into its acceleration structure. Has no API dependencies.
+    class TriangleScene
+    {
+    public:
+        void Clear();
+
+        uint32_t AddMaterial(const SceneMaterial& material);
+        void SetMaterial(uint32_t materialId, const SceneMaterial& material) { mMaterials[materialId] = material; }
+
+        // Positions and normals are already in world space. Without normals the face normal is used.
+        void AddTriangles(const float3* positions, const float3* normals, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, uint32_t materialId);
+
+        // Sizes the scene up front so SetTriangles() can fill disjoint ranges from several threads
+        void Resize(uint32_t vertexCount, uint32_t triangleCount);
+        // AddTriangles() into [firstVertex, firstVertex + vertexCount) and [firstTriangle, firstTriangle + indexCount / 3)
+        void SetTriangles(uint32_t firstVertex, uint32_t firstTriangle, const float3* positions, const float3* normals, uint32_t vertexCount,
+            const uint32_t* indices, uint32_t indexCount, uint32_t materialId);
+
+        void AddLight(const SceneLight& light) { mLights.push_back(light); }
+        void SetLight(uint32_t index, const SceneLight& light) { mLights[index] = light; }
+
+        uint32_t GetTriangleCount() const { return uint32_t(mTriangleMaterials.size()); }
+        uint32_t GetVertexCount() const { return uint32_t(mPositions.size()); }
+        uint32_t GetMaterialCount() const { return uint32_t(mMaterials.size()); }
+        uint32_t GetLightCount() const { return uint32_t(mLights.size()); }
+
+        float3 GetVertex(uint32_t triangle, uint32_t corner) const { return mPositions[mIndices[triangle * 3 + corner]]; }
+
+        // Interpolated shading normal at barycentrics (u, v), i.e. weights (1 - u - v, u, v)
+        float3 GetNormal(uint32_t triangle, float u, float v) const;
+
+        const SceneMaterial& GetTriangleMaterial(uint32_t triangle) const { return mMaterials[mTriangleMaterials[triangle]]; }
+        const SceneMaterial& GetMaterial(uint32_t materialId) const { return mMaterials[materialId]; }
+        const SceneLight& GetLight(uint32_t index) const { return mLights[index]; }
+
+        size_t GetSizeInBytes() const;
+
+    private:
+        std::vector<float3> mPositions;
+        std::vector<float3> mNormals;
+        std::vector<uint32_t> mIndices;
+        std::vector<uint32_t> mTriangleMaterials;
+        std::vector<SceneMaterial> mMaterials;
+        std::vector<SceneLight> mLights;
+    };
+}
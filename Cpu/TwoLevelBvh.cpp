@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "Timer.h"
+#include "TwoLevelBvh.h"
+
+namespace Cpu
+{
+    namespace
+    {
+        // Meshes below this are built one per task, larger ones one after another with the whole pool
+        const uint32_t kSmallMeshTriangles = 1 << 14;
+        const uint32_t kMaxInstancesPerLeaf = 2;
+        const uint32_t kTopStackSize = 64;
+        const float kBoxTFarScale = 1.0000004f; // Same conservative box test as Bvh, see Bvh.cpp
+
+        bool IntersectBox(const float3& origin, const float3& invDir, const float3& boxMin, const float3& boxMax, float tMin, float tMax, float& tNear)
+        {
+            const float3 t0 = (boxMin - origin) * invDir;
+            const float3 t1 = (boxMax - origin) * invDir;
+            const float3 tSmall = min(t0, t1), tLarge = max(t0, t1);
+            tNear = std::max(std::max(tSmall.x, tSmall.y), std::max(tSmall.z, tMin));
+            const float tFar = std::min(std::min(std::min(tLarge.x, tLarge.y), tLarge.z) * kBoxTFarScale, tMax);
+            return tNear <= tFar;
+        }
+    }
+
+    void TwoLevelBvh::Build(const SceneView& view, const BvhBuildSettings& settings, ThreadPool* pool)
+    {
+        Timer timer;
+        if (pool && pool->GetThreadCount() == 1) pool = nullptr;
+
+        mMeshBvhs.clear();
+        mMeshBvhs.resize(view.meshes.count);
+        const bool hasNormals = view.normals.count == view.positions.count;
+        auto buildMesh = [&](uint32_t meshId, ThreadPool* meshPool)
+        {
+            const SceneMesh& mesh = view.meshes[meshId];
+            TriangleScene meshScene;
+            meshScene.Resize(mesh.vertexCount, mesh.indexCount / 3);
+            meshScene.SetTriangles(0, 0, view.positions.data + mesh.firstVertex, hasNormals ? view.normals.data + mesh.firstVertex : nullptr, mesh.vertexCount,
+                view.indices.data + mesh.firstIndex, mesh.indexCount, 0);
+            mMeshBvhs[meshId].Build(meshScene, settings, meshPool);
+        };
+
+        std::vector<uint32_t> smallMeshes;
+        for (uint32_t m = 0; m < view.meshes.count; ++m)
+        {
+            if (pool && view.meshes[m].indexCount / 3 < kSmallMeshTriangles) smallMeshes.push_back(m);
+            else buildMesh(m, pool);
+        }
+        if (!smallMeshes.empty()) pool->ParallelFor(uint32_t(smallMeshes.size()), [&](uint32_t i, uint32_t) { buildMesh(smallMeshes[i], nullptr); });
+
+        mInstances.resize(view.instances.count);
+        mTriangleCount = 0;
+        for (uint32_t i = 0; i < view.instances.count; ++i)
+        {
+            Instance& instance = mInstances[i];
+            instance.meshId = view.instances[i].meshId;
+            instance.firstTriangle = mTriangleCount;
+            mTriangleCount += view.meshes[instance.meshId].indexCount / 3;
+            SetTransform(i, view.instances[i].transform);
+        }
+
+        RebuildTopLevel();
+        mBuildMs = float(timer.GetElapsedMs());
+    }
+
+    void TwoLevelBvh::SetTransform(uint32_t index, const float transform[16])
+    {
+        Instance& instance = mInstances[index];
+        const float* m = transform;
+        instance.axes[0] = float3(m[0], m[1], m[2]);
+        instance.axes[1] = float3(m[4], m[5], m[6]);
+        instance.axes[2] = float3(m[8], m[9], m[10]);
+        instance.translation = float3(m[12], m[13], m[14]);
+
+        // The rows of the inverse are the cofactor columns over the determinant
+        const float3 c0 = cross(instance.axes[1], instance.axes[2]);
+        const float3 c1 = cross(instance.axes[2], instance.axes[0]);
+        const float3 c2 = cross(instance.axes[0], instance.axes[1]);
+        const float det = dot(instance.axes[0], c0);
+        const float invDet = det != 0.0f ? 1.0f / det : 0.0f;
+        instance.inverseRows[0] = c0 * invDet;
+        instance.inverseRows[1] = c1 * invDet;
+        instance.inverseRows[2] = c2 * invDet;
+        const float3& t = instance.translation;
+        instance.inverseTranslation = -float3(dot(instance.inverseRows[0], t), dot(instance.inverseRows[1], t), dot(instance.inverseRows[2], t));
+    }
+
+    void TwoLevelBvh::UpdateInstanceBounds(Instance& instance) const
+    {
+        float3 meshMin, meshMax;
+        mMeshBvhs[instance.meshId].GetBounds(meshMin, meshMax);
+        instance.boundsMin = float3(std::numeric_limits<float>::max());
+        instance.boundsMax = float3(-std::numeric_limits<float>::max());
+        if (meshMin.x > meshMax.x) return;
+
+        for (uint32_t corner = 0; corner < 8; ++corner)
+        {
+            const float3 p((corner & 1) ? meshMax.x : meshMin.x, (corner & 2) ? meshMax.y : meshMin.y, (corner & 4) ? meshMax.z : meshMin.z);
+            const float3 world = instance.axes[0] * p.x + instance.axes[1] * p.y + instance.axes[2] * p.z + instance.translation;
+            instance.boundsMin = min(instance.boundsMin, world);
+            instance.boundsMax = max(instance.boundsMax, world);
+        }
+    }
+
+    void TwoLevelBvh::RebuildTopLevel()
+    {
+        for (Instance& instance : mInstances) UpdateInstanceBounds(instance);
+        mInstanceOrder.resize(mInstances.size());
+        for (uint32_t i = 0; i < mInstanceOrder.size(); ++i) mInstanceOrder[i] = i;
+
+        mTopNodes.clear();
+        if (mInstances.empty()) return;
+        mTopNodes.reserve(mInstances.size() * 2);
+        mTopNodes.emplace_back();
+        BuildTopLevel(0, 0, uint32_t(mInstances.size()));
+    }
+
+    void TwoLevelBvh::BuildTopLevel(uint32_t nodeIndex, uint32_t begin, uint32_t end)
+    {
+        // Median split on the widest axis of the centroids, there are few instances and they move
+        float3 boundsMin(std::numeric_limits<float>::max()), boundsMax(-std::numeric_limits<float>::max());
+        float3 centroidMin = boundsMin, centroidMax = boundsMax;
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const Instance& instance = mInstances[mInstanceOrder[i]];
+            boundsMin = min(boundsMin, instance.boundsMin);
+            boundsMax = max(boundsMax, instance.boundsMax);
+            const float3 centroid = (instance.boundsMin + instance.boundsMax) * 0.5f;
+            centroidMin = min(centroidMin, centroid);
+            centroidMax = max(centroidMax, centroid);
+        }
+        mTopNodes[nodeIndex].boundsMin = boundsMin;
+        mTopNodes[nodeIndex].boundsMax = boundsMax;
+
+        if (end - begin <= kMaxInstancesPerLeaf)
+        {
+            mTopNodes[nodeIndex].first = begin;
+            mTopNodes[nodeIndex].count = end - begin;
+            return;
+        }
+
+        const float3 extent = centroidMax - centroidMin;
+        const uint32_t axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+        const uint32_t mid = begin + (end - begin) / 2;
+        std::nth_element(mInstanceOrder.begin() + begin, mInstanceOrder.begin() + mid, mInstanceOrder.begin() + end, [&](uint32_t a, uint32_t b)
+        {
+            return mInstances[a].boundsMin[axis] + mInstances[a].boundsMax[axis] < mInstances[b].boundsMin[axis] + mInstances[b].boundsMax[axis];
+        });
+
+        const uint32_t children = uint32_t(mTopNodes.size());
+        mTopNodes.emplace_back();
+        mTopNodes.emplace_back();
+        mTopNodes[nodeIndex].first = children;
+        mTopNodes[nodeIndex].count = 0;
+        BuildTopLevel(children, begin, mid);
+        BuildTopLevel(children + 1, mid, end);
+    }
+
+    void TwoLevelBvh::Refit()
+    {
+        Timer timer;
+        for (Instance& instance : mInstances) UpdateInstanceBounds(instance);
+
+        // Children come after their parent, so walking backwards sees them done first
+        for (uint32_t n = uint32_t(mTopNodes.size()); n-- > 0;)
+        {
+            TopNode& node = mTopNodes[n];
+            float3 boundsMin(std::numeric_limits<float>::max()), boundsMax(-std::numeric_limits<float>::max());
+            if (node.count > 0)
+            {
+                for (uint32_t i = node.first; i < node.first + node.count; ++i)
+                {
+                    boundsMin = min(boundsMin, mInstances[mInstanceOrder[i]].boundsMin);
+                    boundsMax = max(boundsMax, mInstances[mInstanceOrder[i]].boundsMax);
+                }
+            }
+            else
+            {
+                for (uint32_t child = node.first; child < node.first + 2; ++child)
+                {
+                    boundsMin = min(boundsMin, mTopNodes[child].boundsMin);
+                    boundsMax = max(boundsMax, mTopNodes[child].boundsMax);
+                }
+            }
+            node.boundsMin = boundsMin;
+            node.boundsMax = boundsMax;
+        }
+        mRefitMs = float(timer.GetElapsedMs());
+    }
+
+    template<bool AnyHit>
+    bool TwoLevelBvh::Traverse(const Ray& ray, RayHit* hit) const
+    {
+        if (mTopNodes.empty()) return false;
+
+        auto safeInverse = [](float d) { return 1.0f / (std::fabs(d) > 1e-20f ? d : std::copysign(1e-20f, d)); };
+        const float3 invDir(safeInverse(ray.direction.x), safeInverse(ray.direction.y), safeInverse(ray.direction.z));
+
+        float tHit = ray.tMax;
+        bool found = false;
+        uint32_t stack[kTopStackSize];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while (stackSize > 0)
+        {
+            const TopNode& node = mTopNodes[stack[--stackSize]];
+            float tNear;
+            if (!IntersectBox(ray.origin, invDir, node.boundsMin, node.boundsMax, ray.tMin, tHit, tNear)) continue;
+
+            if (node.count == 0)
+            {
+                // Nearer child popped first
+                float tLeft, tRight;
+                const bool hitLeft = IntersectBox(ray.origin, invDir, mTopNodes[node.first].boundsMin, mTopNodes[node.first].boundsMax, ray.tMin, tHit, tLeft);
+                const bool hitRight = IntersectBox(ray.origin, invDir, mTopNodes[node.first + 1].boundsMin, mTopNodes[node.first + 1].boundsMax, ray.tMin, tHit, tRight);
+                if (hitLeft && hitRight)
+                {
+                    stack[stackSize++] = tLeft < tRight ? node.first + 1 : node.first;
+                    stack[stackSize++] = tLeft < tRight ? node.first : node.first + 1;
+                }
+                else if (hitLeft || hitRight)
+                {
+                    stack[stackSize++] = hitLeft ? node.first : node.first + 1;
+                }
+                continue;
+            }
+
+            for (uint32_t i = node.first; i < node.first + node.count; ++i)
+            {
+                const Instance& instance = mInstances[mInstanceOrder[i]];
+                float tInstance;
+                if (!IntersectBox(ray.origin, invDir, instance.boundsMin, instance.boundsMax, ray.tMin, tHit, tInstance)) continue;
+
+                // The direction is not renormalized, so t means the same distance along the ray in both spaces
+                Ray objectRay;
+                const float3& o = ray.origin;
+                const float3& d = ray.direction;
+                objectRay.origin = float3(dot(instance.inverseRows[0], o), dot(instance.inverseRows[1], o), dot(instance.inverseRows[2], o)) + instance.inverseTranslation;
+                objectRay.direction = float3(dot(instance.inverseRows[0], d), dot(instance.inverseRows[1], d), dot(instance.inverseRows[2], d));
+                objectRay.tMin = ray.tMin;
+                objectRay.tMax = tHit;
+
+                const Bvh& meshBvh = mMeshBvhs[instance.meshId];
+                if (AnyHit)
+                {
+                    if (meshBvh.Occluded(objectRay)) return true;
+                    continue;
+                }
+
+                RayHit objectHit;
+                if (meshBvh.Intersect(objectRay, objectHit))
+                {
+                    tHit = objectHit.t;
+                    *hit = objectHit;
+                    hit->triangle += instance.firstTriangle;
+                    found = true;
+                }
+            }
+        }
+
+        return found;
+    }
+
+    bool TwoLevelBvh::Intersect(const Ray& ray, RayHit& hit) const
+    {
+        return Traverse<false>(ray, &hit);
+    }
+
+    bool TwoLevelBvh::Occluded(const Ray& ray) const
+    {
+        return Traverse<true>(ray, nullptr);
+    }
+
+    size_t TwoLevelBvh::GetSizeInBytes() const
+    {
+        size_t size = mInstances.size() * sizeof(Instance) + mInstanceOrder.size() * sizeof(uint32_t) + mTopNodes.size() * sizeof(TopNode);
+        for (const Bvh& bvh : mMeshBvhs) size += bvh.GetSizeInBytes();
+        return size;
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Bvh.h"
+#include "SceneCache.h"
+
+namespace Cpu
+{
+    // Two-level BVH like the acceleration structures of an RtScene: a bottom level Bvh per mesh in object space and a
+    // top level over the instances placed by their transforms. Rigid animation only moves instances, so SetTransform()
+    // and Refit() redo the instance boxes and the top level in O(instances) while the meshes stay as built. Hits are
+    // numbered like the triangles of BuildTriangleScene(), so a TriangleScene expanded from the same view shades them.
+    class TwoLevelBvh
+    {
+    public:
+        // With a pool small meshes are built side by side and large ones each use the whole pool
+        void Build(const SceneView& view, const BvhBuildSettings& settings = BvhBuildSettings(), ThreadPool* pool = nullptr);
+
+        uint32_t GetInstanceCount() const { return uint32_t(mInstances.size()); }
+        // Column major like SceneInstance::transform. Takes effect on the next Refit() or RebuildTopLevel().
+        void SetTransform(uint32_t instance, const float transform[16]);
+        // Keeps the top level tree and grows its boxes to the moved instances. After large movements RebuildTopLevel()
+        // gives tighter nodes for about the same cost on scenes with few instances.
+        void Refit();
+        void RebuildTopLevel();
+
+        // Closest hit in (tMin, tMax)
+        bool Intersect(const Ray& ray, RayHit& hit) const;
+        // Any hit in (tMin, tMax)
+        bool Occluded(const Ray& ray) const;
+
+        uint32_t GetTriangleCount() const { return mTriangleCount; }
+        uint32_t GetTopNodeCount() const { return uint32_t(mTopNodes.size()); }
+        size_t GetSizeInBytes() const;
+        float GetBuildMs() const { return mBuildMs; }
+        float GetRefitMs() const { return mRefitMs; }
+
+    private:
+        struct Instance
+        {
+            uint32_t meshId = 0;
+            uint32_t firstTriangle = 0;     // In BuildTriangleScene() numbering
+            float3 axes[3];                 // Object to world
+            float3 translation;
+            float3 inverseRows[3];          // World to object
+            float3 inverseTranslation;
+            float3 boundsMin;               // World space
+            float3 boundsMax;
+        };
+
+        // A leaf covers mInstanceOrder[first, first + count), an inner node has children first and first + 1, which
+        // always come after it
+        struct TopNode
+        {
+            float3 boundsMin;
+            float3 boundsMax;
+            uint32_t first = 0;
+            uint32_t count = 0;
+        };
+
+        void UpdateInstanceBounds(Instance& instance) const;
+        void BuildTopLevel(uint32_t nodeIndex, uint32_t begin, uint32_t end);
+
+        template<bool AnyHit>
+        bool Traverse(const Ray& ray, RayHit* hit) const;
+
+        std::vector<Bvh> mMeshBvhs;
+        std::vector<Instance> mInstances;
+        std::vector<uint32_t> mInstanceOrder;
+        std::vector<TopNode> mTopNodes;
+        uint32_t mTriangleCount = 0;
+        float mBuildMs = 0.0f;
+        float mRefitMs = 0.0f;
+    };
+}
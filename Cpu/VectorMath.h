@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// HLSL-flavoured vector types so the CPU ports read like the shaders they mirror
+namespace Cpu
+{
+    struct float2
+    {
+        float x, y;
+
+        float2() : x(0.0f), y(0.0f) {}
+        explicit float2(float s) : x(s), y(s) {}
+        float2(float x_, float y_) : x(x_), y(y_) {}
+    };
+
+    struct float3
+    {
+        float x, y, z;
+
+        float3() : x(0.0f), y(0.0f), z(0.0f) {}
+        explicit float3(float s) : x(s), y(s), z(s) {}
+        float3(float x_, float y_, float z_) : x(x_), y(y_), z(z_) {}
+
+        float& operator[](int i) { return (&x)[i]; }
+        float operator[](int i) const { return (&x)[i]; }
+    };
+
+    struct float4
+    {
+        float x, y, z, w;
+
+        float4() : x(0.0f), y(0.0f), z(0.0f), w(0.0f) {}
+        explicit float4(float s) : x(s), y(s), z(s), w(s) {}
+        float4(float x_, float y_, float z_, float w_) : x(x_), y(y_), z(z_), w(w_) {}
+        float4(const float3& v, float w_) : x(v.x), y(v.y), z(v.z), w(w_) {}
+
+        float3 rgb() const { return float3(x, y, z); }
+        float2 xy() const { return float2(x, y); }
+        float2 zw() const { return float2(z, w); }
+        float& operator[](int i) { return (&x)[i]; }
+        float operator[](int i) const { return (&x)[i]; }
+    };
+
+    struct int2
+    {
+        int x, y;
+
+        int2() : x(0), y(0) {}
+        int2(int x_, int y_) : x(x_), y(y_) {}
+    };
+
+    struct int3
+    {
+        int x, y, z;
+
+        int3() : x(0), y(0), z(0) {}
+        int3(int x_, int y_, int z_) : x(x_), y(y_), z(z_) {}
+    };
+
+    inline float2 operator+(const float2& a, const float2& b) { return float2(a.x + b.x, a.y + b.y); }
+    inline float2 operator-(const float2& a, const float2& b) { return float2(a.x - b.x, a.y - b.y); }
+    inline float2 operator*(const float2& a, const float2& b) { return float2(a.x * b.x, a.y * b.y); }
+    inline float2 operator*(const float2& a, float s) { return float2(a.x * s, a.y * s); }
+    inline float2 operator*(float s, const float2& a) { return a * s; }
+    inline float2 operator/(const float2& a, float s) { return float2(a.x / s, a.y / s); }
+    inline float2& operator+=(float2& a, const float2& b) { a = a + b; return a; }
+    inline float2& operator/=(float2& a, float s) { a = a / s; return a; }
+
+    inline float3 operator-(const float3& a) { return float3(-a.x, -a.y, -a.z); }
+    inline float3 operator+(const float3& a, const float3& b) { return float3(a.x + b.x, a.y + b.y, a.z + b.z); }
+    inline float3 operator-(const float3& a, const float3& b) { return float3(a.x - b.x, a.y - b.y, a.z - b.z); }
+    inline float3 operator*(const float3& a, const float3& b) { return float3(a.x * b.x, a.y * b.y, a.z * b.z); }
+    inline float3 operator*(const float3& a, float s) { return float3(a.x * s, a.y * s, a.z * s); }
+    inline float3 operator*(float s, const float3& a) { return a * s; }
+    inline float3 operator/(const float3& a, const float3& b) { return float3(a.x / b.x, a.y / b.y, a.z / b.z); }
+    inline float3 operator/(const float3& a, float s) { return float3(a.x / s, a.y / s, a.z / s); }
+    inline float3& operator+=(float3& a, const float3& b) { a = a + b; return a; }
+    inline float3& operator-=(float3& a, const float3& b) { a = a - b; return a; }
+    inline float3& operator*=(float3& a, const float3& b) { a = a * b; return a; }
+    inline float3& operator*=(float3& a, float s) { a = a * s; return a; }
+    inline float3& operator/=(float3& a, float s) { a = a / s; return a; }
+
+    inline float4 operator+(const float4& a, const float4& b) { return float4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); }
+    inline float4 operator-(const float4& a, const float4& b) { return float4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w); }
+    inline float4 operator*(const float4& a, float s) { return float4(a.x * s, a.y * s, a.z * s, a.w * s); }
+    inline float4 operator*(float s, const float4& a) { return a * s; }
+    inline float4 operator/(const float4& a, float s) { return float4(a.x / s, a.y / s, a.z / s, a.w / s); }
+    inline float4& operator+=(float4& a, const float4& b) { a = a + b; return a; }
+
+    inline int2 operator+(const int2& a, const int2& b) { return int2(a.x + b.x, a.y + b.y); }
+    inline int2 operator-(const int2& a, const int2& b) { return int2(a.x - b.x, a.y - b.y); }
+    inline int2 operator*(const int2& a, int s) { return int2(a.x * s, a.y * s); }
+
+    inline float dot(const float2& a, const float2& b) { return a.x * b.x + a.y * b.y; }
+    inline float dot(const float3& a, const float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    inline float3 cross(const float3& a, const float3& b) { return float3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+    inline float length(const float2& v) { return std::sqrt(dot(v, v)); }
+    inline float length(const float3& v) { return std::sqrt(dot(v, v)); }
+    inline float distance(const float3& a, const float3& b) { return length(a - b); }
+    inline float3 normalize(const float3& v) { return v / length(v); }
+    inline float3 abs(const float3& v) { return float3(std::fabs(v.x), std::fabs(v.y), std::fabs(v.z)); }
+    inline float3 min(const float3& a, const float3& b) { return float3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)); }
+    inline float3 max(const float3& a, const float3& b) { return float3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)); }
+    inline float3 reflect(const float3& i, const float3& n) { return i - 2.0f * dot(n, i) * n; }
+    inline float saturate(float v) { return std::min(std::max(v, 0.0f), 1.0f); }
+    inline float frac(float v) { return v - std::floor(v); }
+    inline float lerp(float a, float b, float t) { return a + (b - a) * t; }
+    inline float2 lerp(const float2& a, const float2& b, float t) { return a + (b - a) * t; }
+    inline float3 lerp(const float3& a, const float3& b, float t) { return a + (b - a) * t; }
+    inline float4 lerp(const float4& a, const float4& b, float t) { return a + (b - a) * t; }
+
+    // Rec. 709 weights, same as Falcor's luminance()
+    inline float luminance(const float3& rgb) { return dot(rgb, float3(0.2126f, 0.7152f, 0.0722f)); }
+
+    inline uint32_t asuint(float f) { uint32_t u; std::memcpy(&u, &f, sizeof(u)); return u; }
+    inline float asfloat(uint32_t u) { float f; std::memcpy(&f, &u, sizeof(f)); return f; }
+
+    // Equivalent of HLSL f32tof16 (round to nearest even) and f16tof32
+    inline uint32_t f32tof16(float value)
+    {
+        const uint32_t f = asuint(value);
+        const uint32_t sign = (f >> 16) & 0x8000;
+        const uint32_t absF = f & 0x7FFFFFFF;
+
+        if (absF >= 0x7F800000) return sign | 0x7C00 | (absF > 0x7F800000 ? 0x200 : 0); // Inf / NaN
+        if (absF >= 0x477FF000) return sign | 0x7C00; // Overflows to Inf after rounding
+
+        if (absF < 0x38800000) // Denormal or zero in half precision
+        {
+            if (absF < 0x33000000) return sign;
+            const uint32_t shift = 126 - (absF >> 23);
+            const uint32_t mantissa = (absF & 0x007FFFFF) | 0x00800000;
+            uint32_t half = mantissa >> shift;
+            const uint32_t rest = mantissa & ((1u << shift) - 1);
+            const uint32_t halfway = 1u << (shift - 1);
+            if (rest > halfway || (rest == halfway && (half & 1))) half++;
+            return sign | half;
+        }
+
+        uint32_t half = ((absF - 0x38000000) >> 13);
+        const uint32_t rest = absF & 0x1FFF;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+        return sign | half;
+    }
+
+    inline float f16tof32(uint32_t half)
+    {
+        const uint32_t sign = (half & 0x8000) << 16;
+        const uint32_t exponent = (half >> 10) & 0x1F;
+        uint32_t mantissa = half & 0x3FF;
+
+        if (exponent == 0x1F) return asfloat(sign | 0x7F800000 | (mantissa << 13));
+        if (exponent != 0) return asfloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+        if (mantissa == 0) return asfloat(sign);
+
+        // Renormalize half denormals
+        uint32_t e = 113;
+        while ((mantissa & 0x400) == 0)
+        {
+            mantissa <<= 1;
+            e--;
+        }
+        return asfloat(sign | (e << 23) | ((mantissa & 0x3FF) << 13));
+    }
+
+    // Round trip through half precision, i.e. what a 16-bit float render target stores
+    inline float QuantizeHalf(float value) { return f16tof32(f32tof16(value)); }
+}
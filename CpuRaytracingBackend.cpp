@@ -0,0 +1,245 @@
+#include "CpuRaytracingBackend.h"
+#include "SceneCacheLoader.h"
+#include "TextureReadback.h"
+#include "Cpu/ExrFile.h"
+#include "Cpu/Timer.h"
+
+using namespace Falcor;
+
+namespace
+{
+    Cpu::float3 ToFloat3(const glm::vec3& v)
+    {
+        return Cpu::float3(v.x, v.y, v.z);
+    }
+
+    const char* const kEffectNames[] = { "Shadows", "Reflection", "AO" };
+
+    // The view and projection the G-buffer pass rasterizes with, without the TAA jitter
+    Cpu::PathCamera GetPathCamera(const Camera* camera)
+    {
+        const glm::mat4 invView = glm::inverse(camera->getViewMatrix());
+        const glm::mat4& proj = camera->getProjMatrix();
+
+        Cpu::PathCamera pathCamera;
+        pathCamera.position = ToFloat3(camera->getPosition());
+        pathCamera.right = ToFloat3(glm::normalize(glm::vec3(invView[0])));
+        pathCamera.up = ToFloat3(glm::normalize(glm::vec3(invView[1])));
+        pathCamera.forward = ToFloat3(-glm::normalize(glm::vec3(invView[2])));
+        pathCamera.tanHalfFovY = 1.0f / proj[1][1];
+        pathCamera.aspectRatio = proj[1][1] / proj[0][0];
+        return pathCamera;
+    }
+}
+
+CpuRaytracingBackend::CpuRaytracingBackend()
+{
+    mGBuffer.worldPosition = &mWorldPosition;
+    mGBuffer.normalRoughness = &mNormalRoughness;
+    mGBuffer.albedo = &mAlbedo;
+}
+
+void CpuRaytracingBackend::SetScene(const RtScene::SharedPtr& scene, const std::shared_ptr<Cpu::LoadedScene>& cpuScene)
+{
+    mScene = scene;
+    mCpuScene = cpuScene;
+    mSceneDirty = true;
+}
+
+void CpuRaytracingBackend::BuildScene(RenderContext* renderContext)
+{
+    mSceneDirty = false;
+    mEffects.reset();
+    mPathTracer.reset();
+    mMeshes.clear();
+    if (!mScene)
+    {
+        mCpuScene.reset();
+        return;
+    }
+
+    // A loaded scene comes with its triangles and BVH. Without one the meshes are read back and loaded here, on the
+    // render thread. TriangleScene materials are per mesh and follow the mesh order of either.
+    if (mCpuScene)
+    {
+        mMeshes = GetSceneMeshes(mScene);
+        mMeshes.resize(mCpuScene->view.meshes.count);
+    }
+    else
+    {
+        std::shared_ptr<Cpu::SceneData> data = std::make_shared<Cpu::SceneData>();
+        ExtractSceneData(renderContext, mScene, *data, &mMeshes);
+        Cpu::SceneLoadRequest request;
+        request.data = data;
+        mCpuScene = Cpu::LoadScene(request, &Cpu::ThreadPool::GetDefault());
+    }
+    mEffects.reset(new Cpu::RaytracedEffects(mCpuScene->triangles, mCpuScene->bvh, Cpu::ThreadPool::GetDefault()));
+    mEffects->SetRayOrder(mRayOrder);
+    mEffects->SetReflectionTracing(mReflectionTracing);
+    mPathTracer.reset(new Cpu::PathTracer(mCpuScene->triangles, mCpuScene->bvh, Cpu::ThreadPool::GetDefault()));
+}
+
+// Materials and lights can be edited at runtime, geometry changes need SetScene()
+void CpuRaytracingBackend::UpdateSceneParameters()
+{
+    for (uint32_t i = 0; i < mMeshes.size(); ++i)
+    {
+        if (mMeshes[i]) mCpuScene->triangles.SetMaterial(i, ToSceneMaterial(mMeshes[i]->getMaterial()));
+    }
+    for (uint32_t i = 0; i < mCpuScene->triangles.GetLightCount() && i < mScene->getLightCount(); ++i)
+    {
+        mCpuScene->triangles.SetLight(i, ToSceneLight(mScene->getLight(i)));
+    }
+}
+
+bool CpuRaytracingBackend::PrepareFrame(RenderContext* renderContext, const Fbo::SharedPtr& gBuffer, const Camera* camera, uint32_t frameCount)
+{
+    if (mSceneDirty) BuildScene(renderContext);
+    if (!mEffects) return false;
+    if (mGBufferFrame == frameCount) return true;
+
+    Cpu::Timer timer;
+    UpdateSceneParameters();
+
+    // Rebuilt with the lights, a few microseconds even for a thousand of them
+    if (mSampleLights) mLightSampler.Build(mCpuScene->triangles);
+    mEffects->SetLightSampler(mSampleLights ? &mLightSampler : nullptr);
+
+    // Attachment order of RaysRenderer's G-buffer
+    if (!ReadTexture(renderContext, gBuffer->getColorTexture(0), mWorldPosition) ||
+        !ReadTexture(renderContext, gBuffer->getColorTexture(1), mNormalRoughness) ||
+        !ReadTexture(renderContext, gBuffer->getColorTexture(2), mAlbedo))
+    {
+        return false;
+    }
+    mGBuffer.cameraPosition = ToFloat3(camera->getPosition());
+    mGBufferFrame = frameCount;
+    mReadbackMs = timer.GetElapsedMs();
+    return true;
+}
+
+void CpuRaytracingBackend::Upload(RenderContext* renderContext, Effect effect, const Texture::SharedPtr& output)
+{
+    mStats[effect] = mEffects->GetLastStats();
+    if (!WriteTexture(renderContext, mOutput, output))
+    {
+        logError("CpuRaytracingBackend: cannot upload " + std::string(kEffectNames[effect]));
+    }
+}
+
+void CpuRaytracingBackend::TraceShadows(RenderContext* renderContext, const Fbo::SharedPtr& gBuffer, const Camera* camera, uint32_t frameCount, RayScale scale, const Texture::SharedPtr& output)
+{
+    if (!PrepareFrame(renderContext, gBuffer, camera, frameCount)) return;
+    mEffects->TraceShadows(mGBuffer, (Cpu::RayScale)scale, frameCount, mOutput);
+    Upload(renderContext, Effect::Shadows, output);
+}
+
+void CpuRaytracingBackend::TraceReflection(RenderContext* renderContext, const Fbo::SharedPtr& gBuffer, const Camera* camera, uint32_t frameCount, RayScale scale, const Texture::SharedPtr& output)
+{
+    if (!PrepareFrame(renderContext, gBuffer, camera, frameCount)) return;
+    mEffects->SetReflectionBounces(mReflectionBounces);
+    mEffects->TraceReflection(mGBuffer, (Cpu::RayScale)scale, frameCount, mOutput);
+    Upload(renderContext, Effect::Reflection, output);
+}
+
+void CpuRaytracingBackend::TraceAO(RenderContext* renderContext, const Fbo::SharedPtr& gBuffer, const Camera* camera, uint32_t frameCount, RayScale scale, float aoDistance, const Texture::SharedPtr& output)
+{
+    if (!PrepareFrame(renderContext, gBuffer, camera, frameCount)) return;
+    mEffects->TraceAO(mGBuffer, (Cpu::RayScale)scale, frameCount, aoDistance, mOutput);
+    Upload(renderContext, Effect::AO, output);
+}
+
+void CpuRaytracingBackend::RenderReference(RenderContext* renderContext, const Camera* camera, const Fbo::SharedPtr& targetFbo)
+{
+    if (mSceneDirty) BuildScene(renderContext);
+    if (!mPathTracer) return;
+
+    // Edited materials and lights only take effect with a restart, so a converging image stays one scene
+    if (mPathTracer->GetSampleCount() == 0)
+    {
+        UpdateSceneParameters();
+        if (mSampleLights) mLightSampler.Build(mCpuScene->triangles);
+    }
+    mPathTracer->SetLightSampler(mSampleLights ? &mLightSampler : nullptr);
+    mPathTracer->SetSettings(mPathTracerSettings);
+    mPathTracer->SetCamera(GetPathCamera(camera));
+
+    const uint32_t width = targetFbo->getWidth();
+    const uint32_t height = targetFbo->getHeight();
+    if (mPathTracer->GetSampleCount() < mReferenceSamples || mPathTracer->GetImage().GetWidth() != width || mPathTracer->GetImage().GetHeight() != height)
+    {
+        mPathTracer->Render(width, height);
+    }
+
+    if (!mReferenceTexture || mReferenceTexture->getWidth() != width || mReferenceTexture->getHeight() != height)
+    {
+        mReferenceTexture = Texture::create2D(width, height, ResourceFormat::RGBA32Float, 1, 1, nullptr, Resource::BindFlags::ShaderResource);
+    }
+    if (!WriteTexture(renderContext, mPathTracer->GetImage(), mReferenceTexture))
+    {
+        logError("CpuRaytracingBackend: cannot upload the path traced reference");
+        return;
+    }
+    renderContext->blit(mReferenceTexture->getSRV(), targetFbo->getColorTexture(0)->getRTV());
+}
+
+void CpuRaytracingBackend::RenderReferenceGui(Gui* gui)
+{
+    gui->addIntSlider("Bounces", *reinterpret_cast<int32_t*>(&mPathTracerSettings.maxBounces), 1, 16);
+    gui->addIntSlider("Russian Roulette From", *reinterpret_cast<int32_t*>(&mPathTracerSettings.russianRouletteBounce), 1, 16);
+    gui->addIntSlider("Target Samples", *reinterpret_cast<int32_t*>(&mReferenceSamples), 1, 65536);
+    if (!mPathTracer) return;
+
+    if (gui->addButton("Restart")) mPathTracer->Reset();
+    if (gui->addButton("Save EXR", true))
+    {
+        std::string filename;
+        if (saveFileDialog("OpenEXR\0*.exr\0\0", filename) && !Cpu::WriteExr(filename, mPathTracer->GetImage()))
+        {
+            logError("CpuRaytracingBackend: cannot write " + filename);
+        }
+    }
+
+    const Cpu::PathTracerStats& stats = mPathTracer->GetLastStats();
+    gui->addText(("Samples: " + std::to_string(mPathTracer->GetSampleCount()) + " / " + std::to_string(mReferenceSamples)).c_str());
+    gui->addText(("Last sample: " + std::to_string(stats.elapsedMs) + " ms, " + std::to_string(stats.GetSamplesPerSecond() / 1e6) + " Msamples/s, " +
+        std::to_string(stats.GetRaysPerSecond() / 1e6) + " Mrays/s").c_str());
+    gui->addText(("Generate " + std::to_string(stats.generateMs) + ", extend " + std::to_string(stats.extendMs) + ", shade " + std::to_string(stats.shadeMs) +
+        ", connect " + std::to_string(stats.connectMs) + " ms, " + std::to_string(stats.steals) + " steals").c_str());
+}
+
+void CpuRaytracingBackend::RenderGui(Gui* gui)
+{
+    if (mCpuScene)
+    {
+        const Cpu::Bvh& bvh = mCpuScene->bvh;
+        gui->addText(("Triangles: " + std::to_string(mCpuScene->triangles.GetTriangleCount()) + ", BVH nodes: " + std::to_string(bvh.GetNodeCount()) +
+            (bvh.IsAttached() ? std::string(", from the scene cache") : ", build " + std::to_string(bvh.GetBuildMs()) + " ms")).c_str());
+    }
+
+    Gui::DropdownList rayOrders;
+    rayOrders.push_back({ (int32_t)Cpu::RayOrder::Launch, "Launch" });
+    rayOrders.push_back({ (int32_t)Cpu::RayOrder::Sorted, "Sorted" });
+    rayOrders.push_back({ (int32_t)Cpu::RayOrder::SortedPackets, "Sorted Packets" });
+    if (gui->addDropdown("Ray Order", rayOrders, *reinterpret_cast<uint32_t*>(&mRayOrder)) && mEffects)
+    {
+        mEffects->SetRayOrder(mRayOrder);
+    }
+
+    Gui::DropdownList reflectionTracings;
+    reflectionTracings.push_back({ (int32_t)Cpu::ReflectionTracing::Recursive, "Recursive" });
+    reflectionTracings.push_back({ (int32_t)Cpu::ReflectionTracing::Wavefront, "Wavefront" });
+    if (gui->addDropdown("Reflection Tracing", reflectionTracings, *reinterpret_cast<uint32_t*>(&mReflectionTracing)) && mEffects)
+    {
+        mEffects->SetReflectionTracing(mReflectionTracing);
+    }
+
+    gui->addText(("G-buffer readback: " + std::to_string(mReadbackMs) + " ms").c_str());
+    for (uint32_t i = 0; i < Effect::Count; ++i)
+    {
+        std::string text = std::string(kEffectNames[i]) + ": " + std::to_string(mStats[i].elapsedMs) + " ms, " +
+            std::to_string(mStats[i].GetRaysPerSecond() / 1e6) + " Mrays/s";
+        if (mRayOrder != Cpu::RayOrder::Launch) text += ", binning " + std::to_string(mStats[i].binMs) + " ms";
+        gui->addText(text.c_str());
+    }
+}
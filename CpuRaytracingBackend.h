@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Falcor.h"
+#include "FalcorExperimental.h"
+#include "RayUpsamplePass.h"
+#include "Cpu/AsyncSceneLoader.h"
+#include "Cpu/LightSampling.h"
+#include "Cpu/PathTracer.h"
+#include "Cpu/RaytracedEffects.h"
+
+// Runs the ray traced effects on the CPU instead of DXR. The RtScene triangles go into a Cpu::Bvh, the G-buffer
+// is read back once per frame and every effect is uploaded into the texture its DXR pass would write, so the
+// rest of the render graph does not know the difference. Orders of magnitude slower, it is there for reference
+// renders and for comparing rays per second with the GPU.
+class CpuRaytracingBackend
+{
+public:
+    using SharedPtr = std::shared_ptr<CpuRaytracingBackend>;
+
+    CpuRaytracingBackend();
+
+    // The scene is extracted on first use. With a loaded CPU scene its triangles and BVH are used instead of being read
+    // back and rebuilt; it has to describe the scene, as the one SceneCacheLoader hands out with it does.
+    void SetScene(const Falcor::RtScene::SharedPtr& scene, const std::shared_ptr<Cpu::LoadedScene>& cpuScene = nullptr);
+
+    void TraceShadows(Falcor::RenderContext* renderContext, const Falcor::Fbo::SharedPtr& gBuffer, const Falcor::Camera* camera, uint32_t frameCount, RayScale scale, const Falcor::Texture::SharedPtr& output);
+    void TraceReflection(Falcor::RenderContext* renderContext, const Falcor::Fbo::SharedPtr& gBuffer, const Falcor::Camera* camera, uint32_t frameCount, RayScale scale, const Falcor::Texture::SharedPtr& output);
+    void TraceAO(Falcor::RenderContext* renderContext, const Falcor::Fbo::SharedPtr& gBuffer, const Falcor::Camera* camera, uint32_t frameCount, RayScale scale, float aoDistance, const Falcor::Texture::SharedPtr& output);
+
+    // Path traces the whole frame from camera into targetFbo, one more sample per call, see Cpu::PathTracer. Samples
+    // accumulate while the camera and the path tracer settings stay the same, up to the target sample count.
+    void RenderReference(Falcor::RenderContext* renderContext, const Falcor::Camera* camera, const Falcor::Fbo::SharedPtr& targetFbo);
+
+    // Shadows and reflection hits pick one light from a Cpu::LightSampler, see RaytracedEffects::SetLightSampler()
+    void SetLightSampling(bool enable) { mSampleLights = enable; }
+
+    // Reflection rays per path, see RaytracedEffects::SetReflectionBounces()
+    void SetReflectionBounces(uint32_t bounces) { mReflectionBounces = bounces; }
+
+    void RenderGui(Falcor::Gui* gui);
+    void RenderReferenceGui(Falcor::Gui* gui);
+
+private:
+    enum Effect : uint32_t { Shadows = 0, Reflection, AO, Count };
+
+    bool PrepareFrame(Falcor::RenderContext* renderContext, const Falcor::Fbo::SharedPtr& gBuffer, const Falcor::Camera* camera, uint32_t frameCount);
+    void BuildScene(Falcor::RenderContext* renderContext);
+    void UpdateSceneParameters();
+    void Upload(Falcor::RenderContext* renderContext, Effect effect, const Falcor::Texture::SharedPtr& output);
+
+    Falcor::RtScene::SharedPtr mScene;
+    std::shared_ptr<Cpu::LoadedScene> mCpuScene;
+    bool mSceneDirty = true;
+    std::unique_ptr<Cpu::RaytracedEffects> mEffects;
+    std::unique_ptr<Cpu::PathTracer> mPathTracer;
+    std::vector<Falcor::Mesh::SharedPtr> mMeshes;       // Indexed by TriangleScene material id
+
+    // G-buffer read back for frame mGBufferFrame
+    Cpu::Image4F mWorldPosition;
+    Cpu::Image4F mNormalRoughness;
+    Cpu::Image4F mAlbedo;
+    Cpu::RtGBuffer mGBuffer;
+    uint32_t mGBufferFrame = ~0u;
+
+    Cpu::Image4F mOutput;
+    Cpu::RtTraceStats mStats[Effect::Count];
+    Cpu::RayOrder mRayOrder = Cpu::RayOrder::Launch;
+    // The bounce loop of the DXR shader by default, Recursive for comparing with the closest-hit recursion it replaced
+    Cpu::ReflectionTracing mReflectionTracing = Cpu::ReflectionTracing::Wavefront;
+    uint32_t mReflectionBounces = 2;
+    bool mSampleLights = false;
+    Cpu::LightSampler mLightSampler;
+    double mReadbackMs = 0.0;
+
+    Cpu::PathTracerSettings mPathTracerSettings;
+    uint32_t mReferenceSamples = 1024;
+    Falcor::Texture::SharedPtr mReferenceTexture;
+};
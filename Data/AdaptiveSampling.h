@@ -0,0 +1,22 @@
+#ifndef ADAPTIVE_SAMPLING_H
+#define ADAPTIVE_SAMPLING_H
+
+// Work list written by AdaptiveSampling.slang, mirrors Cpu::AdaptiveSampler. Entries are x | y << 14 | rays << 28,
+// gWorkListCount holds their number.
+uint2 GetWorkListPixel(uint entry)
+{
+    return uint2(entry & 0x3FFF, (entry >> 14) & 0x3FFF);
+}
+
+uint GetWorkListRayCount(uint entry)
+{
+    return entry >> 28;
+}
+
+// Ray k of a listed pixel draws the seed of frame frameCount + (k << 16), so the first one is the ray a launch traces
+uint GetWorkListSeed(uint2 pixel, uint width, uint frameCount, uint k)
+{
+    return rand_init(pixel.x + pixel.y * width, frameCount + (k << 16), 16);
+}
+
+#endif
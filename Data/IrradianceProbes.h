@@ -0,0 +1,151 @@
+#ifndef IRRADIANCE_PROBES_H
+#define IRRADIANCE_PROBES_H
+
+// World-space irradiance probe grid written by IrradianceProbePass, mirrors Cpu::IrradianceProbes. Every probe keeps
+// the irradiance around it in an octahedral tile of PROBE_IRRADIANCE_TEXELS^2 texels of an R11G11B10Float atlas and
+// the mean and mean squared distance to the nearest surface in a tile of PROBE_VISIBILITY_TEXELS^2 texels of an
+// RG16Float atlas. Tiles have a one texel border copied from the opposite octahedral edge so bilinear filtering never
+// leaves them. Probe i is tile (i % (x * y), i / (x * y)). Irradiance is stored divided by pi, a diffuse surface
+// reflects albedo times the stored value. Needs Helpers imported.
+
+#define PROBE_IRRADIANCE_TEXELS 6
+#define PROBE_VISIBILITY_TEXELS 14
+
+shared cbuffer ProbeGridCB
+{
+    float3 gProbeOrigin;
+    float gProbeNormalBias;
+    float3 gProbeSpacing;
+    int3 gProbeCounts;
+};
+
+shared Texture2D gProbeIrradiance;
+shared Texture2D gProbeVisibility;
+shared SamplerState gProbeSampler;
+
+float2 SignNotZero(float2 v)
+{
+    return float2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Unit direction to [-1, 1]^2, the lower hemisphere folded over the corners
+float2 OctEncode(float3 n)
+{
+    const float2 p = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+    return n.z < 0.0 ? (1.0 - abs(p.yx)) * SignNotZero(p) : p;
+}
+
+float3 OctDecode(float2 e)
+{
+    float3 n = float3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * SignNotZero(n.xy);
+    return normalize(n);
+}
+
+uint GetProbeIndex(int3 coords)
+{
+    return uint(coords.x + gProbeCounts.x * (coords.y + gProbeCounts.y * coords.z));
+}
+
+int3 GetProbeCoords(uint index)
+{
+    return int3(index % gProbeCounts.x, (index / gProbeCounts.x) % gProbeCounts.y, index / (gProbeCounts.x * gProbeCounts.y));
+}
+
+float3 GetProbePosition(int3 coords)
+{
+    return gProbeOrigin + float3(coords) * gProbeSpacing;
+}
+
+// Must match Cpu::IrradianceProbes
+static const uint kProbeRotationSeed = 0x50524f42;
+
+// Direction of ray index of count, evenly spread over the sphere
+float3 SphericalFibonacci(uint index, uint count)
+{
+    const float kGoldenRatio = 1.61803398875;
+    const float phi = M_PI2 * frac(float(index) / kGoldenRatio);
+    const float cosTheta = 1.0 - (2.0 * float(index) + 1.0) / float(count);
+    const float sinTheta = sqrt(saturate(1.0 - cosTheta * cosTheta));
+    return float3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
+}
+
+// Uniformly random unit quaternion (Shoemake) the frame's probe rays are rotated by, xyz the vector part
+float4 GetProbeRayRotation(uint frameCount)
+{
+    uint randSeed = rand_init(frameCount, kProbeRotationSeed, 16);
+    const float u1 = rand_next(randSeed);
+    const float u2 = rand_next(randSeed) * M_PI2;
+    const float u3 = rand_next(randSeed) * M_PI2;
+    const float a = sqrt(1.0 - u1);
+    const float b = sqrt(u1);
+    return float4(a * sin(u2), a * cos(u2), b * sin(u3), b * cos(u3));
+}
+
+float3 RotateByQuaternion(float4 q, float3 v)
+{
+    const float3 t = 2.0 * cross(q.xyz, v);
+    return v + q.w * t + cross(q.xyz, t);
+}
+
+// Top left texel of a probe's tile, border included
+int2 GetProbeTile(uint index, uint interiorTexels)
+{
+    const uint columns = gProbeCounts.x * gProbeCounts.y;
+    return int2(index % columns, index / columns) * int(interiorTexels + 2);
+}
+
+float2 GetProbeUV(uint index, float3 direction, uint interiorTexels, float2 atlasSize)
+{
+    const float2 texel = float2(GetProbeTile(index, interiorTexels)) + 1.0 + (OctEncode(direction) * 0.5 + 0.5) * float(interiorTexels);
+    return texel / atlasSize;
+}
+
+// Irradiance / pi at a surface: the 8 probes around it weighted trilinearly, by how much they face the surface and by
+// a Chebyshev test against their distance moments, so probes behind a wall barely contribute
+float3 SampleProbeIrradiance(float3 posW, float3 N)
+{
+    float2 irradianceSize, visibilitySize;
+    gProbeIrradiance.GetDimensions(irradianceSize.x, irradianceSize.y);
+    gProbeVisibility.GetDimensions(visibilitySize.x, visibilitySize.y);
+
+    const float3 biasedPosW = posW + N * gProbeNormalBias;
+    const int3 baseCoords = clamp(int3(floor((biasedPosW - gProbeOrigin) / gProbeSpacing)), int3(0), max(gProbeCounts - 2, int3(0)));
+    const float3 alpha = saturate((biasedPosW - GetProbePosition(baseCoords)) / gProbeSpacing);
+
+    float3 sum = 0.0;
+    float weightSum = 0.0;
+    for (uint i = 0; i < 8; ++i)
+    {
+        const int3 offset = int3(i, i >> 1, i >> 2) & 1;
+        const int3 coords = min(baseCoords + offset, gProbeCounts - 1);
+        const uint index = GetProbeIndex(coords);
+        const float3 probePosW = GetProbePosition(coords);
+
+        const float3 toProbe = probePosW - posW;
+        const float toProbeLength = length(toProbe);
+        const float facing = toProbeLength > 1e-4 ? dot(toProbe / toProbeLength, N) : 1.0;
+        float weight = (facing + 1.0) * (facing + 1.0) * 0.25 + 0.2;
+
+        const float3 probeToPoint = biasedPosW - probePosW;
+        const float distance = length(probeToPoint);
+        const float3 direction = distance > 1e-4 ? probeToPoint / distance : N;
+        const float2 moments = gProbeVisibility.SampleLevel(gProbeSampler, GetProbeUV(index, direction, PROBE_VISIBILITY_TEXELS, visibilitySize), 0).rg;
+        if (distance > moments.x)
+        {
+            const float variance = abs(moments.x * moments.x - moments.y);
+            const float d = distance - moments.x;
+            const float chebyshev = variance / (variance + d * d);
+            weight *= max(chebyshev * chebyshev * chebyshev, 0.05);
+        }
+
+        const float3 trilinear = lerp(1.0 - alpha, alpha, float3(offset));
+        weight *= trilinear.x * trilinear.y * trilinear.z;
+
+        sum += weight * gProbeIrradiance.SampleLevel(gProbeSampler, GetProbeUV(index, N, PROBE_IRRADIANCE_TEXELS, irradianceSize), 0).rgb;
+        weightSum += weight;
+    }
+    return weightSum > 0.0 ? sum / weightSum : float3(0.0);
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef LIGHT_SAMPLING_H
+#define LIGHT_SAMPLING_H
+
+// Lights and alias table uploaded by SceneLightSampler, mirrors Cpu::LightSampler. gLights only holds the first
+// MAX_LIGHT_SOURCES lights, so every light is stored again as 3 float4: posW and type, dirW, intensity. A table slot
+// is threshold, alias, pdf and alias pdf. Needs BRDF and Shading imported.
+shared ByteAddressBuffer gSampledLights;
+shared ByteAddressBuffer gLightAliasTable;
+
+struct SampledLight
+{
+    float3 posW;
+    uint type;
+    float3 dirW;
+    float3 intensity;
+};
+
+SampledLight LoadSampledLight(uint index)
+{
+    const uint address = index * 48;
+    const float4 posType = asfloat(gSampledLights.Load4(address));
+
+    SampledLight light;
+    light.posW = posType.xyz;
+    light.type = asuint(posType.w);
+    light.dirW = asfloat(gSampledLights.Load3(address + 16));
+    light.intensity = asfloat(gSampledLights.Load3(address + 32));
+    return light;
+}
+
+// Picks a light in proportion to its weight, u in [0, 1)
+uint SampleLight(float u, out float pdf)
+{
+    uint size;
+    gLightAliasTable.GetDimensions(size);
+    const uint count = size / 16;
+
+    const float scaled = u * float(count);
+    const uint slot = min(uint(scaled), count - 1);
+    const uint4 entry = gLightAliasTable.Load4(slot * 16);
+    const bool own = scaled - float(slot) < asfloat(entry.x);
+    pdf = asfloat(own ? entry.z : entry.w);
+    return own ? slot : entry.y;
+}
+
+void GetSampledLightDirection(SampledLight light, float3 posW, out float3 direction, out float maxT)
+{
+    if (light.type == LightPoint)
+    {
+        direction = light.posW - posW;
+        maxT = length(direction);
+    }
+    else
+    {
+        direction = -light.dirW;
+        maxT = 1000.0;
+    }
+}
+
+// evalMaterial() for one light, unshadowed
+float3 EvalSampledLight(ShadingData sd, SampledLight light)
+{
+    float3 L;
+    float3 intensity = light.intensity;
+    if (light.type == LightPoint)
+    {
+        const float3 toLight = light.posW - sd.posW;
+        const float distanceSquared = max(1e-8, dot(toLight, toLight));
+        L = toLight / sqrt(distanceSquared);
+        intensity /= distanceSquared;
+    }
+    else
+    {
+        L = -light.dirW;
+    }
+
+    const float NdotL = saturate(dot(sd.N, L));
+    if (NdotL <= 0.0) return 0.0;
+
+    const float3 H = normalize(sd.V + L);
+    const float NdotH = saturate(dot(sd.N, H));
+    const float LdotH = saturate(dot(L, H));
+
+    const float3 diffuse = sd.diffuse * M_INV_PI;
+    const float D = evalGGX(sd.roughness, NdotH);
+    const float G = evalSmithGGX(NdotL, sd.NdotV, sd.roughness);
+    const float3 F = fresnelSchlick(sd.specular, 1, LdotH);
+    const float3 specular = F * D * G * M_INV_PI;
+
+    return (diffuse + specular) * intensity * NdotL;
+}
+
+#endif
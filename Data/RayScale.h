@@ -0,0 +1,49 @@
+#ifndef RAY_SCALE_H
+#define RAY_SCALE_H
+
+// Resolution at which a ray traced effect is launched, mirrors RayScale in RayUpsamplePass.h
+#define RAY_SCALE_FULL          0
+#define RAY_SCALE_HALF          1   // One ray per 2x2 block
+#define RAY_SCALE_CHECKERBOARD  2   // One ray per 2x1 block, alternating rows
+#define RAY_SCALE_QUARTER       3   // One ray per 4x4 block
+
+// Full-res pixels covered by one traced pixel
+uint2 GetRayScaleFactor(uint scale)
+{
+    if (scale == RAY_SCALE_HALF) return uint2(2, 2);
+    if (scale == RAY_SCALE_CHECKERBOARD) return uint2(2, 1);
+    if (scale == RAY_SCALE_QUARTER) return uint2(4, 4);
+    return uint2(1, 1);
+}
+
+// Full-res pixel a traced pixel stands for. The position inside its block changes every frame,
+// so the temporal filter still sees every pixel over a few frames.
+uint2 GetTracedPixel(uint2 tracedPos, uint scale, uint frameCount)
+{
+    if (scale == RAY_SCALE_HALF)
+    {
+        const uint2 offsets[4] = { uint2(0, 0), uint2(1, 1), uint2(1, 0), uint2(0, 1) };
+        return tracedPos * 2 + offsets[frameCount & 3];
+    }
+    if (scale == RAY_SCALE_CHECKERBOARD)
+    {
+        return uint2(tracedPos.x * 2 + ((tracedPos.y + frameCount) & 1), tracedPos.y);
+    }
+    if (scale == RAY_SCALE_QUARTER)
+    {
+        // 4x4 Bayer order
+        const uint bayer[16] = { 0, 10, 2, 8, 5, 15, 7, 13, 1, 11, 3, 9, 4, 14, 6, 12 };
+        const uint index = bayer[frameCount & 15];
+        return tracedPos * 4 + uint2(index & 3, index >> 2);
+    }
+    return tracedPos;
+}
+
+// Random seed of the full-res pixel, so every scale draws the same sequence a full-res launch would
+uint GetTracedPixelIndex(uint2 tracedPos, uint2 tracedDim, uint scale, uint frameCount)
+{
+    const uint2 pixel = GetTracedPixel(tracedPos, scale, frameCount);
+    return pixel.x + pixel.y * tracedDim.x * GetRayScaleFactor(scale).x;
+}
+
+#endif
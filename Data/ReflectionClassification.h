@@ -0,0 +1,53 @@
+#ifndef REFLECTION_CLASSIFICATION_H
+#define REFLECTION_CLASSIFICATION_H
+
+// Reflection classes written by ReflectionClassification.slang, mirrors Cpu/ReflectionClassification.h. Mirror pixels
+// trace a ray every frame, the glossy pixels of a 2x2 quad share one ray and rough pixels trace none, the deferred pass
+// shades them with GetPrefilteredReflection(). Work list entries are x | y << 14 | class << 28, the pixel packed as in
+// AdaptiveSampling.h, gWorkListCount holds their number. Needs RayScale.h included and Shading imported.
+
+#define REFLECTION_MIRROR   0
+#define REFLECTION_GLOSSY   1
+#define REFLECTION_ROUGH    2   // Pixels without geometry too
+
+// The miss color of the reflection rays, the environment rough pixels see without probes
+static const float3 kReflectionEnvironment = float3(0.2, 0.6, 0.9);
+
+// From the G-buffer's linear roughness, before the 0.08 clamp of LoadGBuffer()
+uint GetReflectionClass(float linearRoughness, float glossyRoughness, float roughRoughness)
+{
+    if (linearRoughness >= roughRoughness) return REFLECTION_ROUGH;
+    return linearRoughness >= glossyRoughness ? REFLECTION_GLOSSY : REFLECTION_MIRROR;
+}
+
+uint GetReflectionEntryClass(uint entry)
+{
+    return entry >> 28;
+}
+
+// The k-th pixel of a 2x2 quad in the order its glossy pixels take turns tracing, starting at the one RAY_SCALE_HALF
+// traces this frame
+uint2 GetGlossyQuadPixel(uint2 quad, uint frameCount, uint k)
+{
+    return GetTracedPixel(quad, RAY_SCALE_HALF, frameCount + k);
+}
+
+// Directional albedo of the specular lobe, Karis' analytic fit of the split sum environment BRDF ("Physically Based
+// Shading on Mobile"). What a traced reflection converges to under a constant environment of radiance 1.
+float3 EnvBRDFApprox(float3 specular, float linearRoughness, float NdotV)
+{
+    const float4 c0 = float4(-1.0, -0.0275, -0.572, 0.022);
+    const float4 c1 = float4(1.0, 0.0425, 1.04, -0.04);
+    const float4 r = linearRoughness * c0 + c1;
+    const float a004 = min(r.x * r.x, exp2(-9.28 * NdotV)) * r.x + r.y;
+    const float2 AB = float2(-1.04, 1.04) * a004 + r.zw;
+    return specular * AB.x + AB.y;
+}
+
+// Reflection of a rough pixel from the radiance prefiltered around its mirror direction
+float3 GetPrefilteredReflection(ShadingData sd, float3 prefilteredRadiance)
+{
+    return prefilteredRadiance * EnvBRDFApprox(sd.specular, sd.linearRoughness, sd.NdotV);
+}
+
+#endif
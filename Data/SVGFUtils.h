@@ -26,6 +26,72 @@ uint DirToOct(float3 normal)
     return (asuint(f32tof16(e.y)) << 16) + (asuint(f32tof16(e.x)));
 }
 
+// Whether last frame's sample at coord can be reused for a pixel: inside the screen, and with depth and normal within
+// the pixel's screen space derivatives. Shared by every reprojection so the chains agree on what is disoccluded.
+bool IsReprjValid(int2 coord, int2 imageDim, float Z, float Zprev, float zDeriv, float3 normal, float3 normalPrev, float normalDeriv)
+{
+    // check whether reprojected pixel is inside of the screen
+    if (any(lessThan(coord, int2(1, 1))) || any(greaterThan(coord, imageDim - int2(1, 1)))) return false;
+
+    // check if deviation of depths is acceptable
+    if (abs(Zprev - Z) / (zDeriv + 1e-4) > 2.0) return false;
+
+    // check normals for compatibility
+    if (distance(normal, normalPrev) / (normalDeriv + 1e-2) > 16.0) return false;
+
+    return true;
+}
+
+// History layout. Scalar signals (SCALAR_SIGNAL, shadow and AO) keep (signal, variance) in RG16F filter targets and
+// (signal, variance, moments) in a single RGBA16F reprojection target. Color signals keep RGBA16F targets plus RG16F
+// moments. The moments are stored as EncodeMoments() packs them. The history length is R8Unorm and shared by all
+// filters (SVGFSharedHistory).
+#define HISTORY_LENGTH_SCALE 255.0
+
+// (rgb, variance) from a filter target
+float4 LoadFilteredSignal(Texture2D signalTexture, int2 ipos)
+{
+#if defined(SCALAR_SIGNAL)
+    const float2 s = signalTexture.Load(int3(ipos, 0)).rg;
+    return float4(s.x, 0.0, 0.0, s.y);
+#else
+    return signalTexture.Load(int3(ipos, 0));
+#endif
+}
+
+// (rgb, variance) to the value written to a filter target
+float4 PackFilteredSignal(float4 signal)
+{
+#if defined(SCALAR_SIGNAL)
+    return float4(signal.r, signal.a, 0.0, 0.0);
+#else
+    return signal;
+#endif
+}
+
+// The 16F reprojection targets keep the 1st moment and the variance instead of the 2nd moment. 2nd moment minus 1st
+// squared cancels the bits a converged pixel's variance needs, stored directly it keeps its own precision.
+float2 EncodeMoments(float2 moments)
+{
+    return float2(moments.r, max(0.0, moments.g - moments.r * moments.r));
+}
+
+// Scalar signals read the moments from the reprojection target itself
+float2 LoadMoments(Texture2D momentsTexture, int2 ipos)
+{
+#if defined(SCALAR_SIGNAL)
+    const float2 encoded = momentsTexture.Load(int3(ipos, 0)).ba;
+#else
+    const float2 encoded = momentsTexture.Load(int3(ipos, 0)).rg;
+#endif
+    return float2(encoded.r, encoded.g + encoded.r * encoded.r);
+}
+
+float LoadHistoryLength(Texture2D historyLengthTexture, int2 ipos)
+{
+    return round(historyLengthTexture.Load(int3(ipos, 0)).r * HISTORY_LENGTH_SCALE);
+}
+
 struct SVGFSample
 {
     float3 signal; float variance;
@@ -36,7 +102,7 @@ struct SVGFSample
 
 SVGFSample FetchSignalSample(Texture2D signalTexture, Texture2D ndTexture, int2 ipos)
 {
-    const float4 signal = signalTexture.Load(int3(ipos, 0));
+    const float4 signal = LoadFilteredSignal(signalTexture, ipos);
     const float4 nd = ndTexture.Load(int3(ipos, 0));
 
     SVGFSample s;
@@ -64,6 +130,56 @@ float ComputeWeight(SVGFSample sampleCenter, SVGFSample sampleP, float phiDepth,
     return exp(0.0 - max(wLdirect, 0.0) - max(wZ, 0.0)) * wNormal;
 }
 
+// Packed (multi-signal) layout used by the SVGFPacked_* passes:
+// reflection = (rgb, variance), scalar = (shadow, shadow variance, AO, AO variance)
+struct SVGFPackedSample
+{
+    float3 reflection; float reflectionVariance;
+    float4 scalar;
+    float3 normal; float linearZ;
+    float zDerivative;
+    float3 luminance; // reflection, shadow, AO
+};
+
+// Scalar signals are weighted like the float3(v, 0, 0) an R8 load gives the single-signal filter, so both modes match
+float ScalarLuminance(float v)
+{
+    return luminance(float3(v, 0.0, 0.0));
+}
+
+SVGFPackedSample FetchPackedSample(Texture2D reflectionTexture, Texture2D scalarTexture, Texture2D ndTexture, int2 ipos)
+{
+    const float4 reflection = reflectionTexture.Load(int3(ipos, 0));
+    const float4 scalar = scalarTexture.Load(int3(ipos, 0));
+    const float4 nd = ndTexture.Load(int3(ipos, 0));
+
+    SVGFPackedSample s;
+    s.reflection = reflection.rgb;
+    s.reflectionVariance = reflection.a;
+    s.scalar = scalar;
+    s.normal = normalize(OctToDir(asuint(nd.x)));
+    s.linearZ = nd.y;
+    s.zDerivative = nd.z;
+    s.luminance = float3(luminance(s.reflection), ScalarLuminance(scalar.x), ScalarLuminance(scalar.z));
+
+    return s;
+}
+
+// Depth and normal part of ComputeWeight, shared by every signal at a tap
+float ComputeGeometryWeight(SVGFPackedSample sampleCenter, SVGFPackedSample sampleP, float phiDepth, float phiNormal)
+{
+    const float wNormal = NormalDistanceCos(sampleCenter.normal, sampleP.normal, phiNormal);
+    const float wZ = (phiDepth == 0) ? 0.0f : abs(sampleCenter.linearZ - sampleP.linearZ) / phiDepth;
+
+    return exp(0.0 - max(wZ, 0.0)) * wNormal;
+}
+
+// Luminance part of ComputeWeight for the three packed signals at once
+float3 ComputeLuminanceWeights(float3 luminanceCenter, float3 luminanceP, float3 phiColor)
+{
+    return exp(0.0 - max(abs(luminanceCenter - luminanceP) / phiColor, 0.0));
+}
+
 #define COMPARE_FUNC2(TYPE) \
 bool2 equal(TYPE a, TYPE b)              { return bool2(a.x == b.x, a.y == b.y); } \
 bool2 notEqual(TYPE a, TYPE b)           { return bool2(a.x != b.x, a.y != b.y); } \
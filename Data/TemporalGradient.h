@@ -0,0 +1,46 @@
+#ifndef TEMPORAL_GRADIENT_H
+#define TEMPORAL_GRADIENT_H
+
+// A-SVGF temporal gradients, mirrors Cpu/TemporalGradient.h. The screen is split into 3x3 strata and every frame one
+// pixel per stratum is picked to be shaded again next frame with the seed it was traced with. SVGFSharedHistory keeps
+// the forward projected samples as (claim, seed): the claim is last frame's stratum << 4 | the pixel inside this
+// stratum, x + 3 * y, ~0 where no sample landed.
+
+#define GRADIENT_STRATUM_SIZE 3
+#define NO_GRADIENT_SAMPLE 0xFFFFFFFF
+
+uint2 GetGradientStratumPixel(uint2 stratum, uint offset)
+{
+    return stratum * GRADIENT_STRATUM_SIZE + uint2(offset % 3, offset / 3);
+}
+
+// The pixel of a stratum that frame frameCount picks to be shaded again, never the one that re-shaded last frame's
+// sample (claim)
+uint GetGradientSampleOffset(uint2 stratum, uint strataWidth, uint frameCount, uint claim)
+{
+    uint offset = rand_init(stratum.y * strataWidth + stratum.x, frameCount, 8) % 9;
+    if (claim != NO_GRADIENT_SAMPLE && offset == (claim & 0xF)) offset = (offset + 1) % 9;
+    return offset;
+}
+
+// The seed a launch at full ray scale draws for the pixel, overridden where a gradient sample landed
+uint GetGradientSeed(Texture2D<uint2> samples, uint2 pixel, uint seed)
+{
+    const uint2 sample = samples.Load(int3(pixel / GRADIENT_STRATUM_SIZE, 0));
+    const uint offset = (pixel.x % GRADIENT_STRATUM_SIZE) + (pixel.y % GRADIENT_STRATUM_SIZE) * GRADIENT_STRATUM_SIZE;
+    return (sample.x != NO_GRADIENT_SAMPLE && (sample.x & 0xF) == offset) ? sample.y : seed;
+}
+
+// How much of the history to drop for a filtered gradient (change, normalization, whether any sample contributed)
+float GetGradientLambda(float4 gradient)
+{
+    return gradient.z > 0.0 ? saturate(abs(gradient.x) / max(gradient.y, 1e-4)) : 0.0;
+}
+
+// History length the filter keeps after dropping lambda of it
+float GetGradientHistoryLength(float historyLength, float lambda)
+{
+    return max(1.0, historyLength * (1.0 - lambda));
+}
+
+#endif
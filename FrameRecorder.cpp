@@ -0,0 +1,142 @@
+#include <cstring>
+#include "FrameRecorder.h"
+
+using namespace Falcor;
+
+namespace
+{
+    // Frames in flight before a readback is collected, getData() would wait on the GPU below that
+    const size_t kReadbackLatency = 2;
+
+    bool GetCaptureFormat(ResourceFormat format, Cpu::CaptureFormat& captureFormat)
+    {
+        switch (format)
+        {
+        case ResourceFormat::RGBA32Float: captureFormat = Cpu::CaptureFormat::RGBA32Float; return true;
+        case ResourceFormat::RGBA16Float: captureFormat = Cpu::CaptureFormat::RGBA16Float; return true;
+        case ResourceFormat::RGBA8Unorm: captureFormat = Cpu::CaptureFormat::RGBA8Unorm; return true;
+        case ResourceFormat::R8Unorm: captureFormat = Cpu::CaptureFormat::R8Unorm; return true;
+        default: return false;
+        }
+    }
+
+    void CopyMatrix(const glm::mat4& matrix, float* dst)
+    {
+        std::memcpy(dst, &matrix[0][0], sizeof(float) * 16);
+    }
+}
+
+void FrameRecorder::Start(const std::string& path, Cpu::CaptureCompression compression)
+{
+    Stop();
+    if (!mWriter.Open(path, compression))
+    {
+        logError("FrameRecorder: failed to create " + path);
+        return;
+    }
+
+    mFrameIndex = 0;
+    mRecording = true;
+}
+
+void FrameRecorder::Stop()
+{
+    if (!mRecording) return;
+
+    ResolveFrames(0);
+    mWriter.Close();
+    mRecording = false;
+}
+
+void FrameRecorder::RecordFrame(
+    RenderContext* renderContext,
+    const Fbo::SharedPtr& gBuffer,
+    const Texture::SharedPtr& shadow,
+    const Texture::SharedPtr& reflection,
+    const Texture::SharedPtr& ao,
+    const Camera* camera)
+{
+    if (!mRecording) return;
+    if (mWriter.HasFailed())
+    {
+        logError("FrameRecorder: failed to write the capture");
+        Stop();
+        return;
+    }
+
+    PendingFrame frame;
+    frame.frameIndex = mFrameIndex++;
+    CopyMatrix(camera->getViewMatrix(), frame.camera.view);
+    CopyMatrix(camera->getProjMatrix(), frame.camera.projection);
+    CopyMatrix(camera->getPrevViewProjMatrix(), frame.camera.prevViewProjection);
+    const glm::vec3 position = camera->getPosition();
+    std::memcpy(frame.camera.position, &position, sizeof(frame.camera.position));
+    frame.camera.nearZ = camera->getNearPlane();
+    frame.camera.farZ = camera->getFarPlane();
+    frame.camera.jitter[0] = camera->getJitterX();
+    frame.camera.jitter[1] = camera->getJitterY();
+
+    // G-buffer attachments are in FrameTarget order
+    std::vector<std::pair<Cpu::FrameTarget, Texture::SharedPtr>> textures;
+    const uint32_t gBufferTargetCount = uint32_t(Cpu::FrameTarget::SVGF_CompactNormDepth) + 1;
+    for (uint32_t i = 0; i < gBufferTargetCount; ++i) textures.emplace_back(Cpu::FrameTarget(i), gBuffer->getColorTexture(i));
+    textures.emplace_back(Cpu::FrameTarget::Shadow, shadow);
+    textures.emplace_back(Cpu::FrameTarget::Reflection, reflection);
+    textures.emplace_back(Cpu::FrameTarget::AO, ao);
+
+    for (const auto& texture : textures)
+    {
+        if (!texture.second) continue;
+
+        PendingTarget target;
+        target.target = texture.first;
+        target.width = texture.second->getWidth();
+        target.height = texture.second->getHeight();
+        if (!GetCaptureFormat(texture.second->getFormat(), target.format)) continue;
+        target.readback = renderContext->asyncReadTextureSubresource(texture.second.get(), 0);
+        frame.targets.push_back(std::move(target));
+    }
+
+    mPendingFrames.push_back(std::move(frame));
+    ResolveFrames(kReadbackLatency);
+}
+
+void FrameRecorder::ResolveFrames(size_t keepFrames)
+{
+    while (mPendingFrames.size() > keepFrames)
+    {
+        PendingFrame& pending = mPendingFrames.front();
+
+        Cpu::CaptureFrame frame;
+        frame.frameIndex = pending.frameIndex;
+        frame.camera = pending.camera;
+        bool complete = true;
+        for (PendingTarget& pendingTarget : pending.targets)
+        {
+            Cpu::CaptureTarget target;
+            target.target = pendingTarget.target;
+            target.format = pendingTarget.format;
+            target.width = pendingTarget.width;
+            target.height = pendingTarget.height;
+            target.texels = pendingTarget.readback->getData();
+            if (target.texels.empty())
+            {
+                complete = false;
+                break;
+            }
+
+            // Rows of the readback are padded to the copy pitch
+            const size_t rowBytes = size_t(target.width) * Cpu::GetCaptureFormatBytes(target.format);
+            const size_t rowPitch = target.texels.size() / target.height;
+            if (rowPitch != rowBytes)
+            {
+                for (uint32_t y = 1; y < target.height; ++y) std::memmove(target.texels.data() + y * rowBytes, target.texels.data() + y * rowPitch, rowBytes);
+            }
+            target.texels.resize(rowBytes * target.height);
+            frame.targets.push_back(std::move(target));
+        }
+
+        if (complete) mWriter.Submit(std::move(frame));
+        mPendingFrames.pop_front();
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <deque>
+#include "Falcor.h"
+#include "Cpu/FrameCapture.h"
+
+// Streams the G-buffer, the noisy ray traced signals and the camera of consecutive frames to a Cpu/FrameCapture file,
+// so RaysBench can replay them without a GPU. Readbacks are collected kReadbackLatency frames after they were issued,
+// when the GPU is long done with them, and Cpu::FrameCaptureWriter compresses and writes on its own thread. Recording
+// costs the frame the copies, a frame is dropped rather than waited for when the writer falls behind.
+class FrameRecorder
+{
+public:
+    ~FrameRecorder() { Stop(); }
+
+    void Start(const std::string& path, Cpu::CaptureCompression compression);
+    // Collects the outstanding readbacks and waits for the writer
+    void Stop();
+    bool IsRecording() const { return mRecording; }
+
+    uint32_t GetRecordedFrameCount() const { return uint32_t(mWriter.GetStats().writtenFrames); }
+    Cpu::FrameCaptureStats GetStats() const { return mWriter.GetStats(); }
+
+    // Null signal textures are skipped, as are targets of a format the capture does not store
+    void RecordFrame(
+        Falcor::RenderContext* renderContext,
+        const Falcor::Fbo::SharedPtr& gBuffer,
+        const Falcor::Texture::SharedPtr& shadow,
+        const Falcor::Texture::SharedPtr& reflection,
+        const Falcor::Texture::SharedPtr& ao,
+        const Falcor::Camera* camera);
+
+private:
+    struct PendingTarget
+    {
+        Cpu::FrameTarget target;
+        Cpu::CaptureFormat format;
+        uint32_t width;
+        uint32_t height;
+        Falcor::CopyContext::ReadTextureTask::SharedPtr readback;
+    };
+
+    struct PendingFrame
+    {
+        uint32_t frameIndex;
+        Cpu::CaptureCamera camera;
+        std::vector<PendingTarget> targets;
+    };
+
+    // Hands all but the newest keepFrames frames to the writer
+    void ResolveFrames(size_t keepFrames);
+
+    std::deque<PendingFrame> mPendingFrames;
+    Cpu::FrameCaptureWriter mWriter;
+    uint32_t mFrameIndex = 0;
+    bool mRecording = false;
+};
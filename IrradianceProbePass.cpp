@@ -0,0 +1,235 @@
+#include <cfloat>
+#include "IrradianceProbePass.h"
+#include "PassProfiler.h"
+#include "SVGFSharedHistory.h"
+
+using namespace Falcor;
+
+namespace
+{
+    // Must match ProbeBlend.slang and Data/IrradianceProbes.h
+    const uint32_t kMaxRaysPerProbe = 256;
+    const uint32_t kIrradianceTexels = 6;
+    const uint32_t kVisibilityTexels = 14;
+
+    // Rays that miss see the sky the scene is cleared to
+    const glm::vec3 kSkyColor(0.2f, 0.6f, 0.9f);
+
+    const Resource::BindFlags kAtlasBindFlags = Resource::BindFlags::UnorderedAccess | Resource::BindFlags::ShaderResource;
+}
+
+IrradianceProbePass::IrradianceProbePass(TexturePool::SharedPtr texturePool)
+    : mTexturePool(texturePool),
+      mProbeCounts(8, 4, 8),
+      mAllocatedCounts(0),
+      mOrigin(0.0f),
+      mSpacing(1.0f),
+      mRaysPerProbe(64),
+      mRaysPerFrame(4096),
+      mHysteresis(0.9f),
+      mMaxDistance(4.0f),
+      mNormalBias(0.1f),
+      mMultiBounce(true),
+      mCursor(0),
+      mUpdatedProbes(0)
+{
+    RtProgram::Desc traceProgDesc;
+    traceProgDesc.addShaderLibrary("ProbeTrace.slang");
+    traceProgDesc.setRayGen("RayGen");
+    traceProgDesc.addHitGroup(0, "PrimaryCHS", "");
+    traceProgDesc.addHitGroup(1, "", "ShadowAHS");
+    traceProgDesc.addMiss(0, "PrimaryMiss");
+    traceProgDesc.addMiss(1, "ShadowMiss");
+
+    mTraceProgram = RtProgram::create(traceProgDesc);
+    mTraceState = RtState::create();
+    mTraceState->setProgram(mTraceProgram);
+    mTraceState->setMaxTraceRecursionDepth(2); // 1 probe ray and 1 shadow ray
+
+    mBlendProgram = ComputeProgram::createFromFile("ProbeBlend.slang", "main");
+    mBlendVars = ComputeVars::create(mBlendProgram->getReflector());
+    mBlendState = ComputeState::create();
+    mBlendState->setProgram(mBlendProgram);
+
+    Sampler::Desc samplerDesc;
+    samplerDesc.setFilterMode(Sampler::Filter::Linear, Sampler::Filter::Linear, Sampler::Filter::Point);
+    samplerDesc.setAddressingMode(Sampler::AddressMode::Clamp, Sampler::AddressMode::Clamp, Sampler::AddressMode::Clamp);
+    mSampler = Sampler::create(samplerDesc);
+}
+
+IrradianceProbePass::~IrradianceProbePass()
+{
+    ReleaseAtlases();
+}
+
+void IrradianceProbePass::SetScene(const RtScene::SharedPtr& scene)
+{
+    mScene = scene;
+    mTraceVars = RtProgramVars::create(mTraceProgram, mScene);
+    FitGrid();
+    Reset();
+}
+
+// Probes on the corners of the scene's bounds, as Cpu::FitProbeGrid()
+void IrradianceProbePass::FitGrid()
+{
+    glm::vec3 boundsMin(FLT_MAX);
+    glm::vec3 boundsMax(-FLT_MAX);
+    for (uint32_t m = 0; m < mScene->getModelCount(); ++m)
+    {
+        for (uint32_t i = 0; i < mScene->getModelInstanceCount(m); ++i)
+        {
+            const BoundingBox& box = mScene->getModelInstance(m, i)->getBoundingBox();
+            boundsMin = glm::min(boundsMin, box.getMinPos());
+            boundsMax = glm::max(boundsMax, box.getMaxPos());
+        }
+    }
+    if (boundsMin.x > boundsMax.x) boundsMin = boundsMax = glm::vec3(0.0f);
+
+    mOrigin = boundsMin;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const float extent = std::max(boundsMax[axis] - boundsMin[axis], 1e-3f);
+        mSpacing[axis] = mProbeCounts[axis] > 1 ? extent / float(mProbeCounts[axis] - 1) : extent;
+    }
+    mMaxDistance = 1.5f * glm::length(mSpacing);
+}
+
+void IrradianceProbePass::AllocateAtlases()
+{
+    ReleaseAtlases();
+
+    mProbeCounts = glm::max(mProbeCounts, glm::ivec3(1));
+    mAllocatedCounts = mProbeCounts;
+    const uint32_t columns = uint32_t(mProbeCounts.x * mProbeCounts.y);
+    const uint32_t rows = uint32_t(mProbeCounts.z);
+    mIrradiance = mTexturePool->Acquire(columns * (kIrradianceTexels + 2), rows * (kIrradianceTexels + 2), ResourceFormat::R11G11B10Float, kAtlasBindFlags);
+    mPrevIrradiance = mTexturePool->Acquire(columns * (kIrradianceTexels + 2), rows * (kIrradianceTexels + 2), ResourceFormat::R11G11B10Float, kAtlasBindFlags);
+    mVisibility = mTexturePool->Acquire(columns * (kVisibilityTexels + 2), rows * (kVisibilityTexels + 2), ResourceFormat::RG16Float, kAtlasBindFlags);
+    mPrevVisibility = mTexturePool->Acquire(columns * (kVisibilityTexels + 2), rows * (kVisibilityTexels + 2), ResourceFormat::RG16Float, kAtlasBindFlags);
+}
+
+void IrradianceProbePass::ReleaseAtlases()
+{
+    for (Texture::SharedPtr* texture : { &mIrradiance, &mPrevIrradiance, &mVisibility, &mPrevVisibility })
+    {
+        mTexturePool->Release(*texture);
+        *texture = nullptr;
+    }
+}
+
+uint32_t IrradianceProbePass::GetProbesPerFrame() const
+{
+    const uint32_t raysPerProbe = glm::clamp(mRaysPerProbe, 1u, kMaxRaysPerProbe);
+    return std::min(GetProbeCount(), std::max(1u, mRaysPerFrame / raysPerProbe));
+}
+
+void IrradianceProbePass::SetShaderData(const GraphicsVars::SharedPtr& vars) const
+{
+    vars["ProbeGridCB"]["gProbeOrigin"] = mOrigin;
+    vars["ProbeGridCB"]["gProbeNormalBias"] = mNormalBias;
+    vars["ProbeGridCB"]["gProbeSpacing"] = mSpacing;
+    vars["ProbeGridCB"]["gProbeCounts"] = mAllocatedCounts;
+    vars->setTexture("gProbeIrradiance", mIrradiance);
+    vars->setTexture("gProbeVisibility", mVisibility);
+    vars->setSampler("gProbeSampler", mSampler);
+}
+
+void IrradianceProbePass::Execute(RenderContext* renderContext, const RtSceneRenderer::SharedPtr& raytracer, Camera* camera, uint32_t frameCount)
+{
+    PROFILE_PASS("UpdateProbes");
+
+    if (mAllocatedCounts != glm::max(mProbeCounts, glm::ivec3(1)))
+    {
+        AllocateAtlases();
+        FitGrid();
+        Reset();
+    }
+
+    // Pooled textures hold whatever their last user left
+    if (mUpdatedProbes == 0)
+    {
+        renderContext->clearUAV(mIrradiance->getUAV().get(), glm::vec4(0.0f));
+        renderContext->clearUAV(mVisibility->getUAV().get(), glm::vec4(0.0f));
+    }
+
+    const uint32_t probeCount = GetProbeCount();
+    const uint32_t probesPerFrame = GetProbesPerFrame();
+    const uint32_t raysPerProbe = glm::clamp(mRaysPerProbe, 1u, kMaxRaysPerProbe);
+
+    const size_t rayResultsSize = size_t(probesPerFrame) * raysPerProbe * sizeof(glm::vec4);
+    if (!mRayResults || mRayResults->getSize() < rayResultsSize)
+    {
+        mRayResults = Buffer::create(rayResultsSize, Resource::BindFlags::UnorderedAccess | Resource::BindFlags::ShaderResource, Buffer::CpuAccess::None);
+    }
+
+    // The rays see last frame's probes
+    GraphicsVars::SharedPtr traceVars = mTraceVars->getGlobalVars();
+    SetShaderData(traceVars);
+    traceVars->setRawBuffer("gRayResults", mRayResults);
+    traceVars["PerFrameCB"]["gFrameCount"] = frameCount;
+    traceVars["PerFrameCB"]["gFirstProbe"] = mCursor;
+    traceVars["PerFrameCB"]["gProbeCount"] = probeCount;
+    traceVars["PerFrameCB"]["gMaxDistance"] = mMaxDistance;
+    traceVars["PerFrameCB"]["gSkyColor"] = kSkyColor;
+    traceVars["PerFrameCB"]["gMultiBounce"] = mMultiBounce;
+    raytracer->renderScene(renderContext, mTraceVars, mTraceState, uvec3(raysPerProbe, probesPerFrame, 1), camera);
+
+    // Probes not updated this frame keep their tiles
+    std::swap(mIrradiance, mPrevIrradiance);
+    std::swap(mVisibility, mPrevVisibility);
+    renderContext->copyResource(mIrradiance.get(), mPrevIrradiance.get());
+    renderContext->copyResource(mVisibility.get(), mPrevVisibility.get());
+
+    // A probe's first update since the reset takes the new value as is
+    const uint32_t freshProbes = mUpdatedProbes < probeCount ? uint32_t(std::min<uint64_t>(probesPerFrame, probeCount - mUpdatedProbes)) : 0;
+
+    mBlendVars["ProbeGridCB"]["gProbeOrigin"] = mOrigin;
+    mBlendVars["ProbeGridCB"]["gProbeSpacing"] = mSpacing;
+    mBlendVars["ProbeGridCB"]["gProbeCounts"] = mAllocatedCounts;
+    mBlendVars["PerFrameCB"]["gFrameCount"] = frameCount;
+    mBlendVars["PerFrameCB"]["gFirstProbe"] = mCursor;
+    mBlendVars["PerFrameCB"]["gProbeCount"] = probeCount;
+    mBlendVars["PerFrameCB"]["gRaysPerProbe"] = raysPerProbe;
+    mBlendVars["PerFrameCB"]["gFreshProbes"] = freshProbes;
+    mBlendVars["PerFrameCB"]["gHysteresis"] = glm::clamp(mHysteresis, 0.0f, 1.0f);
+    mBlendVars->setRawBuffer("gRayResults", mRayResults);
+    mBlendVars->setTexture("gPrevIrradiance", mPrevIrradiance);
+    mBlendVars->setTexture("gPrevVisibility", mPrevVisibility);
+    mBlendVars->setTexture("gOutIrradiance", mIrradiance);
+    mBlendVars->setTexture("gOutVisibility", mVisibility);
+
+    renderContext->pushComputeState(mBlendState);
+    renderContext->pushComputeVars(mBlendVars);
+    renderContext->dispatch(probesPerFrame, 1, 1);
+    renderContext->popComputeVars();
+    renderContext->popComputeState();
+
+    mCursor = (mCursor + probesPerFrame) % probeCount;
+    mUpdatedProbes += probesPerFrame;
+}
+
+size_t IrradianceProbePass::GetAllocatedBytes() const
+{
+    return GetTextureSizeInBytes(mIrradiance) + GetTextureSizeInBytes(mPrevIrradiance) + GetTextureSizeInBytes(mVisibility) +
+        GetTextureSizeInBytes(mPrevVisibility) + (mRayResults ? mRayResults->getSize() : 0);
+}
+
+void IrradianceProbePass::RenderGui(Gui* gui)
+{
+    bool changed = false;
+    changed |= gui->addIntSlider("Probes X", mProbeCounts.x, 1, 32);
+    changed |= gui->addIntSlider("Probes Y", mProbeCounts.y, 1, 32);
+    changed |= gui->addIntSlider("Probes Z", mProbeCounts.z, 1, 32);
+    gui->addIntSlider("Rays per Probe", *reinterpret_cast<int32_t*>(&mRaysPerProbe), 16, int32_t(kMaxRaysPerProbe));
+    gui->addIntSlider("Rays per Frame", *reinterpret_cast<int32_t*>(&mRaysPerFrame), 256, 65536);
+    gui->addFloatSlider("Hysteresis", mHysteresis, 0.0f, 0.99f);
+    gui->addFloatSlider("Normal Bias", mNormalBias, 0.0f, 1.0f);
+    if (gui->addCheckBox("Multiple Bounces", mMultiBounce)) Reset();
+    if (changed && mScene) FitGrid();
+
+    const uint32_t probesPerFrame = GetProbesPerFrame();
+    gui->addText(("Probes per frame: " + std::to_string(probesPerFrame) + ", full cycle every " +
+        std::to_string((GetProbeCount() + probesPerFrame - 1) / probesPerFrame) + " frames").c_str());
+    gui->addText(("Allocated: " + std::to_string(GetAllocatedBytes() >> 10) + " KB").c_str());
+}
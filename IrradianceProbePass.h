@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Falcor.h"
+#include "FalcorExperimental.h"
+#include "TexturePool.h"
+
+// World-space irradiance probes as a cheaper alternative to per-pixel near-field GI (DDGI). Each frame the next
+// probes of a round robin, as many as the ray budget allows, trace raysPerProbe rays (ProbeTrace.slang) that are
+// blended into their octahedral irradiance and distance tiles (ProbeBlend.slang). The deferred pass then shades
+// with SampleProbeIrradiance() from Data/IrradianceProbes.h, 8 probe lookups per pixel and no rays. The grid spans
+// the scene's bounds. Cpu::IrradianceProbes is the headless version.
+class IrradianceProbePass
+{
+public:
+    using SharedPtr = std::shared_ptr<IrradianceProbePass>;
+
+    explicit IrradianceProbePass(TexturePool::SharedPtr texturePool);
+    ~IrradianceProbePass();
+
+    // Creates the trace program's vars for the scene, fits the grid to its bounds and drops every probe
+    void SetScene(const Falcor::RtScene::SharedPtr& scene);
+
+    // Drops every probe, they are rebuilt over the next cycle
+    void Reset() { mCursor = 0; mUpdatedProbes = 0; }
+
+    void Execute(Falcor::RenderContext* renderContext, const Falcor::RtSceneRenderer::SharedPtr& raytracer, Falcor::Camera* camera, uint32_t frameCount);
+
+    // Binds the grid and the atlases of the last Execute for SampleProbeIrradiance()
+    void SetShaderData(const Falcor::GraphicsVars::SharedPtr& vars) const;
+
+    void RenderGui(Falcor::Gui* gui);
+
+    uint32_t GetProbeCount() const { return uint32_t(mProbeCounts.x * mProbeCounts.y * mProbeCounts.z); }
+    uint32_t GetProbesPerFrame() const;
+    size_t GetAllocatedBytes() const;
+
+private:
+    void AllocateAtlases();
+    void ReleaseAtlases();
+    void FitGrid();
+
+    Falcor::RtScene::SharedPtr mScene;
+
+    Falcor::RtProgram::SharedPtr mTraceProgram;
+    Falcor::RtProgramVars::SharedPtr mTraceVars;
+    Falcor::RtState::SharedPtr mTraceState;
+
+    Falcor::ComputeProgram::SharedPtr mBlendProgram;
+    Falcor::ComputeVars::SharedPtr mBlendVars;
+    Falcor::ComputeState::SharedPtr mBlendState;
+
+    Falcor::Sampler::SharedPtr mSampler;
+    Falcor::Buffer::SharedPtr mRayResults;
+    Falcor::Texture::SharedPtr mIrradiance;         // Written by the last Execute
+    Falcor::Texture::SharedPtr mPrevIrradiance;
+    Falcor::Texture::SharedPtr mVisibility;
+    Falcor::Texture::SharedPtr mPrevVisibility;
+
+    TexturePool::SharedPtr mTexturePool;
+
+    glm::ivec3 mProbeCounts;
+    glm::ivec3 mAllocatedCounts;
+    glm::vec3 mOrigin;
+    glm::vec3 mSpacing;
+    uint32_t mRaysPerProbe;
+    uint32_t mRaysPerFrame;     // Budget, mRaysPerFrame / mRaysPerProbe probes are updated per frame
+    float mHysteresis;
+    float mMaxDistance;
+    float mNormalBias;
+    bool mMultiBounce;
+
+    uint32_t mCursor;           // Next probe of the round robin
+    uint64_t mUpdatedProbes;    // Probe updates since the reset
+};
@@ -0,0 +1,153 @@
+#include "LightResamplingPass.h"
+#include "PassProfiler.h"
+#include "SVGFSharedHistory.h"
+
+using namespace Falcor;
+
+namespace
+{
+    // Must match LightResampling.slang
+    const uint32_t kTileSize = 16;
+}
+
+LightResamplingPass::LightResamplingPass(uint32_t width, uint32_t height, TexturePool::SharedPtr texturePool)
+    : mHasHistory(false),
+      mTexturePool(texturePool),
+      mCandidateCount(8),
+      mEnableTemporalReuse(true),
+      mEnableSpatialReuse(true),
+      mSpatialSamples(4),
+      mSpatialRadius(16.0f),
+      mMaxHistory(20)
+{
+    mTemporalProgram = ComputeProgram::createFromFile("LightResampling.slang", "Temporal");
+    mTemporalVars = ComputeVars::create(mTemporalProgram->getReflector());
+    mTemporalState = ComputeState::create();
+    mTemporalState->setProgram(mTemporalProgram);
+
+    mSpatialProgram = ComputeProgram::createFromFile("LightResampling.slang", "Spatial");
+    mSpatialVars = ComputeVars::create(mSpatialProgram->getReflector());
+    mSpatialState = ComputeState::create();
+    mSpatialState->setProgram(mSpatialProgram);
+
+    Resize(width, height);
+}
+
+LightResamplingPass::~LightResamplingPass()
+{
+    ReleaseTargets();
+}
+
+void LightResamplingPass::Resize(uint32_t width, uint32_t height)
+{
+    if (mReservoirs && mReservoirs->getWidth() == width && mReservoirs->getHeight() == height) return;
+
+    ReleaseTargets();
+
+    const Resource::BindFlags bindFlags = Resource::BindFlags::UnorderedAccess | Resource::BindFlags::ShaderResource;
+    mReservoirs = mTexturePool->Acquire(width, height, ResourceFormat::RGBA32Float, bindFlags);
+    mTemporalReservoirs = mTexturePool->Acquire(width, height, ResourceFormat::RGBA32Float, bindFlags);
+    mSpareReservoirs = mTexturePool->Acquire(width, height, ResourceFormat::RGBA32Float, bindFlags);
+    mNormalDepth = mTexturePool->Acquire(width, height, ResourceFormat::RGBA16Float, bindFlags);
+    mPrevNormalDepth = mTexturePool->Acquire(width, height, ResourceFormat::RGBA16Float, bindFlags);
+
+    // Pooled textures hold whatever their last user left
+    mHasHistory = false;
+}
+
+void LightResamplingPass::ReleaseTargets()
+{
+    for (Texture::SharedPtr* texture : { &mReservoirs, &mTemporalReservoirs, &mSpareReservoirs, &mNormalDepth, &mPrevNormalDepth })
+    {
+        mTexturePool->Release(*texture);
+        *texture = nullptr;
+    }
+}
+
+void LightResamplingPass::Execute(
+    RenderContext* renderContext,
+    const SceneLightSampler& lights,
+    Texture::SharedPtr worldPosition,
+    Texture::SharedPtr normalRoughness,
+    Texture::SharedPtr albedo,
+    Texture::SharedPtr motionVec,
+    Texture::SharedPtr linearZ,
+    const glm::vec3& cameraPosW,
+    uint32_t frameCount)
+{
+    PROFILE_PASS("LightResampling");
+
+    std::swap(mNormalDepth, mPrevNormalDepth);
+
+    const uint32_t candidateCount = std::max(1u, mCandidateCount);
+    const uint32_t groupsX = (mReservoirs->getWidth() + kTileSize - 1) / kTileSize;
+    const uint32_t groupsY = (mReservoirs->getHeight() + kTileSize - 1) / kTileSize;
+
+    for (const ComputeVars::SharedPtr& vars : { mTemporalVars, mSpatialVars })
+    {
+        vars->setTexture("gGBuf0", worldPosition);
+        vars->setTexture("gGBuf1", normalRoughness);
+        vars->setTexture("gGBuf2", albedo);
+        vars->setRawBuffer("gSampledLights", lights.GetLights());
+        vars->setRawBuffer("gLightAliasTable", lights.GetAliasTable());
+        vars["PerPassCB"]["gCameraPosW"] = cameraPosW;
+        vars["PerPassCB"]["gFrameCount"] = frameCount;
+        vars["PerPassCB"]["gCandidateCount"] = candidateCount;
+        vars["PerPassCB"]["gSpatialSamples"] = mSpatialSamples;
+        vars["PerPassCB"]["gSpatialRadius"] = mSpatialRadius;
+        vars["PerPassCB"]["gMaxHistoryM"] = float(std::max(1u, mMaxHistory) * candidateCount);
+    }
+
+    mTemporalVars->setTexture("gMotion", motionVec);
+    mTemporalVars->setTexture("gLinearZ", linearZ);
+    mTemporalVars->setTexture("gPrevReservoirs", mReservoirs);
+    mTemporalVars->setTexture("gPrevNormalDepth", mPrevNormalDepth);
+    mTemporalVars->setTexture("gOutNormalDepth", mNormalDepth);
+    mTemporalVars->setTexture("gOutReservoirs", mTemporalReservoirs);
+    mTemporalVars["PerPassCB"]["gUseHistory"] = mEnableTemporalReuse && mHasHistory;
+
+    renderContext->pushComputeState(mTemporalState);
+    renderContext->pushComputeVars(mTemporalVars);
+    renderContext->dispatch(groupsX, groupsY, 1);
+    renderContext->popComputeVars();
+    renderContext->popComputeState();
+
+    // The new reservoirs take the place of last frame's, which become the spare
+    if (mEnableSpatialReuse && mSpatialSamples > 0)
+    {
+        mSpatialVars->setTexture("gTemporalReservoirs", mTemporalReservoirs);
+        mSpatialVars->setTexture("gNormalDepth", mNormalDepth);
+        mSpatialVars->setTexture("gOutReservoirs", mSpareReservoirs);
+
+        renderContext->pushComputeState(mSpatialState);
+        renderContext->pushComputeVars(mSpatialVars);
+        renderContext->dispatch(groupsX, groupsY, 1);
+        renderContext->popComputeVars();
+        renderContext->popComputeState();
+
+        std::swap(mReservoirs, mSpareReservoirs);
+    }
+    else
+    {
+        std::swap(mReservoirs, mTemporalReservoirs);
+    }
+
+    mHasHistory = true;
+}
+
+size_t LightResamplingPass::GetAllocatedBytes() const
+{
+    return GetTextureSizeInBytes(mReservoirs) + GetTextureSizeInBytes(mTemporalReservoirs) + GetTextureSizeInBytes(mSpareReservoirs) +
+        GetTextureSizeInBytes(mNormalDepth) + GetTextureSizeInBytes(mPrevNormalDepth);
+}
+
+void LightResamplingPass::RenderGui(Gui* gui)
+{
+    gui->addIntSlider("Candidates", *reinterpret_cast<int32_t*>(&mCandidateCount), 1, 32);
+    gui->addCheckBox("Temporal Reuse", mEnableTemporalReuse);
+    gui->addCheckBox("Spatial Reuse", mEnableSpatialReuse);
+    gui->addIntSlider("Spatial Samples", *reinterpret_cast<int32_t*>(&mSpatialSamples), 1, 16);
+    gui->addFloatSlider("Spatial Radius", mSpatialRadius, 1.0f, 64.0f);
+    gui->addIntSlider("Max History", *reinterpret_cast<int32_t*>(&mMaxHistory), 1, 64);
+    gui->addText(("Allocated: " + std::to_string(GetAllocatedBytes() >> 20) + " MB").c_str());
+}
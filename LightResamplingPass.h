@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Falcor.h"
+#include "SceneLightSampler.h"
+#include "TexturePool.h"
+
+// Resamples the lights of SceneLightSampler per pixel before the shadow rays are traced (ReSTIR): every pixel draws a
+// few candidates from the alias table, keeps one in proportion to its unshadowed light, and merges last frame's
+// reservoir at its motion vector and those of a few neighbors with similar depth and normal. The shadow pass
+// (RESAMPLE_LIGHTS) then traces one ray towards each pixel's light and weights it by the reservoir. The biased
+// variant, merged lights are not traced for visibility at the pixel. Cpu::LightResampler is the headless version.
+class LightResamplingPass
+{
+public:
+    using SharedPtr = std::shared_ptr<LightResamplingPass>;
+
+    LightResamplingPass(uint32_t width, uint32_t height, TexturePool::SharedPtr texturePool);
+    ~LightResamplingPass();
+
+    // Reallocates the reservoirs at the new size and drops their history. Nothing happens at the current size.
+    void Resize(uint32_t width, uint32_t height);
+
+    // Drops last frame's reservoirs, after the lights changed
+    void Reset() { mHasHistory = false; }
+
+    void Execute(
+        Falcor::RenderContext* renderContext,
+        const SceneLightSampler& lights,
+        Falcor::Texture::SharedPtr worldPosition,
+        Falcor::Texture::SharedPtr normalRoughness,
+        Falcor::Texture::SharedPtr albedo,
+        Falcor::Texture::SharedPtr motionVec,
+        Falcor::Texture::SharedPtr linearZ,
+        const glm::vec3& cameraPosW,
+        uint32_t frameCount);
+
+    void RenderGui(Falcor::Gui* gui);
+
+    // RGBA32Float light, contribution weight, M and target pdf of the last Execute
+    Falcor::Texture::SharedPtr GetReservoirs() const { return mReservoirs; }
+
+    size_t GetAllocatedBytes() const;
+
+private:
+    void ReleaseTargets();
+
+    Falcor::ComputeProgram::SharedPtr mTemporalProgram;
+    Falcor::ComputeVars::SharedPtr mTemporalVars;
+    Falcor::ComputeState::SharedPtr mTemporalState;
+    Falcor::ComputeProgram::SharedPtr mSpatialProgram;
+    Falcor::ComputeVars::SharedPtr mSpatialVars;
+    Falcor::ComputeState::SharedPtr mSpatialState;
+
+    Falcor::Texture::SharedPtr mReservoirs;         // Last frame's until Execute writes the new ones
+    Falcor::Texture::SharedPtr mTemporalReservoirs;
+    Falcor::Texture::SharedPtr mSpareReservoirs;
+    Falcor::Texture::SharedPtr mNormalDepth;
+    Falcor::Texture::SharedPtr mPrevNormalDepth;
+    bool mHasHistory;
+
+    TexturePool::SharedPtr mTexturePool;
+
+    uint32_t mCandidateCount;   // Lights drawn from the alias table per pixel and frame
+    bool mEnableTemporalReuse;
+    bool mEnableSpatialReuse;
+    uint32_t mSpatialSamples;   // Neighbors merged per pixel
+    float mSpatialRadius;       // In pixels
+    uint32_t mMaxHistory;       // Last frame's reservoir counts as at most this many times mCandidateCount
+};
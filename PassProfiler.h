@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Falcor.h"
+#include "Cpu/FrameProfiler.h"
+
+// Falcor keys its PROFILE events by name alone, so a scope nested in a pass is named by its path below the outermost
+// scope, "DenoiseAO/Atrous0". The passes directly inside RenderFrame keep their plain names.
+inline std::string GetGpuEventName(const std::string& path)
+{
+    const size_t root = path.find('/');
+    return root == std::string::npos ? path : path.substr(root + 1);
+}
+
+// Marks the scope's node for Cpu::FrameProfiler::ResolveGpuTimes() and returns the name of its event
+inline std::string BeginGpuEvent(const Cpu::ProfileScope& scope, const std::string& name)
+{
+    if (scope.GetNode() == Cpu::kNoProfileNode) return name;
+
+    Cpu::FrameProfiler* profiler = scope.GetProfiler();
+    if (!profiler->GetNode(scope.GetNode()).hasGpuEvent) profiler->MarkGpuEvent(scope.GetNode());
+    return GetGpuEventName(profiler->GetNode(scope.GetNode()).path);
+}
+
+// PROFILE plus a scope of the same name on the active Cpu::FrameProfiler, which RaysRenderer resolves to the GPU time
+// of the event at the end of the frame
+#define PROFILE_PASS(name) \
+    Cpu::ProfileScope FRAME_PROFILE_CONCAT(_passScope, __LINE__)(name); \
+    PROFILE(BeginGpuEvent(FRAME_PROFILE_CONCAT(_passScope, __LINE__), name))
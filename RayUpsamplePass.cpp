@@ -0,0 +1,70 @@
+#include "RayUpsamplePass.h"
+
+using namespace Falcor;
+
+RayUpsamplePass::RayUpsamplePass()
+    : mPhiDepth(3.0f),
+      mPhiNormal(128.0f)
+{
+    mUpsamplePass = FullScreenPass::create("RayUpsample.slang");
+    mUpsampleVars = GraphicsVars::create(mUpsamplePass->getProgram()->getReflector());
+    mUpsampleState = GraphicsState::create();
+}
+
+glm::uvec2 RayUpsamplePass::GetTracedSize(RayScale scale, uint32_t width, uint32_t height)
+{
+    switch (scale)
+    {
+    case RayScale::Half:
+        return glm::uvec2(std::max(1u, width / 2), std::max(1u, height / 2));
+    case RayScale::Checkerboard:
+        return glm::uvec2(std::max(1u, width / 2), height);
+    case RayScale::Quarter:
+        return glm::uvec2(std::max(1u, width / 4), std::max(1u, height / 4));
+    default:
+        return glm::uvec2(width, height);
+    }
+}
+
+const Gui::DropdownList& RayUpsamplePass::GetScaleList()
+{
+    static const Gui::DropdownList kScales =
+    {
+        { (int32_t)RayScale::Full, "Full" },
+        { (int32_t)RayScale::Half, "Half" },
+        { (int32_t)RayScale::Checkerboard, "Checkerboard" },
+        { (int32_t)RayScale::Quarter, "Quarter" },
+    };
+    return kScales;
+}
+
+void RayUpsamplePass::Execute(
+    RenderContext* renderContext,
+    RayScale scale,
+    uint32_t frameCount,
+    Texture::SharedPtr tracedSignal,
+    Texture::SharedPtr normalDepth,
+    Fbo::SharedPtr output)
+{
+    mUpsampleVars->setTexture("gTracedSignal", tracedSignal);
+    mUpsampleVars->setTexture("gCompactNormDepth", normalDepth);
+
+    mUpsampleVars["PerPassCB"]["gRayScale"] = (uint32_t)scale;
+    mUpsampleVars["PerPassCB"]["gFrameCount"] = frameCount;
+    mUpsampleVars["PerPassCB"]["gPhiDepth"] = mPhiDepth;
+    mUpsampleVars["PerPassCB"]["gPhiNormal"] = mPhiNormal;
+
+    mUpsampleState->setFbo(output);
+
+    renderContext->pushGraphicsState(mUpsampleState);
+    renderContext->pushGraphicsVars(mUpsampleVars);
+    mUpsamplePass->execute(renderContext);
+    renderContext->popGraphicsVars();
+    renderContext->popGraphicsState();
+}
+
+void RayUpsamplePass::RenderGui(Gui* gui)
+{
+    gui->addFloatSlider("Upsample Phi Depth", mPhiDepth, 0.1f, 16.0f);
+    gui->addFloatSlider("Upsample Phi Normal", mPhiNormal, 1.0f, 256.0f);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Falcor.h"
+
+// Resolution at which a ray traced effect is launched, mirrors Data/RayScale.h
+enum class RayScale : uint32_t
+{
+    Full = 0,
+    Half,           // One ray per 2x2 block
+    Checkerboard,   // One ray per 2x1 block, alternating rows
+    Quarter         // One ray per 4x4 block
+};
+
+// Joint-bilateral upsampler for effects traced below full resolution. Guided by SVGF_CompactNormDepth,
+// so the denoiser and the deferred pass keep consuming a full-res signal.
+class RayUpsamplePass
+{
+public:
+    using SharedPtr = std::shared_ptr<RayUpsamplePass>;
+
+    RayUpsamplePass();
+
+    // Size of the texture an effect traces into
+    static glm::uvec2 GetTracedSize(RayScale scale, uint32_t width, uint32_t height);
+
+    static const Falcor::Gui::DropdownList& GetScaleList();
+
+    void Execute(
+        Falcor::RenderContext* renderContext,
+        RayScale scale,
+        uint32_t frameCount,
+        Falcor::Texture::SharedPtr tracedSignal,
+        Falcor::Texture::SharedPtr normalDepth,
+        Falcor::Fbo::SharedPtr output);
+
+    void RenderGui(Falcor::Gui* gui);
+
+private:
+    Falcor::FullScreenPass::UniquePtr mUpsamplePass;
+    Falcor::GraphicsVars::SharedPtr mUpsampleVars;
+    Falcor::GraphicsState::SharedPtr mUpsampleState;
+
+    float mPhiDepth;
+    float mPhiNormal;
+};
@@ -1,4 +1,5 @@
 #include "RaysRenderer.h"
+#include "PassProfiler.h"
 
 namespace
 {
@@ -6,6 +7,36 @@ namespace
     static const char* kDefaultScene = "Data/Models/Pica.fscene";
     static const glm::vec4 kClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     static const glm::vec4 kSkyColor(0.2f, 0.6f, 0.9f, 1.0f);
+    static const char* kFrameCapturePath = "FrameCapture.rcap";
+    static const char* kTimingTracePath = "RaysTiming.json";
+    static const char* kTimingFramesPath = "RaysTimingFrames.csv";
+    static const char* kTimingStatsPath = "RaysTimingStats.csv";
+
+    // Full-res textures are also render targets of the upsampler
+    const Resource::BindFlags kRaytraceBindFlags = Resource::BindFlags::UnorderedAccess | Resource::BindFlags::ShaderResource | Resource::BindFlags::RenderTarget;
+    const Resource::BindFlags kTracedBindFlags = Resource::BindFlags::UnorderedAccess | Resource::BindFlags::ShaderResource;
+    const Resource::BindFlags kUpscaleBindFlags = Resource::BindFlags::RenderTarget | Resource::BindFlags::ShaderResource;
+
+    // Render graph resources. GBuffer, SVGFHistory and the denoised signals are owned by their passes
+    // and only order the graph, the noisy signals are transient.
+    static const char* kBackbuffer = "Backbuffer";
+    static const char* kGBufferResource = "GBuffer";
+    static const char* kSVGFHistory = "SVGFHistory";
+    static const char* kShadows = "Shadows";
+    static const char* kReflection = "Reflection";
+    static const char* kAO = "AO";
+    static const char* kDenoisedShadows = "DenoisedShadows";
+    static const char* kDenoisedReflection = "DenoisedReflection";
+    static const char* kDenoisedAO = "DenoisedAO";
+    static const char* kSceneColor = "SceneColor";
+    static const char* kUpscaledMotion = "UpscaledMotion";
+    static const char* kIrradianceProbes = "IrradianceProbes";
+
+    // The full-res texture itself when tracing at full resolution
+    std::string GetTracedTextureName(const std::string& name, RayScale scale)
+    {
+        return (scale == RayScale::Full) ? name : name + "Traced";
+    }
 
     enum GBuffer : uint32_t
     {
@@ -16,31 +47,88 @@ namespace
         SVGF_LinearZ,
         SVGF_CompactNormDepth
     };
+
+    Fbo::Desc GetGBufferDesc()
+    {
+        Fbo::Desc fboDesc;
+        fboDesc.setColorTarget(GBuffer::WorldPosition, ResourceFormat::RGBA32Float);
+        fboDesc.setColorTarget(GBuffer::NormalRoughness, ResourceFormat::RGBA32Float);
+        fboDesc.setColorTarget(GBuffer::Albedo, ResourceFormat::RGBA8Unorm);
+        fboDesc.setColorTarget(GBuffer::MotionVector, ResourceFormat::RGBA16Float);
+        fboDesc.setColorTarget(GBuffer::SVGF_LinearZ, ResourceFormat::RGBA16Float);
+        fboDesc.setColorTarget(GBuffer::SVGF_CompactNormDepth, ResourceFormat::RGBA16Float);
+        fboDesc.setDepthStencilTarget(ResourceFormat::D32Float);
+        return fboDesc;
+    }
+
+    Fbo::Desc GetTAAFboDesc()
+    {
+        Fbo::Desc fboDesc;
+        fboDesc.setColorTarget(0, ResourceFormat::RGBA8UnormSrgb);
+        return fboDesc;
+    }
+
+    // GPU time of a PROFILE scope in the last profiled frame
+    float GetProfiledMs(const char* name)
+    {
+        return (float)Profiler::getEventGpuTime(name);
+    }
+
+    const uint32_t kShadowEffect = uint32_t(Cpu::DynamicEffect::Shadows);
+    const uint32_t kReflectionEffect = uint32_t(Cpu::DynamicEffect::Reflection);
+    const uint32_t kAOEffect = uint32_t(Cpu::DynamicEffect::AO);
 }
 
 void RaysRenderer::onLoad(SampleCallbacks* sample, RenderContext* renderContext)
 {
     mFrameCount = 0;
+    Cpu::FrameProfiler::SetActive(&mFrameProfiler);
     mEnableRaytracedShadows = true;
     mEnableRaytracedReflection = true;
     mEnableRaytracedAO = true;
     mEnableDenoiseShadows = true;
     mEnableDenoiseReflection = true;
     mEnableDenoiseAO = true;
+    mEnablePackedDenoising = false;
+    mEnableAdaptiveSampling = false;
+    mEnableTemporalGradients = false;
+    mEnableReflectionClassification = false;
+    mLightSampler = std::make_shared<SceneLightSampler>();
+    mEnableLightSampling = false;
+    mLightSamplingUserSet = false;
+    mEnableLightResampling = false;
     mEnableNearFieldGI = true;
+    mEnableProbeGI = false;
+    mCompressCapture = false;
     mEnableTAA = true;
     mRenderMode = RenderMode::Hybrid;
     mAODistance = 3.0f;
+    mReflectionBounces = 2;
     mNearFieldGIStrength = 0.5f;
+    mProbeGIStrength = 1.0f;
+    mShadowRayScale = RayScale::Full;
+    mReflectionRayScale = RayScale::Full;
+    mAORayScale = RayScale::Full;
+    mRaytracingBackend = RaytracingBackend::DXR;
+    mCpuRaytracer = std::make_shared<CpuRaytracingBackend>();
+    mEnableDynamicResolution = false;
+    mRenderScale = 1.0f;
+    mTexturePool = std::make_shared<TexturePool>();
+    mRenderGraph = std::make_shared<RenderGraph>(mTexturePool);
+    mProbeGI = std::make_shared<IrradianceProbePass>(mTexturePool);
+    mRenderGraphDirty = true;
+    mResetTemporalHistory = true;
 
     uint32_t width = sample->getCurrentFbo()->getWidth();
     uint32_t height = sample->getCurrentFbo()->getHeight();
+    mOutputWidth = width;
+    mOutputHeight = height;
 
     mCamera = Camera::create();
     mCamera->setAspectRatio((float)width / (float)height);
     mCamController.attachCamera(mCamera);
 
-    SetupScene(kDefaultScene);
+    SetupScene(mSceneLoader.Load(renderContext, kDefaultScene), kDefaultScene);
     SetupRendering(width, height);
     SetupRaytracing(width, height);
     SetupDenoising(width, height);
@@ -49,12 +137,18 @@ void RaysRenderer::onLoad(SampleCallbacks* sample, RenderContext* renderContext)
     ConfigureDeferredProgram();
 }
 
-void RaysRenderer::SetupScene(const std::string& filename)
+void RaysRenderer::SetupScene(const RtScene::SharedPtr& scene, const std::string& filename)
 {
-    mScene = RtScene::loadFromFile(filename, RtBuildFlags::None, Model::LoadFlags::None, Scene::LoadFlags::None);
+    mScene = scene;
 
     mSceneRenderer = SceneRenderer::create(mScene);
     mRaytracer = RtSceneRenderer::create(mScene);
+    mCpuRaytracer->SetScene(mScene, mSceneLoader.GetCpuScene());
+
+    // A single light is cheaper to shade directly, unless the user asked for sampling either way
+    mLightSampler->Update(mScene);
+    if (!mLightSamplingUserSet) mEnableLightSampling = mLightSampler->GetLightCount() > 1;
+    if (mLightResampler) mLightResampler->Reset();
 
     if (filename == kDefaultScene)
     {
@@ -87,6 +181,30 @@ void RaysRenderer::SetupScene(const std::string& filename)
     mCamController.setCameraSpeed(radius);
 }
 
+// Scenes load in the background and are swapped in here, before anything of the frame uses the scene
+void RaysRenderer::UpdateSceneLoading(RenderContext* renderContext, uint32_t width, uint32_t height)
+{
+    switch (mSceneLoader.Update(renderContext))
+    {
+    case SceneCacheLoader::Event::SceneReady:
+        SetupScene(mSceneLoader.GetScene(), mSceneLoader.GetFilename());
+        SetupRaytracing(width, height);
+        ConfigureDeferredProgram();
+        mResetTemporalHistory = true;
+        if (mEnableDynamicResolution)
+        {
+            mDynamicResolution.Reset();
+            ApplyDynamicResolutionState();
+        }
+        break;
+    case SceneCacheLoader::Event::CpuSceneReady:
+        mCpuRaytracer->SetScene(mScene, mSceneLoader.GetCpuScene());
+        break;
+    default:
+        break;
+    }
+}
+
 void RaysRenderer::SetupRendering(uint32_t width, uint32_t height)
 {
     // Forward pass
@@ -102,15 +220,7 @@ void RaysRenderer::SetupRendering(uint32_t width, uint32_t height)
     mGBufferState = GraphicsState::create();
     mGBufferState->setProgram(mGBufferProgram);
 
-    Fbo::Desc fboDesc;
-    fboDesc.setColorTarget(GBuffer::WorldPosition, ResourceFormat::RGBA32Float);
-    fboDesc.setColorTarget(GBuffer::NormalRoughness, ResourceFormat::RGBA32Float);
-    fboDesc.setColorTarget(GBuffer::Albedo, ResourceFormat::RGBA8Unorm);
-    fboDesc.setColorTarget(GBuffer::MotionVector, ResourceFormat::RGBA16Float);
-    fboDesc.setColorTarget(GBuffer::SVGF_LinearZ, ResourceFormat::RGBA16Float);
-    fboDesc.setColorTarget(GBuffer::SVGF_CompactNormDepth, ResourceFormat::RGBA16Float);
-    fboDesc.setDepthStencilTarget(ResourceFormat::D32Float);
-    mGBuffer = FboHelper::create2D(width, height, fboDesc);
+    mGBuffer = mTexturePool->CreateFbo(width, height, GetGBufferDesc());
 
     // Deferred pass
     mDeferredPass = FullScreenPass::create("Deferred.slang");
@@ -134,10 +244,7 @@ void RaysRenderer::SetupRaytracing(uint32_t width, uint32_t height)
 
     mRtReflectionState = RtState::create();
     mRtReflectionState->setProgram(mRtReflectionProgram);
-    mRtReflectionState->setMaxTraceRecursionDepth(4); // 1 camera ray, 2 reflection and 1 NEE ray
-
-    Resource::BindFlags bindFlags = Resource::BindFlags::UnorderedAccess | Resource::BindFlags::ShaderResource;
-    mReflectionTexture = Texture::create2D(width, height, ResourceFormat::RGBA16Float, 1, 1, nullptr, bindFlags);
+    mRtReflectionState->setMaxTraceRecursionDepth(1); // The bounce loop traces every ray from RayGen
 
     // Raytraced shadows
     RtProgram::Desc shadowProgDesc;
@@ -153,8 +260,6 @@ void RaysRenderer::SetupRaytracing(uint32_t width, uint32_t height)
     mRtShadowState->setProgram(mRtShadowProgram);
     mRtShadowState->setMaxTraceRecursionDepth(1); // no recursion
 
-    mShadowTexture = Texture::create2D(width, height, ResourceFormat::R8Unorm, 1, 1, nullptr, bindFlags);
-
     // Raytraced AO
     RtProgram::Desc aoProgDesc;
     aoProgDesc.addShaderLibrary("RaytracedAO.slang");
@@ -169,29 +274,141 @@ void RaysRenderer::SetupRaytracing(uint32_t width, uint32_t height)
     mRtAOState->setProgram(mRtAOProgram);
     mRtAOState->setMaxTraceRecursionDepth(1);
 
-    mAOTexture = Texture::create2D(width, height, ResourceFormat::R8Unorm, 1, 1, nullptr, bindFlags);
+    mRayUpsample = std::make_shared<RayUpsamplePass>();
+    mProbeGI->SetScene(mScene);
+    mRenderGraphDirty = true;
 }
 
 void RaysRenderer::SetupDenoising(uint32_t width, uint32_t height)
 {
-    mShadowFilter = std::make_shared<SVGFPass>(width, height);
-    mReflectionFilter = std::make_shared<SVGFPass>(width, height);
-    mAOFilter = std::make_shared<SVGFPass>(width, height);
+    mSVGFHistory = std::make_shared<SVGFSharedHistory>(width, height, mTexturePool);
+    mShadowFilter = std::make_shared<SVGFPass>(width, height, SVGFPass::SignalType::Scalar, mSVGFHistory, mTexturePool);
+    mReflectionFilter = std::make_shared<SVGFPass>(width, height, SVGFPass::SignalType::Color, mSVGFHistory, mTexturePool);
+    mAOFilter = std::make_shared<SVGFPass>(width, height, SVGFPass::SignalType::Scalar, mSVGFHistory, mTexturePool);
+    mPackedFilter = std::make_shared<SVGFPackedPass>(width, height, mTexturePool);
+    mShadowSampler = std::make_shared<AdaptiveSamplingPass>(width, height, SVGFPass::SignalType::Scalar, mTexturePool);
+    mReflectionSampler = std::make_shared<AdaptiveSamplingPass>(width, height, SVGFPass::SignalType::Color, mTexturePool);
+    mAOSampler = std::make_shared<AdaptiveSamplingPass>(width, height, SVGFPass::SignalType::Scalar, mTexturePool);
+    mReflectionClassifier = std::make_shared<ReflectionClassificationPass>(width, height, mTexturePool);
+    mLightResampler = std::make_shared<LightResamplingPass>(width, height, mTexturePool);
 }
 
 void RaysRenderer::SetupTAA(uint32_t width, uint32_t height)
 {
     mTAA.pTAA = TemporalAA::create();
-
-    Fbo::Desc fboDesc;
-    fboDesc.setColorTarget(0, ResourceFormat::RGBA8UnormSrgb);
-    mTAA.createFbos(width, height, fboDesc);
+    mTAA.createFbos(*mTexturePool, width, height, GetTAAFboDesc());
 
     PatternGenerator::SharedPtr generator;
     generator = HaltonSamplePattern::create();
     mCamera->setPatternGenerator(generator, 1.0f / vec2(width, height));
 }
 
+// Reallocates everything sized by the swap chain. Nothing happens when the size did not change, textures of the
+// old size stay in the pool for a while so that resizing back does not allocate.
+void RaysRenderer::Resize(uint32_t width, uint32_t height)
+{
+    if (mOutputWidth == width && mOutputHeight == height) return;
+
+    mOutputWidth = width;
+    mOutputHeight = height;
+    mCamera->setAspectRatio((float)width / (float)height);
+
+    mTAA.createFbos(*mTexturePool, width, height, GetTAAFboDesc());
+    mResetTemporalHistory = true;
+
+    ResizeRenderTargets();
+
+    // The upscaling targets are render graph transients of the output size
+    mRenderGraphDirty = true;
+}
+
+// Reallocates everything sized by the render size, after a resize or a render scale change. TAA keeps its
+// history, it is sized by the output.
+void RaysRenderer::ResizeRenderTargets()
+{
+    const glm::uvec2 size = GetRenderSize();
+    if (mGBuffer->getWidth() == size.x && mGBuffer->getHeight() == size.y) return;
+
+    // Jitter by render pixels, TAA accumulates the jittered frames into output pixels
+    mCamera->setPatternGenerator(mCamera->getPatternGenerator(), 1.0f / vec2(size.x, size.y));
+
+    mRenderGraph->ReleaseTextures();
+    mTexturePool->ReleaseFbo(mGBuffer);
+    mGBuffer = mTexturePool->CreateFbo(size.x, size.y, GetGBufferDesc());
+
+    mSVGFHistory->Resize(size.x, size.y);
+    mShadowFilter->Resize(size.x, size.y);
+    mReflectionFilter->Resize(size.x, size.y);
+    mAOFilter->Resize(size.x, size.y);
+    mPackedFilter->Resize(size.x, size.y);
+    mShadowSampler->Resize(size.x, size.y);
+    mReflectionSampler->Resize(size.x, size.y);
+    mAOSampler->Resize(size.x, size.y);
+    mReflectionClassifier->Resize(size.x, size.y);
+    mLightResampler->Resize(size.x, size.y);
+
+    // The ray traced signals and their traced textures are render graph transients
+    mRenderGraphDirty = true;
+}
+
+glm::uvec2 RaysRenderer::GetRenderSize() const
+{
+    return glm::uvec2(std::max(1u, uint32_t(mOutputWidth * mRenderScale + 0.5f)), std::max(1u, uint32_t(mOutputHeight * mRenderScale + 0.5f)));
+}
+
+// Deferred rendering goes through SceneColor and an upscale when the G-buffer is smaller than the output
+bool RaysRenderer::UseRenderScale() const
+{
+    return mGBuffer->getWidth() != mOutputWidth || mGBuffer->getHeight() != mOutputHeight;
+}
+
+// Fed with the PROFILE scopes of the last frame, a new state takes effect with the next one. Forward rendering and
+// the path traced reference have no render scale and no ray traced effects to scale.
+void RaysRenderer::UpdateDynamicResolution()
+{
+    if (!mEnableDynamicResolution || mRenderMode == RenderMode::Forward || mRenderMode == RenderMode::PathTraced) return;
+
+    Cpu::DynamicResolutionTimings timings;
+    timings.frameMs = GetProfiledMs("RenderFrame");
+    if (mRenderMode == RenderMode::Hybrid)
+    {
+        if (mEnableRaytracedShadows) timings.traceMs[kShadowEffect] = GetProfiledMs("RaytraceShadows");
+        if (mEnableRaytracedReflection) timings.traceMs[kReflectionEffect] = GetProfiledMs("RaytraceReflection");
+        if (mEnableRaytracedAO) timings.traceMs[kAOEffect] = GetProfiledMs("RaytraceAO");
+
+        // The denoisers only scale with the render scale, the controller weighs them against fewer rays
+        if (UsePackedDenoising())
+        {
+            const float packedMs = GetProfiledMs("DenoisePacked") / float(Cpu::kDynamicEffectCount);
+            for (float& ms : timings.denoiseMs) ms = packedMs;
+        }
+        else
+        {
+            timings.denoiseMs[kShadowEffect] = GetProfiledMs("DenoiseShadows");
+            timings.denoiseMs[kReflectionEffect] = GetProfiledMs("DenoiseReflection");
+            timings.denoiseMs[kAOEffect] = GetProfiledMs("DenoiseAO");
+        }
+    }
+
+    if (mDynamicResolution.Update(timings))
+    {
+        ApplyDynamicResolutionState();
+    }
+}
+
+void RaysRenderer::ApplyDynamicResolutionState()
+{
+    // Cpu::RayScale mirrors ::RayScale
+    const Cpu::DynamicResolutionState& state = mDynamicResolution.GetState();
+    mShadowRayScale = (RayScale)state.rayScales[kShadowEffect];
+    mReflectionRayScale = (RayScale)state.rayScales[kReflectionEffect];
+    mAORayScale = (RayScale)state.rayScales[kAOEffect];
+    mRenderScale = state.renderScale;
+
+    ResizeRenderTargets();
+    mRenderGraphDirty = true;
+}
+
 void RaysRenderer::ConfigureDeferredProgram()
 {
     const auto& program = mDeferredPass->getProgram();
@@ -204,85 +421,361 @@ void RaysRenderer::ConfigureDeferredProgram()
     HANDLE_DEFINE(mEnableRaytracedShadows, "RAYTRACE_SHADOWS");
     HANDLE_DEFINE(mEnableRaytracedAO, "RAYTRACE_AO");
     HANDLE_DEFINE(mEnableNearFieldGI, "NEAR_FIELD_GI_APPROX");
+    HANDLE_DEFINE(mEnableProbeGI, "PROBE_GI");
+    HANDLE_DEFINE(UsePackedDenoising() && mEnableDenoiseAO, "PACKED_AO");
+    HANDLE_DEFINE(mEnableRaytracedShadows && UseLightSampling(), "SAMPLE_LIGHTS");
+
+    ConfigureLightSampling();
+    mRenderGraphDirty = true;
 }
 
-void RaysRenderer::onFrameRender(SampleCallbacks* sample, RenderContext* renderContext, const Fbo::SharedPtr& targetFbo)
+// Sampled lights turn the shadow signal from the visibility of the first light into the shadowed direct light of all
+// of them, a color signal with its own filter and sampler
+void RaysRenderer::ConfigureLightSampling()
 {
-    mCamera->beginFrame();
-    mCamController.update();
-    mSceneRenderer->update(sample->getCurrentTime());
+    const bool sampleLights = UseLightSampling();
+    for (const RtProgram::SharedPtr& program : { mRtShadowProgram, mRtReflectionProgram })
+    {
+        if (sampleLights) program->addDefine("SAMPLE_LIGHTS");
+        else program->removeDefine("SAMPLE_LIGHTS");
+    }
+    if (UseLightResampling()) mRtShadowProgram->addDefine("RESAMPLE_LIGHTS");
+    else mRtShadowProgram->removeDefine("RESAMPLE_LIGHTS");
+    mCpuRaytracer->SetLightSampling(sampleLights);
 
-    renderContext->clearFbo(targetFbo.get(), kSkyColor, 1.0f, 0u, FboAttachmentType::All);
-    renderContext->clearFbo(mTAA.getActiveFbo().get(), kClearColor, 1.0f, 0u, FboAttachmentType::Color);
+    const SVGFPass::SignalType signalType = sampleLights ? SVGFPass::SignalType::Color : SVGFPass::SignalType::Scalar;
+    if (mShadowFilter->GetSignalType() != signalType)
+    {
+        const glm::uvec2 size = GetRenderSize();
+        mShadowFilter = std::make_shared<SVGFPass>(size.x, size.y, signalType, mSVGFHistory, mTexturePool);
+        mShadowSampler = std::make_shared<AdaptiveSamplingPass>(size.x, size.y, signalType, mTexturePool);
+    }
+}
+
+// The packed filter needs all three signals and scalar shadows, otherwise the separate filters are used
+bool RaysRenderer::UsePackedDenoising() const
+{
+    return mEnablePackedDenoising && mEnableRaytracedShadows && mEnableRaytracedReflection && mEnableRaytracedAO && !UseLightSampling();
+}
+
+// Picked per scene in SetupScene(), SceneLightSampler needs at least one light
+bool RaysRenderer::UseLightSampling() const
+{
+    return mEnableLightSampling && mLightSampler->GetLightCount() > 0;
+}
+
+// Resamples the sampled lights of the DXR shadow pass, the CPU backend keeps picking them from the alias table
+bool RaysRenderer::UseLightResampling() const
+{
+    return mEnableLightResampling && UseLightSampling();
+}
+
+// The sampler reads the effect's own SVGF filter, and the work list holds full-res pixels for the DXR shaders
+bool RaysRenderer::UseAdaptiveSampling(RayScale scale, bool denoise) const
+{
+    return mEnableAdaptiveSampling && mRaytracingBackend == RaytracingBackend::DXR && scale == RayScale::Full && denoise && !UsePackedDenoising();
+}
+
+// The gradient samples re-trace full-res launch pixels with last frame's seeds, which work lists do not draw
+bool RaysRenderer::UseTemporalGradients(RayScale scale, bool denoise) const
+{
+    return mEnableTemporalGradients && mRaytracingBackend == RaytracingBackend::DXR && scale == RayScale::Full && denoise && !UsePackedDenoising() &&
+        !UseAdaptiveSampling(scale, denoise);
+}
+
+// Resampled lights change from frame to frame whatever the seed, so they would show up as a gradient everywhere
+bool RaysRenderer::UseShadowTemporalGradients() const
+{
+    return UseTemporalGradients(mShadowRayScale, mEnableDenoiseShadows) && !UseLightResampling();
+}
+
+// The work list holds full-res pixels and the deferred pass reads the classes per full-res pixel. The CPU backend keeps
+// tracing every pixel.
+bool RaysRenderer::UseReflectionClassification() const
+{
+    return mEnableReflectionClassification && mRaytracingBackend == RaytracingBackend::DXR && mReflectionRayScale == RayScale::Full;
+}
+
+// Classification takes the reflection work list, and its shared glossy rays would show up as gradients
+bool RaysRenderer::UseReflectionAdaptiveSampling() const
+{
+    return UseAdaptiveSampling(mReflectionRayScale, mEnableDenoiseReflection) && !UseReflectionClassification();
+}
+
+bool RaysRenderer::UseReflectionTemporalGradients() const
+{
+    return UseTemporalGradients(mReflectionRayScale, mEnableDenoiseReflection) && !UseReflectionClassification();
+}
+
+void RaysRenderer::BuildRenderGraph()
+{
+    mRenderGraph->Clear();
+    mRenderGraphDirty = false;
+
+    mRenderGraph->ImportTexture(kBackbuffer);
+    mRenderGraph->ImportTexture(kGBufferResource);
+    mRenderGraph->MarkOutput(kBackbuffer);
+
+    // Forward rendering and the path traced reference always draw at the output size
+    const bool rasterized = mRenderMode != RenderMode::Forward && mRenderMode != RenderMode::PathTraced;
+    const bool upscale = rasterized && UseRenderScale();
 
     if (mRenderMode == RenderMode::Forward)
     {
-        PROFILE("Forward");
-
-        mForwardState->setFbo(targetFbo);
-        renderContext->setGraphicsState(mForwardState);
-        renderContext->setGraphicsVars(mForwardVars);
-        mSceneRenderer->renderScene(renderContext, mCamera.get());
+        mRenderGraph->AddPass("Forward", {}, { kBackbuffer }, [this](RenderContext* renderContext) { ForwardPass(renderContext); });
     }
-    else if (mRenderMode == RenderMode::Deferred)
+    else if (mRenderMode == RenderMode::PathTraced)
     {
-        PROFILE("Deferred");
-
-        RenderGBuffer(renderContext);
-        DeferredPass(renderContext, targetFbo);
+        mRenderGraph->AddPass("PathTrace", {}, { kBackbuffer }, [this](RenderContext* renderContext)
+        {
+            PROFILE_PASS("PathTrace");
+            mCpuRaytracer->RenderReference(renderContext, mCamera.get(), mCurrentTargetFbo);
+        });
     }
-    else if (mRenderMode == RenderMode::Hybrid)
+    else
     {
-        PROFILE("Hybrid");
-
-        RenderGBuffer(renderContext);
-
-        const auto& motionTex = mGBuffer->getColorTexture(GBuffer::MotionVector);
-        const auto& linearZTex = mGBuffer->getColorTexture(GBuffer::SVGF_LinearZ);
-        const auto& compactTex = mGBuffer->getColorTexture(GBuffer::SVGF_CompactNormDepth);
+        mRenderGraph->AddPass("GBuffer", {}, { kGBufferResource }, [this](RenderContext* renderContext) { RenderGBuffer(renderContext); });
 
-        if (mEnableRaytracedShadows)
+        std::vector<std::string> deferredInputs = { kGBufferResource };
+        if (mRenderMode == RenderMode::Hybrid)
         {
-            RaytraceShadows(renderContext);
+            AddHybridPasses(deferredInputs);
         }
-        if (mEnableRaytracedReflection)
+
+        if (upscale)
         {
-            RaytraceReflection(renderContext);
+            mRenderGraph->AddTexture(kSceneColor, { mGBuffer->getWidth(), mGBuffer->getHeight(), ResourceFormat::RGBA8UnormSrgb, kUpscaleBindFlags });
+            mRenderGraph->AddPass("DeferredPass", deferredInputs, { kSceneColor }, [this](RenderContext* renderContext) { DeferredPass(renderContext, mRenderGraph->GetFbo(kSceneColor)); });
+            mRenderGraph->AddPass("Upscale", { kSceneColor }, { kBackbuffer }, [this](RenderContext* renderContext)
+            {
+                PROFILE_PASS("Upscale");
+                renderContext->blit(mRenderGraph->GetTexture(kSceneColor)->getSRV(), mCurrentTargetFbo->getColorTexture(0)->getRTV());
+            });
         }
-        if (mEnableRaytracedAO)
+        else
         {
-            RaytraceAmbientOcclusion(renderContext);
+            mRenderGraph->AddPass("DeferredPass", deferredInputs, { kBackbuffer }, [this](RenderContext* renderContext) { DeferredPass(renderContext, mCurrentTargetFbo); });
         }
-        if (mEnableRaytracedShadows && mEnableDenoiseShadows)
+    }
+
+    // TAA reprojects output pixels, so it needs the motion vectors at the output size. The path traced reference
+    // converges by itself and has no G-buffer to take motion from.
+    const bool taa = mEnableTAA && mRenderMode != RenderMode::PathTraced;
+    if (taa && UseRenderScale())
+    {
+        mRenderGraph->AddTexture(kUpscaledMotion, { mOutputWidth, mOutputHeight, ResourceFormat::RGBA16Float, kUpscaleBindFlags });
+        mRenderGraph->AddPass("UpscaleMotion", { kGBufferResource }, { kUpscaledMotion }, [this](RenderContext* renderContext)
         {
-            PROFILE("DenoiseShadows");
-            mDenoisedShadowTexture = mShadowFilter->Execute(renderContext, mShadowTexture, motionTex, linearZTex, compactTex);
-        }
-        if (mEnableRaytracedReflection && mEnableDenoiseReflection)
+            renderContext->blit(mGBuffer->getColorTexture(GBuffer::MotionVector)->getSRV(), mRenderGraph->GetTexture(kUpscaledMotion)->getRTV());
+        });
+        mRenderGraph->AddPass("TAA", { kBackbuffer, kUpscaledMotion }, { kBackbuffer }, [this](RenderContext* renderContext)
         {
-            PROFILE("DenoiseReflection");
-            mDenoisedReflectionTexture = mReflectionFilter->Execute(renderContext, mReflectionTexture, motionTex, linearZTex, compactTex);
-        }
-        if (mEnableRaytracedAO && mEnableDenoiseAO)
+            RunTAA(renderContext, mCurrentTargetFbo, mRenderGraph->GetTexture(kUpscaledMotion));
+        });
+    }
+    else if (taa)
+    {
+        mRenderGraph->AddPass("TAA", { kBackbuffer, kGBufferResource }, { kBackbuffer }, [this](RenderContext* renderContext)
         {
-            PROFILE("DenoiseAO");
-            mDenoisedAOTexture = mAOFilter->Execute(renderContext, mAOTexture, motionTex, linearZTex, compactTex);
-        }
+            RunTAA(renderContext, mCurrentTargetFbo, mGBuffer->getColorTexture(GBuffer::MotionVector));
+        });
+    }
+
+    mRenderGraph->Compile();
+}
+
+// Every effect is declared, the graph culls what the deferred pass does not read
+void RaysRenderer::AddHybridPasses(std::vector<std::string>& deferredInputs)
+{
+    const bool packed = UsePackedDenoising();
+
+    mRenderGraph->ImportTexture(kSVGFHistory);
+    mRenderGraph->ImportTexture(kDenoisedShadows);
+    mRenderGraph->ImportTexture(kDenoisedReflection);
+    mRenderGraph->ImportTexture(kDenoisedAO);
+
+    if (!packed)
+    {
+        mRenderGraph->AddPass("SVGFHistory", { kGBufferResource }, { kSVGFHistory }, [this](RenderContext* renderContext)
+        {
+            PROFILE_PASS("SVGFHistory");
+            mSVGFHistory->EnableTemporalGradients(UseShadowTemporalGradients() || UseReflectionTemporalGradients() ||
+                UseTemporalGradients(mAORayScale, mEnableDenoiseAO));
+            mSVGFHistory->Update(renderContext, mGBuffer->getColorTexture(GBuffer::MotionVector), mGBuffer->getColorTexture(GBuffer::SVGF_LinearZ), mFrameCount);
+        });
+    }
+
+    const ResourceFormat shadowFormat = UseLightSampling() ? ResourceFormat::RGBA16Float : ResourceFormat::R8Unorm;
+    AddRaytracePasses(kShadows, shadowFormat, mShadowRayScale, UseAdaptiveSampling(mShadowRayScale, mEnableDenoiseShadows) || UseShadowTemporalGradients(),
+        [this](RenderContext* renderContext) { RaytraceShadows(renderContext); });
+    if (!packed)
+    {
+        mRenderGraph->AddPass("DenoiseShadows", { kShadows, kGBufferResource, kSVGFHistory }, { kDenoisedShadows }, [this](RenderContext* renderContext)
+        {
+            PROFILE_PASS("DenoiseShadows");
+            mDenoisedShadowTexture = mShadowFilter->Execute(renderContext, mRenderGraph->GetTexture(kShadows), mGBuffer->getColorTexture(GBuffer::MotionVector),
+                mGBuffer->getColorTexture(GBuffer::SVGF_LinearZ), mGBuffer->getColorTexture(GBuffer::SVGF_CompactNormDepth),
+                UseAdaptiveSampling(mShadowRayScale, mEnableDenoiseShadows) ? mShadowSampler->GetRayCounts() : nullptr,
+                UseShadowTemporalGradients() ? mSVGFHistory->GetGradientSamples() : nullptr);
+        });
+    }
 
-        DeferredPass(renderContext, targetFbo);
+    AddRaytracePasses(kReflection, ResourceFormat::RGBA16Float, mReflectionRayScale,
+        UseReflectionAdaptiveSampling() || UseReflectionTemporalGradients(),
+        [this](RenderContext* renderContext) { RaytraceReflection(renderContext); });
+    if (!packed)
+    {
+        mRenderGraph->AddPass("DenoiseReflection", { kReflection, kGBufferResource, kSVGFHistory }, { kDenoisedReflection }, [this](RenderContext* renderContext)
+        {
+            PROFILE_PASS("DenoiseReflection");
+            mDenoisedReflectionTexture = mReflectionFilter->Execute(renderContext, mRenderGraph->GetTexture(kReflection), mGBuffer->getColorTexture(GBuffer::MotionVector),
+                mGBuffer->getColorTexture(GBuffer::SVGF_LinearZ), mGBuffer->getColorTexture(GBuffer::SVGF_CompactNormDepth),
+                UseReflectionAdaptiveSampling() ? mReflectionSampler->GetRayCounts() : nullptr,
+                UseReflectionTemporalGradients() ? mSVGFHistory->GetGradientSamples() : nullptr);
+        });
+    }
+
+    AddRaytracePasses(kAO, ResourceFormat::R8Unorm, mAORayScale, UseAdaptiveSampling(mAORayScale, mEnableDenoiseAO) || UseTemporalGradients(mAORayScale, mEnableDenoiseAO),
+        [this](RenderContext* renderContext) { RaytraceAmbientOcclusion(renderContext); });
+    if (!packed)
+    {
+        mRenderGraph->AddPass("DenoiseAO", { kAO, kGBufferResource, kSVGFHistory }, { kDenoisedAO }, [this](RenderContext* renderContext)
+        {
+            PROFILE_PASS("DenoiseAO");
+            mDenoisedAOTexture = mAOFilter->Execute(renderContext, mRenderGraph->GetTexture(kAO), mGBuffer->getColorTexture(GBuffer::MotionVector),
+                mGBuffer->getColorTexture(GBuffer::SVGF_LinearZ), mGBuffer->getColorTexture(GBuffer::SVGF_CompactNormDepth),
+                UseAdaptiveSampling(mAORayScale, mEnableDenoiseAO) ? mAOSampler->GetRayCounts() : nullptr,
+                UseTemporalGradients(mAORayScale, mEnableDenoiseAO) ? mSVGFHistory->GetGradientSamples() : nullptr);
+        });
+
+        mRenderGraph->AddPass("SVGFHistoryEnd", { kSVGFHistory }, {}, [this](RenderContext* renderContext)
+        {
+            PROFILE_PASS("SVGFHistoryEnd");
+            mSVGFHistory->EndFrame(renderContext);
+        }, true);
+    }
+    else
+    {
+        mRenderGraph->AddPass("DenoisePacked", { kReflection, kShadows, kAO, kGBufferResource }, { kDenoisedReflection, kDenoisedShadows, kDenoisedAO }, [this](RenderContext* renderContext)
+        {
+            PROFILE_PASS("DenoisePacked");
+            mPackedFilter->Execute(renderContext, mRenderGraph->GetTexture(kReflection), mRenderGraph->GetTexture(kShadows), mRenderGraph->GetTexture(kAO),
+                mGBuffer->getColorTexture(GBuffer::MotionVector), mGBuffer->getColorTexture(GBuffer::SVGF_LinearZ), mGBuffer->getColorTexture(GBuffer::SVGF_CompactNormDepth));
+            mDenoisedReflectionTexture = mPackedFilter->GetReflectionOutput();
+            mDenoisedShadowTexture = mPackedFilter->GetScalarOutput();
+            mDenoisedAOTexture = mPackedFilter->GetScalarOutput();
+        });
     }
 
-    if (mEnableTAA)
+    // Reads the noisy signals of the enabled effects, so it runs whenever they are traced
+    if (mFrameRecorder.IsRecording())
     {
-        RunTAA(renderContext, targetFbo);
+        std::vector<std::string> recorded;
+        if (mEnableRaytracedShadows) recorded.push_back(kShadows);
+        if (mEnableRaytracedReflection) recorded.push_back(kReflection);
+        if (mEnableRaytracedAO) recorded.push_back(kAO);
+
+        mRenderGraph->AddPass("RecordFrame", recorded, {}, [this](RenderContext* renderContext)
+        {
+            mFrameRecorder.RecordFrame(renderContext, mGBuffer,
+                mEnableRaytracedShadows ? mRenderGraph->GetTexture(kShadows) : nullptr,
+                mEnableRaytracedReflection ? mRenderGraph->GetTexture(kReflection) : nullptr,
+                mEnableRaytracedAO ? mRenderGraph->GetTexture(kAO) : nullptr, mCamera.get());
+        }, true);
     }
 
+    // The probes persist across frames, only the rays of this frame's probes are traced
+    mRenderGraph->ImportTexture(kIrradianceProbes);
+    mRenderGraph->AddPass("UpdateProbes", {}, { kIrradianceProbes }, [this](RenderContext* renderContext)
+    {
+        mProbeGI->Execute(renderContext, mRaytracer, mCamera.get(), mFrameCount);
+    });
+
+    if (mEnableRaytracedShadows) deferredInputs.push_back(mEnableDenoiseShadows ? kDenoisedShadows : kShadows);
+    if (mEnableRaytracedReflection) deferredInputs.push_back(mEnableDenoiseReflection ? kDenoisedReflection : kReflection);
+    if (mEnableRaytracedAO) deferredInputs.push_back(mEnableDenoiseAO ? kDenoisedAO : kAO);
+    if (mEnableProbeGI) deferredInputs.push_back(kIrradianceProbes);
+}
+
+// Traces `name` at `scale`, below full resolution into `name`Traced followed by an upsampling pass. An adaptive
+// trace runs its sampler first, which reads this frame's SVGF history.
+void RaysRenderer::AddRaytracePasses(const std::string& name, ResourceFormat format, RayScale scale, bool readsHistory, const RenderGraph::ExecuteCallback& trace)
+{
+    const uint32_t width = mGBuffer->getWidth();
+    const uint32_t height = mGBuffer->getHeight();
+    const std::string traced = GetTracedTextureName(name, scale);
+
+    mRenderGraph->AddTexture(name, { width, height, format, kRaytraceBindFlags });
+    if (scale == RayScale::Full)
+    {
+        const std::vector<std::string> inputs = readsHistory ? std::vector<std::string>{ kGBufferResource, kSVGFHistory } : std::vector<std::string>{ kGBufferResource };
+        mRenderGraph->AddPass("Raytrace" + name, inputs, { name }, trace);
+        return;
+    }
+
+    const glm::uvec2 tracedSize = RayUpsamplePass::GetTracedSize(scale, width, height);
+    mRenderGraph->AddTexture(traced, { tracedSize.x, tracedSize.y, format, kTracedBindFlags });
+    mRenderGraph->AddPass("Raytrace" + name, { kGBufferResource }, { traced }, trace);
+    mRenderGraph->AddPass("Upsample" + name, { traced, kGBufferResource }, { name }, [this, name, traced, scale](RenderContext* renderContext)
+    {
+        PROFILE_PASS("Upsample" + name);
+        mRayUpsample->Execute(renderContext, scale, mFrameCount, mRenderGraph->GetTexture(traced), mGBuffer->getColorTexture(GBuffer::SVGF_CompactNormDepth), mRenderGraph->GetFbo(name));
+    });
+}
+
+void RaysRenderer::onFrameRender(SampleCallbacks* sample, RenderContext* renderContext, const Fbo::SharedPtr& targetFbo)
+{
+    mFrameProfiler.BeginFrame(mFrameCount);
+    UpdateSceneLoading(renderContext, targetFbo->getWidth(), targetFbo->getHeight());
+    if (mLightSampler->Update(mScene)) mLightResampler->Reset();
+
+    mCamera->beginFrame();
+    mCamController.update();
+    mSceneRenderer->update(sample->getCurrentTime());
+
+    renderContext->clearFbo(targetFbo.get(), kSkyColor, 1.0f, 0u, FboAttachmentType::All);
+    renderContext->clearFbo(mTAA.getActiveFbo().get(), kClearColor, 1.0f, 0u, FboAttachmentType::Color);
+    if (mResetTemporalHistory)
+    {
+        renderContext->clearFbo(mTAA.getInactiveFbo().get(), kClearColor, 1.0f, 0u, FboAttachmentType::Color);
+        mResetTemporalHistory = false;
+    }
+
+    if (mRenderGraphDirty)
+    {
+        BuildRenderGraph();
+    }
+
+    mCurrentTargetFbo = targetFbo;
+    {
+        PROFILE_PASS("RenderFrame");
+        mRenderGraph->Execute(renderContext);
+    }
+    mCurrentTargetFbo = nullptr;
+
+    // The GPU times Falcor resolved last, a few frames behind the CPU times
+    mFrameProfiler.ResolveGpuTimes([](const Cpu::ProfileNode& node) { return Profiler::getEventGpuTime(GetGpuEventName(node.path)); });
+    mFrameProfiler.EndFrame();
+
+    mTexturePool->EndFrame();
+    UpdateDynamicResolution();
+
     mFrameCount++;
 }
 
+void RaysRenderer::ForwardPass(RenderContext* renderContext)
+{
+    PROFILE_PASS("Forward");
+
+    mForwardState->setFbo(mCurrentTargetFbo);
+    renderContext->setGraphicsState(mForwardState);
+    renderContext->setGraphicsVars(mForwardVars);
+    mSceneRenderer->renderScene(renderContext, mCamera.get());
+}
+
 void RaysRenderer::RenderGBuffer(RenderContext* renderContext)
 {
-    PROFILE("GBuffer");
+    PROFILE_PASS("GBuffer");
     mGBufferVars["PerFrameCB"]["gRenderTargetDim"] = glm::vec2(mGBuffer->getWidth(), mGBuffer->getHeight());
 
     mGBufferState->setFbo(mGBuffer);
@@ -312,62 +805,153 @@ void RaysRenderer::ForwardRaytrace(RenderContext* renderContext)
 
 void RaysRenderer::RaytraceShadows(RenderContext* renderContext)
 {
-    PROFILE("RaytraceShadows");
+    PROFILE_PASS("RaytraceShadows");
 
-    uint32_t width = mShadowTexture->getWidth();
-    uint32_t height = mShadowTexture->getHeight();
+    const Texture::SharedPtr output = mRenderGraph->GetTexture(GetTracedTextureName(kShadows, mShadowRayScale));
+    if (mRaytracingBackend == RaytracingBackend::CPU)
+    {
+        mCpuRaytracer->TraceShadows(renderContext, mGBuffer, mCamera.get(), mFrameCount, mShadowRayScale, output);
+        return;
+    }
 
-    mRtShadowVars->getGlobalVars()->setTexture("gOutput", mShadowTexture);
+    uint32_t width = output->getWidth();
+    uint32_t height = output->getHeight();
+
+    mRtShadowVars->getGlobalVars()->setTexture("gOutput", output);
     mRtShadowVars->getGlobalVars()->setTexture("gGBuf0", mGBuffer->getColorTexture(GBuffer::WorldPosition));
+    if (UseLightSampling())
+    {
+        mRtShadowVars->getGlobalVars()->setTexture("gGBuf1", mGBuffer->getColorTexture(GBuffer::NormalRoughness));
+        mRtShadowVars->getGlobalVars()->setTexture("gGBuf2", mGBuffer->getColorTexture(GBuffer::Albedo));
+        mRtShadowVars->getGlobalVars()->setRawBuffer("gSampledLights", mLightSampler->GetLights());
+        mRtShadowVars->getGlobalVars()->setRawBuffer("gLightAliasTable", mLightSampler->GetAliasTable());
+    }
+    if (UseLightResampling())
+    {
+        mLightResampler->Execute(renderContext, *mLightSampler, mGBuffer->getColorTexture(GBuffer::WorldPosition),
+            mGBuffer->getColorTexture(GBuffer::NormalRoughness), mGBuffer->getColorTexture(GBuffer::Albedo),
+            mGBuffer->getColorTexture(GBuffer::MotionVector), mGBuffer->getColorTexture(GBuffer::SVGF_LinearZ), mCamera->getPosition(), mFrameCount);
+        mRtShadowVars->getGlobalVars()->setTexture("gLightReservoirs", mLightResampler->GetReservoirs());
+    }
+    mRtShadowVars->getGlobalVars()->setRawBuffer("gWorkList", mShadowSampler->GetWorkList());
+    mRtShadowVars->getGlobalVars()->setRawBuffer("gWorkListCount", mShadowSampler->GetWorkListCount());
+    mRtShadowVars->getGlobalVars()->setTexture("gGradientSamples", mSVGFHistory->GetGradientSamples());
+
+    const bool adaptive = UseAdaptiveSampling(mShadowRayScale, mEnableDenoiseShadows);
+    if (adaptive)
+    {
+        mShadowSampler->Execute(renderContext, *mSVGFHistory, *mShadowFilter, mGBuffer->getColorTexture(GBuffer::MotionVector),
+            mGBuffer->getColorTexture(GBuffer::SVGF_LinearZ), mFrameCount);
+    }
 
     auto shadowVars = mRtShadowVars->getGlobalVars();
     shadowVars["PerFrameCB"]["gFrameCount"] = mFrameCount;
+    shadowVars["PerFrameCB"]["gRayScale"] = (uint32_t)mShadowRayScale;
+    shadowVars["PerFrameCB"]["gAdaptiveSampling"] = adaptive;
+    shadowVars["PerFrameCB"]["gTemporalGradients"] = UseShadowTemporalGradients();
 
-    renderContext->clearUAV(mShadowTexture->getUAV().get(), kClearColor);
+    renderContext->clearUAV(output->getUAV().get(), kClearColor);
     mRaytracer->renderScene(renderContext, mRtShadowVars, mRtShadowState, uvec3(width, height, 1), mCamera.get());
 }
 
 void RaysRenderer::RaytraceReflection(RenderContext* renderContext)
 {
-    PROFILE("RaytraceReflection");
+    PROFILE_PASS("RaytraceReflection");
+
+    const Texture::SharedPtr output = mRenderGraph->GetTexture(GetTracedTextureName(kReflection, mReflectionRayScale));
+    if (mRaytracingBackend == RaytracingBackend::CPU)
+    {
+        mCpuRaytracer->SetReflectionBounces(mReflectionBounces);
+        mCpuRaytracer->TraceReflection(renderContext, mGBuffer, mCamera.get(), mFrameCount, mReflectionRayScale, output);
+        return;
+    }
 
-    uint32_t width = mReflectionTexture->getWidth();
-    uint32_t height = mReflectionTexture->getHeight();
+    uint32_t width = output->getWidth();
+    uint32_t height = output->getHeight();
 
-    mRtReflectionVars->getGlobalVars()->setTexture("gOutput", mReflectionTexture);
+    mRtReflectionVars->getGlobalVars()->setTexture("gOutput", output);
     mRtReflectionVars->getGlobalVars()->setTexture("gGBuf0", mGBuffer->getColorTexture(GBuffer::WorldPosition));
     mRtReflectionVars->getGlobalVars()->setTexture("gGBuf1", mGBuffer->getColorTexture(GBuffer::NormalRoughness));
     mRtReflectionVars->getGlobalVars()->setTexture("gGBuf2", mGBuffer->getColorTexture(GBuffer::Albedo));
+    if (UseLightSampling())
+    {
+        mRtReflectionVars->getGlobalVars()->setRawBuffer("gSampledLights", mLightSampler->GetLights());
+        mRtReflectionVars->getGlobalVars()->setRawBuffer("gLightAliasTable", mLightSampler->GetAliasTable());
+    }
+    mRtReflectionVars->getGlobalVars()->setTexture("gGradientSamples", mSVGFHistory->GetGradientSamples());
+    mRtReflectionVars->getGlobalVars()->setTexture("gReflectionClasses", mReflectionClassifier->GetClasses());
+
+    const bool adaptive = UseReflectionAdaptiveSampling();
+    if (adaptive)
+    {
+        mReflectionSampler->Execute(renderContext, *mSVGFHistory, *mReflectionFilter, mGBuffer->getColorTexture(GBuffer::MotionVector),
+            mGBuffer->getColorTexture(GBuffer::SVGF_LinearZ), mFrameCount);
+    }
+
+    const bool classified = UseReflectionClassification();
+    if (classified)
+    {
+        mReflectionClassifier->Execute(renderContext, mGBuffer->getColorTexture(GBuffer::WorldPosition), mGBuffer->getColorTexture(GBuffer::NormalRoughness), mFrameCount);
+    }
+
+    // The two never run together, the shader walks whichever work list is bound
+    mRtReflectionVars->getGlobalVars()->setRawBuffer("gWorkList", classified ? mReflectionClassifier->GetWorkList() : mReflectionSampler->GetWorkList());
+    mRtReflectionVars->getGlobalVars()->setRawBuffer("gWorkListCount", classified ? mReflectionClassifier->GetWorkListCount() : mReflectionSampler->GetWorkListCount());
 
     auto reflectionVars = mRtReflectionVars->getGlobalVars();
     reflectionVars["PerFrameCB"]["gFrameCount"] = mFrameCount;
+    reflectionVars["PerFrameCB"]["gRayScale"] = (uint32_t)mReflectionRayScale;
+    reflectionVars["PerFrameCB"]["gAdaptiveSampling"] = adaptive;
+    reflectionVars["PerFrameCB"]["gTemporalGradients"] = UseReflectionTemporalGradients();
+    reflectionVars["PerFrameCB"]["gClassifiedReflections"] = classified;
+    reflectionVars["PerFrameCB"]["gReflectionBounces"] = std::max(1u, mReflectionBounces);
 
-    renderContext->clearUAV(mReflectionTexture->getUAV().get(), kClearColor);
+    renderContext->clearUAV(output->getUAV().get(), kClearColor);
     mRaytracer->renderScene(renderContext, mRtReflectionVars, mRtReflectionState, uvec3(width, height, 1), mCamera.get());
 }
 
 void RaysRenderer::RaytraceAmbientOcclusion(RenderContext* renderContext)
 {
-    PROFILE("RaytraceAO");
+    PROFILE_PASS("RaytraceAO");
+
+    const Texture::SharedPtr output = mRenderGraph->GetTexture(GetTracedTextureName(kAO, mAORayScale));
+    if (mRaytracingBackend == RaytracingBackend::CPU)
+    {
+        mCpuRaytracer->TraceAO(renderContext, mGBuffer, mCamera.get(), mFrameCount, mAORayScale, mAODistance, output);
+        return;
+    }
 
-    uint32_t width = mAOTexture->getWidth();
-    uint32_t height = mAOTexture->getHeight();
+    uint32_t width = output->getWidth();
+    uint32_t height = output->getHeight();
 
-    mRtAOVars->getGlobalVars()->setTexture("gOutput", mAOTexture);
+    mRtAOVars->getGlobalVars()->setTexture("gOutput", output);
     mRtAOVars->getGlobalVars()->setTexture("gGBuf0", mGBuffer->getColorTexture(GBuffer::WorldPosition));
     mRtAOVars->getGlobalVars()->setTexture("gGBuf1", mGBuffer->getColorTexture(GBuffer::NormalRoughness));
+    mRtAOVars->getGlobalVars()->setRawBuffer("gWorkList", mAOSampler->GetWorkList());
+    mRtAOVars->getGlobalVars()->setRawBuffer("gWorkListCount", mAOSampler->GetWorkListCount());
+    mRtAOVars->getGlobalVars()->setTexture("gGradientSamples", mSVGFHistory->GetGradientSamples());
+
+    const bool adaptive = UseAdaptiveSampling(mAORayScale, mEnableDenoiseAO);
+    if (adaptive)
+    {
+        mAOSampler->Execute(renderContext, *mSVGFHistory, *mAOFilter, mGBuffer->getColorTexture(GBuffer::MotionVector),
+            mGBuffer->getColorTexture(GBuffer::SVGF_LinearZ), mFrameCount);
+    }
 
     auto aoVars = mRtAOVars->getGlobalVars();
     aoVars["PerFrameCB"]["gFrameCount"] = mFrameCount;
     aoVars["PerFrameCB"]["gAODistance"] = mAODistance;
+    aoVars["PerFrameCB"]["gRayScale"] = (uint32_t)mAORayScale;
+    aoVars["PerFrameCB"]["gAdaptiveSampling"] = adaptive;
+    aoVars["PerFrameCB"]["gTemporalGradients"] = UseTemporalGradients(mAORayScale, mEnableDenoiseAO);
 
-    renderContext->clearUAV(mAOTexture->getUAV().get(), kClearColor);
+    renderContext->clearUAV(output->getUAV().get(), kClearColor);
     mRaytracer->renderScene(renderContext, mRtAOVars, mRtAOState, uvec3(width, height, 1), mCamera.get());
 }
 
 void RaysRenderer::DeferredPass(RenderContext* renderContext, const Fbo::SharedPtr& targetFbo)
 {
-    PROFILE("DeferredPass");
+    PROFILE_PASS("DeferredPass");
 
     mCamera->setIntoConstantBuffer(mDeferredVars["InternalPerFrameCB"].get(), 0);
     if (mScene->getLightCount() > 0)
@@ -382,10 +966,17 @@ void RaysRenderer::DeferredPass(RenderContext* renderContext, const Fbo::SharedP
 
     if (mRenderMode == RenderMode::Hybrid)
     {
-        mDeferredVars->setTexture("gReflectionTexture", mEnableDenoiseReflection ? mDenoisedReflectionTexture : mReflectionTexture);
-        mDeferredVars->setTexture("gShadowTexture", mEnableDenoiseShadows ? mDenoisedShadowTexture : mShadowTexture);
-        mDeferredVars->setTexture("gAOTexture", mEnableDenoiseAO ? mDenoisedAOTexture : mAOTexture);
+        mDeferredVars->setTexture("gReflectionTexture", mEnableDenoiseReflection ? mDenoisedReflectionTexture : mRenderGraph->GetTexture(kReflection));
+        mDeferredVars->setTexture("gShadowTexture", mEnableDenoiseShadows ? mDenoisedShadowTexture : mRenderGraph->GetTexture(kShadows));
+        mDeferredVars->setTexture("gAOTexture", mEnableDenoiseAO ? mDenoisedAOTexture : mRenderGraph->GetTexture(kAO));
+        mDeferredVars->setTexture("gReflectionClasses", mReflectionClassifier->GetClasses());
         mDeferredVars["PerImageCB"]["gNearFieldGIStrength"] = mNearFieldGIStrength;
+        mDeferredVars["PerImageCB"]["gClassifiedReflections"] = UseReflectionClassification();
+        if (mEnableProbeGI)
+        {
+            mDeferredVars["PerImageCB"]["gProbeGIStrength"] = mProbeGIStrength;
+            mProbeGI->SetShaderData(mDeferredVars);
+        }
     }
 
     mDeferredState->setFbo(targetFbo);
@@ -394,16 +985,15 @@ void RaysRenderer::DeferredPass(RenderContext* renderContext, const Fbo::SharedP
     mDeferredPass->execute(renderContext);
 }
 
-void RaysRenderer::RunTAA(RenderContext* renderContext, const Fbo::SharedPtr& targetFbo)
+void RaysRenderer::RunTAA(RenderContext* renderContext, const Fbo::SharedPtr& targetFbo, const Texture::SharedPtr& motionVec)
 {
-    PROFILE("TAA");
+    PROFILE_PASS("TAA");
 
     const Texture::SharedPtr pCurColor = targetFbo->getColorTexture(0);
-    const Texture::SharedPtr pMotionVec = mGBuffer->getColorTexture(GBuffer::MotionVector);
     const Texture::SharedPtr pPrevColor = mTAA.getInactiveFbo()->getColorTexture(0);
 
     renderContext->getGraphicsState()->pushFbo(mTAA.getActiveFbo());
-    mTAA.pTAA->execute(renderContext, pCurColor, pPrevColor, pMotionVec);
+    mTAA.pTAA->execute(renderContext, pCurColor, pPrevColor, motionVec);
     renderContext->getGraphicsState()->popFbo();
 
     renderContext->blit(mTAA.getActiveFbo()->getColorTexture(0)->getSRV(0, 1), targetFbo->getColorTexture(0)->getRTV());
@@ -431,10 +1021,129 @@ void RaysRenderer::onGuiRender(SampleCallbacks* sample, Gui* gui)
             }
 
             gui->addFloatSlider("AO Distance", mAODistance, 0.1f, 20.0f);
+            gui->addIntSlider("Reflection Bounces", *reinterpret_cast<int32_t*>(&mReflectionBounces), 1, 8);
+
+            if (gui->beginGroup("Raytracing Backend"))
+            {
+                Gui::DropdownList backends;
+                backends.push_back({ RaytracingBackend::DXR, "GPU (DXR)" });
+                backends.push_back({ RaytracingBackend::CPU, "CPU (BVH)" });
+                // Adaptive sampling only runs on DXR and changes the render graph
+                mRenderGraphDirty |= gui->addDropdown("Backend", backends, *reinterpret_cast<uint32_t*>(&mRaytracingBackend));
+
+                if (mRaytracingBackend == RaytracingBackend::CPU)
+                {
+                    mCpuRaytracer->RenderGui(gui);
+                }
+                else
+                {
+                    // One ray per launched pixel, reflection rays also shade and bounce so only its launch rate is comparable
+                    const std::pair<const char*, std::string> effects[] = { { "Shadows", kShadows }, { "Reflection", kReflection }, { "AO", kAO } };
+                    const RayScale scales[] = { mShadowRayScale, mReflectionRayScale, mAORayScale };
+                    for (uint32_t i = 0; i < 3; ++i)
+                    {
+                        const glm::uvec2 tracedSize = RayUpsamplePass::GetTracedSize(scales[i], mGBuffer->getWidth(), mGBuffer->getHeight());
+                        const float ms = GetProfiledMs(("Raytrace" + effects[i].second).c_str());
+                        const float mrays = ms > 0.0f ? float(tracedSize.x * tracedSize.y) / (ms * 1000.0f) : 0.0f;
+                        gui->addText((std::string(effects[i].first) + ": " + std::to_string(ms) + " ms, " + std::to_string(mrays) + " Mrays/s").c_str());
+                    }
+                }
+                gui->endGroup();
+            }
+
+            // Picked by the controller while dynamic resolution is on
+            if (!mEnableDynamicResolution)
+            {
+                const Gui::DropdownList& rayScales = RayUpsamplePass::GetScaleList();
+                bool rayScaleChanged = gui->addDropdown("Reflection Rays", rayScales, *reinterpret_cast<uint32_t*>(&mReflectionRayScale));
+                rayScaleChanged |= gui->addDropdown("Shadow Rays", rayScales, *reinterpret_cast<uint32_t*>(&mShadowRayScale));
+                rayScaleChanged |= gui->addDropdown("AO Rays", rayScales, *reinterpret_cast<uint32_t*>(&mAORayScale));
+                if (rayScaleChanged)
+                {
+                    mRenderGraphDirty = true;
+                }
+            }
+            if (gui->beginGroup("Upsampling"))
+            {
+                mRayUpsample->RenderGui(gui);
+                gui->endGroup();
+            }
+
+            if (gui->beginGroup("Light Sampling"))
+            {
+                if (gui->addCheckBox("Sample Lights", mEnableLightSampling))
+                {
+                    mLightSamplingUserSet = true;
+                    ConfigureDeferredProgram();
+                }
+                mLightSampler->RenderGui(gui);
+                if (gui->addCheckBox("Resample Lights (DXR)", mEnableLightResampling))
+                {
+                    ConfigureLightSampling();
+                }
+                if (UseLightResampling() && gui->beginGroup("Resampling"))
+                {
+                    mLightResampler->RenderGui(gui);
+                    gui->endGroup();
+                }
+                gui->endGroup();
+            }
 
-            gui->addCheckBox("Denoise Reflection", mEnableDenoiseReflection);
-            gui->addCheckBox("Denoise Shadows", mEnableDenoiseShadows);
-            gui->addCheckBox("Denoise AO", mEnableDenoiseAO);
+            if (gui->beginGroup("Adaptive Sampling"))
+            {
+                gui->addText("DXR, full-res rays and separate denoising only");
+                mRenderGraphDirty |= gui->addCheckBox("Enable", mEnableAdaptiveSampling);
+                gui->addText(("Allocated: " + std::to_string((mShadowSampler->GetAllocatedBytes() + mReflectionSampler->GetAllocatedBytes() +
+                    mAOSampler->GetAllocatedBytes()) >> 20) + " MB").c_str());
+
+                const std::pair<const char*, AdaptiveSamplingPass::SharedPtr> samplers[] = { { "Reflection", mReflectionSampler }, { "Shadows", mShadowSampler }, { "AO", mAOSampler } };
+                for (const auto& sampler : samplers)
+                {
+                    if (gui->beginGroup(sampler.first))
+                    {
+                        sampler.second->RenderGui(gui);
+                        gui->endGroup();
+                    }
+                }
+                gui->endGroup();
+            }
+
+            if (gui->beginGroup("Temporal Gradients (A-SVGF)"))
+            {
+                gui->addText("DXR, full-res rays without adaptive sampling and separate denoising only");
+                mRenderGraphDirty |= gui->addCheckBox("Enable", mEnableTemporalGradients);
+                gui->endGroup();
+            }
+
+            if (gui->beginGroup("Reflection Classification"))
+            {
+                gui->addText("DXR and full-res reflection rays only, replaces adaptive sampling and gradients there");
+                mRenderGraphDirty |= gui->addCheckBox("Enable", mEnableReflectionClassification);
+                gui->addText(("Allocated: " + std::to_string(mReflectionClassifier->GetAllocatedBytes() >> 20) + " MB").c_str());
+                mReflectionClassifier->RenderGui(gui);
+                gui->endGroup();
+            }
+
+            mRenderGraphDirty |= gui->addCheckBox("Denoise Reflection", mEnableDenoiseReflection);
+            mRenderGraphDirty |= gui->addCheckBox("Denoise Shadows", mEnableDenoiseShadows);
+            if (gui->addCheckBox("Denoise AO", mEnableDenoiseAO))
+            {
+                ConfigureDeferredProgram();
+            }
+            if (gui->addCheckBox("Packed Denoising", mEnablePackedDenoising))
+            {
+                ConfigureDeferredProgram();
+            }
+
+            const size_t denoiserBytes = UsePackedDenoising() ? mPackedFilter->GetAllocatedBytes() :
+                mSVGFHistory->GetAllocatedBytes() + mShadowFilter->GetAllocatedBytes() + mReflectionFilter->GetAllocatedBytes() + mAOFilter->GetAllocatedBytes();
+            gui->addText(("Denoiser memory: " + std::to_string(denoiserBytes >> 20) + " MB").c_str());
+
+            if (gui->beginGroup("Packed Filter"))
+            {
+                mPackedFilter->RenderGui(gui);
+                gui->endGroup();
+            }
 
             if (gui->beginGroup("Reflection Filter"))
             {
@@ -460,11 +1169,112 @@ void RaysRenderer::onGuiRender(SampleCallbacks* sample, Gui* gui)
             }
 
             gui->addFloatSlider("Near Field GI Strength", mNearFieldGIStrength, 0.0f, 1.0f);
+
+            if (gui->beginGroup("Irradiance Probes (DXR)"))
+            {
+                if (gui->addCheckBox("Enable", mEnableProbeGI))
+                {
+                    mProbeGI->Reset();
+                    ConfigureDeferredProgram();
+                }
+                gui->addFloatSlider("Strength", mProbeGIStrength, 0.0f, 2.0f);
+                mProbeGI->RenderGui(gui);
+                gui->endGroup();
+            }
+
+            bool recording = mFrameRecorder.IsRecording();
+            if (gui->addCheckBox("Capture Frames", recording))
+            {
+                if (recording) mFrameRecorder.Start(kFrameCapturePath, mCompressCapture ? Cpu::CaptureCompression::ShuffleRle : Cpu::CaptureCompression::None);
+                else mFrameRecorder.Stop();
+                mRenderGraphDirty = true;
+            }
+            if (!recording)
+            {
+                gui->addCheckBox("Compress Capture", mCompressCapture);
+            }
+            else
+            {
+                const Cpu::FrameCaptureStats stats = mFrameRecorder.GetStats();
+                gui->addText(("Captured frames: " + std::to_string(stats.writtenFrames) + ", dropped: " + std::to_string(stats.droppedFrames)).c_str());
+                gui->addText(("Capture size: " + std::to_string(stats.fileBytes >> 20) + " MB of " + std::to_string(stats.rawBytes >> 20) + " MB").c_str());
+            }
+        }
+        else if (mRenderMode == RenderMode::PathTraced)
+        {
+            if (gui->beginGroup("Path Tracer"))
+            {
+                mCpuRaytracer->RenderReferenceGui(gui);
+                gui->endGroup();
+            }
         }
 
-        gui->addCheckBox("TAA", mEnableTAA);
+        mRenderGraphDirty |= gui->addCheckBox("TAA", mEnableTAA);
         mTAA.pTAA->renderUI(gui, "TAA");
 
+        if (gui->beginGroup("Dynamic Resolution"))
+        {
+            if (gui->addCheckBox("Enable", mEnableDynamicResolution))
+            {
+                // Starts from full quality, and leaves the ray scales where the controller left them
+                mDynamicResolution.Reset();
+                if (mEnableDynamicResolution)
+                {
+                    ApplyDynamicResolutionState();
+                }
+                else
+                {
+                    mRenderScale = 1.0f;
+                    ResizeRenderTargets();
+                }
+            }
+
+            Cpu::DynamicResolutionSettings& settings = mDynamicResolution.GetSettings();
+            gui->addFloatSlider("Target Frame (ms)", settings.targetFrameMs, 1.0f, 100.0f);
+            gui->addFloatSlider("Upgrade Headroom", settings.upgradeHeadroom, 0.0f, 0.5f);
+            gui->addFloatSlider("Min Render Scale", settings.minRenderScale, 0.25f, 1.0f);
+
+            const glm::uvec2 renderSize = GetRenderSize();
+            gui->addText(("Render size: " + std::to_string(renderSize.x) + "x" + std::to_string(renderSize.y) + " -> " +
+                std::to_string(mOutputWidth) + "x" + std::to_string(mOutputHeight)).c_str());
+            gui->addText(("Average frame: " + std::to_string(mDynamicResolution.GetAverageFrameMs()) + " ms").c_str());
+            gui->addText(("Downgrades: " + std::to_string(mDynamicResolution.GetDowngradeCount()) + ", changes: " + std::to_string(mDynamicResolution.GetChangeCount())).c_str());
+            if (mRenderMode == RenderMode::Hybrid)
+            {
+                const bool packed = UsePackedDenoising();
+                gui->addText(("Shadows: trace " + std::to_string(GetProfiledMs("RaytraceShadows")) + " ms, denoise " + std::to_string(GetProfiledMs(packed ? "DenoisePacked" : "DenoiseShadows")) + " ms").c_str());
+                gui->addText(("Reflection: trace " + std::to_string(GetProfiledMs("RaytraceReflection")) + " ms, denoise " + std::to_string(GetProfiledMs(packed ? "DenoisePacked" : "DenoiseReflection")) + " ms").c_str());
+                gui->addText(("AO: trace " + std::to_string(GetProfiledMs("RaytraceAO")) + " ms, denoise " + std::to_string(GetProfiledMs(packed ? "DenoisePacked" : "DenoiseAO")) + " ms").c_str());
+            }
+            gui->endGroup();
+        }
+
+        if (gui->beginGroup("Render Graph"))
+        {
+            mRenderGraph->RenderGui(gui);
+            mTexturePool->RenderGui(gui);
+            gui->endGroup();
+        }
+
+        if (gui->beginGroup("Timing"))
+        {
+            const Cpu::SampleStats frameStats = mFrameProfiler.GetFrameStats();
+            gui->addText(("Frame: p50 " + std::to_string(frameStats.p50) + " ms, p99 " + std::to_string(frameStats.p99) + " ms over " + std::to_string(frameStats.count) + " frames").c_str());
+            for (uint32_t node = 0; node < mFrameProfiler.GetNodeCount(); ++node)
+            {
+                if (mFrameProfiler.GetNode(node).parent == Cpu::kNoProfileNode) RenderTimingGui(gui, node);
+            }
+
+            if (gui->addButton("Export Timing"))
+            {
+                if (!mFrameProfiler.WriteChromeTrace(kTimingTracePath) || !mFrameProfiler.WriteFramesCsv(kTimingFramesPath) || !mFrameProfiler.WriteStatsCsv(kTimingStatsPath))
+                {
+                    logError("RaysRenderer: failed to write the timing exports");
+                }
+            }
+            gui->endGroup();
+        }
+
         gui->endGroup();
     }
 
@@ -486,8 +1296,7 @@ void RaysRenderer::onGuiRender(SampleCallbacks* sample, Gui* gui)
             std::string filename;
             if (openFileDialog(Scene::kFileExtensionFilters, filename))
             {
-                SetupScene(filename);
-                SetupRaytracing(sample->getCurrentFbo()->getWidth(), sample->getCurrentFbo()->getHeight());
+                mSceneLoader.BeginLoad(filename);
             }
         }
         if (mGroundMaterial)
@@ -500,12 +1309,33 @@ void RaysRenderer::onGuiRender(SampleCallbacks* sample, Gui* gui)
             EDIT_MATERIAL("Model", mBasicMaterial)
         }
 
+        if (gui->beginGroup("Scene Cache"))
+        {
+            mSceneLoader.RenderGui(gui);
+            gui->endGroup();
+        }
+
         mScene->renderUI(gui, "Scene");
 
         gui->endGroup();
     }
 }
 
+// One line per scope of the history, children indented below their parent
+void RaysRenderer::RenderTimingGui(Gui* gui, uint32_t node)
+{
+    const Cpu::ProfileNode& info = mFrameProfiler.GetNode(node);
+    const Cpu::SampleStats cpuStats = mFrameProfiler.GetCpuStats(node);
+    if (cpuStats.count == 0) return;
+
+    std::string text = std::string(2 * info.depth, ' ') + info.name + ": cpu p50 " + std::to_string(cpuStats.p50) + " p90 " + std::to_string(cpuStats.p90) + " p99 " + std::to_string(cpuStats.p99);
+    const Cpu::SampleStats gpuStats = mFrameProfiler.GetGpuStats(node);
+    if (gpuStats.count > 0) text += ", gpu p50 " + std::to_string(gpuStats.p50) + " p90 " + std::to_string(gpuStats.p90) + " p99 " + std::to_string(gpuStats.p99);
+    gui->addText(text.c_str());
+
+    for (uint32_t child : info.children) RenderTimingGui(gui, child);
+}
+
 bool RaysRenderer::onKeyEvent(SampleCallbacks* sample, const KeyboardEvent& keyEvent)
 {
     if (mCamController.onKeyEvent(keyEvent)) return true;
@@ -534,6 +1364,10 @@ void RaysRenderer::onDataReload(SampleCallbacks* sample)
 
 void RaysRenderer::onResizeSwapChain(SampleCallbacks* sample, uint32_t width, uint32_t height)
 {
+    // Nothing to resize before onLoad
+    if (!mGBuffer || width == 0 || height == 0) return;
+
+    Resize(width, height);
 }
 
 void RaysRenderer::onShutdown(SampleCallbacks* sample)
@@ -4,6 +4,20 @@
 #include "FalcorExperimental.h"
 #include "TAA.h"
 #include "SVGFPass.h"
+#include "SVGFPackedPass.h"
+#include "RayUpsamplePass.h"
+#include "AdaptiveSamplingPass.h"
+#include "ReflectionClassificationPass.h"
+#include "SceneLightSampler.h"
+#include "LightResamplingPass.h"
+#include "IrradianceProbePass.h"
+#include "FrameRecorder.h"
+#include "RenderGraph.h"
+#include "TexturePool.h"
+#include "CpuRaytracingBackend.h"
+#include "SceneCacheLoader.h"
+#include "Cpu/DynamicResolution.h"
+#include "Cpu/FrameProfiler.h"
 
 using namespace Falcor;
 
@@ -20,22 +34,45 @@ public:
     void onGuiRender(SampleCallbacks* sample, Gui* gui) override;
 
 private:
-    void SetupScene(const std::string& filename);
+    void SetupScene(const RtScene::SharedPtr& scene, const std::string& filename);
+    void UpdateSceneLoading(RenderContext* renderContext, uint32_t width, uint32_t height);
     void SetupRendering(uint32_t width, uint32_t height);
     void SetupRaytracing(uint32_t width, uint32_t height);
     void SetupDenoising(uint32_t width, uint32_t height);
     void SetupTAA(uint32_t width, uint32_t height);
+    void Resize(uint32_t width, uint32_t height);
+    void ResizeRenderTargets();
+    glm::uvec2 GetRenderSize() const;
+    bool UseRenderScale() const;
+    void UpdateDynamicResolution();
+    void ApplyDynamicResolutionState();
     void ConfigureDeferredProgram();
-
+    bool UsePackedDenoising() const;
+    bool UseAdaptiveSampling(RayScale scale, bool denoise) const;
+    bool UseTemporalGradients(RayScale scale, bool denoise) const;
+    bool UseShadowTemporalGradients() const;
+    bool UseReflectionClassification() const;
+    bool UseReflectionAdaptiveSampling() const;
+    bool UseReflectionTemporalGradients() const;
+    bool UseLightSampling() const;
+    bool UseLightResampling() const;
+    void ConfigureLightSampling();
+    void BuildRenderGraph();
+    void AddHybridPasses(std::vector<std::string>& deferredInputs);
+    void AddRaytracePasses(const std::string& name, ResourceFormat format, RayScale scale, bool readsHistory, const RenderGraph::ExecuteCallback& trace);
+
+    void ForwardPass(RenderContext* renderContext);
     void RenderGBuffer(RenderContext* renderContext);
     void DeferredPass(RenderContext* renderContext, const Fbo::SharedPtr& targetFbo);
     void ForwardRaytrace(RenderContext* renderContext);
     void RaytraceShadows(RenderContext* renderContext);
     void RaytraceReflection(RenderContext* renderContext);
     void RaytraceAmbientOcclusion(RenderContext* renderContext);
-    void RunTAA(RenderContext* renderContext, const Fbo::SharedPtr& colorFbo);
+    void RunTAA(RenderContext* renderContext, const Fbo::SharedPtr& colorFbo, const Texture::SharedPtr& motionVec);
+    void RenderTimingGui(Gui* gui, uint32_t node);
 
     RtScene::SharedPtr mScene;
+    SceneCacheLoader mSceneLoader;
     Material::SharedPtr mBasicMaterial;
     Material::SharedPtr mGroundMaterial;
 
@@ -53,24 +90,60 @@ private:
     RtProgram::SharedPtr mRtShadowProgram;
     RtProgramVars::SharedPtr mRtShadowVars;
     RtState::SharedPtr mRtShadowState;
-    Texture::SharedPtr mShadowTexture;
     Texture::SharedPtr mDenoisedShadowTexture;
 
     RtProgram::SharedPtr mRtReflectionProgram;
     RtProgramVars::SharedPtr mRtReflectionVars;
     RtState::SharedPtr mRtReflectionState;
-    Texture::SharedPtr mReflectionTexture;
     Texture::SharedPtr mDenoisedReflectionTexture;
 
     RtProgram::SharedPtr mRtAOProgram;
     RtProgramVars::SharedPtr mRtAOVars;
     RtState::SharedPtr mRtAOState;
-    Texture::SharedPtr mAOTexture;
     Texture::SharedPtr mDenoisedAOTexture;
 
+    // Effects traced below full resolution are upsampled into their full-res render graph texture
+    RayUpsamplePass::SharedPtr mRayUpsample;
+    RayScale mShadowRayScale;
+    RayScale mReflectionRayScale;
+    RayScale mAORayScale;
+
+    // Traces the same effects on the CPU into the same textures
+    enum RaytracingBackend : uint32_t { DXR = 0, CPU };
+    RaytracingBackend mRaytracingBackend;
+    CpuRaytracingBackend::SharedPtr mCpuRaytracer;
+
+    SVGFSharedHistory::SharedPtr mSVGFHistory;
     std::shared_ptr<SVGFPass> mShadowFilter;
     std::shared_ptr<SVGFPass> mReflectionFilter;
     std::shared_ptr<SVGFPass> mAOFilter;
+    std::shared_ptr<SVGFPackedPass> mPackedFilter;
+
+    // Trace 0 to N rays per pixel where the filters need them, see UseAdaptiveSampling()
+    AdaptiveSamplingPass::SharedPtr mShadowSampler;
+    AdaptiveSamplingPass::SharedPtr mReflectionSampler;
+    AdaptiveSamplingPass::SharedPtr mAOSampler;
+    bool mEnableAdaptiveSampling;
+
+    // A-SVGF history rejection from re-traced gradient samples, see UseTemporalGradients()
+    bool mEnableTemporalGradients;
+
+    // Reflection rays by roughness: every mirror pixel, one per glossy quad, none on rough pixels, see UseReflectionClassification()
+    ReflectionClassificationPass::SharedPtr mReflectionClassifier;
+    bool mEnableReflectionClassification;
+
+    // One light per shading point instead of the first light (shadows) or every light (reflection), see UseLightSampling()
+    SceneLightSampler::SharedPtr mLightSampler;
+    bool mEnableLightSampling;
+    bool mLightSamplingUserSet;     // Once the checkbox was used, scene loads keep its value instead of picking one
+
+    // Shadows trace towards a light resampled across candidates, neighbors and frames, see UseLightResampling()
+    LightResamplingPass::SharedPtr mLightResampler;
+    bool mEnableLightResampling;
+
+    // Indirect diffuse from a world-space probe grid instead of the AO polynomial
+    IrradianceProbePass::SharedPtr mProbeGI;
+    bool mEnableProbeGI;
 
     GraphicsProgram::SharedPtr mForwardProgram;
     GraphicsVars::SharedPtr mForwardVars;
@@ -86,8 +159,32 @@ private:
     GraphicsState::SharedPtr mDeferredState;
 
     TAA mTAA;
+    bool mResetTemporalHistory;
+
+    // Every size dependent texture, shared by the passes and the render graph
+    TexturePool::SharedPtr mTexturePool;
+
+    // Rebuilt when a setting changes the pass sequence. Passes render into mCurrentTargetFbo during Execute.
+    RenderGraph::SharedPtr mRenderGraph;
+    Fbo::SharedPtr mCurrentTargetFbo;
+    bool mRenderGraphDirty;
+
+    FrameRecorder mFrameRecorder;
+    bool mCompressCapture;
+
+    // CPU and GPU times of the PROFILE_PASS scopes over the last frames, also fed by the Cpu:: passes
+    Cpu::FrameProfiler mFrameProfiler;
+
+    // The G-buffer, the ray traced effects and their denoisers run at the render size, output size times
+    // mRenderScale. TAA accumulates the upscaled frame at the output size.
+    Cpu::DynamicResolutionController mDynamicResolution;
+    bool mEnableDynamicResolution;
+    float mRenderScale;
+    uint32_t mOutputWidth;
+    uint32_t mOutputHeight;
 
-    enum RenderMode : uint32_t { Forward = 0, Deferred, Hybrid, Count };
+    // PathTraced shows the CPU backend's progressive reference instead of rasterizing
+    enum RenderMode : uint32_t { Forward = 0, Deferred, Hybrid, PathTraced, Count };
     RenderMode mRenderMode;
 
     bool mEnableRaytracedShadows;
@@ -96,10 +193,13 @@ private:
     bool mEnableDenoiseShadows;
     bool mEnableDenoiseReflection;
     bool mEnableDenoiseAO;
+    bool mEnablePackedDenoising;
     bool mEnableNearFieldGI;
     bool mEnableTAA;
 
     uint32_t mFrameCount;
     float mAODistance;
+    uint32_t mReflectionBounces;    // Reflection rays per path, the one from the G-buffer included
     float mNearFieldGIStrength;
+    float mProbeGIStrength;
 };
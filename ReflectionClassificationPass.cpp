@@ -0,0 +1,85 @@
+#include "ReflectionClassificationPass.h"
+#include "PassProfiler.h"
+
+using namespace Falcor;
+
+namespace
+{
+    // Must match ReflectionClassification.slang
+    const uint32_t kTileSize = 16;
+}
+
+ReflectionClassificationPass::ReflectionClassificationPass(uint32_t width, uint32_t height, TexturePool::SharedPtr texturePool)
+    : mTexturePool(texturePool),
+      mGlossyRoughness(0.15f),
+      mRoughRoughness(0.45f)
+{
+    mClassifyProgram = ComputeProgram::createFromFile("ReflectionClassification.slang", "main");
+    mClassifyVars = ComputeVars::create(mClassifyProgram->getReflector());
+    mClassifyState = ComputeState::create();
+    mClassifyState->setProgram(mClassifyProgram);
+
+    Resize(width, height);
+}
+
+ReflectionClassificationPass::~ReflectionClassificationPass()
+{
+    ReleaseTargets();
+}
+
+void ReflectionClassificationPass::Resize(uint32_t width, uint32_t height)
+{
+    if (mClasses && mClasses->getWidth() == width && mClasses->getHeight() == height) return;
+
+    ReleaseTargets();
+
+    const Resource::BindFlags bindFlags = Resource::BindFlags::UnorderedAccess | Resource::BindFlags::ShaderResource;
+    mClasses = mTexturePool->Acquire(width, height, ResourceFormat::R8Uint, bindFlags);
+
+    // Room for every pixel. Buffers are not pooled, they only change with the size.
+    mWorkList = Buffer::create(size_t(width) * height * sizeof(uint32_t), bindFlags, Buffer::CpuAccess::None);
+    mWorkListCount = Buffer::create(sizeof(uint32_t), bindFlags, Buffer::CpuAccess::None);
+}
+
+void ReflectionClassificationPass::ReleaseTargets()
+{
+    mTexturePool->Release(mClasses);
+    mClasses = nullptr;
+}
+
+void ReflectionClassificationPass::Execute(RenderContext* renderContext, Texture::SharedPtr worldPosition, Texture::SharedPtr normalRoughness, uint32_t frameCount)
+{
+    PROFILE_PASS("ReflectionClassification");
+
+    mClassifyVars->setTexture("gGBuf0", worldPosition);
+    mClassifyVars->setTexture("gGBuf1", normalRoughness);
+    mClassifyVars->setTexture("gClasses", mClasses);
+    mClassifyVars->setRawBuffer("gWorkList", mWorkList);
+    mClassifyVars->setRawBuffer("gWorkListCount", mWorkListCount);
+
+    mClassifyVars["PerPassCB"]["gGlossyRoughness"] = mGlossyRoughness;
+    mClassifyVars["PerPassCB"]["gRoughRoughness"] = std::max(mGlossyRoughness, mRoughRoughness);
+    mClassifyVars["PerPassCB"]["gFrameCount"] = frameCount;
+
+    renderContext->clearUAV(mWorkListCount->getUAV().get(), uvec4(0));
+
+    const uint32_t groupsX = (mClasses->getWidth() + kTileSize - 1) / kTileSize;
+    const uint32_t groupsY = (mClasses->getHeight() + kTileSize - 1) / kTileSize;
+
+    renderContext->pushComputeState(mClassifyState);
+    renderContext->pushComputeVars(mClassifyVars);
+    renderContext->dispatch(groupsX, groupsY, 1);
+    renderContext->popComputeVars();
+    renderContext->popComputeState();
+}
+
+size_t ReflectionClassificationPass::GetAllocatedBytes() const
+{
+    return GetTextureSizeInBytes(mClasses) + mWorkList->getSize() + mWorkListCount->getSize();
+}
+
+void ReflectionClassificationPass::RenderGui(Gui* gui)
+{
+    gui->addFloatSlider("Glossy From Roughness", mGlossyRoughness, 0.0f, 1.0f);
+    gui->addFloatSlider("Rough From Roughness", mRoughRoughness, 0.0f, 1.0f);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Falcor.h"
+#include "TexturePool.h"
+
+// Sorts the pixels of the reflection pass by the linear roughness in the G-buffer, see Data/ReflectionClassification.h.
+// Mirror pixels trace a ray every frame, the glossy pixels of a 2x2 quad take turns tracing one ray for all of them
+// and rough pixels trace none, the deferred pass shades them from the probes or the environment. The pixels that
+// trace are compacted into a work list the reflection ray generation shader walks instead of the launch grid. Runs
+// before tracing. Cpu::ReflectionClassifier is the headless version.
+class ReflectionClassificationPass
+{
+public:
+    using SharedPtr = std::shared_ptr<ReflectionClassificationPass>;
+
+    ReflectionClassificationPass(uint32_t width, uint32_t height, TexturePool::SharedPtr texturePool);
+    ~ReflectionClassificationPass();
+
+    // Reallocates the classes and the work list at the new size. Nothing happens at the current size.
+    void Resize(uint32_t width, uint32_t height);
+
+    void Execute(
+        Falcor::RenderContext* renderContext,
+        Falcor::Texture::SharedPtr worldPosition,
+        Falcor::Texture::SharedPtr normalRoughness,
+        uint32_t frameCount);
+
+    void RenderGui(Falcor::Gui* gui);
+
+    // R8Uint REFLECTION_* class of every pixel of the last Execute
+    Falcor::Texture::SharedPtr GetClasses() const { return mClasses; }
+
+    // Entries are x | y << 14 | class << 28, their number is the first uint of GetWorkListCount()
+    Falcor::Buffer::SharedPtr GetWorkList() const { return mWorkList; }
+    Falcor::Buffer::SharedPtr GetWorkListCount() const { return mWorkListCount; }
+
+    size_t GetAllocatedBytes() const;
+
+private:
+    void ReleaseTargets();
+
+    Falcor::ComputeProgram::SharedPtr mClassifyProgram;
+    Falcor::ComputeVars::SharedPtr mClassifyVars;
+    Falcor::ComputeState::SharedPtr mClassifyState;
+
+    Falcor::Texture::SharedPtr mClasses;
+    Falcor::Buffer::SharedPtr mWorkList;
+    Falcor::Buffer::SharedPtr mWorkListCount;
+
+    TexturePool::SharedPtr mTexturePool;
+
+    float mGlossyRoughness; // Linear roughness from which a pixel is glossy
+    float mRoughRoughness;  // and from which it is rough
+};
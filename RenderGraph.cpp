@@ -0,0 +1,126 @@
+#include "RenderGraph.h"
+
+using namespace Falcor;
+
+RenderGraph::RenderGraph(TexturePool::SharedPtr texturePool)
+    : mTexturePool(texturePool)
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+    for (const Texture::SharedPtr& texture : mPhysicalTextures) mTexturePool->Release(texture);
+}
+
+void RenderGraph::Clear()
+{
+    mCompiler.Clear();
+    mCallbacks.clear();
+    mTextures.clear();
+    mFbos.clear();
+}
+
+void RenderGraph::ReleaseTextures()
+{
+    Clear();
+    for (const Texture::SharedPtr& texture : mPhysicalTextures) mTexturePool->Release(texture);
+    mPhysicalTextures.clear();
+}
+
+void RenderGraph::AddTexture(const std::string& name, const TextureDesc& desc)
+{
+    Cpu::TextureDesc resourceDesc;
+    resourceDesc.width = desc.width;
+    resourceDesc.height = desc.height;
+    resourceDesc.format = (uint32_t)desc.format;
+    resourceDesc.bindFlags = (uint32_t)desc.bindFlags;
+    resourceDesc.bytesPerPixel = getFormatBytesPerBlock(desc.format);
+
+    mCompiler.AddResource(name, resourceDesc);
+    mTextures.push_back(nullptr);
+}
+
+void RenderGraph::ImportTexture(const std::string& name, const Texture::SharedPtr& texture)
+{
+    mCompiler.ImportResource(name);
+    mTextures.push_back(texture);
+}
+
+void RenderGraph::AddPass(const std::string& name, const std::vector<std::string>& reads, const std::vector<std::string>& writes, ExecuteCallback callback, bool epilogue)
+{
+    mCompiler.AddPass(name, reads, writes, epilogue ? Cpu::RenderGraphPassType::Epilogue : Cpu::RenderGraphPassType::Normal);
+    mCallbacks.push_back(callback);
+}
+
+void RenderGraph::MarkOutput(const std::string& name)
+{
+    mCompiler.MarkOutput(name);
+}
+
+bool RenderGraph::Compile()
+{
+    mFbos.clear();
+
+    if (!mCompiler.Compile())
+    {
+        logError("RenderGraph: " + mCompiler.GetError());
+        return false;
+    }
+
+    // Released first, so that a recompile on a toggle gets the same textures back
+    for (const Texture::SharedPtr& texture : mPhysicalTextures) mTexturePool->Release(texture);
+    mPhysicalTextures.resize(mCompiler.GetPhysicalCount());
+    for (uint32_t i = 0; i < mPhysicalTextures.size(); ++i)
+    {
+        const Cpu::TextureDesc& desc = mCompiler.GetPhysicalDesc(i);
+        mPhysicalTextures[i] = mTexturePool->Acquire(desc.width, desc.height, (ResourceFormat)desc.format, (Resource::BindFlags)desc.bindFlags);
+    }
+
+    for (uint32_t r = 0; r < mCompiler.GetResourceCount(); ++r)
+    {
+        if (mCompiler.IsResourceImported(r)) continue;
+        const uint32_t physical = mCompiler.GetPhysicalIndex(r);
+        mTextures[r] = (physical != Cpu::RenderGraphCompiler::kInvalidIndex) ? mPhysicalTextures[physical] : nullptr;
+    }
+    return true;
+}
+
+void RenderGraph::Execute(RenderContext* renderContext)
+{
+    for (uint32_t pass : mCompiler.GetExecutionOrder())
+    {
+        mCallbacks[pass](renderContext);
+    }
+}
+
+Texture::SharedPtr RenderGraph::GetTexture(const std::string& name) const
+{
+    const uint32_t resource = mCompiler.FindResource(name);
+    return (resource != Cpu::RenderGraphCompiler::kInvalidIndex) ? mTextures[resource] : nullptr;
+}
+
+Fbo::SharedPtr RenderGraph::GetFbo(const std::string& name)
+{
+    auto it = mFbos.find(name);
+    if (it != mFbos.end()) return it->second;
+
+    Texture::SharedPtr texture = GetTexture(name);
+    if (!texture) return nullptr;
+
+    Fbo::SharedPtr fbo = Fbo::create();
+    fbo->attachColorTarget(texture, 0);
+    mFbos[name] = fbo;
+    return fbo;
+}
+
+void RenderGraph::RenderGui(Gui* gui)
+{
+    for (uint32_t pass = 0; pass < mCompiler.GetPassCount(); ++pass)
+    {
+        const std::string& name = mCompiler.GetPassName(pass);
+        gui->addText(mCompiler.IsPassCulled(pass) ? (name + " (culled)").c_str() : name.c_str());
+    }
+
+    gui->addText(("Transient memory: " + std::to_string(GetTransientBytes() >> 20) + " MB").c_str());
+    gui->addText(("Aliased: " + std::to_string(GetAliasedBytes() >> 20) + " MB in " + std::to_string(mCompiler.GetPhysicalCount()) + " textures").c_str());
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Falcor.h"
+#include "Cpu/RenderGraphCompiler.h"
+#include "TexturePool.h"
+
+// Frame graph of the renderer. Passes declare the textures they read and write, Compile() culls the passes
+// that do not contribute to an output and backs transient textures of disjoint lifetimes with the same
+// texture. Scheduling, culling and aliasing are done by Cpu::RenderGraphCompiler, the textures come from a TexturePool.
+class RenderGraph
+{
+public:
+    using SharedPtr = std::shared_ptr<RenderGraph>;
+    using ExecuteCallback = std::function<void(Falcor::RenderContext*)>;
+
+    struct TextureDesc
+    {
+        uint32_t width;
+        uint32_t height;
+        Falcor::ResourceFormat format;
+        Falcor::Resource::BindFlags bindFlags;
+    };
+
+    explicit RenderGraph(TexturePool::SharedPtr texturePool);
+    ~RenderGraph();
+
+    // Drops the passes and resources, keeps the textures until the next Compile()
+    void Clear();
+
+    // Clear() that also returns the textures to the pool, for when a resize makes them useless anyway.
+    // Lets the size dependent textures allocated before the next Compile() reuse them.
+    void ReleaseTextures();
+
+    void AddTexture(const std::string& name, const TextureDesc& desc);
+
+    // Owned by the caller. A null texture makes the resource an ordering token between passes.
+    void ImportTexture(const std::string& name, const Falcor::Texture::SharedPtr& texture = nullptr);
+
+    // Passes run in declaration order. An epilogue pass only runs when all its inputs were produced.
+    void AddPass(const std::string& name, const std::vector<std::string>& reads, const std::vector<std::string>& writes, ExecuteCallback callback, bool epilogue = false);
+    void MarkOutput(const std::string& name);
+
+    // Logs the error and returns false on an invalid graph
+    bool Compile();
+    void Execute(Falcor::RenderContext* renderContext);
+
+    // Null for culled resources
+    Falcor::Texture::SharedPtr GetTexture(const std::string& name) const;
+    Falcor::Fbo::SharedPtr GetFbo(const std::string& name);
+
+    uint64_t GetTransientBytes() const { return mCompiler.GetTransientBytes(); }
+    uint64_t GetAliasedBytes() const { return mCompiler.GetAliasedBytes(); }
+
+    void RenderGui(Falcor::Gui* gui);
+
+private:
+    Cpu::RenderGraphCompiler mCompiler;
+    std::vector<ExecuteCallback> mCallbacks;
+    std::vector<Falcor::Texture::SharedPtr> mTextures;
+    std::unordered_map<std::string, Falcor::Fbo::SharedPtr> mFbos;
+
+    // Physical textures of the last compile, returned to the pool by the next one
+    TexturePool::SharedPtr mTexturePool;
+    std::vector<Falcor::Texture::SharedPtr> mPhysicalTextures;
+};
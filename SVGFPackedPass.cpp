@@ -0,0 +1,219 @@
+#include "SVGFPackedPass.h"
+
+using namespace Falcor;
+
+SVGFPackedPass::SVGFPackedPass(uint32_t width, uint32_t height, TexturePool::SharedPtr texturePool)
+    : mTexturePool(texturePool),
+      mHistoryReset(true),
+      mAtrousIterations(4),
+      mFeedbackTap(1),
+      mAtrousRadius(2),
+      mAlpha(0.15f),
+      mMomentsAlpha(0.2f),
+      mPhiColor(10.0f, 10.0f, 10.0f),
+      mPhiNormal(128.0f),
+      mEnableTemporalReprojection(true),
+      mEnableSpatialVarianceEstimation(true)
+{
+    mReprojectionPass = FullScreenPass::create("SVGFPacked_Reprojection.slang");
+    mReprojectionVars = GraphicsVars::create(mReprojectionPass->getProgram()->getReflector());
+    mReprojectionState = GraphicsState::create();
+
+    mVarianceEstimationPass = FullScreenPass::create("SVGFPacked_VarianceEstimation.slang");
+    mVarianceEstimationVars = GraphicsVars::create(mVarianceEstimationPass->getProgram()->getReflector());
+    mVarianceEstimationState = GraphicsState::create();
+
+    mAtrousPass = FullScreenPass::create("SVGFPacked_Atrous.slang");
+    mAtrousPass->getProgram()->addDefine("ATROUS_RADIUS", std::to_string(mAtrousRadius));
+    mAtrousVars = GraphicsVars::create(mAtrousPass->getProgram()->getReflector());
+    mAtrousState = GraphicsState::create();
+
+    Resize(width, height);
+}
+
+SVGFPackedPass::~SVGFPackedPass()
+{
+    ReleaseTargets();
+}
+
+void SVGFPackedPass::Resize(uint32_t width, uint32_t height)
+{
+    if (mOutputFbo && mOutputFbo->getWidth() == width && mOutputFbo->getHeight() == height) return;
+
+    ReleaseTargets();
+
+    Fbo::Desc reprojFboDesc;
+    reprojFboDesc.setColorTarget(0, ResourceFormat::RGBA16Float); // Reflection, variance
+    reprojFboDesc.setColorTarget(1, ResourceFormat::RGBA16Float); // Shadow, variance, AO, variance
+    reprojFboDesc.setColorTarget(2, ResourceFormat::RGBA16Float); // Reflection and shadow 1st and 2nd moments
+    reprojFboDesc.setColorTarget(3, ResourceFormat::RG16Float); // AO 1st and 2nd moments
+    reprojFboDesc.setColorTarget(4, ResourceFormat::R16Float); // History length, shared by all signals
+
+    mCurrReprojFbo = mTexturePool->CreateFbo(width, height, reprojFboDesc);
+    mPrevReprojFbo = mTexturePool->CreateFbo(width, height, reprojFboDesc);
+
+    Fbo::Desc atrousFboDesc;
+    atrousFboDesc.setColorTarget(0, ResourceFormat::RGBA16Float); // Reflection, variance
+    atrousFboDesc.setColorTarget(1, ResourceFormat::RGBA16Float); // Shadow, variance, AO, variance
+
+    mOutputFbo = mTexturePool->CreateFbo(width, height, atrousFboDesc);
+    mLastFilteredFbo = mTexturePool->CreateFbo(width, height, atrousFboDesc);
+    mAtrousPingFbo = mTexturePool->CreateFbo(width, height, atrousFboDesc);
+    mAtrousPongFbo = mTexturePool->CreateFbo(width, height, atrousFboDesc);
+
+    mPrevLinearZTexture = mTexturePool->Acquire(width, height, ResourceFormat::RGBA16Float, ResourceBindFlags::ShaderResource | ResourceBindFlags::RenderTarget);
+
+    // Pooled textures hold whatever their last user left
+    mHistoryReset = true;
+}
+
+void SVGFPackedPass::ReleaseTargets()
+{
+    mTexturePool->ReleaseFbo(mCurrReprojFbo);
+    mTexturePool->ReleaseFbo(mPrevReprojFbo);
+    mTexturePool->ReleaseFbo(mOutputFbo);
+    mTexturePool->ReleaseFbo(mLastFilteredFbo);
+    mTexturePool->ReleaseFbo(mAtrousPingFbo);
+    mTexturePool->ReleaseFbo(mAtrousPongFbo);
+    mTexturePool->Release(mPrevLinearZTexture);
+}
+
+void SVGFPackedPass::Execute(
+    RenderContext* renderContext,
+    Texture::SharedPtr reflection,
+    Texture::SharedPtr shadow,
+    Texture::SharedPtr ao,
+    Texture::SharedPtr motionVec,
+    Texture::SharedPtr linearZ,
+    Texture::SharedPtr normalDepth)
+{
+    mGBufferInput.reflection = reflection;
+    mGBufferInput.shadow = shadow;
+    mGBufferInput.ao = ao;
+    mGBufferInput.linearZ = linearZ;
+    mGBufferInput.motionVec = motionVec;
+    mGBufferInput.compactNormalDepth = normalDepth;
+
+    // A zero previous depth fails every reprojection
+    if (mHistoryReset)
+    {
+        renderContext->clearRtv(mPrevLinearZTexture->getRTV().get(), glm::vec4(0.0f));
+        mHistoryReset = false;
+    }
+
+    TemporalReprojection(renderContext);
+    SpatialVarianceEstimation(renderContext);
+
+    for (uint32_t i = 0; i < mAtrousIterations; ++i)
+    {
+        Fbo::SharedPtr output = (i == mAtrousIterations - 1) ? mOutputFbo : mAtrousPongFbo;
+        AtrousFilter(renderContext, i, mAtrousPingFbo, output);
+
+        if (i == mFeedbackTap)
+        {
+            renderContext->blit(output->getColorTexture(0)->getSRV(), mLastFilteredFbo->getColorTexture(0)->getRTV());
+            renderContext->blit(output->getColorTexture(1)->getSRV(), mLastFilteredFbo->getColorTexture(1)->getRTV());
+        }
+
+        std::swap(mAtrousPingFbo, mAtrousPongFbo);
+    }
+
+    std::swap(mCurrReprojFbo, mPrevReprojFbo);
+
+    renderContext->blit(mGBufferInput.linearZ->getSRV(), mPrevLinearZTexture->getRTV());
+}
+
+void SVGFPackedPass::TemporalReprojection(RenderContext* renderContext)
+{
+    mReprojectionVars->setTexture("gReflection", mGBufferInput.reflection);
+    mReprojectionVars->setTexture("gShadow", mGBufferInput.shadow);
+    mReprojectionVars->setTexture("gAO", mGBufferInput.ao);
+    mReprojectionVars->setTexture("gLinearZ", mGBufferInput.linearZ);
+    mReprojectionVars->setTexture("gMotion", mGBufferInput.motionVec);
+    mReprojectionVars->setTexture("gPrevLinearZ", mPrevLinearZTexture);
+    mReprojectionVars->setTexture("gPrevReflection", mLastFilteredFbo->getColorTexture(0));
+    mReprojectionVars->setTexture("gPrevScalar", mLastFilteredFbo->getColorTexture(1));
+    mReprojectionVars->setTexture("gPrevMoments", mPrevReprojFbo->getColorTexture(2));
+    mReprojectionVars->setTexture("gPrevAOMoments", mPrevReprojFbo->getColorTexture(3));
+    mReprojectionVars->setTexture("gHistoryLength", mPrevReprojFbo->getColorTexture(4));
+
+    mReprojectionVars["PerPassCB"]["gAlpha"] = mAlpha;
+    mReprojectionVars["PerPassCB"]["gMomentsAlpha"] = mMomentsAlpha;
+    mReprojectionVars["PerPassCB"]["gEnableTemporalReprojection"] = mEnableTemporalReprojection;
+
+    mReprojectionState->setFbo(mCurrReprojFbo);
+
+    renderContext->pushGraphicsState(mReprojectionState);
+    renderContext->pushGraphicsVars(mReprojectionVars);
+    mReprojectionPass->execute(renderContext);
+    renderContext->popGraphicsVars();
+    renderContext->popGraphicsState();
+}
+
+void SVGFPackedPass::SpatialVarianceEstimation(RenderContext* renderContext)
+{
+    mVarianceEstimationVars->setTexture("gCompactNormDepth", mGBufferInput.compactNormalDepth);
+    mVarianceEstimationVars->setTexture("gReflection", mCurrReprojFbo->getColorTexture(0));
+    mVarianceEstimationVars->setTexture("gScalar", mCurrReprojFbo->getColorTexture(1));
+    mVarianceEstimationVars->setTexture("gMoments", mCurrReprojFbo->getColorTexture(2));
+    mVarianceEstimationVars->setTexture("gAOMoments", mCurrReprojFbo->getColorTexture(3));
+    mVarianceEstimationVars->setTexture("gHistoryLength", mCurrReprojFbo->getColorTexture(4));
+
+    mVarianceEstimationVars["PerPassCB"]["gPhiColor"] = mPhiColor;
+    mVarianceEstimationVars["PerPassCB"]["gPhiNormal"] = mPhiNormal;
+    mVarianceEstimationVars["PerPassCB"]["gEnableSpatialVarianceEstimation"] = mEnableSpatialVarianceEstimation;
+
+    mVarianceEstimationState->setFbo(mAtrousPingFbo);
+
+    renderContext->pushGraphicsState(mVarianceEstimationState);
+    renderContext->pushGraphicsVars(mVarianceEstimationVars);
+    mVarianceEstimationPass->execute(renderContext);
+    renderContext->popGraphicsVars();
+    renderContext->popGraphicsState();
+}
+
+void SVGFPackedPass::AtrousFilter(RenderContext* renderContext, uint32_t iteration, Fbo::SharedPtr input, Fbo::SharedPtr output)
+{
+    mAtrousVars->setTexture("gCompactNormDepth", mGBufferInput.compactNormalDepth);
+    mAtrousVars->setTexture("gReflection", input->getColorTexture(0));
+    mAtrousVars->setTexture("gScalar", input->getColorTexture(1));
+
+    mAtrousVars["PerPassCB"]["gStepSize"] = 1u << iteration;
+    mAtrousVars["PerPassCB"]["gPhiColor"] = mPhiColor;
+    mAtrousVars["PerPassCB"]["gPhiNormal"] = mPhiNormal;
+
+    mAtrousState->setFbo(output);
+
+    renderContext->pushGraphicsState(mAtrousState);
+    renderContext->pushGraphicsVars(mAtrousVars);
+    mAtrousPass->execute(renderContext);
+    renderContext->popGraphicsVars();
+    renderContext->popGraphicsState();
+}
+
+size_t SVGFPackedPass::GetAllocatedBytes() const
+{
+    return GetFboSizeInBytes(mCurrReprojFbo) + GetFboSizeInBytes(mPrevReprojFbo) +
+        GetFboSizeInBytes(mAtrousPingFbo) + GetFboSizeInBytes(mAtrousPongFbo) +
+        GetFboSizeInBytes(mLastFilteredFbo) + GetFboSizeInBytes(mOutputFbo) +
+        GetTextureSizeInBytes(mPrevLinearZTexture);
+}
+
+void SVGFPackedPass::RenderGui(Gui* gui)
+{
+    gui->addText(("Allocated: " + std::to_string(GetAllocatedBytes() >> 20) + " MB").c_str());
+    gui->addCheckBox("Temporal Reprojection", mEnableTemporalReprojection);
+    gui->addCheckBox("Spatial Variance Estimation", mEnableSpatialVarianceEstimation);
+    gui->addFloatSlider("Color Alpha", mAlpha, 0.0f, 1.0f);
+    gui->addFloatSlider("Moments Alpha", mMomentsAlpha, 0.0f, 1.0f);
+    gui->addFloatSlider("Phi Color Reflection", mPhiColor.x, 0.0f, 64.0f);
+    gui->addFloatSlider("Phi Color Shadow", mPhiColor.y, 0.0f, 64.0f);
+    gui->addFloatSlider("Phi Color AO", mPhiColor.z, 0.0f, 64.0f);
+    gui->addFloatSlider("Phi Normal", mPhiNormal, 1.0f, 256.0f);
+    gui->addIntSlider("Atrous Iterations", *reinterpret_cast<int32_t*>(&mAtrousIterations), 1, 5);
+    gui->addIntSlider("Feedback Tap", *reinterpret_cast<int32_t*>(&mFeedbackTap), 1, 5);
+    if (gui->addIntSlider("Atrous Radius", *reinterpret_cast<int32_t*>(&mAtrousRadius), 1, 2))
+    {
+        mAtrousPass->getProgram()->addDefine("ATROUS_RADIUS", std::to_string(mAtrousRadius));
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Falcor.h"
+#include "SVGFSharedHistory.h"
+#include "TexturePool.h"
+
+// SVGF for reflection, shadow and AO in a single pass chain. Reprojection validity, history length and the
+// depth/normal edge-stopping weights are evaluated once per pixel/tap and shared by the three signals.
+// Outputs: reflection = (rgb, variance), scalar = (shadow, variance, AO, variance).
+class SVGFPackedPass
+{
+public:
+    SVGFPackedPass(uint32_t width, uint32_t height, TexturePool::SharedPtr texturePool);
+    ~SVGFPackedPass();
+
+    // Shadow and AO are read from .r
+    void Execute(
+        Falcor::RenderContext* renderContext,
+        Falcor::Texture::SharedPtr reflection,
+        Falcor::Texture::SharedPtr shadow,
+        Falcor::Texture::SharedPtr ao,
+        Falcor::Texture::SharedPtr motionVec,
+        Falcor::Texture::SharedPtr linearZ,
+        Falcor::Texture::SharedPtr normalDepth);
+
+    Falcor::Texture::SharedPtr GetReflectionOutput() const { return mOutputFbo->getColorTexture(0); }
+    Falcor::Texture::SharedPtr GetScalarOutput() const { return mOutputFbo->getColorTexture(1); }
+
+    // Reallocates the targets at the new size and drops the history. Nothing happens at the current size.
+    void Resize(uint32_t width, uint32_t height);
+
+    void RenderGui(Falcor::Gui* gui);
+
+    size_t GetAllocatedBytes() const;
+
+private:
+    void TemporalReprojection(Falcor::RenderContext* renderContext);
+    void SpatialVarianceEstimation(Falcor::RenderContext* renderContext);
+    void AtrousFilter(Falcor::RenderContext* renderContext, uint32_t iteration, Falcor::Fbo::SharedPtr input, Falcor::Fbo::SharedPtr output);
+    void ReleaseTargets();
+
+    Falcor::FullScreenPass::UniquePtr mReprojectionPass;
+    Falcor::GraphicsVars::SharedPtr mReprojectionVars;
+    Falcor::GraphicsState::SharedPtr mReprojectionState;
+
+    Falcor::FullScreenPass::UniquePtr mVarianceEstimationPass;
+    Falcor::GraphicsVars::SharedPtr mVarianceEstimationVars;
+    Falcor::GraphicsState::SharedPtr mVarianceEstimationState;
+
+    Falcor::FullScreenPass::UniquePtr mAtrousPass;
+    Falcor::GraphicsVars::SharedPtr mAtrousVars;
+    Falcor::GraphicsState::SharedPtr mAtrousState;
+
+    Falcor::Fbo::SharedPtr mAtrousPingFbo;
+    Falcor::Fbo::SharedPtr mAtrousPongFbo;
+
+    Falcor::Fbo::SharedPtr mLastFilteredFbo;
+
+    Falcor::Fbo::SharedPtr mCurrReprojFbo;
+    Falcor::Fbo::SharedPtr mPrevReprojFbo;
+
+    Falcor::Fbo::SharedPtr mOutputFbo;
+
+    Falcor::Texture::SharedPtr mPrevLinearZTexture;
+
+    TexturePool::SharedPtr mTexturePool;
+    bool mHistoryReset;
+
+    uint32_t mAtrousIterations;
+    uint32_t mFeedbackTap;
+    uint32_t mAtrousRadius;
+    float mAlpha;
+    float mMomentsAlpha;
+    glm::vec3 mPhiColor; // reflection, shadow, AO
+    float mPhiNormal;
+    bool mEnableTemporalReprojection;
+    bool mEnableSpatialVarianceEstimation;
+
+    struct
+    {
+        Falcor::Texture::SharedPtr reflection;
+        Falcor::Texture::SharedPtr shadow;
+        Falcor::Texture::SharedPtr ao;
+        Falcor::Texture::SharedPtr linearZ;
+        Falcor::Texture::SharedPtr motionVec;
+        Falcor::Texture::SharedPtr compactNormalDepth;
+    } mGBufferInput;
+};
@@ -1,52 +1,145 @@
 #include "SVGFPass.h"
+#include "PassProfiler.h"
 
 using namespace Falcor;
 
-SVGFPass::SVGFPass(uint32_t width, uint32_t height)
-    : mAtrousIterations(4),
+namespace
+{
+    // Must match SVGF_AtrousTiled.slang
+    const uint32_t kComputeTileSize = 16;
+    const uint32_t kComputeMaxApron = 8;
+}
+
+SVGFPass::SVGFPass(uint32_t width, uint32_t height, SignalType signalType, SVGFSharedHistory::SharedPtr history, TexturePool::SharedPtr texturePool)
+    : mHistory(history),
+      mTexturePool(texturePool),
+      mSignalType(signalType),
+      mLastHistoryFrame(0),
+      mHasHistory(false),
+      mHistoryReset(true),
+      mLastGradientFrame(0),
+      mHasGradientLuminance(false),
+      mUseGradient(false),
+      mAtrousIterations(4),
       mFeedbackTap(1),
       mAtrousRadius(2),
+      mAtrousPath(AtrousPath::Compute),
       mAlpha(0.15f),
       mMomentsAlpha(0.2f),
       mPhiColor(10.0f),
       mPhiNormal(128.0f),
       mEnableTemporalReprojection(true),
-      mEnableSpatialVarianceEstimation(true)
+      mEnableSpatialVarianceEstimation(true),
+      mGradientFilterIterations(3)
 {
-    Fbo::Desc reprojFboDesc;
-    reprojFboDesc.setColorTarget(0, ResourceFormat::RGBA16Float); // Input signal, variance
-    reprojFboDesc.setColorTarget(1, ResourceFormat::RG16Float); // 1st and 2nd Moments
-    reprojFboDesc.setColorTarget(2, ResourceFormat::R16Float); // History length
-
-    mCurrReprojFbo = FboHelper::create2D(width, height, reprojFboDesc);
-    mPrevReprojFbo = FboHelper::create2D(width, height, reprojFboDesc);
+    Program::DefineList defines;
+    if (signalType == SignalType::Scalar) defines.add("SCALAR_SIGNAL");
 
-    Fbo::Desc atrousFboDesc;
-    atrousFboDesc.setColorTarget(0, ResourceFormat::RGBA16Float); // Input signal, variance
+    mTemporalGradientPass = FullScreenPass::create("SVGF_TemporalGradient.slang");
+    mTemporalGradientVars = GraphicsVars::create(mTemporalGradientPass->getProgram()->getReflector());
+    mTemporalGradientState = GraphicsState::create();
 
-    mOutputFbo = FboHelper::create2D(width, height, atrousFboDesc);
-    mLastFilteredFbo = FboHelper::create2D(width, height, atrousFboDesc);
-    mAtrousPingFbo = FboHelper::create2D(width, height, atrousFboDesc);
-    mAtrousPongFbo = FboHelper::create2D(width, height, atrousFboDesc);
+    mGradientAtrousPass = FullScreenPass::create("SVGF_GradientAtrous.slang");
+    mGradientAtrousVars = GraphicsVars::create(mGradientAtrousPass->getProgram()->getReflector());
+    mGradientAtrousState = GraphicsState::create();
 
-    mPrevLinearZTexture = Texture::create2D(width, height, ResourceFormat::RGBA16Float, 1, 1, nullptr, ResourceBindFlags::ShaderResource | ResourceBindFlags::RenderTarget);
-
-    mReprojectionPass = FullScreenPass::create("SVGF_Reprojection.slang");
+    mReprojectionPass = FullScreenPass::create("SVGF_Reprojection.slang", defines);
     mReprojectionVars = GraphicsVars::create(mReprojectionPass->getProgram()->getReflector());
     mReprojectionState = GraphicsState::create();
 
-    mVarianceEstimationPass = FullScreenPass::create("SVGF_VarianceEstimation.slang");
+    mVarianceEstimationPass = FullScreenPass::create("SVGF_VarianceEstimation.slang", defines);
     mVarianceEstimationVars = GraphicsVars::create(mVarianceEstimationPass->getProgram()->getReflector());
     mVarianceEstimationState = GraphicsState::create();
 
-    mAtrousPass = FullScreenPass::create("SVGF_Atrous.slang");
-    mAtrousPass->getProgram()->addDefine("ATROUS_RADIUS", std::to_string(mAtrousRadius));
+    mAtrousPass = FullScreenPass::create("SVGF_Atrous.slang", defines);
     mAtrousVars = GraphicsVars::create(mAtrousPass->getProgram()->getReflector());
     mAtrousState = GraphicsState::create();
+
+    mAtrousComputeProgram = ComputeProgram::createFromFile("SVGF_AtrousTiled.slang", "main", defines);
+    mAtrousComputeVars = ComputeVars::create(mAtrousComputeProgram->getReflector());
+    mAtrousComputeState = ComputeState::create();
+    mAtrousComputeState->setProgram(mAtrousComputeProgram);
+
+    SetAtrousRadiusDefine();
+    Resize(width, height);
 }
 
 SVGFPass::~SVGFPass()
 {
+    ReleaseTargets();
+}
+
+void SVGFPass::Resize(uint32_t width, uint32_t height)
+{
+    if (mOutputFbo && mOutputFbo->getWidth() == width && mOutputFbo->getHeight() == height) return;
+
+    ReleaseTargets();
+
+    const bool isScalar = (mSignalType == SignalType::Scalar);
+
+    // The history length and previous linear Z live in mHistory
+    Fbo::Desc reprojFboDesc;
+    if (isScalar)
+    {
+        reprojFboDesc.setColorTarget(0, ResourceFormat::RGBA16Float); // Input signal, variance, 1st moment and variance of the moments
+    }
+    else
+    {
+        reprojFboDesc.setColorTarget(0, ResourceFormat::RGBA16Float); // Input signal, variance
+        reprojFboDesc.setColorTarget(1, ResourceFormat::RG16Float); // 1st moment and variance of the moments, see EncodeMoments()
+    }
+
+    mCurrReprojFbo = mTexturePool->CreateFbo(width, height, reprojFboDesc);
+    mPrevReprojFbo = mTexturePool->CreateFbo(width, height, reprojFboDesc);
+
+    const ResourceFormat filterFormat = isScalar ? ResourceFormat::RG16Float : ResourceFormat::RGBA16Float;
+
+    Fbo::Desc atrousFboDesc;
+    atrousFboDesc.setColorTarget(0, filterFormat); // Input signal, variance
+
+    // The compute path writes the a-trous targets as UAVs
+    Fbo::Desc atrousUavFboDesc;
+    atrousUavFboDesc.setColorTarget(0, filterFormat, true);
+
+    mOutputFbo = mTexturePool->CreateFbo(width, height, atrousUavFboDesc);
+    mLastFilteredFbo = mTexturePool->CreateFbo(width, height, atrousFboDesc);
+    mAtrousPingFbo = mTexturePool->CreateFbo(width, height, atrousUavFboDesc);
+    mAtrousPongFbo = mTexturePool->CreateFbo(width, height, atrousUavFboDesc);
+
+    // One texel per 3x3 stratum, see Data/TemporalGradient.h
+    const uint32_t strataWidth = (width + 2) / 3;
+    const uint32_t strataHeight = (height + 2) / 3;
+
+    Fbo::Desc gradientFboDesc;
+    gradientFboDesc.setColorTarget(0, ResourceFormat::RGBA16Float); // Change, normalization, whether a sample landed
+    gradientFboDesc.setColorTarget(1, ResourceFormat::R32Float); // Luminance of the picked sample
+
+    Fbo::Desc gradientAtrousFboDesc;
+    gradientAtrousFboDesc.setColorTarget(0, ResourceFormat::RGBA16Float);
+
+    mCurrGradientFbo = mTexturePool->CreateFbo(strataWidth, strataHeight, gradientFboDesc);
+    mPrevGradientFbo = mTexturePool->CreateFbo(strataWidth, strataHeight, gradientFboDesc);
+    mGradientPingFbo = mTexturePool->CreateFbo(strataWidth, strataHeight, gradientAtrousFboDesc);
+    mGradientPongFbo = mTexturePool->CreateFbo(strataWidth, strataHeight, gradientAtrousFboDesc);
+
+    // The pooled targets may hold another filter's data
+    mHasHistory = false;
+    mHasGradientLuminance = false;
+}
+
+void SVGFPass::ReleaseTargets()
+{
+    mTexturePool->ReleaseFbo(mCurrReprojFbo);
+    mTexturePool->ReleaseFbo(mPrevReprojFbo);
+    mTexturePool->ReleaseFbo(mOutputFbo);
+    mTexturePool->ReleaseFbo(mLastFilteredFbo);
+    mTexturePool->ReleaseFbo(mAtrousPingFbo);
+    mTexturePool->ReleaseFbo(mAtrousPongFbo);
+    mTexturePool->ReleaseFbo(mCurrGradientFbo);
+    mTexturePool->ReleaseFbo(mPrevGradientFbo);
+    mTexturePool->ReleaseFbo(mGradientPingFbo);
+    mTexturePool->ReleaseFbo(mGradientPongFbo);
+    mFilteredGradient = nullptr;
 }
 
 Texture::SharedPtr SVGFPass::Execute(
@@ -54,23 +147,57 @@ Texture::SharedPtr SVGFPass::Execute(
     Texture::SharedPtr inputSignal,
     Texture::SharedPtr motionVec,
     Texture::SharedPtr linearZ,
-    Texture::SharedPtr normalDepth)
+    Texture::SharedPtr normalDepth,
+    Texture::SharedPtr rayCounts,
+    Texture::SharedPtr gradientSamples)
 {
     mGBufferInput.inputSignal = inputSignal;
     mGBufferInput.linearZ = linearZ;
     mGBufferInput.motionVec = motionVec;
     mGBufferInput.compactNormalDepth = normalDepth;
+    mGBufferInput.rayCounts = rayCounts;
 
-    TemporalReprojection(renderContext);
-    SpatialVarianceEstimation(renderContext);
+    // Own history is only usable if this filter also ran last frame
+    const uint64_t historyFrame = mHistory->GetFrameIndex();
+    mHistoryReset = !mHasHistory || (mLastHistoryFrame + 1 != historyFrame);
+    mLastHistoryFrame = historyFrame;
+    mHasHistory = true;
+
+    mUseGradient = gradientSamples && mEnableTemporalReprojection;
+    if (mUseGradient)
+    {
+        PROFILE_PASS("TemporalGradient");
+        ComputeTemporalGradient(renderContext, gradientSamples);
+    }
+    mHasGradientLuminance = mUseGradient;
+
+    {
+        PROFILE_PASS("Reprojection");
+        TemporalReprojection(renderContext);
+    }
+    {
+        PROFILE_PASS("VarianceEstimation");
+        SpatialVarianceEstimation(renderContext);
+    }
 
     for (uint32_t i = 0; i < mAtrousIterations; ++i)
     {
         Fbo::SharedPtr output = (i == mAtrousIterations - 1) ? mOutputFbo : mAtrousPongFbo;
-        AtrousFilter(renderContext, i, mAtrousPingFbo, output);
+        {
+            PROFILE_PASS("Atrous" + std::to_string(i));
+            if (UseComputeAtrous(i))
+            {
+                AtrousFilterCompute(renderContext, i, mAtrousPingFbo, output);
+            }
+            else
+            {
+                AtrousFilter(renderContext, i, mAtrousPingFbo, output);
+            }
+        }
 
         if (i == mFeedbackTap)
         {
+            PROFILE_PASS("FeedbackBlit");
             renderContext->blit(output->getColorTexture(0)->getSRV(), mLastFilteredFbo->getColorTexture(0)->getRTV());
         }
 
@@ -78,25 +205,76 @@ Texture::SharedPtr SVGFPass::Execute(
     }
 
     std::swap(mCurrReprojFbo, mPrevReprojFbo);
-
-    renderContext->blit(mGBufferInput.linearZ->getSRV(), mPrevLinearZTexture->getRTV());
+    std::swap(mCurrGradientFbo, mPrevGradientFbo);
 
     return mOutputFbo->getColorTexture(0);
 }
 
+void SVGFPass::ComputeTemporalGradient(RenderContext* renderContext, Texture::SharedPtr gradientSamples)
+{
+    // The samples re-shade what this filter saw last frame, only if it ran last frame
+    const uint64_t historyFrame = mHistory->GetFrameIndex();
+    const bool hasPrevLuminance = mHasGradientLuminance && mLastGradientFrame + 1 == historyFrame;
+    mLastGradientFrame = historyFrame;
+
+    mTemporalGradientVars->setTexture("gInputSignal", mGBufferInput.inputSignal);
+    mTemporalGradientVars->setTexture("gGradientSamples", gradientSamples);
+    mTemporalGradientVars->setTexture("gPrevGradientLuminance", mPrevGradientFbo->getColorTexture(1));
+
+    mTemporalGradientVars["PerPassCB"]["gFrameCount"] = mHistory->GetGradientFrameCount();
+    mTemporalGradientVars["PerPassCB"]["gHasPrevLuminance"] = hasPrevLuminance;
+
+    mTemporalGradientState->setFbo(mCurrGradientFbo);
+
+    renderContext->pushGraphicsState(mTemporalGradientState);
+    renderContext->pushGraphicsVars(mTemporalGradientVars);
+    mTemporalGradientPass->execute(renderContext);
+    renderContext->popGraphicsVars();
+    renderContext->popGraphicsState();
+
+    // The gradients are sparse and noisy, the a-trous passes spread them over the strata without a sample
+    mFilteredGradient = mCurrGradientFbo->getColorTexture(0);
+    for (uint32_t i = 0; i < mGradientFilterIterations; ++i)
+    {
+        FilterTemporalGradient(renderContext, i, mFilteredGradient, mGradientPingFbo);
+        mFilteredGradient = mGradientPingFbo->getColorTexture(0);
+        std::swap(mGradientPingFbo, mGradientPongFbo);
+    }
+}
+
+void SVGFPass::FilterTemporalGradient(RenderContext* renderContext, uint32_t iteration, Texture::SharedPtr input, Fbo::SharedPtr output)
+{
+    mGradientAtrousVars->setTexture("gGradient", input);
+    mGradientAtrousVars->setTexture("gCompactNormDepth", mGBufferInput.compactNormalDepth);
+    mGradientAtrousVars["PerPassCB"]["gStepSize"] = int32_t(1u << iteration);
+
+    mGradientAtrousState->setFbo(output);
+
+    renderContext->pushGraphicsState(mGradientAtrousState);
+    renderContext->pushGraphicsVars(mGradientAtrousVars);
+    mGradientAtrousPass->execute(renderContext);
+    renderContext->popGraphicsVars();
+    renderContext->popGraphicsState();
+}
+
 void SVGFPass::TemporalReprojection(RenderContext* renderContext)
 {
     mReprojectionVars->setTexture("gInputSignal", mGBufferInput.inputSignal);
     mReprojectionVars->setTexture("gLinearZ", mGBufferInput.linearZ);
     mReprojectionVars->setTexture("gMotion", mGBufferInput.motionVec);
-    mReprojectionVars->setTexture("gPrevLinearZ", mPrevLinearZTexture);
+    mReprojectionVars->setTexture("gPrevLinearZ", mHistory->GetPrevLinearZ());
     mReprojectionVars->setTexture("gPrevInputSignal", mLastFilteredFbo->getColorTexture(0));
-    mReprojectionVars->setTexture("gPrevMoments", mPrevReprojFbo->getColorTexture(1));
-    mReprojectionVars->setTexture("gHistoryLength", mPrevReprojFbo->getColorTexture(2));
+    mReprojectionVars->setTexture("gPrevMoments", mPrevReprojFbo->getColorTexture(mSignalType == SignalType::Scalar ? 0 : 1));
+    mReprojectionVars->setTexture("gHistoryLength", mHistory->GetHistoryLength());
+    mReprojectionVars->setTexture("gRayCount", mGBufferInput.rayCounts);
+    mReprojectionVars->setTexture("gGradient", mUseGradient ? mFilteredGradient : nullptr);
 
     mReprojectionVars["PerPassCB"]["gAlpha"] = mAlpha;
     mReprojectionVars["PerPassCB"]["gMomentsAlpha"] = mMomentsAlpha;
     mReprojectionVars["PerPassCB"]["gEnableTemporalReprojection"] = mEnableTemporalReprojection;
+    mReprojectionVars["PerPassCB"]["gHistoryReset"] = mHistoryReset;
+    mReprojectionVars["PerPassCB"]["gAdaptiveSampling"] = mGBufferInput.rayCounts != nullptr;
+    mReprojectionVars["PerPassCB"]["gTemporalGradients"] = mUseGradient;
 
     mReprojectionState->setFbo(mCurrReprojFbo);
 
@@ -111,12 +289,15 @@ void SVGFPass::SpatialVarianceEstimation(RenderContext* renderContext)
 {
     mVarianceEstimationVars->setTexture("gCompactNormDepth", mGBufferInput.compactNormalDepth);
     mVarianceEstimationVars->setTexture("gInputSignal", mCurrReprojFbo->getColorTexture(0));
-    mVarianceEstimationVars->setTexture("gMoments", mCurrReprojFbo->getColorTexture(1));
-    mVarianceEstimationVars->setTexture("gHistoryLength", mCurrReprojFbo->getColorTexture(2));
+    mVarianceEstimationVars->setTexture("gMoments", mCurrReprojFbo->getColorTexture(mSignalType == SignalType::Scalar ? 0 : 1));
+    mVarianceEstimationVars->setTexture("gHistoryLength", mHistory->GetHistoryLength());
+    mVarianceEstimationVars->setTexture("gGradient", mUseGradient ? mFilteredGradient : nullptr);
 
     mVarianceEstimationVars["PerPassCB"]["gPhiColor"] = mPhiColor;
     mVarianceEstimationVars["PerPassCB"]["gPhiNormal"] = mPhiNormal;
     mVarianceEstimationVars["PerPassCB"]["gEnableSpatialVarianceEstimation"] = mEnableSpatialVarianceEstimation;
+    mVarianceEstimationVars["PerPassCB"]["gHistoryReset"] = mHistoryReset || !mEnableTemporalReprojection;
+    mVarianceEstimationVars["PerPassCB"]["gTemporalGradients"] = mUseGradient;
 
     mVarianceEstimationState->setFbo(mAtrousPingFbo);
 
@@ -145,8 +326,52 @@ void SVGFPass::AtrousFilter(RenderContext* renderContext, uint32_t iteration, Fb
     renderContext->popGraphicsState();
 }
 
+void SVGFPass::AtrousFilterCompute(RenderContext* renderContext, uint32_t iteration, Fbo::SharedPtr input, Fbo::SharedPtr output)
+{
+    const Texture::SharedPtr outputTexture = output->getColorTexture(0);
+
+    mAtrousComputeVars->setTexture("gCompactNormDepth", mGBufferInput.compactNormalDepth);
+    mAtrousComputeVars->setTexture("gInputSignal", input->getColorTexture(0));
+    mAtrousComputeVars->setTexture("gOutput", outputTexture);
+
+    mAtrousComputeVars["PerPassCB"]["gStepSize"] = 1u << iteration;
+    mAtrousComputeVars["PerPassCB"]["gPhiColor"] = mPhiColor;
+    mAtrousComputeVars["PerPassCB"]["gPhiNormal"] = mPhiNormal;
+
+    const uint32_t groupsX = (outputTexture->getWidth() + kComputeTileSize - 1) / kComputeTileSize;
+    const uint32_t groupsY = (outputTexture->getHeight() + kComputeTileSize - 1) / kComputeTileSize;
+
+    renderContext->pushComputeState(mAtrousComputeState);
+    renderContext->pushComputeVars(mAtrousComputeVars);
+    renderContext->dispatch(groupsX, groupsY, 1);
+    renderContext->popComputeVars();
+    renderContext->popComputeState();
+}
+
+bool SVGFPass::UseComputeAtrous(uint32_t iteration) const
+{
+    // The groupshared cache holds an apron of at most kComputeMaxApron pixels
+    return mAtrousPath == AtrousPath::Compute && (mAtrousRadius << iteration) <= kComputeMaxApron;
+}
+
+void SVGFPass::SetAtrousRadiusDefine()
+{
+    mAtrousPass->getProgram()->addDefine("ATROUS_RADIUS", std::to_string(mAtrousRadius));
+    mAtrousComputeProgram->addDefine("ATROUS_RADIUS", std::to_string(mAtrousRadius));
+}
+
+size_t SVGFPass::GetAllocatedBytes() const
+{
+    return GetFboSizeInBytes(mCurrReprojFbo) + GetFboSizeInBytes(mPrevReprojFbo) +
+        GetFboSizeInBytes(mAtrousPingFbo) + GetFboSizeInBytes(mAtrousPongFbo) +
+        GetFboSizeInBytes(mLastFilteredFbo) + GetFboSizeInBytes(mOutputFbo) +
+        GetFboSizeInBytes(mCurrGradientFbo) + GetFboSizeInBytes(mPrevGradientFbo) +
+        GetFboSizeInBytes(mGradientPingFbo) + GetFboSizeInBytes(mGradientPongFbo);
+}
+
 void SVGFPass::RenderGui(Gui* gui)
 {
+    gui->addText(("Allocated: " + std::to_string(GetAllocatedBytes() >> 20) + " MB").c_str());
     gui->addCheckBox("Temporal Reprojection", mEnableTemporalReprojection);
     gui->addCheckBox("Spatial Variance Estimation", mEnableSpatialVarianceEstimation);
     gui->addFloatSlider("Color Alpha", mAlpha, 0.0f, 1.0f);
@@ -155,8 +380,14 @@ void SVGFPass::RenderGui(Gui* gui)
     gui->addFloatSlider("Phi Normal", mPhiNormal, 1.0f, 256.0f);
     gui->addIntSlider("Atrous Iterations", *reinterpret_cast<int32_t*>(&mAtrousIterations), 1, 5);
     gui->addIntSlider("Feedback Tap", *reinterpret_cast<int32_t*>(&mFeedbackTap), 1, 5);
+    gui->addIntSlider("Gradient Filter Iterations", *reinterpret_cast<int32_t*>(&mGradientFilterIterations), 0, 5);
     if (gui->addIntSlider("Atrous Radius", *reinterpret_cast<int32_t*>(&mAtrousRadius), 1, 2))
     {
-        mAtrousPass->getProgram()->addDefine("ATROUS_RADIUS", std::to_string(mAtrousRadius));
+        SetAtrousRadiusDefine();
     }
+
+    Gui::DropdownList atrousPaths;
+    atrousPaths.push_back({ (int32_t)AtrousPath::Pixel, "Pixel Shader" });
+    atrousPaths.push_back({ (int32_t)AtrousPath::Compute, "Compute (Groupshared)" });
+    gui->addDropdown("Atrous Path", atrousPaths, *reinterpret_cast<uint32_t*>(&mAtrousPath));
 }
@@ -1,11 +1,27 @@
 #pragma once
 
 #include "Falcor.h"
+#include "SVGFSharedHistory.h"
 
 class SVGFPass
 {
 public:
-    SVGFPass(uint32_t width, uint32_t height);
+    // Pixel runs SVGF_Atrous.slang. Compute runs SVGF_AtrousTiled.slang, which stages tiles in groupshared memory,
+    // for every iteration whose apron fits and falls back to the pixel shader for the wider steps.
+    enum class AtrousPath : uint32_t
+    {
+        Pixel = 0,
+        Compute
+    };
+
+    // Scalar signals (shadow, AO) are read from .r and filtered in RG16F (signal, variance) targets
+    enum class SignalType : uint32_t
+    {
+        Color = 0,
+        Scalar
+    };
+
+    SVGFPass(uint32_t width, uint32_t height, SignalType signalType, SVGFSharedHistory::SharedPtr history, TexturePool::SharedPtr texturePool);
     ~SVGFPass();
 
     Falcor::Texture::SharedPtr Execute(
@@ -13,14 +29,43 @@ public:
         Falcor::Texture::SharedPtr inputSignal,
         Falcor::Texture::SharedPtr motionVec,
         Falcor::Texture::SharedPtr linearZ,
-        Falcor::Texture::SharedPtr normalDepth);
+        Falcor::Texture::SharedPtr normalDepth,
+        Falcor::Texture::SharedPtr rayCounts = nullptr,
+        Falcor::Texture::SharedPtr gradientSamples = nullptr);
+
+    // Reallocates the targets at the new size and drops the history. Nothing happens at the current size.
+    void Resize(uint32_t width, uint32_t height);
 
     void RenderGui(Falcor::Gui* gui);
 
+    // Video memory owned by this filter, not counting the shared history
+    size_t GetAllocatedBytes() const;
+
+    // What AdaptiveSamplingPass reads before this frame's Execute. The history is valid if the filter ran last frame.
+    bool HasValidHistory() const { return mHasHistory && mLastHistoryFrame + 1 == mHistory->GetFrameIndex(); }
+    Falcor::Texture::SharedPtr GetLastFiltered() const { return mLastFilteredFbo->getColorTexture(0); }
+    SignalType GetSignalType() const { return mSignalType; }
+    float GetAlpha() const { return mAlpha; }
+    bool IsTemporalReprojectionEnabled() const { return mEnableTemporalReprojection; }
+
 private:
+    void ComputeTemporalGradient(Falcor::RenderContext* renderContext, Falcor::Texture::SharedPtr gradientSamples);
+    void FilterTemporalGradient(Falcor::RenderContext* renderContext, uint32_t iteration, Falcor::Texture::SharedPtr input, Falcor::Fbo::SharedPtr output);
     void TemporalReprojection(Falcor::RenderContext* renderContext);
     void SpatialVarianceEstimation(Falcor::RenderContext* renderContext);
     void AtrousFilter(Falcor::RenderContext* renderContext, uint32_t iteration, Falcor::Fbo::SharedPtr input, Falcor::Fbo::SharedPtr output);
+    void AtrousFilterCompute(Falcor::RenderContext* renderContext, uint32_t iteration, Falcor::Fbo::SharedPtr input, Falcor::Fbo::SharedPtr output);
+    bool UseComputeAtrous(uint32_t iteration) const;
+    void SetAtrousRadiusDefine();
+    void ReleaseTargets();
+
+    Falcor::FullScreenPass::UniquePtr mTemporalGradientPass;
+    Falcor::GraphicsVars::SharedPtr mTemporalGradientVars;
+    Falcor::GraphicsState::SharedPtr mTemporalGradientState;
+
+    Falcor::FullScreenPass::UniquePtr mGradientAtrousPass;
+    Falcor::GraphicsVars::SharedPtr mGradientAtrousVars;
+    Falcor::GraphicsState::SharedPtr mGradientAtrousState;
 
     Falcor::FullScreenPass::UniquePtr mReprojectionPass;
     Falcor::GraphicsVars::SharedPtr mReprojectionVars;
@@ -34,6 +79,10 @@ private:
     Falcor::GraphicsVars::SharedPtr mAtrousVars;
     Falcor::GraphicsState::SharedPtr mAtrousState;
 
+    Falcor::ComputeProgram::SharedPtr mAtrousComputeProgram;
+    Falcor::ComputeVars::SharedPtr mAtrousComputeVars;
+    Falcor::ComputeState::SharedPtr mAtrousComputeState;
+
     Falcor::Fbo::SharedPtr mAtrousPingFbo;
     Falcor::Fbo::SharedPtr mAtrousPongFbo;
 
@@ -44,17 +93,34 @@ private:
 
     Falcor::Fbo::SharedPtr mOutputFbo;
 
-    Falcor::Texture::SharedPtr mPrevLinearZTexture;
+    // A-SVGF, per stratum. Gradient plus the luminance of the sample each stratum picked, compared against next frame.
+    Falcor::Fbo::SharedPtr mCurrGradientFbo;
+    Falcor::Fbo::SharedPtr mPrevGradientFbo;
+    Falcor::Fbo::SharedPtr mGradientPingFbo;
+    Falcor::Fbo::SharedPtr mGradientPongFbo;
+    Falcor::Texture::SharedPtr mFilteredGradient;   // Of the last Execute() that used gradient samples
+
+    SVGFSharedHistory::SharedPtr mHistory;
+    TexturePool::SharedPtr mTexturePool;
+    SignalType mSignalType;
+    uint64_t mLastHistoryFrame;
+    bool mHasHistory;
+    bool mHistoryReset;
+    uint64_t mLastGradientFrame;
+    bool mHasGradientLuminance;
+    bool mUseGradient;
 
     uint32_t mAtrousIterations;
     uint32_t mFeedbackTap;
     uint32_t mAtrousRadius;
+    AtrousPath mAtrousPath;
     float mAlpha;
     float mMomentsAlpha;
     float mPhiColor;
     float mPhiNormal;
     bool mEnableTemporalReprojection;
     bool mEnableSpatialVarianceEstimation;
+    uint32_t mGradientFilterIterations;
 
     struct
     {
@@ -62,5 +128,6 @@ private:
         Falcor::Texture::SharedPtr linearZ;
         Falcor::Texture::SharedPtr motionVec;
         Falcor::Texture::SharedPtr compactNormalDepth;
+        Falcor::Texture::SharedPtr rayCounts;
     } mGBufferInput;
 };
@@ -0,0 +1,175 @@
+#include "SVGFSharedHistory.h"
+#include "PassProfiler.h"
+
+using namespace Falcor;
+
+namespace
+{
+    // Must match Data/TemporalGradient.h and SVGF_GradientProjection.slang
+    const uint32_t kGradientStratumSize = 3;
+    const uint32_t kGradientTileSize = 8;
+    const uint32_t kNoGradientSample = ~0u;
+}
+
+SVGFSharedHistory::SVGFSharedHistory(uint32_t width, uint32_t height, TexturePool::SharedPtr texturePool)
+    : mTexturePool(texturePool),
+      mFrameIndex(0),
+      mGradientFrameCount(0),
+      mHistoryReset(true),
+      mEnableTemporalGradients(false),
+      mHasGradientSamples(false)
+{
+    mHistoryLengthPass = FullScreenPass::create("SVGF_HistoryLength.slang");
+    mHistoryLengthVars = GraphicsVars::create(mHistoryLengthPass->getProgram()->getReflector());
+    mHistoryLengthState = GraphicsState::create();
+
+    mForwardProjectProgram = ComputeProgram::createFromFile("SVGF_GradientProjection.slang", "ForwardProject");
+    mResolveProgram = ComputeProgram::createFromFile("SVGF_GradientProjection.slang", "Resolve");
+    mForwardProjectVars = ComputeVars::create(mForwardProjectProgram->getReflector());
+    mResolveVars = ComputeVars::create(mResolveProgram->getReflector());
+    mGradientState = ComputeState::create();
+
+    Resize(width, height);
+}
+
+SVGFSharedHistory::~SVGFSharedHistory()
+{
+    ReleaseTargets();
+}
+
+void SVGFSharedHistory::ReleaseTargets()
+{
+    mTexturePool->ReleaseFbo(mCurrHistoryFbo);
+    mTexturePool->ReleaseFbo(mPrevHistoryFbo);
+    mTexturePool->Release(mPrevLinearZTexture);
+    mTexturePool->Release(mGradientClaims);
+    mTexturePool->Release(mCurrGradientSamples);
+    mTexturePool->Release(mPrevGradientSamples);
+}
+
+void SVGFSharedHistory::Resize(uint32_t width, uint32_t height)
+{
+    if (mPrevLinearZTexture && mPrevLinearZTexture->getWidth() == width && mPrevLinearZTexture->getHeight() == height) return;
+
+    ReleaseTargets();
+
+    Fbo::Desc historyFboDesc;
+    historyFboDesc.setColorTarget(0, ResourceFormat::R8Unorm); // History length / HISTORY_LENGTH_SCALE
+
+    mCurrHistoryFbo = mTexturePool->CreateFbo(width, height, historyFboDesc);
+    mPrevHistoryFbo = mTexturePool->CreateFbo(width, height, historyFboDesc);
+    mPrevLinearZTexture = mTexturePool->Acquire(width, height, ResourceFormat::RGBA16Float, ResourceBindFlags::ShaderResource | ResourceBindFlags::RenderTarget);
+
+    const uint32_t strataWidth = (width + kGradientStratumSize - 1) / kGradientStratumSize;
+    const uint32_t strataHeight = (height + kGradientStratumSize - 1) / kGradientStratumSize;
+    const Resource::BindFlags gradientBindFlags = Resource::BindFlags::UnorderedAccess | Resource::BindFlags::ShaderResource;
+    mGradientClaims = mTexturePool->Acquire(strataWidth, strataHeight, ResourceFormat::R32Uint, gradientBindFlags);
+    mCurrGradientSamples = mTexturePool->Acquire(strataWidth, strataHeight, ResourceFormat::RG32Uint, gradientBindFlags);
+    mPrevGradientSamples = mTexturePool->Acquire(strataWidth, strataHeight, ResourceFormat::RG32Uint, gradientBindFlags);
+
+    // Pooled textures hold whatever their last user left. A gap in the frame index also resets every filter.
+    mHistoryReset = true;
+    mHasGradientSamples = false;
+    mFrameIndex++;
+}
+
+void SVGFSharedHistory::Update(RenderContext* renderContext, Texture::SharedPtr motionVec, Texture::SharedPtr linearZ, uint32_t frameCount)
+{
+    mLinearZ = linearZ;
+
+    // A zero previous depth fails every reprojection, which starts the history length over
+    if (mHistoryReset)
+    {
+        renderContext->clearRtv(mPrevLinearZTexture->getRTV().get(), glm::vec4(0.0f));
+        mHistoryReset = false;
+    }
+
+    mHistoryLengthVars->setTexture("gLinearZ", linearZ);
+    mHistoryLengthVars->setTexture("gMotion", motionVec);
+    mHistoryLengthVars->setTexture("gPrevLinearZ", mPrevLinearZTexture);
+    mHistoryLengthVars->setTexture("gPrevHistoryLength", mPrevHistoryFbo->getColorTexture(0));
+
+    mHistoryLengthState->setFbo(mCurrHistoryFbo);
+
+    renderContext->pushGraphicsState(mHistoryLengthState);
+    renderContext->pushGraphicsVars(mHistoryLengthVars);
+    mHistoryLengthPass->execute(renderContext);
+    renderContext->popGraphicsVars();
+    renderContext->popGraphicsState();
+
+    if (mEnableTemporalGradients)
+    {
+        PROFILE_PASS("GradientProjection");
+        ForwardProjectGradientSamples(renderContext, motionVec, linearZ);
+    }
+    mHasGradientSamples = mEnableTemporalGradients;
+    mGradientFrameCount = frameCount;
+}
+
+void SVGFSharedHistory::ForwardProjectGradientSamples(RenderContext* renderContext, Texture::SharedPtr motionVec, Texture::SharedPtr linearZ)
+{
+    const uint32_t groupsX = (mGradientClaims->getWidth() + kGradientTileSize - 1) / kGradientTileSize;
+    const uint32_t groupsY = (mGradientClaims->getHeight() + kGradientTileSize - 1) / kGradientTileSize;
+
+    renderContext->clearUAV(mGradientClaims->getUAV().get(), uvec4(kNoGradientSample));
+
+    // Last frame's samples claim the strata they land in, then every stratum takes its winner's seed
+    for (ComputeVars::SharedPtr vars : { mForwardProjectVars, mResolveVars })
+    {
+        vars->setTexture("gMotion", motionVec);
+        vars->setTexture("gLinearZ", linearZ);
+        vars->setTexture("gPrevLinearZ", mPrevLinearZTexture);
+        vars->setTexture("gPrevSamples", mPrevGradientSamples);
+        vars->setTexture("gClaims", mGradientClaims);
+        vars->setTexture("gSamples", mCurrGradientSamples);
+        vars["PerPassCB"]["gFrameCount"] = mGradientFrameCount;
+        vars["PerPassCB"]["gHasSamples"] = mHasGradientSamples;
+    }
+
+    mGradientState->setProgram(mForwardProjectProgram);
+    renderContext->pushComputeState(mGradientState);
+    renderContext->pushComputeVars(mForwardProjectVars);
+    renderContext->dispatch(groupsX, groupsY, 1);
+    renderContext->popComputeVars();
+    renderContext->popComputeState();
+
+    mGradientState->setProgram(mResolveProgram);
+    renderContext->pushComputeState(mGradientState);
+    renderContext->pushComputeVars(mResolveVars);
+    renderContext->dispatch(groupsX, groupsY, 1);
+    renderContext->popComputeVars();
+    renderContext->popComputeState();
+}
+
+void SVGFSharedHistory::EndFrame(RenderContext* renderContext)
+{
+    std::swap(mCurrHistoryFbo, mPrevHistoryFbo);
+    std::swap(mCurrGradientSamples, mPrevGradientSamples);
+
+    PROFILE_PASS("PrevLinearZBlit");
+    renderContext->blit(mLinearZ->getSRV(), mPrevLinearZTexture->getRTV());
+
+    mFrameIndex++;
+}
+
+size_t SVGFSharedHistory::GetAllocatedBytes() const
+{
+    return GetFboSizeInBytes(mCurrHistoryFbo) + GetFboSizeInBytes(mPrevHistoryFbo) + GetTextureSizeInBytes(mPrevLinearZTexture) +
+        GetTextureSizeInBytes(mGradientClaims) + GetTextureSizeInBytes(mCurrGradientSamples) + GetTextureSizeInBytes(mPrevGradientSamples);
+}
+
+size_t GetTextureSizeInBytes(const Texture::SharedPtr& texture)
+{
+    if (!texture) return 0;
+    return size_t(texture->getWidth()) * texture->getHeight() * texture->getArraySize() * getFormatBytesPerBlock(texture->getFormat());
+}
+
+size_t GetFboSizeInBytes(const Fbo::SharedPtr& fbo)
+{
+    size_t bytes = 0;
+    for (uint32_t i = 0; i < Fbo::getMaxColorTargetCount(); ++i)
+    {
+        bytes += GetTextureSizeInBytes(fbo->getColorTexture(i));
+    }
+    return bytes;
+}
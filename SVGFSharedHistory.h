@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Falcor.h"
+#include "TexturePool.h"
+
+// G-buffer history shared by every SVGFPass: the previous frame's linear Z and the per-pixel history length.
+// Both only depend on the G-buffer, so one copy serves all filters instead of one per filter.
+class SVGFSharedHistory
+{
+public:
+    using SharedPtr = std::shared_ptr<SVGFSharedHistory>;
+
+    SVGFSharedHistory(uint32_t width, uint32_t height, TexturePool::SharedPtr texturePool);
+    ~SVGFSharedHistory();
+
+    // Reallocates the history at the new size and starts it over. Nothing happens at the current size.
+    void Resize(uint32_t width, uint32_t height);
+
+    // Once per frame before the filters run. frameCount is the frame the ray tracers seed this frame's rays with.
+    void Update(Falcor::RenderContext* renderContext, Falcor::Texture::SharedPtr motionVec, Falcor::Texture::SharedPtr linearZ, uint32_t frameCount = 0);
+
+    // Once per frame after the filters ran
+    void EndFrame(Falcor::RenderContext* renderContext);
+
+    // A-SVGF, see Data/TemporalGradient.h. Update() forward projects last frame's gradient samples into this frame.
+    // The samples are for ray tracers launched at full scale and for every SVGFPass::Execute() of the frame.
+    void EnableTemporalGradients(bool enable) { mEnableTemporalGradients = enable; }
+    bool AreTemporalGradientsEnabled() const { return mEnableTemporalGradients; }
+    // RG32Uint (claim, seed) per 3x3 stratum
+    Falcor::Texture::SharedPtr GetGradientSamples() const { return mCurrGradientSamples; }
+    uint32_t GetGradientFrameCount() const { return mGradientFrameCount; }
+
+    Falcor::Texture::SharedPtr GetHistoryLength() const { return mCurrHistoryFbo->getColorTexture(0); }
+    Falcor::Texture::SharedPtr GetPrevLinearZ() const { return mPrevLinearZTexture; }
+
+    // Number of completed frames. A filter that skipped a frame sees a gap and drops its own history.
+    uint64_t GetFrameIndex() const { return mFrameIndex; }
+
+    size_t GetAllocatedBytes() const;
+
+private:
+    void ForwardProjectGradientSamples(Falcor::RenderContext* renderContext, Falcor::Texture::SharedPtr motionVec, Falcor::Texture::SharedPtr linearZ);
+    void ReleaseTargets();
+
+    Falcor::FullScreenPass::UniquePtr mHistoryLengthPass;
+    Falcor::GraphicsVars::SharedPtr mHistoryLengthVars;
+    Falcor::GraphicsState::SharedPtr mHistoryLengthState;
+
+    Falcor::Fbo::SharedPtr mCurrHistoryFbo;
+    Falcor::Fbo::SharedPtr mPrevHistoryFbo;
+    Falcor::Texture::SharedPtr mPrevLinearZTexture;
+    Falcor::Texture::SharedPtr mLinearZ;
+
+    // SVGF_GradientProjection.slang, one thread per stratum
+    Falcor::ComputeProgram::SharedPtr mForwardProjectProgram;
+    Falcor::ComputeProgram::SharedPtr mResolveProgram;
+    Falcor::ComputeVars::SharedPtr mForwardProjectVars;
+    Falcor::ComputeVars::SharedPtr mResolveVars;
+    Falcor::ComputeState::SharedPtr mGradientState;
+
+    Falcor::Texture::SharedPtr mGradientClaims;     // R32Uint, lowest claim wins
+    Falcor::Texture::SharedPtr mCurrGradientSamples;
+    Falcor::Texture::SharedPtr mPrevGradientSamples;
+
+    TexturePool::SharedPtr mTexturePool;
+    uint64_t mFrameIndex;
+    uint32_t mGradientFrameCount;
+    bool mHistoryReset;
+    bool mEnableTemporalGradients;
+    bool mHasGradientSamples;   // Last frame picked samples
+};
+
+// Video memory of a texture's top mip, used for the per-pass allocation reports
+size_t GetTextureSizeInBytes(const Falcor::Texture::SharedPtr& texture);
+size_t GetFboSizeInBytes(const Falcor::Fbo::SharedPtr& fbo);
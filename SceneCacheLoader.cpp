@@ -0,0 +1,559 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <fstream>
+#include <sstream>
+#include "SceneCacheLoader.h"
+#include "Cpu/Timer.h"
+
+using namespace Falcor;
+
+namespace
+{
+    // Vertex and index data created per frame while a cached scene goes up, the frame keeps rendering the old scene meanwhile
+    const size_t kUploadBytesPerFrame = 64 << 20;
+
+    // Blocks until the copy completes, buffers with GPU only access have to go through a staging buffer
+    std::vector<uint8_t> ReadBuffer(RenderContext* renderContext, const Buffer::SharedPtr& buffer)
+    {
+        const size_t size = buffer->getSize();
+        Buffer::SharedPtr staging = Buffer::create(size, Resource::BindFlags::None, Buffer::CpuAccess::Read, nullptr);
+        renderContext->copyResource(staging.get(), buffer.get());
+        renderContext->flush(true);
+
+        std::vector<uint8_t> data(size);
+        std::memcpy(data.data(), staging->map(Buffer::MapType::Read), size);
+        staging->unmap();
+        return data;
+    }
+
+    Cpu::float3 ToFloat3(const glm::vec3& v)
+    {
+        return Cpu::float3(v.x, v.y, v.z);
+    }
+
+    glm::vec3 ToVec3(const Cpu::float3& v)
+    {
+        return glm::vec3(v.x, v.y, v.z);
+    }
+
+    // Models in order, meshes in model order, each mesh once
+    template<typename Fn>
+    void ForEachSceneMesh(const RtScene::SharedPtr& scene, const Fn& fn)
+    {
+        std::vector<const Mesh*> visited;
+        for (uint32_t m = 0; m < scene->getModelCount(); ++m)
+        {
+            const Model::SharedPtr& model = scene->getModel(m);
+            for (uint32_t meshId = 0; meshId < model->getMeshCount(); ++meshId)
+            {
+                const Mesh::SharedPtr& mesh = model->getMesh(meshId);
+                if (std::find(visited.begin(), visited.end(), mesh.get()) != visited.end()) continue;
+                visited.push_back(mesh.get());
+                fn(m, mesh);
+            }
+        }
+    }
+
+    bool HasTextures(const Material::SharedPtr& material)
+    {
+        return material && (material->getBaseColorTexture() || material->getSpecularTexture() || material->getNormalMap() || material->getEmissiveTexture());
+    }
+
+    // Object space attributes of one mesh. Returns ~0u for meshes the SceneData cannot hold.
+    uint32_t ReadMesh(RenderContext* renderContext, const Mesh::SharedPtr& mesh, uint32_t materialId, uint32_t modelId, Cpu::SceneData& data, bool& complete)
+    {
+        const Vao::SharedPtr& vao = mesh->getVao();
+        if (vao->getPrimitiveTopology() != Vao::Topology::TriangleList || !vao->getIndexBuffer()) return ~0u;
+
+        const VertexLayout::SharedPtr& layout = vao->getVertexLayout();
+        std::vector<Cpu::float3> positions, normals, bitangents;
+        std::vector<Cpu::float2> texCoords;
+        for (uint32_t b = 0; b < vao->getVertexBuffersCount(); ++b)
+        {
+            const VertexBufferLayout::SharedConstPtr& bufferLayout = layout->getBufferLayout(b);
+            if (!bufferLayout) continue;
+
+            std::vector<uint8_t> vertexData;
+            for (uint32_t e = 0; e < bufferLayout->getElementCount(); ++e)
+            {
+                const uint32_t location = bufferLayout->getElementShaderLocation(e);
+                const ResourceFormat format = bufferLayout->getElementFormat(e);
+                const bool isFloat3 = format == ResourceFormat::RGB32Float;
+                const bool isTexCoord = location == VERTEX_TEXCOORD_LOC && (format == ResourceFormat::RG32Float || isFloat3);
+                const bool isVector = isFloat3 && (location == VERTEX_POSITION_LOC || location == VERTEX_NORMAL_LOC || location == VERTEX_BITANGENT_LOC);
+                if (!isVector && !isTexCoord) continue;
+
+                if (vertexData.empty()) vertexData = ReadBuffer(renderContext, vao->getVertexBuffer(b));
+                const uint32_t stride = bufferLayout->getStride();
+                const uint32_t offset = bufferLayout->getElementOffset(e);
+                const uint32_t vertexCount = uint32_t(vertexData.size() / stride);
+
+                if (isTexCoord)
+                {
+                    texCoords.resize(vertexCount);
+                    for (uint32_t v = 0; v < vertexCount; ++v) std::memcpy(&texCoords[v], vertexData.data() + size_t(v) * stride + offset, sizeof(Cpu::float2));
+                    continue;
+                }
+
+                std::vector<Cpu::float3>& target = (location == VERTEX_POSITION_LOC) ? positions : (location == VERTEX_NORMAL_LOC ? normals : bitangents);
+                target.resize(vertexCount);
+                for (uint32_t v = 0; v < vertexCount; ++v) std::memcpy(&target[v], vertexData.data() + size_t(v) * stride + offset, sizeof(Cpu::float3));
+            }
+        }
+        if (positions.empty()) return ~0u;
+
+        const std::vector<uint8_t> indexData = ReadBuffer(renderContext, vao->getIndexBuffer());
+        std::vector<uint32_t> indices;
+        if (vao->getIndexBufferFormat() == ResourceFormat::R16Uint)
+        {
+            const uint16_t* src = reinterpret_cast<const uint16_t*>(indexData.data());
+            indices.assign(src, src + indexData.size() / sizeof(uint16_t));
+        }
+        else
+        {
+            const uint32_t* src = reinterpret_cast<const uint32_t*>(indexData.data());
+            indices.assign(src, src + indexData.size() / sizeof(uint32_t));
+        }
+
+        // SceneData holds an attribute for every mesh or for none. The importer writes all four, anything else is
+        // zero filled and keeps the scene out of the cache.
+        const uint32_t vertexCount = uint32_t(positions.size());
+        const bool firstMesh = data.meshes.empty();
+        auto matchAttribute = [&](auto& attribute, bool present)
+        {
+            if (firstMesh || present != attribute.empty()) return;
+            if (present) attribute.resize(vertexCount);
+            else attribute.clear();
+            complete = false;
+        };
+        matchAttribute(normals, !data.normals.empty());
+        matchAttribute(bitangents, !data.bitangents.empty());
+        matchAttribute(texCoords, !data.texCoords.empty());
+
+        return data.AddMesh(positions.data(), normals.empty() ? nullptr : normals.data(), bitangents.empty() ? nullptr : bitangents.data(),
+            texCoords.empty() ? nullptr : texCoords.data(), vertexCount, indices.data(), uint32_t(indices.size()), materialId, modelId);
+    }
+
+    // The fscene and the model files its "file" entries name, resolved the way the importer finds them
+    std::vector<std::string> GetSourceFiles(const std::string& scenePath)
+    {
+        std::vector<std::string> files = { scenePath };
+
+        std::ifstream stream(scenePath);
+        std::stringstream buffer;
+        buffer << stream.rdbuf();
+        const std::string text = buffer.str();
+        const std::string sceneDirectory = getDirectoryFromFile(scenePath);
+
+        size_t position = 0;
+        while ((position = text.find("\"file\"", position)) != std::string::npos)
+        {
+            position = text.find('"', text.find(':', position));
+            if (position == std::string::npos) break;
+
+            std::string path;
+            for (++position; position < text.size() && text[position] != '"'; ++position)
+            {
+                if (text[position] == '\\' && position + 1 < text.size()) ++position;
+                path += text[position];
+            }
+
+            std::string fullPath;
+            if (doesFileExist(path)) fullPath = path;
+            else if (doesFileExist(sceneDirectory + "/" + path)) fullPath = sceneDirectory + "/" + path;
+            else if (!findFileInDataDirectories(path, fullPath)) fullPath = path;
+            files.push_back(fullPath);
+        }
+        return files;
+    }
+
+    Mesh::SharedPtr CreateMesh(const Cpu::SceneView& view, const Cpu::SceneMesh& sceneMesh, const Material::SharedPtr& material)
+    {
+        VertexLayout::SharedPtr layout = VertexLayout::create();
+        Vao::BufferVec vertexBuffers;
+
+        // One buffer per attribute, uploaded straight from the mapping
+        auto addAttribute = [&](const void* data, size_t elementSize, ResourceFormat format, const std::string& name, uint32_t location)
+        {
+            VertexBufferLayout::SharedPtr bufferLayout = VertexBufferLayout::create();
+            bufferLayout->addElement(name, 0, format, 1, location);
+            layout->addBufferLayout(uint32_t(vertexBuffers.size()), bufferLayout);
+            vertexBuffers.push_back(Buffer::create(sceneMesh.vertexCount * elementSize, Resource::BindFlags::Vertex | Resource::BindFlags::ShaderResource,
+                Buffer::CpuAccess::None, data));
+        };
+
+        addAttribute(view.positions.data + sceneMesh.firstVertex, sizeof(Cpu::float3), ResourceFormat::RGB32Float, VERTEX_POSITION_NAME, VERTEX_POSITION_LOC);
+        if (!view.normals.empty())
+        {
+            addAttribute(view.normals.data + sceneMesh.firstVertex, sizeof(Cpu::float3), ResourceFormat::RGB32Float, VERTEX_NORMAL_NAME, VERTEX_NORMAL_LOC);
+        }
+        if (!view.bitangents.empty())
+        {
+            addAttribute(view.bitangents.data + sceneMesh.firstVertex, sizeof(Cpu::float3), ResourceFormat::RGB32Float, VERTEX_BITANGENT_NAME, VERTEX_BITANGENT_LOC);
+        }
+        if (!view.texCoords.empty())
+        {
+            addAttribute(view.texCoords.data + sceneMesh.firstVertex, sizeof(Cpu::float2), ResourceFormat::RG32Float, VERTEX_TEXCOORD_NAME, VERTEX_TEXCOORD_LOC);
+        }
+
+        Buffer::SharedPtr indexBuffer = Buffer::create(sceneMesh.indexCount * sizeof(uint32_t), Resource::BindFlags::Index | Resource::BindFlags::ShaderResource,
+            Buffer::CpuAccess::None, view.indices.data + sceneMesh.firstIndex);
+        const BoundingBox bounds = BoundingBox::fromMinMax(ToVec3(sceneMesh.boundsMin), ToVec3(sceneMesh.boundsMax));
+        return Mesh::create(vertexBuffers, sceneMesh.vertexCount, indexBuffer, sceneMesh.indexCount, layout, Vao::Topology::TriangleList, material, bounds, false);
+    }
+}
+
+// Metal-rough, the convention the material sliders in RaysRenderer use
+Cpu::SceneMaterial ToSceneMaterial(const Material::SharedPtr& material)
+{
+    Cpu::SceneMaterial result;
+    if (!material) return result;
+    result.baseColor = ToFloat3(glm::vec3(material->getBaseColor()));
+    result.linearRoughness = material->getSpecularParams().g;
+    result.metalness = material->getSpecularParams().b;
+    return result;
+}
+
+Cpu::SceneLight ToSceneLight(const Light::SharedPtr& light)
+{
+    const LightData& data = light->getData();
+
+    Cpu::SceneLight result;
+    result.type = (data.type == LightPoint) ? Cpu::SceneLight::Type::Point : Cpu::SceneLight::Type::Directional;
+    result.position = ToFloat3(data.posW);
+    result.direction = ToFloat3(data.dirW);
+    result.intensity = ToFloat3(data.intensity);
+    return result;
+}
+
+std::vector<Mesh::SharedPtr> GetSceneMeshes(const RtScene::SharedPtr& scene)
+{
+    std::vector<Mesh::SharedPtr> meshes;
+    ForEachSceneMesh(scene, [&](uint32_t, const Mesh::SharedPtr& mesh) { meshes.push_back(mesh); });
+    return meshes;
+}
+
+bool ExtractSceneData(RenderContext* renderContext, const RtScene::SharedPtr& scene, Cpu::SceneData& data, std::vector<Mesh::SharedPtr>* meshes)
+{
+    data.Clear();
+    if (meshes) meshes->clear();
+    bool complete = true;
+
+    // One SceneData mesh per scene mesh, materials shared like in the scene
+    std::vector<const Mesh*> sceneMeshes;
+    std::vector<uint32_t> meshIds;
+    std::vector<const Material*> materials;
+    ForEachSceneMesh(scene, [&](uint32_t modelId, const Mesh::SharedPtr& mesh)
+    {
+        const Material::SharedPtr& material = mesh->getMaterial();
+        if (HasTextures(material)) complete = false;
+
+        uint32_t materialId = uint32_t(std::find(materials.begin(), materials.end(), material.get()) - materials.begin());
+        if (materialId == materials.size())
+        {
+            materials.push_back(material.get());
+            data.materials.push_back(ToSceneMaterial(material));
+        }
+
+        const uint32_t meshId = ReadMesh(renderContext, mesh, materialId, modelId, data, complete);
+        if (meshId == ~0u) complete = false;
+        else if (meshes) meshes->push_back(mesh);
+        sceneMeshes.push_back(mesh.get());
+        meshIds.push_back(meshId);
+    });
+
+    for (uint32_t m = 0; m < scene->getModelCount(); ++m)
+    {
+        const Model::SharedPtr& model = scene->getModel(m);
+        for (uint32_t i = 0; i < scene->getModelInstanceCount(m); ++i)
+        {
+            const glm::mat4 modelTransform = scene->getModelInstance(m, i)->getTransformMatrix();
+            for (uint32_t meshIndex = 0; meshIndex < model->getMeshCount(); ++meshIndex)
+            {
+                const uint32_t meshId = meshIds[std::find(sceneMeshes.begin(), sceneMeshes.end(), model->getMesh(meshIndex).get()) - sceneMeshes.begin()];
+                if (meshId == ~0u) continue;
+
+                for (uint32_t j = 0; j < model->getMeshInstanceCount(meshIndex); ++j)
+                {
+                    const glm::mat4 transform = modelTransform * model->getMeshInstance(meshIndex, j)->getTransformMatrix();
+                    Cpu::SceneInstance instance;
+                    instance.meshId = meshId;
+                    std::memcpy(instance.transform, &transform[0][0], sizeof(instance.transform));
+                    data.instances.push_back(instance);
+                }
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < scene->getLightCount(); ++i)
+    {
+        data.lights.push_back(ToSceneLight(scene->getLight(i)));
+    }
+    return complete;
+}
+
+Cpu::SceneLoadRequest SceneCacheLoader::GetRequest() const
+{
+    Cpu::SceneLoadRequest request;
+    request.sourceFiles = mSourceFiles;
+    request.cachePath = mCachePath;
+    return request;
+}
+
+void SceneCacheLoader::BeginLoad(const std::string& filename)
+{
+    std::string scenePath = filename;
+    if (!doesFileExist(scenePath)) findFileInDataDirectories(filename, scenePath);
+
+    mPendingFilename = filename;
+    mSourceFiles = GetSourceFiles(scenePath);
+    mCachePath = scenePath + ".rayscache";
+    mPendingCpuScene.reset();
+    mPendingMaterials.clear();
+    mPendingMeshes.clear();
+    mPendingStats = Stats();
+    mPendingStats.sourceFileCount = uint32_t(mSourceFiles.size());
+    mLoadTimer.Reset();
+
+    mLoader.Start(GetRequest());
+    mState = State::Loading;
+}
+
+SceneCacheLoader::Event SceneCacheLoader::Update(RenderContext* renderContext)
+{
+    return Advance(renderContext, kUploadBytesPerFrame);
+}
+
+RtScene::SharedPtr SceneCacheLoader::Load(RenderContext* renderContext, const std::string& filename)
+{
+    BeginLoad(filename);
+
+    // Nothing is shown yet, so the loader is waited on instead of polled and the meshes go up in one go
+    RtScene::SharedPtr scene;
+    while (mState != State::Idle)
+    {
+        if (mState != State::Uploading) mLoader.Wait();
+        if (Advance(renderContext, SIZE_MAX) == Event::SceneReady) scene = mScene;
+    }
+    return scene;
+}
+
+SceneCacheLoader::Event SceneCacheLoader::Advance(RenderContext* renderContext, size_t uploadBytes)
+{
+    if (mState == State::Loading || mState == State::Finishing)
+    {
+        std::unique_ptr<Cpu::LoadedScene> loaded = mLoader.TakeResult();
+        if (!loaded)
+        {
+            if (!mLoader.IsBusy()) mState = State::Idle;
+            return Event::None;
+        }
+        if (mState == State::Finishing) return OnFinished(std::move(loaded));
+
+        const Event event = OnLoaded(renderContext, std::move(loaded));
+        if (mState != State::Uploading) return event;
+    }
+
+    if (mState == State::Uploading)
+    {
+        Cpu::Timer timer;
+        const bool uploaded = UploadMeshes(uploadBytes);
+        if (uploaded) mScene = CreateScene();
+        mPendingStats.uploadMs += timer.GetElapsedMs();
+        mPendingStats.uploadFrames++;
+        if (!uploaded) return Event::None;
+
+        mFilename = mPendingFilename;
+        mCpuScene = std::move(mPendingCpuScene);
+        mPendingMaterials.clear();
+        mPendingMeshes.clear();
+        mStats = mPendingStats;
+        mStats.totalMs = mLoadTimer.GetElapsedMs();
+        mState = State::Idle;
+        return Event::SceneReady;
+    }
+    return Event::None;
+}
+
+SceneCacheLoader::Event SceneCacheLoader::OnLoaded(RenderContext* renderContext, std::unique_ptr<Cpu::LoadedScene> loaded)
+{
+    std::copy(std::begin(loaded->stageMs), std::end(loaded->stageMs), std::begin(mPendingStats.stageMs));
+    mPendingStats.cacheStatus = loaded->cacheStatus;
+    if (loaded->needsParse) return ParseScene(renderContext);
+    if (!loaded->succeeded)
+    {
+        logError("SceneCacheLoader: cannot load '" + mPendingFilename + "'");
+        mState = State::Idle;
+        return Event::None;
+    }
+
+    mPendingStats.fromCache = true;
+    mPendingStats.cacheBytes = loaded->cache->GetSizeInBytes();
+    mPendingCpuScene = std::move(loaded);
+
+    const Cpu::SceneView& view = mPendingCpuScene->view;
+    for (uint32_t i = 0; i < view.materials.count; ++i)
+    {
+        const Cpu::SceneMaterial& sceneMaterial = view.materials[i];
+        Material::SharedPtr material = Material::create("Material" + std::to_string(i));
+        material->setShadingModel(ShadingModelMetalRough);
+        material->setBaseColor(glm::vec4(ToVec3(sceneMaterial.baseColor), 1.0f));
+        material->setSpecularParams(glm::vec4(0.0f, sceneMaterial.linearRoughness, sceneMaterial.metalness, 0.0f));
+        mPendingMaterials.push_back(material);
+    }
+    mState = State::Uploading;
+    return Event::None;
+}
+
+SceneCacheLoader::Event SceneCacheLoader::ParseScene(RenderContext* renderContext)
+{
+    Cpu::Timer timer;
+    RtScene::SharedPtr scene = RtScene::loadFromFile(mPendingFilename, RtBuildFlags::None, Model::LoadFlags::None, Scene::LoadFlags::None);
+    if (!scene)
+    {
+        logError("SceneCacheLoader: cannot load '" + mPendingFilename + "'");
+        mState = State::Idle;
+        return Event::None;
+    }
+
+    // Read back before the renderer replaces any materials, so the cache holds what the files describe. The BVH and
+    // the cache are built on the loader thread while the scene is already shown.
+    std::shared_ptr<Cpu::SceneData> data = std::make_shared<Cpu::SceneData>();
+    const bool complete = ExtractSceneData(renderContext, scene, *data);
+    mPendingStats.parseMs = timer.GetElapsedMs();
+
+    mScene = scene;
+    mFilename = mPendingFilename;
+    mCpuScene.reset();
+    mStats = mPendingStats;
+    mStats.totalMs = mLoadTimer.GetElapsedMs();
+    mState = State::Idle;
+
+    if (complete)
+    {
+        Cpu::SceneLoadRequest request = GetRequest();
+        request.data = data;
+        mLoader.Start(request);
+        mState = State::Finishing;
+    }
+    else
+    {
+        logInfo("SceneCacheLoader: '" + mPendingFilename + "' has textured materials or unsupported meshes and is not cached");
+    }
+    return Event::SceneReady;
+}
+
+SceneCacheLoader::Event SceneCacheLoader::OnFinished(std::unique_ptr<Cpu::LoadedScene> loaded)
+{
+    mState = State::Idle;
+    if (!loaded->succeeded) return Event::None;
+
+    for (uint32_t i = 0; i < Cpu::kSceneLoadStageCount; ++i) mStats.stageMs[i] += loaded->stageMs[i];
+    if (loaded->cacheWritten) mStats.cacheBytes = loaded->cache->GetSizeInBytes();
+    else logWarning("SceneCacheLoader: cannot write '" + mCachePath + "'");
+
+    mCpuScene = std::move(loaded);
+    return Event::CpuSceneReady;
+}
+
+bool SceneCacheLoader::UploadMeshes(size_t byteBudget)
+{
+    const Cpu::SceneView& view = mPendingCpuScene->view;
+    const size_t vertexBytes = sizeof(Cpu::float3) * ((view.normals.empty() ? 1 : 2) + (view.bitangents.empty() ? 0 : 1)) +
+        (view.texCoords.empty() ? 0 : sizeof(Cpu::float2));
+
+    // At least one mesh per call, so a mesh larger than the budget still goes through
+    size_t uploadedBytes = 0;
+    while (mPendingMeshes.size() < view.meshes.count && uploadedBytes < byteBudget)
+    {
+        const Cpu::SceneMesh& sceneMesh = view.meshes[uint32_t(mPendingMeshes.size())];
+        mPendingMeshes.push_back(CreateMesh(view, sceneMesh, mPendingMaterials[sceneMesh.materialId]));
+        uploadedBytes += sceneMesh.vertexCount * vertexBytes + sceneMesh.indexCount * sizeof(uint32_t);
+    }
+    return mPendingMeshes.size() == view.meshes.count;
+}
+
+RtScene::SharedPtr SceneCacheLoader::CreateScene()
+{
+    const Cpu::SceneView& view = mPendingCpuScene->view;
+
+    // Models keep their fscene order so getModel(i) means the same as after a cold load. Every mesh instance carries
+    // the combined transform and each model gets a single identity instance.
+    std::vector<Model::SharedPtr> models;
+    for (const Cpu::SceneMesh& sceneMesh : view.meshes)
+    {
+        if (sceneMesh.modelId >= models.size()) models.resize(sceneMesh.modelId + 1);
+        if (!models[sceneMesh.modelId]) models[sceneMesh.modelId] = Model::create();
+    }
+    for (const Cpu::SceneInstance& instance : view.instances)
+    {
+        glm::mat4 transform;
+        std::memcpy(&transform[0][0], instance.transform, sizeof(instance.transform));
+        models[view.meshes[instance.meshId].modelId]->addMeshInstance(mPendingMeshes[instance.meshId], transform);
+    }
+
+    RtScene::SharedPtr scene = RtScene::create(RtBuildFlags::None);
+    for (uint32_t m = 0; m < models.size(); ++m)
+    {
+        if (models[m]) scene->addModelInstance(RtModel::createFromModel(*models[m], RtBuildFlags::None), "Model" + std::to_string(m));
+    }
+
+    for (const Cpu::SceneLight& sceneLight : view.lights)
+    {
+        if (sceneLight.type == Cpu::SceneLight::Type::Point)
+        {
+            PointLight::SharedPtr light = PointLight::create();
+            light->setWorldPosition(ToVec3(sceneLight.position));
+            light->setIntensity(ToVec3(sceneLight.intensity));
+            scene->addLight(light);
+        }
+        else
+        {
+            DirectionalLight::SharedPtr light = DirectionalLight::create();
+            light->setWorldDirection(ToVec3(sceneLight.direction));
+            light->setIntensity(ToVec3(sceneLight.intensity));
+            scene->addLight(light);
+        }
+    }
+    return scene;
+}
+
+void SceneCacheLoader::RenderGui(Gui* gui)
+{
+    if (mState == State::Uploading)
+    {
+        gui->addText(("Loading " + getFilenameFromPath(mPendingFilename) + ": creating meshes, " + std::to_string(mPendingMeshes.size()) + " of " +
+            std::to_string(mPendingCpuScene->view.meshes.count)).c_str());
+    }
+    else if (mState == State::Loading || mState == State::Finishing)
+    {
+        const Cpu::SceneLoadProgress progress = mLoader.GetProgress();
+        const std::string what = mState == State::Loading ? "Loading " + getFilenameFromPath(mPendingFilename) : std::string("Caching");
+        gui->addText((what + ": " + Cpu::GetSceneLoadStageName(progress.stage) +
+            (progress.stageFraction > 0.0f ? " " + std::to_string(int(progress.stageFraction * 100.0f)) + "%" : std::string()) + ", " +
+            std::to_string(int(progress.elapsedMs)) + " ms").c_str());
+    }
+
+    if (!mScene) return;
+    if (mStats.fromCache)
+    {
+        gui->addText(("Loaded from cache: " + std::to_string(mStats.totalMs) + " ms, " + std::to_string(mStats.cacheBytes >> 20) + " MB, meshes created over " +
+            std::to_string(mStats.uploadFrames) + " frames in " + std::to_string(mStats.uploadMs) + " ms").c_str());
+    }
+    else
+    {
+        gui->addText(("Parsed: " + std::to_string(mStats.parseMs) + " ms, cache " + Cpu::GetSceneCacheStatusName(mStats.cacheStatus) +
+            (mCpuScene && mCpuScene->cacheWritten ? std::string(", rewritten") : std::string(", not written"))).c_str());
+    }
+
+    std::string stages = "Loader thread:";
+    for (uint32_t i = 0; i < Cpu::kSceneLoadStageCount; ++i)
+    {
+        if (mStats.stageMs[i] > 0.0) stages += " " + std::string(Cpu::GetSceneLoadStageName(Cpu::SceneLoadStage(i))) + " " + std::to_string(mStats.stageMs[i]) + " ms,";
+    }
+    stages.pop_back();
+    gui->addText(stages.c_str());
+    gui->addText(("Source hash: " + std::to_string(mStats.sourceFileCount) + " files").c_str());
+}
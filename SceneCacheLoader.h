@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Falcor.h"
+#include "FalcorExperimental.h"
+#include "Cpu/AsyncSceneLoader.h"
+#include "Cpu/Timer.h"
+
+// Loads .fscene files through a binary cache next to them, <scene>.rayscache. A cold start parses the fscene and its
+// models with Falcor, reads the meshes back and writes the flattened vertex and index buffers, instance transforms,
+// material constants, lights and a prebuilt Cpu::Bvh into the cache. Later starts map the cache and create the meshes
+// straight from the mapping without opening the FBX files. The cache is keyed by a hash of the fscene and every model
+// file it references, so editing any of them rebuilds it on the next load. DXR acceleration structures are rebuilt
+// by the driver either way, only the CPU BVH is stored.
+//
+// BeginLoad() returns at once and the scene being shown keeps rendering. Hashing, mapping the cache, expanding the
+// instances for the CPU ray tracer and the BVH run on a Cpu::AsyncSceneLoader thread. Falcor creates and uploads
+// resources through the render context, which is not thread safe, so the GPU side happens in Update() at the start of
+// a frame: a few meshes per frame up to an upload budget, then the scene is handed over in one piece. A cold load
+// parses on the render thread, the importer needs the device, and leaves the BVH build and cache write to the loader.
+class SceneCacheLoader
+{
+public:
+    enum class Event
+    {
+        None = 0,
+        SceneReady,         // GetScene() is a new scene, to be swapped in before this frame renders
+        CpuSceneReady       // GetCpuScene() now describes GetScene(), after the background half of a cold load
+    };
+
+    struct Stats
+    {
+        bool fromCache = false;
+        Cpu::SceneCache::Status cacheStatus = Cpu::SceneCache::Status::Missing;
+        uint32_t sourceFileCount = 0;
+        double stageMs[Cpu::kSceneLoadStageCount] = {};     // On the loader thread
+        double parseMs = 0.0;                               // Falcor import on the render thread, cold loads only
+        double uploadMs = 0.0;                              // Mesh creation on the render thread
+        uint32_t uploadFrames = 0;
+        double totalMs = 0.0;                               // From BeginLoad() to SceneReady
+        size_t cacheBytes = 0;
+    };
+
+    // Replaces any load in flight
+    void BeginLoad(const std::string& filename);
+    // Once per frame on the render thread, before anything uses the scene
+    Event Update(Falcor::RenderContext* renderContext);
+    // Blocks until the scene and its CPU side are ready, for the first scene
+    Falcor::RtScene::SharedPtr Load(Falcor::RenderContext* renderContext, const std::string& filename);
+
+    bool IsLoading() const { return mState == State::Loading || mState == State::Uploading; }
+
+    // The scene the last SceneReady announced, and the file it came from
+    const Falcor::RtScene::SharedPtr& GetScene() const { return mScene; }
+    const std::string& GetFilename() const { return mFilename; }
+    // Its triangles and BVH for CpuRaytracingBackend, null when the scene could not be cached or is still being processed
+    const std::shared_ptr<Cpu::LoadedScene>& GetCpuScene() const { return mCpuScene; }
+    const Stats& GetStats() const { return mStats; }
+
+    void RenderGui(Falcor::Gui* gui);
+
+private:
+    enum class State
+    {
+        Idle = 0,
+        Loading,            // Loader thread, or the Falcor import of a cold load
+        Uploading,          // Creating the meshes of a cached scene
+        Finishing           // Loader thread building the BVH and cache of a scene already handed over
+    };
+
+    Cpu::SceneLoadRequest GetRequest() const;
+    Event Advance(Falcor::RenderContext* renderContext, size_t uploadBytes);
+    Event OnLoaded(Falcor::RenderContext* renderContext, std::unique_ptr<Cpu::LoadedScene> loaded);
+    Event ParseScene(Falcor::RenderContext* renderContext);
+    Event OnFinished(std::unique_ptr<Cpu::LoadedScene> loaded);
+    // True once every mesh exists; stops after byteBudget bytes of vertex and index data
+    bool UploadMeshes(size_t byteBudget);
+    Falcor::RtScene::SharedPtr CreateScene();
+
+    Cpu::AsyncSceneLoader mLoader;
+    State mState = State::Idle;
+    Cpu::Timer mLoadTimer;
+
+    // The load in flight
+    std::string mPendingFilename;
+    std::vector<std::string> mSourceFiles;
+    std::string mCachePath;
+    std::shared_ptr<Cpu::LoadedScene> mPendingCpuScene;
+    std::vector<Falcor::Material::SharedPtr> mPendingMaterials;
+    std::vector<Falcor::Mesh::SharedPtr> mPendingMeshes;
+    Stats mPendingStats;
+
+    Falcor::RtScene::SharedPtr mScene;
+    std::string mFilename;
+    std::shared_ptr<Cpu::LoadedScene> mCpuScene;
+    Stats mStats;
+};
+
+// Every mesh of the scene once, models in order and meshes in model order. The mesh ids of a complete ExtractSceneData()
+// and of a scene created from a cache follow this order.
+std::vector<Falcor::Mesh::SharedPtr> GetSceneMeshes(const Falcor::RtScene::SharedPtr& scene);
+
+// Reads the meshes back from the GPU into object space SceneData, one SceneInstance per model instance and mesh instance.
+// Triangle lists with RGB32Float positions only, the layout the model importer creates; anything else is skipped.
+// Returns false when the scene has something a cache cannot hold, e.g. textured materials. meshes receives the scene
+// mesh of every SceneData mesh.
+bool ExtractSceneData(Falcor::RenderContext* renderContext, const Falcor::RtScene::SharedPtr& scene, Cpu::SceneData& data,
+    std::vector<Falcor::Mesh::SharedPtr>* meshes = nullptr);
+
+Cpu::SceneMaterial ToSceneMaterial(const Falcor::Material::SharedPtr& material);
+Cpu::SceneLight ToSceneLight(const Falcor::Light::SharedPtr& light);
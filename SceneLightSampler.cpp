@@ -0,0 +1,94 @@
+#include "SceneLightSampler.h"
+#include "SceneCacheLoader.h"
+
+using namespace Falcor;
+
+namespace
+{
+    // Must match LoadSampledLight() in Data/LightSampling.h
+    struct GpuLight
+    {
+        vec3 posW;
+        uint32_t type;
+        vec3 dirW;
+        float pad0;
+        vec3 intensity;
+        float pad1;
+    };
+
+    static_assert(sizeof(GpuLight) == 48, "GpuLight must be 3 float4");
+    static_assert(sizeof(Cpu::LightAliasEntry) == 16, "LightAliasEntry must be one uint4");
+
+    bool IsSame(const Cpu::float3& a, const Cpu::float3& b)
+    {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    }
+
+    bool IsSameLight(const Cpu::SceneLight& a, const Cpu::SceneLight& b)
+    {
+        return a.type == b.type && IsSame(a.position, b.position) && IsSame(a.direction, b.direction) && IsSame(a.intensity, b.intensity);
+    }
+}
+
+bool SceneLightSampler::Update(const Scene::SharedPtr& scene)
+{
+    const uint32_t lightCount = scene ? scene->getLightCount() : 0;
+
+    bool changed = lightCount != mLights.size();
+    mLights.resize(lightCount);
+    for (uint32_t i = 0; i < lightCount; ++i)
+    {
+        const Cpu::SceneLight light = ToSceneLight(scene->getLight(i));
+        changed |= !IsSameLight(light, mLights[i]);
+        mLights[i] = light;
+    }
+    if (!changed) return false;
+
+    std::vector<float> weights(lightCount);
+    std::vector<GpuLight> gpuLights(lightCount);
+    for (uint32_t i = 0; i < lightCount; ++i)
+    {
+        const LightData& data = scene->getLight(i)->getData();
+        weights[i] = Cpu::GetLightSelectionWeight(mLights[i]);
+        gpuLights[i].posW = data.posW;
+        gpuLights[i].type = data.type;
+        gpuLights[i].dirW = data.dirW;
+        gpuLights[i].intensity = data.intensity;
+    }
+    mSampler.Build(weights);
+
+    if (lightCount == 0)
+    {
+        mLightBuffer = nullptr;
+        mAliasTable = nullptr;
+        return true;
+    }
+
+    // Recreated with the data rather than updated, the lights rarely change
+    mLightBuffer = Buffer::create(gpuLights.size() * sizeof(GpuLight), Resource::BindFlags::ShaderResource, Buffer::CpuAccess::None, gpuLights.data());
+    mAliasTable = Buffer::create(mSampler.GetEntries().size() * sizeof(Cpu::LightAliasEntry), Resource::BindFlags::ShaderResource,
+        Buffer::CpuAccess::None, mSampler.GetEntries().data());
+    return true;
+}
+
+size_t SceneLightSampler::GetAllocatedBytes() const
+{
+    return (mLightBuffer ? mLightBuffer->getSize() : 0) + (mAliasTable ? mAliasTable->getSize() : 0);
+}
+
+void SceneLightSampler::RenderGui(Gui* gui)
+{
+    gui->addText(("Lights: " + std::to_string(mLights.size()) + ", table built in " + std::to_string(mSampler.GetBuildMs()) + " ms").c_str());
+    gui->addText(("Allocated: " + std::to_string(GetAllocatedBytes() / 1024) + " KB").c_str());
+
+    // The most likely light, to spot a light that takes all the samples
+    uint32_t mostLikely = 0;
+    for (uint32_t i = 1; i < mSampler.GetLightCount(); ++i)
+    {
+        if (mSampler.GetPdf(i) > mSampler.GetPdf(mostLikely)) mostLikely = i;
+    }
+    if (mSampler.GetLightCount() > 0)
+    {
+        gui->addText(("Most likely: light " + std::to_string(mostLikely) + ", pdf " + std::to_string(mSampler.GetPdf(mostLikely))).c_str());
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Falcor.h"
+#include "Cpu/LightSampling.h"
+
+// Uploads every light of the scene and a Cpu::LightSampler alias table over them for Data/LightSampling.h, so the
+// ray tracing shaders can pick one light per shading point instead of looping over gLights. Update() only rebuilds
+// and uploads when a light was added or changed since the last call.
+class SceneLightSampler
+{
+public:
+    using SharedPtr = std::shared_ptr<SceneLightSampler>;
+
+    // Returns true if the lights changed
+    bool Update(const Falcor::Scene::SharedPtr& scene);
+
+    void RenderGui(Falcor::Gui* gui);
+
+    uint32_t GetLightCount() const { return uint32_t(mLights.size()); }
+
+    // 3 float4 per light, posW and type, dirW, intensity. nullptr without lights.
+    Falcor::Buffer::SharedPtr GetLights() const { return mLightBuffer; }
+    // One Cpu::LightAliasEntry per light
+    Falcor::Buffer::SharedPtr GetAliasTable() const { return mAliasTable; }
+
+    size_t GetAllocatedBytes() const;
+
+private:
+    std::vector<Cpu::SceneLight> mLights;
+    Cpu::LightSampler mSampler;
+    Falcor::Buffer::SharedPtr mLightBuffer;
+    Falcor::Buffer::SharedPtr mAliasTable;
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Falcor.h"
+#include "TexturePool.h"
 
 class TAA
 {
@@ -8,10 +9,18 @@ public:
     Falcor::TemporalAA::SharedPtr pTAA;
     Falcor::Fbo::SharedPtr getActiveFbo() { return pTAAFbos[activeFboIndex]; }
     Falcor::Fbo::SharedPtr getInactiveFbo()  { return pTAAFbos[1 - activeFboIndex]; }
-    void createFbos(uint32_t width, uint32_t height, const Falcor::Fbo::Desc & fboDesc)
+    void createFbos(TexturePool& texturePool, uint32_t width, uint32_t height, const Falcor::Fbo::Desc & fboDesc)
     {
-        pTAAFbos[0] = Falcor::FboHelper::create2D(width, height, fboDesc);
-        pTAAFbos[1] = Falcor::FboHelper::create2D(width, height, fboDesc);
+        releaseFbos(texturePool);
+        pTAAFbos[0] = texturePool.CreateFbo(width, height, fboDesc);
+        pTAAFbos[1] = texturePool.CreateFbo(width, height, fboDesc);
+    }
+
+    void releaseFbos(TexturePool& texturePool)
+    {
+        texturePool.ReleaseFbo(pTAAFbos[0]);
+        texturePool.ReleaseFbo(pTAAFbos[1]);
+        resetFbos();
     }
 
     void switchFbos() { activeFboIndex = 1 - activeFboIndex; }
@@ -0,0 +1,90 @@
+#include "TexturePool.h"
+
+using namespace Falcor;
+
+namespace
+{
+    // Long enough to cover resizing a window back and forth
+    const uint32_t kMaxIdleFrames = 120;
+
+    Cpu::TextureDesc GetTextureDesc(uint32_t width, uint32_t height, ResourceFormat format, Resource::BindFlags bindFlags)
+    {
+        Cpu::TextureDesc desc;
+        desc.width = width;
+        desc.height = height;
+        desc.format = (uint32_t)format;
+        desc.bindFlags = (uint32_t)bindFlags;
+        desc.bytesPerPixel = getFormatBytesPerBlock(format);
+        return desc;
+    }
+}
+
+TexturePool::TexturePool()
+    : mPool([](const Cpu::TextureDesc& desc)
+      {
+          return Texture::create2D(desc.width, desc.height, (ResourceFormat)desc.format, 1, 1, nullptr, (Resource::BindFlags)desc.bindFlags);
+      }),
+      mFrameStartAllocationCount(0),
+      mFrameAllocationCount(0)
+{
+}
+
+Texture::SharedPtr TexturePool::Acquire(uint32_t width, uint32_t height, ResourceFormat format, Resource::BindFlags bindFlags)
+{
+    return mPool.Acquire(GetTextureDesc(width, height, format, bindFlags));
+}
+
+void TexturePool::Release(const Texture::SharedPtr& texture)
+{
+    mPool.Release(texture);
+}
+
+Fbo::SharedPtr TexturePool::CreateFbo(uint32_t width, uint32_t height, const Fbo::Desc& desc)
+{
+    Fbo::SharedPtr fbo = Fbo::create();
+
+    for (uint32_t i = 0; i < Fbo::getMaxColorTargetCount(); ++i)
+    {
+        const ResourceFormat format = desc.getColorTargetFormat(i);
+        if (format == ResourceFormat::Unknown) continue;
+
+        Resource::BindFlags bindFlags = Resource::BindFlags::RenderTarget | Resource::BindFlags::ShaderResource;
+        if (desc.isColorTargetUav(i)) bindFlags |= Resource::BindFlags::UnorderedAccess;
+        fbo->attachColorTarget(Acquire(width, height, format, bindFlags), i);
+    }
+
+    const ResourceFormat depthFormat = desc.getDepthStencilFormat();
+    if (depthFormat != ResourceFormat::Unknown)
+    {
+        Resource::BindFlags bindFlags = Resource::BindFlags::DepthStencil | Resource::BindFlags::ShaderResource;
+        fbo->attachDepthStencilTarget(Acquire(width, height, depthFormat, bindFlags));
+    }
+
+    return fbo;
+}
+
+void TexturePool::ReleaseFbo(const Fbo::SharedPtr& fbo)
+{
+    if (!fbo) return;
+
+    for (uint32_t i = 0; i < Fbo::getMaxColorTargetCount(); ++i)
+    {
+        Release(fbo->getColorTexture(i));
+    }
+    Release(fbo->getDepthStencilTexture());
+}
+
+void TexturePool::EndFrame()
+{
+    mFrameAllocationCount = mPool.GetAllocationCount() - mFrameStartAllocationCount;
+    mFrameStartAllocationCount = mPool.GetAllocationCount();
+    mPool.EndFrame(kMaxIdleFrames);
+}
+
+void TexturePool::RenderGui(Gui* gui)
+{
+    gui->addText(("Pooled textures: " + std::to_string(mPool.GetResourceCount()) + " (" + std::to_string(mPool.GetInUseCount()) + " in use), " +
+        std::to_string(GetResidentBytes() >> 20) + " MB").c_str());
+    gui->addText(("Allocations: " + std::to_string(GetAllocationCount()) + ", reused: " + std::to_string(mPool.GetReuseCount()) +
+        ", last frame: " + std::to_string(mFrameAllocationCount)).c_str());
+}
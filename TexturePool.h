@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Falcor.h"
+#include "Cpu/ResourcePool.h"
+
+// Every size dependent texture of the renderer comes from here. Textures released on a resize, a scene load or
+// a render graph recompile are reused by the next request for the same format, size and bind flags, and freed
+// once they stayed unused for a while.
+class TexturePool
+{
+public:
+    using SharedPtr = std::shared_ptr<TexturePool>;
+
+    TexturePool();
+
+    Falcor::Texture::SharedPtr Acquire(uint32_t width, uint32_t height, Falcor::ResourceFormat format, Falcor::Resource::BindFlags bindFlags);
+    void Release(const Falcor::Texture::SharedPtr& texture);
+
+    // Same targets as FboHelper::create2D, backed by pooled textures
+    Falcor::Fbo::SharedPtr CreateFbo(uint32_t width, uint32_t height, const Falcor::Fbo::Desc& desc);
+    void ReleaseFbo(const Falcor::Fbo::SharedPtr& fbo);
+
+    // Once per frame
+    void EndFrame();
+
+    // Texture::create2D calls during the last frame, zero in steady state
+    uint64_t GetFrameAllocationCount() const { return mFrameAllocationCount; }
+    uint64_t GetAllocationCount() const { return mPool.GetAllocationCount(); }
+    uint64_t GetResidentBytes() const { return mPool.GetResidentBytes(); }
+
+    void RenderGui(Falcor::Gui* gui);
+
+private:
+    Cpu::ResourcePool<Falcor::Texture> mPool;
+    uint64_t mFrameStartAllocationCount;
+    uint64_t mFrameAllocationCount;
+};
@@ -0,0 +1,102 @@
+#include <cstring>
+#include "TextureReadback.h"
+
+using namespace Falcor;
+
+namespace
+{
+    uint8_t ToUnorm8(float value)
+    {
+        return uint8_t(Cpu::saturate(value) * 255.0f + 0.5f);
+    }
+}
+
+bool ReadTexture(RenderContext* renderContext, const Texture::SharedPtr& texture, Cpu::Image4F& image)
+{
+    const uint32_t width = texture->getWidth();
+    const uint32_t height = texture->getHeight();
+    const ResourceFormat format = texture->getFormat();
+    const std::vector<uint8_t> data = renderContext->readTextureSubresource(texture.get(), 0);
+
+    image.Resize(width, height);
+    if (data.empty()) return false;
+    const size_t rowPitch = data.size() / height;
+
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const uint8_t* src = data.data() + rowPitch * y;
+        float* dst = reinterpret_cast<float*>(image.GetRow(y));
+
+        for (uint32_t x = 0; x < width; ++x, dst += 4)
+        {
+            switch (format)
+            {
+            case ResourceFormat::RGBA32Float:
+                std::memcpy(dst, src + x * 16, 16);
+                break;
+            case ResourceFormat::RGBA16Float:
+            {
+                const uint16_t* texel = reinterpret_cast<const uint16_t*>(src + x * 8);
+                for (uint32_t c = 0; c < 4; ++c) dst[c] = Cpu::f16tof32(texel[c]);
+                break;
+            }
+            case ResourceFormat::RGBA8Unorm:
+                for (uint32_t c = 0; c < 4; ++c) dst[c] = src[x * 4 + c] / 255.0f;
+                break;
+            case ResourceFormat::R8Unorm:
+                dst[0] = src[x] / 255.0f;
+                dst[1] = 0.0f;
+                dst[2] = 0.0f;
+                dst[3] = 1.0f;
+                break;
+            default:
+                logError("ReadTexture: unsupported texture format " + to_string(format));
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool WriteTexture(RenderContext* renderContext, const Cpu::Image4F& image, const Texture::SharedPtr& texture)
+{
+    const uint32_t width = texture->getWidth();
+    const uint32_t height = texture->getHeight();
+    const ResourceFormat format = texture->getFormat();
+    if (image.GetWidth() != width || image.GetHeight() != height) return false;
+
+    std::vector<uint8_t> data(size_t(width) * height * getFormatBytesPerBlock(format));
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const Cpu::float4* src = image.GetRow(y);
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            const size_t texel = size_t(y) * width + x;
+            switch (format)
+            {
+            case ResourceFormat::RGBA32Float:
+                std::memcpy(data.data() + texel * 16, &src[x], 16);
+                break;
+            case ResourceFormat::RGBA16Float:
+            {
+                uint16_t* dst = reinterpret_cast<uint16_t*>(data.data() + texel * 8);
+                for (int c = 0; c < 4; ++c) dst[c] = uint16_t(Cpu::f32tof16(src[x][c]));
+                break;
+            }
+            case ResourceFormat::RGBA8Unorm:
+                for (int c = 0; c < 4; ++c) data[texel * 4 + c] = ToUnorm8(src[x][c]);
+                break;
+            case ResourceFormat::R8Unorm:
+                data[texel] = ToUnorm8(src[x].x);
+                break;
+            default:
+                logError("WriteTexture: unsupported texture format " + to_string(format));
+                return false;
+            }
+        }
+    }
+
+    renderContext->updateTextureData(texture.get(), data.data());
+    return true;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Falcor.h"
+#include "Cpu/Image.h"
+
+// Texture <-> Cpu::Image4F conversion for the CPU side of the renderer. Both block until the copy completes.
+// Single channel formats map to .x, reads expand to float4 the same way a Texture2D load would.
+bool ReadTexture(Falcor::RenderContext* renderContext, const Falcor::Texture::SharedPtr& texture, Cpu::Image4F& image);
+bool WriteTexture(Falcor::RenderContext* renderContext, const Cpu::Image4F& image, const Falcor::Texture::SharedPtr& texture);